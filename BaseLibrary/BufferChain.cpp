@@ -0,0 +1,391 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: BufferChain.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// // Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "BufferChain.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// BufferBlock
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Copy of a buffer. Like all FileBuffer parts it ends in two zero bytes (UTF-16)
+BufferBlock*
+BufferBlock::CreateCopy(const uchar* p_buffer,size_t p_length)
+{
+  uchar* buffer = new uchar[p_length + 2];
+  if(p_length)
+  {
+    memcpy(buffer,p_buffer,p_length);
+  }
+  buffer[p_length    ] = 0;
+  buffer[p_length + 1] = 0;
+  return CreateOwned(buffer,p_length);
+}
+
+// Take over a buffer allocated with 'new uchar[]'
+BufferBlock*
+BufferBlock::CreateOwned(uchar* p_buffer,size_t p_length)
+{
+  BufferBlock* block = new BufferBlock();
+  block->m_kind   = BufferKind::BK_Memory;
+  block->m_data   = p_buffer;
+  block->m_length = p_length;
+  return block;
+}
+
+// Reference memory of someone else
+BufferBlock*
+BufferBlock::CreateReference(const uchar* p_buffer,size_t p_length,LPFN_BUFFERRELEASE p_release,void* p_context)
+{
+  BufferBlock* block = new BufferBlock();
+  block->m_kind    = BufferKind::BK_Reference;
+  block->m_data    = p_buffer;
+  block->m_length  = p_length;
+  block->m_release = p_release;
+  block->m_context = p_context;
+  return block;
+}
+
+// Region of an open file
+BufferBlock*
+BufferBlock::CreateFileRegion(HANDLE p_file,ULONGLONG p_offset,ULONGLONG p_length,bool p_owner)
+{
+  BufferBlock* block = new BufferBlock();
+  block->m_kind   = BufferKind::BK_File;
+  block->m_file   = p_file;
+  block->m_offset = p_offset;
+  block->m_length = p_length;
+  block->m_owner  = p_owner;
+  return block;
+}
+
+BufferBlock::~BufferBlock()
+{
+  switch(m_kind)
+  {
+    case BufferKind::BK_Memory:     delete [] m_data;
+                                    break;
+    case BufferKind::BK_Reference:  if(m_release)
+                                    {
+                                      (*m_release)(m_context);
+                                    }
+                                    break;
+    case BufferKind::BK_File:       if(m_owner && m_file && m_file != INVALID_HANDLE_VALUE)
+                                    {
+                                      CloseHandle(m_file);
+                                    }
+                                    break;
+  }
+}
+
+void
+BufferBlock::AddReference()
+{
+  InterlockedIncrement(&m_references);
+}
+
+void
+BufferBlock::DropReference()
+{
+  if(InterlockedDecrement(&m_references) == 0)
+  {
+    delete this;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// BufferChain
+//
+//////////////////////////////////////////////////////////////////////////
+
+BufferChain::BufferChain(const BufferChain& p_chain)
+{
+  Append(p_chain);
+}
+
+BufferChain::~BufferChain()
+{
+  Reset();
+}
+
+BufferChain&
+BufferChain::operator=(const BufferChain& p_chain)
+{
+  if(&p_chain != this)
+  {
+    Reset();
+    Append(p_chain);
+  }
+  return *this;
+}
+
+// Drop all slices
+void
+BufferChain::Reset()
+{
+  for(auto& slice : m_slices)
+  {
+    slice.m_block->DropReference();
+  }
+  m_slices.clear();
+  m_length = 0;
+}
+
+void
+BufferChain::AddCopy(const uchar* p_buffer,size_t p_length)
+{
+  AddBlock(BufferBlock::CreateCopy(p_buffer,p_length));
+}
+
+void
+BufferChain::AddOwned(uchar* p_buffer,size_t p_length)
+{
+  AddBlock(BufferBlock::CreateOwned(p_buffer,p_length));
+}
+
+void
+BufferChain::AddReference(const uchar* p_buffer,size_t p_length,LPFN_BUFFERRELEASE p_release,void* p_context)
+{
+  AddBlock(BufferBlock::CreateReference(p_buffer,p_length,p_release,p_context));
+}
+
+void
+BufferChain::AddFileRegion(HANDLE p_file,ULONGLONG p_offset,ULONGLONG p_length,bool p_owner)
+{
+  AddBlock(BufferBlock::CreateFileRegion(p_file,p_offset,p_length,p_owner));
+}
+
+// Add a part of a block, taking a reference on the block
+void
+BufferChain::AddSlice(BufferBlock* p_block,ULONGLONG p_offset,ULONGLONG p_length)
+{
+  if(p_block == nullptr || p_offset + p_length > p_block->GetLength())
+  {
+    return;
+  }
+  p_block->AddReference();
+  m_slices.push_back({ p_block,p_offset,p_length });
+  m_length += p_length;
+}
+
+// Add all slices of another chain
+void
+BufferChain::Append(const BufferChain& p_chain)
+{
+  m_slices.reserve(m_slices.size() + p_chain.m_slices.size());
+  for(const auto& slice : p_chain.m_slices)
+  {
+    AddSlice(slice.m_block,slice.m_offset,slice.m_length);
+  }
+}
+
+// New chain with a part of this chain
+BufferChain
+BufferChain::Slice(ULONGLONG p_offset,ULONGLONG p_length) const
+{
+  BufferChain chain;
+  for(const auto& slice : m_slices)
+  {
+    if(p_length == 0)
+    {
+      break;
+    }
+    if(p_offset >= slice.m_length)
+    {
+      p_offset -= slice.m_length;
+      continue;
+    }
+    ULONGLONG length = slice.m_length - p_offset;
+    if(length > p_length)
+    {
+      length = p_length;
+    }
+    chain.AddSlice(slice.m_block,slice.m_offset + p_offset,length);
+    p_length -= length;
+    p_offset  = 0;
+  }
+  return chain;
+}
+
+const BufferSlice*
+BufferChain::GetSlice(int p_index) const
+{
+  if(p_index < 0 || p_index >= (int)m_slices.size())
+  {
+    return nullptr;
+  }
+  return &m_slices[p_index];
+}
+
+bool
+BufferChain::GetHasFileRegions() const
+{
+  for(const auto& slice : m_slices)
+  {
+    if(slice.m_block->GetKind() == BufferKind::BK_File)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Fill HTTP API data chunks from slice 'p_first' on
+// Memory slices become 'FromMemory' chunks, file regions 'FromFileHandle' chunks
+USHORT
+BufferChain::GetDataChunks(int p_first,PHTTP_DATA_CHUNK p_chunks,USHORT p_max,ULONGLONG* p_bytes /*= nullptr*/) const
+{
+  USHORT    count = 0;
+  ULONGLONG bytes = 0;
+  for(int index = p_first; index < (int)m_slices.size() && count < p_max; ++index)
+  {
+    const BufferSlice& slice = m_slices[index];
+    PHTTP_DATA_CHUNK   chunk = &p_chunks[count++];
+    ZeroMemory(chunk,sizeof(HTTP_DATA_CHUNK));
+    bytes += slice.m_length;
+
+    if(slice.m_block->GetKind() == BufferKind::BK_File)
+    {
+      chunk->DataChunkType = HttpDataChunkFromFileHandle;
+      chunk->FromFileHandle.FileHandle = slice.m_block->GetFile();
+      chunk->FromFileHandle.ByteRange.StartingOffset.QuadPart = slice.m_block->GetOffset() + slice.m_offset;
+      chunk->FromFileHandle.ByteRange.Length.QuadPart         = slice.m_length;
+    }
+    else
+    {
+      chunk->DataChunkType           = HttpDataChunkFromMemory;
+      chunk->FromMemory.pBuffer      = const_cast<uchar*>(slice.m_block->GetData() + slice.m_offset);
+      chunk->FromMemory.BufferLength = (ULONG)slice.m_length;
+    }
+  }
+  if(p_bytes)
+  {
+    *p_bytes = bytes;
+  }
+  return count;
+}
+
+// Copy all data into one buffer of at least GetLength() bytes
+bool
+BufferChain::CopyTo(uchar* p_buffer) const
+{
+  uchar* dest = p_buffer;
+  for(const auto& slice : m_slices)
+  {
+    if(slice.m_block->GetKind() == BufferKind::BK_File)
+    {
+      ULONGLONG  offset = slice.m_block->GetOffset() + slice.m_offset;
+      OVERLAPPED position;
+      ZeroMemory(&position,sizeof(OVERLAPPED));
+      position.Offset     = (DWORD)(offset & 0xFFFFFFFF);
+      position.OffsetHigh = (DWORD)(offset >> 32);
+      DWORD didread = 0;
+      if(!::ReadFile(slice.m_block->GetFile(),dest,(DWORD)slice.m_length,&didread,&position) || didread != (DWORD)slice.m_length)
+      {
+        return false;
+      }
+    }
+    else
+    {
+      memcpy(dest,slice.m_block->GetData() + slice.m_offset,(size_t)slice.m_length);
+    }
+    dest += slice.m_length;
+  }
+  return true;
+}
+
+// Write all slices to a file. Memory is written straight from the blocks,
+// the regions of other files are read and written in parts
+bool
+BufferChain::WriteTo(HANDLE p_file) const
+{
+  const DWORD bounceSize = 64 * 1024;
+  uchar* bounce = nullptr;
+  bool   result = true;
+
+  for(const auto& slice : m_slices)
+  {
+    if(slice.m_block->GetKind() == BufferKind::BK_File)
+    {
+      if(bounce == nullptr)
+      {
+        bounce = new uchar[bounceSize];
+      }
+      ULONGLONG offset    = slice.m_block->GetOffset() + slice.m_offset;
+      ULONGLONG remaining = slice.m_length;
+      while(result && remaining > 0)
+      {
+        DWORD amount = remaining < bounceSize ? (DWORD)remaining : bounceSize;
+        OVERLAPPED position;
+        ZeroMemory(&position,sizeof(OVERLAPPED));
+        position.Offset     = (DWORD)(offset & 0xFFFFFFFF);
+        position.OffsetHigh = (DWORD)(offset >> 32);
+        DWORD didread    = 0;
+        DWORD didwritten = 0;
+        result = ::ReadFile(slice.m_block->GetFile(),bounce,amount,&didread,&position) && didread == amount &&
+                 ::WriteFile(p_file,bounce,amount,&didwritten,NULL) && didwritten == amount;
+        offset    += amount;
+        remaining -= amount;
+      }
+    }
+    else
+    {
+      DWORD didwritten = 0;
+      result = ::WriteFile(p_file,slice.m_block->GetData() + slice.m_offset,(DWORD)slice.m_length,&didwritten,NULL) &&
+               didwritten == (DWORD)slice.m_length;
+    }
+    if(!result)
+    {
+      break;
+    }
+  }
+  delete[] bounce;
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Add a new block, taking over its first reference
+void
+BufferChain::AddBlock(BufferBlock* p_block)
+{
+  m_slices.push_back({ p_block,0,p_block->GetLength() });
+  m_length += p_block->GetLength();
+}
@@ -0,0 +1,149 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: BufferChain.h
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// // Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//////////////////////////////////////////////////////////////////////////
+//
+// Buffer chain: scatter/gather body data in refcounted, immutable slices
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <http.h>
+#include <vector>
+
+// Maximum number of data chunks handed to the HTTP API in one call
+#define BUFFERCHAIN_MAX_CHUNKS  64
+
+// Called when the last slice of a referenced (not owned) memory block is gone
+typedef void (*LPFN_BUFFERRELEASE)(void* p_context);
+
+enum class BufferKind
+{
+  BK_Memory = 1   // Memory allocated with 'new uchar[]', owned by the block
+ ,BK_Reference    // Memory of someone else (receive buffer, cached fragment)
+ ,BK_File         // Region of an open file
+};
+
+// One block of body data. Never changes after creation.
+// Shared by all slices (in all chains) that reference it.
+//
+class BufferBlock
+{
+public:
+  // Copy of a buffer
+  static BufferBlock* CreateCopy(const uchar* p_buffer,size_t p_length);
+  // Take over a buffer allocated with 'new uchar[]'
+  static BufferBlock* CreateOwned(uchar* p_buffer,size_t p_length);
+  // Reference memory of someone else. p_release(p_context) when the last slice is gone
+  static BufferBlock* CreateReference(const uchar* p_buffer,size_t p_length,LPFN_BUFFERRELEASE p_release,void* p_context);
+  // Region of an open file. With p_owner the handle is closed when the last slice is gone
+  static BufferBlock* CreateFileRegion(HANDLE p_file,ULONGLONG p_offset,ULONGLONG p_length,bool p_owner);
+
+  void          AddReference();
+  void          DropReference();
+
+  BufferKind    GetKind()   const { return m_kind;   }
+  const uchar*  GetData()   const { return m_data;   }
+  HANDLE        GetFile()   const { return m_file;   }
+  ULONGLONG     GetOffset() const { return m_offset; }
+  ULONGLONG     GetLength() const { return m_length; }
+
+private:
+  BufferBlock() = default;
+ ~BufferBlock();
+
+  BufferKind          m_kind       { BufferKind::BK_Memory };
+  const uchar*        m_data       { nullptr };   // Memory blocks
+  HANDLE              m_file       { NULL    };   // File regions
+  ULONGLONG           m_offset     { 0       };   // Offset of the region in the file
+  ULONGLONG           m_length     { 0       };
+  LPFN_BUFFERRELEASE  m_release    { nullptr };   // Referenced memory
+  void*               m_context    { nullptr };
+  bool                m_owner      { false   };   // Owner of the file handle
+  volatile long       m_references { 1       };
+};
+
+// Part of a block in a chain
+typedef struct _bufferSlice
+{
+  BufferBlock*  m_block;
+  ULONGLONG     m_offset;   // Offset within the block
+  ULONGLONG     m_length;
+}
+BufferSlice;
+
+// Body data as a list of slices of blocks. Copying a chain, appending a chain
+// or taking a part of a chain never copies the data: only references are taken.
+// A chain maps directly onto an array of HTTP_DATA_CHUNK's for the HTTP API.
+//
+class BufferChain
+{
+public:
+  BufferChain() = default;
+  BufferChain(const BufferChain& p_chain);
+ ~BufferChain();
+  BufferChain& operator=(const BufferChain& p_chain);
+
+  // Drop all slices
+  void      Reset();
+
+  // Add a copy of a buffer
+  void      AddCopy(const uchar* p_buffer,size_t p_length);
+  // Add a buffer allocated with 'new uchar[]'. The chain becomes the owner
+  void      AddOwned(uchar* p_buffer,size_t p_length);
+  // Add memory of someone else without copying
+  void      AddReference(const uchar* p_buffer,size_t p_length,LPFN_BUFFERRELEASE p_release,void* p_context);
+  // Add a region of an open file
+  void      AddFileRegion(HANDLE p_file,ULONGLONG p_offset,ULONGLONG p_length,bool p_owner);
+  // Add a part of a block, taking a reference on the block
+  void      AddSlice(BufferBlock* p_block,ULONGLONG p_offset,ULONGLONG p_length);
+  // Add all slices of another chain
+  void      Append(const BufferChain& p_chain);
+  // New chain with a part of this chain (e.g. for a byte range)
+  BufferChain Slice(ULONGLONG p_offset,ULONGLONG p_length) const;
+
+  // GETTERS
+  ULONGLONG GetLength() const              { return m_length;               }
+  int       GetNumberOfSlices() const      { return (int)m_slices.size();   }
+  const BufferSlice* GetSlice(int p_index) const;
+  bool      GetHasFileRegions() const;
+
+  // Fill HTTP API data chunks from slice 'p_first' on. Returns the number of chunks
+  // Optionally returns the number of bytes in those chunks
+  USHORT    GetDataChunks(int p_first,PHTTP_DATA_CHUNK p_chunks,USHORT p_max,ULONGLONG* p_bytes = nullptr) const;
+  // Copy all data into one buffer of at least GetLength() bytes. Reads the file regions
+  bool      CopyTo(uchar* p_buffer) const;
+  // Write all data to an open file. File regions are copied through a bounce buffer
+  bool      WriteTo(HANDLE p_file) const;
+
+private:
+  // Add a new block, taking over its first reference
+  void      AddBlock(BufferBlock* p_block);
+
+  std::vector<BufferSlice> m_slices;
+  ULONGLONG                m_length { 0 };
+};
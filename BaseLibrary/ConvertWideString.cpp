@@ -29,6 +29,12 @@
 #include <map>
 #include <xstring>
 
+// SSE2 is always there on our Intel/AMD platforms
+#if defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define CONVERT_SSE2
+#endif
+
 #ifdef _DEBUG
 #define new DEBUG_NEW
 #undef THIS_FILE
@@ -220,29 +226,465 @@ static CPIDNameMap cp_cpid_map;
 static NameCPIDMap cp_name_map;
 static CPIDNameMap cp_info_map;
 // 
+static bool
+FillCodePageNames()
+{
+  CodePageName* pointer = cpNames;
+  while(pointer->m_codepage_ID >= 0)
+  {
+    // Fill in both mappings
+    if(_tcslen(pointer->m_codepage_Name))
+    {
+      XString lowerName(pointer->m_codepage_Name);
+      lowerName.MakeLower();
+
+      cp_cpid_map.insert(std::make_pair(pointer->m_codepage_ID,pointer->m_codepage_Name));
+      cp_name_map.insert(std::make_pair(lowerName,pointer->m_codepage_ID));
+    }
+    // always fill in code to info 
+    cp_info_map.insert(std::make_pair(pointer->m_codepage_ID,pointer->m_information));
+    // Next record
+    ++pointer;
+  }
+  return true;
+}
+
 void 
 InitCodePageNames()
 {
-  // See if we are already initialized
-  if(cp_cpid_map.empty())
+  // Filled exactly once, even if the first calls come from several threads
+  static const bool filled = FillCodePageNames();
+  UNREFERENCED_PARAMETER(filled);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// FAST PATHS FOR THE MOST USED CHARSETS
+//
+//////////////////////////////////////////////////////////////////////////
+
+// How we can convert a charset without the OS
+enum class WireCodec
+{
+  OS        // Only through MultiByteToWideChar / WideCharToMultiByte
+ ,ASCII     // Superset of US-ASCII: pure ASCII text passes unchanged
+ ,Latin1    // ISO-8859-1: the byte values are the Unicode code points
+ ,UTF8      // Direct UTF-8 <-> UTF-16 transcoding
+};
+
+typedef struct _knownCharset
+{
+  LPCTSTR   m_name;         // Charset name as in HTTP protocol
+  int       m_codepage;     // Codepage ID
+  WireCodec m_codec;        // Fast converter
+}
+KnownCharset;
+
+// The charsets we see on almost every message
+// Searched before the general code page map
+static KnownCharset knownCharsets[] =
+{
+  { _T("utf-8"),        65001, WireCodec::UTF8   }
+ ,{ _T("us-ascii"),     20127, WireCodec::ASCII  }
+ ,{ _T("iso-8859-1"),   28591, WireCodec::Latin1 }
+ ,{ _T("windows-1252"),  1252, WireCodec::ASCII  }
+ ,{ _T("utf-16"),        1200, WireCodec::OS     }
+};
+
+// Fast converter for a code page
+static WireCodec
+CodepageToCodec(int p_codepage)
+{
+  switch(p_codepage)
+  {
+    case 65001: return WireCodec::UTF8;
+    case 28591: return WireCodec::Latin1;
+    case 20127: // US-ASCII
+    case 1250:  // All windows ANSI code pages
+    case 1251:
+    case 1252:
+    case 1253:
+    case 1254:
+    case 1255:
+    case 1256:
+    case 1257:
+    case 1258:
+    case 28592: // Most ISO-8859 code pages
+    case 28593:
+    case 28594:
+    case 28595:
+    case 28596:
+    case 28597:
+    case 28598:
+    case 28599:
+    case 28603:
+    case 28605: return WireCodec::ASCII;
+  }
+  // The ANSI code page of MS-Windows is always a superset of US-ASCII
+  if(p_codepage == (int) GetACP())
+  {
+    return WireCodec::ASCII;
+  }
+  return WireCodec::OS;
+}
+
+// Find the code page and the fast converter of a charset
+// An empty or unknown charset results in the default code page
+static int
+FindCharsetCodec(const XString& p_charset,int p_default,WireCodec& p_codec)
+{
+  for(const auto& known : knownCharsets)
+  {
+    if(p_charset.CompareNoCase(known.m_name) == 0)
+    {
+      p_codec = known.m_codec;
+      return known.m_codepage;
+    }
+  }
+  int codepage = p_default;
+  if(!p_charset.IsEmpty())
+  {
+    // Names in the map are in lowercase
+    XString charset(p_charset);
+    charset.MakeLower();
+
+    InitCodePageNames();
+    NameCPIDMap::iterator it = cp_name_map.find(charset);
+    if(it != cp_name_map.end())
+    {
+      codepage = it->second;
+    }
+  }
+  p_codec = CodepageToCodec(codepage);
+  return codepage;
+}
+
+// Number of leading US-ASCII bytes
+size_t
+ASCIIPrefix(const BYTE* p_buffer,size_t p_length)
+{
+  size_t index = 0;
+#ifdef CONVERT_SSE2
+  // 16 bytes at a time: any high bit stops the scan
+  for(; index + 16 <= p_length; index += 16)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_buffer + index));
+    if(_mm_movemask_epi8(block))
+    {
+      break;
+    }
+  }
+#endif
+  // Remainder and the exact position in the last block
+  for(; index < p_length; ++index)
+  {
+    if(p_buffer[index] & 0x80)
+    {
+      break;
+    }
+  }
+  return index;
+}
+
+// Number of leading UTF-16 chars without any of the bits in the mask
+static size_t
+WidePrefix(const wchar_t* p_buffer,size_t p_length,unsigned short p_mask)
+{
+  size_t index = 0;
+#ifdef CONVERT_SSE2
+  // 8 chars at a time
+  const __m128i mask = _mm_set1_epi16((short)p_mask);
+  const __m128i zero = _mm_setzero_si128();
+  for(; index + 8 <= p_length; index += 8)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_buffer + index));
+    __m128i clear = _mm_cmpeq_epi16(_mm_and_si128(block,mask),zero);
+    if(_mm_movemask_epi8(clear) != 0xFFFF)
+    {
+      break;
+    }
+  }
+#endif
+  for(; index < p_length; ++index)
+  {
+    if(p_buffer[index] & p_mask)
+    {
+      break;
+    }
+  }
+  return index;
+}
+
+size_t
+ASCIIPrefix(const wchar_t* p_buffer,size_t p_length)
+{
+  return WidePrefix(p_buffer,p_length,0xFF80);
+}
+
+bool
+IsASCII(const BYTE* p_buffer,size_t p_length)
+{
+  return ASCIIPrefix(p_buffer,p_length) == p_length;
+}
+
+bool
+IsASCII(const wchar_t* p_buffer,size_t p_length)
+{
+  return ASCIIPrefix(p_buffer,p_length) == p_length;
+}
+
+// Bytes to UTF-16 chars (for ASCII and Latin-1)
+static void
+WidenBytes(const BYTE* p_source,size_t p_length,wchar_t* p_target)
+{
+  size_t index = 0;
+#ifdef CONVERT_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  for(; index + 16 <= p_length; index += 16)
+  {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_source + index));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p_target + index),    _mm_unpacklo_epi8(block,zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p_target + index + 8),_mm_unpackhi_epi8(block,zero));
+  }
+#endif
+  for(; index < p_length; ++index)
+  {
+    p_target[index] = (wchar_t) p_source[index];
+  }
+}
+
+// UTF-16 chars to bytes. All chars must be below 0x100 !!
+static void
+NarrowChars(const wchar_t* p_source,size_t p_length,BYTE* p_target)
+{
+  size_t index = 0;
+#ifdef CONVERT_SSE2
+  for(; index + 16 <= p_length; index += 16)
+  {
+    __m128i low  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_source + index));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p_source + index + 8));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p_target + index),_mm_packus_epi16(low,high));
+  }
+#endif
+  for(; index < p_length; ++index)
+  {
+    p_target[index] = (BYTE) p_source[index];
+  }
+}
+
+// Direct UTF-8 to UTF-16. The target must have room for p_length chars.
+// Returns false on any illegal UTF-8, so the OS can do its replacements
+static bool
+UTF8ToUTF16(const BYTE* p_source,size_t p_length,wchar_t* p_target,size_t& p_chars)
+{
+  size_t index  = 0;
+  size_t output = 0;
+
+  while(index < p_length)
+  {
+    // Runs of ASCII are copied in blocks
+    size_t run = ASCIIPrefix(p_source + index,p_length - index);
+    if(run)
+    {
+      WidenBytes(p_source + index,run,p_target + output);
+      index  += run;
+      output += run;
+      if(index >= p_length)
+      {
+        break;
+      }
+    }
+    BYTE     lead = p_source[index];
+    unsigned cp   = 0;
+    size_t   num  = 0;
+    if     ((lead & 0xE0) == 0xC0) { cp = lead & 0x1F; num = 2; }
+    else if((lead & 0xF0) == 0xE0) { cp = lead & 0x0F; num = 3; }
+    else if((lead & 0xF8) == 0xF0) { cp = lead & 0x07; num = 4; }
+    else
+    {
+      return false;
+    }
+    if(index + num > p_length)
+    {
+      return false;
+    }
+    for(size_t ind = 1; ind < num; ++ind)
+    {
+      BYTE follow = p_source[index + ind];
+      if((follow & 0xC0) != 0x80)
+      {
+        return false;
+      }
+      cp = (cp << 6) | (follow & 0x3F);
+    }
+    // Overlong encodings, UTF-16 surrogates and beyond the last plane
+    if((num == 2 && cp < 0x80)    ||
+       (num == 3 && cp < 0x800)   ||
+       (num == 4 && cp < 0x10000) ||
+       (cp >= 0xD800 && cp <= 0xDFFF) ||
+       (cp > 0x10FFFF))
+    {
+      return false;
+    }
+    if(cp >= 0x10000)
+    {
+      cp -= 0x10000;
+      p_target[output++] = (wchar_t) (0xD800 + (cp >> 10));
+      p_target[output++] = (wchar_t) (0xDC00 + (cp & 0x3FF));
+    }
+    else
+    {
+      p_target[output++] = (wchar_t) cp;
+    }
+    index += num;
+  }
+  p_chars = output;
+  return true;
+}
+
+// Length of UTF-16 as UTF-8. Returns false on unpaired surrogates
+static bool
+UTF16LengthAsUTF8(const wchar_t* p_source,size_t p_length,size_t& p_bytes)
+{
+  size_t bytes = 0;
+  size_t index = 0;
+
+  while(index < p_length)
   {
-    CodePageName* pointer = cpNames;
-    while(pointer->m_codepage_ID >= 0)
+    size_t run = ASCIIPrefix(p_source + index,p_length - index);
+    bytes += run;
+    index += run;
+    if(index >= p_length)
     {
-      // Fill in both mappings
-      if(_tcslen(pointer->m_codepage_Name))
+      break;
+    }
+    unsigned ch = p_source[index++];
+    if(ch < 0x800)
+    {
+      bytes += 2;
+    }
+    else if(ch >= 0xD800 && ch <= 0xDBFF)
+    {
+      if(index >= p_length || p_source[index] < 0xDC00 || p_source[index] > 0xDFFF)
       {
-        XString lowerName(pointer->m_codepage_Name);
-        lowerName.MakeLower();
+        return false;
+      }
+      ++index;
+      bytes += 4;
+    }
+    else if(ch >= 0xDC00 && ch <= 0xDFFF)
+    {
+      return false;
+    }
+    else
+    {
+      bytes += 3;
+    }
+  }
+  p_bytes = bytes;
+  return true;
+}
 
-        cp_cpid_map.insert(std::make_pair(pointer->m_codepage_ID,pointer->m_codepage_Name));
-        cp_name_map.insert(std::make_pair(lowerName,pointer->m_codepage_ID));
+// Direct UTF-16 to UTF-8, after UTF16LengthAsUTF8 has checked the string
+static void
+UTF16ToUTF8(const wchar_t* p_source,size_t p_length,BYTE* p_target)
+{
+  size_t index = 0;
+
+  while(index < p_length)
+  {
+    size_t run = ASCIIPrefix(p_source + index,p_length - index);
+    if(run)
+    {
+      NarrowChars(p_source + index,run,p_target);
+      p_target += run;
+      index    += run;
+      if(index >= p_length)
+      {
+        break;
       }
-      // always fill in code to info 
-      cp_info_map.insert(std::make_pair(pointer->m_codepage_ID,pointer->m_information));
-      // Next record
-      ++pointer;
     }
+    unsigned cp = p_source[index++];
+    if(cp >= 0xD800 && cp <= 0xDBFF)
+    {
+      cp = 0x10000 + ((cp - 0xD800) << 10) + (p_source[index++] - 0xDC00);
+    }
+    if(cp < 0x800)
+    {
+      *p_target++ = (BYTE) (0xC0 | (cp >> 6));
+      *p_target++ = (BYTE) (0x80 | (cp & 0x3F));
+    }
+    else if(cp < 0x10000)
+    {
+      *p_target++ = (BYTE) (0xE0 | (cp >> 12));
+      *p_target++ = (BYTE) (0x80 | ((cp >> 6) & 0x3F));
+      *p_target++ = (BYTE) (0x80 | (cp & 0x3F));
+    }
+    else
+    {
+      *p_target++ = (BYTE) (0xF0 | (cp >> 18));
+      *p_target++ = (BYTE) (0x80 | ((cp >> 12) & 0x3F));
+      *p_target++ = (BYTE) (0x80 | ((cp >> 6)  & 0x3F));
+      *p_target++ = (BYTE) (0x80 | (cp & 0x3F));
+    }
+  }
+}
+
+// Can we widen this buffer without the OS?
+static bool
+CanWidenFast(const BYTE* p_source,size_t p_length,WireCodec p_codec)
+{
+  switch(p_codec)
+  {
+    case WireCodec::OS:     return false;
+    case WireCodec::ASCII:  return IsASCII(p_source,p_length);
+    case WireCodec::Latin1: // Fall through
+    case WireCodec::UTF8:   return true;
+  }
+  return false;
+}
+
+// Widen to UTF-16. Target must have room for p_length chars
+static bool
+FastWiden(const BYTE* p_source,size_t p_length,WireCodec p_codec,wchar_t* p_target,size_t& p_chars)
+{
+  if(p_codec == WireCodec::UTF8)
+  {
+    return UTF8ToUTF16(p_source,p_length,p_target,p_chars);
+  }
+  WidenBytes(p_source,p_length,p_target);
+  p_chars = p_length;
+  return true;
+}
+
+// Size in bytes of narrowing without the OS. False if the OS must do it
+static bool
+FastNarrowSize(const wchar_t* p_source,size_t p_length,WireCodec p_codec,size_t& p_bytes)
+{
+  switch(p_codec)
+  {
+    case WireCodec::OS:     return false;
+    case WireCodec::ASCII:  p_bytes = p_length;
+                            return IsASCII(p_source,p_length);
+    case WireCodec::Latin1: p_bytes = p_length;
+                            return WidePrefix(p_source,p_length,0xFF00) == p_length;
+    case WireCodec::UTF8:   return UTF16LengthAsUTF8(p_source,p_length,p_bytes);
+  }
+  return false;
+}
+
+// Narrowing after FastNarrowSize. Target must have room for p_bytes
+static void
+FastNarrow(const wchar_t* p_source,size_t p_length,size_t p_bytes,BYTE* p_target)
+{
+  if(p_bytes == p_length)
+  {
+    // ASCII, Latin-1 or UTF-8 without any multi-byte chars
+    NarrowChars(p_source,p_length,p_target);
+  }
+  else
+  {
+    UTF16ToUTF8(p_source,p_length,p_target);
   }
 }
 
@@ -281,15 +723,8 @@ CharsetToCodepage(XString p_charset)
   {
     return GetACP();
   }
-
-  InitCodePageNames();
-  p_charset.MakeLower();
-  NameCPIDMap::iterator it = cp_name_map.find(p_charset);
-  if(it != cp_name_map.end())
-  {
-    result = it->second;
-  }
-  return result;
+  WireCodec codec = WireCodec::OS;
+  return FindCharsetCodec(p_charset,result,codec);
 }
 
 // Getting the name of the codepage
@@ -493,9 +928,6 @@ TryConvertNarrowString(const BYTE* p_buffer
   p_string.Empty();
   p_foundBOM = false;
 
-  // Fill the code page names the first time
-  InitCodePageNames();
-
   // Check if we know the codepage from the character set
   if(p_charset.IsEmpty())
   {
@@ -525,10 +957,25 @@ TryConvertNarrowString(const BYTE* p_buffer
   }
 
   // Now find our codepage
-  NameCPIDMap::iterator it = cp_name_map.find(p_charset);
-  if(it != cp_name_map.end())
+  WireCodec codec = WireCodec::OS;
+  codePage = FindCharsetCodec(p_charset,codePage,codec);
+
+  // Fast path for ASCII, Latin-1 and UTF-8 without a BOM
+  // Just like the OS conversion, we stop at the first closing zero
+  if(bomfound != BOMOpenResult::BOM && p_length > 0)
   {
-    codePage = it->second;
+    size_t length = strnlen(reinterpret_cast<const char*>(p_buffer),(size_t)p_length);
+    if(CanWidenFast(p_buffer,length,codec))
+    {
+      size_t chars  = 0;
+      PWSTR  buffer = p_string.GetBufferSetLength((int)length);
+      bool   fast   = FastWiden(p_buffer,length,codec,buffer,chars);
+      p_string.ReleaseBufferSetLength(fast ? (int)chars : 0);
+      if(fast)
+      {
+        return true;
+      }
+    }
   }
 
   // Getting the length of the buffer, by specifying no output
@@ -577,15 +1024,29 @@ TryCreateNarrowString(const XString& p_string
   int  extra    = 0;        // Extra space for a BOM
   bool result   = false;
 
-  // Fill the code page names the first time
-  InitCodePageNames();
-
   // Check if we know the codepage from the charset
   XString charset = p_charset.IsEmpty() ? _T("utf-8") : p_charset;
-  NameCPIDMap::iterator it = cp_name_map.find(charset);
-  if(it != cp_name_map.end())
+  WireCodec codec = WireCodec::OS;
+  codePage = FindCharsetCodec(charset,codePage,codec);
+
+  // Fast path for ASCII, Latin-1 and UTF-8
+  // Just like the OS conversion, we stop at the first closing zero
+  size_t length = wcsnlen(p_string.GetString(),(size_t)p_string.GetLength());
+  size_t bytes  = 0;
+  if(FastNarrowSize(p_string.GetString(),length,codec,bytes))
   {
-    codePage = it->second;
+    extra = (p_doBom && codePage == 65001) ? 3 : 0;
+    *p_buffer = new BYTE[bytes + extra + 1];
+    if(extra)
+    {
+      (*p_buffer)[0] = (BYTE) 0xEF;
+      (*p_buffer)[1] = (BYTE) 0xBB;
+      (*p_buffer)[2] = (BYTE) 0xBF;
+    }
+    FastNarrow(p_string.GetString(),length,bytes,*p_buffer + extra);
+    (*p_buffer)[bytes + extra] = 0;
+    p_length = (int)(bytes + extra);
+    return true;
   }
 
   // Getting the length of the translation buffer first
@@ -608,9 +1069,9 @@ TryCreateNarrowString(const XString& p_string
     if(p_doBom && codePage == 65001)
     {
       extra = 3;
-      *p_buffer[0] = (BYTE) 0xEF;
-      *p_buffer[1] = (BYTE) 0xBB;
-      *p_buffer[2] = (BYTE) 0xBF;
+      (*p_buffer)[0] = (BYTE) 0xEF;
+      (*p_buffer)[1] = (BYTE) 0xBB;
+      (*p_buffer)[2] = (BYTE) 0xBF;
     }
 
     DWORD dwFlag = 0; // WC_COMPOSITECHECK | WC_DISCARDNS;
@@ -622,8 +1083,8 @@ TryCreateNarrowString(const XString& p_string
                                     iLength,
                                     NULL,
                                     NULL);
-    // Result!
-    p_length = iLength > 0 ? iLength - 1: 0;
+    // Result! Including the BOM
+    p_length = iLength > 0 ? iLength - 1 + extra : 0;
     result   = true;
   }
   return result;
@@ -674,7 +1135,16 @@ WStringToString(std::wstring p_string)
 XString
 DecodeStringFromTheWire(XString p_string,XString p_charset /*="utf-8"*/)
 {
-  int   length = p_string.GetLength();
+  int length = p_string.GetLength();
+
+  // Pure ASCII is the same in all ASCII compatible charsets
+  WireCodec codec = WireCodec::UTF8;
+  FindCharsetCodec(p_charset.IsEmpty() ? XString(_T("utf-8")) : p_charset,GetACP(),codec);
+  if(codec != WireCodec::OS && IsASCII(p_string.GetString(),(size_t)length))
+  {
+    return p_string;
+  }
+
   BYTE* buffer = new BYTE[length + 1];
   for(int ind = 0;ind < length; ++ind)
   {
@@ -694,15 +1164,22 @@ DecodeStringFromTheWire(XString p_string,XString p_charset /*="utf-8"*/)
 XString
 EncodeStringForTheWire(XString p_string,XString p_charset /*="utf-8"*/)
 {
+  // Pure ASCII is the same in all ASCII compatible charsets
+  WireCodec codec = WireCodec::UTF8;
+  FindCharsetCodec(p_charset.IsEmpty() ? XString(_T("utf-8")) : p_charset,GetACP(),codec);
+  if(codec != WireCodec::OS && IsASCII(p_string.GetString(),(size_t)p_string.GetLength()))
+  {
+    return p_string;
+  }
+
   BYTE* buffer = nullptr;
   int length = 0;
   if(TryCreateNarrowString(p_string,p_charset,false,&buffer,length))
   {
+    // One byte per char on the wire
     XString result;
-    for(int ind = 0;ind < length; ++ind)
-    {
-      result += (TCHAR) buffer[ind];
-    }
+    WidenBytes(buffer,(size_t)length,result.GetBufferSetLength(length));
+    result.ReleaseBufferSetLength(length);
     delete[] buffer;
     return result;
   }
@@ -802,9 +1279,6 @@ TryConvertWideString(const BYTE* p_buffer
   p_string.Empty();
   p_foundBOM = false;
 
-  // Fill the code page names the first time
-  InitCodePageNames();
-
   if(reinterpret_cast<const BYTE*>(p_buffer)[p_length    ] != 0 &&
      reinterpret_cast<const BYTE*>(p_buffer)[p_length + 1] != 0)
   {
@@ -820,14 +1294,8 @@ TryConvertWideString(const BYTE* p_buffer
   }
 
   // Check if we know the codepage from the charset
-  if(!p_charset.IsEmpty())
-  {
-    NameCPIDMap::iterator it = cp_name_map.find(p_charset);
-    if(it != cp_name_map.end())
-    {
-      codePage = it->second;
-    }
-  }
+  WireCodec codec = WireCodec::OS;
+  codePage = FindCharsetCodec(p_charset,codePage,codec);
 
   // Scanning for a BOM UTF-16 in Little-endian mode for Intel processors
   DWORD_PTR extra = 0;
@@ -838,6 +1306,19 @@ TryConvertWideString(const BYTE* p_buffer
     p_foundBOM = true;  // Remember we found a BOM
   }
 
+  // Fast path for ASCII, Latin-1 and UTF-8
+  // Just like the OS conversion, we stop at the first closing zero
+  LPCWSTR source = (LPCWSTR)((DWORD_PTR)p_buffer + extra);
+  size_t  length = p_length > (int)extra ? wcsnlen(source,((size_t)p_length - extra) / 2) : 0;
+  size_t  bytes  = 0;
+  if(FastNarrowSize(source,length,codec,bytes))
+  {
+    FastNarrow(source,length,bytes,reinterpret_cast<BYTE*>(p_string.GetBufferSetLength((int)bytes)));
+    p_string.ReleaseBufferSetLength((int)bytes);
+    delete[] extraBuffer;
+    return true;
+  }
+
   // Getting the length of the translation buffer first
   iLength = ::WideCharToMultiByte(codePage,
                                   0, 
@@ -897,16 +1378,32 @@ TryCreateWideString(const XString& p_string
   p_length = 0;
 
   // Check if we know the codepage from the character set
-  if(!p_charset.IsEmpty())
+  WireCodec codec = WireCodec::OS;
+  codePage = FindCharsetCodec(p_charset,codePage,codec);
+
+  // Fast path for ASCII, Latin-1 and UTF-8
+  // Just like the OS conversion, we stop at the first closing zero
+  const BYTE* source = reinterpret_cast<const BYTE*>(p_string.GetString());
+  size_t      length = strnlen(p_string.GetString(),(size_t)p_string.GetLength());
+  if(CanWidenFast(source,length,codec))
   {
-    // Fill the code page names the first time
-    InitCodePageNames();
-
-    NameCPIDMap::iterator it = cp_name_map.find(p_charset);
-    if(it != cp_name_map.end())
+    // +2 chars for a BOM and the closing zero
+    *p_buffer = new BYTE[2 * length + 4];
+    BYTE*  buffer = *p_buffer + (p_doBom ? 2 : 0);
+    size_t chars  = 0;
+    if(FastWiden(source,length,codec,reinterpret_cast<wchar_t*>(buffer),chars))
     {
-      codePage = it->second;
+      if(p_doBom)
+      {
+        (*p_buffer)[0] = 0xFF;
+        (*p_buffer)[1] = 0xFE;
+      }
+      reinterpret_cast<wchar_t*>(buffer)[chars] = 0;
+      p_length = (int)(2 * chars) + (p_doBom ? 2 : 0);
+      return true;
     }
+    delete[] *p_buffer;
+    *p_buffer = NULL;
   }
 
   // Getting the length of the buffer, by specifying no output
@@ -1054,6 +1551,15 @@ DecodeStringFromTheWire(XString p_string,XString p_charset /*="utf-8"*/)
     p_charset = _T("utf-8");
   }
 
+  // No conversion for our own code page, or for pure ASCII in a compatible charset
+  WireCodec codec = WireCodec::OS;
+  int codePage = FindCharsetCodec(p_charset,-1,codec);
+  if(codePage == (int) GetACP() ||
+    (codec != WireCodec::OS && IsASCII(reinterpret_cast<const BYTE*>(p_string.GetString()),(size_t)p_string.GetLength())))
+  {
+    return p_string;
+  }
+
   // Now decode the UTF-8 in the encoded string, to decoded MBCS
   BYTE*  buffer = nullptr;
   int    length = 0;
@@ -1081,6 +1587,15 @@ EncodeStringForTheWire(XString p_string,XString p_charset /*="utf-8"*/)
     p_charset = _T("utf-8");
   }
 
+  // No conversion for our own code page, or for pure ASCII in a compatible charset
+  WireCodec codec = WireCodec::OS;
+  int codePage = FindCharsetCodec(p_charset,-1,codec);
+  if(codePage == (int) GetACP() ||
+    (codec != WireCodec::OS && IsASCII(reinterpret_cast<const BYTE*>(p_string.GetString()),(size_t)p_string.GetLength())))
+  {
+    return p_string;
+  }
+
   // Now encode MBCS to UTF-8 without a BOM
   BYTE*  buffer = nullptr;
   int    length = 0;
@@ -1176,6 +1691,16 @@ bool
 DetectUTF8(XString& p_string)
 {
   const BYTE* bytes = reinterpret_cast<const BYTE*>(p_string.GetString());
+#ifndef UNICODE
+  // Skip the leading ASCII in blocks. Cannot contain UTF-8
+  size_t length = (size_t) p_string.GetLength();
+  size_t prefix = ASCIIPrefix(bytes,length);
+  if(prefix == length)
+  {
+    return false;
+  }
+  bytes += prefix;
+#endif
   return DetectUTF8(bytes);
 }
 
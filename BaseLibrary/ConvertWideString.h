@@ -113,6 +113,13 @@ XString ConstructBOMUTF8();
 bool    DetectUTF8(XString& p_string);
 bool    DetectUTF8(const BYTE* p_bytes);
 
+// Scan for pure 7-bits US-ASCII (the fast path for most of our traffic)
+// Returns the number of leading ASCII characters
+size_t  ASCIIPrefix(const BYTE*    p_buffer,size_t p_length);
+size_t  ASCIIPrefix(const wchar_t* p_buffer,size_t p_length);
+bool    IsASCII(const BYTE*    p_buffer,size_t p_length);
+bool    IsASCII(const wchar_t* p_buffer,size_t p_length);
+
 // Convert directly from LPCSTR (No 'T' !!) to XString and vice versa
 XString LPCSTRToString(LPCSTR p_string,bool p_utf8 = false);
 int     StringToLPCSTR(XString p_string,LPCSTR* p_buffer,int& p_size,bool p_utf8 = false);
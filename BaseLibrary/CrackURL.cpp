@@ -223,19 +223,21 @@ CrackedURL::CrackURL(XString p_url)
     }
 
     // Find all query parameters
+    // Walk the query string by position: no copies of the remainder
+    int start = 0;
     while(query > 0)
     {
       // FindNext query
-      query = p_url.Find('&');
+      query = p_url.Find('&',start);
       XString part;
       if(query > 0)
       {
-        part  = p_url.Left(query);
-        p_url = p_url.Mid(query + 1);
+        part  = p_url.Mid(start,query - start);
+        start = query + 1;
       }
       else
       {
-        part = p_url;
+        part = p_url.Mid(start);
       }
 
       UriParam param;
@@ -297,6 +299,11 @@ CrackedURL::SetPath(XString p_path)
 XString
 CrackedURL::EncodeURLChars(XString p_text,bool p_queryValue /*=false*/)
 {
+  // Most paths and parameters need no encoding at all
+  if(!NeedsEncoding(p_text,p_queryValue))
+  {
+    return p_text;
+  }
   XString encoded;
   uchar*  buffer = nullptr;
   int     length = 0;
@@ -355,6 +362,11 @@ CrackedURL::EncodeURLChars(XString p_text,bool p_queryValue /*=false*/)
 XString
 CrackedURL::DecodeURLChars(XString p_text,bool p_queryValue /*=false*/)
 {
+  // Nothing to decode: spare the character-by-character copy
+  if(p_text.FindOneOf(_T("%+")) < 0)
+  {
+    return p_text;
+  }
   XString encoded;
   XString decoded;
   bool  convertUTF = false;
@@ -413,6 +425,27 @@ CrackedURL::DecodeURLChars(XString p_text,bool p_queryValue /*=false*/)
   return decoded;
 }
 
+// See if a text would be changed by EncodeURLChars
+bool
+CrackedURL::NeedsEncoding(const XString& p_text,bool p_queryValue)
+{
+  LPCTSTR pointer = p_text.GetString();
+  for(int ind = 0; ind < p_text.GetLength(); ++ind)
+  {
+    _TUCHAR ch = (_TUCHAR) pointer[ind];
+    if(ch == '?')
+    {
+      p_queryValue = true;
+    }
+    if(ch < 0x20 || ch > 0x7F || _tcschr(m_unsafeString,ch) ||
+       (p_queryValue && _tcsrchr(m_reservedString,ch)))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Decode 1 hex char for URL decoding
 uchar
 CrackedURL::GetHexcodedChar(XString& p_text
@@ -111,6 +111,7 @@ public:
 private:
   static LPCTSTR m_unsafeString;
   static LPCTSTR m_reservedString;
+  static bool    NeedsEncoding(const XString& p_text,bool p_queryValue);
   static uchar   GetHexcodedChar(XString& p_string
                                 ,int&     p_index
                                 ,bool&    p_percent
@@ -27,6 +27,8 @@
 //
 #include "pch.h"
 #include "Crypto.h"
+#include "CryptoHash.h"
+#include "CryptoAES.h"
 #include "Base64.h"
 #include "GetLastErrorAsString.h"
 #include "AutoCritical.h"
@@ -79,15 +81,26 @@ Crypto::~Crypto()
 XString
 Crypto::Digest(const void* data,const size_t data_size,unsigned hashType /*=0*/)
 {
-  AutoCritSec lock(&m_lock);
-  HCRYPTPROV hProv = NULL;
-
   // Do we have input?
   if(data_size == 0 || data == nullptr)
   {
     return _T("");
   }
 
+  // The SHA family is built-in: no provider and no lock
+  unsigned type = hashType > 0 ? hashType : m_hashMethod;
+  if(CryptoHash::IsSupported(type))
+  {
+    BYTE buffer[CRYPTOHASH_MAXSIZE];
+    size_t size = CryptoHash::Hash(type,data,data_size,buffer);
+    Base64 base64(m_base64 ? CRYPT_STRING_BASE64 : CRYPT_STRING_HEXRAW);
+    return base64.Encrypt(buffer,(int)size);
+  }
+
+  // Older methods (MD2/MD4/MD5) through the crypto provider
+  AutoCritSec lock(&m_lock);
+  HCRYPTPROV hProv = NULL;
+
   // Get last modern encryption provider
   if(!CryptAcquireContext(&hProv,NULL,MS_ENH_RSA_AES_PROV,PROV_RSA_AES,CRYPT_VERIFYCONTEXT|CRYPT_MACHINE_KEYSET))
   {
@@ -96,7 +109,6 @@ Crypto::Digest(const void* data,const size_t data_size,unsigned hashType /*=0*/)
 
   BOOL hash_ok = FALSE;
   HCRYPTPROV hHash = NULL;
-  unsigned type = hashType > 0 ? hashType : m_hashMethod;
   switch(type)
   {
     case CALG_SHA1:   hash_ok = CryptCreateHash(hProv,CALG_SHA1,   0,0,&hHash); break;
@@ -153,315 +165,89 @@ Crypto::Digest(const void* data,const size_t data_size,unsigned hashType /*=0*/)
 XString 
 Crypto::Encryption(XString p_input,XString p_password)
 {
-  AutoCritSec lock(&m_lock);
-
-  HCRYPTPROV hCryptProv = NULL;
-  HCRYPTKEY  hCryptKey  = NULL;
-  HCRYPTHASH hCryptHash = NULL;
-  DWORD      dwDataLen  = 0;
-  BYTE*      pbData     = NULL;
-  BYTE*      pbConvert  = nullptr;
-  DWORD      blocklen   = 0;
-  DWORD      cbBlocklen = sizeof(DWORD);
-  DWORD      dwFlags    = 0;
-  BOOL       bFinal     = FALSE;
-  DWORD      totallen   = 0;
-  BYTE*      crypting   = nullptr;
-  XString    result;
-  Base64     base64;
-
   // Do we have input?
   if(p_input.GetLength() == 0 || p_password.GetLength() == 0)
   {
     return _T("");
   }
 
-  // Get last modern encryption provider
-  if(!CryptAcquireContext(&hCryptProv,NULL,MS_ENH_RSA_AES_PROV,PROV_RSA_AES,CRYPT_VERIFYCONTEXT | CRYPT_MACHINE_KEYSET))
-  {
-    m_error.Format(_T("Error acquiring encryption context: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-
-  if(!CryptCreateHash(hCryptProv,ENCRYPT_PASSWORD,0,0,&hCryptHash))
+  std::vector<BYTE> encrypted;
+  if(!Encryption(reinterpret_cast<const BYTE*>(p_input.GetString())
+                ,p_input.GetLength() * sizeof(TCHAR)
+                ,p_password
+                ,encrypted))
   {
-    m_error.Format(_T("Error creating encryption hash: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-
-  if(!CryptHashData(hCryptHash,reinterpret_cast<const BYTE *>(p_password.GetString()),p_password.GetLength() * sizeof(TCHAR),0))
-  {
-    m_error.Format(_T("Error hashing password for encryption: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-
-  if(!CryptDeriveKey(hCryptProv,ENCRYPT_ALGORITHM,hCryptHash,0,&hCryptKey))
-  {
-    m_error.Format(_T("Error deriving password key for encryption: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-
-  if(!CryptGetKeyParam(hCryptKey,KP_BLOCKLEN,reinterpret_cast<BYTE*>(&blocklen),&cbBlocklen,0))
-  {
-    m_error = _T("Cannot get the block length of the encryption method");
-    goto error_exit;
+    return _T("");
   }
+  // Create a base64 string of the encrypted data
+  Base64 base64;
+  return base64.Encrypt(encrypted.data(),(int)encrypted.size());
+}
 
-  // Build data buffer that's large enough
-  dwDataLen = p_input.GetLength() * sizeof(TCHAR);
-  crypting  = (BYTE*) p_input.GetString();
-  pbData    = (BYTE*) malloc(2 * blocklen);
-  pbConvert = pbData;
-  
-  do
-  {
-    // Calculate the part to encrypt, and if we do the final block!
-    DWORD dataLength = 0;
-    if(dwDataLen <= blocklen)
-    {
-      bFinal = TRUE;
-      dataLength = dwDataLen;
-    }
-    else
-    {
-      dataLength = blocklen;
-    }
-    // Copy a data block to be encrypted
-    memcpy(pbConvert,crypting,dataLength);
-
-// #ifdef _DEBUG
-//     for(DWORD ind = 0; ind < dataLength; ++ind)
-//     {
-//       TRACE("RAW %X %c\n",pbConvert[ind],pbConvert[ind]);
-//     }
-// #endif
-
-    DWORD processed = dataLength;
-
-    // Do the encryption of the block
-    if(CryptEncrypt(hCryptKey
-                   ,NULL            // No hashing
-                   ,bFinal          // Final action
-                   ,dwFlags         // Reserved
-                   ,pbConvert       // The data
-                   ,&processed      // Pointer to data length
-                   ,2 * blocklen))  // Pointer to buffer length
-    {
-      // Total encrypted bytes
-      totallen  += processed;
-      // This much space left in the receiving buffer
-      dwDataLen -= blocklen;
-      // Next pointer to data to be encrypted
-      crypting  += blocklen;
-
-      // Add to the result;
-      pbData[totallen] = 0;
-      
-// #ifdef _DEBUG
-//       for(DWORD ind = 0; ind < dataLength;++ind)
-//       {
-//         TRACE("ENCODED %X\n",pbConvert[ind]);
-//       }
-// #endif
-      if(!bFinal)
-      {
-        // Make room for the next block and continue after totallen
-        pbData    = (BYTE*) realloc(pbData,totallen + (2 * blocklen));
-        pbConvert = pbData + totallen;
-      }
-    }
-    else
-    {
-      m_error.Format(_T("Error encrypting data: 0x%08x : %s"),GetLastError(),GetLastErrorAsString().GetString());
-      goto error_exit;
-    }
-  }
-  while(bFinal == FALSE);
-
-  // Create a base64 string of the hash data
-  result = base64.Encrypt(pbData,totallen);
-
-error_exit:
-  // Freeing everything
-  if(hCryptKey)
-  {
-    CryptDestroyKey(hCryptKey);
-  }
-  if(hCryptHash)
-  {
-    CryptDestroyHash(hCryptHash);
-  }
-  if(pbData)
-  {
-    free(pbData);
-  }
-  if(hCryptProv)
+// ENCRYPT a byte buffer in AES-256 (CBC) with a key derived from the password
+// Derived keys are cached, so a shared password costs one hash per message
+bool
+Crypto::Encryption(const BYTE* p_input,size_t p_size,const XString& p_password,std::vector<BYTE>& p_output)
+{
+  AESKey key;
+  if(!CryptoAES::DeriveKey(p_password.GetString(),p_password.GetLength() * sizeof(TCHAR),ENCRYPT_ALGORITHM,key))
   {
-    CryptReleaseContext(hCryptProv,0);
+    m_error = _T("Error deriving password key for encryption");
+    return false;
   }
-  return result;
+  CryptoAES::Encrypt(key,p_input,p_size,p_output);
+  SecureZeroMemory(&key,sizeof(AESKey));
+  return true;
 }
 
 // DECRYPT a buffer
 XString 
 Crypto::Decryption(XString p_input,XString p_password)
 {
-  AutoCritSec lock(&m_lock);
-
-  HCRYPTPROV hCryptProv = NULL;
-  HCRYPTKEY  hCryptKey  = NULL;
-  HCRYPTHASH hCryptHash = NULL;
-  DWORD      dwDataLen  = 0;
-  DWORD      dataLength = 0;
-  BYTE*      pbData     = NULL;
-  BYTE*      pbEncrypt  = nullptr;
-  DWORD      blocklen   = 0;
-  DWORD      cbBlocklen = sizeof(DWORD);
-  BOOL       bFinal     = FALSE;
-  DWORD      dwFlags    = 0;
-  DWORD      totallen   = 0;
-  BYTE*      decrypting = nullptr;
-  XString    result;
-  XString    encoded;
-  Base64     base64;
-
-  dwDataLen = p_input.GetLength();
+  XString result;
+  Base64  base64;
+  int     length = p_input.GetLength();
 
   // Check if we have anything to do
-  if(dwDataLen < 3)
+  if(length < 3)
   {
     return result;
   }
 
-  // Decrypt by way of a cryptographic provider
-  if(!CryptAcquireContext(&hCryptProv,NULL,MS_ENH_RSA_AES_PROV,PROV_RSA_AES,CRYPT_VERIFYCONTEXT | CRYPT_MACHINE_KEYSET))
-  {
-    m_error.Format(_T("Crypto context not acquired: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-  if(!CryptCreateHash(hCryptProv,ENCRYPT_PASSWORD,0,0,&hCryptHash)) // MD5?
-  {
-    m_error.Format(_T("Hash not created for decryption: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-
-  if(!CryptHashData(hCryptHash,reinterpret_cast<const BYTE *>(p_password.GetString()),p_password.GetLength() * sizeof(TCHAR),0))
-  {
-    m_error.Format(_T("Error hashing password data for decryption: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-
-  if(!CryptDeriveKey(hCryptProv,ENCRYPT_ALGORITHM,hCryptHash,0,&hCryptKey))
-  {
-    m_error.Format(_T("Error creating derived key for decryption: 0x%08x"),GetLastError());
-    goto error_exit;
-  }
-
-  if(!CryptGetKeyParam(hCryptKey,KP_BLOCKLEN,reinterpret_cast<BYTE*>(&blocklen),&cbBlocklen,0))
-  {
-    m_error = _T("Cannot get the block length of the encryption method");
-    goto error_exit;
-  }
-
   // Maximum of 2 times a trailing zero at a base64 (because 64 is a multiple of 3!!)
   // You MUST take them of, otherwise decrypting will not work
   // as the block size of the algorithm is incorrect.
-  dataLength = (DWORD) base64.Ascii_length(dwDataLen);
-  if(p_input.GetAt(p_input.GetLength() - 1) == '=') --dataLength;
-  if(p_input.GetAt(p_input.GetLength() - 2) == '=') --dataLength;
+  size_t dataLength = base64.Ascii_length(length);
+  if(p_input.GetAt(length - 1) == '=') --dataLength;
+  if(p_input.GetAt(length - 2) == '=') --dataLength;
 
-  // Create a data string of the base64 string
-  pbEncrypt  = new BYTE[dataLength + 2];
-  base64.Decrypt(p_input,pbEncrypt,dataLength + 2);
-  decrypting = pbEncrypt;
-  // Buffer to do the conversion in
-  pbData     = new BYTE[blocklen + 2];
-
-  do 
-  {
-    // Calculate the part to decrypt, and if we do the final block!
-    DWORD dataLen = 0;
-    if(dataLength <= blocklen)
-    {
-      dataLen = (DWORD)dataLength;
-      bFinal  = TRUE;
-      dwFlags = 0;  // CRYPT_DECRYPT_RSA_NO_PADDING_CHECK;
-    }
-    else
-    {
-      dataLen = blocklen;
-    }
-
-    // Copy a block to be decrypted
-    memcpy(pbData,decrypting,dataLen);
-
-// #ifdef _DEBUG
-//     for(DWORD ind = 0; ind < dataLen; ++ind)
-//     {
-//       TRACE("RAW %X\n",pbData[ind]);
-//     }
-// #endif
-    DWORD processed = dataLen;
-
-    // Decrypt
-    if(CryptDecrypt(hCryptKey
-                   ,NULL            // No hashing
-                   ,bFinal          // Final action
-                   ,dwFlags         // Reserved
-                   ,pbData          // The data
-                   ,&processed))    // Pointer to data length
-    {
-      // Totally decrypted length
-      totallen   += processed;
-      // Work the lengths
-      dataLength -= dataLen;
-
-      // Keep the result
-      pbData[processed    ] = 0;
-      pbData[processed + 1] = 0;
-      result += (LPTSTR) pbData;
-
-// #ifdef _DEBUG
-//       for(DWORD ind = 0; ind < dataLen;++ind)
-//       {
-//         TRACE("DECODED %X %c\n",pbData[ind],pbData[ind]);
-//       }
-// #endif
-      if(!bFinal)
-      {
-        // Next block of data to be decrypted
-        decrypting += blocklen;
-      }
-    }
-    else
-    {
-      m_error.Format(_T("Decrypting not done: 0x%08x : %s"),GetLastError(),GetLastErrorAsString().GetString());
-      goto error_exit;
-    }
-  }
-  while(bFinal == FALSE);
+  // Create a data buffer of the base64 string
+  std::vector<BYTE> encrypted(dataLength + 2);
+  base64.Decrypt(p_input,encrypted.data(),(int)dataLength + 2);
 
-error_exit:
-  // Freeing everything
-  if(hCryptKey)
-  {
-    CryptDestroyKey(hCryptKey);
-  }
-  if(hCryptHash)
-  {
-    CryptDestroyHash(hCryptHash);
-  }
-  if(pbData)
+  std::vector<BYTE> decrypted;
+  if(Decryption(encrypted.data(),dataLength,p_password,decrypted) && !decrypted.empty())
   {
-    delete[] pbData;
+    result.Append(reinterpret_cast<LPCTSTR>(decrypted.data()),(int)(decrypted.size() / sizeof(TCHAR)));
   }
-  if(pbEncrypt)
+  return result;
+}
+
+// DECRYPT a byte buffer in AES-256 (CBC) with a key derived from the password
+bool
+Crypto::Decryption(const BYTE* p_input,size_t p_size,const XString& p_password,std::vector<BYTE>& p_output)
+{
+  AESKey key;
+  if(!CryptoAES::DeriveKey(p_password.GetString(),p_password.GetLength() * sizeof(TCHAR),ENCRYPT_ALGORITHM,key))
   {
-    delete[] pbEncrypt;
+    m_error = _T("Error creating derived key for decryption");
+    return false;
   }
-  if(hCryptProv)
+  bool result = CryptoAES::Decrypt(key,p_input,p_size,p_output);
+  SecureZeroMemory(&key,sizeof(AESKey));
+  if(!result)
   {
-    CryptReleaseContext(hCryptProv,0);
+    m_error = _T("Decrypting not done: wrong password or damaged data");
   }
   return result;
 }
@@ -26,6 +26,7 @@
 // THE SOFTWARE.
 //
 #pragma once
+#include <vector>
 
 // Standard signing hashing 
 // 
@@ -61,13 +62,16 @@ public:
   XString  Encryption(XString p_input,XString password);
   // DECRYPT a buffer in AES-256
   XString  Decryption(XString p_input,XString password);
+  // Same on byte buffers, without base64 and string conversions
+  bool     Encryption(const BYTE* p_input,size_t p_size,const XString& p_password,std::vector<BYTE>& p_output);
+  bool     Decryption(const BYTE* p_input,size_t p_size,const XString& p_password,std::vector<BYTE>& p_output);
 
   // ENCRYPT a buffer quickly in RC4 through the BCrypt interface
   XString  FastEncryption(XString p_input, XString password);
   // DECRYPT a buffer quickly in RC4 through BCrypt interface
   XString  FastDecryption(XString p_input, XString password);
 
-  // Make a MD5 Hash value for a buffer
+  // Make a hash value for a buffer. The SHA family is built-in (see CryptoHash)
   XString  Digest(const void* data,const size_t data_size,unsigned hashType = 0);
   XString& GetDigest(void);
   void     SetDigestBase64(bool p_base64);
@@ -0,0 +1,555 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: CryptoAES.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// // Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "CryptoAES.h"
+#include "CryptoHash.h"
+#include "AutoCritical.h"
+#include <wincrypt.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <wmmintrin.h>
+#define CRYPTOAES_AESNI
+#endif
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PORTABLE AES
+//
+//////////////////////////////////////////////////////////////////////////
+
+static BYTE g_sbox[256];
+static BYTE g_inverse[256];
+
+static inline BYTE
+Rotl8(BYTE x,int n)
+{
+  return (BYTE)((x << n) | (x >> (8 - n)));
+}
+
+// Multiply by x in GF(2^8)
+static inline BYTE
+Times2(BYTE x)
+{
+  return (BYTE)((x << 1) ^ ((x & 0x80) ? 0x1B : 0x00));
+}
+
+// MixColumns of one column
+static inline void
+MixColumn(BYTE* p_column)
+{
+  BYTE all   = p_column[0] ^ p_column[1] ^ p_column[2] ^ p_column[3];
+  BYTE first = p_column[0];
+  p_column[0] ^= all ^ Times2(p_column[0] ^ p_column[1]);
+  p_column[1] ^= all ^ Times2(p_column[1] ^ p_column[2]);
+  p_column[2] ^= all ^ Times2(p_column[2] ^ p_column[3]);
+  p_column[3] ^= all ^ Times2(p_column[3] ^ first);
+}
+
+// InvMixColumns is a small step before MixColumns
+static inline void
+InvMixColumn(BYTE* p_column)
+{
+  BYTE u = Times2(Times2(p_column[0] ^ p_column[2]));
+  BYTE v = Times2(Times2(p_column[1] ^ p_column[3]));
+  p_column[0] ^= u;
+  p_column[1] ^= v;
+  p_column[2] ^= u;
+  p_column[3] ^= v;
+  MixColumn(p_column);
+}
+
+// Build the S-box from the multiplicative inverse and the affine transformation
+static bool
+BuildSBox()
+{
+  BYTE p = 1;
+  BYTE q = 1;
+  do
+  {
+    // p = p * 3 and q = q / 3: q stays the inverse of p
+    p = p ^ Times2(p);
+    q ^= q << 1;
+    q ^= q << 2;
+    q ^= q << 4;
+    if(q & 0x80)
+    {
+      q ^= 0x09;
+    }
+    g_sbox[p] = q ^ Rotl8(q,1) ^ Rotl8(q,2) ^ Rotl8(q,3) ^ Rotl8(q,4) ^ 0x63;
+  }
+  while(p != 1);
+  g_sbox[0] = 0x63;
+
+  for(int index = 0; index < 256; ++index)
+  {
+    g_inverse[g_sbox[index]] = (BYTE)index;
+  }
+  return true;
+}
+
+static bool g_sboxReady = BuildSBox();
+
+static void
+EncryptBlock_Portable(const AESKey& p_key,BYTE* p_block)
+{
+  const BYTE* roundKey = p_key.m_encrypt;
+  BYTE state[16];
+  for(int index = 0; index < 16; ++index)
+  {
+    state[index] = p_block[index] ^ roundKey[index];
+  }
+  for(int round = 1; round <= p_key.m_rounds; ++round)
+  {
+    // SubBytes and ShiftRows: byte (row r, column c) is at 4c + r
+    BYTE shifted[16];
+    for(int column = 0; column < 4; ++column)
+    {
+      for(int row = 0; row < 4; ++row)
+      {
+        shifted[4 * column + row] = g_sbox[state[4 * ((column + row) & 3) + row]];
+      }
+    }
+    // MixColumns, except in the last round
+    if(round < p_key.m_rounds)
+    {
+      for(int column = 0; column < 4; ++column)
+      {
+        MixColumn(&shifted[4 * column]);
+      }
+    }
+    roundKey += 16;
+    for(int index = 0; index < 16; ++index)
+    {
+      state[index] = shifted[index] ^ roundKey[index];
+    }
+  }
+  memcpy(p_block,state,16);
+}
+
+static void
+DecryptBlock_Portable(const AESKey& p_key,BYTE* p_block)
+{
+  const BYTE* roundKey = p_key.m_encrypt + 16 * p_key.m_rounds;
+  BYTE state[16];
+  for(int index = 0; index < 16; ++index)
+  {
+    state[index] = p_block[index] ^ roundKey[index];
+  }
+  for(int round = p_key.m_rounds - 1; round >= 0; --round)
+  {
+    // InvShiftRows and InvSubBytes
+    BYTE shifted[16];
+    for(int column = 0; column < 4; ++column)
+    {
+      for(int row = 0; row < 4; ++row)
+      {
+        shifted[4 * ((column + row) & 3) + row] = g_inverse[state[4 * column + row]];
+      }
+    }
+    roundKey -= 16;
+    for(int index = 0; index < 16; ++index)
+    {
+      state[index] = shifted[index] ^ roundKey[index];
+    }
+    // InvMixColumns, except after the last round
+    if(round > 0)
+    {
+      for(int column = 0; column < 4; ++column)
+      {
+        InvMixColumn(&state[4 * column]);
+      }
+    }
+  }
+  memcpy(p_block,state,16);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// AES INSTRUCTIONS OF THE PROCESSOR
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef CRYPTOAES_AESNI
+
+static bool
+DetectAESInstructions()
+{
+  int info[4] = { 0,0,0,0 };
+  __cpuidex(info,1,0);
+  return (info[2] & (1 << 25)) != 0;
+}
+
+static bool g_hasAES = DetectAESInstructions();
+
+// CBC encryption is serial: one block after the other
+static void
+Encrypt_AESNI(const AESKey& p_key,const BYTE* p_input,BYTE* p_output,size_t p_blocks)
+{
+  const __m128i* keys = reinterpret_cast<const __m128i*>(p_key.m_encrypt);
+  __m128i feedback = _mm_setzero_si128();
+
+  while(p_blocks--)
+  {
+    __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i*)p_input),feedback);
+    block = _mm_xor_si128(block,_mm_loadu_si128(&keys[0]));
+    for(int round = 1; round < p_key.m_rounds; ++round)
+    {
+      block = _mm_aesenc_si128(block,_mm_loadu_si128(&keys[round]));
+    }
+    block = _mm_aesenclast_si128(block,_mm_loadu_si128(&keys[p_key.m_rounds]));
+    _mm_storeu_si128((__m128i*)p_output,block);
+    feedback  = block;
+    p_input  += 16;
+    p_output += 16;
+  }
+}
+
+// CBC decryption of 4 blocks at a time: they do not depend on each other
+static void
+Decrypt_AESNI(const AESKey& p_key,const BYTE* p_input,BYTE* p_output,size_t p_blocks)
+{
+  const __m128i* keys = reinterpret_cast<const __m128i*>(p_key.m_decrypt);
+  const int      last = p_key.m_rounds;
+  __m128i previous = _mm_setzero_si128();
+
+  while(p_blocks >= 4)
+  {
+    __m128i c0 = _mm_loadu_si128((const __m128i*)(p_input +  0));
+    __m128i c1 = _mm_loadu_si128((const __m128i*)(p_input + 16));
+    __m128i c2 = _mm_loadu_si128((const __m128i*)(p_input + 32));
+    __m128i c3 = _mm_loadu_si128((const __m128i*)(p_input + 48));
+    __m128i key = _mm_loadu_si128(&keys[0]);
+    __m128i b0 = _mm_xor_si128(c0,key);
+    __m128i b1 = _mm_xor_si128(c1,key);
+    __m128i b2 = _mm_xor_si128(c2,key);
+    __m128i b3 = _mm_xor_si128(c3,key);
+    for(int round = 1; round < last; ++round)
+    {
+      key = _mm_loadu_si128(&keys[round]);
+      b0 = _mm_aesdec_si128(b0,key);
+      b1 = _mm_aesdec_si128(b1,key);
+      b2 = _mm_aesdec_si128(b2,key);
+      b3 = _mm_aesdec_si128(b3,key);
+    }
+    key = _mm_loadu_si128(&keys[last]);
+    b0 = _mm_aesdeclast_si128(b0,key);
+    b1 = _mm_aesdeclast_si128(b1,key);
+    b2 = _mm_aesdeclast_si128(b2,key);
+    b3 = _mm_aesdeclast_si128(b3,key);
+    _mm_storeu_si128((__m128i*)(p_output +  0),_mm_xor_si128(b0,previous));
+    _mm_storeu_si128((__m128i*)(p_output + 16),_mm_xor_si128(b1,c0));
+    _mm_storeu_si128((__m128i*)(p_output + 32),_mm_xor_si128(b2,c1));
+    _mm_storeu_si128((__m128i*)(p_output + 48),_mm_xor_si128(b3,c2));
+    previous  = c3;
+    p_input  += 64;
+    p_output += 64;
+    p_blocks -= 4;
+  }
+  while(p_blocks--)
+  {
+    __m128i cipher = _mm_loadu_si128((const __m128i*)p_input);
+    __m128i block  = _mm_xor_si128(cipher,_mm_loadu_si128(&keys[0]));
+    for(int round = 1; round < last; ++round)
+    {
+      block = _mm_aesdec_si128(block,_mm_loadu_si128(&keys[round]));
+    }
+    block = _mm_aesdeclast_si128(block,_mm_loadu_si128(&keys[last]));
+    _mm_storeu_si128((__m128i*)p_output,_mm_xor_si128(block,previous));
+    previous  = cipher;
+    p_input  += 16;
+    p_output += 16;
+  }
+}
+
+// Round keys for the equivalent inverse cipher of the AESDEC instruction
+static void
+InverseKeys_AESNI(AESKey& p_key)
+{
+  const __m128i* encrypt = reinterpret_cast<const __m128i*>(p_key.m_encrypt);
+  __m128i*       decrypt = reinterpret_cast<__m128i*>(p_key.m_decrypt);
+  int rounds = p_key.m_rounds;
+
+  _mm_storeu_si128(&decrypt[0],_mm_loadu_si128(&encrypt[rounds]));
+  for(int round = 1; round < rounds; ++round)
+  {
+    _mm_storeu_si128(&decrypt[round],_mm_aesimc_si128(_mm_loadu_si128(&encrypt[rounds - round])));
+  }
+  _mm_storeu_si128(&decrypt[rounds],_mm_loadu_si128(&encrypt[0]));
+}
+
+#else
+static bool g_hasAES = false;
+#endif
+
+// Use the AES instructions if the processor has them
+static volatile bool g_accelerate = g_hasAES;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// CACHE OF DERIVED KEYS
+//
+//////////////////////////////////////////////////////////////////////////
+
+typedef struct _derivedKey
+{
+  bool      m_used;
+  unsigned  m_algorithm;
+  BYTE      m_hash[32];     // SHA-256 of the password
+  ULONG64   m_lastUse;
+  AESKey    m_key;
+}
+DerivedKey;
+
+static DerivedKey       g_cache[CRYPTOAES_CACHE];
+static ULONG64          g_cacheClock = 0;
+static CRITICAL_SECTION g_cacheLock;
+
+static bool
+InitCacheLock()
+{
+  InitializeCriticalSection(&g_cacheLock);
+  return true;
+}
+
+static bool g_cacheLockReady = InitCacheLock();
+
+//////////////////////////////////////////////////////////////////////////
+//
+// CryptoAES
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Key schedule of a password.
+// Our peers use only a handful of shared passwords, so the schedules are
+// kept in a small cache. The least recently used one makes room.
+bool
+CryptoAES::DeriveKey(const void* p_password,size_t p_size,unsigned p_algorithm,AESKey& p_key)
+{
+  size_t length = 0;
+  switch(p_algorithm)
+  {
+    case CALG_AES_128: length = 16; break;
+    case CALG_AES_192: length = 24; break;
+    case CALG_AES_256: length = 32; break;
+    default:           return false;
+  }
+  BYTE hash[32];
+  CryptoHash::Hash(CALG_SHA_256,p_password,p_size,hash);
+
+  AutoCritSec lock(&g_cacheLock);
+
+  DerivedKey* oldest = &g_cache[0];
+  for(auto& entry : g_cache)
+  {
+    if(entry.m_used && entry.m_algorithm == p_algorithm && memcmp(entry.m_hash,hash,32) == 0)
+    {
+      entry.m_lastUse = ++g_cacheClock;
+      p_key = entry.m_key;
+      SecureZeroMemory(hash,sizeof(hash));
+      return true;
+    }
+    if(!entry.m_used || (oldest->m_used && entry.m_lastUse < oldest->m_lastUse))
+    {
+      oldest = &entry;
+    }
+  }
+
+  // Derived key is the first bytes of the hash (as CryptDeriveKey does for SHA-2)
+  SetKey(hash,length,p_key);
+  oldest->m_used      = true;
+  oldest->m_algorithm = p_algorithm;
+  oldest->m_lastUse   = ++g_cacheClock;
+  oldest->m_key       = p_key;
+  memcpy(oldest->m_hash,hash,32);
+  SecureZeroMemory(hash,sizeof(hash));
+  return true;
+}
+
+// Key expansion of FIPS-197
+bool
+CryptoAES::SetKey(const BYTE* p_key,size_t p_size,AESKey& p_schedule)
+{
+  int words = (int)(p_size / 4);
+  if(p_size != 16 && p_size != 24 && p_size != 32)
+  {
+    return false;
+  }
+  ZeroMemory(&p_schedule,sizeof(AESKey));
+  p_schedule.m_rounds = words + 6;
+
+  BYTE* w = p_schedule.m_encrypt;
+  memcpy(w,p_key,p_size);
+
+  BYTE rcon  = 0x01;
+  int  total = 4 * (p_schedule.m_rounds + 1);
+  for(int index = words; index < total; ++index)
+  {
+    BYTE temp[4];
+    memcpy(temp,&w[4 * (index - 1)],4);
+    if(index % words == 0)
+    {
+      BYTE first = temp[0];
+      temp[0] = g_sbox[temp[1]] ^ rcon;
+      temp[1] = g_sbox[temp[2]];
+      temp[2] = g_sbox[temp[3]];
+      temp[3] = g_sbox[first];
+      rcon = Times2(rcon);
+    }
+    else if(words > 6 && index % words == 4)
+    {
+      for(int byte = 0; byte < 4; ++byte)
+      {
+        temp[byte] = g_sbox[temp[byte]];
+      }
+    }
+    for(int byte = 0; byte < 4; ++byte)
+    {
+      w[4 * index + byte] = w[4 * (index - words) + byte] ^ temp[byte];
+    }
+  }
+#ifdef CRYPTOAES_AESNI
+  if(g_hasAES)
+  {
+    InverseKeys_AESNI(p_schedule);
+  }
+#endif
+  return true;
+}
+
+// Encrypt a buffer in CBC mode. Output is padded to a whole number of blocks
+void
+CryptoAES::Encrypt(const AESKey& p_key,const BYTE* p_input,size_t p_size,std::vector<BYTE>& p_output)
+{
+  size_t blocks = p_size / CRYPTOAES_BLOCK + 1;
+  p_output.resize(blocks * CRYPTOAES_BLOCK);
+  BYTE* output = p_output.data();
+
+  // PKCS#7 padding: always at least one byte
+  size_t rest = p_size % CRYPTOAES_BLOCK;
+  BYTE   pad  = (BYTE)(CRYPTOAES_BLOCK - rest);
+  memcpy(output,p_input,p_size);
+  memset(output + p_size,pad,pad);
+
+#ifdef CRYPTOAES_AESNI
+  if(g_accelerate)
+  {
+    Encrypt_AESNI(p_key,output,output,blocks);
+    return;
+  }
+#endif
+  BYTE feedback[CRYPTOAES_BLOCK] = { 0 };
+  for(size_t block = 0; block < blocks; ++block)
+  {
+    BYTE* data = output + block * CRYPTOAES_BLOCK;
+    for(int index = 0; index < CRYPTOAES_BLOCK; ++index)
+    {
+      data[index] ^= feedback[index];
+    }
+    EncryptBlock_Portable(p_key,data);
+    memcpy(feedback,data,CRYPTOAES_BLOCK);
+  }
+}
+
+// Decrypt a buffer in CBC mode. Fails on a wrong length or wrong padding
+bool
+CryptoAES::Decrypt(const AESKey& p_key,const BYTE* p_input,size_t p_size,std::vector<BYTE>& p_output)
+{
+  if(p_size == 0 || (p_size % CRYPTOAES_BLOCK) != 0)
+  {
+    return false;
+  }
+  size_t blocks = p_size / CRYPTOAES_BLOCK;
+  p_output.resize(p_size);
+  BYTE* output = p_output.data();
+
+#ifdef CRYPTOAES_AESNI
+  if(g_accelerate)
+  {
+    Decrypt_AESNI(p_key,p_input,output,blocks);
+  }
+  else
+#endif
+  {
+    BYTE feedback[CRYPTOAES_BLOCK] = { 0 };
+    for(size_t block = 0; block < blocks; ++block)
+    {
+      BYTE* data = output + block * CRYPTOAES_BLOCK;
+      memcpy(data,p_input + block * CRYPTOAES_BLOCK,CRYPTOAES_BLOCK);
+      DecryptBlock_Portable(p_key,data);
+      for(int index = 0; index < CRYPTOAES_BLOCK; ++index)
+      {
+        data[index] ^= feedback[index];
+      }
+      memcpy(feedback,p_input + block * CRYPTOAES_BLOCK,CRYPTOAES_BLOCK);
+    }
+  }
+
+  // Check and remove the padding
+  BYTE pad = output[p_size - 1];
+  if(pad == 0 || pad > CRYPTOAES_BLOCK)
+  {
+    return false;
+  }
+  for(size_t index = p_size - pad; index < p_size; ++index)
+  {
+    if(output[index] != pad)
+    {
+      return false;
+    }
+  }
+  p_output.resize(p_size - pad);
+  return true;
+}
+
+bool
+CryptoAES::GetAcceleration()
+{
+  return g_accelerate;
+}
+
+// Can only be switched on if the processor has the instructions
+void
+CryptoAES::SetAcceleration(bool p_accelerate)
+{
+  g_accelerate = p_accelerate && g_hasAES;
+}
+
+void
+CryptoAES::FlushCache()
+{
+  AutoCritSec lock(&g_cacheLock);
+  SecureZeroMemory(g_cache,sizeof(g_cache));
+}
@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: CryptoAES.h
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// // Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//////////////////////////////////////////////////////////////////////////
+//
+// Bulk AES-CBC on byte buffers, with a cache of derived keys
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <vector>
+
+// Same cipher as the CryptoAPI provider of the Crypto class used:
+// Key is the first bytes of the SHA-256 hash of the password (CryptDeriveKey),
+// CBC mode with an initialization vector of zero and PKCS#7 padding.
+// Uses the AES instructions of the processor if present.
+
+#define CRYPTOAES_BLOCK        16   // AES block size
+#define CRYPTOAES_MAXROUNDS    14   // AES-256
+#define CRYPTOAES_CACHE        32   // Derived keys kept for the shared passwords
+
+// Expanded key schedule of one key
+typedef struct _aesKey
+{
+  int   m_rounds;                                               // 10, 12 or 14
+  BYTE  m_encrypt[(CRYPTOAES_MAXROUNDS + 1) * CRYPTOAES_BLOCK]; // Round keys
+  BYTE  m_decrypt[(CRYPTOAES_MAXROUNDS + 1) * CRYPTOAES_BLOCK]; // For the AES instructions
+}
+AESKey;
+
+class CryptoAES
+{
+public:
+  // Key schedule of a password for CALG_AES_128/192/256. Cached by hash of the password
+  static bool   DeriveKey(const void* p_password,size_t p_size,unsigned p_algorithm,AESKey& p_key);
+  // Key schedule of a raw key of 16, 24 or 32 bytes
+  static bool   SetKey(const BYTE* p_key,size_t p_size,AESKey& p_schedule);
+
+  // Bulk encryption/decryption of a buffer
+  static void   Encrypt(const AESKey& p_key,const BYTE* p_input,size_t p_size,std::vector<BYTE>& p_output);
+  static bool   Decrypt(const AESKey& p_key,const BYTE* p_input,size_t p_size,std::vector<BYTE>& p_output);
+
+  // Using the AES instructions of the processor?
+  static bool   GetAcceleration();
+  // Switch the AES instructions off (testing the portable fallback) or back on
+  static void   SetAcceleration(bool p_accelerate);
+  // Forget all derived keys
+  static void   FlushCache();
+};
@@ -0,0 +1,637 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: CryptoHash.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// // Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "CryptoHash.h"
+#include <wincrypt.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <immintrin.h>
+#define CRYPTOHASH_SHANI
+#endif
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// CONSTANTS AND HELPERS
+//
+//////////////////////////////////////////////////////////////////////////
+
+static const DWORD K256[64] =
+{
+  0x428a2f98,0x71374491,0xb5c0fbcf,0xe9b5dba5,0x3956c25b,0x59f111f1,0x923f82a4,0xab1c5ed5
+ ,0xd807aa98,0x12835b01,0x243185be,0x550c7dc3,0x72be5d74,0x80deb1fe,0x9bdc06a7,0xc19bf174
+ ,0xe49b69c1,0xefbe4786,0x0fc19dc6,0x240ca1cc,0x2de92c6f,0x4a7484aa,0x5cb0a9dc,0x76f988da
+ ,0x983e5152,0xa831c66d,0xb00327c8,0xbf597fc7,0xc6e00bf3,0xd5a79147,0x06ca6351,0x14292967
+ ,0x27b70a85,0x2e1b2138,0x4d2c6dfc,0x53380d13,0x650a7354,0x766a0abb,0x81c2c92e,0x92722c85
+ ,0xa2bfe8a1,0xa81a664b,0xc24b8b70,0xc76c51a3,0xd192e819,0xd6990624,0xf40e3585,0x106aa070
+ ,0x19a4c116,0x1e376c08,0x2748774c,0x34b0bcb5,0x391c0cb3,0x4ed8aa4a,0x5b9cca4f,0x682e6ff3
+ ,0x748f82ee,0x78a5636f,0x84c87814,0x8cc70208,0x90befffa,0xa4506ceb,0xbef9a3f7,0xc67178f2
+};
+
+static const ULONG64 K512[80] =
+{
+  0x428a2f98d728ae22ULL,0x7137449123ef65cdULL,0xb5c0fbcfec4d3b2fULL,0xe9b5dba58189dbbcULL
+ ,0x3956c25bf348b538ULL,0x59f111f1b605d019ULL,0x923f82a4af194f9bULL,0xab1c5ed5da6d8118ULL
+ ,0xd807aa98a3030242ULL,0x12835b0145706fbeULL,0x243185be4ee4b28cULL,0x550c7dc3d5ffb4e2ULL
+ ,0x72be5d74f27b896fULL,0x80deb1fe3b1696b1ULL,0x9bdc06a725c71235ULL,0xc19bf174cf692694ULL
+ ,0xe49b69c19ef14ad2ULL,0xefbe4786384f25e3ULL,0x0fc19dc68b8cd5b5ULL,0x240ca1cc77ac9c65ULL
+ ,0x2de92c6f592b0275ULL,0x4a7484aa6ea6e483ULL,0x5cb0a9dcbd41fbd4ULL,0x76f988da831153b5ULL
+ ,0x983e5152ee66dfabULL,0xa831c66d2db43210ULL,0xb00327c898fb213fULL,0xbf597fc7beef0ee4ULL
+ ,0xc6e00bf33da88fc2ULL,0xd5a79147930aa725ULL,0x06ca6351e003826fULL,0x142929670a0e6e70ULL
+ ,0x27b70a8546d22ffcULL,0x2e1b21385c26c926ULL,0x4d2c6dfc5ac42aedULL,0x53380d139d95b3dfULL
+ ,0x650a73548baf63deULL,0x766a0abb3c77b2a8ULL,0x81c2c92e47edaee6ULL,0x92722c851482353bULL
+ ,0xa2bfe8a14cf10364ULL,0xa81a664bbc423001ULL,0xc24b8b70d0f89791ULL,0xc76c51a30654be30ULL
+ ,0xd192e819d6ef5218ULL,0xd69906245565a910ULL,0xf40e35855771202aULL,0x106aa07032bbd1b8ULL
+ ,0x19a4c116b8d2d0c8ULL,0x1e376c085141ab53ULL,0x2748774cdf8eeb99ULL,0x34b0bcb5e19b48a8ULL
+ ,0x391c0cb3c5c95a63ULL,0x4ed8aa4ae3418acbULL,0x5b9cca4f7763e373ULL,0x682e6ff3d6b2b8a3ULL
+ ,0x748f82ee5defb2fcULL,0x78a5636f43172f60ULL,0x84c87814a1f0ab72ULL,0x8cc702081a6439ecULL
+ ,0x90befffa23631e28ULL,0xa4506cebde82bde9ULL,0xbef9a3f7b2c67915ULL,0xc67178f2e372532bULL
+ ,0xca273eceea26619cULL,0xd186b8c721c0c207ULL,0xeada7dd6cde0eb1eULL,0xf57d4f7fee6ed178ULL
+ ,0x06f067aa72176fbaULL,0x0a637dc5a2c898a6ULL,0x113f9804bef90daeULL,0x1b710b35131c471bULL
+ ,0x28db77f523047d84ULL,0x32caab7b40c72493ULL,0x3c9ebe0a15c9bebcULL,0x431d67c49c100d4cULL
+ ,0x4cc5d4becb3e42b6ULL,0x597f299cfc657e2aULL,0x5fcb6fab3ad6faecULL,0x6c44198c4a475817ULL
+};
+
+static const DWORD   IV_SHA1[5]   = { 0x67452301,0xefcdab89,0x98badcfe,0x10325476,0xc3d2e1f0 };
+static const DWORD   IV_SHA256[8] = { 0x6a09e667,0xbb67ae85,0x3c6ef372,0xa54ff53a,0x510e527f,0x9b05688c,0x1f83d9ab,0x5be0cd19 };
+static const ULONG64 IV_SHA384[8] =
+{
+  0xcbbb9d5dc1059ed8ULL,0x629a292a367cd507ULL,0x9159015a3070dd17ULL,0x152fecd8f70e5939ULL
+ ,0x67332667ffc00b31ULL,0x8eb44a8768581511ULL,0xdb0c2e0d64f98fa7ULL,0x47b5481dbefa4fa4ULL
+};
+static const ULONG64 IV_SHA512[8] =
+{
+  0x6a09e667f3bcc908ULL,0xbb67ae8584caa73bULL,0x3c6ef372fe94f82bULL,0xa54ff53a5f1d36f1ULL
+ ,0x510e527fade682d1ULL,0x9b05688c2b3e6c1fULL,0x1f83d9abfb41bd6bULL,0x5be0cd19137e2179ULL
+};
+
+static inline DWORD   Rotl32(DWORD   x,int n) { return (x << n) | (x >> (32 - n)); }
+static inline DWORD   Rotr32(DWORD   x,int n) { return (x >> n) | (x << (32 - n)); }
+static inline ULONG64 Rotr64(ULONG64 x,int n) { return (x >> n) | (x << (64 - n)); }
+
+static inline DWORD
+Load32(const BYTE* p)
+{
+  return ((DWORD)p[0] << 24) | ((DWORD)p[1] << 16) | ((DWORD)p[2] << 8) | (DWORD)p[3];
+}
+
+static inline ULONG64
+Load64(const BYTE* p)
+{
+  return ((ULONG64)Load32(p) << 32) | (ULONG64)Load32(p + 4);
+}
+
+static inline void
+Store32(BYTE* p,DWORD v)
+{
+  p[0] = (BYTE)(v >> 24);
+  p[1] = (BYTE)(v >> 16);
+  p[2] = (BYTE)(v >>  8);
+  p[3] = (BYTE)(v);
+}
+
+static inline void
+Store64(BYTE* p,ULONG64 v)
+{
+  Store32(p,    (DWORD)(v >> 32));
+  Store32(p + 4,(DWORD)(v));
+}
+
+static size_t
+BlockSize(unsigned p_method)
+{
+  return (p_method == CALG_SHA_384 || p_method == CALG_SHA_512) ? 128 : 64;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PORTABLE KERNELS
+//
+//////////////////////////////////////////////////////////////////////////
+
+static void
+SHA1_Portable(DWORD* p_state,const BYTE* p_data,size_t p_blocks)
+{
+  DWORD w[80];
+  while(p_blocks--)
+  {
+    for(int t = 0; t < 16; ++t)
+    {
+      w[t] = Load32(p_data + 4 * t);
+    }
+    for(int t = 16; t < 80; ++t)
+    {
+      w[t] = Rotl32(w[t - 3] ^ w[t - 8] ^ w[t - 14] ^ w[t - 16],1);
+    }
+    DWORD a = p_state[0],b = p_state[1],c = p_state[2],d = p_state[3],e = p_state[4];
+    for(int t = 0; t < 80; ++t)
+    {
+      DWORD f,k;
+      if(t < 20)      { f = (b & c) | (~b & d);          k = 0x5a827999; }
+      else if(t < 40) { f = b ^ c ^ d;                   k = 0x6ed9eba1; }
+      else if(t < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8f1bbcdc; }
+      else            { f = b ^ c ^ d;                   k = 0xca62c1d6; }
+      DWORD temp = Rotl32(a,5) + f + e + k + w[t];
+      e = d;
+      d = c;
+      c = Rotl32(b,30);
+      b = a;
+      a = temp;
+    }
+    p_state[0] += a;
+    p_state[1] += b;
+    p_state[2] += c;
+    p_state[3] += d;
+    p_state[4] += e;
+    p_data += 64;
+  }
+}
+
+static void
+SHA256_Portable(DWORD* p_state,const BYTE* p_data,size_t p_blocks)
+{
+  DWORD w[64];
+  while(p_blocks--)
+  {
+    for(int t = 0; t < 16; ++t)
+    {
+      w[t] = Load32(p_data + 4 * t);
+    }
+    for(int t = 16; t < 64; ++t)
+    {
+      DWORD s0 = Rotr32(w[t - 15], 7) ^ Rotr32(w[t - 15],18) ^ (w[t - 15] >>  3);
+      DWORD s1 = Rotr32(w[t -  2],17) ^ Rotr32(w[t -  2],19) ^ (w[t -  2] >> 10);
+      w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    DWORD a = p_state[0],b = p_state[1],c = p_state[2],d = p_state[3];
+    DWORD e = p_state[4],f = p_state[5],g = p_state[6],h = p_state[7];
+    for(int t = 0; t < 64; ++t)
+    {
+      DWORD S1 = Rotr32(e,6) ^ Rotr32(e,11) ^ Rotr32(e,25);
+      DWORD ch = (e & f) ^ (~e & g);
+      DWORD t1 = h + S1 + ch + K256[t] + w[t];
+      DWORD S0 = Rotr32(a,2) ^ Rotr32(a,13) ^ Rotr32(a,22);
+      DWORD mj = (a & b) ^ (a & c) ^ (b & c);
+      DWORD t2 = S0 + mj;
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    p_state[0] += a;
+    p_state[1] += b;
+    p_state[2] += c;
+    p_state[3] += d;
+    p_state[4] += e;
+    p_state[5] += f;
+    p_state[6] += g;
+    p_state[7] += h;
+    p_data += 64;
+  }
+}
+
+// SHA-384 is SHA-512 with another start value and a shorter digest
+static void
+SHA512_Portable(ULONG64* p_state,const BYTE* p_data,size_t p_blocks)
+{
+  ULONG64 w[80];
+  while(p_blocks--)
+  {
+    for(int t = 0; t < 16; ++t)
+    {
+      w[t] = Load64(p_data + 8 * t);
+    }
+    for(int t = 16; t < 80; ++t)
+    {
+      ULONG64 s0 = Rotr64(w[t - 15], 1) ^ Rotr64(w[t - 15], 8) ^ (w[t - 15] >> 7);
+      ULONG64 s1 = Rotr64(w[t -  2],19) ^ Rotr64(w[t -  2],61) ^ (w[t -  2] >> 6);
+      w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+    }
+    ULONG64 a = p_state[0],b = p_state[1],c = p_state[2],d = p_state[3];
+    ULONG64 e = p_state[4],f = p_state[5],g = p_state[6],h = p_state[7];
+    for(int t = 0; t < 80; ++t)
+    {
+      ULONG64 S1 = Rotr64(e,14) ^ Rotr64(e,18) ^ Rotr64(e,41);
+      ULONG64 ch = (e & f) ^ (~e & g);
+      ULONG64 t1 = h + S1 + ch + K512[t] + w[t];
+      ULONG64 S0 = Rotr64(a,28) ^ Rotr64(a,34) ^ Rotr64(a,39);
+      ULONG64 mj = (a & b) ^ (a & c) ^ (b & c);
+      ULONG64 t2 = S0 + mj;
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    p_state[0] += a;
+    p_state[1] += b;
+    p_state[2] += c;
+    p_state[3] += d;
+    p_state[4] += e;
+    p_state[5] += f;
+    p_state[6] += g;
+    p_state[7] += h;
+    p_data += 128;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// KERNELS WITH THE SHA EXTENSIONS OF THE PROCESSOR
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifdef CRYPTOHASH_SHANI
+
+// SHA extensions need SSSE3 and SSE4.1 as well
+static bool
+DetectSHAExtensions()
+{
+  int info[4] = { 0,0,0,0 };
+  __cpuidex(info,0,0);
+  if(info[0] < 7)
+  {
+    return false;
+  }
+  __cpuidex(info,1,0);
+  bool ssse3 = (info[2] & (1 <<  9)) != 0;
+  bool sse41 = (info[2] & (1 << 19)) != 0;
+  __cpuidex(info,7,0);
+  bool sha   = (info[1] & (1 << 29)) != 0;
+  return ssse3 && sse41 && sha;
+}
+
+static void
+SHA1_Extensions(DWORD* p_state,const BYTE* p_data,size_t p_blocks)
+{
+  const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,0x08090a0b0c0d0e0fULL);
+
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)p_state),0x1B);
+  __m128i e0   = _mm_set_epi32((int)p_state[4],0,0,0);
+
+  while(p_blocks--)
+  {
+    __m128i abcdSave = abcd;
+    __m128i e0Save   = e0;
+    __m128i previous = abcd;
+    __m128i msg[4];
+    __m128i e;
+
+    // 20 groups of 4 rounds. The schedule runs 4 words at a time
+    for(int group = 0; group < 20; ++group)
+    {
+      __m128i w;
+      if(group < 4)
+      {
+        w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p_data + 16 * group)),mask);
+      }
+      else
+      {
+        w = _mm_sha1msg1_epu32(msg[group & 3],msg[(group + 1) & 3]);
+        w = _mm_xor_si128(w,msg[(group + 2) & 3]);
+        w = _mm_sha1msg2_epu32(w,msg[(group + 3) & 3]);
+      }
+      msg[group & 3] = w;
+
+      e = (group == 0) ? _mm_add_epi32(e0,w) : _mm_sha1nexte_epu32(previous,w);
+      previous = abcd;
+      switch(group / 5)
+      {
+        case 0: abcd = _mm_sha1rnds4_epu32(abcd,e,0); break;
+        case 1: abcd = _mm_sha1rnds4_epu32(abcd,e,1); break;
+        case 2: abcd = _mm_sha1rnds4_epu32(abcd,e,2); break;
+        default:abcd = _mm_sha1rnds4_epu32(abcd,e,3); break;
+      }
+    }
+    e0   = _mm_sha1nexte_epu32(previous,e0Save);
+    abcd = _mm_add_epi32(abcd,abcdSave);
+    p_data += 64;
+  }
+
+  _mm_storeu_si128((__m128i*)p_state,_mm_shuffle_epi32(abcd,0x1B));
+  p_state[4] = (DWORD)_mm_extract_epi32(e0,3);
+}
+
+static void
+SHA256_Extensions(DWORD* p_state,const BYTE* p_data,size_t p_blocks)
+{
+  const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,0x0405060700010203ULL);
+
+  // State as ABEF and CDGH for the round instructions
+  __m128i temp   = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&p_state[0]),0xB1);
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&p_state[4]),0x1B);
+  __m128i state0 = _mm_alignr_epi8(temp,state1,8);
+  state1 = _mm_blend_epi16(state1,temp,0xF0);
+
+  while(p_blocks--)
+  {
+    __m128i abefSave = state0;
+    __m128i cdghSave = state1;
+    __m128i msg[4];
+
+    // 16 groups of 4 rounds. The schedule runs 4 words at a time
+    for(int group = 0; group < 16; ++group)
+    {
+      __m128i w;
+      if(group < 4)
+      {
+        w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(p_data + 16 * group)),mask);
+      }
+      else
+      {
+        w = _mm_sha256msg1_epu32(msg[group & 3],msg[(group + 1) & 3]);
+        w = _mm_add_epi32(w,_mm_alignr_epi8(msg[(group + 3) & 3],msg[(group + 2) & 3],4));
+        w = _mm_sha256msg2_epu32(w,msg[(group + 3) & 3]);
+      }
+      msg[group & 3] = w;
+
+      __m128i k = _mm_add_epi32(w,_mm_loadu_si128((const __m128i*)&K256[4 * group]));
+      state1 = _mm_sha256rnds2_epu32(state1,state0,k);
+      state0 = _mm_sha256rnds2_epu32(state0,state1,_mm_shuffle_epi32(k,0x0E));
+    }
+    state0 = _mm_add_epi32(state0,abefSave);
+    state1 = _mm_add_epi32(state1,cdghSave);
+    p_data += 64;
+  }
+
+  // Back to ABCD and EFGH
+  temp   = _mm_shuffle_epi32(state0,0x1B);
+  state1 = _mm_shuffle_epi32(state1,0xB1);
+  state0 = _mm_blend_epi16(temp,state1,0xF0);
+  state1 = _mm_alignr_epi8(state1,temp,8);
+  _mm_storeu_si128((__m128i*)&p_state[0],state0);
+  _mm_storeu_si128((__m128i*)&p_state[4],state1);
+}
+
+static bool g_hasExtensions = DetectSHAExtensions();
+#else
+static bool g_hasExtensions = false;
+#endif
+
+// Use the extensions if the processor has them
+static volatile bool g_accelerate = g_hasExtensions;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// CryptoHash
+//
+//////////////////////////////////////////////////////////////////////////
+
+CryptoHash::CryptoHash()
+{
+  ZeroMemory(&m_state,sizeof(HashState));
+}
+
+CryptoHash::CryptoHash(unsigned p_method)
+{
+  Init(m_state,p_method);
+}
+
+bool
+CryptoHash::Init(unsigned p_method)
+{
+  return Init(m_state,p_method);
+}
+
+void
+CryptoHash::Update(const void* p_data,size_t p_size)
+{
+  Update(m_state,static_cast<const BYTE*>(p_data),p_size);
+}
+
+size_t
+CryptoHash::Final(BYTE* p_digest)
+{
+  return Final(m_state,p_digest);
+}
+
+// One-shot hashing on the reusable context of the calling thread.
+// Nothing is shared between threads, so nothing needs a lock
+size_t
+CryptoHash::Hash(unsigned p_method,const void* p_data,size_t p_size,BYTE* p_digest)
+{
+  static __declspec(thread) HashState state;
+
+  if(!Init(state,p_method))
+  {
+    return 0;
+  }
+  Update(state,static_cast<const BYTE*>(p_data),p_size);
+  return Final(state,p_digest);
+}
+
+bool
+CryptoHash::IsSupported(unsigned p_method)
+{
+  return GetHashSize(p_method) > 0;
+}
+
+size_t
+CryptoHash::GetHashSize(unsigned p_method)
+{
+  switch(p_method)
+  {
+    case CALG_SHA1:    return 20;
+    case CALG_SHA_256: return 32;
+    case CALG_SHA_384: return 48;
+    case CALG_SHA_512: return 64;
+    default:           return 0;
+  }
+}
+
+bool
+CryptoHash::GetAcceleration()
+{
+  return g_accelerate;
+}
+
+// Can only be switched on if the processor has the extensions
+void
+CryptoHash::SetAcceleration(bool p_accelerate)
+{
+  g_accelerate = p_accelerate && g_hasExtensions;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+bool
+CryptoHash::Init(HashState& p_state,unsigned p_method)
+{
+  p_state.m_method = p_method;
+  p_state.m_length = 0;
+  p_state.m_used   = 0;
+
+  switch(p_method)
+  {
+    case CALG_SHA1:    memcpy(p_state.m_state32,IV_SHA1,  sizeof(IV_SHA1));   return true;
+    case CALG_SHA_256: memcpy(p_state.m_state32,IV_SHA256,sizeof(IV_SHA256)); return true;
+    case CALG_SHA_384: memcpy(p_state.m_state64,IV_SHA384,sizeof(IV_SHA384)); return true;
+    case CALG_SHA_512: memcpy(p_state.m_state64,IV_SHA512,sizeof(IV_SHA512)); return true;
+    default:           p_state.m_method = 0;                                  return false;
+  }
+}
+
+void
+CryptoHash::Update(HashState& p_state,const BYTE* p_data,size_t p_size)
+{
+  if(p_state.m_method == 0 || p_size == 0)
+  {
+    return;
+  }
+  size_t block = BlockSize(p_state.m_method);
+  p_state.m_length += p_size;
+
+  // Complete a waiting block first
+  if(p_state.m_used)
+  {
+    size_t part = block - p_state.m_used;
+    if(part > p_size)
+    {
+      part = p_size;
+    }
+    memcpy(p_state.m_block + p_state.m_used,p_data,part);
+    p_state.m_used += part;
+    p_data += part;
+    p_size -= part;
+    if(p_state.m_used < block)
+    {
+      return;
+    }
+    Compress(p_state,p_state.m_block,1);
+    p_state.m_used = 0;
+  }
+  // All whole blocks straight from the input
+  if(p_size >= block)
+  {
+    size_t blocks = p_size / block;
+    Compress(p_state,p_data,blocks);
+    p_data += blocks * block;
+    p_size -= blocks * block;
+  }
+  // Keep the rest for the next update
+  if(p_size)
+  {
+    memcpy(p_state.m_block,p_data,p_size);
+    p_state.m_used = p_size;
+  }
+}
+
+size_t
+CryptoHash::Final(HashState& p_state,BYTE* p_digest)
+{
+  unsigned method = p_state.m_method;
+  size_t   size   = GetHashSize(method);
+  if(size == 0)
+  {
+    return 0;
+  }
+  // Padding: one bit, zeros and the length in bits at the end of a block
+  size_t  block  = BlockSize(method);
+  size_t  length = (block == 128) ? 16 : 8;
+  ULONG64 bits   = p_state.m_length * 8;
+
+  p_state.m_block[p_state.m_used++] = 0x80;
+  if(p_state.m_used > block - length)
+  {
+    memset(p_state.m_block + p_state.m_used,0,block - p_state.m_used);
+    Compress(p_state,p_state.m_block,1);
+    p_state.m_used = 0;
+  }
+  memset(p_state.m_block + p_state.m_used,0,block - p_state.m_used);
+  Store64(p_state.m_block + block - 8,bits);
+  Compress(p_state,p_state.m_block,1);
+
+  // Big-endian digest
+  if(block == 64)
+  {
+    for(size_t index = 0; index < size / 4; ++index)
+    {
+      Store32(p_digest + 4 * index,p_state.m_state32[index]);
+    }
+  }
+  else
+  {
+    for(size_t index = 0; index < size / 8; ++index)
+    {
+      Store64(p_digest + 8 * index,p_state.m_state64[index]);
+    }
+  }
+  // Ready for the same method again
+  Init(p_state,method);
+  return size;
+}
+
+void
+CryptoHash::Compress(HashState& p_state,const BYTE* p_data,size_t p_blocks)
+{
+  switch(p_state.m_method)
+  {
+    case CALG_SHA1:
+#ifdef CRYPTOHASH_SHANI
+      if(g_accelerate)
+      {
+        SHA1_Extensions(p_state.m_state32,p_data,p_blocks);
+        break;
+      }
+#endif
+      SHA1_Portable(p_state.m_state32,p_data,p_blocks);
+      break;
+    case CALG_SHA_256:
+#ifdef CRYPTOHASH_SHANI
+      if(g_accelerate)
+      {
+        SHA256_Extensions(p_state.m_state32,p_data,p_blocks);
+        break;
+      }
+#endif
+      SHA256_Portable(p_state.m_state32,p_data,p_blocks);
+      break;
+    case CALG_SHA_384:
+    case CALG_SHA_512:
+      SHA512_Portable(p_state.m_state64,p_data,p_blocks);
+      break;
+  }
+}
@@ -0,0 +1,88 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: CryptoHash.h
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// // Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//////////////////////////////////////////////////////////////////////////
+//
+// Built-in hashing of the SHA family, without provider and without lock
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Hash methods are the CALG_* numbers of the Crypto class:
+// CALG_SHA1, CALG_SHA_256, CALG_SHA_384 and CALG_SHA_512
+//
+// SHA-1 and SHA-256 use the SHA extensions of the processor if present.
+// All methods have a portable implementation, used as the fallback.
+
+#define CRYPTOHASH_MAXSIZE   64   // Largest digest (SHA-512)
+#define CRYPTOHASH_BLOCK    128   // Largest block  (SHA-384/512)
+
+// The hashing context. Plain data, so every thread can keep its own
+typedef struct _hashState
+{
+  unsigned  m_method;                     // CALG_* hash method
+  ULONG64   m_length;                     // Total bytes hashed so far
+  size_t    m_used;                       // Bytes waiting in the block
+  DWORD     m_state32[8];                 // SHA-1 and SHA-256
+  ULONG64   m_state64[8];                 // SHA-384 and SHA-512
+  BYTE      m_block[CRYPTOHASH_BLOCK];    // Incomplete block
+}
+HashState;
+
+class CryptoHash
+{
+public:
+  CryptoHash();
+  explicit CryptoHash(unsigned p_method);
+
+  // Incremental hashing
+  bool          Init(unsigned p_method);
+  void          Update(const void* p_data,size_t p_size);
+  // Get the digest. Context is ready for the same method again
+  size_t        Final(BYTE* p_digest);
+
+  // One-shot hashing on the reusable context of the calling thread
+  static size_t Hash(unsigned p_method,const void* p_data,size_t p_size,BYTE* p_digest);
+
+  // Is this method built-in?
+  static bool   IsSupported(unsigned p_method);
+  // Size of the digest in bytes, or 0 if not supported
+  static size_t GetHashSize(unsigned p_method);
+  // Using the SHA extensions of the processor?
+  static bool   GetAcceleration();
+  // Switch the SHA extensions off (testing the portable fallback) or back on
+  static void   SetAcceleration(bool p_accelerate);
+
+private:
+  static bool   Init    (HashState& p_state,unsigned p_method);
+  static void   Update  (HashState& p_state,const BYTE* p_data,size_t p_size);
+  static size_t Final   (HashState& p_state,BYTE* p_digest);
+  static void   Compress(HashState& p_state,const BYTE* p_data,size_t p_blocks);
+
+  HashState     m_state;
+};
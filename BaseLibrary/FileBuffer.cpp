@@ -84,17 +84,8 @@ FileBuffer::FileBuffer(FileBuffer& p_orig)
     m_buffer[m_binaryLength + 1] = 0;
   }
 
-  // If it had buffer parts, duplicate them
-  for(const auto& part : p_orig.m_parts)
-  {
-    BufPart dupli;
-    dupli.m_length = part.m_length;
-    dupli.m_buffer = new uchar[dupli.m_length + 2];
-    memcpy(dupli.m_buffer,part.m_buffer,dupli.m_length);
-    dupli.m_buffer[part.m_length    ] = 0;
-    dupli.m_buffer[part.m_length + 1] = 0;
-    m_parts.push_back(dupli);
-  }
+  // If it had buffer parts, share them. Parts never change after adding
+  m_parts = p_orig.m_parts;
 }
 
 FileBuffer::~FileBuffer()
@@ -113,11 +104,7 @@ FileBuffer::Reset()
     m_buffer = NULL;
   }
   // Free buffer parts
-  for(const auto& part : m_parts)
-  {
-    delete [] part.m_buffer;
-  }
-  m_parts.clear();
+  m_parts.Reset();
   // Close file handle
   if((m_file > 0) && (m_file != INVALID_HANDLE_VALUE))
   {
@@ -154,14 +141,9 @@ FileBuffer::GetLength()
   }
 
   // See if we do it in parts
-  if(m_parts.size())
+  if(m_parts.GetNumberOfSlices())
   {
-    size_t length = 0;
-    for(const auto& part : m_parts)
-    {
-      length += part.m_length;
-    }
-    return length;
+    return (size_t)m_parts.GetLength();
   }
   // Return in one go
   return m_binaryLength;
@@ -186,15 +168,7 @@ FileBuffer::SetBuffer(uchar* p_buffer,size_t p_length)
 void    
 FileBuffer::AddBuffer(uchar* p_buffer,size_t p_length)
 {
-  BufPart part;
-  part.m_buffer = new uchar[p_length + 2];
-  part.m_length = p_length;
-
-  memcpy(part.m_buffer,p_buffer,p_length);
-  part.m_buffer[p_length    ] = 0;
-  part.m_buffer[p_length + 1] = 0;
-  // Keep the buffer part
-  m_parts.push_back(part);
+  m_parts.AddCopy(p_buffer,p_length);
 }
 
 // Add buffer part + CRLF
@@ -202,23 +176,32 @@ FileBuffer::AddBuffer(uchar* p_buffer,size_t p_length)
 void
 FileBuffer::AddBufferCRLF(uchar* p_buffer,size_t p_length)
 {
-  BufPart part;
-  part.m_buffer = new uchar[p_length + 3];
-  part.m_length = p_length;
-
-  if(part.m_buffer)
+  uchar* buffer = new uchar[p_length + 3];
+  memcpy(buffer,p_buffer,p_length);
+  if(p_length == 0 || p_buffer[p_length-1] != '\n')
   {
-    memcpy(part.m_buffer,p_buffer,p_length);
-    if(p_buffer[p_length-1] != '\n')
-    {
-      *(part.m_buffer + p_length++) = '\r';
-      *(part.m_buffer + p_length++) = '\n';
-      part.m_length = p_length;
-    }
-    *(part.m_buffer + p_length) = 0;
+    buffer[p_length++] = '\r';
+    buffer[p_length++] = '\n';
   }
+  buffer[p_length] = 0;
   // Keep the buffer part
-  m_parts.push_back(part);
+  m_parts.AddOwned(buffer,p_length);
+}
+
+// Add buffer part allocated with 'new uchar[]'
+// Saves a copy for buffers that were converted/serialized anyway
+void
+FileBuffer::AddBufferOwned(uchar* p_buffer,size_t p_length)
+{
+  m_parts.AddOwned(p_buffer,p_length);
+}
+
+// Add all parts of a buffer chain
+// The parts are shared: nothing gets copied
+void
+FileBuffer::AddBufferChain(const BufferChain& p_chain)
+{
+  m_parts.Append(p_chain);
 }
 
 // Specialized add a string (FormData protocol)
@@ -248,7 +231,7 @@ FileBuffer::AddStringToBuffer(XString p_string,XString p_charset,bool p_crlf/*=t
 bool    
 FileBuffer::AllocateBuffer(size_t p_length)
 {
-  if(m_parts.empty())
+  if(!GetHasBufferParts())
   {
     if(m_binaryLength == 0)
     {
@@ -264,7 +247,7 @@ FileBuffer::AllocateBuffer(size_t p_length)
 void
 FileBuffer::GetBuffer(uchar*& p_buffer,size_t& p_length)
 {
-  if(m_parts.size())
+  if(GetHasBufferParts())
   {
     // CANNOT GET IT. Indicate the length
     p_buffer = NULL;
@@ -281,15 +264,14 @@ bool
 FileBuffer::GetBufferPart(unsigned p_index,uchar*& p_buffer,size_t& p_length)
 {
   // Read past end?
-  if(p_index >= m_parts.size())
+  const BufferSlice* slice = m_parts.GetSlice((int)p_index);
+  if(slice == nullptr || slice->m_block->GetKind() == BufferKind::BK_File)
   {
     return false;
   }
   // Get the part
-  const BufPart& part = m_parts[p_index];
-
-  p_buffer = part.m_buffer;
-  p_length = part.m_length;
+  p_buffer = const_cast<uchar*>(slice->m_block->GetData() + slice->m_offset);
+  p_length = (size_t)slice->m_length;
 
   return true;
 }
@@ -304,7 +286,7 @@ FileBuffer::GetBufferCopy(uchar*& p_buffer,size_t& p_length)
   p_buffer = new uchar[p_length + 2];
 
   // Optimize in one go
-  if(m_parts.empty())
+  if(!GetHasBufferParts())
   {
     if(m_buffer == nullptr) 
     {
@@ -314,15 +296,11 @@ FileBuffer::GetBufferCopy(uchar*& p_buffer,size_t& p_length)
     }
     memcpy(p_buffer,m_buffer,p_length + 2);
   }
-  else 
+  else if(!m_parts.CopyTo(p_buffer))
   {
-    DWORD_PTR dest = (DWORD_PTR) p_buffer;
-    for(unsigned ind = 0;ind < m_parts.size(); ++ind)
-    {
-      BufPart& part = m_parts[ind];
-      memcpy(reinterpret_cast<void*>(dest),part.m_buffer,part.m_length);
-      dest += part.m_length;
-    }
+    delete [] p_buffer;
+    p_buffer = nullptr;
+    return false;
   }
   // Zero delimiter of the buffer (UTF-16)
   p_buffer[p_length    ] = 0;
@@ -466,23 +444,10 @@ FileBuffer::WriteFile()
 
   DWORD written = 0;
 
-  if(m_parts.size())
+  if(GetHasBufferParts())
   {
-    // Write the parts
-    DWORD part = 0;
-    Parts::iterator it;
-    for(it = m_parts.begin();it != m_parts.end(); ++it)
-    {
-      if(::WriteFile(m_file,it->m_buffer,(DWORD)it->m_length,&part,NULL))
-      {
-        written += part;
-      }
-    }
-    // Check if everything is written
-    if(written >= (DWORD)GetLength())
-    {
-      result = true;
-    }
+    // Write all parts, including the regions of other files
+    result = m_parts.WriteTo(m_file);
   }
   else
   {
@@ -534,17 +499,8 @@ FileBuffer::operator=(FileBuffer& p_orig)
     m_buffer[m_binaryLength    ] = 0;
     m_buffer[m_binaryLength + 1] = 0;
   }
-  // If it had buffer parts, duplicate them
-  for(const auto& part : p_orig.m_parts)
-  {
-    BufPart  dupli;
-    dupli.m_length = part.m_length;
-    dupli.m_buffer = new uchar[dupli.m_length + 2];
-    memcpy(dupli.m_buffer,part.m_buffer,dupli.m_length);
-    dupli.m_buffer[part.m_length    ] = 0;
-    dupli.m_buffer[part.m_length + 1] = 0;
-    m_parts.push_back(dupli);
-  }
+  // If it had buffer parts, share them
+  m_parts = p_orig.m_parts;
 
   // Return ourselves
   return *this;
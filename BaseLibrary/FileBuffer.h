@@ -26,7 +26,7 @@
 // THE SOFTWARE.
 //
 #pragma once
-#include <vector>
+#include "BufferChain.h"
 
 // Max streaming serialize/deserialize limit
 // Files bigger than this can only be putted/gotten by indirect file references
@@ -41,15 +41,6 @@
 extern unsigned long g_streaming_limit; // = STREAMING_LIMIT;
 extern unsigned long g_compress_limit;  // = COMPRESS_LIMIT;
 
-typedef struct _bufferPart
-{
-  size_t m_length;
-  uchar* m_buffer;
-}
-BufPart;
-
-using Parts = std::vector<BufPart>;
-
 class FileBuffer
 {
 public:
@@ -78,9 +69,14 @@ public:
   void    SetFileName(const XString& p_fileName);
   // Set the buffer in one go
   void    SetBuffer(uchar* p_buffer,size_t p_length);
-  // Add buffer part
+  // Add buffer part. Makes a copy, as the caller keeps its buffer.
+  // Without copying: AddBufferOwned, or AddBufferChain with a referenced block
   void    AddBuffer(uchar* p_buffer,size_t p_length);
   void    AddBufferCRLF(uchar* p_buffer,size_t p_length);
+  // Add buffer part allocated with 'new uchar[]'. The FileBuffer becomes the owner
+  void    AddBufferOwned(uchar* p_buffer,size_t p_length);
+  // Add all parts of a buffer chain without copying
+  void    AddBufferChain(const BufferChain& p_chain);
   void    AddStringToBuffer(XString p_string,XString p_charset,bool p_crlf = true);
   // Allocate a one-buffer block
   bool    AllocateBuffer(size_t p_length);
@@ -97,6 +93,8 @@ public:
   void    GetBuffer(uchar*& p_buffer,size_t& p_length);
   // Get a buffer part
   bool    GetBufferPart(unsigned p_index,uchar*& p_buffer,size_t& p_length);
+  // Get the buffer parts as a scatter/gather chain
+  const BufferChain& GetBufferChain();
   // Get a copy of the total buffer, call 'free' yourselves!
   bool    GetBufferCopy(uchar*& p_buffer,size_t& p_length);
   // Get the length of the buffer
@@ -124,13 +122,13 @@ private:
   HANDLE   m_file          { NULL };
   size_t   m_binaryLength  { NULL };
   uchar*   m_buffer        { nullptr };
-  Parts    m_parts;
+  BufferChain m_parts;     // Buffer parts, shared with copies of this buffer
 };
 
 inline bool
 FileBuffer::GetHasBufferParts()
 {
-  return m_parts.size() > 0;
+  return m_parts.GetNumberOfSlices() > 0;
 }
 
 inline void    
@@ -145,6 +143,12 @@ FileBuffer::GetFileName()
   return m_fileName;
 }
 
+inline const BufferChain&
+FileBuffer::GetBufferChain()
+{
+  return m_parts;
+}
+
 inline HANDLE
 FileBuffer::GetFileHandle()
 {
@@ -160,5 +164,5 @@ FileBuffer::ResetFilename()
 inline int
 FileBuffer::GetNumberOfParts()
 {
-  return (int)m_parts.size();
+  return m_parts.GetNumberOfSlices();
 }
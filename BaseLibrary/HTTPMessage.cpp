@@ -34,6 +34,8 @@
 #include "Crypto.h"
 #include "HTTPTime.h"
 #include "MultiPartBuffer.h"
+#include "StringWriter.h"
+#include "JSONTranscoder.h"
 #include <xutility>
 #include <string>
 
@@ -133,7 +135,7 @@ HTTPMessage::HTTPMessage(HTTPMessage* p_msg,bool p_deep /*=false*/)
             ,m_contentType   (p_msg->m_contentType)
             ,m_acceptEncoding(p_msg->m_acceptEncoding)
             ,m_verbTunnel    (p_msg->m_verbTunnel)
-            ,m_url           (p_msg->m_url)
+            ,m_url           (p_msg->GetURL())
             ,m_site          (p_msg->m_site)
             ,m_desktop       (p_msg->m_desktop)
             ,m_ifmodified    (p_msg->m_ifmodified)
@@ -180,14 +182,14 @@ HTTPMessage::HTTPMessage(HTTPMessage* p_msg,bool p_deep /*=false*/)
 }
 
 // XTOR from a SOAPServerMessage
-HTTPMessage::HTTPMessage(HTTPCommand p_command,const SOAPMessage* p_msg)
+HTTPMessage::HTTPMessage(HTTPCommand p_command,const SOAPMessage* p_msg,bool p_asJson /*=false*/)
             :m_command       (p_command)
             ,m_request       (p_msg->GetRequestHandle())
             ,m_cookies       (p_msg->GetCookies())
             ,m_contentType   (p_msg->GetContentType())
             ,m_desktop       (p_msg->GetRemoteDesktop())
             ,m_site          (p_msg->GetHTTPSite())
-            ,m_sendBOM       (p_msg->GetSendBOM())
+            ,m_sendBOM       (p_asJson ? false : p_msg->GetSendBOM())
             ,m_acceptEncoding(p_msg->GetAcceptEncoding())
             ,m_status        (p_msg->GetStatus())
             ,m_user          (p_msg->GetUser())
@@ -216,8 +218,8 @@ HTTPMessage::HTTPMessage(HTTPCommand p_command,const SOAPMessage* p_msg)
   // Copy routing information
   m_routing = p_msg->GetRouting();
 
-  // Take care of character encoding
-  Encoding encoding = p_msg->GetEncoding();
+  // Take care of character encoding (JSON is UTF-8 by default)
+  Encoding encoding = p_asJson ? Encoding::UTF8 : p_msg->GetEncoding();
   XString charset = FindCharsetInContentType(m_contentType);
 
   if(charset.Left(6).CompareNoCase(_T("utf-16")) == 0 || p_msg->GetSendUnicode())
@@ -237,11 +239,18 @@ HTTPMessage::HTTPMessage(HTTPCommand p_command,const SOAPMessage* p_msg)
   }
 
   // Reconstruct the content type header
-  m_contentType = FindMimeTypeInContentType(m_contentType);
+  m_contentType = p_asJson ? XString(_T("application/json")) : FindMimeTypeInContentType(m_contentType);
   m_contentType.AppendFormat(_T("; charset=%s"),charset.GetString());
 
   // Set body 
-  ConstructBodyFromString(const_cast<SOAPMessage*>(p_msg)->GetSoapMessage(),charset,p_msg->GetSendBOM());
+  if(p_asJson)
+  {
+    ConstructBodyFromSoapAsJson(p_msg,charset,m_sendBOM);
+  }
+  else
+  {
+    ConstructBodyFromString(const_cast<SOAPMessage*>(p_msg)->GetSoapMessage(),charset,p_msg->GetSendBOM());
+  }
 
   // Make sure we have a server name for host headers
   CheckServer();
@@ -318,7 +327,7 @@ HTTPMessage::operator=(const JSONMessage& p_msg)
   m_contentType.AppendFormat(_T("; charset=%s"),charset.GetString());
 
   // Set body 
-  ConstructBodyFromString(p_msg.GetJsonMessage(),charset,p_msg.GetSendBOM());
+  ConstructBodyFromJson(p_msg,charset,p_msg.GetSendBOM());
 
   // Make sure we have a server name for host headers
   CheckServer();
@@ -393,6 +402,74 @@ HTTPMessage::ConstructBodyFromString(XString p_string,XString p_charset,bool p_w
   AddHeader(_T("Content-Length"),cl);
 }
 
+// PRIVATE: TO BE CALLED FROM THE XTOR!!
+// Stream the JSON text directly into the parts of our body buffer
+// No intermediate string of the whole message is ever created
+void
+HTTPMessage::ConstructBodyFromJson(const JSONMessage& p_message,XString p_charset,bool p_withBom)
+{
+#ifndef UNICODE
+  // MBCS only sends a BOM for UTF-16
+  if(p_charset.CompareNoCase(_T("utf-16")) != 0)
+  {
+    p_withBom = false;
+  }
+#endif
+  m_buffer.Reset();
+
+  StringWriter writer(&m_buffer,p_charset,p_withBom);
+  p_message.WriteJsonMessage(writer);
+  writer.Flush();
+
+  if(writer.GetError())
+  {
+    // We are now officially in error state
+    // So produce a status 400 (incoming = client error)
+    // or produce a status 500 (outgoing = server error)
+    m_status = (m_command == HTTPCommand::http_response) ? HTTP_STATUS_SERVER_ERROR : HTTP_STATUS_BAD_REQUEST;
+  }
+
+  // Set the correct content length after constructing the body
+  XString cl;
+  cl.Format(_T("%d"),(int)m_buffer.GetLength());
+
+  DelHeader(_T("Content-Length"));
+  AddHeader(_T("Content-Length"),cl);
+}
+
+// PRIVATE: TO BE CALLED FROM THE XTOR!!
+// Stream the SOAP message as JSON, without an intermediate JSONMessage
+void
+HTTPMessage::ConstructBodyFromSoapAsJson(const SOAPMessage* p_message,XString p_charset,bool p_withBom)
+{
+#ifndef UNICODE
+  // MBCS only sends a BOM for UTF-16
+  if(p_charset.CompareNoCase(_T("utf-16")) != 0)
+  {
+    p_withBom = false;
+  }
+#endif
+  m_buffer.Reset();
+
+  SOAPMessage* soap = const_cast<SOAPMessage*>(p_message);
+  StringWriter writer(&m_buffer,p_charset,p_withBom);
+  JSONTranscoder transcoder;
+  transcoder.WriteSoapAsJson(soap,writer,!soap->GetCondensed());
+  writer.Flush();
+
+  if(writer.GetError())
+  {
+    m_status = (m_command == HTTPCommand::http_response) ? HTTP_STATUS_SERVER_ERROR : HTTP_STATUS_BAD_REQUEST;
+  }
+
+  // Set the correct content length after constructing the body
+  XString cl;
+  cl.Format(_T("%d"),(int)m_buffer.GetLength());
+
+  DelHeader(_T("Content-Length"));
+  AddHeader(_T("Content-Length"),cl);
+}
+
 // General DTOR
 HTTPMessage::~HTTPMessage()
 {
@@ -401,6 +478,11 @@ HTTPMessage::~HTTPMessage()
     CloseHandle(m_token);
     m_token = NULL;
   }
+  if(m_formData)
+  {
+    delete m_formData;
+    m_formData = nullptr;
+  }
 }
 
 // Recycle the object for usage in a return message
@@ -416,6 +498,7 @@ HTTPMessage::Reset(bool p_resetURL /*=false*/)
   if(p_resetURL)
   {
     m_url.Empty();
+    m_reparse = false;
     m_cracked.Reset();
   }
 
@@ -535,15 +618,12 @@ HTTPMessage::GetRawBody(uchar** p_body,size_t& p_length)
 
   if(m_buffer.GetHasBufferParts())
   {
-    int    part = 0;
-    uchar* buf  = nullptr;
-    size_t len  = 0;
-    uchar* dest = *p_body;
-
-    while(m_buffer.GetBufferPart(part++,buf,len))
+    // Copies memory and file regions alike
+    if(!m_buffer.GetBufferChain().CopyTo(*p_body))
     {
-      memcpy(dest,buf,len);
-      dest += len;
+      delete [] *p_body;
+      *p_body = NULL;
+      return;
     }
   }
   else
@@ -562,7 +642,8 @@ HTTPMessage::GetRawBody(uchar** p_body,size_t& p_length)
 void
 HTTPMessage::SetURL(const XString& p_url)
 {
-  m_url = p_url;
+  m_url     = p_url;
+  m_reparse = false;
   ParseURL(p_url);
 }
 
@@ -649,6 +730,31 @@ HTTPMessage::SetReadBuffer(bool p_read,size_t p_length)
   m_contentLength = p_length;
 };
 
+// Parse incoming form-data while receiving the body (message becomes the owner)
+void
+HTTPMessage::SetStreamedFormData(MultiPartBuffer* p_buffer)
+{
+  if(m_formData && m_formData != p_buffer)
+  {
+    delete m_formData;
+  }
+  m_formData = p_buffer;
+}
+
+// Add a block of the incoming body as it is received from the network.
+// Streamed form-data goes to the parser instead of the body buffer
+bool
+HTTPMessage::ReceiveBody(uchar* p_buffer,size_t p_length)
+{
+  m_received += p_length;
+  if(m_formData && m_formData->GetIsStreaming())
+  {
+    return m_formData->StreamBuffer(p_buffer,p_length);
+  }
+  m_buffer.AddBuffer(p_buffer,p_length);
+  return true;
+}
+
 void
 HTTPMessage::SetSender(PSOCKADDR_IN6 p_address)
 {
@@ -767,11 +873,17 @@ HTTPMessage::ParseURL(XString p_url)
   return true;
 }
 
-// Reparse URL after setting a part of the URL
-void
-HTTPMessage::ReparseURL()
+// The URL is only rebuilt from its parts when asked for,
+// so setting server, port and path in a row rebuilds it only once
+XString
+HTTPMessage::GetURL()
 {
-  m_url = m_cracked.URL();
+  if(m_reparse)
+  {
+    m_url     = m_cracked.URL();
+    m_reparse = false;
+  }
+  return m_url;
 }
 
 // Check that we have a server string (for host headers)
@@ -780,7 +892,7 @@ HTTPMessage::CheckServer()
 {
   if(m_cracked.m_host.IsEmpty())
   {
-    if(!m_url.IsEmpty())
+    if(!GetURL().IsEmpty())
     {
       ParseURL(m_url);
     }
@@ -876,14 +988,13 @@ HTTPMessage::SetAllHeaders(PHTTP_REQUEST_HEADERS p_headers)
   // Add all unknown headers
   SetUnknownHeaders(p_headers);
 
-  // Add all known headers
+  // Add all known headers by their interned id
   for(int ind = 0; ind < HttpHeaderMaximum; ++ind)
   {
     if(p_headers->KnownHeaders[ind].RawValueLength)
     {
       XString value(p_headers->KnownHeaders[ind].pRawValue);
-      XString name(header_fields[ind]);
-      AddHeader(name,value);
+      AddHeader(m_headers.FindKnown(ind),ind,value);
     }
   }
 }
@@ -901,23 +1012,18 @@ HTTPMessage::SetUnknownHeaders(PHTTP_REQUEST_HEADERS p_headers)
 }
 
 // Add a header by known header-id
+// Below 'Accept-Ranges' the id's are shared. From there on the response headers are meant
 void    
 HTTPMessage::AddHeader(HTTP_HEADER_ID p_id,XString p_value)
 {
-  int maximum = HttpHeaderMaximum;
-
-  if(p_id >= 0 && p_id < maximum)
+  int id = ResponseHeaderToID(p_id);
+  if(id == HEADER_NAME_UNKNOWN && p_id >= 0 && p_id < HttpHeaderMaximum)
   {
-    XString name;
-    if(p_id >= 0 && p_id < HttpHeaderAcceptRanges)
-    {
-      name = header_fields[p_id];
-    }
-    else if(p_id >= HttpHeaderAcceptRanges && p_id < HttpHeaderMaximum)
-    {
-      name = header_response[p_id - HttpHeaderAcceptRanges];
-    }
-    AddHeader(name,p_value);
+    id = p_id;
+  }
+  if(id != HEADER_NAME_UNKNOWN)
+  {
+    AddHeader(m_headers.FindKnown(id),id,p_value);
   }
 }
 
@@ -938,7 +1044,7 @@ HTTPMessage::AddHeader(XString p_name,XString p_value)
     if(p_name.CompareNoCase(_T("Set-Cookie")) == 0)
     {
       // Insert as a new header
-      m_headers.insert(std::make_pair(p_name,p_value));
+      m_headers.insert(p_name,p_value);
       return;
     }
     // New value of the header
@@ -947,7 +1053,28 @@ HTTPMessage::AddHeader(XString p_name,XString p_value)
   else
   {
     // Insert as a new header
-    m_headers.insert(std::make_pair(p_name,p_value));
+    m_headers.insert(p_name,p_value);
+  }
+}
+
+// Add a header by interned id, where we already looked it up
+void
+HTTPMessage::AddHeader(HeaderMap::iterator p_found,int p_id,const XString& p_value)
+{
+  if(p_found == m_headers.end())
+  {
+    m_headers.insert(p_id,p_value);
+  }
+  else if(p_found->second.Find(p_value) < 0)
+  {
+    if(p_id == ResponseHeaderToID(HttpHeaderSetCookie))
+    {
+      m_headers.insert(p_id,p_value);
+    }
+    else
+    {
+      p_found->second = p_value;
+    }
   }
 }
 
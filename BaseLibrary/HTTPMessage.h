@@ -116,8 +116,8 @@ public:
   explicit HTTPMessage(HTTPCommand p_command,XString p_url);
   // XTOR from another HTTPMessage
   explicit HTTPMessage(HTTPMessage* p_msg,bool p_deep = false);
-  // XTOR from a SOAPMessage
-  explicit HTTPMessage(HTTPCommand p_command,const SOAPMessage* p_msg);
+  // XTOR from a SOAPMessage (optionally streamed as JSON: check JSONTranscoder::CanWriteSoap first!)
+  explicit HTTPMessage(HTTPCommand p_command,const SOAPMessage* p_msg,bool p_asJson = false);
   // XTOR from a JSONMessage
   explicit HTTPMessage(HTTPCommand p_command,const JSONMessage* p_msg);
   // DTOR
@@ -180,10 +180,11 @@ public:
   void SetCookiePairs(XString p_cookies);     // From "Cookie:" only
   void SetCookies(const Cookies& p_cookies);
   bool SetHTTPSite(HTTPSite* p_site);
+  void SetStreamedFormData(MultiPartBuffer* p_buffer);
 
   // GETTERS
   HTTPCommand         GetCommand()              { return m_command;                   }
-  XString             GetURL()                  { return m_url;                       }
+  XString             GetURL();
   XString             GetReferrer()             { return m_referrer;                  }
   CrackedURL&         GetCrackedURL()           { return m_cracked;                   }
   unsigned            GetStatus()               { return m_status;                    }
@@ -217,6 +218,8 @@ public:
   unsigned            GetChunkNumber()          { return m_chunkNumber;               }
   boolean             GetXMLHttpRequest()       { return m_XMLHttpRequest;            }
   bool                GetSendUnicode()          { return m_sendUnicode;               }
+  size_t              GetBodyReceived()         { return m_received;                  }
+  MultiPartBuffer*    GetStreamedFormData()     { return m_formData;                  }
 
   XString             GetBody();
   size_t              GetBodyLength();
@@ -237,6 +240,8 @@ public:
   void    AddBody(XString p_body,XString p_charset = _T("utf-8"));
   // Add a body from a binary BLOB
   void    AddBody(void* p_body,unsigned p_length);
+  // Add a block of the incoming body as it is received from the network
+  bool    ReceiveBody(uchar* p_buffer,size_t p_length);
   // Add a header-name / header-value pair
   void    AddHeader(XString p_name,XString p_value);
   // Add a header by known header-id
@@ -258,6 +263,7 @@ public:
   // Reference system for storing the message elsewhere
   void    AddReference();
   void    DropReference();
+  long    GetReferences() const { return m_references; }
 
   // Operators
   HTTPMessage& operator=(const JSONMessage& p_message);
@@ -265,12 +271,16 @@ public:
 private:
   // TO BE CALLED FROM THE XTOR!!
   void    ConstructBodyFromString(XString p_string,XString p_charset,bool p_withBom);
+  void    ConstructBodyFromJson(const JSONMessage& p_message,XString p_charset,bool p_withBom);
+  void    ConstructBodyFromSoapAsJson(const SOAPMessage* p_message,XString p_charset,bool p_withBom);
   // Parse raw URL to cracked URL data
   bool    ParseURL(XString p_url);
   // Check for minimal sending requirements
   void    CheckServer();
-  // Re-parse URL after setting a part of the URL
-  void    ReparseURL();
+  // Re-parse URL after setting a part of the URL (done upon the next GetURL)
+  void    ReparseURL()                          { m_reparse = true; }
+  // Add a header by interned id, where we already looked it up
+  void    AddHeader(HeaderMap::iterator p_found,int p_id,const XString& p_value);
   // Fill message with FormData buffer
   bool    SetMultiPartBuffer (MultiPartBuffer* p_buffer);
   // Fill message with FormData URL encoding
@@ -296,6 +306,7 @@ private:
   FileBuffer          m_buffer;                                       // Body or file buffer
   Cookies             m_cookies;                                      // Cookies
   XString             m_url;                                          // Full URL to service
+  bool                m_reparse       { false   };                    // m_url must be rebuilt from m_cracked
   CrackedURL          m_cracked;                                      // Cracked down URL
   XString             m_referrer;                                     // Referrer of this call
   HANDLE              m_token         { NULL    };                    // Access token
@@ -308,6 +319,8 @@ private:
   SYSTEMTIME          m_systemtime;                                   // System time for m_modified
   long                m_references    { 1       };                    // Referencing system
   boolean             m_XMLHttpRequest{ false   };                    // Ajax Request (Triggers CORS!)
+  size_t              m_received      { 0       };                    // Body bytes received from the network
+  MultiPartBuffer*    m_formData      { nullptr };                    // Form-data parsed while receiving
 };
 
 inline void 
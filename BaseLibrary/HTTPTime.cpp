@@ -34,7 +34,7 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
-const TCHAR* weekday_short[7] =
+static const TCHAR* weekday_short[7] =
 {
   _T("Sun")
  ,_T("Mon")
@@ -45,7 +45,7 @@ const TCHAR* weekday_short[7] =
  ,_T("Sat")
 };
 
-const TCHAR* weekday_long[7] =
+static const TCHAR* weekday_long[7] =
 {
    _T("Sunday")
   ,_T("Monday")
@@ -56,7 +56,7 @@ const TCHAR* weekday_long[7] =
   ,_T("Saturday")
 };
 
-const TCHAR* month[12] =
+static const TCHAR* month[12] =
 {
   _T("Jan")
  ,_T("Feb")
@@ -72,30 +72,164 @@ const TCHAR* month[12] =
  ,_T("Dec")
 };
 
+// All two-digit numbers, for the fixed-width formatting
+static const TCHAR g_digitPairs[] = _T("00010203040506070809101112131415161718192021222324252627282930313233343536373839404142434445464748495051525354555657585960616263646566676869707172737475767778798081828384858687888990919293949596979899");
+
+// Cache of the current "Date:" header, rendered once per second.
+// Works as a seqlock: the sequence number is odd while one thread renders a new second.
+// Readers never wait: if the cache is stale or busy, they render the time themselves.
+static volatile LONG   g_dateSequence { 0 };
+static volatile LONG64 g_dateSecond   { 0 };
+static TCHAR           g_dateCache[HTTPTIME_LENGTH + 1];
+
+// Write a number as 2 or 4 digits
+inline void PutDigits2(LPTSTR p_buffer,unsigned p_number)
+{
+  p_buffer[0] = g_digitPairs[2 * p_number];
+  p_buffer[1] = g_digitPairs[2 * p_number + 1];
+}
+
+inline void PutDigits4(LPTSTR p_buffer,unsigned p_number)
+{
+  PutDigits2(p_buffer,    p_number / 100);
+  PutDigits2(p_buffer + 2,p_number % 100);
+}
+
+// Read 2 or 4 digits. All non-digits are collected in the 'bad' flag
+inline unsigned GetDigits2(LPCTSTR p_string,unsigned& p_bad)
+{
+  unsigned high = (unsigned)(p_string[0] - '0');
+  unsigned low  = (unsigned)(p_string[1] - '0');
+  p_bad |= (unsigned)(high > 9) | (unsigned)(low > 9);
+  return high * 10 + low;
+}
+
+inline unsigned GetDigits4(LPCTSTR p_string,unsigned& p_bad)
+{
+  return GetDigits2(p_string,p_bad) * 100 + GetDigits2(p_string + 2,p_bad);
+}
+
+// Three letters of a day or month name as one number
+inline ULONGLONG NameKey(LPCTSTR p_name)
+{
+  return ((ULONGLONG)(unsigned)p_name[0] << 32) | ((ULONGLONG)(unsigned)p_name[1] << 16) | (ULONGLONG)(unsigned)p_name[2];
+}
+
+static int
+FindName(const TCHAR** p_names,int p_count,LPCTSTR p_name)
+{
+  ULONGLONG key = NameKey(p_name);
+  for(int ind = 0; ind < p_count; ++ind)
+  {
+    if(NameKey(p_names[ind]) == key)
+    {
+      return ind;
+    }
+  }
+  return -1;
+}
+
+// Print HTTP time in the fixed-width RFC 1123 format
+// as in "Tue, 08 Dec 2015 21:26:32 GMT"
+bool
+HTTPTimeFormat(const SYSTEMTIME* p_systemtime,LPTSTR p_buffer)
+{
+  // Check that we have a system time that fits
+  if(!p_systemtime || !p_buffer ||
+      p_systemtime->wDayOfWeek > 6  ||
+      p_systemtime->wMonth     < 1  ||
+      p_systemtime->wMonth     > 12 ||
+      p_systemtime->wDay       > 31 ||
+      p_systemtime->wYear      > 9999 ||
+      p_systemtime->wHour      > 23 ||
+      p_systemtime->wMinute    > 59 ||
+      p_systemtime->wSecond    > 60)
+  {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return false;
+  }
+  const TCHAR* day = weekday_short[p_systemtime->wDayOfWeek];
+  const TCHAR* mon = month[p_systemtime->wMonth - 1];
+
+  p_buffer[ 0] = day[0];
+  p_buffer[ 1] = day[1];
+  p_buffer[ 2] = day[2];
+  p_buffer[ 3] = ',';
+  p_buffer[ 4] = ' ';
+  PutDigits2(&p_buffer[5],p_systemtime->wDay);
+  p_buffer[ 7] = ' ';
+  p_buffer[ 8] = mon[0];
+  p_buffer[ 9] = mon[1];
+  p_buffer[10] = mon[2];
+  p_buffer[11] = ' ';
+  PutDigits4(&p_buffer[12],p_systemtime->wYear);
+  p_buffer[16] = ' ';
+  PutDigits2(&p_buffer[17],p_systemtime->wHour);
+  p_buffer[19] = ':';
+  PutDigits2(&p_buffer[20],p_systemtime->wMinute);
+  p_buffer[22] = ':';
+  PutDigits2(&p_buffer[23],p_systemtime->wSecond);
+  p_buffer[25] = ' ';
+  p_buffer[26] = 'G';
+  p_buffer[27] = 'M';
+  p_buffer[28] = 'T';
+  p_buffer[29] = 0;
+
+  SetLastError(ERROR_SUCCESS);
+  return true;
+}
+
 // Print HTTP time in RFC 1123 format (Preferred standard)
-// as in "Tue, 8 Dec 2015 21:26:32 GMT"
+// as in "Tue, 08 Dec 2015 21:26:32 GMT"
 bool
 HTTPTimeFromSystemTime(const SYSTEMTIME* p_systemtime,XString& p_time)
 {
-  // Check that we have a system time
-  if(!p_systemtime ||
-      p_systemtime->wDayOfWeek < 0 ||
-      p_systemtime->wDayOfWeek > 6 ||
-      p_systemtime->wMonth     < 1 ||
-      p_systemtime->wMonth     > 12 )
+  TCHAR buffer[HTTPTIME_LENGTH + 1];
+  if(!HTTPTimeFormat(p_systemtime,buffer))
   {
-    SetLastError(ERROR_INVALID_PARAMETER);
     return false;
   }
+  p_time = XString(buffer,HTTPTIME_LENGTH);
+  return true;
+}
 
-  p_time.Format(_T("%s, %02d %s %04d %2.2d:%2.2d:%2.2d GMT")
-                ,weekday_short[p_systemtime->wDayOfWeek]
-                ,p_systemtime->wDay
-                ,month[p_systemtime->wMonth - 1]
-                ,p_systemtime->wYear
-                ,p_systemtime->wHour
-                ,p_systemtime->wMinute
-                ,p_systemtime->wSecond);
+// Strict parsing of the fixed-width RFC 1123 format only
+// as in "Sun, 06 Nov 1994 08:49:37 GMT"
+bool
+HTTPTimeParse(LPCTSTR p_string,SYSTEMTIME* p_systemtime)
+{
+  if(!p_string || !p_systemtime || _tcsnlen(p_string,HTTPTIME_LENGTH + 1) != HTTPTIME_LENGTH)
+  {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return false;
+  }
+  // All separators and digits are checked in one go
+  unsigned bad = (unsigned)(p_string[ 3] != ',') | (unsigned)(p_string[ 4] != ' ') |
+                 (unsigned)(p_string[ 7] != ' ') | (unsigned)(p_string[11] != ' ') |
+                 (unsigned)(p_string[16] != ' ') | (unsigned)(p_string[19] != ':') |
+                 (unsigned)(p_string[22] != ':') | (unsigned)(p_string[25] != ' ') |
+                 (unsigned)(NameKey(&p_string[26]) != NameKey(_T("GMT")));
+  unsigned day    = GetDigits2(&p_string[ 5],bad);
+  unsigned year   = GetDigits4(&p_string[12],bad);
+  unsigned hour   = GetDigits2(&p_string[17],bad);
+  unsigned minute = GetDigits2(&p_string[20],bad);
+  unsigned second = GetDigits2(&p_string[23],bad);
+  int      wday   = FindName(weekday_short, 7,&p_string[0]);
+  int      mon    = FindName(month,        12,&p_string[8]);
+
+  if(bad || wday < 0 || mon < 0 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+  {
+    SetLastError(ERROR_INVALID_PARAMETER);
+    return false;
+  }
+  memset(p_systemtime,0,sizeof(SYSTEMTIME));
+  p_systemtime->wDayOfWeek = (WORD) wday;
+  p_systemtime->wDay       = (WORD) day;
+  p_systemtime->wMonth     = (WORD)(mon + 1);
+  p_systemtime->wYear      = (WORD) year;
+  p_systemtime->wHour      = (WORD) hour;
+  p_systemtime->wMinute    = (WORD) minute;
+  p_systemtime->wSecond    = (WORD) second;
 
   SetLastError(ERROR_SUCCESS);
   return true;
@@ -152,6 +286,11 @@ HTTPTimeToSystemTime(const XString p_time,SYSTEMTIME* p_systemtime)
     SetLastError(ERROR_INVALID_PARAMETER);
     return false;
   }
+  // Most times are in the preferred format
+  if(length == HTTPTIME_LENGTH && HTTPTimeParse(p_time.GetString(),p_systemtime))
+  {
+    return true;
+  }
   SetLastError(ERROR_SUCCESS);
 
   // Reset systemtime
@@ -318,25 +457,52 @@ HTTPTimeToSystemTime(const XString p_time,SYSTEMTIME* p_systemtime)
   return true;
 }
 
-// Print HTTP time in RFC 1123 format (Preferred standard)
-// as in "Tue, 8 Dec 2015 21:26:32 GMT"
+// Current HTTP time in RFC 1123 format (Preferred standard)
+// as in "Tue, 08 Dec 2015 21:26:32 GMT"
+// Only the first call in a new second renders the time for all others
+void
+HTTPGetSystemTime(LPTSTR p_buffer)
+{
+  FILETIME       filetime;
+  ULARGE_INTEGER now;
+  GetSystemTimeAsFileTime(&filetime);
+  now.LowPart  = filetime.dwLowDateTime;
+  now.HighPart = filetime.dwHighDateTime;
+  LONG64 second = (LONG64)(now.QuadPart / 10000000ULL);
+
+  // Try the cache. Valid if no writer came by while copying
+  LONG sequence = ReadAcquire(&g_dateSequence);
+  if((sequence & 1) == 0 && ReadAcquire64(&g_dateSecond) == second)
+  {
+    memcpy(p_buffer,g_dateCache,sizeof(g_dateCache));
+    MemoryBarrier();
+    if(ReadAcquire(&g_dateSequence) == sequence)
+    {
+      return;
+    }
+  }
+
+  // Render this second ourselves
+  SYSTEMTIME systemtime;
+  FileTimeToSystemTime(&filetime,&systemtime);
+  HTTPTimeFormat(&systemtime,p_buffer);
+
+  // Become the one writer of the cache. Never let the cache go back in time
+  if((sequence & 1) == 0 && second > ReadAcquire64(&g_dateSecond) &&
+     InterlockedCompareExchange(&g_dateSequence,sequence + 1,sequence) == sequence)
+  {
+    memcpy(g_dateCache,p_buffer,sizeof(g_dateCache));
+    WriteRelease64(&g_dateSecond,second);
+    InterlockedExchange(&g_dateSequence,sequence + 2);
+  }
+}
+
 XString
 HTTPGetSystemTime()
 {
-  XString    time;
-  SYSTEMTIME systemtime;
-  GetSystemTime(&systemtime);
-
-  time.Format(_T("%s, %02d %s %04d %2.2d:%2.2d:%2.2d GMT")
-             ,weekday_short[systemtime.wDayOfWeek]
-             ,systemtime.wDay
-             ,month[systemtime.wMonth - 1]
-             ,systemtime.wYear
-             ,systemtime.wHour
-             ,systemtime.wMinute
-             ,systemtime.wSecond);
-
-  return time;
+  TCHAR buffer[HTTPTIME_LENGTH + 1];
+  HTTPGetSystemTime(buffer);
+  return XString(buffer,HTTPTIME_LENGTH);
 }
 
 const double SecondsPer100ns = 100. * 1.E-9;
@@ -40,4 +40,14 @@
 bool    HTTPTimeFromSystemTime(const SYSTEMTIME* p_systemTime,XString& p_string);
 bool    HTTPTimeToSystemTime  (const XString p_string,SYSTEMTIME* p_systemtime);
 XString HTTPGetSystemTime();
+
+// A RFC 1123 time is always 29 characters: "Sun, 06 Nov 1994 08:49:37 GMT"
+#define HTTPTIME_LENGTH 29
+
+// Fixed-width RFC 1123 formatting and strict parsing. Buffers are at least HTTPTIME_LENGTH + 1
+// Strict parsing only accepts the preferred format: HTTPTimeToSystemTime accepts all others
+bool    HTTPTimeFormat(const SYSTEMTIME* p_systemTime,LPTSTR p_buffer);
+bool    HTTPTimeParse (LPCTSTR p_string,SYSTEMTIME* p_systemtime);
+// Current time for the "Date:" header. Rendered only once per second for all threads
+void    HTTPGetSystemTime(LPTSTR p_buffer);
 void    AddSecondsToSystemTime(SYSTEMTIME* p_timeIn,SYSTEMTIME* p_timeOut,double p_seconds);
@@ -0,0 +1,275 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: Headers.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "Headers.h"
+#include "HTTPMessage.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// INTERNING OF THE HEADER NAMES
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Open addressing table of all interned names. Power of 2!
+constexpr int HEADER_HASH_SIZE = 128;
+
+// Case-insensitive hash of a header name (header names are US-ASCII)
+static unsigned
+HeaderNameHash(LPCTSTR p_name,int p_length)
+{
+  unsigned hash = 2166136261U;
+  for(int ind = 0; ind < p_length; ++ind)
+  {
+    unsigned ch = (unsigned) p_name[ind];
+    if(ch >= 'A' && ch <= 'Z')
+    {
+      ch += ('a' - 'A');
+    }
+    hash = (hash ^ ch) * 16777619U;
+  }
+  return hash;
+}
+
+class HeaderNameTable
+{
+public:
+  HeaderNameTable()
+  {
+    for(auto& slot : m_slots)
+    {
+      slot = HEADER_NAME_UNKNOWN;
+    }
+    for(int id = 0; id < HEADER_NAME_MAXIMUM; ++id)
+    {
+      LPCTSTR name = HeaderIDToName(id);
+      m_length[id] = (int) _tcslen(name);
+      unsigned hash = HeaderNameHash(name,m_length[id]);
+      while(m_slots[hash & (HEADER_HASH_SIZE - 1)] != HEADER_NAME_UNKNOWN)
+      {
+        ++hash;
+      }
+      m_slots[hash & (HEADER_HASH_SIZE - 1)] = id;
+    }
+  }
+
+  int Find(const XString& p_name) const
+  {
+    int length = p_name.GetLength();
+    unsigned hash = HeaderNameHash(p_name.GetString(),length);
+    while(true)
+    {
+      int id = m_slots[hash & (HEADER_HASH_SIZE - 1)];
+      if(id == HEADER_NAME_UNKNOWN)
+      {
+        return HEADER_NAME_UNKNOWN;
+      }
+      if(m_length[id] == length && _tcsicmp(HeaderIDToName(id),p_name.GetString()) == 0)
+      {
+        return id;
+      }
+      ++hash;
+    }
+  }
+
+private:
+  int m_slots [HEADER_HASH_SIZE];
+  int m_length[HEADER_NAME_MAXIMUM];
+};
+
+int
+HeaderNameToID(const XString& p_name)
+{
+  static const HeaderNameTable table;
+  return table.Find(p_name);
+}
+
+LPCTSTR
+HeaderIDToName(int p_id)
+{
+  if(p_id >= 0 && p_id < HEADER_NAME_RESPONSE)
+  {
+    return header_fields[p_id];
+  }
+  if(p_id >= HEADER_NAME_RESPONSE && p_id < HEADER_NAME_MAXIMUM)
+  {
+    return header_response[p_id - HEADER_NAME_RESPONSE];
+  }
+  return _T("");
+}
+
+int
+ResponseHeaderToID(HTTP_HEADER_ID p_id)
+{
+  if(p_id >= 0 && p_id < HttpHeaderAcceptRanges)
+  {
+    return p_id;
+  }
+  if(p_id >= HttpHeaderAcceptRanges && p_id < HttpHeaderResponseMaximum)
+  {
+    return HEADER_NAME_RESPONSE + (p_id - HttpHeaderAcceptRanges);
+  }
+  return HEADER_NAME_UNKNOWN;
+}
+
+int
+IDToResponseHeader(int p_id)
+{
+  if(p_id >= 0 && p_id < HttpHeaderAcceptRanges)
+  {
+    return p_id;
+  }
+  if(p_id >= HEADER_NAME_RESPONSE && p_id < HEADER_NAME_MAXIMUM)
+  {
+    return HttpHeaderAcceptRanges + (p_id - HEADER_NAME_RESPONSE);
+  }
+  return HEADER_NAME_UNKNOWN;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// HEADERMAP
+//
+//////////////////////////////////////////////////////////////////////////
+
+HeaderMap::HeaderMap()
+{
+  memset(m_known,-1,sizeof(m_known));
+}
+
+HeaderMap::iterator
+HeaderMap::find(const XString& p_name)
+{
+  int id = HeaderNameToID(p_name);
+  if(id != HEADER_NAME_UNKNOWN)
+  {
+    return FindKnown(id);
+  }
+  int length = p_name.GetLength();
+  for(iterator it = m_headers.begin(); it != m_headers.end(); ++it)
+  {
+    if(it->m_id == HEADER_NAME_UNKNOWN     &&
+       it->first.GetLength() == length    &&
+       it->first.CompareNoCase(p_name) == 0)
+    {
+      return it;
+    }
+  }
+  return m_headers.end();
+}
+
+HeaderMap::const_iterator
+HeaderMap::find(const XString& p_name) const
+{
+  return const_cast<HeaderMap*>(this)->find(p_name);
+}
+
+HeaderMap::iterator
+HeaderMap::FindKnown(int p_id)
+{
+  if(p_id >= 0 && p_id < HEADER_NAME_MAXIMUM && m_known[p_id] >= 0)
+  {
+    return m_headers.begin() + m_known[p_id];
+  }
+  return m_headers.end();
+}
+
+HeaderMap::iterator
+HeaderMap::insert(const XString& p_name,const XString& p_value)
+{
+  int id = HeaderNameToID(p_name);
+  if(id != HEADER_NAME_UNKNOWN && m_known[id] < 0)
+  {
+    m_known[id] = (short) m_headers.size();
+  }
+  ReserveFirst();
+  m_headers.emplace_back(p_name,p_value,id);
+  return m_headers.end() - 1;
+}
+
+HeaderMap::iterator
+HeaderMap::insert(int p_id,const XString& p_value)
+{
+  if(p_id < 0 || p_id >= HEADER_NAME_MAXIMUM)
+  {
+    return m_headers.end();
+  }
+  if(m_known[p_id] < 0)
+  {
+    m_known[p_id] = (short) m_headers.size();
+  }
+  ReserveFirst();
+  m_headers.emplace_back(XString(HeaderIDToName(p_id)),p_value,p_id);
+  return m_headers.end() - 1;
+}
+
+HeaderMap::iterator
+HeaderMap::erase(iterator p_iterator)
+{
+  size_t position = p_iterator - m_headers.begin();
+  m_headers.erase(p_iterator);
+  Reindex();
+  return m_headers.begin() + position;
+}
+
+void
+HeaderMap::clear()
+{
+  m_headers.clear();
+  memset(m_known,-1,sizeof(m_known));
+}
+
+// Empty maps stay without allocation.
+// The first header makes room for the usual number of headers
+void
+HeaderMap::ReserveFirst()
+{
+  if(m_headers.capacity() == 0)
+  {
+    m_headers.reserve(HEADER_MAP_RESERVE);
+  }
+}
+
+void
+HeaderMap::Reindex()
+{
+  memset(m_known,-1,sizeof(m_known));
+  for(size_t ind = m_headers.size(); ind-- > 0;)
+  {
+    int id = m_headers[ind].m_id;
+    if(id != HEADER_NAME_UNKNOWN)
+    {
+      m_known[id] = (short) ind;
+    }
+  }
+}
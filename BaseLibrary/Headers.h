@@ -26,14 +26,43 @@
 // THE SOFTWARE.
 //
 #pragma once
-#include <map>
+#include <http.h>
+#include <vector>
 
-struct headerCompare
+// Interned header names
+// 0  .. 40 are the request headers in the order of HTTP_HEADER_ID
+// 41 .. 50 are the response-only headers from 'Accept-Ranges' up to 'WWW-Authenticate'
+constexpr int HEADER_NAME_UNKNOWN  = -1;
+constexpr int HEADER_NAME_RESPONSE = HttpHeaderMaximum;
+constexpr int HEADER_NAME_MAXIMUM  = HttpHeaderMaximum + (HttpHeaderResponseMaximum - HttpHeaderAcceptRanges);
+
+// Number of headers we reserve room for at the first insert
+constexpr int HEADER_MAP_RESERVE   = 16;
+
+// Find the interned id of a header name (case-insensitive) or HEADER_NAME_UNKNOWN
+int     HeaderNameToID(const XString& p_name);
+// Lower case name of an interned header id
+LPCTSTR HeaderIDToName(int p_id);
+// Interned id of a known response header (HttpHeaderCacheControl .. HttpHeaderWwwAuthenticate)
+int     ResponseHeaderToID(HTTP_HEADER_ID p_id);
+// Response HTTP_HEADER_ID of an interned id, or HEADER_NAME_UNKNOWN if not a response header
+int     IDToResponseHeader(int p_id);
+
+// One header in the HeaderMap.
+// The members are called 'first' and 'second', so the
+// map can be used in the same way as the former std::multimap
+class HTTPHeader
 {
-  bool operator() (const XString& p_left,const XString& p_right) const
+public:
+  HTTPHeader(const XString& p_name,const XString& p_value,int p_id)
+            :first(p_name)
+            ,second(p_value)
+            ,m_id(p_id)
   {
-    return p_left.CompareNoCase(p_right) < 0;
   }
+  XString first;        // Name of the header as it was added
+  XString second;       // Value of the header
+  int     m_id;         // Interned name id or HEADER_NAME_UNKNOWN
 };
 
 // HeaderMap is intended for the following objects
@@ -41,5 +70,55 @@ struct headerCompare
 // - SOAPMessage
 // - JSONMessage
 // - HTTPClient
-using HeaderMap = std::multimap<XString,XString,headerCompare>;
+//
+// Flat table of headers in order of arrival, with a direct index for the known headers.
+// Known headers are found in O(1) by their interned name id. Unknown headers are found
+// by a case-insensitive scan over the (few) entries. Copying a HeaderMap is one block
+// copy of the table and the known index: no tree nodes are allocated.
+//
+class HeaderMap
+{
+public:
+  using iterator       = std::vector<HTTPHeader>::iterator;
+  using const_iterator = std::vector<HTTPHeader>::const_iterator;
+
+  HeaderMap();
 
+  // Iterating over all headers in order of arrival
+  iterator        begin()               { return m_headers.begin(); }
+  iterator        end()                 { return m_headers.end();   }
+  const_iterator  begin() const         { return m_headers.begin(); }
+  const_iterator  end()   const         { return m_headers.end();   }
+  size_t          size()  const         { return m_headers.size();  }
+  bool            empty() const         { return m_headers.empty(); }
+
+  // Find the first header with this name (case-insensitive)
+  iterator        find(const XString& p_name);
+  const_iterator  find(const XString& p_name) const;
+  // Find the first header by interned name id
+  iterator        FindKnown(int p_id);
+  // Find a known request or response header
+  iterator        FindRequestHeader (HTTP_HEADER_ID p_id) { return FindKnown(p_id);                     }
+  iterator        FindResponseHeader(HTTP_HEADER_ID p_id) { return FindKnown(ResponseHeaderToID(p_id)); }
+
+  // Append a header. Duplicates are allowed (e.g. 'Set-Cookie')
+  iterator        insert(const XString& p_name,const XString& p_value);
+  // Append a header by interned name id
+  iterator        insert(int p_id,const XString& p_value);
+  // Compatibility with the former std::multimap
+  template<typename N,typename V>
+  iterator        insert(const std::pair<N,V>& p_pair) { return insert(XString(p_pair.first),XString(p_pair.second)); }
+
+  // Removing headers
+  iterator        erase(iterator p_iterator);
+  void            clear();
+
+private:
+  // Rebuild the known header index after a removal
+  void            Reindex();
+  // Allocate room for the headers at the first insert
+  void            ReserveFirst();
+
+  std::vector<HTTPHeader> m_headers;
+  short                   m_known[HEADER_NAME_MAXIMUM];   // First position of a known header or -1
+};
@@ -31,6 +31,8 @@
 #include "XMLParser.h"
 #include "HTTPMessage.h"
 #include "ConvertWideString.h"
+#include "StringWriter.h"
+#include "NameIndex.h"
 #include <iterator>
 #include <algorithm>
 
@@ -44,6 +46,11 @@ JSONvalue::JSONvalue()
 {
 }
 
+JSONvalue::JSONvalue(const JSONvalue& p_other)
+{
+  *this = p_other;
+}
+
 JSONvalue::JSONvalue(const JSONvalue* p_other)
 {
   *this = *p_other;
@@ -83,6 +90,7 @@ JSONvalue::~JSONvalue()
 {
   m_array .clear();
   m_object.clear();
+  DropIndex();
 }
 
 JSONvalue&
@@ -103,6 +111,7 @@ JSONvalue::operator=(const JSONvalue& p_other)
   // Copy objects
   m_array.clear();
   m_object.clear();
+  DropIndex();
   std::copy(p_other.m_object.begin(),p_other.m_object.end(),back_inserter(m_object));
   std::copy(p_other.m_array .begin(),p_other.m_array .end(),back_inserter(m_array));
 
@@ -119,6 +128,7 @@ JSONvalue::operator=(const XString& p_other)
   m_bcdNumber.Zero();
   m_array.clear();
   m_object.clear();
+  DropIndex();
 
   return *this;
 }
@@ -133,6 +143,7 @@ JSONvalue::operator=(LPCTSTR p_other)
   m_bcdNumber.Zero();
   m_array.clear();
   m_object.clear();
+  DropIndex();
 
   return *this;
 }
@@ -147,6 +158,7 @@ JSONvalue::operator=(const int& p_other)
   m_string.Empty();
   m_array.clear();
   m_object.clear();
+  DropIndex();
 
   return *this;
 }
@@ -161,6 +173,7 @@ JSONvalue::operator=(const bcd& p_other)
   m_string.Empty();
   m_array.clear();
   m_object.clear();
+  DropIndex();
 
   return *this;
 }
@@ -175,6 +188,7 @@ JSONvalue::operator=(JsonConst& p_other)
   m_string.Empty();
   m_array.clear();
   m_object.clear();
+  DropIndex();
 
   return *this;
 }
@@ -189,6 +203,7 @@ JSONvalue::operator=(const bool& p_other)
   m_string.Empty();
   m_array.clear();
   m_object.clear();
+  DropIndex();
 
   return *this;
 }
@@ -199,6 +214,7 @@ JSONvalue::SetDatatype(JsonType p_type)
 {
   // Clear the values
   m_object.clear();
+  DropIndex();
   m_array .clear();
   m_string.Empty();
   m_intNumber = 0;
@@ -216,6 +232,7 @@ JSONvalue::SetValue(XString p_value)
   // Clear the rest
   m_array .clear();
   m_object.clear();
+  DropIndex();
   m_intNumber = 0;
   m_bcdNumber.Zero();
   m_constant = JsonConst::JSON_NONE;
@@ -229,6 +246,7 @@ JSONvalue::SetValue(LPCTSTR p_value)
   // Clear the rest
   m_array .clear();
   m_object.clear();
+  DropIndex();
   m_intNumber = 0;
   m_bcdNumber.Zero();
   m_constant = JsonConst::JSON_NONE;
@@ -242,6 +260,7 @@ JSONvalue::SetValue(JsonConst p_value)
   // Clear the rest
   m_array.clear();
   m_object.clear();
+  DropIndex();
   m_intNumber = 0;
   m_bcdNumber.Zero();
   m_string.Empty();
@@ -252,6 +271,7 @@ JSONvalue::SetValue(JSONobject p_value)
 {
   m_type = JsonType::JDT_object;
   m_object.clear();
+  DropIndex();
   std::copy(p_value.begin(),p_value.end(),back_inserter(m_object));
   // Clear the rest
   m_array.clear();
@@ -269,6 +289,7 @@ JSONvalue::SetValue(JSONarray p_value)
   std::copy(p_value.begin(),p_value.end(),back_inserter(m_array));
   // Clear the rest
   m_object.clear();
+  DropIndex();
   // m_string.Empty();
   m_intNumber = 0;
   m_bcdNumber.Zero();
@@ -283,6 +304,7 @@ JSONvalue::SetValue(int p_value)
   m_bcdNumber.Zero();
   // Clear the rest
   m_object.clear();
+  DropIndex();
   m_array.clear();
   m_string.Empty();
   m_constant = JsonConst::JSON_NONE;
@@ -296,6 +318,7 @@ JSONvalue::SetValue(const bcd& p_value)
   m_intNumber = 0;
   // Clear the rest
   m_object.clear();
+  DropIndex();
   m_array.clear();
   m_string.Empty();
   m_constant = JsonConst::JSON_NONE;
@@ -352,49 +375,65 @@ JSONvalue::Add(JSONpair& p_value)
 XString
 JSONvalue::GetAsJsonString(bool p_white,Encoding p_encoding /*=Encoding::Default*/, unsigned p_level /*=0*/)
 {
-  XString result;
-  XString separ,less;
-  XString newln = p_white ? _T("\n") : _T("");
+  StringWriter writer;
+  WriteAsJson(writer,p_white,p_encoding,p_level);
+  return writer.GetString();
+}
 
-  if(p_white)
-  {
-    for(unsigned ind = 0;ind < p_level; ++ind)
-    {
-      less   = separ;
-      separ += _T("\t");
-    }
-  }
+// Streaming the JSON text into one buffer, without intermediate strings
+// p_trim: Leave out the leading indentation of an object (after a name)
+void
+JSONvalue::WriteAsJson(StringWriter& p_writer,bool p_white,Encoding p_encoding /*=Encoding::Default*/,unsigned p_level /*=0*/,bool p_trim /*=false*/)
+{
+  int separ = p_white ? (int) p_level : 0;
+  int less  = separ > 0 ? separ - 1 : 0;
 
   switch(m_type)
   {
     case JsonType::JDT_const:       switch(m_constant)
                                     {
-                                      case JsonConst::JSON_NONE:  return _T("");
-                                      case JsonConst::JSON_NULL:  return _T("null");
-                                      case JsonConst::JSON_FALSE: return _T("false");
-                                      case JsonConst::JSON_TRUE:  return _T("true");
+                                      case JsonConst::JSON_NONE:  break;
+                                      case JsonConst::JSON_NULL:  p_writer.Write(_T("null"),4);  break;
+                                      case JsonConst::JSON_FALSE: p_writer.Write(_T("false"),5); break;
+                                      case JsonConst::JSON_TRUE:  p_writer.Write(_T("true"),4);  break;
                                     }
                                     break;
-    case JsonType::JDT_string:      return XMLParser::PrintJsonString(m_string,p_encoding);
-    case JsonType::JDT_number_int:  result.Format(_T("%d"),m_intNumber);
+    case JsonType::JDT_string:      p_writer.WriteJsonString(m_string,p_encoding);
+                                    break;
+    case JsonType::JDT_number_int:  p_writer.WriteInteger(m_intNumber);
                                     break;
-    case JsonType::JDT_number_bcd:  result = m_bcdNumber.AsString(bcd::Format::Bookkeeping,false,0);
+    case JsonType::JDT_number_bcd:  p_writer.WriteBcd(m_bcdNumber);
                                     break;
-    case JsonType::JDT_array:       result = _T("[") + newln;
+    case JsonType::JDT_array:       p_writer.Write('[');
+                                    if(p_white)
+                                    {
+                                      p_writer.Write('\n');
+                                    }
                                     for(unsigned ind = 0;ind < m_array.size();++ind)
                                     {
-                                      result += separ;
-                                      result += m_array[ind].GetAsJsonString(p_white,p_encoding,p_level+1);
+                                      p_writer.WriteIndent('\t',separ);
+                                      m_array[ind].WriteAsJson(p_writer,p_white,p_encoding,p_level+1);
                                       if(ind < m_array.size() - 1)
                                       {
-                                        result += _T(",");
+                                        p_writer.Write(',');
+                                      }
+                                      if(p_white)
+                                      {
+                                        p_writer.Write('\n');
                                       }
-                                      result += newln;
                                     }
-                                    result += separ;
-                                    result += _T("]");
+                                    p_writer.WriteIndent('\t',separ);
+                                    p_writer.Write(']');
                                     break;
-    case JsonType::JDT_object:      result = less + _T("{") + newln;
+    case JsonType::JDT_object:      if(!p_trim)
+                                    {
+                                      p_writer.WriteIndent('\t',less);
+                                    }
+                                    p_writer.Write('{');
+                                    if(p_white)
+                                    {
+                                      p_writer.Write('\n');
+                                    }
                                     for(unsigned ind = 0; ind < m_object.size(); ++ind)
                                     {
                                       // Check for empty object
@@ -404,22 +443,23 @@ JSONvalue::GetAsJsonString(bool p_white,Encoding p_encoding /*=Encoding::Default
                                       {
                                         break;
                                       }
-                                      result += separ;
-                                      result += p_white ? _T("\t") : _T("");
-                                      result += XMLParser::PrintJsonString(m_object[ind].m_name,p_encoding);
-                                      result += _T(":");
-                                      result += m_object[ind].m_value.GetAsJsonString(p_white,p_encoding,p_level+1).TrimLeft('\t');
+                                      p_writer.WriteIndent('\t',p_white ? separ + 1 : 0);
+                                      p_writer.WriteJsonString(m_object[ind].m_name,p_encoding);
+                                      p_writer.Write(':');
+                                      m_object[ind].m_value.WriteAsJson(p_writer,p_white,p_encoding,p_level+1,true);
                                       if(ind < m_object.size() - 1)
                                       {
-                                        result += _T(",");
+                                        p_writer.Write(',');
+                                      }
+                                      if(p_white)
+                                      {
+                                        p_writer.Write('\n');
                                       }
-                                      result += newln;
                                     }
-                                    result += separ;
-                                    result += _T("}");
+                                    p_writer.WriteIndent('\t',separ);
+                                    p_writer.Write('}');
                                     break;
   }
-  return result;
 }
 
 // Getting the value from an JSONarray
@@ -445,14 +485,93 @@ JSONvalue::operator[](XString p_name)
   {
     throw StdException(_T("JSON object index used on an non-object node"));
   }
-  for(auto& pair : m_object)
+  int position = FindName(p_name);
+  if(position >= 0)
   {
-    if(pair.m_name.Compare(p_name) == 0)
+    return m_object[position].m_value;
+  }
+  throw StdException(_T("JSON object index not found!"));
+}
+
+// Position of the first pair with this name at or after p_from, or -1
+int
+JSONvalue::FindName(const XString& p_name,int p_from /*= 0*/)
+{
+  if(m_type != JsonType::JDT_object)
+  {
+    return -1;
+  }
+  if(m_object.size() >= NAMEINDEX_MINIMUM)
+  {
+    AcquireSRWLockExclusive(&m_indexLock);
+    NameIndex* index = GetNameIndex();
+    int position = index->First(p_name);
+    while(position >= 0 && position < p_from)
+    {
+      position = index->Next(position);
+    }
+    if(position >= 0 && m_object[position].m_name.Compare(p_name) == 0)
     {
-      return pair.m_value;
+      ReleaseSRWLockExclusive(&m_indexLock);
+      return position;
     }
+    ReleaseSRWLockExclusive(&m_indexLock);
   }
-  throw StdException(_T("JSON object index not found!"));
+  // A miss of the index is not trusted: a pair can be renamed through
+  // SetName or the public m_name without the index knowing about it.
+  for(int position = p_from; position < (int)m_object.size(); ++position)
+  {
+    if(m_object[position].m_name.Compare(p_name) == 0)
+    {
+      if(m_object.size() >= NAMEINDEX_MINIMUM)
+      {
+        // Index is stale: build it again at the next lookup
+        DropIndex();
+      }
+      return position;
+    }
+  }
+  return -1;
+}
+
+// Pairs have been changed: forget the name index
+void
+JSONvalue::DropIndex()
+{
+  AcquireSRWLockExclusive(&m_indexLock);
+  delete m_index;
+  m_index = nullptr;
+  ReleaseSRWLockExclusive(&m_indexLock);
+}
+
+// Get the name index of the object pairs, with the lock held.
+// Pairs appended since the last lookup are added to the index.
+// After an insert, a removal or a reallocation the index is built again.
+NameIndex*
+JSONvalue::GetNameIndex()
+{
+  size_t count = m_object.size();
+  if(m_index)
+  {
+    int indexed = m_index->GetCount();
+    if(indexed > (int)count ||
+       m_index->GetFirst() != &m_object.front() ||
+       m_index->GetLast()  != &m_object[indexed - 1])
+    {
+      delete m_index;
+      m_index = nullptr;
+    }
+  }
+  if(m_index == nullptr)
+  {
+    m_index = new NameIndex(count);
+  }
+  for(size_t position = m_index->GetCount(); position < count; ++position)
+  {
+    m_index->Add(m_object[position].m_name);
+  }
+  m_index->SetEnds(&m_object.front(),&m_object.back());
+  return m_index;
 }
 
 void
@@ -688,7 +807,7 @@ JSONMessage::JSONMessage(JSONMessage* p_other)
   m_incoming    = p_other->m_incoming;
   m_errorstate  = p_other->m_errorstate;
   m_lastError   = p_other->m_lastError;
-  m_url         = p_other->m_url;
+  m_url         = p_other->GetURL();
   m_cracked     = p_other->m_cracked;
   m_user        = p_other->m_user;
   m_password    = p_other->m_password;
@@ -940,6 +1059,7 @@ JSONMessage::Reset(bool p_resetURL /*= false*/)
   if(p_resetURL)
   {
     m_url.Empty();
+    m_reparse = false;
     m_cracked.Reset();
   }
 
@@ -961,11 +1081,17 @@ JSONMessage::ParseURL(XString p_url)
   return true;
 }
 
-// Reparse URL after setting a part of the URL
-void
-JSONMessage::ReparseURL()
+// The URL is only rebuilt from its parts when asked for,
+// so setting server, port and path in a row rebuilds it only once
+XString
+JSONMessage::GetURL() const
 {
-  m_url = m_cracked.URL();
+  if(m_reparse)
+  {
+    m_url     = m_cracked.URL();
+    m_reparse = false;
+  }
+  return m_url;
 }
 
 XString
@@ -1064,7 +1190,8 @@ JSONMessage::GetHeader(XString p_name)
 void
 JSONMessage::SetURL(const XString& p_url)
 {
-  m_url = p_url;
+  m_url     = p_url;
+  m_reparse = false;
 
   CrackedURL url;
   if(url.CrackURL(p_url))
@@ -1115,6 +1242,13 @@ JSONMessage::GetJsonMessage(Encoding p_encoding /*=Encoding::UTF8*/) const
   return m_value->GetAsJsonString(m_whitespace,p_encoding);
 }
 
+// Stream the message into a writer (one buffer or the parts of a FileBuffer)
+void
+JSONMessage::WriteJsonMessage(StringWriter& p_writer,Encoding p_encoding /*=Encoding::Default*/) const
+{
+  m_value->WriteAsJson(p_writer,m_whitespace,p_encoding);
+}
+
 XString 
 JSONMessage::GetJsonMessageWithBOM(Encoding p_encoding /*=Encoding::UTF8*/) const
 {
@@ -1253,28 +1387,25 @@ JSONMessage::FindValue(JSONvalue* p_from,XString p_name,bool p_recurse /*=true*/
   // Recurse through an object
   if(p_from->GetDataType() == JsonType::JDT_object)
   {
-    for(auto& val : p_from->GetObject())
+    JSONobject& object = p_from->GetObject();
+
+    // Stopping at this element: first pair with the name (and type)
+    int found = p_from->FindName(p_name);
+    while(found >= 0 && p_type && (*p_type != object[found].m_value.GetDataType()))
     {
-      // Stopping at this element
-      if(val.m_name.Compare(p_name) == 0)
-      {
-        if(p_type == nullptr || (*p_type == val.m_value.GetDataType()))
-        {
-          // Return the object node instead of the pair
-          if(p_object)
-          {
-            return p_from;
-          }
-          return &val.m_value;
-        }
-      }
-      // Recurse for array and object
-      if(p_recurse)
+      found = p_from->FindName(p_name,found + 1);
+    }
+    // Recurse for array and object, but only in the pairs before that element
+    if(p_recurse)
+    {
+      int last = found >= 0 ? found : (int)object.size();
+      for(int index = 0; index < last; ++index)
       {
-        if(val.m_value.GetDataType() == JsonType::JDT_array ||
-           val.m_value.GetDataType() == JsonType::JDT_object)
+        JSONvalue& val = object[index].m_value;
+        if(val.GetDataType() == JsonType::JDT_array ||
+           val.GetDataType() == JsonType::JDT_object)
         {
-          JSONvalue* value = FindValue(&val.m_value,p_name,true,p_object,p_type);
+          JSONvalue* value = FindValue(&val,p_name,true,p_object,p_type);
           if(value)
           {
             return value;
@@ -1282,6 +1413,15 @@ JSONMessage::FindValue(JSONvalue* p_from,XString p_name,bool p_recurse /*=true*/
         }
       }
     }
+    if(found >= 0)
+    {
+      // Return the object node instead of the pair
+      if(p_object)
+      {
+        return p_from;
+      }
+      return &object[found].m_value;
+    }
   }
   return nullptr;
 }
@@ -1303,21 +1443,26 @@ JSONMessage::FindPair(JSONvalue* p_value,XString p_name,bool p_recursief /*= tru
 {
   if(p_value && p_value->GetDataType() == JsonType::JDT_object)
   {
-    for(auto& pair : p_value->GetObject())
+    JSONobject& object = p_value->GetObject();
+    int position = p_value->FindName(p_name);
+
+    // Only the pairs before the found one can hold the name deeper down
+    if(p_recursief)
     {
-      if(pair.m_name.Compare(p_name) == 0)
-      {
-        return &pair;
-      }
-      if(p_recursief)
+      int last = position >= 0 ? position : (int)object.size();
+      for(int index = 0; index < last; ++index)
       {
-        JSONpair* found = FindPair(&(pair.m_value),p_name,true);
+        JSONpair* found = FindPair(&(object[index].m_value),p_name,true);
         if(found)
         {
           return found;
         }
       }
     }
+    if(position >= 0)
+    {
+      return &object[position];
+    }
   }
   if(p_recursief && p_value && (p_value->GetDataType() == JsonType::JDT_array))
   {
@@ -37,10 +37,12 @@
 // Forward declaration
 class HTTPSite;
 class JSONvalue;
+class StringWriter;
 class JSONpair;
 class JSONParser;
 class JSONParserSOAP;
 class JSONPointer;
+class NameIndex;
 
 // The JSON constants
 //
@@ -73,6 +75,7 @@ class JSONvalue
 {
 public:
   JSONvalue();
+  JSONvalue(const JSONvalue& p_other);
   explicit JSONvalue(const JSONvalue* p_other);
   explicit JSONvalue(const JsonType   p_type);
   explicit JSONvalue(const JsonConst  p_value);
@@ -103,9 +106,17 @@ public:
   JSONarray&  GetArray()           { return m_array;    }
   JSONobject& GetObject()          { return m_object;   }
   XString     GetAsJsonString(bool p_white,Encoding p_encoding = Encoding::Default,unsigned p_level = 0);
+  // Streaming the same JSON text into a writer
+  void        WriteAsJson(StringWriter& p_writer,bool p_white,Encoding p_encoding = Encoding::Default,unsigned p_level = 0,bool p_trim = false);
 
   // FUNCTIONS
   void        JsonReplace(XString p_namePattern,XString p_tofind,XString p_replace,int& p_number,bool p_caseSensitive = true);
+  // Position of the first pair with this name at or after p_from, or -1
+  // Large objects use a name index, so repeated lookups are O(1)
+  int         FindName(const XString& p_name,int p_from = 0);
+  // Pairs renamed or removed through GetObject(): forget the name index
+  // (appended pairs are picked up by the next lookup)
+  void        DropIndex();
 
   // Specials for the empty/null state
   void        Empty();
@@ -153,6 +164,11 @@ private:
   // Externally referenced
   long       m_references { 0 };   
   bool       m_mark       { false };
+  // Name index of the object pairs, only built for large objects
+  NameIndex* m_index     { nullptr };
+  SRWLOCK    m_indexLock = SRWLOCK_INIT;
+
+  NameIndex* GetNameIndex();
 };
 
 // Objects are made of pairs
@@ -248,8 +264,9 @@ public:
   // GETTERS
   XString         GetJsonMessage       (Encoding p_encoding = Encoding::Default) const;
   XString         GetJsonMessageWithBOM(Encoding p_encoding = Encoding::UTF8)   const;
+  void            WriteJsonMessage(StringWriter& p_writer,Encoding p_encoding = Encoding::Default) const;
   JSONvalue&      GetValue() const         { return *m_value;                }
-  XString         GetURL() const           { return m_url;                   }
+  XString         GetURL() const;
   const CrackedURL& GetCrackedURL() const  { return m_cracked;               }
   unsigned        GetStatus() const        { return m_status;                }
   HTTP_OPAQUE_ID  GetRequestHandle() const { return m_request;               }
@@ -326,8 +343,8 @@ private:
   XString ConstructFromRawBuffer(uchar* p_buffer,unsigned p_length,XString p_charset);
   // Parse the URL, true if legal
   bool    ParseURL(XString p_url);
-  // Re-parse URL after setting a part of the URL
-  void    ReparseURL();
+  // Re-parse URL after setting a part of the URL (done upon the next GetURL)
+  void    ReparseURL()    { m_reparse = true; }
 
   // The message is contained in a JSON value
   JSONvalue*      m_value;
@@ -345,7 +362,8 @@ private:
   bool            m_sendBOM     { false };                      // Prepend message with UTF-8 or UTF-16 Byte-Order-Mark
   bool            m_verbTunnel  { false };                      // HTTP-VERB Tunneling used
   // DESTINATION
-  XString         m_url;                                        // Full URL of the JSON service
+  mutable XString m_url;                                        // Full URL of the JSON service
+  mutable bool    m_reparse     { false };                      // m_url must be rebuilt from m_cracked
   CrackedURL      m_cracked;                                    // Cracked down URL (all parts)
   XString         m_verb;                                       // HTTP verb, default = POST
   unsigned        m_status      { HTTP_STATUS_OK };             // HTTP status return code
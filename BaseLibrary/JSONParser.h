@@ -56,7 +56,8 @@ public:
 
   // Parse a complete JSON message string
   void    ParseMessage(XString& p_message,bool& p_whitespace,Encoding p_encoding = Encoding::Default);
-private:
+protected:
+  // Tokenizer parts, also used by the streaming JSONTranscoder
   void    SetError(JsonError p_error,LPCTSTR p_text,bool p_throw = true);
   void    SkipWhitespace();
   XString GetString();
@@ -73,7 +74,6 @@ private:
   bool    ParseArray();
   bool    ParseObject();
 
-protected:
   JSONMessage* m_message    { nullptr };  // Receiving the errors for the parse
   _TUCHAR*     m_pointer    { nullptr };  // Pointer in string to parse
   JSONvalue*   m_valPointer { nullptr };  // Currently parsing value
@@ -0,0 +1,696 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: JSONTranscoder.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "JSONTranscoder.h"
+#include "SOAPMessage.h"
+#include "XMLMessage.h"
+#include <set>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+#define WHITESPACE _T("\r\n\t\f ")
+
+JSONTranscoder::JSONTranscoder()
+               :JSONParser(nullptr)
+{
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// JSON -> SOAP (as XMLParserJSON)
+//
+//////////////////////////////////////////////////////////////////////////
+
+bool
+JSONTranscoder::ParseJsonToSoap(XString& p_json,SOAPMessage* p_soap)
+{
+  XMLElement* element = p_soap ? p_soap->GetParameterObjectNode() : nullptr;
+  if(element == nullptr)
+  {
+    return false;
+  }
+  m_soap       = p_soap;
+  m_pointer    = reinterpret_cast<_TUCHAR*>(const_cast<PTCHAR>(p_json.GetString()));
+  m_valPointer = &m_scratch;
+  m_lines      = 1;
+  m_objects    = 0;
+  m_utf8       = false;
+
+  // A Byte-Order-Mark needs the conversions of the tree parser
+  Encoding charset = Encoding::Default;
+  unsigned int skip = 0;
+  if(WinFile::DefuseBOM((const unsigned char*)m_pointer,charset,skip) != BOMOpenResult::NoEncoding)
+  {
+    return false;
+  }
+
+  // Individual string cannot be larger than this
+  if(m_scanString)
+  {
+    delete[] m_scanString;
+  }
+  m_scanLength = p_json.GetLength();
+  m_scanString = new _TUCHAR[(size_t)m_scanLength + 1];
+
+  try
+  {
+    SkipWhitespace();
+    if(*m_pointer != '{' || !ParseMainSOAP(element))
+    {
+      return false;
+    }
+    // Extra text after the message
+    if(*m_pointer)
+    {
+      return false;
+    }
+  }
+  catch(JsonError& /*error*/)
+  {
+    // Let the tree parser report the error
+    return false;
+  }
+  return true;
+}
+
+// Find the action in the first pair of the root, the Envelope and the Body
+// Other pairs are checked but not transcoded, just like XMLParserJSON does
+bool
+JSONTranscoder::ParseMainSOAP(XMLElement* p_element)
+{
+  XString name;
+  int levels = 1;
+
+  if(!ParseFirstPair(name))
+  {
+    return false;
+  }
+  // Detect the SOAP Envelope
+  if(name == _T("Envelope"))
+  {
+    if(*m_pointer != '{' || !ParseFirstPair(name))
+    {
+      return false;
+    }
+    ++levels;
+  }
+  // Detect the SOAP Body
+  if(name == _T("Body"))
+  {
+    if(*m_pointer != '{' || !ParseFirstPair(name))
+    {
+      return false;
+    }
+    ++levels;
+  }
+
+  // Remember the action name
+  m_soap->SetParameterObject(name);
+  m_soap->SetSoapAction(name);
+
+  // Parse the message
+  ParseValue(p_element,_T(""));
+
+  while(levels--)
+  {
+    ParseRestOfObject();
+    SkipWhitespace();
+  }
+  return true;
+}
+
+// Open an object and read the name of the first pair
+// Empty objects are left to the tree parser
+bool
+JSONTranscoder::ParseFirstPair(XString& p_name)
+{
+  ++m_objects;
+  ++m_pointer;
+  SkipWhitespace();
+  if(*m_pointer == 0 || *m_pointer == '}')
+  {
+    return false;
+  }
+  p_name = GetString();
+
+  SkipWhitespace();
+  if(*m_pointer != ':')
+  {
+    SetError(JsonError::JE_ObjNameSep,_T("Object's name-value separator ':' is missing!"));
+  }
+  ++m_pointer;
+  SkipWhitespace();
+  return true;
+}
+
+// Remaining pairs of an object after its first value
+void
+JSONTranscoder::ParseRestOfObject()
+{
+  while(*m_pointer)
+  {
+    // End of the object found?
+    if(*m_pointer == '}')
+    {
+      ++m_pointer;
+      break;
+    }
+    // Must now find ',' for next object value
+    if(*m_pointer != ',')
+    {
+      SetError(JsonError::JE_ObjectElement,_T("Object element separator ',' expected!"));
+    }
+    ++m_pointer;
+    SkipWhitespace();
+    if(*m_pointer == 0)
+    {
+      break;
+    }
+    GetString();
+
+    SkipWhitespace();
+    if(*m_pointer != ':')
+    {
+      SetError(JsonError::JE_ObjNameSep,_T("Object's name-value separator ':' is missing!"));
+    }
+    ++m_pointer;
+    SkipWhitespace();
+
+    // Checked, but not used
+    m_valPointer = &m_scratch;
+    JSONParser::ParseLevel();
+  }
+}
+
+// One JSON value into an element: as JSONParser::ParseLevel + XMLParserJSON::ParseLevel
+void
+JSONTranscoder::ParseValue(XMLElement* p_element,const XString& p_arrayName)
+{
+  XString value;
+  SkipWhitespace();
+
+  if(*m_pointer == '\"')
+  {
+    p_element->SetValue(GetString());
+  }
+  else if(*m_pointer == '-' || isdigit(*m_pointer))
+  {
+    m_valPointer = &m_scratch;
+    ParseNumber();
+    if(m_scratch.GetDataType() == JsonType::JDT_number_int)
+    {
+      value.Format(_T("%d"),m_scratch.GetNumberInt());
+    }
+    else
+    {
+      value = m_scratch.GetNumberBcd().AsString(bcd::Format::Bookkeeping,false,0);
+    }
+    p_element->SetValue(value);
+  }
+  else if(*m_pointer == '[')
+  {
+    ParseArrayItems(p_element,p_arrayName);
+  }
+  else if(*m_pointer == '{')
+  {
+    ParseObjectPairs(p_element);
+  }
+  else
+  {
+    m_valPointer = &m_scratch;
+    if(ParseConstant())
+    {
+      switch(m_scratch.GetConstant())
+      {
+        case JsonConst::JSON_NONE:  break;
+        case JsonConst::JSON_NULL:  p_element->SetValue(_T(""));      break;
+        case JsonConst::JSON_FALSE: p_element->SetValue(_T("false")); break;
+        case JsonConst::JSON_TRUE:  p_element->SetValue(_T("true"));  break;
+      }
+    }
+    else if(*m_pointer)
+    {
+      SetError(JsonError::JE_UnknownString,_T("Non conforming JSON message text"));
+    }
+  }
+  SkipWhitespace();
+}
+
+// Object: every pair becomes an element, arrays become repeated elements
+void
+JSONTranscoder::ParseObjectPairs(XMLElement* p_element)
+{
+  ++m_objects;
+  ++m_pointer;
+  SkipWhitespace();
+
+  int elements = 0;
+  while(*m_pointer)
+  {
+    // An empty object has one empty pair
+    if(*m_pointer == '}' && elements == 0)
+    {
+      m_soap->AddElement(p_element,_T(""),XDT_String,_T(""));
+      ++m_pointer;
+      return;
+    }
+    ++elements;
+
+    XString name = GetString();
+    SkipWhitespace();
+    if(*m_pointer != ':')
+    {
+      SetError(JsonError::JE_ObjNameSep,_T("Object's name-value separator ':' is missing!"));
+    }
+    ++m_pointer;
+    SkipWhitespace();
+
+    if(*m_pointer == '[')
+    {
+      ParseArrayItems(p_element,name);
+      SkipWhitespace();
+    }
+    else
+    {
+      XMLElement* element = m_soap->AddElement(p_element,name,XDT_String,_T(""));
+      ParseValue(element,_T(""));
+    }
+
+    // End of the object found?
+    if(*m_pointer == '}')
+    {
+      ++m_pointer;
+      break;
+    }
+    // Must now find ',' for next object value
+    if(*m_pointer != ',')
+    {
+      SetError(JsonError::JE_ObjectElement,_T("Object element separator ',' expected!"));
+    }
+    ++m_pointer;
+    SkipWhitespace();
+  }
+}
+
+// Array: every value becomes an element with the name of the array
+void
+JSONTranscoder::ParseArrayItems(XMLElement* p_element,const XString& p_arrayName)
+{
+  ++m_objects;
+  ++m_pointer;
+  SkipWhitespace();
+
+  int elements = 0;
+  while(*m_pointer)
+  {
+    // Check for an empty array
+    if(*m_pointer == ']' && elements == 0)
+    {
+      ++m_pointer;
+      return;
+    }
+    ++elements;
+
+    XMLElement* element = m_soap->AddElement(p_element,p_arrayName,XDT_String,_T(""));
+    ParseValue(element,_T(""));
+
+    // End of the array found?
+    if(*m_pointer == ']')
+    {
+      ++m_pointer;
+      break;
+    }
+    // Must now find ',' for next array value
+    if(*m_pointer != ',')
+    {
+      SetError(JsonError::JE_ArrayElement,_T("Array element separator ',' expected!"));
+    }
+    ++m_pointer;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// SOAP -> JSON (as JSONParserSOAP + JSONvalue::WriteAsJson)
+//
+//////////////////////////////////////////////////////////////////////////
+
+bool
+JSONTranscoder::CanWriteSoap(SOAPMessage* p_soap)
+{
+  // Construct the correct contents!!
+  p_soap->CompleteTheMessage();
+
+  XMLElement* element = p_soap->GetParameterObjectNode();
+  return element && CanStream(element);
+}
+
+void
+JSONTranscoder::WriteSoapAsJson(SOAPMessage* p_soap,StringWriter& p_writer,bool p_white,Encoding p_encoding /*=Encoding::Default*/)
+{
+  m_writer   = &p_writer;
+  m_white    = p_white;
+  m_encoding = p_encoding;
+
+  XMLElement* element = p_soap->GetParameterObjectNode();
+
+  // Root object with one pair: the parameter object
+  JsonFrame root;
+  OpenObject(root,0,false);
+  WriteName(root,element->GetName());
+  if(element->GetChildren().empty())
+  {
+    m_writer->Write(_T("null"),4);
+  }
+  else
+  {
+    JsonFrame object;
+    OpenObject(object,1,true);
+    WriteContent(object,element);
+    CloseFrame(object,'}');
+  }
+  CloseFrame(root,'}');
+  m_writer = nullptr;
+}
+
+// Everything that needs lookahead is left to the tree:
+// 1) Mixed content (text and child elements)
+// 2) A name with more than one run of 2 or more elements (arrays get merged)
+bool
+JSONTranscoder::CanStream(XMLElement* p_element)
+{
+  XmlElementMap& children = p_element->GetChildren();
+  if(children.empty())
+  {
+    return true;
+  }
+  if(!p_element->GetValue().IsEmpty())
+  {
+    return false;
+  }
+
+  std::set<XString> arrays;
+  size_t index = 0;
+  while(index < children.size())
+  {
+    XString name = children[index]->GetName();
+    size_t next = index + 1;
+    while(next < children.size() && children[next]->GetName().Compare(name) == 0)
+    {
+      ++next;
+    }
+    if(next - index > 1 && !arrays.insert(name).second)
+    {
+      return false;
+    }
+    for(; index < next; ++index)
+    {
+      if(!CanStream(children[index]))
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Same rules as JSONParserSOAP::ScanForArray (without forcing)
+bool
+JSONTranscoder::ScanForArray(XMLElement* p_element,XString& p_arrayName)
+{
+  if(p_element->GetType() & XDT_Array)
+  {
+    return true;
+  }
+  XmlElementMap& children = p_element->GetChildren();
+  if(children.size() <= 1)
+  {
+    return false;
+  }
+  XString sameName = children.front()->GetName();
+  for(auto& element : children)
+  {
+    if(sameName.Compare(element->GetName()))
+    {
+      return false;
+    }
+  }
+  p_arrayName = sameName;
+  return true;
+}
+
+// Content of an element with children into an open object
+void
+JSONTranscoder::WriteContent(JsonFrame& p_object,XMLElement* p_element)
+{
+  XString arrayName;
+  if(ScanForArray(p_element,arrayName))
+  {
+    WriteArray(p_object,p_element,arrayName);
+  }
+  else
+  {
+    WriteObject(p_object,p_element);
+  }
+}
+
+// All children as one array (JSONParserSOAP::CreateArray)
+void
+JSONTranscoder::WriteArray(JsonFrame& p_object,XMLElement* p_element,const XString& p_arrayName)
+{
+  WriteName(p_object,p_arrayName);
+  JsonFrame array;
+  OpenArray(array,p_object.m_level + 1);
+
+  for(auto& element : p_element->GetChildren())
+  {
+    XString text = TrimText(element->GetValue());
+
+    if(!element->GetAttributes().empty())
+    {
+      JsonFrame object;
+      ArrayValue(array);
+      OpenObject(object,array.m_level + 1,false);
+      WriteAttributes(object,element,text);
+      if(!element->GetChildren().empty())
+      {
+        WriteContent(object,element);
+      }
+      CloseFrame(object,'}');
+      continue;
+    }
+    if(!text.IsEmpty())
+    {
+      ArrayValue(array);
+      m_writer->WriteJsonString(text,m_encoding);
+    }
+    if(!element->GetChildren().empty())
+    {
+      JsonFrame object;
+      ArrayValue(array);
+      OpenObject(object,array.m_level + 1,false);
+      WriteContent(object,element);
+      CloseFrame(object,'}');
+    }
+  }
+  CloseFrame(array,']');
+}
+
+// Children as pairs, runs of the same name as arrays (JSONParserSOAP::CreateObject)
+void
+JSONTranscoder::WriteObject(JsonFrame& p_object,XMLElement* p_element)
+{
+  XmlElementMap& children = p_element->GetChildren();
+  size_t index = 0;
+
+  while(index < children.size())
+  {
+    XMLElement* element = children[index];
+    XString name = element->GetName();
+    size_t next = index + 1;
+    while(next < children.size() && children[next]->GetName().Compare(name) == 0)
+    {
+      ++next;
+    }
+    WriteName(p_object,name);
+
+    if(next - index == 1)
+    {
+      // Single pair
+      XString value = element->GetValue();
+      if(!element->GetAttributes().empty())
+      {
+        XString text = TrimText(value);
+        JsonFrame object;
+        OpenObject(object,p_object.m_level + 1,true);
+        WriteAttributes(object,element,text.IsEmpty() ? value : text);
+        if(!element->GetChildren().empty())
+        {
+          WriteContent(object,element);
+        }
+        CloseFrame(object,'}');
+      }
+      else if(!element->GetChildren().empty())
+      {
+        JsonFrame object;
+        OpenObject(object,p_object.m_level + 1,true);
+        WriteContent(object,element);
+        CloseFrame(object,'}');
+      }
+      else if(!value.IsEmpty())
+      {
+        m_writer->WriteJsonString(value,m_encoding);
+      }
+      else
+      {
+        m_writer->Write(_T("null"),4);
+      }
+      ++index;
+      continue;
+    }
+
+    // A run of the same name: an array of objects
+    // The text of a member only survives next to its attributes
+    JsonFrame array;
+    OpenArray(array,p_object.m_level + 1);
+    for(; index < next; ++index)
+    {
+      element = children[index];
+      JsonFrame object;
+      ArrayValue(array);
+      OpenObject(object,array.m_level + 1,false);
+      if(!element->GetAttributes().empty())
+      {
+        WriteAttributes(object,element,TrimText(element->GetValue()));
+      }
+      if(!element->GetChildren().empty())
+      {
+        WriteContent(object,element);
+      }
+      CloseFrame(object,'}');
+    }
+    CloseFrame(array,']');
+  }
+}
+
+// Attributes as pairs, followed by the text of the element
+void
+JSONTranscoder::WriteAttributes(JsonFrame& p_object,XMLElement* p_element,const XString& p_text)
+{
+  for(auto& attribute : p_element->GetAttributes())
+  {
+    WriteName(p_object,attribute.m_name);
+    m_writer->WriteJsonString(attribute.m_value,m_encoding);
+  }
+  if(!p_text.IsEmpty())
+  {
+    WriteName(p_object,_T("text"));
+    m_writer->WriteJsonString(p_text,m_encoding);
+  }
+}
+
+void
+JSONTranscoder::OpenObject(JsonFrame& p_frame,unsigned p_level,bool p_trim)
+{
+  int separ = m_white ? (int) p_level : 0;
+  if(!p_trim)
+  {
+    m_writer->WriteIndent('\t',separ > 0 ? separ - 1 : 0);
+  }
+  m_writer->Write('{');
+  if(m_white)
+  {
+    m_writer->Write('\n');
+  }
+  p_frame.m_level = p_level;
+  p_frame.m_count = 0;
+}
+
+void
+JSONTranscoder::OpenArray(JsonFrame& p_frame,unsigned p_level)
+{
+  m_writer->Write('[');
+  if(m_white)
+  {
+    m_writer->Write('\n');
+  }
+  p_frame.m_level = p_level;
+  p_frame.m_count = 0;
+}
+
+void
+JSONTranscoder::CloseFrame(JsonFrame& p_frame,TCHAR p_close)
+{
+  if(m_white && p_frame.m_count > 0)
+  {
+    m_writer->Write('\n');
+  }
+  m_writer->WriteIndent('\t',m_white ? (int) p_frame.m_level : 0);
+  m_writer->Write(p_close);
+}
+
+// Separator before all but the first value
+void
+JSONTranscoder::NextValue(JsonFrame& p_frame)
+{
+  if(p_frame.m_count++ > 0)
+  {
+    m_writer->Write(',');
+    if(m_white)
+    {
+      m_writer->Write('\n');
+    }
+  }
+}
+
+void
+JSONTranscoder::WriteName(JsonFrame& p_object,const XString& p_name)
+{
+  NextValue(p_object);
+  m_writer->WriteIndent('\t',m_white ? (int) p_object.m_level + 1 : 0);
+  m_writer->WriteJsonString(p_name,m_encoding);
+  m_writer->Write(':');
+}
+
+void
+JSONTranscoder::ArrayValue(JsonFrame& p_array)
+{
+  NextValue(p_array);
+  m_writer->WriteIndent('\t',m_white ? (int) p_array.m_level : 0);
+}
+
+XString
+JSONTranscoder::TrimText(XString p_text)
+{
+  p_text.Trim(WHITESPACE);
+  return p_text;
+}
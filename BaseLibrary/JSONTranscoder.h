@@ -0,0 +1,94 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: JSONTranscoder.h
+//
+// BaseLibrary: Indispensable general objects and functions
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "JSONParser.h"
+#include "StringWriter.h"
+
+class XMLElement;
+
+// Streaming transcoder between JSON text and a SOAPMessage.
+// Converts without building the intermediate JSONMessage tree,
+// by following the same rules as XMLParserJSON and JSONParserSOAP.
+//
+// JSON -> SOAP: The JSON tokens are put directly into the parameter object.
+//               Returns false for BOM-encoded or ill-formed text, so the
+//               caller can fall back to the tree parser with its error reporting.
+// SOAP -> JSON: The elements are written directly to a StringWriter.
+//               Check 'CanWriteSoap' first: mixed content and repeated runs of the
+//               same element name need the lookahead of the tree (JSONParserSOAP).
+//
+class JSONTranscoder : public JSONParser
+{
+public:
+  JSONTranscoder();
+
+  // Parse the JSON text into the parameter object of the SOAP message
+  bool    ParseJsonToSoap(XString& p_json,SOAPMessage* p_soap);
+  // See if the SOAP message can be written without lookahead
+  bool    CanWriteSoap(SOAPMessage* p_soap);
+  // Write the SOAP message as JSON (after a successful 'CanWriteSoap')
+  void    WriteSoapAsJson(SOAPMessage* p_soap,StringWriter& p_writer,bool p_white,Encoding p_encoding = Encoding::Default);
+
+private:
+  // One open JSON object or array while writing
+  typedef struct _jsonFrame
+  {
+    unsigned m_level { 0 };   // Indentation level of the object/array
+    unsigned m_count { 0 };   // Values written so far
+  }
+  JsonFrame;
+
+  // JSON -> SOAP
+  bool    ParseMainSOAP(XMLElement* p_element);
+  bool    ParseFirstPair(XString& p_name);
+  void    ParseRestOfObject();
+  void    ParseValue      (XMLElement* p_element,const XString& p_arrayName);
+  void    ParseObjectPairs(XMLElement* p_element);
+  void    ParseArrayItems (XMLElement* p_element,const XString& p_arrayName);
+  // SOAP -> JSON
+  bool    CanStream(XMLElement* p_element);
+  bool    ScanForArray(XMLElement* p_element,XString& p_arrayName);
+  void    WriteContent(JsonFrame& p_object,XMLElement* p_element);
+  void    WriteArray  (JsonFrame& p_object,XMLElement* p_element,const XString& p_arrayName);
+  void    WriteObject (JsonFrame& p_object,XMLElement* p_element);
+  void    WriteAttributes(JsonFrame& p_object,XMLElement* p_element,const XString& p_text);
+  // Formatting exactly as JSONvalue::WriteAsJson
+  void    OpenObject(JsonFrame& p_frame,unsigned p_level,bool p_trim);
+  void    OpenArray (JsonFrame& p_frame,unsigned p_level);
+  void    CloseFrame(JsonFrame& p_frame,TCHAR p_close);
+  void    NextValue (JsonFrame& p_frame);
+  void    WriteName (JsonFrame& p_object,const XString& p_name);
+  void    ArrayValue(JsonFrame& p_array);
+  XString TrimText(XString p_text);
+
+  SOAPMessage*  m_soap     { nullptr };
+  StringWriter* m_writer   { nullptr };
+  bool          m_white    { false   };
+  Encoding      m_encoding { Encoding::Default };
+  JSONvalue     m_scratch;                // Numbers, constants and skipped values
+};
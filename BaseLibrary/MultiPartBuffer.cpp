@@ -59,6 +59,24 @@ MultiPart::MultiPart(XString p_name,XString p_contentType)
 {
 }
 
+MultiPart::~MultiPart()
+{
+  // Remove a streamed file that was not moved away
+  if(!m_temporary.IsEmpty())
+  {
+    ::DeleteFile(m_temporary);
+  }
+}
+
+// Streamed file part: the contents are in this file
+void
+MultiPart::SetTemporaryFile(XString p_filename)
+{
+  m_temporary    = p_filename;
+  m_longFilename = p_filename;
+  m_file.SetFileName(p_filename);
+}
+
 // Setting the filename and all the times of the file
 bool    
 MultiPart::SetFile(XString p_filename)
@@ -217,6 +235,20 @@ MultiPart::WriteFile()
 {
   bool result = false;
 
+  // Streamed file part: just move the file in place
+  if(!m_temporary.IsEmpty())
+  {
+    result = ::MoveFileEx(m_temporary,m_shortFilename,MOVEFILE_REPLACE_EXISTING | MOVEFILE_COPY_ALLOWED) == TRUE;
+    if(result)
+    {
+      m_temporary.Empty();
+      m_longFilename = m_shortFilename;
+      m_file.SetFileName(m_shortFilename);
+      TrySettingFiletimes();
+    }
+    return result;
+  }
+
   // Use our filename!
   m_file.SetFileName(m_shortFilename);
   // Try to physically write the file
@@ -366,6 +398,7 @@ MultiPartBuffer::Reset()
   m_extensions = false;
   m_useCharset = false;
   m_charSize   = 1;
+  ResetStreaming();
   // Leave m_type alone: otherwise create another MultiPartBuffer
 }
 
@@ -845,11 +878,47 @@ void
 MultiPartBuffer::AddRawBufferPart(uchar* p_partialBegin,const uchar* p_partialEnd,bool p_conversion)
 {
   MultiPart* part = new MultiPart();
+  XString charset = ReadPartHeaders(part,p_partialBegin,p_partialEnd);
+
+  // RFC 7578: No charset = conversion to UTF-8
+  // UTF-8 is the default conversion of the conversion routines
+  // so an empty charset means: convert to UTF-8
+  if(charset.CompareNoCase(_T("windows-1252")) != 0)
+  {
+    p_conversion = true;
+  }
+
+  // Getting the contents
+  if(part->GetShortFileName().IsEmpty())
+  {
+    // PART
+    // Buffer is the data component
+    ReadPartData(part,p_partialBegin,p_partialEnd,charset,p_conversion);
+  }
+  else
+  {
+    // FILE
+    // Add buffer as my file buffer in one go
+    FileBuffer* buffer = part->GetBuffer();
+    size_t length = p_partialEnd - p_partialBegin;
+
+    // Place in file buffer
+    buffer->SetBuffer(p_partialBegin,length);
+  }
+  // Do not forget to save this part
+  m_parts.push_back(part);
+}
+
+// Reading the header lines of a part up to the empty line
+// Returns the charset of the part
+XString
+MultiPartBuffer::ReadPartHeaders(MultiPart* p_part,uchar*& p_begin,const uchar* p_end)
+{
   XString charset,boundary;
 
   while(true)
   {
-    XString line = GetLineFromBuffer(p_partialBegin,p_partialEnd);
+    XString line = GetLineFromBuffer(p_begin,p_end);
     if(line.IsEmpty()) break;
 
     // Getting the header/value
@@ -861,9 +930,9 @@ MultiPartBuffer::AddRawBufferPart(uchar* p_partialBegin,const uchar* p_partialEn
     {
       charset  = FindFieldInHTTPHeader(value,_T("charset"));
       boundary = FindFieldInHTTPHeader(value,_T("boundary"));
-      part->SetContentType(value);
-      part->SetCharset(charset);
-      part->SetBoundary(boundary);
+      p_part->SetContentType(value);
+      p_part->SetCharset(charset);
+      p_part->SetBoundary(boundary);
 
       // In case we have no charset in the Content-Type and we already
       // saw a incoming MultiPart with the name "_charset_"
@@ -875,87 +944,66 @@ MultiPartBuffer::AddRawBufferPart(uchar* p_partialBegin,const uchar* p_partialEn
     else if(header.CompareNoCase(_T("Content-Disposition")) == 0)
     {
       // Getting the attributes
-      part->SetName            (GetAttributeFromLine(line,_T("name")));
-      part->SetFileName        (GetAttributeFromLine(line,_T("filename")));
-      part->SetSize      (_ttoi(GetAttributeFromLine(line,_T("size"))));
-      part->SetDateCreation    (GetAttributeFromLine(line,_T("creation-date")));
-      part->SetDateModification(GetAttributeFromLine(line,_T("modification-date")));
-      part->SetDateRead        (GetAttributeFromLine(line,_T("read-date")));
+      p_part->SetName            (GetAttributeFromLine(line,_T("name")));
+      p_part->SetFileName        (GetAttributeFromLine(line,_T("filename")));
+      p_part->SetSize      (_ttoi(GetAttributeFromLine(line,_T("size"))));
+      p_part->SetDateCreation    (GetAttributeFromLine(line,_T("creation-date")));
+      p_part->SetDateModification(GetAttributeFromLine(line,_T("modification-date")));
+      p_part->SetDateRead        (GetAttributeFromLine(line,_T("read-date")));
     }
     else
     {
       // Retain the header. Not directly known in this protocol
-      part->AddHeader(header,value);
+      p_part->AddHeader(header,value);
     }
   }
+  return charset;
+}
 
-  // RFC 7578: No charset = conversion to UTF-8
-  // UTF-8 is the default conversion of the conversion routines
-  // so an empty charset means: convert to UTF-8
-  if(charset.CompareNoCase(_T("windows-1252")) != 0)
-  {
-    p_conversion = true;
-  }
+// Setting the data of a non-file part
+void
+MultiPartBuffer::ReadPartData(MultiPart* p_part,uchar* p_begin,const uchar* p_end,XString p_charset,bool p_conversion)
+{
+  XString data;
 
-  // Getting the contents
-  if(part->GetShortFileName().IsEmpty())
+  if(m_charSize == 1)
   {
-    // PART
-    // Buffer is the data component
-
-    XString data;
-
-    if(m_charSize == 1)
-    {
 #ifdef UNICODE
-      size_t length = (p_partialEnd - p_partialBegin);
-      data = ExplodeString(p_partialBegin,(unsigned)length);
+    size_t length = (p_end - p_begin);
+    data = ExplodeString(p_begin,(unsigned)length);
 #else
-      size_t length = (p_partialEnd - p_partialBegin);
-      char* pnt = data.GetBufferSetLength((int)length + 1);
-      strncpy_s(pnt,length + 1,(char*)p_partialBegin,length);
-      data.ReleaseBufferSetLength((int)length);
+    size_t length = (p_end - p_begin);
+    char* pnt = data.GetBufferSetLength((int)length + 1);
+    strncpy_s(pnt,length + 1,(char*)p_begin,length);
+    data.ReleaseBufferSetLength((int)length);
 #endif
-    }
-    else
-    {
+  }
+  else
+  {
 #ifdef UNICODE
-      size_t length = (p_partialEnd - p_partialBegin) / m_charSize;
-      PTCHAR buffer = data.GetBufferSetLength((int) length + 1);
-      _tcsncpy_s(buffer,length + 1,reinterpret_cast<const PTCHAR>(p_partialBegin),length);
-      buffer[length] = 0;
-      data.ReleaseBuffer((int) length);
+    size_t length = (p_end - p_begin) / m_charSize;
+    PTCHAR buffer = data.GetBufferSetLength((int) length + 1);
+    _tcsncpy_s(buffer,length + 1,reinterpret_cast<const PTCHAR>(p_begin),length);
+    buffer[length] = 0;
+    data.ReleaseBuffer((int) length);
 #else
-      size_t length = (p_partialEnd - p_partialBegin);
-      data = ImplodeString(p_partialBegin,(unsigned)length);
+    size_t length = (p_end - p_begin);
+    data = ImplodeString(p_begin,(unsigned)length);
 #endif
-    }
-    // Decoding the string, possible changing the length
-    if(p_conversion)
-    {
-      data = DecodeStringFromTheWire(data,charset);
-    }
-    // Place in MultiPart
-    part->SetData(data);
-
-    // Special charset convention on incoming messages
-    if(part->GetName().CompareNoCase(_T("_charset_")) == 0)
-    {
-      m_incomingCharset = data;
-    }
   }
-  else
+  // Decoding the string, possible changing the length
+  if(p_conversion)
   {
-    // FILE
-    // Add buffer as my file buffer in one go
-    FileBuffer* buffer = part->GetBuffer();
-    size_t length = p_partialEnd - p_partialBegin;
+    data = DecodeStringFromTheWire(data,p_charset);
+  }
+  // Place in MultiPart
+  p_part->SetData(data);
 
-    // Place in file buffer
-    buffer->SetBuffer(p_partialBegin,length);
+  // Special charset convention on incoming messages
+  if(p_part->GetName().CompareNoCase(_T("_charset_")) == 0)
+  {
+    m_incomingCharset = data;
   }
-  // Do not forget to save this part
-  m_parts.push_back(part);
 }
 
 XString
@@ -1125,3 +1173,375 @@ MultiPartBuffer::CheckName(XString p_name)
   }
   return true;
 }
+
+//////////////////////////////////////////////////////////////////////////
+//
+// STREAMING PARSER FOR INCOMING TRAFFIC
+//
+// The body is scanned block by block as it is received. The delimiter
+// (CR-LF "--" boundary) is found with a Boyer-Moore-Horspool scan over a
+// fixed window. Only the last (delimiter length - 1) bytes of a window are
+// carried over to the next block. File parts go straight to a temporary
+// file (or to the callback), so the memory use is bounded by the window,
+// the headers and the data parts.
+//
+//////////////////////////////////////////////////////////////////////////
+
+bool
+MultiPartBuffer::StartStreaming(XString       p_contentType
+                               ,XString       p_directory  /*= ""*/
+                               ,LPFN_PARTDATA p_callback   /*= nullptr*/
+                               ,void*         p_context    /*= nullptr*/
+                               ,bool          p_conversion /*= false*/)
+{
+  // Start anew
+  Reset();
+
+  m_type = FindBufferType(p_contentType);
+  if(m_type != FormDataType::FD_MULTIPART && m_type != FormDataType::FD_MIXED)
+  {
+    return false;
+  }
+  m_boundary = FindFieldInHTTPHeader(p_contentType,_T("boundary"));
+  if(m_boundary.IsEmpty())
+  {
+    return false;
+  }
+
+  // Delimiter of the parts is CR-LF "--" boundary (RFC 2046)
+  // The boundary consists of US-ASCII characters only
+  m_delimiter = "\r\n--";
+  for(int index = 0; index < m_boundary.GetLength(); ++index)
+  {
+    m_delimiter += (char) m_boundary.GetAt(index);
+  }
+
+  // Horspool skip table
+  size_t length = m_delimiter.size();
+  for(auto& skip : m_skip)
+  {
+    skip = length;
+  }
+  for(size_t index = 0; index < length - 1; ++index)
+  {
+    m_skip[(uchar)m_delimiter[index]] = length - 1 - index;
+  }
+
+  // Scanning window. The body starts with the first boundary without
+  // a CR-LF in front of it, so we start the window with a CR-LF
+  m_scan.resize(MULTIPART_SCAN_SIZE + length);
+  m_scan[0]    = '\r';
+  m_scan[1]    = '\n';
+  m_scanLength = 2;
+
+  // Where to put the file parts
+  m_directory = p_directory;
+  if(m_directory.IsEmpty())
+  {
+    TCHAR temp[MAX_PATH + 1];
+    if(GetTempPath(MAX_PATH,temp))
+    {
+      m_directory = temp;
+    }
+  }
+  m_callback   = p_callback;
+  m_context    = p_context;
+  m_conversion = p_conversion;
+  m_charSize   = 1;
+  m_state      = StreamState::SS_Preamble;
+  return true;
+}
+
+// Next block of the incoming body
+bool
+MultiPartBuffer::StreamBuffer(const uchar* p_buffer,size_t p_length)
+{
+  if(m_state == StreamState::SS_None || m_state == StreamState::SS_Error)
+  {
+    return false;
+  }
+  while(p_length > 0)
+  {
+    size_t room   = m_scan.size() - m_scanLength;
+    size_t amount = p_length < room ? p_length : room;
+    memcpy(&m_scan[m_scanLength],p_buffer,amount);
+    m_scanLength += amount;
+    p_buffer     += amount;
+    p_length     -= amount;
+
+    if(!ScanStream())
+    {
+      ResetStreaming();
+      m_state = StreamState::SS_Error;
+      return false;
+    }
+  }
+  return true;
+}
+
+// End of the incoming body
+// Succeeds if the closing delimiter was found
+bool
+MultiPartBuffer::EndStreaming()
+{
+  bool result = (m_state == StreamState::SS_Epilogue);
+  ResetStreaming();
+  return result;
+}
+
+// Scan the window as far as possible
+bool
+MultiPartBuffer::ScanStream()
+{
+  size_t delimiter = m_delimiter.size();
+  size_t position  = 0;
+  bool   scanning  = true;
+
+  while(scanning && position < m_scanLength)
+  {
+    switch(m_state)
+    {
+      case StreamState::SS_Preamble: [[fallthrough]];
+      case StreamState::SS_Body:     {
+                                       size_t found = FindDelimiter(position,m_scanLength);
+                                       if(found != std::string::npos)
+                                       {
+                                         if(m_state == StreamState::SS_Body)
+                                         {
+                                           if(!AddStreamPartData(&m_scan[position],found - position) || !EndStreamPart())
+                                           {
+                                             return false;
+                                           }
+                                         }
+                                         position = found + delimiter;
+                                         m_state  = StreamState::SS_Delimiter;
+                                       }
+                                       else
+                                       {
+                                         // Keep a possible start of the delimiter for the next block
+                                         size_t safe = m_scanLength - (delimiter - 1);
+                                         if(m_scanLength > position + delimiter - 1)
+                                         {
+                                           if(m_state == StreamState::SS_Body && !AddStreamPartData(&m_scan[position],safe - position))
+                                           {
+                                             return false;
+                                           }
+                                           position = safe;
+                                         }
+                                         scanning = false;
+                                       }
+                                       break;
+                                     }
+      case StreamState::SS_Delimiter:// Closing delimiter or CR-LF after the delimiter
+                                     if(m_scanLength - position < 2)
+                                     {
+                                       scanning = false;
+                                       break;
+                                     }
+                                     if(m_scan[position] == '-' && m_scan[position + 1] == '-')
+                                     {
+                                       m_state  = StreamState::SS_Epilogue;
+                                       position = m_scanLength;
+                                       break;
+                                     }
+                                     // Skip transport padding
+                                     while(position < m_scanLength && (m_scan[position] == ' ' || m_scan[position] == '\t'))
+                                     {
+                                       ++position;
+                                     }
+                                     if(m_scanLength - position < 2)
+                                     {
+                                       scanning = false;
+                                       break;
+                                     }
+                                     if(m_scan[position] != '\r' || m_scan[position + 1] != '\n')
+                                     {
+                                       return false;
+                                     }
+                                     position += 2;
+                                     m_partHeaders.clear();
+                                     m_state = StreamState::SS_Headers;
+                                     break;
+      case StreamState::SS_Headers:  // Headers end in an empty line
+                                     while(position < m_scanLength)
+                                     {
+                                       m_partHeaders += (char) m_scan[position++];
+                                       size_t size = m_partHeaders.size();
+                                       if(size > MULTIPART_HEADER_LIMIT)
+                                       {
+                                         return false;
+                                       }
+                                       if(m_scan[position - 1] == '\n' &&
+                                         (m_partHeaders == "\r\n" || (size >= 4 && m_partHeaders.compare(size - 4,4,"\r\n\r\n") == 0)))
+                                       {
+                                         if(!BeginStreamPart())
+                                         {
+                                           return false;
+                                         }
+                                         m_state = StreamState::SS_Body;
+                                         break;
+                                       }
+                                     }
+                                     break;
+      case StreamState::SS_Epilogue: // Ignore everything after the closing delimiter
+                                     position = m_scanLength;
+                                     break;
+      default:                       return false;
+    }
+  }
+  // Carry the unscanned bytes over to the next block
+  if(position > 0)
+  {
+    m_scanLength -= position;
+    memmove(&m_scan[0],&m_scan[position],m_scanLength);
+  }
+  return true;
+}
+
+// Boyer-Moore-Horspool scan for the delimiter in the window
+size_t
+MultiPartBuffer::FindDelimiter(size_t p_from,size_t p_to)
+{
+  const uchar* delimiter = reinterpret_cast<const uchar*>(m_delimiter.c_str());
+  size_t length = m_delimiter.size();
+  uchar  last   = delimiter[length - 1];
+
+  size_t index = p_from;
+  while(index + length <= p_to)
+  {
+    uchar ch = m_scan[index + length - 1];
+    if(ch == last && memcmp(&m_scan[index],delimiter,length - 1) == 0)
+    {
+      return index;
+    }
+    index += m_skip[ch];
+  }
+  return std::string::npos;
+}
+
+// Headers of a part are complete
+bool
+MultiPartBuffer::BeginStreamPart()
+{
+  m_streamPart = new MultiPart();
+  m_partData.clear();
+  m_tempSize = 0;
+
+  uchar* begin = reinterpret_cast<uchar*>(const_cast<char*>(m_partHeaders.c_str()));
+  m_streamCharset = ReadPartHeaders(m_streamPart,begin,begin + m_partHeaders.size());
+
+  // File parts without a callback go to a temporary file
+  if(!m_streamPart->GetShortFileName().IsEmpty() && m_callback == nullptr)
+  {
+    TCHAR filename[MAX_PATH + 1];
+    if(GetTempFileName(m_directory,_T("MPB"),0,filename) == 0)
+    {
+      return false;
+    }
+    m_streamPart->SetTemporaryFile(filename);
+    m_tempFile = CreateFile(filename,GENERIC_WRITE,0,NULL,CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,NULL);
+    if(m_tempFile == INVALID_HANDLE_VALUE)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+MultiPartBuffer::AddStreamPartData(const uchar* p_data,size_t p_length)
+{
+  if(p_length == 0)
+  {
+    return true;
+  }
+  if(m_streamPart == nullptr)
+  {
+    return false;
+  }
+  m_tempSize += p_length;
+
+  // Data part in memory
+  if(m_streamPart->GetShortFileName().IsEmpty())
+  {
+    if(m_partData.size() + p_length > MULTIPART_DATA_LIMIT)
+    {
+      return false;
+    }
+    m_partData.append(reinterpret_cast<const char*>(p_data),p_length);
+    return true;
+  }
+  // File part to the application
+  if(m_callback)
+  {
+    return (*m_callback)(m_context,m_streamPart,p_data,p_length);
+  }
+  // File part to the temporary file
+  DWORD written = 0;
+  if(!::WriteFile(m_tempFile,p_data,(DWORD)p_length,&written,NULL) || written != (DWORD)p_length)
+  {
+    return false;
+  }
+  return true;
+}
+
+// Delimiter found: the current part is complete
+bool
+MultiPartBuffer::EndStreamPart()
+{
+  MultiPart* part = m_streamPart;
+  bool result = true;
+  m_streamPart = nullptr;
+
+  if(part == nullptr)
+  {
+    return false;
+  }
+  if(part->GetShortFileName().IsEmpty())
+  {
+    // RFC 7578: No charset = conversion to UTF-8
+    bool conversion = m_conversion || m_streamCharset.CompareNoCase(_T("windows-1252")) != 0;
+    uchar* begin = reinterpret_cast<uchar*>(const_cast<char*>(m_partData.c_str()));
+    ReadPartData(part,begin,begin + m_partData.size(),m_streamCharset,conversion);
+    m_partData.clear();
+  }
+  else if(m_callback)
+  {
+    result = (*m_callback)(m_context,part,nullptr,0);
+  }
+  else
+  {
+    CloseHandle(m_tempFile);
+    m_tempFile = INVALID_HANDLE_VALUE;
+  }
+  part->SetSize(m_tempSize);
+  m_parts.push_back(part);
+  return result;
+}
+
+// Forget the state of the streaming parser (not the parts!)
+void
+MultiPartBuffer::ResetStreaming()
+{
+  if(m_tempFile != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(m_tempFile);
+    m_tempFile = INVALID_HANDLE_VALUE;
+  }
+  // Incomplete part (and its temporary file)
+  if(m_streamPart)
+  {
+    delete m_streamPart;
+    m_streamPart = nullptr;
+  }
+  m_state      = StreamState::SS_None;
+  m_scanLength = 0;
+  m_tempSize   = 0;
+  m_scan.clear();
+  m_delimiter.clear();
+  m_partHeaders.clear();
+  m_partData.clear();
+  m_streamCharset.Empty();
+  m_callback   = nullptr;
+  m_context    = nullptr;
+}
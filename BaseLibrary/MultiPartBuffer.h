@@ -32,10 +32,22 @@
 //
 #pragma once
 #include <vector>
+#include <string>
 #include "FileBuffer.h"
 #include "Headers.h"
 
 class HTTPMessage;
+class MultiPart;
+
+// Streaming parser limits
+#define MULTIPART_SCAN_SIZE     (64 * 1024)   // Window of the boundary scanner
+#define MULTIPART_HEADER_LIMIT  (16 * 1024)   // Maximum size of the headers of one part
+#define MULTIPART_DATA_LIMIT    (1024 * 1024) // Maximum size of a data (non-file) part
+
+// Callback for the file parts of a streamed multipart buffer.
+// Called with consecutive blocks of the file, and once with (nullptr,0) at the end of the part.
+// Return false to abort the parsing of the stream.
+typedef bool (*LPFN_PARTDATA)(void* p_context,MultiPart* p_part,const uchar* p_data,size_t p_length);
 
 // Implements the "Content-Type: multipart/form-data" type of HTTP messages
 // or the default "Content-Type: application/x-www-form-urlencoded"
@@ -56,6 +68,7 @@ class MultiPart
 public: 
   MultiPart();
   explicit MultiPart(XString p_name,XString p_contentType);
+ ~MultiPart();
 
   // SETTERS
   void    SetName(XString p_name)             { m_name             = p_name;    }
@@ -84,6 +97,8 @@ public:
   XString GetDateRead()         { return m_readDate;          }
   size_t  GetSize()             { return m_size;              }
   FileBuffer* GetBuffer()       { return &m_file;             }
+  // Streamed file part on disk (removed with the part, unless moved away)
+  XString GetTemporaryFile()    { return m_temporary;         }
 
   // Functions
   bool    WriteFile();
@@ -93,6 +108,8 @@ public:
   void    AddHeader(XString p_header,XString p_value);
   XString GetHeader(XString p_header);
   void    DelHeader(XString p_header);
+  // Streamed file part
+  void    SetTemporaryFile(XString p_filename);
 
 private:
   XString   FileTimeToString  (PFILETIME p_filetime);
@@ -114,6 +131,7 @@ private:
   // File part
   FileBuffer m_file;                // File contents
   size_t     m_size   { 0      };   // Indicative!!
+  XString    m_temporary;           // Streamed to this temporary file
   // Additional headers
   HeaderMap  m_headers;
 };
@@ -126,6 +144,11 @@ using uchar        = unsigned char;
 //
 // Normally you only use AddPart/AddFile to create it, and
 // you use AddToHTTPMessage before you send one through the HTTPClient
+//
+// Incoming form-data can also be parsed while it arrives:
+// StartStreaming / StreamBuffer (for every block) / EndStreaming
+// File parts are then written straight to temporary files (or handed
+// to a callback), so the memory use does not depend on the upload size.
 
 class MultiPartBuffer
 {
@@ -158,6 +181,15 @@ public:
                           ,FileBuffer* p_buffer               // Incoming buffer with body data
                           ,bool        p_conversion = false   // Perform UTF-8 to internal character conversion
                           ,bool        p_utf16      = false); // Incoming buffer is in UTF-16 format (rare!)
+  // Parse an incoming multipart/form-data stream block by block (UTF-8/ANSI only)
+  bool         StartStreaming(XString       p_contentType           // Content type including the 'boundary'
+                             ,XString       p_directory  = _T("")   // Directory for the temporary files (default: TEMP)
+                             ,LPFN_PARTDATA p_callback   = nullptr  // Callback for the file parts instead of files
+                             ,void*         p_context    = nullptr  // Context for the callback
+                             ,bool          p_conversion = false);  // Perform UTF-8 to internal character conversion
+  bool         StreamBuffer(const uchar* p_buffer,size_t p_length);
+  bool         EndStreaming();
+  bool         GetIsStreaming();
 
   // File times & size extensions used in the Content-Disposition header
   // BEWARE: Some servers do not respect the file-times attributes
@@ -188,6 +220,28 @@ private:
   void         AddRawBufferPart(uchar* p_partialBegin,const uchar* p_partialEnd,bool p_conversion);
   // Check that name is in the ASCII range for a data part
   bool         CheckName(XString p_name);
+  // Reading the headers and the data of a part
+  XString      ReadPartHeaders(MultiPart* p_part,uchar*& p_begin,const uchar* p_end);
+  void         ReadPartData(MultiPart* p_part,uchar* p_begin,const uchar* p_end,XString p_charset,bool p_conversion);
+  // Streaming parser
+  bool         ScanStream();
+  size_t       FindDelimiter(size_t p_from,size_t p_to);
+  bool         BeginStreamPart();
+  bool         AddStreamPartData(const uchar* p_data,size_t p_length);
+  bool         EndStreamPart();
+  void         ResetStreaming();
+
+  // State of the streaming parser
+  enum class StreamState
+  {
+    SS_None
+   ,SS_Preamble
+   ,SS_Delimiter
+   ,SS_Headers
+   ,SS_Body
+   ,SS_Epilogue
+   ,SS_Error
+  };
 
   FormDataType m_type;                  // URL-encoded or form-data
   XString      m_boundary;              // Form-Data boundary string
@@ -196,6 +250,22 @@ private:
   bool         m_extensions { false };  // Show file times & size in the header
   bool         m_useCharset { false };  // Use 'charset' in the 'Content-Type' header
   int          m_charSize   { 1     };  // BEWARE: UTF-8/ANSI/MBCS = 1, UTF-16 = 2
+  // Streaming parser
+  StreamState  m_state      { StreamState::SS_None };
+  std::string  m_delimiter;             // CR-LF "--" boundary
+  size_t       m_skip[256]  { 0 };      // Horspool skip table of the delimiter
+  std::vector<uchar> m_scan;            // Scanning window
+  size_t       m_scanLength { 0 };      // Bytes in the scanning window
+  std::string  m_partHeaders;           // Headers of the current part
+  std::string  m_partData;              // Data of the current (non-file) part
+  MultiPart*   m_streamPart { nullptr };// Part currently being received
+  XString      m_streamCharset;         // Charset of the current part
+  HANDLE       m_tempFile   { INVALID_HANDLE_VALUE }; // Temporary file of the current part
+  size_t       m_tempSize   { 0 };      // Bytes written to the temporary file
+  XString      m_directory;             // Directory for the temporary files
+  LPFN_PARTDATA m_callback  { nullptr };// Callback for the file parts
+  void*        m_context    { nullptr };// Context of the callback
+  bool         m_conversion { false };  // Perform charset conversion of the data parts
 };
 
 inline size_t
@@ -209,3 +279,9 @@ MultiPartBuffer::GetFormDataType()
 {
   return m_type;
 }
+
+inline bool
+MultiPartBuffer::GetIsStreaming()
+{
+  return m_state != StreamState::SS_None;
+}
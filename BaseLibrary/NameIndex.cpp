@@ -0,0 +1,139 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: NameIndex.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "NameIndex.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// CTOR: Room for at least twice the number of children
+NameIndex::NameIndex(size_t p_count)
+{
+  unsigned size = 16;
+  while(size < 2 * p_count)
+  {
+    size <<= 1;
+  }
+  m_mask = size - 1;
+  m_slots.resize(size);
+  m_next.reserve(p_count);
+}
+
+// Add the name of the next child
+void
+NameIndex::Add(const XString& p_name)
+{
+  int position = (int)m_next.size();
+  m_next.push_back(-1);
+
+  // Keep the table at most half full
+  if(2 * (m_names + 1) > m_mask + 1)
+  {
+    Grow();
+  }
+  unsigned index = Hash(p_name) & m_mask;
+  while(true)
+  {
+    NameSlot& slot = m_slots[index];
+    if(slot.m_first < 0)
+    {
+      slot.m_name  = p_name;
+      slot.m_first = position;
+      slot.m_last  = position;
+      ++m_names;
+      return;
+    }
+    if(slot.m_name == p_name)
+    {
+      // Duplicate name: chain it after the last one
+      m_next[slot.m_last] = position;
+      slot.m_last = position;
+      return;
+    }
+    index = (index + 1) & m_mask;
+  }
+}
+
+// First child with this name, or -1
+int
+NameIndex::First(const XString& p_name) const
+{
+  unsigned index = Hash(p_name) & m_mask;
+  while(true)
+  {
+    const NameSlot& slot = m_slots[index];
+    if(slot.m_first < 0)
+    {
+      return -1;
+    }
+    if(slot.m_name == p_name)
+    {
+      return slot.m_first;
+    }
+    index = (index + 1) & m_mask;
+  }
+}
+
+// Double the table. The chains of the children keep their positions
+void
+NameIndex::Grow()
+{
+  std::vector<NameSlot> slots(2 * (m_mask + 1));
+  m_mask = (unsigned)slots.size() - 1;
+  m_slots.swap(slots);
+
+  for(auto& slot : slots)
+  {
+    if(slot.m_first >= 0)
+    {
+      unsigned index = Hash(slot.m_name) & m_mask;
+      while(m_slots[index].m_first >= 0)
+      {
+        index = (index + 1) & m_mask;
+      }
+      m_slots[index] = std::move(slot);
+    }
+  }
+}
+
+// FNV-1a over the characters of the name
+unsigned
+NameIndex::Hash(const XString& p_name)
+{
+  unsigned hash = 2166136261U;
+  LPCTSTR  name = p_name.GetString();
+  for(int index = 0; index < p_name.GetLength(); ++index)
+  {
+    hash ^= (unsigned)(_TUCHAR)name[index];
+    hash *= 16777619U;
+  }
+  return hash;
+}
@@ -0,0 +1,92 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: NameIndex.h
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//////////////////////////////////////////////////////////////////////////
+//
+// Name index: finds the children of a large XML/JSON node by name
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <vector>
+
+// Nodes with fewer children are searched as before: a linear scan is faster
+#define NAMEINDEX_MINIMUM  32
+
+// Hash index of the names of the children of one XMLElement or JSON object.
+// Built on the first lookup in a node with at least NAMEINDEX_MINIMUM children.
+// Duplicate names are chained in document order, so a lookup still finds the
+// first child with that name. Children appended after the last lookup are
+// added on the next lookup, so building a node while looking up its names
+// stays linear. The index remembers its first and last indexed child, so an
+// owner can see that children were inserted or removed and rebuild it.
+// Hits must always be verified by the caller. Misses only count if the owner
+// gets to hear about the renaming of all indexed children (see SetTrustMisses).
+//
+class NameIndex
+{
+public:
+  explicit NameIndex(size_t p_count);
+
+  // Add the name of the next child
+  void    Add(const XString& p_name);
+  // First child with this name, or -1
+  int     First(const XString& p_name) const;
+  // Next child with the same name, or -1
+  int     Next(int p_position) const { return m_next[p_position]; }
+
+  // First and last child that have been indexed
+  void        SetEnds(const void* p_first,const void* p_last) { m_first = p_first; m_last = p_last; }
+  const void* GetFirst() const        { return m_first; }
+  const void* GetLast()  const        { return m_last;  }
+  // Number of children indexed
+  int         GetCount() const        { return (int)m_next.size(); }
+  // A miss can be trusted if no child can be renamed behind our back
+  void        SetTrustMisses(bool p_trust) { m_trustMisses = p_trust; }
+  bool        GetTrustMisses() const  { return m_trustMisses; }
+
+private:
+  static unsigned Hash(const XString& p_name);
+  void    Grow();
+
+  typedef struct _nameSlot
+  {
+    XString m_name;
+    int     m_first { -1 };   // First child with this name
+    int     m_last  { -1 };   // Last child with this name (for chaining)
+  }
+  NameSlot;
+
+  std::vector<NameSlot> m_slots;      // Open addressing, power of 2
+  std::vector<int>      m_next;       // Next child with the same name
+  unsigned              m_mask  { 0 };
+  unsigned              m_names { 0 };        // Slots in use
+  // Indexed children
+  const void*           m_first { nullptr };
+  const void*           m_last  { nullptr };
+  bool                  m_trustMisses { true };
+};
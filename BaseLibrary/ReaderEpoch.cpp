@@ -0,0 +1,76 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ReaderEpoch.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "ReaderEpoch.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Register a reader in the current epoch
+long
+ReaderEpoch::Enter()
+{
+  while(true)
+  {
+    long epoch = m_epoch;
+    InterlockedIncrement(&m_readers[epoch]);
+    if(epoch == m_epoch)
+    {
+      return epoch;
+    }
+    // A writer flipped the epoch in between: try again
+    InterlockedDecrement(&m_readers[epoch]);
+  }
+}
+
+void
+ReaderEpoch::Leave(long p_epoch)
+{
+  InterlockedDecrement(&m_readers[p_epoch]);
+}
+
+// Flip the epoch twice and wait until both epochs are drained.
+// A reader that entered before the first flip is gone after the first drain.
+// A reader that entered the new epoch just before the flip (and saw the old
+// pointer) is gone after the second drain.
+void
+ReaderEpoch::WaitForReaders()
+{
+  for(int flip = 0; flip < 2; ++flip)
+  {
+    long epoch = m_epoch;
+    InterlockedExchange(&m_epoch,1 - epoch);
+    while(m_readers[epoch] > 0)
+    {
+      SwitchToThread();
+    }
+  }
+}
@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ReaderEpoch.h
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//////////////////////////////////////////////////////////////////////////
+//
+// Reader epoch: retiring an immutable snapshot that is read without a lock
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+// Readers register in the current epoch for as long as they use the published
+// pointer. A writer swaps in a new snapshot and then calls WaitForReaders:
+// the epoch is flipped twice and each old epoch is drained. After that no
+// reader can still hold a pointer that was unpublished before the call, so
+// the old snapshot can be deleted.
+//
+// Writers must be serialized by the caller (e.g. under their own lock).
+// A reader must not wait for a writer: that would deadlock.
+class ReaderEpoch
+{
+public:
+  // Register a reader. Returns the epoch to leave
+  long Enter();
+  void Leave(long p_epoch);
+  // Writers: wait until all readers of the previous snapshot are gone
+  void WaitForReaders();
+
+private:
+  volatile long m_epoch      { 0 };         // Current epoch of the readers
+  volatile long m_readers[2] { 0,0 };       // Number of readers per epoch
+};
+
+// Reading in an epoch for the duration of a scope (also when throwing)
+class AutoReaderEpoch
+{
+public:
+  explicit AutoReaderEpoch(ReaderEpoch& p_epoch) : m_epoch(&p_epoch),m_entered(p_epoch.Enter())
+  {
+  }
+  ~AutoReaderEpoch()
+  {
+    m_epoch->Leave(m_entered);
+  }
+private:
+  ReaderEpoch* m_epoch;
+  long         m_entered;
+};
@@ -37,6 +37,7 @@
 #include "ConvertWideString.h"
 #include "XMLParser.h"
 #include "XMLParserJSON.h"
+#include "JSONTranscoder.h"
 #include <utility>
 
 #ifdef _DEBUG
@@ -531,10 +532,10 @@ SOAPMessage::DelHeader(XString p_name)
 void
 SOAPMessage::DelHeader(HTTP_HEADER_ID p_id)
 {
-  if(p_id >= 0 && p_id < HttpHeaderMaximum)
+  HeaderMap::iterator it = m_headers.FindRequestHeader(p_id);
+  if(it != m_headers.end())
   {
-    XString name(header_fields[p_id]);
-    DelHeader(name);
+    m_headers.erase(it);
   }
 }
 
@@ -554,6 +555,45 @@ SOAPMessage::GetHeader(XString p_name)
 // OPERATORS
 SOAPMessage* 
 SOAPMessage::operator=(JSONMessage& p_json)
+{
+  ReuseFromJSON(p_json);
+
+  // The message itself
+  XMLParserJSON(this,&p_json);
+  CheckAfterParsing();
+
+  return this;
+}
+
+// Transcode a JSON text without building the JSON tree first.
+// Falls back to the tree parser for anything the transcoder does not stream
+void
+SOAPMessage::TranscodeJSON(JSONMessage& p_json,XString& p_text)
+{
+  ReuseFromJSON(p_json);
+
+  XString action = m_soapAction;
+  XString object = GetParameterObject();
+
+  JSONTranscoder transcoder;
+  if(!transcoder.ParseJsonToSoap(p_text,this))
+  {
+    // Start all over with the JSON tree
+    m_soapAction = action;
+    SetParameterObject(object);
+    if(m_paramObject)
+    {
+      CleanNode(m_paramObject);
+      m_paramObject->SetValue(_T(""));
+    }
+    p_json.ParseMessage(p_text);
+    XMLParserJSON(this,&p_json);
+  }
+  CheckAfterParsing();
+}
+
+void
+SOAPMessage::ReuseFromJSON(JSONMessage& p_json)
 {
   m_request       = p_json.GetRequestHandle();
   m_site          = p_json.GetHTTPSite();
@@ -587,12 +627,6 @@ SOAPMessage::operator=(JSONMessage& p_json)
 
   CreateHeaderAndBody();
   CreateParametersObject();
-
-  // The message itself
-  XMLParserJSON(this,&p_json);
-  CheckAfterParsing();
-
-  return this;
 }
 
 #pragma endregion ReUse
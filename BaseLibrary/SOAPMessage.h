@@ -358,6 +358,8 @@ public:
 
   // OPERATORS
   SOAPMessage* operator=(JSONMessage& p_json);
+  // Reuse for a JSON answer: transcode the text directly, the JSON message holds the HTTP parts
+  void            TranscodeJSON(JSONMessage& p_json,XString& p_text);
 
   // Complete the message (members to XML)
   void            CompleteTheMessage();
@@ -378,6 +380,8 @@ protected:
   void            CreateHeaderAndBody();
   // Create the parameters object
   void            CreateParametersObject(ResponseType p_responseType = ResponseType::RESP_ACTION_NAME);
+  // Take over the HTTP parts of a JSON message and create an empty body
+  void            ReuseFromJSON(JSONMessage& p_json);
   // Find Header and Body after a parsed message is coming in
   void            FindHeaderAndBody();
   // TO do after we set parts of the URL in setters
@@ -41,7 +41,8 @@ public:
   XString m_value;
 };
 
-using QOptionMap = std::map<int,QualityOption>;
+// Options by quality. Options of the same quality are all kept.
+using QOptionMap = std::multimap<int,QualityOption>;
 
 //////////////////////////////////////////////////////////////////////////
 //
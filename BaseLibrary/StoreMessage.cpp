@@ -38,6 +38,8 @@ static char THIS_FILE[] = __FILE__;
 
 StoreMessage::StoreMessage()
 {
+  // Records use UTF-8 encoding for strings
+  m_file.SetEncoding(Encoding::UTF8);
 }
 
 StoreMessage::StoreMessage(XString p_filename)
@@ -194,6 +196,131 @@ StoreMessage::ReadResponseMessage()
   return msg;
 }
 
+// Serialize an incoming message to a record in memory
+bool
+StoreMessage::StoreIncomingMessage(HTTPMessage* p_message,std::string& p_record)
+{
+  bool result = false;
+  p_record.clear();
+  m_record = &p_record;
+
+  try
+  {
+    WriteVersion();
+    WriteResponseOffset(0);
+    StoreMessagePart(p_message);
+    // Now we know the length and rewrite the offset
+    ReWriteOffset();
+
+    result = true;
+  }
+  catch(StdException& e)
+  {
+    if(m_error == 0)
+    {
+      m_error = e.GetApplicationCode();
+    }
+  }
+  m_record = nullptr;
+  return result;
+}
+
+// Append the response to a record with an incoming message
+bool
+StoreMessage::StoreResponseMessage(HTTPMessage* p_message,std::string& p_record)
+{
+  bool   result = false;
+  size_t offset = 0;
+  m_reading  = reinterpret_cast<const BYTE*>(p_record.c_str());
+  m_length   = p_record.size();
+  m_position = 0;
+
+  try
+  {
+    ReadVersion();
+    SkipToResponse(false);
+    // Response is appended after the incoming message
+    offset = m_position;
+    p_record.resize(offset);
+    m_reading = nullptr;
+    m_record  = &p_record;
+    StoreMessagePart(p_message);
+
+    result = true;
+  }
+  catch(StdException& e)
+  {
+    if(m_error == 0)
+    {
+      m_error = e.GetApplicationCode();
+    }
+    // Do not leave half a response in the record
+    if(offset)
+    {
+      p_record.resize(offset);
+    }
+  }
+  m_record  = nullptr;
+  m_reading = nullptr;
+  return result;
+}
+
+// Read the incoming message from a record in memory
+HTTPMessage*
+StoreMessage::ReadIncomingMessage(const BYTE* p_record,size_t p_length)
+{
+  m_reading  = p_record;
+  m_length   = p_length;
+  m_position = 0;
+  HTTPMessage* msg = new HTTPMessage();
+
+  try
+  {
+    ReadVersion();
+    ReadResponseOffset();
+    ReadMessagePart(msg);
+  }
+  catch(StdException& e)
+  {
+    if(m_error == 0)
+    {
+      m_error = e.GetApplicationCode();
+    }
+    delete msg;
+    msg = nullptr;
+  }
+  m_reading = nullptr;
+  return msg;
+}
+
+// Read the response message from a record in memory
+HTTPMessage*
+StoreMessage::ReadResponseMessage(const BYTE* p_record,size_t p_length)
+{
+  m_reading  = p_record;
+  m_length   = p_length;
+  m_position = 0;
+  HTTPMessage* msg = new HTTPMessage();
+
+  try
+  {
+    ReadVersion();
+    SkipToResponse(true);
+    ReadMessagePart(msg);
+  }
+  catch(StdException& e)
+  {
+    if(m_error == 0)
+    {
+      m_error = e.GetApplicationCode();
+    }
+    delete msg;
+    msg = nullptr;
+  }
+  m_reading = nullptr;
+  return msg;
+}
+
 XString 
 StoreMessage::GetErrorMessage()
 {
@@ -211,6 +338,7 @@ StoreMessage::GetErrorMessage()
       case ERROR_FT_RESPONSE:       error = _T("Cannot skip to HTTPMessage response");            break;
       case ERROR_FT_NOFILE:         error = _T("Cannot skip to EOF of HTTPMessage");              break;
       case ERROR_FT_NORESPONSE:     error = _T("HTTPMessage file has no response part");          break;
+      case ERROR_FT_RECORD:         error = _T("Reading past the end of a HTTPMessage record");   break;
     }
   }
   else
@@ -235,11 +363,54 @@ StoreMessage::CloseFile()
   }
 }
 
+// Write to the file, or append to the record in memory
+void
+StoreMessage::WriteBytes(void* p_buffer,size_t p_length)
+{
+  if(m_record)
+  {
+    m_record->append(reinterpret_cast<const char*>(p_buffer),p_length);
+    return;
+  }
+  if(!m_file.Write(p_buffer,p_length))
+  {
+    throw StdException(GetLastError());
+  }
+}
+
+// Read from the file, or from the record in memory
+void
+StoreMessage::ReadBytes(void* p_buffer,size_t p_length)
+{
+  if(m_reading)
+  {
+    if(m_position + p_length > m_length)
+    {
+      throw StdException(ERROR_FT_RECORD);
+    }
+    memcpy(p_buffer,m_reading + m_position,p_length);
+    m_position += p_length;
+    return;
+  }
+  int read = 0;
+  if(!m_file.Read(p_buffer,p_length,read))
+  {
+    throw StdException(GetLastError());
+  }
+}
+
 // Go back to after the version number and re-write the offset 
 // where the response message will be written
 void
 StoreMessage::ReWriteOffset()
 {
+  if(m_record)
+  {
+    // Record: overwrite the number after the field header
+    DWORD offset = (DWORD) m_record->size();
+    m_record->replace(STORE_HTTP_RESPONSE_OFFSET + 1,sizeof(DWORD),reinterpret_cast<const char*>(&offset),sizeof(DWORD));
+    return;
+  }
   size_t position = m_file.Position();
 
   if(m_file.Position(FSeek::file_begin,STORE_HTTP_RESPONSE_OFFSET) != STORE_HTTP_RESPONSE_OFFSET)
@@ -257,6 +428,17 @@ StoreMessage::SkipToResponse(bool p_checkPresence)
   // Reread the offset first
   size_t offset = ReadResponseOffset();
 
+  // Record in memory
+  if(m_reading)
+  {
+    if(offset > m_length || (p_checkPresence && offset == m_length))
+    {
+      throw StdException(p_checkPresence ? ERROR_FT_NORESPONSE : ERROR_FT_RESPONSE);
+    }
+    m_position = offset;
+    return;
+  }
+
   // See if we are *NOT* at the EOF
   if(p_checkPresence)
   {
@@ -342,47 +524,32 @@ void
 StoreMessage::WriteHeader(MSGFieldType p_type)
 {
   uchar buffer = (uchar)p_type;
-  if(!m_file.Write(&buffer,1))
-  {
-    throw StdException(GetLastError());
-  }
+  WriteBytes(&buffer,1);
 }
 
 void
 StoreMessage::WriteNumber8(unsigned char p_number)
 {
-  if(!m_file.Write(&p_number,1))
-  {
-    throw StdException(GetLastError());
-  }
+  WriteBytes(&p_number,1);
 }
 
 void
 StoreMessage::WriteNumber16(unsigned int p_number)
 {
   ushort buffer = (ushort)p_number;
-  if(!m_file.Write(&buffer,2))
-  {
-    throw StdException(GetLastError());
-  }
+  WriteBytes(&buffer,2);
 }
 
 void
 StoreMessage::WriteNumber32(unsigned int p_number)
 {
-  if(!m_file.Write(&p_number,4))
-  {
-    throw StdException(GetLastError());
-  }
+  WriteBytes(&p_number,4);
 }
 
 void
 StoreMessage::WriteNumber64(unsigned __int64 p_number)
 {
-  if(!m_file.Write(&p_number,8))
-  {
-    throw StdException(GetLastError());
-  }
+  WriteBytes(&p_number,8);
 }
 
 void
@@ -392,10 +559,7 @@ StoreMessage::WriteString(XString p_string)
   WriteNumber32((unsigned)output.size());
   if(output.size())
   {
-    if(!m_file.Write(const_cast<char*>(output.c_str()),output.size()))
-    {
-      throw StdException(GetLastError());
-    }
+    WriteBytes(const_cast<char*>(output.c_str()),output.size());
   }
 }
 
@@ -553,10 +717,14 @@ StoreMessage::WriteBody(FileBuffer* p_buffer)
     WriteNumber64(length);
     if(length > 0)
     {
-      if(!m_file.Write(buffer,length))
+      try
+      {
+        WriteBytes(buffer,length);
+      }
+      catch(StdException&)
       {
         delete[] buffer;
-        throw StdException(GetLastError());
+        throw;
       }
     }
   }
@@ -583,11 +751,7 @@ MSGFieldType
 StoreMessage::ReadHeader()
 {
   uchar buffer = 0;
-  int read = 0;
-  if(!m_file.Read(&buffer,1,read))
-  {
-    throw StdException(GetLastError());
-  }
+  ReadBytes(&buffer,1);
   return (MSGFieldType)buffer;
 }
 
@@ -595,11 +759,7 @@ unsigned char
 StoreMessage::ReadNumber8()
 {
   uchar buffer = 0;
-  int read = 0;
-  if(!m_file.Read(&buffer,1,read))
-  {
-    throw StdException(GetLastError());
-  }
+  ReadBytes(&buffer,1);
   return buffer;
 }
 
@@ -607,11 +767,7 @@ unsigned int
 StoreMessage::ReadNumber16()
 {
   ushort buffer = 0;
-  int read = 0;
-  if(!m_file.Read(&buffer,2,read))
-  {
-    throw StdException(GetLastError());
-  }
+  ReadBytes(&buffer,2);
   return (int) buffer;
 }
 
@@ -619,11 +775,7 @@ unsigned int
 StoreMessage::ReadNumber32()
 {
   unsigned int buffer = 0;
-  int read = 0;
-  if(!m_file.Read(&buffer,4,read))
-  {
-    throw StdException(GetLastError());
-  }
+  ReadBytes(&buffer,4);
   return buffer;
 }
 
@@ -631,11 +783,7 @@ unsigned __int64
 StoreMessage::ReadNumber64()
 {
   unsigned __int64 buffer = 0;
-  int read = 0;
-  if(!m_file.Read(&buffer,8,read))
-  {
-    throw StdException(GetLastError());
-  }
+  ReadBytes(&buffer,8);
   return buffer;
 }
 
@@ -646,14 +794,10 @@ StoreMessage::ReadString()
   int length = ReadNumber32();
   if(length)
   {
-    int read = 0;
     std::string input;
     input.append(length,' ');
 
-    if(!m_file.Read(const_cast<char*>(input.c_str()),length,read))
-    {
-      throw StdException(GetLastError());
-    }
+    ReadBytes(const_cast<char*>(input.c_str()),length);
     string = m_file.TranslateInputBuffer(input);
   }
   return string;
@@ -816,7 +960,17 @@ void
 StoreMessage::ReadBody(HTTPMessage* p_msg)
 {
   size_t length = (size_t) ReadNumber64();
-  if(length)
+  if(length && m_reading)
+  {
+    // Straight from the record, without an extra copy
+    if(m_position + length > m_length)
+    {
+      throw StdException(ERROR_FT_BODY);
+    }
+    p_msg->SetBody(const_cast<BYTE*>(m_reading + m_position),(unsigned)length);
+    m_position += length;
+  }
+  else if(length)
   {
     int read = 0;
     unsigned char* buffer = new unsigned char[length];
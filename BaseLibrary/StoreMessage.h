@@ -28,6 +28,7 @@
 #pragma once
 #include "HTTPMessage.h"
 #include "WinFile.h"
+#include <string>
 
 #define HTTP_FILE_VERSION 0x0101  // Effectively version 1.1
 
@@ -66,7 +67,8 @@ enum class MSGFieldType
 #define ERROR_FT_RESPONSE        -7    // Cannot skip to response
 #define ERROR_FT_NOFILE          -8    // Cannot skip to EOF
 #define ERROR_FT_NORESPONSE      -9    // No response part in this file
-#define ERROR_FT_LAST           -10
+#define ERROR_FT_RECORD         -10    // Reading past the end of a record in memory
+#define ERROR_FT_LAST           -11
 
 // The response offset is just after the version number (3 bytes long)
 #define STORE_HTTP_RESPONSE_OFFSET 3
@@ -84,6 +86,14 @@ public:
   virtual HTTPMessage* ReadIncomingMessage();
   virtual HTTPMessage* ReadResponseMessage();
 
+  // IN MEMORY RECORDS
+  // A record has exactly the same layout as a storage file
+  // so a record can be written to a file as-is, and vice versa.
+  bool         StoreIncomingMessage(HTTPMessage* p_message,std::string& p_record);
+  bool         StoreResponseMessage(HTTPMessage* p_message,std::string& p_record);
+  HTTPMessage* ReadIncomingMessage(const BYTE* p_record,size_t p_length);
+  HTTPMessage* ReadResponseMessage(const BYTE* p_record,size_t p_length);
+
   // SETTERS
   void    SetFilename(XString p_filename);
   // GETTERS
@@ -94,6 +104,8 @@ public:
 private:
   // File methods
   void    CloseFile();
+  void    WriteBytes(void* p_buffer,size_t p_length);
+  void    ReadBytes (void* p_buffer,size_t p_length);
   void    ReWriteOffset();
   void    SkipToResponse(bool p_checkPresence);
   void    StoreMessagePart(HTTPMessage* p_message);
@@ -158,4 +170,9 @@ private:
   XString m_filename;
   WinFile m_file;
   errno_t m_error { 0 };
+  // In memory records
+  std::string* m_record   { nullptr };  // Writing to this record instead of the file
+  const BYTE*  m_reading  { nullptr };  // Reading from this record instead of the file
+  size_t       m_length   { 0 };        // Length of the record we are reading
+  size_t       m_position { 0 };        // Reading position in the record
 };
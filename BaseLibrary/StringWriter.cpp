@@ -0,0 +1,410 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: StringWriter.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "StringWriter.h"
+#include "FileBuffer.h"
+#include "ConvertWideString.h"
+#include "XMLParser.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Precomputed indentation
+static const TCHAR g_tabs[]   = _T("\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t");
+static const TCHAR g_spaces[] = _T("                                                                ");
+
+// Writing into one growable buffer
+StringWriter::StringWriter(size_t p_reserve /*= WRITER_RESERVE*/)
+{
+  m_size   = p_reserve > 16 ? p_reserve : 16;
+  m_buffer = new TCHAR[m_size];
+}
+
+// Writing in parts into a FileBuffer
+StringWriter::StringWriter(FileBuffer* p_buffer,XString p_charset,bool p_bom /*=false*/,size_t p_chunk /*= WRITER_CHUNK_SIZE*/)
+             :m_target(p_buffer)
+             ,m_chunk(p_chunk > 16 ? p_chunk : 16)
+{
+  m_codepage = CharsetToCodepage(p_charset);
+  if(m_codepage <= 0)
+  {
+    m_codepage = GetACP();
+  }
+  // Room for a full part and some characters not yet converted
+  m_size   = m_chunk + 16;
+  m_buffer = new TCHAR[m_size];
+
+  if(p_bom && m_target)
+  {
+    if(m_codepage == CP_UTF8)
+    {
+      uchar bom[3] = { 0xEF, 0xBB, 0xBF };
+      m_target->AddBuffer(bom,3);
+    }
+    else if(m_codepage == 1200)
+    {
+      uchar bom[2] = { 0xFF, 0xFE };
+      m_target->AddBuffer(bom,2);
+    }
+  }
+}
+
+StringWriter::~StringWriter()
+{
+  delete [] m_buffer;
+}
+
+void
+StringWriter::Write(LPCTSTR p_text)
+{
+  if(p_text)
+  {
+    Write(p_text,_tcslen(p_text));
+  }
+}
+
+void
+StringWriter::Write(const XString& p_text)
+{
+  Write(p_text.GetString(),(size_t)p_text.GetLength());
+}
+
+void
+StringWriter::Write(LPCTSTR p_text,size_t p_length)
+{
+  while(p_length)
+  {
+    if(m_length + p_length > m_size)
+    {
+      Reserve(p_length);
+    }
+    // In FileBuffer mode we may only copy what is left of the part
+    size_t length = p_length;
+    if(m_length + length > m_size)
+    {
+      length = m_size - m_length;
+    }
+    memcpy(m_buffer + m_length,p_text,length * sizeof(TCHAR));
+    m_length += length;
+    m_total  += length;
+    p_text   += length;
+    p_length -= length;
+  }
+}
+
+void
+StringWriter::WriteIndent(TCHAR p_char,int p_count)
+{
+  const TCHAR* indent = (p_char == '\t') ? g_tabs : g_spaces;
+  size_t block = (p_char == '\t') ? (sizeof(g_tabs) / sizeof(TCHAR)) - 1 : (sizeof(g_spaces) / sizeof(TCHAR)) - 1;
+
+  while(p_count > 0)
+  {
+    size_t length = (size_t)p_count < block ? (size_t)p_count : block;
+    Write(indent,length);
+    p_count -= (int)length;
+  }
+}
+
+void
+StringWriter::WriteInteger(__int64 p_number)
+{
+  TCHAR  digits[24];
+  TCHAR* pointer = &digits[24];
+  unsigned __int64 number = p_number < 0 ? (unsigned __int64)(-(p_number + 1)) + 1 : (unsigned __int64)p_number;
+
+  do
+  {
+    *--pointer = (TCHAR)('0' + (number % 10));
+    number /= 10;
+  }
+  while(number);
+
+  if(p_number < 0)
+  {
+    *--pointer = '-';
+  }
+  Write(pointer,&digits[24] - pointer);
+}
+
+// Integral numbers are written directly, all others as in bcd::AsString
+void
+StringWriter::WriteBcd(const bcd& p_number)
+{
+  if(p_number.IsValid() && p_number.GetFitsInInt64() && !p_number.GetHasDecimals())
+  {
+    WriteInteger(p_number.AsInt64());
+  }
+  else
+  {
+    Write(p_number.AsString(bcd::Format::Bookkeeping,false,0));
+  }
+}
+
+// Runs of characters without escapes are copied in one go
+void
+StringWriter::WriteJsonString(const XString& p_string,Encoding p_encoding /*= Encoding::Default*/)
+{
+  // Encoded strings take the long way
+  if(p_encoding != Encoding::Default)
+  {
+    Write(XMLParser::PrintJsonString(p_string,p_encoding));
+    return;
+  }
+  LPCTSTR begin   = p_string.GetString();
+  LPCTSTR end     = begin + p_string.GetLength();
+  LPCTSTR run     = begin;
+  LPCTSTR pointer = begin;
+
+  Write('\"');
+  for(; pointer < end; ++pointer)
+  {
+    TCHAR escape = 0;
+    switch(*pointer)
+    {
+      case '\"': escape = '\"'; break;
+      case '\\': escape = '\\'; break;
+      case '\b': escape = 'b';  break;
+      case '\f': escape = 'f';  break;
+      case '\n': escape = 'n';  break;
+      case '\r': escape = 'r';  break;
+      case '\t': escape = 't';  break;
+      default:   continue;
+    }
+    Write(run,pointer - run);
+    Write('\\');
+    Write(escape);
+    run = pointer + 1;
+  }
+  Write(run,pointer - run);
+  Write('\"');
+}
+
+// Runs of characters without entities are copied in one go
+void
+StringWriter::WriteXmlString(const XString& p_string,bool p_utf8 /*= false*/)
+{
+  XString uncoded;
+  if(p_utf8)
+  {
+    // Now encode MBCS to UTF-8 without a BOM
+    uncoded = EncodeStringForTheWire(p_string,_T("utf-8"));
+  }
+  const _TUCHAR* begin   = (const _TUCHAR*)(p_utf8 ? uncoded.GetString() : p_string.GetString());
+  const _TUCHAR* run     = begin;
+  const _TUCHAR* pointer = begin;
+
+  // Stops at the first closing zero, just like XMLParser::PrintXmlString
+  for(; *pointer; ++pointer)
+  {
+    LPCTSTR entity = nullptr;
+    switch(*pointer)
+    {
+      case '&': entity = _T("&amp;");  break;
+      case '<': entity = _T("&lt;");   break;
+      case '>': entity = _T("&gt;");   break;
+      case '\'':entity = _T("&apos;"); break;
+      case '\"':entity = _T("&quot;"); break;
+      case ' ' :[[fallthrough]];
+      case '\t':[[fallthrough]];
+      case '\r':[[fallthrough]];
+      case '\n':continue;
+      default:  if(*pointer >= ' ')
+                {
+                  continue;
+                }
+                break;
+    }
+    Write((LPCTSTR)run,pointer - run);
+    if(entity)
+    {
+      Write(entity);
+    }
+    else
+    {
+      // All control chars under 0x20 are restricted chars in the XML-standard
+      Write(_T("&#"));
+      Write((TCHAR)('0' + (*pointer / 10)));
+      Write((TCHAR)('0' + (*pointer % 10)));
+      Write(';');
+    }
+    run = pointer + 1;
+  }
+  Write((LPCTSTR)run,pointer - run);
+}
+
+// Write the last part into the FileBuffer
+void
+StringWriter::Flush()
+{
+  if(m_target)
+  {
+    WritePart(true);
+  }
+}
+
+XString
+StringWriter::GetString() const
+{
+  XString result;
+  if(m_target == nullptr && m_length)
+  {
+    result.Append(m_buffer,(int)m_length);
+  }
+  return result;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Make room for extra characters.
+// In buffer mode the buffer doubles. In FileBuffer mode a full part is written out.
+void
+StringWriter::Reserve(size_t p_extra)
+{
+  if(m_target)
+  {
+    if(m_length >= m_chunk)
+    {
+      WritePart(false);
+    }
+    return;
+  }
+  size_t size = m_size * 2;
+  while(size < m_length + p_extra)
+  {
+    size *= 2;
+  }
+  TCHAR* buffer = new TCHAR[size];
+  memcpy(buffer,m_buffer,m_length * sizeof(TCHAR));
+  delete [] m_buffer;
+  m_buffer = buffer;
+  m_size   = size;
+}
+
+// Convert the buffer to the codepage and add it as a part to the FileBuffer
+// A part never ends halfway a character (surrogate pair or DBCS lead byte)
+void
+StringWriter::WritePart(bool p_final)
+{
+  size_t length = m_length;
+  if(!p_final && length)
+  {
+#ifdef UNICODE
+    if(IS_HIGH_SURROGATE(m_buffer[length - 1]))
+    {
+      --length;
+    }
+#else
+    size_t pos = 0;
+    while(pos < length)
+    {
+      pos += IsDBCSLeadByte((BYTE)m_buffer[pos]) ? 2 : 1;
+    }
+    if(pos > length)
+    {
+      --length;
+    }
+#endif
+  }
+  if(length == 0)
+  {
+    return;
+  }
+
+#ifdef UNICODE
+  if(m_codepage == 1200)
+  {
+    m_target->AddBuffer((uchar*)m_buffer,length * sizeof(TCHAR));
+  }
+  else
+  {
+    int bytes = ::WideCharToMultiByte(m_codepage,0,m_buffer,(int)length,nullptr,0,nullptr,nullptr);
+    if(bytes > 0)
+    {
+      // Converted buffer is handed over to the target: no extra copy
+      uchar* buffer = new uchar[bytes + 2];
+      ::WideCharToMultiByte(m_codepage,0,m_buffer,(int)length,(LPSTR)buffer,bytes,nullptr,nullptr);
+      buffer[bytes] = buffer[bytes + 1] = 0;
+      m_target->AddBufferOwned(buffer,bytes);
+    }
+    else
+    {
+      m_error = true;
+    }
+  }
+#else
+  if(m_codepage == (int)GetACP())
+  {
+    m_target->AddBuffer((uchar*)m_buffer,length);
+  }
+  else
+  {
+    int chars = ::MultiByteToWideChar(CP_ACP,0,m_buffer,(int)length,nullptr,0);
+    wchar_t* wide = new wchar_t[chars > 0 ? chars : 1];
+    ::MultiByteToWideChar(CP_ACP,0,m_buffer,(int)length,wide,chars);
+    if(chars <= 0)
+    {
+      m_error = true;
+    }
+    else if(m_codepage == 1200)
+    {
+      m_target->AddBuffer((uchar*)wide,chars * sizeof(wchar_t));
+    }
+    else
+    {
+      int bytes = ::WideCharToMultiByte(m_codepage,0,wide,chars,nullptr,0,nullptr,nullptr);
+      if(bytes > 0)
+      {
+        uchar* buffer = new uchar[bytes + 2];
+        ::WideCharToMultiByte(m_codepage,0,wide,chars,(LPSTR)buffer,bytes,nullptr,nullptr);
+        buffer[bytes] = buffer[bytes + 1] = 0;
+        m_target->AddBufferOwned(buffer,bytes);
+      }
+      else
+      {
+        m_error = true;
+      }
+    }
+    delete [] wide;
+  }
+#endif
+
+  // Keep the remainder (an incomplete character) for the next part
+  m_length -= length;
+  if(m_length)
+  {
+    memmove(m_buffer,m_buffer + length,m_length * sizeof(TCHAR));
+  }
+}
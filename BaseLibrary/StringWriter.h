@@ -0,0 +1,102 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: StringWriter.h
+//
+// BaseLibrary: Indispensable general objects and functions
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "Encoding.h"
+
+class FileBuffer;
+class bcd;
+
+// Initial size of the buffer of a string writer (in characters)
+#define WRITER_RESERVE      (4 * 1024)
+// Size of the parts that are written into a FileBuffer (in characters)
+#define WRITER_CHUNK_SIZE   (64 * 1024)
+
+// Serializing text (XML, JSON) into one growable buffer.
+// All writing is appending: no intermediate strings are created.
+// Optionally the text is written in fixed size parts into a FileBuffer,
+// converted to the codepage of the charset of the message.
+//
+class StringWriter
+{
+public:
+  // Writing into one growable buffer
+  explicit StringWriter(size_t p_reserve = WRITER_RESERVE);
+  // Writing in parts into a FileBuffer in the charset, optionally starting with a BOM
+  StringWriter(FileBuffer* p_buffer,XString p_charset,bool p_bom = false,size_t p_chunk = WRITER_CHUNK_SIZE);
+ ~StringWriter();
+
+  // Appending text
+  void    Write(TCHAR p_char);
+  void    Write(LPCTSTR p_text);
+  void    Write(LPCTSTR p_text,size_t p_length);
+  void    Write(const XString& p_text);
+  // Appending a number of tabs or spaces for indentation
+  void    WriteIndent(TCHAR p_char,int p_count);
+  // Appending numbers
+  void    WriteInteger(__int64 p_number);
+  void    WriteBcd(const bcd& p_number);
+  // Appending a JSON string in double quotes with the escapes (as XMLParser::PrintJsonString)
+  void    WriteJsonString(const XString& p_string,Encoding p_encoding = Encoding::Default);
+  // Appending a XML text with the entities (as XMLParser::PrintXmlString)
+  void    WriteXmlString(const XString& p_string,bool p_utf8 = false);
+  // Write the last part into the FileBuffer
+  void    Flush();
+
+  // GETTERS
+  // Text written so far (buffer mode only)
+  XString GetString() const;
+  // Number of characters written so far
+  size_t  GetLength() const  { return m_total; };
+  // Conversion to the charset failed
+  bool    GetError() const   { return m_error; };
+
+private:
+  void    Reserve(size_t p_extra);
+  void    WritePart(bool p_final);
+
+  TCHAR*      m_buffer   { nullptr };
+  size_t      m_length   { 0 };         // Characters in the buffer
+  size_t      m_size     { 0 };         // Size of the buffer
+  size_t      m_total    { 0 };         // Total characters written
+  // Writing into a FileBuffer
+  FileBuffer* m_target   { nullptr };
+  size_t      m_chunk    { 0 };
+  int         m_codepage { 0 };
+  bool        m_error    { false };
+};
+
+inline void
+StringWriter::Write(TCHAR p_char)
+{
+  if(m_length == m_size)
+  {
+    Reserve(1);
+  }
+  m_buffer[m_length++] = p_char;
+  ++m_total;
+}
@@ -0,0 +1,614 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: URLView.cpp
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "pch.h"
+#include "URLView.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+URLView::URLView()
+{
+}
+
+URLView::URLView(const XString& p_url)
+{
+  Parse(p_url);
+}
+
+void
+URLView::Reset()
+{
+  m_url.Empty();
+  m_valid      = false;
+  m_secure     = false;
+  m_port       = INTERNET_DEFAULT_HTTP_PORT;
+  m_scheme     = URLSpan();
+  m_host       = URLSpan();
+  m_path       = URLSpan();
+  m_query      = URLSpan();
+  m_anchor     = URLSpan();
+  m_hasQuery   = false;
+  m_hasAnchor  = false;
+  m_parameters = 0;
+  m_decoded    = 0;
+  m_lastFound  = -1;
+  m_changed    = 0;
+  m_overflow.clear();
+  m_newParameters.clear();
+}
+
+// Parse an URL: only record the positions of the parts
+// foo://example.com:8042/over/there/index.dtb?type=animal&name=white%20narwhal#nose
+bool
+URLView::Parse(const XString& p_url)
+{
+  Reset();
+  m_url = p_url;
+
+  LPCTSTR url    = m_url.GetString();
+  int     length = m_url.GetLength();
+
+  // Find the scheme
+  int pos = m_url.Find(':');
+  if(pos <= 0)
+  {
+    return false;
+  }
+  m_scheme.m_length = pos;
+  if(pos == 5 && _tcsnicmp(url,_T("https"),5) == 0)
+  {
+    m_secure = true;
+    m_port   = INTERNET_DEFAULT_HTTPS_PORT;
+  }
+  // Check for '//'
+  if(pos + 2 >= length || url[pos + 1] != '/' || url[pos + 2] != '/')
+  {
+    return false;
+  }
+  pos += 3;
+
+  // Server ends at the path, the query or the anchor
+  int server = pos;
+  while(pos < length && url[pos] != '/' && url[pos] != '?' && url[pos] != '#')
+  {
+    ++pos;
+  }
+  int serverEnd = pos;
+
+  // Find the port.
+  // BEWARE OF IPv6 TEREDO ADDRESSES!!
+  // So skip over '[ad:::::a:b:c]' part
+  int colon = server;
+  if(url[server] == '[')
+  {
+    while(colon < serverEnd && url[colon] != ']')
+    {
+      ++colon;
+    }
+  }
+  while(colon < serverEnd && url[colon] != ':')
+  {
+    ++colon;
+  }
+  m_host.m_offset = server;
+  m_host.m_length = colon - server;
+  if(colon < serverEnd)
+  {
+    m_port = _ttoi(&url[colon + 1]);
+  }
+  // Check that there IS a server host
+  if(m_host.m_length == 0)
+  {
+    return false;
+  }
+
+  // Absolute path up to the query or the anchor
+  m_path.m_offset = pos;
+  while(pos < length && url[pos] != '?' && url[pos] != '#')
+  {
+    ++pos;
+  }
+  m_path.m_length = pos - m_path.m_offset;
+
+  // Query parameters
+  if(pos < length && url[pos] == '?')
+  {
+    m_hasQuery = true;
+    m_query.m_offset = ++pos;
+    while(pos < length && url[pos] != '#')
+    {
+      ++pos;
+    }
+    m_query.m_length = pos - m_query.m_offset;
+
+    int begin = m_query.m_offset;
+    for(int end = begin; end <= pos; ++end)
+    {
+      if(end == pos || url[end] == '&')
+      {
+        AddParameter(begin,end);
+        begin = end + 1;
+      }
+    }
+  }
+
+  // Anchor
+  if(pos < length && url[pos] == '#')
+  {
+    m_hasAnchor = true;
+    m_anchor.m_offset = pos + 1;
+    m_anchor.m_length = length - pos - 1;
+  }
+  return (m_valid = true);
+}
+
+// Rebuild the URL, but only if parts where set
+XString
+URLView::URL()
+{
+  if(m_changed && m_valid)
+  {
+    XString url(GetScheme());
+    url += _T("://");
+    url += (m_changed & URL_Host) ? m_newHost : Part(m_host);
+
+    // Possibly add a port
+    if((m_secure == false && m_port != INTERNET_DEFAULT_HTTP_PORT) ||
+       (m_secure == true  && m_port != INTERNET_DEFAULT_HTTPS_PORT))
+    {
+      url.AppendFormat(_T(":%d"),m_port);
+    }
+    BuildAbsolutePath(url);
+    Parse(url);
+  }
+  return m_url;
+}
+
+// Absolute path, including parameters & anchor
+XString
+URLView::AbsolutePath()
+{
+  if(m_changed & (URL_Path | URL_Parameters))
+  {
+    XString path;
+    BuildAbsolutePath(path);
+    return path;
+  }
+  return m_url.Mid(m_path.m_offset);
+}
+
+// Raw absolute path can be sent as-is. False if CrackedURL would
+// change more than the notation: illegal chars or a path to be reduced
+bool
+URLView::PlainPath() const
+{
+  if(!m_valid || m_changed)
+  {
+    return false;
+  }
+  LPCTSTR url    = m_url.GetString();
+  int     length = m_url.GetLength();
+  int     anchor = m_hasAnchor ? m_anchor.m_offset - 1 : length;
+  for(int pos = m_path.m_offset; pos < length; ++pos)
+  {
+    _TUCHAR ch = (_TUCHAR) url[pos];
+    if(ch <= 0x20 || ch > 0x7E || _tcschr(_T("\"<>\\^`{|}"),ch) || (ch == '#' && pos != anchor))
+    {
+      return false;
+    }
+    if(ch == '/' && pos < m_path.m_offset + m_path.m_length - 1 && url[pos + 1] == '/')
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Copy into an eagerly cracked URL
+void
+URLView::ToCrackedURL(CrackedURL& p_cracked) const
+{
+  p_cracked.Reset();
+  if(!m_valid)
+  {
+    return;
+  }
+  p_cracked.m_valid       = true;
+  p_cracked.m_scheme      = GetScheme();
+  p_cracked.m_secure      = m_secure;
+  p_cracked.m_host        = GetHost();
+  p_cracked.m_port        = m_port;
+  p_cracked.m_path        = GetPath();
+  p_cracked.m_extension   = GetExtension();
+  p_cracked.m_anchor      = GetAnchor();
+  p_cracked.m_foundScheme = true;
+  p_cracked.m_foundSecure = m_secure;
+  p_cracked.m_foundPath   = !p_cracked.m_path.IsEmpty();
+  p_cracked.m_foundAnchor = m_hasAnchor;
+
+  for(unsigned index = 0; index < GetParameterCount(); ++index)
+  {
+    UriParam param;
+    param.m_key   = GetParameterKey(index);
+    param.m_value = GetParameterValue(index);
+    p_cracked.m_parameters.push_back(param);
+    p_cracked.m_foundParameters = true;
+  }
+}
+
+// Scheme follows a SetSecure: http <-> https and ws <-> wss
+XString
+URLView::GetScheme() const
+{
+  XString scheme(Part(m_scheme));
+  if(m_changed & URL_Secure)
+  {
+    if(m_secure && (scheme.CompareNoCase(_T("http")) == 0 || scheme.CompareNoCase(_T("ws")) == 0))
+    {
+      scheme += _T("s");
+    }
+    else if(!m_secure && (scheme.CompareNoCase(_T("https")) == 0 || scheme.CompareNoCase(_T("wss")) == 0))
+    {
+      scheme.Truncate(scheme.GetLength() - 1);
+    }
+  }
+  return scheme;
+}
+
+XString
+URLView::GetHost() const
+{
+  return (m_changed & URL_Host) ? m_newHost : Part(m_host);
+}
+
+// Decoded path, with the same corrections as CrackedURL
+XString
+URLView::GetPath() const
+{
+  if(m_changed & URL_Path)
+  {
+    return m_newPath;
+  }
+  XString path = CrackedURL::DecodeURLChars(Part(m_path));
+  if(path.FindOneOf(_T("/\\")) >= 0)
+  {
+    path.Replace(_T("//"),  _T("/"));
+    path.Replace(_T("\\\\"),_T("\\"));
+    path.Replace(_T("\\"),  _T("/"));
+  }
+  return path;
+}
+
+// Extension of the resource, without the '.'
+XString
+URLView::GetExtension() const
+{
+  if(m_changed & URL_Path)
+  {
+    int posp = m_newPath.ReverseFind('.');
+    int poss = m_newPath.ReverseFind('/');
+    return (posp >= 0 && posp > poss) ? m_newPath.Mid(posp + 1) : XString();
+  }
+  LPCTSTR path = GetRaw(m_path);
+  for(int pos = m_path.m_length - 1; pos >= 0; --pos)
+  {
+    if(path[pos] == '.')
+    {
+      URLSpan extension;
+      extension.m_offset = m_path.m_offset + pos + 1;
+      extension.m_length = m_path.m_length - pos - 1;
+      return CrackedURL::DecodeURLChars(Part(extension));
+    }
+    if(path[pos] == '/' || path[pos] == '\\')
+    {
+      break;
+    }
+  }
+  return XString();
+}
+
+XString
+URLView::GetAnchor() const
+{
+  return m_hasAnchor ? CrackedURL::DecodeURLChars(Part(m_anchor)) : XString();
+}
+
+unsigned
+URLView::GetParameterCount() const
+{
+  return (m_changed & URL_Parameters) ? (unsigned)m_newParameters.size() : m_parameters;
+}
+
+XString
+URLView::GetParameterKey(unsigned p_index) const
+{
+  if(m_changed & URL_Parameters)
+  {
+    return p_index < m_newParameters.size() ? m_newParameters[p_index].m_key : XString();
+  }
+  if(p_index >= m_parameters)
+  {
+    return XString();
+  }
+  return CrackedURL::DecodeURLChars(Part(ParamSpan(p_index).m_key));
+}
+
+// Values are decoded only once
+XString
+URLView::GetParameterValue(unsigned p_index) const
+{
+  if(m_changed & URL_Parameters)
+  {
+    return p_index < m_newParameters.size() ? m_newParameters[p_index].m_value : XString();
+  }
+  if(p_index >= m_parameters)
+  {
+    return XString();
+  }
+  if(p_index < URLVIEW_PARAMETERS)
+  {
+    if((m_decoded & (1 << p_index)) == 0)
+    {
+      m_values[p_index] = CrackedURL::DecodeURLChars(Part(ParamSpan(p_index).m_value),true);
+      m_decoded |= (1 << p_index);
+    }
+    return m_values[p_index];
+  }
+  return CrackedURL::DecodeURLChars(Part(ParamSpan(p_index).m_value),true);
+}
+
+XString
+URLView::GetParameter(LPCTSTR p_key) const
+{
+  int index = FindParameter(p_key);
+  return index >= 0 ? GetParameterValue(index) : XString();
+}
+
+bool
+URLView::HasParameter(LPCTSTR p_key) const
+{
+  return FindParameter(p_key) >= 0;
+}
+
+// The default port goes along with the scheme, other ports are kept
+void
+URLView::SetSecure(bool p_secure)
+{
+  if(m_port == (m_secure ? INTERNET_DEFAULT_HTTPS_PORT : INTERNET_DEFAULT_HTTP_PORT))
+  {
+    m_port = p_secure ? INTERNET_DEFAULT_HTTPS_PORT : INTERNET_DEFAULT_HTTP_PORT;
+  }
+  m_secure   = p_secure;
+  m_changed |= URL_Secure;
+}
+
+void
+URLView::SetHost(const XString& p_host)
+{
+  m_newHost  = p_host;
+  m_changed |= URL_Host;
+}
+
+void
+URLView::SetPort(int p_port)
+{
+  m_port     = p_port;
+  m_changed |= URL_Port;
+}
+
+// Set a new (decoded) path. Parameters and anchors are stripped
+void
+URLView::SetPath(XString p_path)
+{
+  int pos = p_path.FindOneOf(_T("#?"));
+  if(pos >= 0)
+  {
+    p_path = p_path.Left(pos);
+  }
+  m_newPath  = p_path;
+  m_changed |= URL_Path;
+}
+
+void
+URLView::SetParameter(const XString& p_key,const XString& p_value)
+{
+  EditParameters();
+  for(auto& param : m_newParameters)
+  {
+    if(param.m_key.CompareNoCase(p_key) == 0)
+    {
+      param.m_value = p_value;
+      return;
+    }
+  }
+  UriParam param;
+  param.m_key   = p_key;
+  param.m_value = p_value;
+  m_newParameters.push_back(param);
+}
+
+bool
+URLView::DelParameter(const XString& p_key)
+{
+  EditParameters();
+  for(UriParams::iterator it = m_newParameters.begin(); it != m_newParameters.end(); ++it)
+  {
+    if(it->m_key.CompareNoCase(p_key) == 0)
+    {
+      m_newParameters.erase(it);
+      return true;
+    }
+  }
+  return false;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+XString
+URLView::Part(const URLSpan& p_span) const
+{
+  return m_url.Mid(p_span.m_offset,p_span.m_length);
+}
+
+// Compare a (raw) key with a decoded key, case insensitive
+bool
+URLView::KeyEquals(const URLSpan& p_span,LPCTSTR p_key) const
+{
+  LPCTSTR raw = GetRaw(p_span);
+  for(int pos = 0; pos < p_span.m_length; ++pos)
+  {
+    if(raw[pos] == '%' || raw[pos] == '+')
+    {
+      // Encoded key: take the long way
+      return CrackedURL::DecodeURLChars(Part(p_span)).CompareNoCase(p_key) == 0;
+    }
+  }
+  return _tcsnicmp(raw,p_key,p_span.m_length) == 0 && p_key[p_span.m_length] == 0;
+}
+
+// Find a parameter. The last one found is tried first
+int
+URLView::FindParameter(LPCTSTR p_key) const
+{
+  if(m_changed & URL_Parameters)
+  {
+    for(unsigned index = 0; index < m_newParameters.size(); ++index)
+    {
+      if(m_newParameters[index].m_key.CompareNoCase(p_key) == 0)
+      {
+        return (int)index;
+      }
+    }
+    return -1;
+  }
+  if(m_lastFound >= 0 && KeyEquals(ParamSpan(m_lastFound).m_key,p_key))
+  {
+    return m_lastFound;
+  }
+  for(unsigned index = 0; index < m_parameters; ++index)
+  {
+    if(KeyEquals(ParamSpan(index).m_key,p_key))
+    {
+      return (m_lastFound = (int)index);
+    }
+  }
+  return -1;
+}
+
+// Record a 'key=value' or 'key' parameter
+void
+URLView::AddParameter(int p_begin,int p_end)
+{
+  URLParamSpan span;
+  span.m_key.m_offset = p_begin;
+  span.m_key.m_length = p_end - p_begin;
+
+  LPCTSTR url = m_url.GetString();
+  for(int pos = p_begin + 1; pos < p_end; ++pos)
+  {
+    if(url[pos] == '=')
+    {
+      span.m_key.m_length   = pos - p_begin;
+      span.m_value.m_offset = pos + 1;
+      span.m_value.m_length = p_end - pos - 1;
+      break;
+    }
+  }
+  if(m_parameters < URLVIEW_PARAMETERS)
+  {
+    m_inline[m_parameters] = span;
+  }
+  else
+  {
+    m_overflow.push_back(span);
+  }
+  ++m_parameters;
+}
+
+const URLParamSpan&
+URLView::ParamSpan(unsigned p_index) const
+{
+  return p_index < URLVIEW_PARAMETERS ? m_inline[p_index] : m_overflow[p_index - URLVIEW_PARAMETERS];
+}
+
+// Parameters are about to change: take them out of the raw URL
+void
+URLView::EditParameters()
+{
+  if((m_changed & URL_Parameters) == 0)
+  {
+    m_newParameters.clear();
+    for(unsigned index = 0; index < m_parameters; ++index)
+    {
+      UriParam param;
+      param.m_key   = GetParameterKey(index);
+      param.m_value = GetParameterValue(index);
+      m_newParameters.push_back(param);
+    }
+    m_changed |= URL_Parameters;
+  }
+}
+
+// Path, parameters and anchor. Unchanged parts are taken as-is from the raw URL
+void
+URLView::BuildAbsolutePath(XString& p_url) const
+{
+  p_url += (m_changed & URL_Path) ? CrackedURL::EncodeURLChars(m_newPath) : Part(m_path);
+
+  if(m_changed & URL_Parameters)
+  {
+    for(unsigned index = 0; index < m_newParameters.size(); ++index)
+    {
+      const UriParam& param = m_newParameters[index];
+      p_url += index ? _T("&") : _T("?");
+      p_url += CrackedURL::EncodeURLChars(param.m_key);
+      if(!param.m_value.IsEmpty())
+      {
+        p_url += _T("=");
+        p_url += CrackedURL::EncodeURLChars(param.m_value,true);
+      }
+    }
+  }
+  else if(m_hasQuery)
+  {
+    p_url += _T("?");
+    p_url += Part(m_query);
+  }
+  if(m_hasAnchor)
+  {
+    p_url += _T("#");
+    p_url += Part(m_anchor);
+  }
+}
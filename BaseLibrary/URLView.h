@@ -0,0 +1,153 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: URLView.h
+//
+// BaseLibrary: Indispensable general objects and functions
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+//////////////////////////////////////////////////////////////////////////
+//
+// Lazy URL: keeps the raw URL and only knows where the parts are
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include "CrackURL.h"
+
+// Number of query parameters kept without any allocation
+#define URLVIEW_PARAMETERS  16
+
+// Position of a part in the raw URL
+typedef struct _url_span
+{
+  int m_offset { 0 };
+  int m_length { 0 };
+}
+URLSpan;
+
+// Position of a query parameter in the raw URL
+typedef struct _url_param_span
+{
+  URLSpan m_key;
+  URLSpan m_value;
+}
+URLParamSpan;
+
+// Parsing a URL into a URLView does not split it into separate strings:
+// only the positions of scheme, host, path, query parameters and anchor are recorded.
+// Parts are decoded when asked for. Decoded parameter values are cached.
+// Setting parts is recorded aside, the URL string is rebuilt only when
+// it is asked for by URL() or AbsolutePath().
+// Decoding and encoding rules are the ones of CrackedURL.
+//
+class URLView
+{
+public:
+  URLView();
+  explicit URLView(const XString& p_url);
+
+  // Parse a new URL. False if not a valid URL
+  bool      Parse(const XString& p_url);
+  void      Reset();
+  bool      Valid() const { return m_valid; };
+
+  // Rebuild the URL (only if parts were set)
+  XString   URL();
+  // Absolute path, including parameters & anchor
+  XString   AbsolutePath();
+  // Raw absolute path can be sent as-is: nothing to encode or to reduce
+  bool      PlainPath() const;
+  // Copy into an eagerly cracked URL
+  void      ToCrackedURL(CrackedURL& p_cracked) const;
+
+  // Raw (still encoded) part of the URL. Valid until the next Parse or URL
+  LPCTSTR   GetRaw(const URLSpan& p_span) const { return m_url.GetString() + p_span.m_offset; };
+
+  // Parts of the URL, decoded on demand
+  XString   GetScheme() const;
+  bool      GetSecure() const     { return m_secure; };
+  XString   GetHost() const;
+  int       GetPort() const       { return m_port;   };
+  XString   GetPath() const;
+  XString   GetExtension() const;
+  XString   GetAnchor() const;
+
+  // Query parameters, decoded on demand
+  unsigned  GetParameterCount() const;
+  XString   GetParameterKey  (unsigned p_index) const;
+  XString   GetParameterValue(unsigned p_index) const;
+  XString   GetParameter(LPCTSTR p_key) const;
+  bool      HasParameter(LPCTSTR p_key) const;
+
+  // Setting parts of the URL
+  void      SetSecure(bool p_secure);
+  void      SetHost(const XString& p_host);
+  void      SetPort(int p_port);
+  void      SetPath(XString p_path);
+  void      SetParameter(const XString& p_key,const XString& p_value);
+  bool      DelParameter(const XString& p_key);
+
+private:
+  // Parts that are set after parsing
+  enum Changed
+  {
+     URL_Secure     = 0x01
+    ,URL_Host       = 0x02
+    ,URL_Port       = 0x04
+    ,URL_Path       = 0x08
+    ,URL_Parameters = 0x10
+  };
+
+  XString         Part(const URLSpan& p_span) const;
+  bool            KeyEquals(const URLSpan& p_span,LPCTSTR p_key) const;
+  int             FindParameter(LPCTSTR p_key) const;
+  void            AddParameter(int p_begin,int p_end);
+  const URLParamSpan& ParamSpan(unsigned p_index) const;
+  void            EditParameters();
+  void            BuildAbsolutePath(XString& p_url) const;
+
+  XString         m_url;                          // The raw URL: the one and only copy
+  bool            m_valid     { false };
+  bool            m_secure    { false };
+  int             m_port      { INTERNET_DEFAULT_HTTP_PORT };
+  URLSpan         m_scheme;
+  URLSpan         m_host;
+  URLSpan         m_path;                         // Begins at the first '/' after the host
+  URLSpan         m_query;                        // Without the '?'
+  URLSpan         m_anchor;                       // Without the '#'
+  bool            m_hasQuery  { false };
+  bool            m_hasAnchor { false };
+  // Query parameters
+  unsigned        m_parameters { 0 };
+  URLParamSpan    m_inline[URLVIEW_PARAMETERS];   // First parameters
+  std::vector<URLParamSpan> m_overflow;           // Parameters after the first ones
+  // Cache of decoded parameter values
+  mutable XString  m_values[URLVIEW_PARAMETERS];
+  mutable unsigned m_decoded   { 0 };             // Bit per decoded value
+  mutable int      m_lastFound { -1 };            // Index of the last parameter found
+  // Parts that are set and not yet in m_url
+  unsigned        m_changed   { 0 };
+  XString         m_newHost;
+  XString         m_newPath;
+  UriParams       m_newParameters;
+};
@@ -27,7 +27,9 @@
 #include "XMLMessage.h"
 #include "XMLParser.h"
 #include "XMLRestriction.h"
+#include "StringWriter.h"
 #include "Namespace.h"
+#include "NameIndex.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -94,6 +96,7 @@ XMLElement::Reset()
     element->DropReference();
   }
   m_elements.clear();
+  DropIndex();
   // No more restrictions
   m_restriction = nullptr;
 }
@@ -155,9 +158,113 @@ XMLElement::SetName(XString p_name)
   {
     throw StdException(InvalidNameMessage(p_name));
   }
+  if(m_parent && m_indexed && m_name.Compare(p_name) != 0)
+  {
+    m_parent->DropIndex();
+  }
   m_name = p_name; 
 }
 
+// Find a direct child by name (and namespace)
+// Large nodes use the name index, so repeated lookups are O(1)
+XMLElement*
+XMLElement::FindChild(const XString& p_name,const XString& p_namespace /*= ""*/)
+{
+  if(m_elements.size() >= NAMEINDEX_MINIMUM)
+  {
+    XMLElement* found = nullptr;
+    bool        scan  = false;
+
+    AcquireSRWLockExclusive(&m_indexLock);
+    NameIndex* index = GetNameIndex();
+    for(int position = index->First(p_name); position >= 0; position = index->Next(position))
+    {
+      XMLElement* element = m_elements[position];
+      if(element->m_name.Compare(p_name) != 0)
+      {
+        // Index is stale after all. Scan as a small node does
+        delete m_index;
+        m_index = nullptr;
+        scan    = true;
+        break;
+      }
+      if(p_namespace.IsEmpty() || element->m_namespace.Compare(p_namespace) == 0)
+      {
+        found = element;
+        break;
+      }
+    }
+    if(!found && !scan && !index->GetTrustMisses())
+    {
+      // Some children can be renamed without telling us
+      scan = true;
+    }
+    ReleaseSRWLockExclusive(&m_indexLock);
+    if(!scan)
+    {
+      return found;
+    }
+  }
+  for(auto& element : m_elements)
+  {
+    if(element->m_name.Compare(p_name) == 0)
+    {
+      if(p_namespace.IsEmpty() || element->m_namespace.Compare(p_namespace) == 0)
+      {
+        return element;
+      }
+    }
+  }
+  return nullptr;
+}
+
+// Children have been changed: forget the name index
+void
+XMLElement::DropIndex()
+{
+  AcquireSRWLockExclusive(&m_indexLock);
+  delete m_index;
+  m_index = nullptr;
+  ReleaseSRWLockExclusive(&m_indexLock);
+}
+
+// Get the name index of the children, with the lock held.
+// Children appended since the last lookup are added to the index.
+// After an insert or removal the index is built again.
+NameIndex*
+XMLElement::GetNameIndex()
+{
+  size_t count = m_elements.size();
+  if(m_index)
+  {
+    int indexed = m_index->GetCount();
+    if(indexed > (int)count ||
+       m_index->GetFirst() != m_elements.front() ||
+       m_index->GetLast()  != m_elements[indexed - 1])
+    {
+      delete m_index;
+      m_index = nullptr;
+    }
+  }
+  if(m_index == nullptr)
+  {
+    m_index = new NameIndex(count);
+  }
+  for(size_t position = m_index->GetCount(); position < count; ++position)
+  {
+    XMLElement* element = m_elements[position];
+    m_index->Add(element->m_name);
+    element->m_indexed = true;
+    // A child of another parent does not tell us when it gets renamed
+    if(element->m_parent != this)
+    {
+      m_index->SetTrustMisses(false);
+    }
+  }
+  m_index->SetEnds(m_elements.front(),m_elements.back());
+  return m_index;
+}
+
 #pragma endregion XMLElement
 
 #pragma region XMLMessage_XTOR
@@ -364,16 +471,16 @@ XMLMessage::ParseForNode(XMLElement* p_node,XString& p_message,WhiteSpace p_whit
 XString
 XMLMessage::Print()
 {
-  XString message = PrintHeader();
-
-  message += PrintStylesheet();
-  message += PrintElements(m_root,false,0);
+  StringWriter writer;
+  writer.Write(PrintHeader());
+  writer.Write(PrintStylesheet());
+  WriteElements(writer,m_root,false,0);
 
   if(m_condensed)
   {
-    message += "\n";
+    writer.Write('\n');
   }
-  return message;
+  return writer.GetString();
 }
 
 XString
@@ -446,20 +553,19 @@ XMLMessage::PrintElements(XMLElement* p_element
                          ,bool        p_utf8  /*=true*/
                          ,int         p_level /*=0*/)
 {
-  XString temp;
-  XString spaces;
-  XString newline;
-  XString message;
+  StringWriter writer;
+  WriteElements(writer,p_element,p_utf8,p_level);
+  return writer.GetString();
+}
 
-  // Find indentation
-  if(m_condensed == false)
-  {
-    newline = _T("\n");
-    for(int ind = 0;ind < p_level; ++ind)
-    {
-      spaces += _T("  ");
-    }
-  }
+// Stream the elements stack into one buffer, without intermediate strings
+void
+XMLMessage::WriteElements(StringWriter& p_writer
+                         ,XMLElement*   p_element
+                         ,bool          p_utf8  /*=true*/
+                         ,int           p_level /*=0*/)
+{
+  int spaces = m_condensed ? 0 : 2 * p_level;
 
   XString namesp = p_element->GetNamespace();
   XString name   = p_element->GetName();
@@ -470,104 +576,132 @@ XMLMessage::PrintElements(XMLElement* p_element
   {
     name = namesp + _T(":") + name;
   }
+  // Name is needed in the opening and the closing tag
+  StringWriter tag(name.GetLength() + 8);
+  tag.WriteXmlString(name,p_utf8);
+  XString element = tag.GetString();
 
   // Print domain value restriction of the element
   if(m_printRestiction && p_element->GetRestriction())
   {
-    temp     = p_element->GetRestriction()->PrintRestriction(name);
-    message += spaces + temp + newline;
+    p_writer.WriteIndent(' ',spaces);
+    p_writer.Write(p_element->GetRestriction()->PrintRestriction(name));
+    if(!m_condensed)
+    {
+      p_writer.Write('\n');
+    }
   }
   if((p_element->GetType() & WSDL_Mask) & ~(WSDL_Mandatory | WSDL_Sequence))
   {
-    message += spaces;
-    message += PrintWSDLComment(p_element);
-    message += newline;
+    p_writer.WriteIndent(' ',spaces);
+    p_writer.Write(PrintWSDLComment(p_element));
+    if(!m_condensed)
+    {
+      p_writer.Write('\n');
+    }
   }
 
   // Print by type
+  p_writer.WriteIndent(' ',spaces);
   if(p_element->GetType() & XDT_CDATA)
   {
     // CDATA section
-    temp.Format(_T("<%s><![CDATA[%s]]>"),XMLParser::PrintXmlString(name,p_utf8).GetString(),value.GetString());
-    message += spaces + temp;
+    p_writer.Write('<');
+    p_writer.Write(element);
+    p_writer.Write(_T("><![CDATA["));
+    p_writer.Write(value);
+    p_writer.Write(_T("]]>"));
   }
   else if(value.IsEmpty() && p_element->GetAttributes().size() == 0 && p_element->GetChildren().size() == 0)
   {
     // A 'real' empty node
-    temp.Format(_T("<%s />%s"),XMLParser::PrintXmlString(name,p_utf8).GetString(),newline.GetString());
-    message += spaces + temp;
-    return message;
+    p_writer.Write('<');
+    p_writer.Write(element);
+    p_writer.Write(_T(" />"));
+    if(!m_condensed)
+    {
+      p_writer.Write('\n');
+    }
+    return;
   }
   else
   {
     // Parameter printing with attributes
-    temp.Format(_T("<%s"),XMLParser::PrintXmlString(name,p_utf8).GetString());
-    message += spaces + temp;
+    p_writer.Write('<');
+    p_writer.Write(element);
 
     // Print all of our attributes
     for(auto& attrib : p_element->GetAttributes())
     {
-      XString attribute = attrib.m_name;
-
       // Append attribute name
-      if(attrib.m_namespace.IsEmpty())
+      p_writer.Write(' ');
+      if(!attrib.m_namespace.IsEmpty())
       {
-        temp.Format(_T(" %s="),XMLParser::PrintXmlString(attribute,p_utf8).GetString());
+        p_writer.Write(attrib.m_namespace);
+        p_writer.Write(':');
       }
-      else
-      {
-        temp.Format(_T(" %s:%s="),attrib.m_namespace.GetString(),XMLParser::PrintXmlString(attribute,p_utf8).GetString());
-      }
-      message += temp;
+      p_writer.WriteXmlString(attrib.m_name,p_utf8);
+      p_writer.Write(_T("=\""));
 
       switch(attrib.m_type & XDT_Mask & ~XDT_Type)
       {
-        default:                    temp.Format(_T("\"%s\""),attrib.m_value.GetString());
+        default:                    p_writer.Write(attrib.m_value);
                                     break;
         case XDT_String:            [[fallthrough]];
         case XDT_AnyURI:            [[fallthrough]];
-        case XDT_NormalizedString:  temp.Format(_T("\"%s\""),XMLParser::PrintXmlString(attrib.m_value,p_utf8).GetString());
+        case XDT_NormalizedString:  p_writer.WriteXmlString(attrib.m_value,p_utf8);
                                     break;
       }
-      message += temp;
+      p_writer.Write('\"');
     }
 
     // Mandatory type in the xml
     if(p_element->GetType() & XDT_Type)
     {
-      temp.Format(_T(" type=\"%s\""),XmlDataTypeToString(p_element->GetType() & XDT_MaskTypes).GetString());
-      message += temp;
+      p_writer.Write(_T(" type=\""));
+      p_writer.Write(XmlDataTypeToString(p_element->GetType() & XDT_MaskTypes));
+      p_writer.Write('\"');
     }
 
     // After the attributes, empty value or value
     if(value.IsEmpty() && p_element->GetChildren().empty())
     {
-      message += XString(_T("/>")) + newline;
-      return message;
+      p_writer.Write(_T("/>"));
+      if(!m_condensed)
+      {
+        p_writer.Write('\n');
+      }
+      return;
     }
     else
     {
       // Write value and end of the key
-      temp.Format(_T(">%s"),XMLParser::PrintXmlString(value,p_utf8).GetString());
-      message += temp;
+      p_writer.Write('>');
+      p_writer.WriteXmlString(value,p_utf8);
     }
   }
 
   if(p_element->GetChildren().size())
   {
-    message += newline;
+    if(!m_condensed)
+    {
+      p_writer.Write('\n');
+    }
     // call recursively
-    for(auto& element : p_element->GetChildren())
+    for(auto& child : p_element->GetChildren())
     {
-      message += PrintElements(element,p_utf8,p_level + 1);
+      WriteElements(p_writer,child,p_utf8,p_level + 1);
     }
-    message += spaces;
+    p_writer.WriteIndent(' ',spaces);
   }
   // Write ending of parameter name
-  temp.Format(_T("</%s>%s"),XMLParser::PrintXmlString(name,p_utf8).GetString(),newline.GetString());
-  message += temp;
-
-  return message;
+  p_writer.Write(_T("</"));
+  p_writer.Write(element);
+  p_writer.Write('>');
+  if(!m_condensed)
+  {
+    p_writer.Write('\n');
+  }
 }
 
 XString
@@ -745,20 +879,18 @@ XMLMessage::SetElement(XMLElement* p_base,XString p_name,XmlDataType p_type,XStr
 {
   XString name(p_name);
   XString namesp = SplitNamespace(name);
-  XmlElementMap& elements = p_base ? p_base->GetChildren() : m_root->GetChildren();
+  XMLElement* base = p_base ? p_base : m_root;
 
   // Finding existing element
-  for (auto& element : elements)
+  XMLElement* element = base->FindChild(name);
+  if(element)
   {
-    if (element->GetName().Compare(name) == 0)
-    {
-      // Just setting the values again
-      element->SetNamespace(namesp);
-      element->SetName(name);
-      element->SetType(p_type);
-      element->SetValue(p_value);
-      return element;
-    }
+    // Just setting the values again
+    element->SetNamespace(namesp);
+    element->SetName(name);
+    element->SetType(p_type);
+    element->SetValue(p_value);
+    return element;
   }
   
   // Create a new node
@@ -965,15 +1097,13 @@ XMLMessage::SetAttribute(XMLElement* p_elem,XString p_name,double p_value)
 XString  
 XMLMessage::GetElement(XMLElement* p_elem,XString p_name)
 {
-  XmlElementMap& map = p_elem ? p_elem->GetChildren() : m_root->GetChildren();
+  XMLElement* base = p_elem ? p_elem : m_root;
 
   // Find in the current mapping
-  for(unsigned ind = 0; ind < map.size(); ++ind)
+  XMLElement* element = base->FindChild(p_name);
+  if(element)
   {
-    if(map[ind]->GetName().Compare(p_name) == 0)
-    {
-      return map[ind]->GetValue();
-    }
+    return element->GetValue();
   }
   return _T("");
 }
@@ -1082,15 +1212,10 @@ XMLMessage::FindElement(XMLElement* p_base, XString p_name,bool p_recurse /*=tru
     }
   }
 
-  for(auto& element : base->GetChildren())
+  XMLElement* child = base->FindChild(elementName,namesp);
+  if(child)
   {
-    if(element->GetName().Compare(elementName) == 0)
-    {
-      if(namesp.IsEmpty() || element->GetNamespace().Compare(namesp) == 0)
-      {
-        return element;
-      }
-    }
+    return child;
   }
   if(p_recurse)
   {
@@ -1247,6 +1372,7 @@ XMLMessage::DeleteElement(XMLElement* p_base, XString p_name, int p_instance /*=
     {
       delete *it;
       map.erase(it);
+      (p_base ? p_base : m_root)->DropIndex();
       return true;
     }
   } 
@@ -1269,6 +1395,7 @@ XMLMessage::DeleteElement(XMLElement* p_base,XMLElement* p_element)
     {
       p_element->DropReference();
       map.erase(it);
+      (p_base ? p_base : m_root)->DropIndex();
       return true;
     }
   }
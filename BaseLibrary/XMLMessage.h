@@ -28,6 +28,8 @@
 #include "ConvertWideString.h"
 #include <deque>
 
+class StringWriter;
+
 // Ordering of the parameters in the WSDL
 enum class WsdlOrder
 {
@@ -73,6 +75,7 @@ class XMLMessage;
 class XMLParser;
 class XMLParserImport;
 class XMLRestriction;
+class NameIndex;
 
 // Different types of maps for the server message
 using XmlElementMap = std::deque<XMLElement*>;
@@ -113,6 +116,11 @@ public:
   static bool     IsValidName(const XString& p_name);
   static XString  InvalidNameMessage(const XString& p_name);
 
+  // Find a direct child by name (and namespace). Large nodes use a name index
+  XMLElement*     FindChild(const XString& p_name,const XString& p_namespace = _T(""));
+  // Children renamed or removed: forget the name index
+  void            DropIndex();
+
   // SETTERS
   void            SetParent(XMLElement* parent)  { m_parent    = parent;    };
   void            SetNamespace(XString p_namesp) { m_namespace = p_namesp;  };
@@ -136,6 +144,12 @@ private:
   XMLElement*     m_parent      { nullptr };
   XMLRestriction* m_restriction { nullptr };
   long            m_references  { 1       };
+  // Name index of the children, only built for large nodes
+  NameIndex*      m_index       { nullptr };
+  SRWLOCK         m_indexLock   = SRWLOCK_INIT;
+  bool            m_indexed     { false   };  // Name is in the index of the parent
+
+  NameIndex*      GetNameIndex();
 };
 
 //////////////////////////////////////////////////////////////////////////
@@ -171,6 +185,11 @@ public:
   virtual XString PrintElements(XMLElement* p_element
                                ,bool        p_utf8  = true
                                ,int         p_level = 0);
+  // Stream the elements stack into a writer (as PrintElements)
+  void            WriteElements(StringWriter& p_writer
+                               ,XMLElement*   p_element
+                               ,bool          p_utf8  = true
+                               ,int           p_level = 0);
   // Print the XML as a JSON object
   virtual XString PrintJson(bool p_attributes);
   // Print the elements stack as a JSON string
@@ -26,7 +26,7 @@
 #include "pch.h"
 #include "XMLRestriction.h"
 #include "XMLTemporal.h"
-#include "CrackURL.h"
+#include "URLView.h"
 #include <stdint.h>
 #include <regex>
 
@@ -598,7 +598,8 @@ XString
 XMLRestriction::CheckAnyURI(XString p_value)
 {
   XString result;
-  CrackedURL url(p_value);
+  // Only the validity counts: nothing needs to be decoded
+  URLView url(p_value);
   if(!url.Valid())
   {
     result = _T("Not a valid URI: ") + p_value;
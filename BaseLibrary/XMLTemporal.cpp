@@ -55,6 +55,199 @@ int g_daysInTheMonth[14] =
   ,396  // February next year
 };
 
+//////////////////////////////////////////////////////////////////////////
+//
+// FIXED-WIDTH ISO 8601
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Read 2 or 4 digits. All non-digits are collected in the 'bad' flag
+inline int ISODigits2(LPCTSTR p_string,unsigned& p_bad)
+{
+  unsigned high = (unsigned)(p_string[0] - '0');
+  unsigned low  = (unsigned)(p_string[1] - '0');
+  p_bad |= (unsigned)(high > 9) | (unsigned)(low > 9);
+  return (int)(high * 10 + low);
+}
+
+inline int ISODigits4(LPCTSTR p_string,unsigned& p_bad)
+{
+  return ISODigits2(p_string,p_bad) * 100 + ISODigits2(p_string + 2,p_bad);
+}
+
+// Write a number as 2 digits
+inline void ISOPut2(LPTSTR p_buffer,int p_number)
+{
+  p_buffer[0] = (TCHAR)('0' + p_number / 10);
+  p_buffer[1] = (TCHAR)('0' + p_number % 10);
+}
+
+// Scaling of the fraction digits to nanoseconds
+static const int g_fractionScale[10] =
+{
+  1000000000,100000000,10000000,1000000,100000,10000,1000,100,10,1
+};
+
+// Parse "YYYY-MM-DDThh:mm:ss[.fraction][Z|+hh:mm|-hh:mm]"
+// Anything else is left to the generic XML date parser
+bool
+ISO8601ToStamp(LPCTSTR p_string,int p_length,XmlStampStorage& p_stamp,int& p_fraction,bool& p_zone,int& p_offset)
+{
+  if(!p_string || p_length < 19)
+  {
+    return false;
+  }
+  // All separators and digits of the fixed part are checked in one go
+  unsigned bad = (unsigned)(p_string[ 4] != '-') | (unsigned)(p_string[ 7] != '-') |
+                 (unsigned)(p_string[10] != 'T') | (unsigned)(p_string[13] != ':') |
+                 (unsigned)(p_string[16] != ':');
+  int year   = ISODigits4(&p_string[ 0],bad);
+  int month  = ISODigits2(&p_string[ 5],bad);
+  int day    = ISODigits2(&p_string[ 8],bad);
+  int hour   = ISODigits2(&p_string[11],bad);
+  int minute = ISODigits2(&p_string[14],bad);
+  int second = ISODigits2(&p_string[17],bad);
+
+  // Optional fraction. Digits beyond the nanoseconds are ignored
+  int pos      = 19;
+  int fraction = 0;
+  if(pos < p_length && p_string[pos] == '.')
+  {
+    int digits = 0;
+    unsigned digit = 0;
+    while(++pos < p_length && (digit = (unsigned)(p_string[pos] - '0')) <= 9)
+    {
+      if(digits < 9)
+      {
+        fraction = fraction * 10 + (int)digit;
+        ++digits;
+      }
+    }
+    if(digits == 0)
+    {
+      return false;
+    }
+    fraction *= g_fractionScale[digits];
+  }
+
+  // Optional time zone
+  bool zone   = false;
+  int  offset = 0;
+  if(pos < p_length)
+  {
+    TCHAR sign = p_string[pos];
+    if(sign == 'Z' && pos + 1 == p_length)
+    {
+      zone = true;
+    }
+    else if((sign == '+' || sign == '-') && pos + 6 == p_length && p_string[pos + 3] == ':')
+    {
+      int hours   = ISODigits2(&p_string[pos + 1],bad);
+      int minutes = ISODigits2(&p_string[pos + 4],bad);
+      bad   |= (unsigned)(minutes > 59) | (unsigned)(hours * 60 + minutes > 840);
+      offset = (sign == '-') ? -(hours * 60 + minutes) : (hours * 60 + minutes);
+      zone   = true;
+    }
+    else
+    {
+      return false;
+    }
+  }
+  if(bad || month < 1 || month > 12 || day < 1 || day > 31 || hour > 24 || minute > 59 || second > 59)
+  {
+    return false;
+  }
+  p_stamp.m_year   = (short)year;
+  p_stamp.m_month  = (char) month;
+  p_stamp.m_day    = (char) day;
+  p_stamp.m_hour   = (char) hour;
+  p_stamp.m_minute = (char) minute;
+  p_stamp.m_second = (char) second;
+  p_fraction = fraction;
+  p_zone     = zone;
+  p_offset   = offset;
+  return true;
+}
+
+// Print "YYYY-MM-DDThh:mm:ss[.fraction]" without trailing zeros in the fraction
+// Buffer must be at least ISO8601_MAXLENGTH + 1. Returns the length of the string
+int
+ISO8601FromStamp(const XmlStampStorage& p_stamp,int p_fraction,LPTSTR p_buffer)
+{
+  ISOPut2(&p_buffer[ 0],p_stamp.m_year / 100);
+  ISOPut2(&p_buffer[ 2],p_stamp.m_year % 100);
+  p_buffer[ 4] = '-';
+  ISOPut2(&p_buffer[ 5],p_stamp.m_month);
+  p_buffer[ 7] = '-';
+  ISOPut2(&p_buffer[ 8],p_stamp.m_day);
+  p_buffer[10] = 'T';
+  ISOPut2(&p_buffer[11],p_stamp.m_hour);
+  p_buffer[13] = ':';
+  ISOPut2(&p_buffer[14],p_stamp.m_minute);
+  p_buffer[16] = ':';
+  ISOPut2(&p_buffer[17],p_stamp.m_second);
+
+  int length = 19;
+  if(p_fraction > 0)
+  {
+    unsigned fraction = (p_fraction < NANOSECONDS_PER_SEC) ? (unsigned)p_fraction : NANOSECONDS_PER_SEC - 1;
+    p_buffer[length++] = '.';
+    for(int ind = 8; ind >= 0; --ind)
+    {
+      p_buffer[length + ind] = (TCHAR)('0' + fraction % 10);
+      fraction /= 10;
+    }
+    length += 9;
+    while(p_buffer[length - 1] == '0')
+    {
+      --length;
+    }
+  }
+  p_buffer[length] = 0;
+  return length;
+}
+
+// Setting a parsed moment, converting the time zone to local time
+static bool
+SetParsedMoment(XMLTimestamp& p_moment
+               ,int p_year,int p_month,int p_day
+               ,int p_hour,int p_minute,int p_second
+               ,int p_fraction,bool p_UTC,int p_offset)
+{
+  if((p_hour   >= 0 && p_hour   <= 23 &&
+      p_minute >= 0 && p_minute <= 59 &&
+      p_second >= 0 && p_second <= 59) ||
+     (p_hour == 24 && p_minute == 0 && p_second == 0 && p_fraction == 0))
+  {
+    bool plusdag = p_hour == 24;
+    if(plusdag) p_hour = 0;
+
+    p_moment.SetTimestamp(p_year,p_month,p_day,p_hour,p_minute,p_second);
+
+    if(plusdag)
+    {
+      p_moment = p_moment.AddDays(1);
+    }
+    if(p_offset)
+    {
+      p_moment = p_moment.AddMinutes(p_offset);
+    }
+    if(p_UTC)
+    {
+      TIME_ZONE_INFORMATION tziCurrent;
+      ::ZeroMemory(&tziCurrent,sizeof(tziCurrent));
+      if(::GetTimeZoneInformation(&tziCurrent) != TIME_ZONE_ID_INVALID)
+      {
+        p_moment = p_moment.AddMinutes(-tziCurrent.Bias);
+      }
+    }
+    // Store the fraction (if any)
+    p_moment.SetFraction(p_fraction);
+    return true;
+  }
+  return false;
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 // BASE CLASS XMLTemporal
@@ -71,6 +264,18 @@ XMLTemporal::XMLTemporal(XString p_value)
 bool
 XMLTemporal::ParseXMLDate(const XString& p_string,XMLTimestamp& p_moment)
 {
+  // Fast path for the fixed-width "YYYY-MM-DDThh:mm:ss[.fraction][Z|+hh:mm|-hh:mm]"
+  XmlStampStorage stamp;
+  int  nanoseconds = 0;
+  int  zoneOffset  = 0;
+  bool zone        = false;
+  if(ISO8601ToStamp(p_string.GetString(),p_string.GetLength(),stamp,nanoseconds,zone,zoneOffset))
+  {
+    return SetParsedMoment(p_moment,stamp.m_year,stamp.m_month,stamp.m_day
+                          ,stamp.m_hour,stamp.m_minute,stamp.m_second
+                          ,nanoseconds,zone,zoneOffset);
+  }
+
   int ja[4] = {0,0,0,0};
   int ma[2] = {0,0};
   int da[2] = {0,0};
@@ -194,38 +399,10 @@ XMLTemporal::ParseXMLDate(const XString& p_string,XMLTimestamp& p_moment)
              }
              break;
     }
-    if((valid || offset || UTC) && 
-      ((uur     >= 0 && uur     <= 23 && 
-        minuut  >= 0 && minuut  <= 59 && 
-        seconde >= 0 && seconde <= 59) || 
-        (uur == 24 && minuut == 0 && seconde == 0 && fraction == 0)))
+    if(valid || offset || UTC)
     {
-      bool plusdag = uur == 24;
-      if(plusdag) uur = 0;
-
-      p_moment.SetTimestamp(jaar,maand,dag,uur,minuut,seconde);
-
-      if(plusdag)
-      {
-        p_moment = p_moment.AddDays(1);
-      }
-      if(offset)
-      {
-        p_moment = p_moment.AddMinutes(offsetminuten);
-        UTC = true;
-      }
-      if(UTC)
-      {
-        TIME_ZONE_INFORMATION tziCurrent;
-        ::ZeroMemory(&tziCurrent,sizeof(tziCurrent));
-        if(::GetTimeZoneInformation(&tziCurrent) != TIME_ZONE_ID_INVALID)
-        {
-          p_moment = p_moment.AddMinutes(-tziCurrent.Bias);
-        }
-      }
-      // Store the fraction (if any)
-      p_moment.SetFraction(fraction);
-      return true;
+      return SetParsedMoment(p_moment,jaar,maand,dag,uur,minuut,seconde
+                            ,fraction,offset || UTC,offset ? offsetminuten : 0);
     }
   }
   return false;
@@ -897,20 +1074,9 @@ XMLTimestamp::AddMinutes(int p_number) const
 XString 
 XMLTimestamp::AsString()
 {
-  XString string;
-  string.Format(_T("%04d-%02d-%02dT%02d:%02d:%02d")
-               ,m_timestamp.m_year
-               ,m_timestamp.m_month
-               ,m_timestamp.m_day
-               ,m_timestamp.m_hour
-               ,m_timestamp.m_minute
-               ,m_timestamp.m_second);
-  if(m_fraction)
-  {
-    string.AppendFormat(_T(".%d"),m_fraction);
-    string.TrimRight(_T("0"));
-  }
-  return string;
+  TCHAR buffer[ISO8601_MAXLENGTH + 1];
+  int length = ISO8601FromStamp(m_timestamp,m_fraction,buffer);
+  return XString(buffer,length);
 }
 
 void
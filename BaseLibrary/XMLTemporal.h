@@ -63,6 +63,14 @@ struct XmlStampStorage
   char  m_second;    // 0 - 59    seconds
 };
 
+// Longest fixed-width ISO 8601 timestamp as in "YYYY-MM-DDThh:mm:ss.fffffffff+hh:mm"
+#define ISO8601_MAXLENGTH 35
+
+// Fixed-width ISO 8601 timestamps "YYYY-MM-DDThh:mm:ss[.fraction][Z|+hh:mm|-hh:mm]"
+// The fraction is in nanoseconds. The offset is in minutes, with the sign as in the string
+bool ISO8601ToStamp  (LPCTSTR p_string,int p_length,XmlStampStorage& p_stamp,int& p_fraction,bool& p_zone,int& p_offset);
+int  ISO8601FromStamp(const XmlStampStorage& p_stamp,int p_fraction,LPTSTR p_buffer);
+
 class XMLTimestamp;
 
 //////////////////////////////////////////////////////////////////////////
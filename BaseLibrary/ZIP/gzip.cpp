@@ -155,3 +155,26 @@ bool gzip_decompress_memory(void *in_data,size_t in_data_size,std::vector<uint8_
   delete [] temp_buffer;
   return true;
 }
+
+// Inflate a raw 'deflate' stream (as stored in a ZIP archive) into a buffer
+// The inflated size must be known beforehand (e.g. from the ZIP central directory)
+bool zip_inflate_memory(void *in_data,size_t in_data_size,void* out_data,size_t out_data_size)
+{
+  z_stream strm;
+  memset(&strm,0,sizeof(z_stream));
+  strm.next_in   = reinterpret_cast<uint8_t *>(in_data);
+  strm.avail_in  = (uInt)in_data_size;
+  strm.next_out  = reinterpret_cast<uint8_t *>(out_data);
+  strm.avail_out = (uInt)out_data_size;
+
+  // Negative window bits: no zlib or gzip header
+  int windowBits = 15;
+  if(inflateInit2(&strm,-windowBits) != Z_OK)
+  {
+    return false;
+  }
+  int res = inflate(&strm,Z_FINISH);
+  inflateEnd(&strm);
+
+  return res == Z_STREAM_END && strm.total_out == out_data_size;
+}
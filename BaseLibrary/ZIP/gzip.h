@@ -36,3 +36,4 @@
 
 bool gzip_compress_memory  (void *in_data,size_t in_data_size,std::vector<uint8_t>& buffer);
 bool gzip_decompress_memory(void *in_data,size_t in_data_size,std::vector<uint8_t>& buffer);
+bool zip_inflate_memory    (void *in_data,size_t in_data_size,void* out_data,size_t out_data_size);
@@ -0,0 +1,293 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// USER-SPACE IMPLEMENTTION OF HTTP.SYS
+//
+// 2018 (c) ir. W.E. Huisman
+// License: MIT
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "http_private.h"
+#include "FragmentCache.h"
+#include "ServerSession.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// FRAGMENT
+//
+//////////////////////////////////////////////////////////////////////////
+
+Fragment::Fragment(CString p_name,PVOID p_buffer,ULONG p_length,ULONGLONG p_expires)
+         :m_name(p_name)
+         ,m_length(p_length)
+         ,m_expires(p_expires)
+{
+  m_buffer = new BYTE[p_length + 1];
+  memcpy(m_buffer,p_buffer,p_length);
+  m_buffer[p_length] = 0;
+}
+
+Fragment::~Fragment()
+{
+  delete [] m_buffer;
+}
+
+void
+Fragment::AddReference()
+{
+  InterlockedIncrement(&m_references);
+}
+
+void
+Fragment::DropReference()
+{
+  if(InterlockedDecrement(&m_references) == 0)
+  {
+    delete this;
+  }
+}
+
+bool
+Fragment::GetIsExpired(ULONGLONG p_now)
+{
+  return m_expires != 0 && p_now >= m_expires;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// FRAGMENT CACHE
+//
+//////////////////////////////////////////////////////////////////////////
+
+FragmentCache::FragmentCache()
+{
+  InitializeSRWLock(&m_lock);
+  m_budget = (ULONGLONG)SESSION_CACHE_DEFAULT * 1024 * 1024;
+  m_hand   = m_fragments.end();
+}
+
+FragmentCache::~FragmentCache()
+{
+  DeleteAllFragments();
+}
+
+void
+FragmentCache::SetBudget(ULONGLONG p_bytes)
+{
+  AcquireSRWLockExclusive(&m_lock);
+  m_budget = p_bytes;
+  MakeRoom(0);
+  ReleaseSRWLockExclusive(&m_lock);
+}
+
+// Add a copy of a memory chunk to the cache
+ULONG
+FragmentCache::AddFragment(CString p_name,PHTTP_DATA_CHUNK p_chunk,PHTTP_CACHE_POLICY p_policy)
+{
+  ULONG length = p_chunk->FromMemory.BufferLength;
+  if(length > m_budget)
+  {
+    return ERROR_NOT_ENOUGH_MEMORY;
+  }
+  ULONGLONG expires = 0;
+  if(p_policy && p_policy->Policy == HttpCachePolicyTimeToLive)
+  {
+    expires = GetTickCount64() + (ULONGLONG)p_policy->SecondsToLive * 1000;
+  }
+  p_name.MakeLower();
+
+  // Copy outside the lock
+  Fragment* fragment = new Fragment(p_name,p_chunk->FromMemory.pBuffer,length,expires);
+  ULONG result = NO_ERROR;
+
+  AcquireSRWLockExclusive(&m_lock);
+  FragmentMap::iterator it = m_fragments.find(p_name);
+  if(it != m_fragments.end())
+  {
+    if(it->second->GetIsExpired(GetTickCount64()))
+    {
+      // Expired fragment may be replaced
+      RemoveFragment(it);
+      InterlockedIncrement64(&m_expirations);
+    }
+    else
+    {
+      result = ERROR_DUPLICATE_TAG;
+    }
+  }
+  if(result == NO_ERROR)
+  {
+    if(MakeRoom(length))
+    {
+      m_fragments.insert(std::make_pair(p_name,fragment));
+      m_bytes += length;
+      fragment = nullptr;
+    }
+    else
+    {
+      result = ERROR_NOT_ENOUGH_MEMORY;
+    }
+  }
+  ReleaseSRWLockExclusive(&m_lock);
+
+  if(fragment)
+  {
+    fragment->DropReference();
+  }
+  return result;
+}
+
+// Find a fragment and hand out a reference to it
+Fragment*
+FragmentCache::FindFragment(CString p_name)
+{
+  Fragment* fragment = nullptr;
+  p_name.MakeLower();
+
+  AcquireSRWLockShared(&m_lock);
+  FragmentMap::iterator it = m_fragments.find(p_name);
+  if(it != m_fragments.end() && !it->second->GetIsExpired(GetTickCount64()))
+  {
+    fragment = it->second;
+    fragment->AddReference();
+    // Only write if needed: keeps the cache line shared between readers
+    if(fragment->m_referenced == 0)
+    {
+      InterlockedExchange(&fragment->m_referenced,1);
+    }
+  }
+  ReleaseSRWLockShared(&m_lock);
+
+  InterlockedIncrement64(fragment ? &m_hits : &m_misses);
+  return fragment;
+}
+
+// Flush (remove) a fragment from the cache
+// Removes one fragment or all descendants of it.
+ULONG
+FragmentCache::FlushFragment(CString p_name,bool p_recursive)
+{
+  int erased = 0;
+  p_name.MakeLower();
+
+  AcquireSRWLockExclusive(&m_lock);
+
+  // Try to erase exactly this name from the cache
+  FragmentMap::iterator it = m_fragments.find(p_name);
+  if(it != m_fragments.end())
+  {
+    RemoveFragment(it);
+    ++erased;
+  }
+
+  // Also find fragments that are descendants of the name given
+  // The map is sorted, so these are all in one range
+  if(p_recursive)
+  {
+    it = m_fragments.lower_bound(p_name);
+    while(it != m_fragments.end() && p_name.Compare(it->first.Left(p_name.GetLength())) == 0)
+    {
+      it = RemoveFragment(it);
+      ++erased;
+    }
+  }
+  ReleaseSRWLockExclusive(&m_lock);
+
+  // Return flushed or no fragments found
+  return erased > 0 ? NO_ERROR : ERROR_NOT_FOUND;
+}
+
+// Directly remove all fragments from the fragment cache
+void
+FragmentCache::DeleteAllFragments()
+{
+  AcquireSRWLockExclusive(&m_lock);
+  for(auto& fragment : m_fragments)
+  {
+    fragment.second->DropReference();
+  }
+  m_fragments.clear();
+  m_hand  = m_fragments.end();
+  m_bytes = 0;
+  ReleaseSRWLockExclusive(&m_lock);
+}
+
+void
+FragmentCache::GetStatistics(FragmentStatistics& p_statistics)
+{
+  AcquireSRWLockShared(&m_lock);
+  p_statistics.m_fragments   = (ULONG)m_fragments.size();
+  p_statistics.m_bytes       = m_bytes;
+  p_statistics.m_budget      = m_budget;
+  ReleaseSRWLockShared(&m_lock);
+
+  p_statistics.m_hits        = (ULONGLONG)ReadNoFence64(&m_hits);
+  p_statistics.m_misses      = (ULONGLONG)ReadNoFence64(&m_misses);
+  p_statistics.m_evictions   = (ULONGLONG)ReadNoFence64(&m_evictions);
+  p_statistics.m_expirations = (ULONGLONG)ReadNoFence64(&m_expirations);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE: Exclusive lock must be held
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Remove one fragment. Senders may still hold a reference to it
+FragmentMap::iterator
+FragmentCache::RemoveFragment(FragmentMap::iterator p_iterator)
+{
+  Fragment* fragment = p_iterator->second;
+  m_bytes -= fragment->GetLength();
+  fragment->DropReference();
+
+  bool hand = (m_hand == p_iterator);
+  FragmentMap::iterator next = m_fragments.erase(p_iterator);
+  if(hand)
+  {
+    m_hand = next;
+  }
+  return next;
+}
+
+// Make room for a new fragment of this length by sweeping the CLOCK hand.
+// Expired fragments are removed on the way. Recently used ones get a second chance
+bool
+FragmentCache::MakeRoom(ULONG p_length)
+{
+  ULONGLONG now = GetTickCount64();
+
+  // At most two rounds: the first one clears the referenced bits
+  size_t steps = 2 * m_fragments.size();
+  while(m_bytes + p_length > m_budget && steps-- > 0)
+  {
+    if(m_hand == m_fragments.end())
+    {
+      m_hand = m_fragments.begin();
+    }
+    Fragment* fragment = m_hand->second;
+    if(fragment->GetIsExpired(now))
+    {
+      m_hand = RemoveFragment(m_hand);
+      InterlockedIncrement64(&m_expirations);
+    }
+    else if(fragment->m_referenced)
+    {
+      fragment->m_referenced = 0;
+      ++m_hand;
+    }
+    else
+    {
+      m_hand = RemoveFragment(m_hand);
+      InterlockedIncrement64(&m_evictions);
+    }
+  }
+  return m_bytes + p_length <= m_budget;
+}
@@ -0,0 +1,97 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// USER-SPACE IMPLEMENTTION OF HTTP.SYS
+//
+// 2018 (c) ir. W.E. Huisman
+// License: MIT
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+#include <map>
+
+// One cached fragment: an immutable copy of the memory chunk of the application.
+// A fragment is reference counted. The cache holds one reference, and every
+// request that is sending from the fragment holds one more, so a fragment can
+// be flushed or evicted while still being written to a socket.
+//
+class Fragment
+{
+public:
+  Fragment(CString p_name,PVOID p_buffer,ULONG p_length,ULONGLONG p_expires);
+
+  void      AddReference();
+  void      DropReference();
+  bool      GetIsExpired(ULONGLONG p_now);
+
+  CString   GetName()   { return m_name;   };
+  PVOID     GetBuffer() { return m_buffer; };
+  ULONG     GetLength() { return m_length; };
+
+private:
+  friend class FragmentCache;
+ ~Fragment();
+
+  CString         m_name;
+  BYTE*           m_buffer  { nullptr };
+  ULONG           m_length  { 0 };
+  ULONGLONG       m_expires { 0 };          // GetTickCount64 moment. 0 = until flushed
+  volatile LONG   m_references { 1 };       // The cache itself is the first reference
+  volatile LONG   m_referenced { 0 };       // Used since the last pass of the clock hand
+};
+
+using FragmentMap = std::map<CString,Fragment*>;
+
+// Statistics of the fragment cache
+typedef struct _fragmentStatistics
+{
+  ULONG     m_fragments;    // Fragments currently in the cache
+  ULONGLONG m_bytes;        // Bytes currently in the cache
+  ULONGLONG m_budget;       // Maximum bytes in the cache
+  ULONGLONG m_hits;         // Lookups that found a fragment
+  ULONGLONG m_misses;       // Lookups that did not find a (living) fragment
+  ULONGLONG m_evictions;    // Fragments removed to make room for new ones
+  ULONGLONG m_expirations;  // Fragments removed because their time-to-live has passed
+}
+FragmentStatistics;
+
+// The fragment cache of a request queue.
+// Holds at most 'budget' bytes of fragments. When a new fragment does not fit
+// the least recently used fragments are evicted by a CLOCK sweep over the cache:
+// fragments used since the last pass of the hand get a second chance.
+// Lookups take a shared lock only, so sending threads do not block each other.
+// Adding, flushing and evicting take the lock exclusively.
+//
+class FragmentCache
+{
+public:
+  FragmentCache();
+ ~FragmentCache();
+
+  void      SetBudget(ULONGLONG p_bytes);
+
+  // Add a copy of a memory chunk under this name
+  ULONG     AddFragment(CString p_name,PHTTP_DATA_CHUNK p_chunk,PHTTP_CACHE_POLICY p_policy);
+  // Find a fragment. Caller must call 'DropReference' on the result
+  Fragment* FindFragment(CString p_name);
+  // Flush one fragment, or all fragments that start with this name
+  ULONG     FlushFragment(CString p_name,bool p_recursive);
+  // Remove all fragments
+  void      DeleteAllFragments();
+
+  void      GetStatistics(FragmentStatistics& p_statistics);
+
+private:
+  FragmentMap::iterator RemoveFragment(FragmentMap::iterator p_iterator);
+  bool      MakeRoom(ULONG p_length);
+
+  FragmentMap           m_fragments;
+  FragmentMap::iterator m_hand;                 // The hand of the CLOCK
+  ULONGLONG             m_budget      { 0 };
+  ULONGLONG             m_bytes       { 0 };
+  volatile LONG64       m_hits        { 0 };
+  volatile LONG64       m_misses      { 0 };
+  volatile LONG64       m_evictions   { 0 };
+  volatile LONG64       m_expirations { 0 };
+  SRWLOCK               m_lock;
+};
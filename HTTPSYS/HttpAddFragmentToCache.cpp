@@ -37,9 +37,9 @@ HttpAddFragmentToCache(IN HANDLE              RequestQueueHandle
     return ERROR_INVALID_PARAMETER;
   }
 
-  // Only user invalidated fragments are accepted in the fragment cache
-  // Time-to-live parameter not yet implemented
-  if(CachePolicy && CachePolicy->Policy != HttpCachePolicyUserInvalidates)
+  // Only user invalidated and time-to-live fragments are accepted in the fragment cache
+  if(CachePolicy && CachePolicy->Policy != HttpCachePolicyUserInvalidates
+                 && CachePolicy->Policy != HttpCachePolicyTimeToLive)
   {
     return ERROR_INVALID_PARAMETER;
   }
@@ -61,5 +61,5 @@ HttpAddFragmentToCache(IN HANDLE              RequestQueueHandle
   CString prefix(W2A(UrlPrefix));
 
   // Add fragment to the fragment cache of the request queue
-  return queue->AddFragment(prefix,DataChunk);
+  return queue->AddFragment(prefix,DataChunk,CachePolicy);
 }
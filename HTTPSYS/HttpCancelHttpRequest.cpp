@@ -32,8 +32,13 @@ HttpCancelHttpRequest(IN HANDLE           RequestQueueHandle
 
   // Finding the elementary object
   RequestQueue* queue = GetRequestQueueFromHandle(RequestQueueHandle);
-  Request*    request = GetRequestFromHandle(RequestId);
-  if (queue == nullptr || request == nullptr)
+  if(queue == nullptr)
+  {
+    return ERROR_INVALID_PARAMETER;
+  }
+  // We now hold a reference to the request
+  Request* request = GetRequestFromHandle(RequestId);
+  if(request == nullptr)
   {
     return ERROR_INVALID_PARAMETER;
   }
@@ -48,5 +53,6 @@ HttpCancelHttpRequest(IN HANDLE           RequestQueueHandle
       queue->RemoveRequest(request);
 //    }
   }
+  request->DropReference();
   return NO_ERROR;
 }
@@ -72,5 +72,17 @@ HttpQueryRequestQueueProperty(_In_ HANDLE                 RequestQueueHandle
       return NO_ERROR;
     }
   }
+  else if(Property == HttpServerFragmentCacheProperty)
+  {
+    if(PropertyInformationLength >= sizeof(FragmentStatistics))
+    {
+      queue->GetFragmentStatistics(*((FragmentStatistics*)PropertyInformation));
+      if(ReturnLength)
+      {
+        *ReturnLength = sizeof(FragmentStatistics);
+      }
+      return NO_ERROR;
+    }
+  }
   return ERROR_INVALID_PARAMETER;
 }
@@ -48,18 +48,39 @@ HttpReadFragmentFromCache(IN HANDLE           RequestQueueHandle
   USES_CONVERSION;
   CString prefix(W2A(UrlPrefix));
 
-  PHTTP_DATA_CHUNK chunk = queue->FindFragment(prefix);
-  if(chunk)
+  Fragment* fragment = queue->FindFragment(prefix);
+  if(fragment == nullptr)
   {
-    ULONG size = chunk->FromMemory.BufferLength;
-    *BytesRead = size;
-    if(BufferLength < size)
+    return ERROR_NOT_FOUND;
+  }
+
+  // Optionally only a part of the fragment
+  ULONG start = 0;
+  ULONG size  = fragment->GetLength();
+  if(ByteRange)
+  {
+    ULONGLONG offset = ByteRange->StartingOffset.QuadPart;
+    ULONGLONG length = ByteRange->Length.QuadPart;
+    if(offset >= size || (length != HTTP_BYTE_RANGE_TO_EOF && offset + length > size))
     {
-      // Reporting the number of bytes needed in 'BytesRead'
-      return ERROR_MORE_DATA;
+      fragment->DropReference();
+      return ERROR_INVALID_PARAMETER;
     }
-    memcpy(Buffer,chunk->FromMemory.pBuffer,size);
-    return NO_ERROR;
+    start = (ULONG)offset;
+    size  = (length == HTTP_BYTE_RANGE_TO_EOF) ? size - start : (ULONG)length;
+  }
+
+  ULONG result = NO_ERROR;
+  *BytesRead = size;
+  if(BufferLength < size)
+  {
+    // Reporting the number of bytes needed in 'BytesRead'
+    result = ERROR_MORE_DATA;
+  }
+  else
+  {
+    memcpy(Buffer,(BYTE*)fragment->GetBuffer() + start,size);
   }
-  return ERROR_NOT_FOUND;
+  fragment->DropReference();
+  return result;
 }
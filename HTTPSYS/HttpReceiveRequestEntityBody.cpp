@@ -47,20 +47,26 @@ HttpReceiveRequestEntityBody(IN HANDLE          RequestQueueHandle
 
   // Getting the elementary objects
   RequestQueue* queue = GetRequestQueueFromHandle(RequestQueueHandle);
-  Request*    request = GetRequestFromHandle(RequestId);
-
-  if(queue == nullptr || request == nullptr)
+  if(queue == nullptr)
+  {
+    return ERROR_INVALID_PARAMETER;
+  }
+  // We now hold a reference to the request
+  Request* request = GetRequestFromHandle(RequestId);
+  if(request == nullptr)
   {
     return ERROR_INVALID_PARAMETER;
   }
 
   // Try to receive for this request
+  ULONG result = ERROR_HANDLE_EOF;
   if(queue->RequestStillInService(request))
   {
-    return request->ReceiveBuffer(EntityBuffer
-                                 ,EntityBufferLength
-                                 ,BytesReturned
-                                 ,Flags == HTTP_RECEIVE_REQUEST_ENTITY_BODY_FLAG_FILL_BUFFER);
+    result = request->ReceiveBuffer(EntityBuffer
+                                   ,EntityBufferLength
+                                   ,BytesReturned
+                                   ,Flags == HTTP_RECEIVE_REQUEST_ENTITY_BODY_FLAG_FILL_BUFFER);
   }
-  return ERROR_HANDLE_EOF;
+  request->DropReference();
+  return result;
 }
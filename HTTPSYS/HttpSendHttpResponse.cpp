@@ -50,10 +50,15 @@ HttpSendHttpResponse(IN HANDLE              RequestQueueHandle
 
   // Finding the elementary object
   RequestQueue* queue = GetRequestQueueFromHandle(RequestQueueHandle);
-  Request*    request = GetRequestFromHandle(RequestId);
   ULONG        result = ERROR_HANDLE_EOF;
 
-  if (queue == nullptr || request == nullptr)
+  if (queue == nullptr)
+  {
+    return ERROR_INVALID_PARAMETER;
+  }
+  // We now hold a reference to the request
+  Request* request = GetRequestFromHandle(RequestId);
+  if(request == nullptr)
   {
     return ERROR_INVALID_PARAMETER;
   }
@@ -75,6 +80,7 @@ HttpSendHttpResponse(IN HANDLE              RequestQueueHandle
       }
     }
   }
+  request->DropReference();
 
   // Log our response
   if (LogData)
@@ -44,10 +44,15 @@ HttpSendResponseEntityBody(IN HANDLE          RequestQueueHandle
 
   // Finding the elementary object
   RequestQueue* queue = GetRequestQueueFromHandle(RequestQueueHandle);
-  Request*    request = GetRequestFromHandle(RequestId);
   ULONG        result = ERROR_HANDLE_EOF;
 
-  if (queue == nullptr || request == nullptr)
+  if (queue == nullptr)
+  {
+    return ERROR_INVALID_PARAMETER;
+  }
+  // We now hold a reference to the request
+  Request* request = GetRequestFromHandle(RequestId);
+  if(request == nullptr)
   {
     return ERROR_INVALID_PARAMETER;
   }
@@ -76,6 +81,7 @@ HttpSendResponseEntityBody(IN HANDLE          RequestQueueHandle
       }
     }
   }
+  request->DropReference();
 
   // Log our response on the closing of the call
   if (LogData)
@@ -558,20 +558,35 @@ int PlainSocket::RecvMsg(LPVOID p_buffer, const ULONG p_length)
 // sends a message, or part of one
 int PlainSocket::SendPartial(LPCVOID p_buffer, const ULONG p_length)
 {
-	WSAOVERLAPPED os;
 	WSABUF buffer;
-	DWORD bytes_sent = 0;
 
 	// Setup the buffer array
 	buffer.buf = (char *)p_buffer;
 	buffer.len = p_length;
 
+  return SendGather(&buffer,1);
+}
+
+// sends a message from an array of buffers in one (1) call, or part of it
+int PlainSocket::SendGather(LPWSABUF p_buffers,const DWORD p_count)
+{
+	WSAOVERLAPPED os;
+	DWORD bytes_sent = 0;
+  ULONG length     = 0;
+
+  for(DWORD index = 0; index < p_count; ++index)
+  {
+    length += p_buffers[index].len;
+  }
 
   if(!InSecureMode())
   {
     DebugMsg(_T(" "));
-    DebugMsg(_T("Send message has %d bytes"),p_length);
-    PrintHexDump(p_length,p_buffer);
+    DebugMsg(_T("Send message has %d bytes in %d buffers"),length,p_count);
+    for(DWORD index = 0; index < p_count; ++index)
+    {
+      PrintHexDump(p_buffers[index].len,p_buffers[index].buf);
+    }
   }
 
 	// Reset the timer if it has been invalidated 
@@ -585,7 +600,7 @@ int PlainSocket::SendPartial(LPCVOID p_buffer, const ULONG p_length)
 	memset(&os, 0, sizeof(OVERLAPPED));
 	os.hEvent = m_write_event;
 	WSAResetEvent(m_read_event);
-	int received = WSASend(m_actualSocket, &buffer, 1, &bytes_sent, 0, &os, NULL);
+	int received = WSASend(m_actualSocket, p_buffers, p_count, &bytes_sent, 0, &os, NULL);
 	m_lastError  = WSAGetLastError();
 
 	// Now wait for the I/O to complete if necessary, and see what happened
@@ -612,7 +627,7 @@ int PlainSocket::SendPartial(LPCVOID p_buffer, const ULONG p_length)
 		DWORD msg_flags = 0;
 		if (WSAGetOverlappedResult(m_actualSocket, &os, &bytes_sent, true, &msg_flags))
 		{
-      if(bytes_sent == p_length) // Everything that was requested was sent
+      if(bytes_sent == length) // Everything that was requested was sent
       {
         m_sendEndTime = 0;  // Invalidate the timer so it is set next time through
       }
@@ -41,6 +41,8 @@ public:
 	int   RecvPartial(LPVOID p_buffer, const ULONG p_length) override;
   // Sends up to      p_length bytes of data and returns the amount sent     - or SOCKET_ERROR if it times out
 	int   SendPartial(LPCVOID p_buffer,const ULONG p_length) override;
+  // Sends up to all buffers of a scatter/gather array in one (1) call - or SOCKET_ERROR if it times out
+  int   SendGather (LPWSABUF p_buffers,const DWORD p_count);
 
   // Set up SSL/TLS state for this connection: NEVER USED ON PLAIN SOCKETS! Only on derived classes!!
   HRESULT InitializeSSL(const void* p_buffer = nullptr,const int p_length = 0) override;
@@ -21,8 +21,10 @@
 #include "SSLUtilities.h"
 #include "CodeBase64.h"
 #include <LogAnalysis.h>
+#include <HTTPTime.h>
 #include <wininet.h>
 #include <mswsock.h>
+#include <memory>
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -61,11 +63,13 @@ Request::Request(RequestQueue* p_queue
   // Setting OUR identity!!
   // This is WHY we implemented HTTP.SYS in user space!
   m_request.ConnectionId = (HTTP_CONNECTION_ID)m_socket;
-  m_request.RequestId    = (HTTP_REQUEST_ID)   this;
+  m_request.RequestId    = g_requestTable.RegisterRequest(this);
 }
 
 Request::~Request()
 {
+  // Our request id is now invalid for the application
+  g_requestTable.ReleaseRequest(m_request.RequestId);
   CloseRequest();
   Reset();
 }
@@ -130,7 +134,7 @@ Request::ReceiveRequest()
       {
         LogError(_T("Illegal HTTP client call. Error: %d"), error);
         ReplyClientError();
-        delete this;
+        DropReference();
         return;
       }
     }
@@ -184,15 +188,30 @@ Request::DrainRequest()
 
   // Calculate the amount we must read from the stream to reach the next 
   // HTTP header position of the next command
-  ULONGLONG readin = m_contentLength;
+  ULONGLONG readin = 0;
   if(m_bytesRead < m_contentLength)
   {
-    readin -= m_bytesRead;
+    readin = m_contentLength - m_bytesRead;
   }
 
-  // drain the incoming request body
+  // Body part in the initial buffer can be skipped without copying
+  ULONG buffered = m_initialLength - m_bufferPosition;
+  if(readin > 0 && buffered > 0)
+  {
+    ULONG skip = (ULONG) min((ULONGLONG)buffered,readin);
+    m_bufferPosition += skip;
+    m_bytesRead      += skip;
+    readin           -= skip;
+  }
+
+  // drain the rest of the incoming request body from the socket
   if(readin > 0)
   {
+    // Authentication round trips drain before the request was handed out
+    if(m_status == RQ_CREATED)
+    {
+      m_status = RQ_READING;
+    }
     // Temporary read buffer
     unsigned char* drain_buffer = new unsigned char[MESSAGE_BUFFER_LENGTH + 1];
 
@@ -200,15 +219,12 @@ Request::DrainRequest()
     while(readin > 0)
     {
       ULONG read = 0L;
-      if(ReceiveBuffer(drain_buffer,MESSAGE_BUFFER_LENGTH,&read,false) > 0)
+      int result = ReceiveBuffer(drain_buffer,MESSAGE_BUFFER_LENGTH,&read,false);
+      if((result != NO_ERROR && result != ERROR_MORE_DATA) || read == 0)
       {
-        if(read <= readin)
-        {
-          readin -= read;
-        }
-        else readin = 0;
+        break;
       }
-      else break;
+      readin -= min((ULONGLONG)read,readin);
     }
     delete [] drain_buffer;
   }
@@ -216,6 +232,10 @@ Request::DrainRequest()
 
 // If it was a keep-alive connection, reset to receive new request
 // on the same socket channel. Remove from servicing queue first!!
+// Bytes of a pipelined next request that were already read in stay in
+// the initial buffer, so the next request is parsed without waiting for the socket.
+// As the next request is only parsed after the response of this one has been
+// completed, the responses are always sent in the order of the requests.
 bool
 Request::RestartConnection()
 {
@@ -267,6 +287,18 @@ Request::ReceiveBuffer(PVOID p_buffer,ULONG p_size,PULONG p_bytes,bool p_all)
     return ERROR_CONNECTION_INVALID;
   }
 
+  // On a keep-alive connection the body ends at the content-length
+  // Never read into a following (pipelined) request.
+  // A chunked body has no content-length: the reader finds its last chunk
+  if(m_keepAlive && !m_chunked && m_bytesRead >= m_contentLength)
+  {
+    if(p_bytes)
+    {
+      *p_bytes = 0;
+    }
+    return ERROR_HANDLE_EOF;
+  }
+
   // Initial buffer left?, so use it!
   if(m_bufferPosition < m_initialLength)
   {
@@ -280,7 +312,7 @@ Request::ReceiveBuffer(PVOID p_buffer,ULONG p_size,PULONG p_bytes,bool p_all)
     (m_bytesRead < m_contentLength) &&
     (m_contentLength - m_bytesRead) < p_size)
   {
-    p_size = (ULONG) m_contentLength;
+    p_size = (ULONG)(m_contentLength - m_bytesRead);
   }
 
   // Reading loop
@@ -435,9 +467,29 @@ Request::SendEntityChunks(PHTTP_DATA_CHUNK p_chunks,int p_count,PULONG p_bytes)
     return ERROR_CONNECTION_INVALID;
   }
 
-  for(int index = 0; index < p_count; ++index)
+  int index = 0;
+  while(index < p_count)
   {
-    int result = SendEntityChunk(&p_chunks[index],p_bytes);
+    // On plain sockets a run of memory chunks is sent in one (1) gathered send
+    int run = 0;
+    if(!m_secure)
+    {
+      while(index + run < p_count && run < HTTP_MAXIMUM_GATHER &&
+            p_chunks[index + run].DataChunkType == HttpDataChunkFromMemory)
+      {
+        ++run;
+      }
+    }
+    int result = NO_ERROR;
+    if(run > 1)
+    {
+      result = SendEntityChunksFromMemory(&p_chunks[index],run,p_bytes);
+      index += run;
+    }
+    else
+    {
+      result = SendEntityChunk(&p_chunks[index++],p_bytes);
+    }
     if (result != NO_ERROR)
     {
       return result;
@@ -457,6 +509,47 @@ Request::GetResponseComplete()
   return false;
 }
 
+// Change the queued state, only if we are still in the expected state
+// Used by the request queue to hand out or abandon us exactly once
+bool
+Request::ChangeQueued(RQ_Queued p_from,RQ_Queued p_to)
+{
+  return InterlockedCompareExchange(&m_queued,p_to,p_from) == (LONG)p_from;
+}
+
+void
+Request::AddReference()
+{
+  InterlockedIncrement(&m_references);
+}
+
+void
+Request::DropReference()
+{
+  if(InterlockedDecrement(&m_references) == 0)
+  {
+    delete this;
+  }
+}
+
+// Only succeeds if the last reference has not been dropped yet.
+// Used by the request table, where a request can be dying while we find it
+bool
+Request::AcquireReference()
+{
+  LONG references = ReadAcquire(&m_references);
+  while(references > 0)
+  {
+    LONG previous = InterlockedCompareExchange(&m_references,references + 1,references);
+    if(previous == references)
+    {
+      return true;
+    }
+    references = previous;
+  }
+  return false;
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 // PRIVATE
@@ -605,6 +698,7 @@ Request::ResetRequestV1()
   m_bytesWritten  = 0L;
   m_contentLength = 0L;
   m_keepAlive     = false;
+  m_chunked       = false;
   m_url           = nullptr;
 }
 
@@ -753,20 +847,20 @@ Request::ReceiveHeaders()
   ReadInitialMessage();
 
   // Getting the HTTP protocol line
-  LPSTR line = ReadTextLine();
-  ReceiveHTTPLine(line);
+  // Lines are owned by a unique_ptr, as parsing can throw an error status
+  std::unique_ptr<char[]> line(ReadTextLine());
+  ReceiveHTTPLine(line.get());
 
   // Reading all request headers
-  while (true)
+  while(true)
   {
-    line = ReadTextLine();
-    if(line[0])
+    line.reset(ReadTextLine());
+    if(line[0] == 0)
     {
-      ProcessHeader(line);
+      break;
     }
-    else break;
+    ProcessHeader(line.get());
   }
-  delete[] line;
 
   // Finding our site context
   FindUrlContext();
@@ -785,22 +879,54 @@ Request::ReceiveHeaders()
 }
 
 // Grab the first available message part just under the optimal buffer length
-// so we can parse off the initial headers of the message
+// so we can parse off the initial headers of the message.
+// The buffer is allocated once and reused for all requests on the connection.
+// Bytes of a pipelined request left behind by the previous request are moved
+// to the front, and the socket is only read if the headers are not yet complete.
 void
 Request::ReadInitialMessage()
 {
-  FreeInitialBuffer();
-  m_initialBuffer = (BYTE*) malloc(MESSAGE_BUFFER_LENGTH + 1);
+  if(m_initialBuffer == nullptr)
+  {
+    m_initialBuffer = (BYTE*) malloc(MESSAGE_BUFFER_LENGTH + 1);
+  }
 
-  int length = m_socket->RecvPartial(m_initialBuffer,MESSAGE_BUFFER_LENGTH);
-  if (length > 0)
+  // Carry over what is left of the previous read
+  // Clients may send an extra empty line after a body: skip it
+  ULONG position = m_bufferPosition;
+  while(position + 1 < m_initialLength && m_initialBuffer[position] == '\r' && m_initialBuffer[position + 1] == '\n')
   {
-    m_initialBuffer[length] = 0;
-    m_initialLength = length;
-    m_bytesRead    += length;
-    return;
+    position += 2;
+  }
+  ULONG leftover = (position < m_initialLength) ? m_initialLength - position : 0;
+  if(leftover && position)
+  {
+    memmove(m_initialBuffer,&m_initialBuffer[position],leftover);
+  }
+  m_initialLength  = leftover;
+  m_bufferPosition = 0;
+  m_initialBuffer[m_initialLength] = 0;
+
+  // Read until the empty line under the headers
+  ULONG searched = 0;
+  while(strstr((char*)&m_initialBuffer[searched],"\r\n\r\n") == nullptr)
+  {
+    if(m_initialLength >= MESSAGE_BUFFER_LENGTH)
+    {
+      // Headers do not fit in the buffer
+      throw ERROR_HTTP_INVALID_HEADER;
+    }
+    // Next search may start in the last partial line end
+    searched = m_initialLength > 3 ? m_initialLength - 3 : 0;
+
+    int length = m_socket->RecvPartial(&m_initialBuffer[m_initialLength],MESSAGE_BUFFER_LENGTH - m_initialLength);
+    if(length <= 0)
+    {
+      throw (int)ERROR_HANDLE_EOF;
+    }
+    m_initialLength += length;
+    m_initialBuffer[m_initialLength] = 0;
   }
-  throw (int)ERROR_HANDLE_EOF;
 }
 
 // Find the next line in the initial buffers up to the "\r\n"
@@ -960,9 +1086,19 @@ Request::FindUrlContext()
 
 // Finding the content length header
 // Also works for empty headers (converts to zero)
+// A chunked transfer-encoding overrides the content length
 void
 Request::FindContentLength()
 {
+  USES_CONVERSION;
+  CString encoding = A2T((LPSTR)m_request.Headers.KnownHeaders[HttpHeaderTransferEncoding].pRawValue);
+  m_chunked = encoding.MakeLower().Find(_T("chunked")) >= 0;
+  if(m_chunked)
+  {
+    m_request.Flags = HTTP_REQUEST_FLAG_MORE_ENTITY_BODY_EXISTS;
+    return;
+  }
+
   if(m_request.Headers.KnownHeaders[HttpHeaderContentLength].pRawValue)
   {
     m_contentLength = _atoi64(m_request.Headers.KnownHeaders[HttpHeaderContentLength].pRawValue);
@@ -1004,9 +1140,8 @@ Request::CorrectFullURL()
   }
 }
 
-// At various stages: we may now forget the initial buffer
-// In case we just read all of the body
-// or in case we reset and destroy the request.
+// Forget the initial buffer when we reset and destroy the request.
+// Between requests on a keep-alive connection the buffer is kept.
 void
 Request::FreeInitialBuffer()
 {
@@ -1335,11 +1470,16 @@ Request::ReplyServerError()
 }
 
 // Copy the part of the first initial read to this read buffer
+// Only the body of this request: the rest can be a pipelined next request
 int
 Request::CopyInitialBuffer(PVOID p_buffer,ULONG p_size,PULONG p_bytes)
 {
   // Calculate how much we have left in the buffer
   ULONG length = m_initialLength - m_bufferPosition;
+  if(m_contentLength && (m_contentLength - m_bytesRead) < length)
+  {
+    length = (ULONG)(m_contentLength - m_bytesRead);
+  }
 
   // Test if we can copy the buffer in ONE go!
   if(length > p_size)
@@ -1356,9 +1496,9 @@ Request::CopyInitialBuffer(PVOID p_buffer,ULONG p_size,PULONG p_bytes)
     return ERROR_MORE_DATA;
   }
 
-  // OK, We have enough buffer. Do it in one go, and be done with the buffer
+  // OK, We have enough buffer. Do it in one go, and be done with this part of the buffer
   memcpy_s(p_buffer,length,&m_initialBuffer[m_bufferPosition],length);
-  FreeInitialBuffer();
+  m_bufferPosition += length;
   if (p_bytes)
   {
     *p_bytes = length;
@@ -1762,6 +1902,31 @@ Request::SendEntityChunkFromMemory(PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes)
   return result;
 }
 
+// Write a series of memory chunks to the socket in one (1) gathered send
+// No copying: the socket reads directly from the buffers of the chunks
+int
+Request::SendEntityChunksFromMemory(PHTTP_DATA_CHUNK p_chunks,int p_count,PULONG p_bytes)
+{
+  WSABUF buffers[HTTP_MAXIMUM_GATHER];
+  DWORD  count = 0;
+  for(int index = 0; index < p_count && count < HTTP_MAXIMUM_GATHER; ++index)
+  {
+    if(p_chunks[index].FromMemory.BufferLength)
+    {
+      buffers[count].buf = (CHAR*)p_chunks[index].FromMemory.pBuffer;
+      buffers[count].len = p_chunks[index].FromMemory.BufferLength;
+      ++count;
+    }
+  }
+  ULONG written = 0;
+  int result = WriteGather(buffers,count,&written);
+  if (result == NO_ERROR)
+  {
+    *p_bytes += written;
+  }
+  return result;
+}
+
 // Sending one (1) file from opened file handle in the chunk to the socket
 // int
 // Request::SendEntityChunkFromFile(PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes)
@@ -1891,18 +2056,26 @@ Request::SendEntityChunkFromFile(PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes)
 }
 
 // Sending one (1) fragment from the general fragment cache
-// This is done by relaying the buffer to sending a chunk from memory.
+// The cached buffer is written directly to the socket. We hold a reference
+// to the fragment while sending, so it can be flushed in the meantime.
 int
 Request::SendEntityChunkFromFragment(PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes)
 {
   USES_CONVERSION;
   CString prefix(W2A(p_chunk->FromFragmentCache.pFragmentName));
 
-  // Find memory chunk
-  PHTTP_DATA_CHUNK chunk = m_queue->FindFragment(prefix);
-  if(chunk)
+  // Find memory fragment
+  Fragment* fragment = m_queue->FindFragment(prefix);
+  if(fragment)
   {
-    return SendEntityChunkFromMemory(chunk,p_bytes);
+    ULONG written = 0;
+    int result = WriteBuffer(fragment->GetBuffer(),fragment->GetLength(),&written);
+    if(result == NO_ERROR)
+    {
+      *p_bytes += written;
+    }
+    fragment->DropReference();
+    return result;
   }
   // Log error : Chunk not found
   LogError(_T("Data chunk [%s] not found"),prefix);
@@ -1911,86 +2084,56 @@ Request::SendEntityChunkFromFragment(PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes)
 
 // Sending one (1) fragment from the general fragment cache
 // while defining a specific part of the fragment (begin / length)
-// This is done by relaying the buffer to sending a chunk from memory.
+// The cached buffer is written directly to the socket, while holding a reference.
 int
 Request::SendEntityChunkFromFragmentEx(PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes)
 {
   USES_CONVERSION;
   CString prefix(W2A(p_chunk->FromFragmentCacheEx.pFragmentName));
 
-  // Find memory chunk
-  PHTTP_DATA_CHUNK chunk = m_queue->FindFragment(prefix);
-  if (chunk)
+  // Find memory fragment
+  Fragment* fragment = m_queue->FindFragment(prefix);
+  if(fragment)
   {
-    DWORD start = p_chunk->FromFragmentCacheEx.ByteRange.StartingOffset.LowPart;
-    DWORD end   = p_chunk->FromFragmentCacheEx.ByteRange.Length.LowPart;
+    ULONGLONG size   = fragment->GetLength();
+    ULONGLONG start  = p_chunk->FromFragmentCacheEx.ByteRange.StartingOffset.QuadPart;
+    ULONGLONG length = p_chunk->FromFragmentCacheEx.ByteRange.Length.QuadPart;
+    if(length == HTTP_BYTE_RANGE_TO_EOF && start < size)
+    {
+      length = size - start;
+    }
 
-    if(start < chunk->FromMemory.BufferLength && 
-       end   < chunk->FromMemory.BufferLength &&
-       start < end)
+    int result = ERROR_RANGE_NOT_FOUND;
+    if(start < size && length > 0 && start + length <= size)
     {
       ULONG written = 0;
-      int result = WriteBuffer((PVOID)&(((char*)chunk->FromMemory.pBuffer)[start]),end - start,&written);
-      if (result == NO_ERROR)
+      result = WriteBuffer((BYTE*)fragment->GetBuffer() + start,(ULONG)length,&written);
+      if(result == NO_ERROR)
       {
         *p_bytes += written;
       }
-      return result;
     }
-    LogError(_T("Data chunk [%s] out of range"),prefix);
-    return ERROR_RANGE_NOT_FOUND;
+    else
+    {
+      LogError(_T("Data chunk [%s] out of range"),prefix);
+    }
+    fragment->DropReference();
+    return result;
   }
   // Log error : Chunk not found
   LogError(_T("Data chunk [%s] not found"),prefix);
   return ERROR_INVALID_PARAMETER;
 }
 
-LPCTSTR weekday_short[7] =
-{
-   _T("Sun")
-  ,_T("Mon")
-  ,_T("Tue")
-  ,_T("Wed")
-  ,_T("Thu")
-  ,_T("Fri")
-  ,_T("Sat")
-};
-
-LPCTSTR month[12] =
-{
-   _T("Jan")
-  ,_T("Feb")
-  ,_T("Mar")
-  ,_T("Apr")
-  ,_T("May")
-  ,_T("Jun")
-  ,_T("Jul")
-  ,_T("Aug")
-  ,_T("Sep")
-  ,_T("Oct")
-  ,_T("Nov")
-  ,_T("Dec")
-};
-
 // Print HTTP time in RFC 1123 format (Preferred standard)
-// as in "Tue, 8 Dec 2015 21:26:32 GMT"
+// as in "Tue, 08 Dec 2015 21:26:32 GMT"
+// Rendered only once per second for all requests
 CString
 Request::HTTPSystemTime()
 {
-  CString    time;
-  SYSTEMTIME systemtime;
-  GetSystemTime(&systemtime);
-
-  time.Format(_T("%s, %02d %s %04d %2.2d:%2.2d:%2.2d GMT")
-             ,weekday_short[systemtime.wDayOfWeek]
-             ,systemtime.wDay
-             ,month[systemtime.wMonth - 1]
-             ,systemtime.wYear
-             ,systemtime.wHour
-             ,systemtime.wMinute
-             ,systemtime.wSecond);
-
-  return time;
+  TCHAR buffer[HTTPTIME_LENGTH + 1];
+  HTTPGetSystemTime(buffer);
+  return CString(buffer,HTTPTIME_LENGTH);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -2048,3 +2191,54 @@ Request::WriteBuffer(PVOID p_buffer,ULONG p_size,PULONG p_bytes)
 
   return NO_ERROR;;
 }
+
+// Low level gathered write to a plain socket
+// Continues after a partial send until all buffers are written
+int
+Request::WriteGather(LPWSABUF p_buffers,DWORD p_count,PULONG p_bytes)
+{
+  PlainSocket* sock = reinterpret_cast<PlainSocket*>(m_socket);
+
+  while(p_count > 0)
+  {
+    int result = sock->SendGather(p_buffers,p_count);
+    if (result == SOCKET_ERROR)
+    {
+      // Log the error
+      int error = WSAGetLastError();
+      LogError(_T("Writing to connection: %s Error: %d"), m_request.pRawUrl,error);
+      return error;
+    }
+    if (result == 0)
+    {
+      // Connection closed, no chance of sending more
+      break;
+    }
+
+    // Keep track of bytes written
+    m_bytesWritten += result;
+    *p_bytes       += result;
+
+    // Skip the buffers that were sent, and the sent part of a partial buffer
+    ULONG sent = (ULONG)result;
+    while(p_count > 0 && sent >= p_buffers->len)
+    {
+      sent -= p_buffers->len;
+      ++p_buffers;
+      --p_count;
+    }
+    if(p_count > 0)
+    {
+      p_buffers->buf += sent;
+      p_buffers->len -= sent;
+    }
+  }
+
+  // Keep track of service status
+  // Does **not** happen for RQ_OPAQUE mode!!
+  if((m_status == RQ_WRITING) && m_contentLength && m_bytesWritten >= m_contentLength)
+  {
+    m_status = RQ_SERVICED;
+  }
+  return NO_ERROR;
+}
@@ -10,6 +10,7 @@
 #pragma once
 #define SECURITY_WIN32
 #include <sspi.h>
+#include "RequestTable.h"
 
 // Test to see if it is still a request object
 #define HTTP_REQUEST_IDENT 0x00EDED0000EDED00
@@ -20,6 +21,8 @@
 #define HTTP_MINIMUM_TIMEOUT 10 
 // Default space for a SSPI authentication provider buffer
 #define SSPI_BUFFER_DEFAULT (8*1024)
+// Maximum number of memory chunks gathered into one (1) socket send
+#define HTTP_MAXIMUM_GATHER 64
 
 typedef enum _rq_status
 {
@@ -33,6 +36,16 @@ typedef enum _rq_status
 }
 RQ_Status;
 
+// Where the request resides in the RequestQueue
+typedef enum _rq_queued
+{
+  RQ_NOTQUEUED  // Not (or no longer) in the request queue
+ ,RQ_INCOMING   // In the incoming queue, waiting for the application
+ ,RQ_SERVICING  // Handed out to the application
+ ,RQ_ABANDONED  // Removed while still incoming. The queue will delete it
+}
+RQ_Queued;
+
 class RequestQueue;
 class Listener;
 class SocketStream;
@@ -50,10 +63,13 @@ public:
   void              SetStatus(RQ_Status p_status)             { m_status = p_status; };
   void              SetURLContext(HTTP_URL_CONTEXT p_context) { m_request.UrlContext    = p_context; };
   void              SetBytesRead(ULONG p_bytes)               { m_request.BytesReceived = p_bytes;   };
+  void              SetQueued(RQ_Queued p_queued)             { InterlockedExchange(&m_queued,p_queued); };
 
   // GETTERS
   ULONGLONG         GetIdent()          { return m_ident;               };
   RQ_Status         GetStatus()         { return m_status;              };
+  RQ_Queued         GetQueued()         { return (RQ_Queued)m_queued;   };
+  RequestQueue*     GetRequestQueue()   { return m_queue;               };
   SocketStream*     GetSocket()         { return m_socket;              };
   ULONG             GetBytes()          { return m_bytesRead;           };
   PHTTP_REQUEST_V2  GetV2Request()      { return &m_request;            };
@@ -63,6 +79,14 @@ public:
   Listener*         GetListener()       { return m_listener;            };
   HANDLE            GetAccessToken()    { return m_token;               };
   bool              GetResponseComplete();
+  // Change the queued state, only if we are still in the expected state
+  bool              ChangeQueued(RQ_Queued p_from,RQ_Queued p_to);
+
+  // Reference counting. The request queue holds the first reference
+  void              AddReference();
+  void              DropReference();
+  // Take a reference, only if the request is still alive
+  bool              AcquireReference();
 
   // FUNCTIONS
   void              ReceiveRequest();
@@ -128,6 +152,7 @@ private:
   void              AddAllUnknownResponseHeaders(CString& p_buffer,PHTTP_UNKNOWN_HEADER p_headers,int p_count);
   int               SendEntityChunk              (PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes);
   int               SendEntityChunkFromMemory    (PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes);
+  int               SendEntityChunksFromMemory   (PHTTP_DATA_CHUNK p_chunks,int p_count,PULONG p_bytes);
   int               SendEntityChunkFromFile      (PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes);
   int               SendEntityChunkFromFragment  (PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes);
   int               SendEntityChunkFromFragmentEx(PHTTP_DATA_CHUNK p_chunk,PULONG p_bytes);
@@ -138,6 +163,7 @@ private:
   // Reading and writing
   int               ReadBuffer (PVOID p_buffer,ULONG p_size,PULONG p_bytes);
   int               WriteBuffer(PVOID p_buffer,ULONG p_size,PULONG p_bytes);
+  int               WriteGather(LPWSABUF p_buffers,DWORD p_count,PULONG p_bytes);
 
   // Identification of the request 
   ULONGLONG         m_ident{ HTTP_REQUEST_IDENT };
@@ -147,6 +173,8 @@ private:
   // Request data
   HTTP_REQUEST_V2   m_request;        // Standard HTTP driver structure
   RQ_Status         m_status;         // Current status of the request (by our driver)
+  volatile LONG     m_queued { RQ_NOTQUEUED }; // Where we reside in the request queue
+  volatile LONG     m_references { 1 };        // The request queue is the first reference
   bool              m_secure;         // HTTPS (secure) or not (HTTP)
   bool              m_handshakeDone;  // HTTPS initial handshake done for socket
   ULONG             m_bytesRead;      // Total number of bytes read so far
@@ -155,6 +183,7 @@ private:
   USHORT            m_port;           // Port the request came from
   ULONGLONG         m_contentLength;  // Content length to be read or write
   bool              m_keepAlive;      // Keep connection alive
+  bool              m_chunked { false }; // Body in chunked transfer-encoding
   URL*              m_url;            // URL with longest matching absolute path
   // SSPI authentication handlers
   CString           m_challenge;      // Authentication challenge
@@ -162,25 +191,25 @@ private:
   clock_t           m_timestamp;      // Time of the authentication
   HANDLE            m_token;          // Primary authentication token
   // Initial buffer (Header and optional first body part) are cached here
+  // Kept for the lifetime of the connection. May hold a pipelined next request
   BYTE*             m_initialBuffer { 0 };
   ULONG             m_initialLength { 0 };
   ULONG             m_bufferPosition{ 0 };
 };
 
+// Caller must drop the reference to the request after use
 inline Request*
 GetRequestFromHandle(HTTP_REQUEST_ID p_handle)
 {
-  try
+  // Request id's are handles in the table of living requests
+  Request* request = g_requestTable.FindRequest(p_handle);
+  if(request)
   {
-    Request* request = reinterpret_cast<Request*>(p_handle);
-    if(request && request->GetIdent() == HTTP_REQUEST_IDENT)
+    if(request->GetIdent() == HTTP_REQUEST_IDENT)
     {
       return request;
     }
-  }
-  catch(...)
-  {
-    // Error in application: Not a Request handle
+    request->DropReference();
   }
   return nullptr;
 }
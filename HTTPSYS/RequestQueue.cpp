@@ -12,10 +12,10 @@
 #include "URL.h"
 #include "RequestQueue.h"
 #include "UrlGroup.h"
+#include "ServerSession.h"
 #include <malloc.h>
 #include <algorithm>
 #include <winhttp.h>
-#include <algorithm>
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -31,15 +31,21 @@ RequestQueue::RequestQueue(CString p_name)
 {
   m_name = p_name;
   InitializeCriticalSection(&m_lock);
-  CreateEvent();
+  CreateShards();
+  CreateWaitObjects();
+  if(g_session)
+  {
+    m_fragments.SetBudget((ULONGLONG)g_session->GetMaxCacheMegabytes() * 1024 * 1024);
+  }
 }
 
 RequestQueue::~RequestQueue()
 {
   StopAllListeners();
-  DeleteAllFragments();
+  m_fragments.DeleteAllFragments();
+  DeleteShards();
   DeleteCriticalSection(&m_lock);
-  CloseEvent();
+  CloseWaitObjects();
   CloseQueueHandle();
 }
 
@@ -197,11 +203,10 @@ RequestQueue::FindListener(USHORT p_port)
 }
 
 // Add a new request to the incoming queue
+// No lock is taken: the request goes into the shard of the current CPU
 void
 RequestQueue::AddIncomingRequest(Request* p_request)
 {
-  AutoCritSec lock(&m_lock);
-
   if(m_state == HttpEnabledStateInactive)
   {
     // TODO: Report inactive server receiving calls
@@ -211,33 +216,40 @@ RequestQueue::AddIncomingRequest(Request* p_request)
   // Headers now fully received
   p_request->SetStatus(RQ_RECEIVED);
 
-  // See if there is space in the queue
-  if(m_incoming.size() < m_queueLength)
-  {
-    m_incoming.push_back(p_request);
-    // Wake up waiters for the request queue
-    SetEvent(m_event);
-  }
-  else
+  // See if there is space in the queue (or the driver is out of request id's)
+  if(p_request->GetV2Request()->RequestId == 0 ||
+     InterlockedIncrement(&m_queued) > (LONG)m_queueLength)
   {
+    InterlockedDecrement(&m_queued);
     // Report queue overflow = Server overflow
     throw HTTP_STATUS_SERVICE_UNAVAIL;
   }
+  p_request->SetQueued(RQ_INCOMING);
+
+  // Start at the shard of our CPU. Only if that one is full try the others
+  ULONG shards = (ULONG)m_shards.size();
+  ULONG first  = GetCurrentProcessorNumber() % shards;
+  for(ULONG index = 0; index < shards; ++index)
+  {
+    if(m_shards[(first + index) % shards]->Push(p_request))
+    {
+      // Wake up exactly one waiter for the request queue
+      SignalRequests(1);
+      return;
+    }
+  }
+
+  // All shards full: Report queue overflow = Server overflow
+  p_request->SetQueued(RQ_NOTQUEUED);
+  InterlockedDecrement(&m_queued);
+  throw HTTP_STATUS_SERVICE_UNAVAIL;
 }
 
-// Put the request back in the servicing queue
+// Take the request out of service, so it can be queued again
 bool
 RequestQueue::ResetToServicing(Request* p_request)
 {
-  AutoCritSec lock(&m_lock);
-
-  Requests::iterator it = std::find(m_servicing.begin(),m_servicing.end(),p_request);
-  if(it != m_servicing.end())
-  {
-    m_servicing.erase(it);
-    return true;
-  }
-  return false;
+  return p_request->ChangeQueued(RQ_SERVICING,RQ_NOTQUEUED);
 }
 
 // Our workhorse. Implementations call this to get the next HTTP request
@@ -254,26 +266,29 @@ RequestQueue::GetNextRequest(HTTP_REQUEST_ID  RequestId
   if(RequestId == 0)
   {
     // Get a new request from the incoming queue
-    AutoCritSec lock(&m_lock);
-
-    if(m_incoming.empty())
+    while(request == nullptr)
     {
-      lock.Unlock();
-      // Wait for event of incoming request
-      DWORD result = WaitForSingleObject(m_event,INFINITE);
-      lock.Relock();
+      // Wait until a request is available for this thread
+      if(!WaitForRequest())
+      {
+        return ERROR_HANDLE_EOF;
+      }
+      request = PopIncoming();
 
-      // Still no request in the queue, or event interrupted
-      if(m_incoming.empty() || result == WAIT_ABANDONED || result == WAIT_FAILED)
+      // No request in the queue: we were woken up to stop
+      if(request == nullptr)
       {
         return ERROR_HANDLE_EOF;
       }
+      // Move request to servicing, unless it was removed while incoming
+      if(!request->ChangeQueued(RQ_INCOMING,RQ_SERVICING))
+      {
+        request->DropReference();
+        request = nullptr;
+      }
     }
-
-    // Move request to servicing queue
-    request = m_incoming.front();
-    m_incoming.pop_front();
-    m_servicing.push_back(request);
+    // Same as the restart below: hold our own reference while we copy it
+    request->AddReference();
     request->SetStatus(RQ_READING);
 
     // BitBlitting our request!
@@ -312,7 +327,12 @@ RequestQueue::GetNextRequest(HTTP_REQUEST_ID  RequestId
       return ERROR_INVALID_PARAMETER;
     }
     // This is our request. Flags will be set!
-    request = reinterpret_cast<Request*>(RequestId);
+    // We now hold a reference to the request
+    request = GetRequestFromHandle(RequestId);
+    if(request == nullptr)
+    {
+      return ERROR_CONNECTION_INVALID;
+    }
   }
 
   // Reading chunks
@@ -343,6 +363,7 @@ RequestQueue::GetNextRequest(HTTP_REQUEST_ID  RequestId
   {
     *Bytes = request->GetBytes();
   }
+  request->DropReference();
   return result;
 }
 
@@ -377,75 +398,41 @@ RequestQueue::FindLongestURL(USHORT p_port,CString p_abspath)
 void
 RequestQueue::RemoveRequest(Request* p_request)
 {
-  AutoCritSec lock(&m_lock);
-
-  // Close socket of the request
-  p_request->CloseRequest();
-
-  // After servicing find the request in the servicing queue
-  Requests::iterator it = std::find(m_servicing.begin(),m_servicing.end(),p_request);
-  if(it != m_servicing.end())
+  // Only one thread can take a request out of service.
+  // A cancel and a completing response may race for it.
+  if(p_request->GetQueued() == RQ_SERVICING &&
+    !p_request->ChangeQueued(RQ_SERVICING,RQ_NOTQUEUED))
   {
-    delete p_request;
-    m_servicing.erase(it);
     return;
   }
 
-  // Just to be sure, also look in the incoming queue
-  it = std::find(m_incoming.begin(),m_incoming.end(),p_request);
-  if(it != m_incoming.end())
+  // Close socket of the request
+  p_request->CloseRequest();
+
+  // Still in the incoming queue: the thread that pops it will delete it
+  if(p_request->ChangeQueued(RQ_INCOMING,RQ_ABANDONED))
   {
-    delete p_request;
-    m_incoming.erase(it);
     return;
   }
 
-  // Request was not found in any queue
-  // Delete it all the while
-  delete p_request;
+  // Drop the reference of the queue. The request is deleted as soon as
+  // the callers that found it by its request id are done with it.
+  p_request->DropReference();
 }
 
 // Add a fragment to the fragment cache
 ULONG
-RequestQueue::AddFragment(CString p_prefix, PHTTP_DATA_CHUNK p_chunk)
+RequestQueue::AddFragment(CString p_prefix,PHTTP_DATA_CHUNK p_chunk,PHTTP_CACHE_POLICY p_policy)
 {
-  AutoCritSec lock(&m_lock);
-
-  p_prefix.MakeLower();
-  Fragments::iterator it = m_fragments.find(p_prefix);
-  if(it != m_fragments.end())
-  {
-    // Make a copy of the memory data chunk
-    PHTTP_DATA_CHUNK chunk = (PHTTP_DATA_CHUNK) calloc(1,sizeof(HTTP_DATA_CHUNK));
-    chunk->DataChunkType = HttpDataChunkFromMemory;
-    ULONG length = p_chunk->FromMemory.BufferLength;
-    chunk->FromMemory.BufferLength =   length;
-    chunk->FromMemory.pBuffer = malloc(length + 1);
-    memcpy (chunk->FromMemory.pBuffer,p_chunk->FromMemory.pBuffer,length);
-    ((char*)chunk->FromMemory.pBuffer)[length] = 0;
-
-    // Add the copied chunk into the cache
-    m_fragments.insert(std::make_pair(p_prefix,chunk));
-    return NO_ERROR;
-  }
-  // Duplicate fragment
-  return ERROR_DUPLICATE_TAG;
+  return m_fragments.AddFragment(p_prefix,p_chunk,p_policy);
 }
 
 // Finding a fragment in the fragment cache
-PHTTP_DATA_CHUNK
+// Caller must drop the reference to the fragment after use
+Fragment*
 RequestQueue::FindFragment(CString p_prefix)
 {
-  AutoCritSec lock(&m_lock);
-
-  p_prefix.MakeLower();
-  Fragments::iterator it = m_fragments.find(p_prefix);
-  if(it != m_fragments.end())
-  {
-    return it->second;
-  }
-  // Fragment not found
-  return nullptr;
+  return m_fragments.FindFragment(p_prefix);
 }
 
 // Flush (remove) a fragment from the cache
@@ -453,45 +440,14 @@ RequestQueue::FindFragment(CString p_prefix)
 ULONG
 RequestQueue::FlushFragment(CString p_prefix,ULONG Flags)
 {
-  AutoCritSec lock(&m_lock);
-
-  int erased = 0;
-  p_prefix.MakeLower();
-
-  // Try to erase exactly this prefix from the cache
-  Fragments::iterator it = m_fragments.find(p_prefix);
-  if(it != m_fragments.end())
-  {
-    PHTTP_DATA_CHUNK chunk = it->second;
-    free(chunk->FromMemory.pBuffer);
-    free(chunk);
-    m_fragments.erase(it);
-    ++erased;
-  }
-
-  // Also find fragments that are descendants of the prefix given
-  if(Flags == HTTP_FLUSH_RESPONSE_FLAG_RECURSIVE)
-  {
-    Fragments::iterator fr = m_fragments.begin();
-    while(fr != m_fragments.end())
-    {
-      if(p_prefix.Compare(fr->first.Left(p_prefix.GetLength())) == 0)
-      {
-        PHTTP_DATA_CHUNK chunk = fr->second;
-        free(chunk->FromMemory.pBuffer);
-        free(chunk);
-        fr = m_fragments.erase(fr);
-        ++erased;
-      }
-      else
-      {
-        ++fr;
-      }
-    }
-  }
+  return m_fragments.FlushFragment(p_prefix,Flags == HTTP_FLUSH_RESPONSE_FLAG_RECURSIVE);
+}
 
-  // Return flushed or no fragments found
-  return erased > 0 ? NO_ERROR : ERROR_NOT_FOUND;
+// Hits, misses, evictions and size of the fragment cache
+void
+RequestQueue::GetFragmentStatistics(FragmentStatistics& p_statistics)
+{
+  m_fragments.GetStatistics(p_statistics);
 }
 
 // Return the 'TransmitFile' function for a socket
@@ -521,23 +477,27 @@ RequestQueue::GetTransmitFile(SOCKET p_socket)
   return m_transmitFile;
 }
 
-// Signal all listeners to stop listening
+// Signal all waiting threads to stop waiting for requests
 void
 RequestQueue::ClearIncomingWaiters()
 {
-  SetEvent(m_event);
+  LONG waiting = -ReadAcquire(&m_available);
+  if(waiting > 0)
+  {
+    // Each of these wakeups will find no request and return
+    InterlockedExchangeAdd(&m_wakeups,waiting);
+    SignalRequests(waiting);
+  }
   Sleep(50);
 }
 
-// Find out if a request is still in the servicing queue
+// Find out if a request is still in service of the application
 // so we know whether still to destroy it.
 bool
 RequestQueue::RequestStillInService(Request* p_request)
 {
-  AutoCritSec lock(&m_lock);
-
-  Requests::iterator it = std::find(m_servicing.begin(),m_servicing.end(),p_request);
-  return it != m_servicing.end();
+  return p_request->GetRequestQueue() == this &&
+         p_request->GetQueued() == RQ_SERVICING;
 }
 
 // Demand start
@@ -599,53 +559,153 @@ RequestQueue::NumberOfPorts(USHORT p_port)
   return total;
 }
 
-// Creating a stop event
+// Creating the incoming shards. One per CPU, but not more than the maximum.
+// Each shard can hold the maximum queue length divided over the shards, so that
+// the queue length can be changed at any time without resizing the shards.
 void
-RequestQueue::CreateEvent()
+RequestQueue::CreateShards()
 {
-  if(m_event == 0L)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+
+  ULONG shards = info.dwNumberOfProcessors;
+  if(shards < 1)
+  {
+    shards = 1;
+  }
+  if(shards > HTTP_QUEUE_SHARDS_MAXIMUM)
   {
-    m_event = ::CreateEvent(nullptr,FALSE,FALSE,nullptr);
+    shards = HTTP_QUEUE_SHARDS_MAXIMUM;
+  }
+  ULONG capacity = HTTP_REQUEST_QUEUE_MAXIMUM / shards;
+  if(capacity < HTTP_QUEUE_SHARD_MINIMUM)
+  {
+    capacity = HTTP_QUEUE_SHARD_MINIMUM;
+  }
+  for(ULONG index = 0; index < shards; ++index)
+  {
+    m_shards.push_back(new RequestShard(capacity));
   }
 }
 
-// Closing the event, freeing the kernel resources
+// Delete the shards and the requests that were never serviced
 void
-RequestQueue::CloseEvent()
+RequestQueue::DeleteShards()
 {
-  if(m_event)
+  for(auto& shard : m_shards)
   {
-    CloseHandle(m_event);
-    m_event = NULL;
+    Request* request = nullptr;
+    while((request = shard->Pop()) != nullptr)
+    {
+      request->DropReference();
+    }
+    delete shard;
   }
-  if(m_start)
+  m_shards.clear();
+  m_queued = 0;
+}
+
+// Take the first request from any shard, starting at the shard of our CPU
+Request*
+RequestQueue::PopIncoming()
+{
+  ULONG shards = (ULONG)m_shards.size();
+  while(true)
   {
-    CloseHandle(m_start);
-    m_start = NULL;
+    ULONG first = GetCurrentProcessorNumber() % shards;
+    for(ULONG index = 0; index < shards; ++index)
+    {
+      Request* request = m_shards[(first + index) % shards]->Pop();
+      if(request)
+      {
+        InterlockedDecrement(&m_queued);
+        return request;
+      }
+    }
+    // No request: see if we were woken up to stop waiting
+    LONG wakeups = ReadAcquire(&m_wakeups);
+    while(wakeups > 0)
+    {
+      if(InterlockedCompareExchange(&m_wakeups,wakeups - 1,wakeups) == wakeups)
+      {
+        return nullptr;
+      }
+      wakeups = ReadAcquire(&m_wakeups);
+    }
+    // Our request is claimed in a shard, but not yet filled by the producer
+    YieldProcessor();
+  }
+}
+
+// Wait for a request to become available for this thread
+// Every request that is added to the queue releases exactly one thread.
+// Only if no request is available, the thread goes to sleep in the kernel
+bool
+RequestQueue::WaitForRequest()
+{
+  // Spin shortly: a request might come in very soon
+  for(int spin = 0; spin < HTTP_QUEUE_SPINCOUNT; ++spin)
+  {
+    LONG available = ReadAcquire(&m_available);
+    if(available > 0 && InterlockedCompareExchange(&m_available,available - 1,available) == available)
+    {
+      return true;
+    }
+    YieldProcessor();
   }
+  // Claim a request, or register ourselves as waiting
+  if(InterlockedDecrement(&m_available) >= 0)
+  {
+    return true;
+  }
+  DWORD result = WaitForSingleObject(m_waiting,INFINITE);
+  return result == WAIT_OBJECT_0;
 }
 
+// Make requests available. Wake up as many waiting threads
 void
-RequestQueue::CloseQueueHandle()
+RequestQueue::SignalRequests(LONG p_count)
 {
-  if(m_handle)
+  LONG before  = InterlockedExchangeAdd(&m_available,p_count);
+  LONG waiting = before < 0 ? min(-before,p_count) : 0;
+  if(waiting > 0)
   {
-    CloseHandle(m_handle);
-    m_handle = nullptr;
+    ReleaseSemaphore(m_waiting,waiting,nullptr);
   }
 }
 
-// Directly remove all fragments from the fragment cache
+// Creating the semaphore for the waiting threads
 void
-RequestQueue::DeleteAllFragments()
+RequestQueue::CreateWaitObjects()
 {
-  AutoCritSec lock(&m_lock);
+  if(m_waiting == NULL)
+  {
+    m_waiting = ::CreateSemaphore(nullptr,0,LONG_MAX,nullptr);
+  }
+}
+
+// Closing the wait objects, freeing the kernel resources
+void
+RequestQueue::CloseWaitObjects()
+{
+  if(m_waiting)
+  {
+    CloseHandle(m_waiting);
+    m_waiting = NULL;
+  }
+  if(m_start)
+  {
+    CloseHandle(m_start);
+    m_start = NULL;
+  }
+}
 
-  for(auto& frag : m_fragments)
+void
+RequestQueue::CloseQueueHandle()
+{
+  if(m_handle)
   {
-    PHTTP_DATA_CHUNK chunk = frag.second;
-    free(chunk->FromMemory.pBuffer);
-    free(chunk);
+    CloseHandle(m_handle);
+    m_handle = nullptr;
   }
-  m_fragments.clear();
 }
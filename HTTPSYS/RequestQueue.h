@@ -11,9 +11,10 @@
 #include "URL.h"
 #include "Listener.h"
 #include "Request.h"
+#include "RequestShard.h"
+#include "FragmentCache.h"
 #include <mswsock.h>
 #include <vector>
-#include <deque>
 #include <map>
 
 #define HTTP_QUEUE_IDENT 0xEDED0000EDED0000
@@ -22,12 +23,15 @@
 #define HTTP_REQUEST_QUEUE_DEFAULT    400   // Twice the standard WinSock backlog
 #define HTTP_REQUEST_QUEUE_MAXIMUM  64000   // Seriously overloaded server?
 
+#define HTTP_QUEUE_SHARDS_MAXIMUM      16   // Incoming queue is sharded per CPU, up to this many shards
+#define HTTP_QUEUE_SHARD_MINIMUM       64   // Minimal capacity of one shard
+#define HTTP_QUEUE_SPINCOUNT          200   // Spinning for a request before going to sleep
+
 class UrlGroup;
 
 using UrlGroups = std::vector<UrlGroup*>;
 using Listeners = std::map<USHORT,Listener*>;
-using Requests  = std::deque<Request*>;
-using Fragments = std::map<CString,PHTTP_DATA_CHUNK>;
+using Shards    = std::vector<RequestShard*>;
 
 typedef BOOL (* PointTransmitFile)(SOCKET hSocket,
                                    HANDLE hFile,
@@ -49,6 +53,8 @@ public:
   CString                     GetName()         { return m_name;        };
   HTTP_503_RESPONSE_VERBOSITY GetVerbosity()    { return m_verbosity;   };
   ULONG                       GetQueueLength()  { return m_queueLength; };
+  ULONG                       GetQueued()       { return m_queued;      };
+  ULONG                       GetShards()       { return (ULONG)m_shards.size(); };
   HTTP_ENABLED_STATE          GetEnabledState() { return m_state;       };
 
   // SETTERS
@@ -79,18 +85,23 @@ public:
   ULONG     GetNextRequest(HTTP_REQUEST_ID RequestId,ULONG Flags,PHTTP_REQUEST RequestBuffer,ULONG RequestBufferLength,PULONG Bytes);
 
   // The fragment cache
-  ULONG             AddFragment  (CString p_prefix,PHTTP_DATA_CHUNK p_chunk);
+  ULONG             AddFragment  (CString p_prefix,PHTTP_DATA_CHUNK p_chunk,PHTTP_CACHE_POLICY p_policy);
   ULONG             FlushFragment(CString p_prefix,ULONG Flags);
-  PHTTP_DATA_CHUNK  FindFragment (CString p_prefix);
+  Fragment*         FindFragment (CString p_prefix);
+  void              GetFragmentStatistics(FragmentStatistics& p_statistics);
 
   PointTransmitFile GetTransmitFile(SOCKET p_socket);
 
 private:
   void        StopAllListeners();
   ULONG       NumberOfPorts(USHORT p_port);
-  void        DeleteAllFragments();
-  void        CreateEvent();
-  void        CloseEvent();
+  void        CreateShards();
+  void        DeleteShards();
+  Request*    PopIncoming();
+  bool        WaitForRequest();
+  void        SignalRequests(LONG p_count);
+  void        CreateWaitObjects();
+  void        CloseWaitObjects();
   void        CloseQueueHandle();
 
   // Identification of the request queue
@@ -105,17 +116,20 @@ private:
   UrlGroups                   m_groups;
   // All listeners
   Listeners                   m_listeners;
-  // All requests from HTTP. Our 'real' queues
-  Requests                    m_incoming;       // Incoming (unserviced) requests
-  Requests                    m_servicing;      // Currently serviced by server
-  // The fragment cache
-  Fragments                   m_fragments;
+  // All incoming (unserviced) requests from HTTP. Our 'real' queue.
+  // Requests in service are marked in the request itself (RQ_SERVICING)
+  Shards                      m_shards;            // Incoming queue, sharded per CPU
+  volatile LONG               m_queued    { 0 };   // Number of requests in all shards
+  volatile LONG               m_available { 0 };   // Requests available. Negative = waiting threads
+  volatile LONG               m_wakeups   { 0 };   // Waiters woken without a request
+  // The fragment cache. Has its own locking
+  FragmentCache               m_fragments;
 
   PointTransmitFile           m_transmitFile { nullptr };
   // Synchronization
-  HANDLE                      m_start { NULL }; // Demand start event
-  CRITICAL_SECTION            m_lock;           // Queue synchronization
-  HANDLE                      m_event { 0L };   // Queue waiting event
+  HANDLE                      m_start   { NULL };  // Demand start event
+  CRITICAL_SECTION            m_lock;              // Groups and listeners
+  HANDLE                      m_waiting { NULL };  // Semaphore for threads waiting on a request
 };
 
 // All request queues are held globally
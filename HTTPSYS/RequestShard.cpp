@@ -0,0 +1,123 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// USER-SPACE IMPLEMENTTION OF HTTP.SYS
+//
+// 2018 (c) ir. W.E. Huisman
+// License: MIT
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "RequestShard.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// CTOR: Capacity will be rounded up to a power of 2
+RequestShard::RequestShard(ULONG p_capacity)
+{
+  ULONG capacity = 2;
+  while(capacity < p_capacity)
+  {
+    capacity <<= 1;
+  }
+  m_mask  = capacity - 1;
+  m_cells = new Cell[capacity];
+
+  for(ULONG index = 0; index < capacity; ++index)
+  {
+    m_cells[index].m_sequence = index;
+    m_cells[index].m_request  = nullptr;
+  }
+}
+
+RequestShard::~RequestShard()
+{
+  delete [] m_cells;
+}
+
+// Add a request at the back of the shard
+bool
+RequestShard::Push(Request* p_request)
+{
+  Cell*  cell = nullptr;
+  LONG64 position = ReadNoFence64(&m_enqueue);
+
+  while(true)
+  {
+    cell = &m_cells[position & m_mask];
+    LONG64 sequence = ReadAcquire64(&cell->m_sequence);
+    LONG64 diff     = sequence - position;
+
+    if(diff == 0)
+    {
+      // Cell is free for this position: try to claim it
+      LONG64 found = InterlockedCompareExchange64(&m_enqueue,position + 1,position);
+      if(found == position)
+      {
+        break;
+      }
+      position = found;
+    }
+    else if(diff < 0)
+    {
+      // Consumers did not yet free this cell: shard is full
+      return false;
+    }
+    else
+    {
+      // Another producer was here first
+      position = ReadNoFence64(&m_enqueue);
+    }
+  }
+
+  // Publish the request to the consumers
+  cell->m_request = p_request;
+  WriteRelease64(&cell->m_sequence,position + 1);
+  return true;
+}
+
+// Take a request from the front of the shard
+Request*
+RequestShard::Pop()
+{
+  Cell*  cell = nullptr;
+  LONG64 position = ReadNoFence64(&m_dequeue);
+
+  while(true)
+  {
+    cell = &m_cells[position & m_mask];
+    LONG64 sequence = ReadAcquire64(&cell->m_sequence);
+    LONG64 diff     = sequence - (position + 1);
+
+    if(diff == 0)
+    {
+      // Cell is filled for this position: try to claim it
+      LONG64 found = InterlockedCompareExchange64(&m_dequeue,position + 1,position);
+      if(found == position)
+      {
+        break;
+      }
+      position = found;
+    }
+    else if(diff < 0)
+    {
+      // Producer did not (yet) fill this cell: shard is empty
+      return nullptr;
+    }
+    else
+    {
+      // Another consumer was here first
+      position = ReadNoFence64(&m_dequeue);
+    }
+  }
+
+  // Free the cell for the producer one round further
+  Request* request = cell->m_request;
+  cell->m_request  = nullptr;
+  WriteRelease64(&cell->m_sequence,position + m_mask + 1);
+  return request;
+}
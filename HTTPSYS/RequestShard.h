@@ -0,0 +1,51 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// USER-SPACE IMPLEMENTTION OF HTTP.SYS
+//
+// 2018 (c) ir. W.E. Huisman
+// License: MIT
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+class Request;
+
+// Size of a cache line. Positions are kept apart to prevent false sharing
+#define SHARD_CACHE_LINE  64
+
+// One shard of the incoming queue of a RequestQueue.
+// Bounded multi-producer/multi-consumer ring of requests.
+// Every cell carries a sequence number that tells whether the cell is free
+// for the producer at this position, or filled for the consumer at this position.
+// Producers and consumers only compete with a compare-exchange on their own position.
+//
+class RequestShard
+{
+public:
+  explicit RequestShard(ULONG p_capacity);
+ ~RequestShard();
+
+  // Add a request at the back. False if the shard is full
+  bool      Push(Request* p_request);
+  // Take a request from the front. nullptr if the shard is empty
+  Request*  Pop();
+
+  ULONG     GetCapacity() { return m_mask + 1; };
+
+private:
+  typedef struct _cell
+  {
+    volatile LONG64 m_sequence;
+    Request*        m_request;
+  }
+  Cell;
+
+  Cell*           m_cells { nullptr };
+  ULONG           m_mask  { 0 };
+  char            m_pad1[SHARD_CACHE_LINE];
+  volatile LONG64 m_enqueue { 0 };      // Next position to write to
+  char            m_pad2[SHARD_CACHE_LINE];
+  volatile LONG64 m_dequeue { 0 };      // Next position to read from
+  char            m_pad3[SHARD_CACHE_LINE];
+};
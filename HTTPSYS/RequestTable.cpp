@@ -0,0 +1,178 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// USER-SPACE IMPLEMENTTION OF HTTP.SYS
+//
+// 2018 (c) ir. W.E. Huisman
+// License: MIT
+//
+//////////////////////////////////////////////////////////////////////////
+
+#include "stdafx.h"
+#include "http_private.h"
+#include "RequestTable.h"
+#include "Request.h"
+#include <malloc.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// All requests of the driver
+RequestTable g_requestTable;
+
+// CTOR
+RequestTable::RequestTable()
+{
+  InitializeSListHead(&m_free);
+  InitializeCriticalSection(&m_lock);
+  ZeroMemory(m_pages,sizeof(m_pages));
+}
+
+RequestTable::~RequestTable()
+{
+  InterlockedFlushSList(&m_free);
+  for(LONG page = 0; page < m_numPages; ++page)
+  {
+    _aligned_free(m_pages[page]);
+  }
+  DeleteCriticalSection(&m_lock);
+}
+
+// Register a new request and get its request id
+HTTP_REQUEST_ID
+RequestTable::RegisterRequest(Request* p_request)
+{
+  PSLIST_ENTRY entry = InterlockedPopEntrySList(&m_free);
+  while(entry == nullptr)
+  {
+    if(!AddPage())
+    {
+      // Table is full. Seriously overloaded server?
+      return 0;
+    }
+    entry = InterlockedPopEntrySList(&m_free);
+  }
+
+  Slot* slot = CONTAINING_RECORD(entry,Slot,m_entry);
+  InterlockedExchangePointer((PVOID volatile*)&slot->m_request,p_request);
+
+  return ((HTTP_REQUEST_ID)(ULONG)slot->m_generation << 32) | ((HTTP_REQUEST_ID)slot->m_index + 1);
+}
+
+// Find the request of a request id
+Request*
+RequestTable::FindRequest(HTTP_REQUEST_ID p_handle)
+{
+  Request* found = nullptr;
+  Slot* slot = FindSlot(p_handle);
+  if(slot)
+  {
+    // Pin the slot: a releasing request waits for us before it is gone
+    InterlockedIncrement(&slot->m_pins);
+
+    Request* request = slot->m_request;
+    // Generation must still be the same after pinning and reading the request
+    if(request && (ULONG)ReadAcquire(&slot->m_generation) == (ULONG)(p_handle >> 32))
+    {
+      if(request->AcquireReference())
+      {
+        found = request;
+      }
+    }
+    InterlockedDecrement(&slot->m_pins);
+  }
+  return found;
+}
+
+// Forget about a request: the next generation of the slot becomes free
+void
+RequestTable::ReleaseRequest(HTTP_REQUEST_ID p_handle)
+{
+  Slot* slot = FindSlot(p_handle);
+  if(slot)
+  {
+    // Generation 0 is never handed out, so a request id is never 0
+    LONG generation = (LONG)(p_handle >> 32);
+    LONG next = (generation == -1) ? 1 : generation + 1;
+    if(InterlockedCompareExchange(&slot->m_generation,next,generation) == generation)
+    {
+      // Wait for threads that found the request before the generation changed
+      while(ReadAcquire(&slot->m_pins) > 0)
+      {
+        YieldProcessor();
+      }
+      InterlockedExchangePointer((PVOID volatile*)&slot->m_request,nullptr);
+      InterlockedPushEntrySList(&m_free,&slot->m_entry);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Find the slot of a request id. Generation must match
+RequestTable::Slot*
+RequestTable::FindSlot(HTTP_REQUEST_ID p_handle)
+{
+  ULONG index = (ULONG)(p_handle & 0xFFFFFFFF);
+  if(index == 0)
+  {
+    return nullptr;
+  }
+  --index;
+  ULONG page = index / REQUEST_TABLE_PAGESIZE;
+  if(page >= (ULONG)ReadAcquire(&m_numPages))
+  {
+    return nullptr;
+  }
+  Slot* slot = &m_pages[page][index % REQUEST_TABLE_PAGESIZE];
+  if((ULONG)ReadAcquire(&slot->m_generation) != (ULONG)(p_handle >> 32))
+  {
+    return nullptr;
+  }
+  return slot;
+}
+
+// Add a new page of free slots to the table
+bool
+RequestTable::AddPage()
+{
+  AutoCritSec lock(&m_lock);
+
+  // Another thread might have added a page while we were waiting
+  if(QueryDepthSList(&m_free) > 0)
+  {
+    return true;
+  }
+  if(m_numPages >= REQUEST_TABLE_PAGES)
+  {
+    return false;
+  }
+  Slot* page = (Slot*)_aligned_malloc(sizeof(Slot) * REQUEST_TABLE_PAGESIZE,MEMORY_ALLOCATION_ALIGNMENT);
+  if(page == nullptr)
+  {
+    return false;
+  }
+  ZeroMemory(page,sizeof(Slot) * REQUEST_TABLE_PAGESIZE);
+
+  ULONG base = (ULONG)m_numPages * REQUEST_TABLE_PAGESIZE;
+  for(ULONG index = 0; index < REQUEST_TABLE_PAGESIZE; ++index)
+  {
+    page[index].m_index      = base + index;
+    page[index].m_generation = 1;
+  }
+  m_pages[m_numPages] = page;
+  InterlockedIncrement(&m_numPages);
+
+  // Push in reverse order, so the lowest slots are handed out first
+  for(ULONG index = REQUEST_TABLE_PAGESIZE; index-- > 0;)
+  {
+    InterlockedPushEntrySList(&m_free,&page[index].m_entry);
+  }
+  return true;
+}
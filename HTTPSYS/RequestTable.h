@@ -0,0 +1,61 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// USER-SPACE IMPLEMENTTION OF HTTP.SYS
+//
+// 2018 (c) ir. W.E. Huisman
+// License: MIT
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+class Request;
+
+#define REQUEST_TABLE_PAGESIZE  1024    // Slots per page of the table
+#define REQUEST_TABLE_PAGES     1024    // Maximum number of pages (1M concurrent requests)
+
+// Table of all living requests of the driver.
+// The HTTP_REQUEST_ID of a request is a handle into this table:
+// the upper 32 bits are the generation of the slot, the lower 32 bits the slot number + 1.
+// A slot gets a new generation as soon as the request is gone, so a stale
+// request id is never mistaken for a newer request in the same slot.
+// Registering, finding and releasing a request are all O(1) and lock-free.
+// Only adding a new page to the table takes the lock.
+// Finding a request pins its slot, so the request cannot be released and
+// destroyed while we take our reference on it.
+//
+class RequestTable
+{
+public:
+  RequestTable();
+ ~RequestTable();
+
+  // Register a new request and get its request id
+  HTTP_REQUEST_ID   RegisterRequest(Request* p_request);
+  // Find the request of a request id, or nullptr if the request is gone
+  // Caller must drop the reference to the request after use
+  Request*          FindRequest(HTTP_REQUEST_ID p_handle);
+  // Forget about a request. The request id is invalid from now on
+  void              ReleaseRequest(HTTP_REQUEST_ID p_handle);
+
+private:
+  typedef struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) _slot
+  {
+    SLIST_ENTRY       m_entry;        // Link in the free list. Must be first!
+    Request* volatile m_request;      // Living request in this slot
+    volatile LONG     m_generation;   // Current generation of the slot
+    volatile LONG     m_pins;         // Threads finding the request of this slot
+    ULONG             m_index;        // Slot number in the table
+  }
+  Slot;
+
+  Slot*             FindSlot(HTTP_REQUEST_ID p_handle);
+  bool              AddPage();
+
+  SLIST_HEADER      m_free;                         // Free slots
+  Slot*             m_pages[REQUEST_TABLE_PAGES];   // Pages of slots
+  volatile LONG     m_numPages { 0 };               // Pages in use
+  CRITICAL_SECTION  m_lock;                         // Only for growing the table
+};
+
+extern RequestTable g_requestTable;
@@ -321,4 +321,12 @@ ServerSession::ReadRegistrySettings()
       m_maxConnections = value2;
     }
   }
+
+  if(HTTPReadRegister(sectie,_T("UriMaxCacheMegabyteCount"),REG_DWORD,value1,&value2,value3,&size3))
+  {
+    if(value2 > 0 && value2 <= SESSION_CACHE_MAXIMUM)
+    {
+      m_maxCacheMegabytes = value2;
+    }
+  }
 }
@@ -16,6 +16,8 @@
 
 #define SESSION_MIN_CONNECTIONS      1024
 #define SESSION_MAX_CONNECTIONS   2000000
+#define SESSION_CACHE_DEFAULT          64   // Megabytes in the fragment cache of a request queue
+#define SESSION_CACHE_MAXIMUM        4096
 
 class UrlGroup;
 class LogAnalysis;
@@ -57,6 +59,7 @@ public:
  ULONG      GetTimeoutMinSendRate()     { return m_timeoutMinSendRate;      };
  int        GetDisableServerHeader()    { return m_disableServerHeader;     };
  unsigned   GetMaxConnections()         { return m_maxConnections;          };
+ ULONG      GetMaxCacheMegabytes()      { return m_maxCacheMegabytes;       };
 
 private:
   // Create and start our logfile
@@ -80,6 +83,7 @@ private:
   // Registry settings
   int                 m_disableServerHeader { 0    };
   unsigned            m_maxConnections      { SESSION_MIN_CONNECTIONS };
+  ULONG               m_maxCacheMegabytes   { SESSION_CACHE_DEFAULT   };
   // Locking for update
   CRITICAL_SECTION    m_lock;
 };
@@ -52,6 +52,10 @@
 // Size of a certificate thumbprint
 #define CERT_THUMBPRINT_SIZE  20
 
+// Private request queue property of this driver: the counters of the fragment cache.
+// Queried by HttpQueryRequestQueueProperty into a FragmentStatistics (see FragmentCache.h)
+#define HttpServerFragmentCacheProperty ((HTTP_SERVER_PROPERTY)0x1000)
+
 // The system is/was initialized by calling HttpInitialize
 extern bool g_httpsys_initialized;   // Default = false;
 
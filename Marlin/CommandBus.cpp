@@ -29,6 +29,7 @@
 #include "CommandBus.h"
 #include "ThreadPool.h"
 #include "AutoCritical.h"
+#include <malloc.h>
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -36,6 +37,74 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
+// Pending argument of a batched subscriber
+typedef struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) _pendingCommand
+{
+  SLIST_ENTRY m_entry;
+  void*       m_argument;
+}
+PendingCommand;
+
+// Drop a reference to a subscriber. The last one removes it,
+// together with any arguments that were never delivered
+static void
+ReleaseSubscriber(Subscriber* p_subscriber)
+{
+  if(InterlockedDecrement(&p_subscriber->m_references) == 0)
+  {
+    PSLIST_ENTRY entry = InterlockedFlushSList(&p_subscriber->m_pending);
+    while(entry)
+    {
+      PSLIST_ENTRY next = entry->Next;
+      _aligned_free(CONTAINING_RECORD(entry,PendingCommand,m_entry));
+      entry = next;
+    }
+    delete p_subscriber;
+  }
+}
+
+// Pool item of a batched subscriber: deliver all pending arguments in order.
+// There is never more than one drain per subscriber in the pool,
+// so the subscriber gets its commands one at a time, in order of publishing.
+static void
+DrainSubscriber(void* p_subscriber)
+{
+  Subscriber* subscriber = reinterpret_cast<Subscriber*>(p_subscriber);
+
+  while(true)
+  {
+    PSLIST_ENTRY entry = InterlockedFlushSList(&subscriber->m_pending);
+    if(entry == nullptr)
+    {
+      InterlockedExchange(&subscriber->m_scheduled,0);
+      // A publisher might have pushed just before we were done
+      if(QueryDepthSList(&subscriber->m_pending) == 0 ||
+         InterlockedCompareExchange(&subscriber->m_scheduled,1,0) != 0)
+      {
+        break;
+      }
+      continue;
+    }
+    // The list is last-in-first-out: reverse it
+    PSLIST_ENTRY ordered = nullptr;
+    while(entry)
+    {
+      PSLIST_ENTRY next = entry->Next;
+      entry->Next = ordered;
+      ordered     = entry;
+      entry       = next;
+    }
+    while(ordered)
+    {
+      PendingCommand* command = CONTAINING_RECORD(ordered,PendingCommand,m_entry);
+      ordered = ordered->Next;
+      (*subscriber->m_target)(command->m_argument);
+      _aligned_free(command);
+    }
+  }
+  ReleaseSubscriber(subscriber);
+}
+
 CommandBus::CommandBus(XString p_name,ThreadPool* p_pool)
            :m_name(p_name)
            ,m_pool(p_pool)
@@ -46,6 +115,19 @@ CommandBus::CommandBus(XString p_name,ThreadPool* p_pool)
 
 CommandBus::~CommandBus()
 {
+  m_open = false;
+  if(m_table)
+  {
+    for(auto& list : m_table->m_subscribers)
+    {
+      for(auto& subscriber : list)
+      {
+        ReleaseSubscriber(subscriber);
+      }
+    }
+    delete m_table;
+    m_table = nullptr;
+  }
   DeleteCriticalSection(&m_lock);
 }
 
@@ -53,7 +135,6 @@ CommandBus::~CommandBus()
 bool 
 CommandBus::IsOpen()
 {
-  AutoCritSec lock(&m_lock);
   return m_open;
 }
 
@@ -65,9 +146,38 @@ CommandBus::Close()
   m_open = false;
 }
 
+// Intern a command name for fast publishing
+int
+CommandBus::GetCommandID(XString p_command)
+{
+  {
+    AutoReaderEpoch reader(m_readers);
+    const CommandTable* table = m_table;
+    if(table)
+    {
+      CommandIDs::const_iterator it = table->m_ids.find(p_command);
+      if(it != table->m_ids.end())
+      {
+        return it->second;
+      }
+    }
+  }
+  AutoCritSec lock(&m_lock);
+
+  // See if bus is stil 'open'
+  if(IsOpen() == false)
+  {
+    return -1;
+  }
+  CommandTable* table = CopyTable();
+  int id = InternCommand(table,p_command);
+  PublishTable(table);
+  return id;
+}
+
 // Subscribe a function to a command
 bool
-CommandBus::SubscribeCommand(XString p_command,LPFN_CALLBACK p_function,void* p_default /*=NULL*/)
+CommandBus::SubscribeCommand(XString p_command,LPFN_CALLBACK p_function,void* p_default /*=NULL*/,bool p_batched /*=false*/)
 {
   AutoCritSec lock(&m_lock);
 
@@ -77,21 +187,26 @@ CommandBus::SubscribeCommand(XString p_command,LPFN_CALLBACK p_function,void* p_
     return false;
   }
 
-  Commands comm = m_subscribers.equal_range(p_command);
-  for(CommandMap::iterator it = comm.first;it != comm.second;++it)
+  CommandTable* table = CopyTable();
+  int id = InternCommand(table,p_command);
+  for(auto& subscriber : table->m_subscribers[id])
   {
-    if(it->second.m_target == p_function)
+    if(subscriber->m_target == p_function)
     {
       // Command already subscribed for this function
+      delete table;
       return false;
     }
   }
   // Create subscriber target
-  Subscriber target;
-  target.m_target   = p_function;
-  target.m_argument = p_default;
+  Subscriber* target = new Subscriber();
+  InitializeSListHead(&target->m_pending);
+  target->m_target   = p_function;
+  target->m_argument = p_default;
+  target->m_batched  = p_batched;
 
-  m_subscribers.insert(std::make_pair(p_command,target));
+  table->m_subscribers[id].push_back(target);
+  PublishTable(table);
   return true;
 }
 
@@ -99,16 +214,18 @@ CommandBus::SubscribeCommand(XString p_command,LPFN_CALLBACK p_function,void* p_
 int  
 CommandBus::GetNumberOfSubscribers(XString p_command)
 {
-  AutoCritSec lock(&m_lock);
-
-  int number = 0;
-  Commands comm = m_subscribers.equal_range(p_command);
+  AutoReaderEpoch reader(m_readers);
 
-  for(CommandMap::iterator it = comm.first; it != comm.second; ++it)
+  const CommandTable* table = m_table;
+  if(table)
   {
-    ++number;
+    CommandIDs::const_iterator it = table->m_ids.find(p_command);
+    if(it != table->m_ids.end())
+    {
+      return (int)table->m_subscribers[it->second].size();
+    }
   }
-  return number;
+  return 0;
 }
 
 // Un-Subscribe a command function
@@ -117,16 +234,32 @@ CommandBus::UnSubscribe(XString p_command,LPFN_CALLBACK p_function)
 {
   AutoCritSec lock(&m_lock);
 
-  Commands comm = m_subscribers.equal_range(p_command);
-
-  for(CommandMap::iterator it = comm.first; it != comm.second; ++it)
+  if(m_table == nullptr)
+  {
+    return false;
+  }
+  CommandIDs::iterator it = m_table->m_ids.find(p_command);
+  if(it == m_table->m_ids.end())
+  {
+    return false;
+  }
+  int id = it->second;
+  CommandTable* table = CopyTable();
+  SubscriberList& list = table->m_subscribers[id];
+  for(SubscriberList::iterator sub = list.begin(); sub != list.end(); ++sub)
   {
-    if(it->second.m_target == p_function)
+    if((*sub)->m_target == p_function)
     {
-      m_subscribers.erase(it);
+      Subscriber* subscriber = *sub;
+      list.erase(sub);
+      PublishTable(table);
+      // No publisher can see the subscriber any more.
+      // Batched arguments still pending will be delivered by the drain.
+      ReleaseSubscriber(subscriber);
       return true;
     }
   }
+  delete table;
   return false;
 }
 
@@ -134,23 +267,125 @@ CommandBus::UnSubscribe(XString p_command,LPFN_CALLBACK p_function)
 bool 
 CommandBus::PublishCommand(XString p_command,void* p_argument)
 {
-  AutoCritSec lock(&m_lock);
+  // See if bus is stil 'open'
+  if(IsOpen() == false)
+  {
+    return false;
+  }
+  int id = -1;
+  {
+    AutoReaderEpoch reader(m_readers);
+    const CommandTable* table = m_table;
+    if(table)
+    {
+      CommandIDs::const_iterator it = table->m_ids.find(p_command);
+      if(it != table->m_ids.end())
+      {
+        id = it->second;
+      }
+    }
+  }
+  return id >= 0 ? PublishCommand(id,p_argument) : false;
+}
 
+// Publish new command for all subscribers.
+// Lock-free: publishers only read the current snapshot of the command table
+bool
+CommandBus::PublishCommand(int p_commandID,void* p_argument)
+{
   // See if bus is stil 'open'
   if(IsOpen() == false)
   {
     return false;
   }
+  AutoReaderEpoch reader(m_readers);
 
-  // Find all subscribers
-  bool result = false;
-  Commands comm = m_subscribers.equal_range(p_command);
+  const CommandTable* table = m_table;
+  if(table == nullptr || p_commandID < 0 || p_commandID >= (int)table->m_subscribers.size())
+  {
+    return false;
+  }
 
   // Publish to each subscriber through the threadpool
-  for(CommandMap::iterator it = comm.first; it != comm.second; ++it)
+  bool result = false;
+  for(auto& subscriber : table->m_subscribers[p_commandID])
   {
-    m_pool->SubmitWork(it->second.m_target,p_argument);
+    if(subscriber->m_batched)
+    {
+      Enqueue(subscriber,p_argument);
+    }
+    else
+    {
+      m_pool->SubmitWork(subscriber->m_target,p_argument);
+    }
     result = true;
   }
   return result;
 }
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Start a new command table from the current one
+CommandTable*
+CommandBus::CopyTable()
+{
+  return m_table ? new CommandTable(*m_table) : new CommandTable();
+}
+
+// Find or add the id of a command name
+int
+CommandBus::InternCommand(CommandTable* p_table,XString p_command)
+{
+  CommandIDs::iterator it = p_table->m_ids.find(p_command);
+  if(it != p_table->m_ids.end())
+  {
+    return it->second;
+  }
+  int id = (int)p_table->m_subscribers.size();
+  p_table->m_ids.insert(std::make_pair(p_command,id));
+  p_table->m_subscribers.push_back(SubscriberList());
+  return id;
+}
+
+// Publish a new snapshot of the command table.
+// After the swap we wait for the publishers that are reading,
+// so no publisher can have a reference to the old table.
+void
+CommandBus::PublishTable(CommandTable* p_table)
+{
+  CommandTable* old = reinterpret_cast<CommandTable*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&m_table),p_table));
+
+  m_readers.WaitForReaders();
+  delete old;
+}
+
+// Queue an argument for a batched subscriber,
+// and put a drain in the pool if there is none yet
+bool
+CommandBus::Enqueue(Subscriber* p_subscriber,void* p_argument)
+{
+  PendingCommand* command = reinterpret_cast<PendingCommand*>(_aligned_malloc(sizeof(PendingCommand),MEMORY_ALLOCATION_ALIGNMENT));
+  if(command == nullptr)
+  {
+    return false;
+  }
+  command->m_argument = p_argument;
+  InterlockedPushEntrySList(&p_subscriber->m_pending,&command->m_entry);
+
+  if(InterlockedCompareExchange(&p_subscriber->m_scheduled,1,0) == 0)
+  {
+    InterlockedIncrement(&p_subscriber->m_references);
+    if(!m_pool->SubmitWork(DrainSubscriber,p_subscriber))
+    {
+      // Pool is stopping. Arguments are removed with the subscriber
+      InterlockedExchange(&p_subscriber->m_scheduled,0);
+      ReleaseSubscriber(p_subscriber);
+      return false;
+    }
+  }
+  return true;
+}
@@ -27,17 +27,34 @@
 //
 #pragma once
 #include "ThreadPool.h"
+#include "ReaderEpoch.h"
 #include <map>
+#include <vector>
 
-typedef struct _subscriber
+// A subscriber of a command. Lives as long as it is subscribed,
+// or as long as it has batched arguments waiting to be delivered.
+typedef struct DECLSPEC_ALIGN(MEMORY_ALLOCATION_ALIGNMENT) _subscriber
 {
+  SLIST_HEADER  m_pending;               // Pending arguments (batched only)
   LPFN_CALLBACK m_target;
   void*         m_argument;
+  bool          m_batched    { false };  // One pool item drains all pending arguments
+  volatile long m_scheduled  { 0 };      // A drain is in the pool for this subscriber
+  volatile long m_references { 1 };      // Command table + scheduled drain
 }
 Subscriber;
 
-using CommandMap = std::multimap<XString,Subscriber>;
-using Commands   = std::pair<CommandMap::iterator,CommandMap::iterator>;
+// Immutable snapshot of all commands and their subscribers
+// Command names are interned: a command id is the index in m_subscribers
+using SubscriberList = std::vector<Subscriber*>;
+using CommandIDs     = std::map<XString,int>;
+
+typedef struct _commandTable
+{
+  CommandIDs                  m_ids;
+  std::vector<SubscriberList> m_subscribers;
+}
+CommandTable;
 
 class CommandBus
 {
@@ -47,18 +64,22 @@ public:
 
   // FUNCTIONS
  
-  // Subscribe a function to a command
-  bool SubscribeCommand(XString p_command,LPFN_CALLBACK p_function,void* p_default = NULL);
+  // Subscribe a function to a command. Batched subscribers get their commands in order
+  bool SubscribeCommand(XString p_command,LPFN_CALLBACK p_function,void* p_default = NULL,bool p_batched = false);
   // Un-Subscribe a command function
   bool UnSubscribe(XString p_command,LPFN_CALLBACK p_function);
   // Publish new command for all subscribers
   bool PublishCommand(XString p_command,void* p_argument);
+  // Publish new command by its interned id (see GetCommandID)
+  bool PublishCommand(int p_commandID,void* p_argument);
   // Find out if command bus is (still) open
   bool IsOpen();
   // Close bus for new publishing
   void Close();
   // Find out if command has subscribers
   int  GetNumberOfSubscribers(XString p_command);
+  // Intern a command name for fast publishing. Returns -1 if the bus is closed
+  int  GetCommandID(XString p_command);
 
   // SETTERS
   void SetName(XString p_name)     { m_name = p_name; };
@@ -69,10 +90,18 @@ public:
   ThreadPool* GetPool()   { return m_pool; };
 
 private:
-  XString     m_name;               // Name of the command bus
-  bool        m_open { false  };    // Open for publishing
-  ThreadPool* m_pool { nullptr};    // Thread pool used by the bus
-  CommandMap  m_subscribers;        // Command/subscriber-target pairs
-  // Multi-threading lock for the bus
+  // Writers: (MUST be called with the m_lock held!)
+  CommandTable* CopyTable();
+  int           InternCommand(CommandTable* p_table,XString p_command);
+  void          PublishTable(CommandTable* p_table);
+  // Batched delivery
+  bool  Enqueue(Subscriber* p_subscriber,void* p_argument);
+
+  XString       m_name;                     // Name of the command bus
+  volatile bool m_open   { false  };        // Open for publishing
+  ThreadPool*   m_pool   { nullptr};        // Thread pool used by the bus
+  CommandTable* volatile m_table { nullptr };  // Published command/subscriber-target snapshot
+  ReaderEpoch   m_readers;                  // Publishers reading the command table
+  // Multi-threading lock for the bus (subscribing only)
   CRITICAL_SECTION m_lock;
 };
@@ -0,0 +1,532 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ConfigSnapshot.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "ConfigSnapshot.h"
+#include "LogAnalysis.h"
+#include "AutoCritical.h"
+#include <algorithm>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Logging via the server
+#define DETAILLOG1(text)        if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,false,text)
+#define DETAILLOGS(text,extra)  if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,true, text,extra)
+#define DETAILLOGV(text,...)    if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,true, text,__VA_ARGS__)
+#define WARNINGLOG(text,...)    if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_WARN,true, text,__VA_ARGS__)
+#define ERRORLOG(code,text)     if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,true,text,code)
+#define ERRORLOGS(code,text,x)  if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,true,text,code,x)
+
+//////////////////////////////////////////////////////////////////////////
+//
+// THE SNAPSHOT
+//
+//////////////////////////////////////////////////////////////////////////
+
+ConfigSnapshot::ConfigSnapshot(XString p_filename,long p_version)
+               :m_config(p_filename)
+               ,m_version(p_version)
+{
+  m_filled = m_config.IsFilled();
+  if(!m_filled)
+  {
+    return;
+  }
+  // Flatten all sections into "Section/Parameter" keys
+  XMLElement* section = m_config.GetElementFirstChild(m_config.GetRoot());
+  while(section)
+  {
+    XMLElement* parameter = m_config.GetElementFirstChild(section);
+    while(parameter)
+    {
+      XString key = section->GetName() + _T("/") + parameter->GetName();
+      m_values[key] = parameter->GetValue();
+      for(auto& attribute : parameter->GetAttributes())
+      {
+        m_values[key + _T("@") + attribute.m_name] = attribute.m_value;
+      }
+      parameter = m_config.GetElementSibling(parameter);
+    }
+    section = m_config.GetElementSibling(section);
+  }
+}
+
+XString
+ConfigSnapshot::GetParameterString(XString p_section,XString p_parameter,XString p_default) const
+{
+  ConfigValues::const_iterator it = m_values.find(p_section + _T("/") + p_parameter);
+  if(it != m_values.end())
+  {
+    return it->second;
+  }
+  return p_default;
+}
+
+bool
+ConfigSnapshot::GetParameterBoolean(XString p_section,XString p_parameter,bool p_default) const
+{
+  XString param = GetParameterString(p_section,p_parameter,_T(""));
+  if(param.IsEmpty())
+  {
+    return p_default;
+  }
+  if(param.CompareNoCase(_T("true")) == 0)
+  {
+    return true;
+  }
+  if(param.CompareNoCase(_T("false")) == 0)
+  {
+    return false;
+  }
+  // Simply 0 or 1
+  return (_ttoi(param) > 0);
+}
+
+int
+ConfigSnapshot::GetParameterInteger(XString p_section,XString p_parameter,int p_default) const
+{
+  XString param = GetParameterString(p_section,p_parameter,_T(""));
+  if(param.IsEmpty())
+  {
+    return p_default;
+  }
+  return _ttoi(param);
+}
+
+bool
+ConfigSnapshot::HasParameter(XString p_section,XString p_parameter) const
+{
+  return m_values.find(p_section + _T("/") + p_parameter) != m_values.end();
+}
+
+// Keys that were added, changed or removed in respect to another snapshot
+void
+ConfigSnapshot::GetChangedKeys(const ConfigSnapshot* p_other,ConfigKeys& p_keys) const
+{
+  for(const auto& value : m_values)
+  {
+    ConfigValues::const_iterator it = p_other->m_values.find(value.first);
+    if(it == p_other->m_values.end() || it->second.Compare(value.second) != 0)
+    {
+      p_keys.insert(value.first);
+    }
+  }
+  for(const auto& value : p_other->m_values)
+  {
+    if(m_values.find(value.first) == m_values.end())
+    {
+      p_keys.insert(value.first);
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// THE WATCHER
+//
+//////////////////////////////////////////////////////////////////////////
+
+ConfigWatcher::ConfigWatcher()
+{
+  InitializeCriticalSection(&m_lock);
+  InitializeCriticalSection(&m_reloadLock);
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+  StopWatching();
+  delete m_snapshot;
+  DeleteCriticalSection(&m_lock);
+  DeleteCriticalSection(&m_reloadLock);
+}
+
+static unsigned int __stdcall StartingTheWatcherThread(void* p_context)
+{
+  ConfigWatcher* watcher = reinterpret_cast<ConfigWatcher*>(p_context);
+  if(watcher)
+  {
+    watcher->WatcherThreadRunning();
+  }
+  return 0;
+}
+
+// Read the config file and start watching it for changes
+bool
+ConfigWatcher::StartWatching(XString p_filename)
+{
+  // No reload can come in between
+  AutoCritSec reload(&m_reloadLock);
+  {
+    AutoCritSec lock(&m_lock);
+    if(m_running)
+    {
+      // Already watching
+      return true;
+    }
+    m_filename = p_filename;
+  }
+
+  // Read the first version of the file
+  if(!Reload())
+  {
+    return false;
+  }
+  AutoCritSec lock(&m_lock);
+
+  // Create an event to stop the watcher
+  if(!m_event)
+  {
+    m_event = CreateEvent(NULL,FALSE,FALSE,NULL);
+  }
+
+  // Thread for watching the file
+  unsigned int threadID = 0;
+  m_running = true;
+  if((m_thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL,0,StartingTheWatcherThread,reinterpret_cast<void*>(this),0,&threadID))) == INVALID_HANDLE_VALUE)
+  {
+    m_thread  = NULL;
+    m_running = false;
+    ERRORLOG(ERROR_SERVICE_NOT_ACTIVE,_T("Code [%d] Cannot start a thread for watching the configuration."));
+    return false;
+  }
+  DETAILLOGV(_T("Configuration watcher started with threadID [%d] for: %s"),threadID,m_filename.GetString());
+  return true;
+}
+
+void
+ConfigWatcher::StopWatching()
+{
+  {
+    AutoCritSec lock(&m_lock);
+    if(!m_running)
+    {
+      return;
+    }
+    m_running = false;
+  }
+  SetEvent(m_event);
+  if(WaitForSingleObject(m_thread,CONFIG_END_TIMEOUT) == WAIT_TIMEOUT)
+  {
+    // Since waiting on the thread did not work, we must preemptively terminate it.
+#pragma warning(disable:6258)
+    TerminateThread(m_thread,3);
+    ERRORLOG(ERROR_TIMEOUT,_T("Code [%d] Configuration watcher did not stop in time"));
+  }
+  CloseHandle(m_thread);
+  m_thread = NULL;
+  CloseHandle(m_event);
+  m_event = NULL;
+  DETAILLOG1(_T("Configuration watcher stopped."));
+}
+
+// Re-read the file. Only publish if something did change
+// The first version is published without notifying the listeners.
+// Reloads are serialized, so the published snapshot stays alive
+// while the listeners apply it outside the m_lock.
+bool
+ConfigWatcher::Reload()
+{
+  AutoCritSec reload(&m_reloadLock);
+  ConfigSnapshot* snapshot = nullptr;
+  ConfigKeys      changed;
+  {
+    AutoCritSec lock(&m_lock);
+    snapshot = ReadSnapshot(changed);
+  }
+  if(snapshot == nullptr)
+  {
+    return false;
+  }
+  if(!changed.empty())
+  {
+    NotifyListeners(snapshot,changed);
+  }
+  AutoCritSec lock(&m_lock);
+  m_applied = snapshot->GetVersion();
+  return true;
+}
+
+// Read and publish a new snapshot with its changed keys. (MUST be called with the m_lock held!)
+// Returns nullptr if the file could not be read or did not change
+ConfigSnapshot*
+ConfigWatcher::ReadSnapshot(ConfigKeys& p_changed)
+{
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  ZeroMemory(&data,sizeof(WIN32_FILE_ATTRIBUTE_DATA));
+  GetFileAttributesEx(m_filename,GetFileExInfoStandard,&data);
+
+  ConfigSnapshot* current  = m_snapshot;
+  ConfigSnapshot* snapshot = new ConfigSnapshot(m_filename,current ? current->GetVersion() + 1 : 1);
+  if(!snapshot->IsFilled())
+  {
+    // Probably half written by an editor: try again on the next change
+    ERRORLOGS(ERROR_INVALID_DATA,_T("Code [%d] Cannot read the configuration. Keeping the running version: %s"),m_filename.GetString());
+    delete snapshot;
+    return nullptr;
+  }
+  m_lastWrite = data.ftLastWriteTime;
+
+  if(current == nullptr)
+  {
+    PublishSnapshot(snapshot);
+    return snapshot;
+  }
+  snapshot->GetChangedKeys(current,p_changed);
+  if(p_changed.empty())
+  {
+    // Saved by an editor, but nothing changed
+    delete snapshot;
+    return nullptr;
+  }
+  PublishSnapshot(snapshot);
+  return snapshot;
+}
+
+void
+ConfigWatcher::AddListener(ConfigListener* p_listener)
+{
+  AutoCritSec lock(&m_lock);
+  if(std::find(m_listeners.begin(),m_listeners.end(),p_listener) == m_listeners.end())
+  {
+    m_listeners.push_back(p_listener);
+  }
+}
+
+// After removing, the listener is never called again.
+// Waits for a reload that is notifying the listeners right now.
+void
+ConfigWatcher::RemoveListener(ConfigListener* p_listener)
+{
+  AutoCritSec reload(&m_reloadLock);
+  AutoCritSec lock(&m_lock);
+  ConfigListeners::iterator it = std::find(m_listeners.begin(),m_listeners.end(),p_listener);
+  if(it != m_listeners.end())
+  {
+    m_listeners.erase(it);
+  }
+}
+
+bool
+ConfigWatcher::GetIsWatching()
+{
+  AutoCritSec lock(&m_lock);
+  return m_running;
+}
+
+XString
+ConfigWatcher::GetFilename()
+{
+  AutoCritSec lock(&m_lock);
+  return m_filename;
+}
+
+long
+ConfigWatcher::GetVersion()
+{
+  AutoCritSec lock(&m_lock);
+  return m_snapshot ? m_snapshot->GetVersion() : 0;
+}
+
+long
+ConfigWatcher::GetAppliedVersion()
+{
+  AutoCritSec lock(&m_lock);
+  return m_applied;
+}
+
+ConfigKeys
+ConfigWatcher::GetRestartKeys()
+{
+  AutoCritSec lock(&m_lock);
+  return m_restart;
+}
+
+bool
+ConfigWatcher::HasListener(ConfigListener* p_listener)
+{
+  AutoCritSec lock(&m_lock);
+  return std::find(m_listeners.begin(),m_listeners.end(),p_listener) != m_listeners.end();
+}
+
+// Waiting for changes in the directory of the config file
+// Without a change notification (e.g. on some network shares) we poll the file
+void
+ConfigWatcher::WatcherThreadRunning()
+{
+  // Installing our SEH to exception translator
+  _set_se_translator(SeTranslator);
+  DETAILLOG1(_T("Configuration watcher started."));
+
+  XString directory(m_filename);
+  int pos = directory.ReverseFind('\\');
+  directory = pos > 0 ? directory.Left(pos) : XString(_T("."));
+
+  HANDLE change = FindFirstChangeNotification(directory,FALSE,FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+  if(change == INVALID_HANDLE_VALUE)
+  {
+    change = NULL;
+    DETAILLOGS(_T("No change notification possible. Polling the configuration in: "),directory);
+  }
+
+  // First look: the file can change before we watch the directory
+  bool look = true;
+  while(m_running)
+  {
+    if(look && FileHasChanged())
+    {
+      try
+      {
+        Reload();
+      }
+      catch(StdException& ex)
+      {
+        ERRORLOGS(ERROR_INVALID_DATA,_T("Code [%d] Error while reloading the configuration: %s"),ex.GetErrorMessage().GetString());
+      }
+    }
+    HANDLE  events[2] = { m_event, change };
+    DWORD   waited = WaitForMultipleObjects(change ? 2 : 1,events,FALSE,change ? INFINITE : CONFIG_POLL_TIME);
+    if(!m_running)
+    {
+      break;
+    }
+    if(waited == WAIT_OBJECT_0 + 1)
+    {
+      FindNextChangeNotification(change);
+      // Give the editor some time to write out the complete file
+      WaitForSingleObject(m_event,CONFIG_SETTLE_TIME);
+    }
+    look = (waited == WAIT_OBJECT_0 + 1 || waited == WAIT_TIMEOUT);
+  }
+  if(change)
+  {
+    FindCloseChangeNotification(change);
+  }
+  DETAILLOG1(_T("Configuration watcher stopped."));
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Swap in the new snapshot. The snapshots are only used under the m_lock
+// so the old one can go right away.
+// MUST be called with the m_lock held!
+void
+ConfigWatcher::PublishSnapshot(ConfigSnapshot* p_snapshot)
+{
+  delete m_snapshot;
+  m_snapshot = p_snapshot;
+  DETAILLOGV(_T("Configuration version [%d] published from: %s"),p_snapshot->GetVersion(),m_filename.GetString());
+}
+
+// Hand the changed keys to the listeners that can apply them
+// The listeners are called outside the m_lock, so they can read the watcher.
+// MUST be called with the m_reloadLock held, but NOT the m_lock!
+void
+ConfigWatcher::NotifyListeners(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed)
+{
+  ConfigListeners listeners;
+  {
+    AutoCritSec lock(&m_lock);
+    listeners = m_listeners;
+  }
+  ConfigKeys applied;
+  for(auto& listener : listeners)
+  {
+    // A listener can remove another one while we are calling
+    if(!HasListener(listener))
+    {
+      continue;
+    }
+    ConfigKeys live;
+    listener->GetLiveConfigKeys(live);
+
+    ConfigKeys keys;
+    for(const auto& key : p_changed)
+    {
+      if(IsLiveKey(live,key))
+      {
+        keys.insert(key);
+        applied.insert(key);
+      }
+    }
+    if(!keys.empty())
+    {
+      listener->ApplyConfig(p_snapshot,keys);
+    }
+  }
+  AutoCritSec lock(&m_lock);
+  for(const auto& key : p_changed)
+  {
+    if(applied.find(key) == applied.end())
+    {
+      m_restart.insert(key);
+      WARNINGLOG(_T("Configuration changed. Needs a restart to take effect: %s"),key.GetString());
+    }
+  }
+  DETAILLOGV(_T("Configuration version [%d] changed keys: %d applied live: %d")
+            ,p_snapshot->GetVersion(),(int)p_changed.size(),(int)applied.size());
+}
+
+// See if the file got written after we last read it
+bool
+ConfigWatcher::FileHasChanged()
+{
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if(!GetFileAttributesEx(m_filename,GetFileExInfoStandard,&data))
+  {
+    // File (temporarily) gone: keep the running version
+    return false;
+  }
+  AutoCritSec lock(&m_lock);
+  return CompareFileTime(&data.ftLastWriteTime,&m_lastWrite) != 0;
+}
+
+// A key is live if the listener names it, or names its section with "Section/*"
+// Attributes are live if their parameter is live
+/* static */ bool
+ConfigWatcher::IsLiveKey(const ConfigKeys& p_live,const XString& p_key)
+{
+  XString key(p_key);
+  int attrib = key.Find('@');
+  if(attrib > 0)
+  {
+    key = key.Left(attrib);
+  }
+  if(p_live.find(key) != p_live.end())
+  {
+    return true;
+  }
+  int pos = key.Find('/');
+  return pos > 0 && p_live.find(key.Left(pos) + _T("/*")) != p_live.end();
+}
@@ -0,0 +1,151 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ConfigSnapshot.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "MarlinConfig.h"
+#include <map>
+#include <set>
+#include <vector>
+
+// Hot reloading of a Marlin.config file
+//
+// A ConfigSnapshot is an immutable and versioned copy of a config file.
+// The ConfigWatcher re-reads the file as soon as it changes on disk, publishes
+// the new snapshot and hands the changed keys to its listeners.
+// The listeners copy the new values into their own settings, which the request
+// threads read as before. Only the thread of the watcher touches the snapshots.
+//
+// Keys are named "Section/Parameter" (and "Section/Parameter@Attribute").
+// Every listener declares the keys it can apply while running. "Section/*" stands
+// for all parameters of a section. Changed keys that no listener can apply
+// are logged: these only take effect after a restart of the server.
+// A key that is removed from the file reverts to the value the listener had
+// before any config file was applied.
+
+#define CONFIG_SETTLE_TIME    250   // Milliseconds for an editor to finish writing the file
+#define CONFIG_POLL_TIME     5000   // Polling the file if no change notification is possible
+#define CONFIG_END_TIMEOUT  10000   // Waiting for the watcher to stop
+
+class LogAnalysis;
+
+using ConfigValues = std::map<XString,XString>;
+using ConfigKeys   = std::set<XString>;
+
+class ConfigSnapshot
+{
+public:
+  ConfigSnapshot(XString p_filename,long p_version);
+
+  // GETTERS: Same semantics as the MarlinConfig
+  XString GetParameterString (XString p_section,XString p_parameter,XString p_default) const;
+  bool    GetParameterBoolean(XString p_section,XString p_parameter,bool    p_default) const;
+  int     GetParameterInteger(XString p_section,XString p_parameter,int     p_default) const;
+  bool    HasParameter(XString p_section,XString p_parameter) const;
+
+  bool    IsFilled()   const { return m_filled;  }
+  long    GetVersion() const { return m_version; }
+  // Keys that differ from another snapshot (added, changed or removed)
+  void    GetChangedKeys(const ConfigSnapshot* p_other,ConfigKeys& p_keys) const;
+  // The config the snapshot was read from. Only for the listeners that apply it!
+  MarlinConfig& GetConfig()  { return m_config;  }
+
+private:
+  MarlinConfig  m_config;               // Config as read from disk
+  ConfigValues  m_values;               // All keys and their values
+  long          m_version { 0     };    // Version of the snapshot
+  bool          m_filled  { false };    // Correctly read from disk
+};
+
+// Subsystem that can apply (some) changes of the configuration while running
+class ConfigListener
+{
+public:
+  virtual ~ConfigListener() = default;
+
+  // Keys this listener can apply without a restart
+  virtual void GetLiveConfigKeys(ConfigKeys& p_keys) = 0;
+  // Apply a new snapshot. Only called for the changed keys of GetLiveConfigKeys
+  // Called on the thread of the watcher, outside the lock of the watcher
+  virtual void ApplyConfig(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed) = 0;
+};
+
+using ConfigListeners = std::vector<ConfigListener*>;
+
+class ConfigWatcher
+{
+public:
+  ConfigWatcher();
+ ~ConfigWatcher();
+
+  // Read the config file and start watching it for changes
+  bool    StartWatching(XString p_filename);
+  // Stop watching. The last snapshot stays readable
+  void    StopWatching();
+  // Re-read the file now. Returns true if a new version was published
+  bool    Reload();
+  // Subsystems applying the live changes
+  void    AddListener   (ConfigListener* p_listener);
+  void    RemoveListener(ConfigListener* p_listener);
+
+  // SETTERS
+  void    SetLogfile(LogAnalysis* p_logfile) { m_logfile = p_logfile; }
+
+  // GETTERS
+  bool    GetIsWatching();
+  XString GetFilename();
+  long    GetVersion();
+  // Version that has been handed to all listeners
+  long    GetAppliedVersion();
+  // Changed keys that did not get applied: restart needed
+  ConfigKeys GetRestartKeys();
+
+  // Only to be called by the background watcher thread
+  void    WatcherThreadRunning();
+
+private:
+  // Writers: (MUST be called with the m_lock held!)
+  ConfigSnapshot* ReadSnapshot(ConfigKeys& p_changed);
+  void    PublishSnapshot(ConfigSnapshot* p_snapshot);
+  // (MUST be called with the m_reloadLock held, but NOT the m_lock)
+  void    NotifyListeners(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed);
+  bool    HasListener(ConfigListener* p_listener);
+  bool    FileHasChanged();
+  static bool IsLiveKey(const ConfigKeys& p_live,const XString& p_key);
+
+  XString         m_filename;                     // Config file being watched
+  ConfigSnapshot* m_snapshot   { nullptr };       // Published snapshot
+  FILETIME        m_lastWrite  { 0,0 };           // Last write time of the file we read
+  long            m_applied    { 0   };           // Version the listeners are done with
+  ConfigListeners m_listeners;                    // Subsystems applying the changes
+  ConfigKeys      m_restart;                      // Keys waiting for a restart
+  bool            m_running    { false   };       // Watcher thread is running
+  HANDLE          m_thread     { NULL    };       // Background watcher
+  HANDLE          m_event      { NULL    };       // Stops the watcher
+  LogAnalysis*    m_logfile    { nullptr };       // Logging
+  CRITICAL_SECTION m_lock;                        // Snapshot, state and the listeners
+  CRITICAL_SECTION m_reloadLock;                  // One reload (with its notification) at the time
+};
@@ -28,6 +28,7 @@
 #include "StdAfx.h"
 #include "HTTPClient.h"
 #include "CrackURL.h"
+#include "URLView.h"
 #include "GetLastErrorAsString.h"
 #include "ConvertWideString.h"
 #include "HTTPMessage.h"
@@ -43,6 +44,7 @@
 #include "HTTPClientTracing.h"
 #include "HTTPError.h"
 #include "OAuth2Cache.h"
+#include "Metrics.h"
 #include "Version.h"
 #include <ZIP\gzip.h>
 #include <winerror.h>
@@ -201,6 +203,64 @@ HTTPClient::Reset()
   m_initializedLog = false;
 }
 
+// Take over all settings a caller may have made on another client
+// so that a second connection behaves the same way (proxy, certificates,
+// credentials, single-sign-on, extra headers, logging and OAuth2).
+// Connection handles, bodies and results are NOT copied.
+void
+HTTPClient::CopySettings(const HTTPClient& p_other)
+{
+  AutoCritSec lock(&m_sendSection);
+
+  m_agent           = p_other.m_agent;
+  m_retries         = p_other.m_retries;
+  // Proxy
+  m_useProxy        = p_other.m_useProxy;
+  m_proxy           = p_other.m_proxy;
+  m_proxyBypass     = p_other.m_proxyBypass;
+  m_proxyUser       = p_other.m_proxyUser;
+  m_proxyPassword   = p_other.m_proxyPassword;
+  // Protocol
+  m_soapCompress    = p_other.m_soapCompress;
+  m_verbTunneling   = p_other.m_verbTunneling;
+  m_httpCompression = p_other.m_httpCompression;
+  m_sendUnicode     = p_other.m_sendUnicode;
+  m_sniffCharset    = p_other.m_sniffCharset;
+  m_sendBOM         = p_other.m_sendBOM;
+  // Authentication and security
+  m_user            = p_other.m_user;
+  m_password        = p_other.m_password;
+  m_relax           = p_other.m_relax;
+  m_terminalServices= p_other.m_terminalServices;
+  m_securityLevel   = p_other.m_securityLevel;
+  m_enc_password    = p_other.m_enc_password;
+  m_sso             = p_other.m_sso;
+  m_ssltls          = p_other.m_ssltls;
+  m_preemtive       = p_other.m_preemtive;
+  m_certPreset      = p_other.m_certPreset;
+  m_certStore       = p_other.m_certStore;
+  m_certName        = p_other.m_certName;
+  // Timeouts
+  m_timeoutResolve  = p_other.m_timeoutResolve;
+  m_timeoutConnect  = p_other.m_timeoutConnect;
+  m_timeoutSend     = p_other.m_timeoutSend;
+  m_timeoutReceive  = p_other.m_timeoutReceive;
+  // Extra headers, cookies and CORS
+  m_requestHeaders  = p_other.m_requestHeaders;
+  m_cookies         = p_other.m_cookies;
+  m_corsOrigin      = p_other.m_corsOrigin;
+  // OAuth2
+  m_oauthCache      = p_other.m_oauthCache;
+  m_oauthSession    = p_other.m_oauthSession;
+
+  // Share the logfile, but never take ownership
+  if(p_other.m_log)
+  {
+    SetLogging(p_other.m_log,false);
+  }
+  m_logLevel        = p_other.m_logLevel;
+}
+
 void
 HTTPClient::ResetBody()
 {
@@ -740,14 +800,24 @@ HTTPClient::SetURL(XString p_url)
   m_url = p_url;
   DETAILLOG(_T("URL set to: %s"),p_url.GetString());
 
-  CrackedURL url(p_url);
+  // Only the server parts are needed: no cracking of all the parameters
+  URLView url(p_url);
   if(url.Valid())
   {
-    m_scheme   = url.m_scheme;
-    m_secure   = url.m_secure;
-    m_server   = url.m_host;
-    m_port     = url.m_port;
-    m_url      = url.AbsolutePath();
+    m_scheme   = url.GetScheme();
+    m_secure   = url.GetSecure();
+    m_server   = url.GetHost();
+    m_port     = url.GetPort();
+    if(url.PlainPath())
+    {
+      m_url = url.AbsolutePath();
+    }
+    else
+    {
+      // Path must be encoded or reduced
+      CrackedURL cracked(p_url);
+      m_url = cracked.AbsolutePath();
+    }
     return true;
   }
   // Generic path-not-found error
@@ -1272,7 +1342,7 @@ HTTPClient::ResetOAuth2Session()
 {
   if(m_oauthCache && m_oauthSession)
   {
-    m_oauthCache->SetExpired(m_oauthSession);
+    m_oauthCache->SetExpired(m_oauthSession,m_lastBearerToken);
   }
   AddOAuth2authorization();
   FlushAllHeaders();
@@ -1571,7 +1641,29 @@ HTTPClient::SendBodyData()
       size_t length = 0;
 
       m_buffer->GetBuffer(buffer,length);
-      if(buffer)
+      if(buffer == nullptr && m_buffer->GetBufferChain().GetHasFileRegions())
+      {
+        // File regions have no memory part: flatten the chain first
+        m_buffer->GetBufferCopy(buffer,length);
+        DWORD dwWritten = 0;
+        if(buffer && length)
+        {
+          if(!::WinHttpWriteData(m_request
+                                ,buffer
+                                ,(DWORD)length
+                                ,&dwWritten))
+          {
+            ErrorLog(_T(__FUNCTION__),_T("Write body: Buffer chain. Error [%d] %s"));
+          }
+        }
+        else if(buffer == nullptr)
+        {
+          ERRORLOG(_T("Write body: Cannot read file regions of the buffer chain"));
+        }
+        DETAILLOG(_T("Write body. Buffer chain. Size: %d. Written: %d"),length,dwWritten);
+        delete [] buffer;
+      }
+      else if(buffer)
       {
         DWORD dwWritten = 0;
         if(length)
@@ -2637,7 +2729,7 @@ HTTPClient::Send(JSONMessage* p_msg)
 }
 
 void
-HTTPClient::ProcessJSONResult(JSONMessage* p_msg,bool& p_result)
+HTTPClient::ProcessJSONResult(JSONMessage* p_msg,bool& p_result,XString* p_answer /*=nullptr*/)
 {
   // Headers from the answer
   XString nosniff = FindHeader(_T("X-Content-Type-Options"));
@@ -2701,8 +2793,16 @@ HTTPClient::ProcessJSONResult(JSONMessage* p_msg,bool& p_result)
   }
 
   // Keep response as new body. Might contain an error!!
+  // Or leave the text to the caller for a direct transcoding
   DETAILLOG(_T("Incoming JSON answer"));
-  p_msg->ParseMessage(answer);
+  if(p_answer)
+  {
+    *p_answer = answer;
+  }
+  else
+  {
+    p_msg->ParseMessage(answer);
+  }
 
   // Keep cookies
   p_msg->SetCookies(m_resultCookies);
@@ -2767,12 +2867,13 @@ HTTPClient::SendAsJSON(SOAPMessage* p_msg)
   p_msg->Reset();
   if(result)
   {
-    // Translate our result back to JSON
+    // Get our JSON result with the HTTP parts
     JSONMessage json;
-    ProcessJSONResult(&json,result);
+    XString answer;
+    ProcessJSONResult(&json,result,&answer);
 
-    // Translate our JSON back to SOAP
-    *p_msg = json;
+    // Transcode the JSON text directly back to SOAP
+    p_msg->TranscodeJSON(json,answer);
   }
   else
   {
@@ -2886,11 +2987,54 @@ HTTPClient::SendAndRedirect()
 }
 
 // Our primary function: send a message
+// Timed in the metrics of the target server
 bool
 HTTPClient::Send()
 {
   AutoCritSec lock(&m_sendSection);
 
+  if(!g_metrics.GetActive())
+  {
+    return SendRequest();
+  }
+
+  LARGE_INTEGER start,stop;
+  QueryPerformanceCounter(&start);
+  bool result = SendRequest();
+  QueryPerformanceCounter(&stop);
+
+  FindTargetMetrics();
+  m_targetMetrics->RecordTicks(stop.QuadPart - start.QuadPart);
+  if(!result)
+  {
+    m_targetErrors->Add();
+  }
+  return result;
+}
+
+// Metrics are only looked up in the registry if the target server changes
+void
+HTTPClient::FindTargetMetrics()
+{
+  if(m_targetMetrics && m_targetPort == m_port && m_targetSecure == m_secure && m_targetServer == m_server)
+  {
+    return;
+  }
+  m_targetServer = m_server;
+  m_targetPort   = m_port;
+  m_targetSecure = m_secure;
+
+  XString target;
+  target.Format(_T("%s://%s:%d"),m_secure ? _T("https") : _T("http"),m_server.GetString(),m_port);
+  MetricsLabels labels { { _T("target"),target } };
+  m_targetMetrics = g_metrics.GetHistogram(_T("marlin_client_request_seconds"),labels,_T("Duration of the requests of the HTTP clients per target server"));
+  m_targetErrors  = g_metrics.GetCounter  (_T("marlin_client_errors_total"),   labels,_T("Failed requests of the HTTP clients per target server"));
+}
+
+// Sending the message to the server
+bool
+HTTPClient::SendRequest()
+{
   bool retValue            = false;
   bool getReponseSucceed   = false;
   unsigned int iRetryTimes = 0;
@@ -94,6 +94,8 @@ class EventSource;
 class ThreadPool;
 class OAuth2Cache;
 class HTTPClientTracing;
+class MetricsHistogram;
+class MetricsCounter;
 
 // Types of proxies supported
 enum class ProxyType
@@ -137,6 +139,8 @@ public:
  ~HTTPClient();
   // Reset the client to 'sane' values
   void Reset();
+  // Take over the connection settings of another client
+  void CopySettings(const HTTPClient& p_other);
   // Pre-Initialize the client
   bool Initialize();
 
@@ -339,6 +343,10 @@ private:
   void     InitSecurity();
   void     ReplaceSetting(XString* m_setting,XString p_potential);
   bool     StartEventStream(const XString& p_url); // Called from EventStream
+  // The real sending of the message (timed by 'Send')
+  bool     SendRequest();
+  // Metrics of the current target server
+  void     FindTargetMetrics();
   // To be done inside a 'Send'
   void     AddProxyInfo();
   void     AddHostHeader();
@@ -388,7 +396,7 @@ private:
   bool     StartEventStreamingThread();
   void     OnCloseSeen();
   // Processing after a send
-  void     ProcessJSONResult(JSONMessage* p_msg,bool& p_result);
+  void     ProcessJSONResult(JSONMessage* p_msg,bool& p_result,XString* p_answer = nullptr);
   // Setting a client certificate on the request handle
   bool     SetClientCertificate(HINTERNET p_request);
   // Running the queue
@@ -486,6 +494,12 @@ private:
   bool          m_logOwner        { false   };                    // Owner of the current logging
   int           m_logLevel        { HLL_NOLOG };                  // Logging level of the client
   HPFCounter    m_counter;                                        // High Performance counter
+  // Metrics of the last target server
+  XString       m_targetServer;                                   // Target of the metrics: server
+  int           m_targetPort      { 0       };                    // Target of the metrics: port
+  bool          m_targetSecure    { false   };                    // Target of the metrics: secure
+  MetricsHistogram* m_targetMetrics { nullptr };                  // Duration of the requests to the target
+  MetricsCounter*   m_targetErrors  { nullptr };                  // Failed requests to the target
   HTTPClientTracing* m_trace      { nullptr };                    // The tracing object
   // WebSocket
   bool          m_websocket       { false   };                    // Try WebSocket handshake
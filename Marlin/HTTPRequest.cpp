@@ -476,6 +476,8 @@ HTTPRequest::ReceivedRequest()
   // Remember the fact that we should read the rest of the message
   if((m_request->Flags & HTTP_REQUEST_FLAG_MORE_ENTITY_BODY_EXISTS) && contentLen > 0)
   {
+    // Form-data of the site can be parsed while receiving
+    m_server->StartStreamingFormData(m_message);
     // Read the body of the message, before we handle it
     StartReceiveRequest();
   }
@@ -540,11 +542,17 @@ HTTPRequest::ReceivedBodyPart()
     if(bytes)
     {
       m_readBuffer[bytes] = 0;
-      m_message->GetFileBuffer()->AddBuffer(m_readBuffer,bytes);
+      if(!m_message->ReceiveBody(m_readBuffer,bytes))
+      {
+        ERRORLOG(ERROR_INVALID_DATA,_T("Invalid multipart/form-data stream"));
+        m_server->RespondWithClientError(m_message,HTTP_STATUS_BAD_REQUEST,_T("Bad request"));
+        Finalize();
+        return;
+      }
     }
 
     // See how far we have come, so we do not read past EOF
-    size_t readSofar = m_message->GetFileBuffer()->GetLength();
+    size_t readSofar = m_message->GetBodyReceived();
     size_t mustRead  = m_message->GetContentLength();
 
     if(result == NO_ERROR && readSofar < mustRead)
@@ -571,6 +579,14 @@ HTTPRequest::PostReceive()
 {
   TRACE0("Post Receive\n");
 
+  // Complete the form-data that was parsed while receiving
+  if(!m_server->EndStreamingFormData(m_message))
+  {
+    m_server->RespondWithClientError(m_message,HTTP_STATUS_BAD_REQUEST,_T("Bad request"));
+    Finalize();
+    return;
+  }
+
   // Now also trace the request body of the message
   m_server->LogTraceRequestBody(m_message->GetFileBuffer(),m_message->GetSendUnicode());
 
@@ -685,17 +701,14 @@ HTTPRequest::SendResponseBody()
   if(filebuf->GetHasBufferParts())
   {
     // FILEBUFFER CONTAINS VARIOUS MEMORY CHUNKS
-    // Send buffer in various chunks
-    uchar* buffer = nullptr;
-    size_t length = 0;
-    filebuf->GetBufferPart(m_bufferpart,buffer,length);
-
-    m_sendChunk.DataChunkType           = HttpDataChunkFromMemory;
-    m_sendChunk.FromMemory.pBuffer      = buffer;
-    m_sendChunk.FromMemory.BufferLength = (ULONG)length;
+    // Send up to BUFFERCHAIN_MAX_CHUNKS parts in one scatter/gather call.
+    // The parts are referenced directly: nothing gets copied
+    chunks     = m_bodyChunks;
+    chunkcount = filebuf->GetBufferChain().GetDataChunks(m_bufferpart,m_bodyChunks,BUFFERCHAIN_MAX_CHUNKS);
 
     // See if there are more buffer parts to come
-    if(++m_bufferpart < filebuf->GetNumberOfParts())
+    m_bufferpart += chunkcount;
+    if(m_bufferpart < filebuf->GetNumberOfParts())
     {
       flags = HTTP_SEND_RESPONSE_FLAG_MORE_DATA;
     }
@@ -1085,8 +1098,9 @@ HTTPRequest::Finalize()
 void 
 HTTPRequest::AddRequestString(XString p_string,LPCSTR& p_buffer,USHORT& p_size)
 {
-  p_size   = (USHORT) p_string.GetLength();
-  p_buffer = new char[p_size + 1];
+  AutoCSTR str(p_string);
+  p_size   = (USHORT) str.size();
+  p_buffer = str.grab();
   m_strings.push_back(p_buffer);
 }
 
@@ -1102,38 +1116,53 @@ HTTPRequest::AddKnownHeader(HTTP_HEADER_ID p_header,LPCTSTR p_value)
   m_response->Headers.KnownHeaders[p_header].RawValueLength = size;
 }
 
+// Add the headers of the message and the extra unknown headers.
+// Known response headers of the message go straight into their slot
 void
-HTTPRequest::AddUnknownHeaders(UKHeaders& p_headers)
+HTTPRequest::AddUnknownHeaders(HeaderMap* p_map,UKHeaders& p_headers)
 {
   TRACE0("Add Unknown Headers\n");
 
   // Something to do?
-  if(p_headers.empty())
+  size_t count = p_headers.size() + (p_map ? p_map->size() : 0);
+  if(count == 0)
   {
     return;
   }
   // Allocate some space
-  m_unknown = (PHTTP_UNKNOWN_HEADER) malloc((1 + p_headers.size()) * sizeof(HTTP_UNKNOWN_HEADER));
+  m_unknown = (PHTTP_UNKNOWN_HEADER) malloc(count * sizeof(HTTP_UNKNOWN_HEADER));
   if(!m_unknown)
   {
     return;
   }
-  unsigned ind = 0;
+  USHORT ind = 0;
+  if(p_map)
+  {
+    for(auto& header : *p_map)
+    {
+      // Multiple 'Set-Cookie' headers cannot use the one known slot
+      int known = IDToResponseHeader(header.m_id);
+      if(known != HEADER_NAME_UNKNOWN && known != HttpHeaderSetCookie &&
+         m_response->Headers.KnownHeaders[known].pRawValue == nullptr)
+      {
+        AddRequestString(header.second
+                        ,m_response->Headers.KnownHeaders[known].pRawValue
+                        ,m_response->Headers.KnownHeaders[known].RawValueLength);
+        continue;
+      }
+      AddRequestString(header.first, m_unknown[ind].pName,    m_unknown[ind].NameLength);
+      AddRequestString(header.second,m_unknown[ind].pRawValue,m_unknown[ind].RawValueLength);
+      ++ind;
+    }
+  }
   for(auto& header : p_headers)
   {
-    AutoCSTR name(header.m_name);
-    header.m_nameStr = name.grab();
-    m_unknown[ind].NameLength = (USHORT) name.size();
-    m_unknown[ind].pName      = header.m_nameStr;
-
-    AutoCSTR value(header.m_value);
-    header.m_valueStr = value.grab();
-    m_unknown[ind].RawValueLength = (USHORT) value.size();
-    m_unknown[ind].pRawValue      = header.m_valueStr;
-
-    // next header
+    AddRequestString(header.m_name, m_unknown[ind].pName,    m_unknown[ind].NameLength);
+    AddRequestString(header.m_value,m_unknown[ind].pRawValue,m_unknown[ind].RawValueLength);
     ++ind;
   }
+  m_response->Headers.UnknownHeaderCount = ind;
+  m_response->Headers.pUnknownHeaders    = m_unknown;
 }
 
 void
@@ -1303,16 +1332,12 @@ HTTPRequest::FillResponse(int p_status,bool p_responseOnly /*=false*/)
   // Add extra headers from the message, except for content-length
   m_message->DelHeader(_T("Content-Length"));
 
+  // The headers of the message are copied from its header map into the response
+  HeaderMap* headers = m_message->GetHeaderMap();
   if(p_status == HTTP_STATUS_SWITCH_PROTOCOLS)
   {
     FillResponseWebSocketHeaders(ukheaders);
-  }
-  else
-  {
-    for(auto& header : *m_message->GetHeaderMap())
-    {
-      ukheaders.push_back(UKHeader(header.first, header.second));
-    }
+    headers = nullptr;
   }
 
   // Add other optional security headers like CORS etc.
@@ -1322,8 +1347,10 @@ HTTPRequest::FillResponse(int p_status,bool p_responseOnly /*=false*/)
   FileBuffer* buffer = m_message->GetFileBuffer();
   if(m_site->GetHTTPCompression() && buffer)
   {
-    // But only if the client side requested it
-    if(m_message->GetAcceptEncoding().Find(_T("gzip")) >= 0)
+    // But only if the client side requested it,
+    // and the content is not already encoded (e.g. from a ZIP webroot)
+    if(m_message->GetAcceptEncoding().Find(_T("gzip")) >= 0 &&
+       m_message->GetHeader(_T("Content-Encoding")).IsEmpty())
     {
       if(buffer->ZipBuffer())
       {
@@ -1333,10 +1360,8 @@ HTTPRequest::FillResponse(int p_status,bool p_responseOnly /*=false*/)
     }
   }
 
-  // Now add all unknown headers to the response
-  AddUnknownHeaders(ukheaders);
-  m_response->Headers.UnknownHeaderCount = (USHORT)ukheaders.size();
-  m_response->Headers.pUnknownHeaders    = m_unknown;
+  // Now add all message headers and unknown headers to the response
+  AddUnknownHeaders(headers,ukheaders);
 
   // See if this request must send a file as part of a 'GET'
   // Or if the content comes from the buffer
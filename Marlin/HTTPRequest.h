@@ -127,8 +127,8 @@ private:
   void PostReceive();
   // Add a well known HTTP header to the response structure
   void AddKnownHeader(HTTP_HEADER_ID p_header,LPCTSTR p_value);
-  // Add previously unknown HTTP headers
-  void AddUnknownHeaders(UKHeaders& p_headers);
+  // Add the message headers and previously unknown HTTP headers
+  void AddUnknownHeaders(HeaderMap* p_map,UKHeaders& p_headers);
   // Fill response structure out of the HTTPMessage
   void FillResponse(int p_status,bool p_responseOnly = false);
   void FillResponseWebSocketHeaders(UKHeaders& p_headers);
@@ -158,6 +158,7 @@ private:
   BYTE*             m_readBuffer { nullptr };   // Read data buffer
   BYTE*             m_sendBuffer { nullptr };   // Send data buffer
   HTTP_DATA_CHUNK   m_sendChunk;                // Send buffer as a chunked info
+  HTTP_DATA_CHUNK   m_bodyChunks[BUFFERCHAIN_MAX_CHUNKS]; // Scatter/gather of the buffer parts
   RequestStrings    m_strings;                  // Strings for headers and such
   HANDLE            m_file       { NULL    };   // File handle for sending a file
   int               m_bufferpart { 0       };   // Buffer part being sent
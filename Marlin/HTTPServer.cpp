@@ -49,6 +49,10 @@
 #include "PrintToken.h"
 #include "Cookie.h"
 #include "Crypto.h"
+#include "MessageCapture.h"
+#include "Metrics.h"
+#include "SiteHandlerMetrics.h"
+#include "MultiPartBuffer.h"
 #include <WinFile.h>
 #include <ServiceReporting.h>
 #include <algorithm>
@@ -143,6 +147,13 @@ HTTPServer::~HTTPServer()
   }
   m_requests.clear();
 
+  // Stop the traffic capture
+  if(m_capture)
+  {
+    delete m_capture;
+    m_capture = nullptr;
+  }
+
   // Clean out the Marlin.config
   if(m_marlinConfig)
   {
@@ -180,28 +191,35 @@ HTTPServer::InitLogging()
     m_log = LogAnalysis::CreateLogfile(m_name);
     m_logOwner = true;
 
-  XString file    = m_log->GetLogFileName();
-  int  cache      = m_log->GetCacheSize();
-  int  logging    = m_log->GetLogLevel();
-  bool timing     = m_log->GetDoTiming();
-  bool events     = m_log->GetDoEvents();
-  bool doLogging  = m_log->GetDoLogging();
-  int  keepfiles  = m_log->GetKeepfiles();
-
-  // Get parameters from Marlin.config
-  file      = m_marlinConfig->GetParameterString (_T("Logging"),_T("Logfile"),  file);
-  doLogging = m_marlinConfig->GetParameterBoolean(_T("Logging"),_T("DoLogging"),doLogging);
-  logging   = m_marlinConfig->GetParameterInteger(_T("Logging"),_T("LogLevel"), logging);
-  timing    = m_marlinConfig->GetParameterBoolean(_T("Logging"),_T("DoTiming"), timing);
-  events    = m_marlinConfig->GetParameterBoolean(_T("Logging"),_T("DoEvents"), events);
-  cache     = m_marlinConfig->GetParameterInteger(_T("Logging"),_T("Cache"),    cache);
-  keepfiles = m_marlinConfig->GetParameterInteger(_T("Logging"),_T("Keep"),     keepfiles);
+  // Get the logfile from Marlin.config
+  XString file = m_marlinConfig->GetParameterString(_T("Logging"),_T("Logfile"),m_log->GetLogFileName());
 
   // Use if overridden in Marlin.config
   if(!file.IsEmpty())
   {
     m_log->SetLogFilename(file);
   }
+
+  // Settings of the logfile itself are the defaults
+  m_liveDefaults.m_logLevel  = m_log->GetLogLevel();
+  m_liveDefaults.m_doTiming  = m_log->GetDoTiming();
+  m_liveDefaults.m_doEvents  = m_log->GetDoEvents();
+  m_liveDefaults.m_logCache  = m_log->GetCacheSize();
+  m_liveDefaults.m_keepfiles = m_log->GetKeepfiles();
+  ApplyLogging(*m_marlinConfig);
+}
+
+// Logging settings that can change while running
+void
+HTTPServer::ApplyLogging(MarlinConfig& p_config)
+{
+  // Get parameters from Marlin.config
+  int  logging   = p_config.GetParameterInteger(_T("Logging"),_T("LogLevel"), m_liveDefaults.m_logLevel);
+  bool timing    = p_config.GetParameterBoolean(_T("Logging"),_T("DoTiming"), m_liveDefaults.m_doTiming);
+  bool events    = p_config.GetParameterBoolean(_T("Logging"),_T("DoEvents"), m_liveDefaults.m_doEvents);
+  int  cache     = p_config.GetParameterInteger(_T("Logging"),_T("Cache"),    m_liveDefaults.m_logCache);
+  int  keepfiles = p_config.GetParameterInteger(_T("Logging"),_T("Keep"),     m_liveDefaults.m_keepfiles);
+
   m_log->SetCache(cache);
   m_log->SetLogLevel(m_logLevel = logging);
   m_log->SetDoTiming(timing);
@@ -213,41 +231,202 @@ HTTPServer::InitLogging()
 void
 HTTPServer::InitThreadPool()
 {
+  // Maximum of the pool itself is the default
+  m_liveDefaults.m_maxThreads = m_pool.GetMaxThreads();
+
   int minThreads = m_marlinConfig->GetParameterInteger(_T("Server"),_T("MinThreads"),NUM_THREADS_MINIMUM);
-  int maxThreads = m_marlinConfig->GetParameterInteger(_T("Server"),_T("MaxThreads"),NUM_THREADS_MAXIMUM);
+  int maxThreads = m_marlinConfig->GetParameterInteger(_T("Server"),_T("MaxThreads"),m_liveDefaults.m_maxThreads);
   int stackSize  = m_marlinConfig->GetParameterInteger(_T("Server"),_T("StackSize"), THREAD_STACKSIZE);
+  XString sizer  = m_marlinConfig->GetParameterString (_T("Server"),_T("PoolSizer"),_T(""));
+  int targetWait = m_marlinConfig->GetParameterInteger(_T("Server"),_T("PoolTargetWait"),SIZER_TARGET_WAIT / 1000);
 
   m_pool.TrySetMinimum(minThreads);
   m_pool.TrySetMaximum(maxThreads);
   m_pool.SetStackSize(stackSize);
+
+  // Optionally size the pool on the waiting time of the work instead of the CPU load
+  PoolSizer* poolSizer = CreatePoolSizer(sizer,(LONGLONG)targetWait * 1000);
+  if(poolSizer && !m_pool.SetSizer(poolSizer))
+  {
+    delete poolSizer;
+  }
+}
+
+// Initialise the traffic capture
+void
+HTTPServer::InitCapture()
+{
+  XString directory = m_marlinConfig->GetParameterString (_T("Server"),_T("CaptureDirectory"),_T(""));
+  int     fileSize  = m_marlinConfig->GetParameterInteger(_T("Server"),_T("CaptureFileSize"),CAPTURE_FILE_SIZE / (1024 * 1024));
+  int     files     = m_marlinConfig->GetParameterInteger(_T("Server"),_T("CaptureFiles"),   CAPTURE_FILES);
+
+  if(!directory.IsEmpty())
+  {
+    StartCapture(directory,(size_t)fileSize * 1024 * 1024,files);
+  }
+}
+
+// Start capturing all request/response traffic to rolling files
+bool
+HTTPServer::StartCapture(XString p_directory,size_t p_fileSize,unsigned p_files)
+{
+  if(m_capture == nullptr)
+  {
+    m_capture = new MessageCapture(m_log);
+  }
+  m_capture->SetLogfile(m_log);
+  if(m_capture->Start(p_directory,p_fileSize,p_files))
+  {
+    DETAILLOGS(_T("Capturing the traffic of the server in: "),p_directory);
+    return true;
+  }
+  return false;
+}
+
+// Recording of the metrics is cheap, so it is 'on' by default
+void
+HTTPServer::InitMetrics()
+{
+  m_liveDefaults.m_metrics = g_metrics.GetActive();
+  bool active = m_marlinConfig->GetParameterBoolean(_T("Server"),_T("Metrics"),m_liveDefaults.m_metrics);
+  g_metrics.SetActive(active);
+  DETAILLOGS(_T("Server-wide metrics recording: "),active ? _T("on") : _T("off"));
+}
+
+// Optionally re-read the Marlin.config as soon as it changes on disk
+// The server and its sites apply the live keys, all others need a restart
+void
+HTTPServer::InitConfigWatcher()
+{
+  if(m_marlinConfig->GetParameterBoolean(_T("Server"),_T("ConfigReload"),false) == false)
+  {
+    return;
+  }
+  m_configWatcher.SetLogfile(m_log);
+  if(m_configWatcher.StartWatching(m_marlinConfig->GetFilename()))
+  {
+    m_configWatcher.AddListener(this);
+    DETAILLOGS(_T("Reloading the configuration on changes of: "),m_marlinConfig->GetFilename());
+  }
+}
+
+// Server-wide keys that can be applied while running
+void
+HTTPServer::GetLiveConfigKeys(ConfigKeys& p_keys)
+{
+  p_keys.insert(_T("Logging/LogLevel"));
+  p_keys.insert(_T("Logging/DoTiming"));
+  p_keys.insert(_T("Logging/DoEvents"));
+  p_keys.insert(_T("Logging/Cache"));
+  p_keys.insert(_T("Logging/Keep"));
+  p_keys.insert(_T("Server/MaxThreads"));
+  p_keys.insert(_T("Server/StreamingLimit"));
+  p_keys.insert(_T("Server/CompressLimit"));
+  p_keys.insert(_T("Server/EventKeepAlive"));
+  p_keys.insert(_T("Server/EventRetryTime"));
+  p_keys.insert(_T("Server/Metrics"));
+}
+
+// Apply a reloaded Marlin.config. Called on the thread of the config watcher
+void
+HTTPServer::ApplyConfig(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed)
+{
+  MarlinConfig& config = p_snapshot->GetConfig();
+
+  // Only the logfile we own. Otherwise it's configured somewhere else
+  if(m_log && m_logOwner)
+  {
+    ApplyLogging(config);
+  }
+  ApplyHardLimits(config);
+  ApplyEventstreamKeepalive(config);
+
+  // The pool can only grow, or shrink to the number of running threads
+  if(p_changed.find(_T("Server/MaxThreads")) != p_changed.end())
+  {
+    int maxThreads = config.GetParameterInteger(_T("Server"),_T("MaxThreads"),m_liveDefaults.m_maxThreads);
+    if(!m_pool.TrySetMaximum(maxThreads))
+    {
+      WARNINGLOG(_T("Cannot set the maximum of the threadpool to: %d"),maxThreads);
+    }
+  }
+  if(p_changed.find(_T("Server/Metrics")) != p_changed.end())
+  {
+    g_metrics.SetActive(config.GetParameterBoolean(_T("Server"),_T("Metrics"),m_liveDefaults.m_metrics));
+  }
+  DETAILLOGV(_T("Server applied %d changed settings of configuration version [%d]"),(int)p_changed.size(),p_snapshot->GetVersion());
+}
+
+// Create a site that serves the server-wide metrics
+// GET on the site gives the Prometheus text format
+// GET on a resource ending in 'json' (or accepting JSON) gives a JSON object
+HTTPSite*
+HTTPServer::CreateMetricsSite(int p_port,XString p_baseURL,bool p_secure /*=false*/)
+{
+  HTTPSite* site = CreateSite(PrefixType::URLPRE_Strong,p_secure,p_port,p_baseURL);
+  if(site == nullptr)
+  {
+    ERRORLOG(ERROR_INVALID_PARAMETER,_T("Cannot create the metrics site: ") + p_baseURL);
+    return nullptr;
+  }
+  site->SetHandler(HTTPCommand::http_get,new SiteHandlerMetrics());
+  if(site->StartSite() == false)
+  {
+    ERRORLOG(ERROR_INVALID_PARAMETER,_T("Cannot start the metrics site: ") + p_baseURL);
+    DeleteSite(p_port,p_baseURL,true);
+    return nullptr;
+  }
+  DETAILLOGS(_T("Serving the server-wide metrics on: "),p_baseURL);
+  return site;
+}
+
+// Stop capturing. The object stays, as threads may still be completing their records
+void
+HTTPServer::StopCapture()
+{
+  if(m_capture)
+  {
+    m_capture->Stop();
+  }
 }
 
 // Initialise the hard server limits in bytes
 void
 HTTPServer::InitHardLimits()
 {
-  g_streaming_limit = m_marlinConfig->GetParameterInteger(_T("Server"),_T("StreamingLimit"),g_streaming_limit);
-  g_compress_limit  = m_marlinConfig->GetParameterInteger(_T("Server"),_T("CompressLimit"),g_compress_limit);
+  m_liveDefaults.m_streaming = g_streaming_limit;
+  m_liveDefaults.m_compress  = g_compress_limit;
+  ApplyHardLimits(*m_marlinConfig);
+}
+
+// Limits are checked before they become visible to the running requests
+void
+HTTPServer::ApplyHardLimits(MarlinConfig& p_config)
+{
+  unsigned long streaming = p_config.GetParameterInteger(_T("Server"),_T("StreamingLimit"),m_liveDefaults.m_streaming);
+  unsigned long compress  = p_config.GetParameterInteger(_T("Server"),_T("CompressLimit"), m_liveDefaults.m_compress);
 
   // Cannot be bigger than 2 GB, otherwise use indirect file access!
-  if(g_streaming_limit > (0x7FFFFFFF))
+  if(streaming > (0x7FFFFFFF))
   {
-    g_streaming_limit = 0x7FFFFFFF;
+    streaming = 0x7FFFFFFF;
   }
   // Should not be smaller than 1MB
-  if(g_streaming_limit < (1024 * 1024))
+  if(streaming < (1024 * 1024))
   {
-    g_streaming_limit = (1024 * 1024);
+    streaming = (1024 * 1024);
   }
   // Should not be bigger than 25 4K pages
-  if(g_compress_limit > (25 * 4 * 1024))
+  if(compress > (25 * 4 * 1024))
   {
-    g_compress_limit = (25 * 4 * 1024);
+    compress = (25 * 4 * 1024);
   }
-  if(g_compress_limit < (4 * 1024))
+  if(compress < (4 * 1024))
   {
-    g_compress_limit = (4 * 1024);
+    compress = (4 * 1024);
   }
+  g_streaming_limit = streaming;
+  g_compress_limit  = compress;
 
   DETAILLOGV(_T("Server hard-limit file-size streaming limit: %d"),g_streaming_limit);
   DETAILLOGV(_T("Server hard-limit compression threshold: %d"),    g_compress_limit);
@@ -257,13 +436,22 @@ HTTPServer::InitHardLimits()
 void
 HTTPServer::InitEventstreamKeepalive()
 {
-  m_eventKeepAlive = m_marlinConfig->GetParameterInteger(_T("Server"),_T("EventKeepAlive"),DEFAULT_EVENT_KEEPALIVE);
-  m_eventRetryTime = m_marlinConfig->GetParameterInteger(_T("Server"),_T("EventRetryTime"),DEFAULT_EVENT_RETRYTIME);
+  ApplyEventstreamKeepalive(*m_marlinConfig);
+}
+
+// Event stream parameters. The event monitor picks them up on its next round
+void
+HTTPServer::ApplyEventstreamKeepalive(MarlinConfig& p_config)
+{
+  ULONG keepAlive = p_config.GetParameterInteger(_T("Server"),_T("EventKeepAlive"),DEFAULT_EVENT_KEEPALIVE);
+  ULONG retryTime = p_config.GetParameterInteger(_T("Server"),_T("EventRetryTime"),DEFAULT_EVENT_RETRYTIME);
 
-  if(m_eventKeepAlive < EVENT_KEEPALIVE_MIN) m_eventKeepAlive = EVENT_KEEPALIVE_MIN;
-  if(m_eventKeepAlive > EVENT_KEEPALIVE_MAX) m_eventKeepAlive = EVENT_KEEPALIVE_MAX;
-  if(m_eventRetryTime < EVENT_RETRYTIME_MIN) m_eventRetryTime = EVENT_RETRYTIME_MIN;
-  if(m_eventRetryTime > EVENT_RETRYTIME_MAX) m_eventRetryTime = EVENT_RETRYTIME_MAX;
+  if(keepAlive < EVENT_KEEPALIVE_MIN) keepAlive = EVENT_KEEPALIVE_MIN;
+  if(keepAlive > EVENT_KEEPALIVE_MAX) keepAlive = EVENT_KEEPALIVE_MAX;
+  if(retryTime < EVENT_RETRYTIME_MIN) retryTime = EVENT_RETRYTIME_MIN;
+  if(retryTime > EVENT_RETRYTIME_MAX) retryTime = EVENT_RETRYTIME_MAX;
+  m_eventKeepAlive = keepAlive;
+  m_eventRetryTime = retryTime;
 
   DETAILLOGV(_T("Server SSE keepalive interval: %d ms"), m_eventKeepAlive);
   DETAILLOGV(_T("Server SSE client retry time : %d ms"), m_eventRetryTime);
@@ -1027,6 +1215,48 @@ HTTPServer::LogSSLConnection(PHTTP_SSL_PROTOCOL_INFO p_sslInfo)
             ,exchange.GetString(),p_sslInfo->KeyExchangeStrength);
 }
 
+// Parse incoming multipart/form-data while it is received
+// So large uploads are not kept in memory, but go straight to temporary files
+void
+HTTPServer::StartStreamingFormData(HTTPMessage* p_message)
+{
+  HTTPSite* site = p_message->GetHTTPSite();
+  if(site == nullptr || !site->GetStreamFormData())
+  {
+    return;
+  }
+  if(p_message->GetContentType().Find(_T("multipart/form-data")) < 0)
+  {
+    return;
+  }
+  MultiPartBuffer* buffer = new MultiPartBuffer(FormDataType::FD_UNKNOWN);
+  if(buffer->StartStreaming(p_message->GetContentType()))
+  {
+    p_message->SetStreamedFormData(buffer);
+    DETAILLOG1(_T("Receiving multipart/form-data as a stream"));
+  }
+  else
+  {
+    delete buffer;
+  }
+}
+
+// Complete the streamed form-data after the last block of the body
+bool
+HTTPServer::EndStreamingFormData(HTTPMessage* p_message)
+{
+  MultiPartBuffer* buffer = p_message->GetStreamedFormData();
+  if(buffer && buffer->GetIsStreaming())
+  {
+    if(!buffer->EndStreaming())
+    {
+      ERRORLOG(ERROR_INVALID_DATA,_T("Incomplete or invalid multipart/form-data stream"));
+      return false;
+    }
+  }
+  return true;
+}
+
 // Handle text-based content-type messages
 void
 HTTPServer::HandleTextContent(HTTPMessage* p_message)
@@ -36,6 +36,7 @@
 #include "LogAnalysis.h"
 #include "HTTPMessage.h"
 #include "MarlinConfig.h"
+#include "ConfigSnapshot.h"
 #include "CreateURLPrefix.h"
 #include "HPFCounter.h"
 #include "ServerEvent.h"
@@ -160,6 +161,7 @@ class JSONMessage;
 class WebServiceServer;
 class WebSocket;
 class RawFrame;
+class MessageCapture;
 
 // Type declarations for mappings
 using SiteMap     = std::map<XString,HTTPSite*>;
@@ -174,6 +176,22 @@ using DDOSMap     = std::vector<DDOS>;
 // All the media types
 extern MediaTypes* g_media;
 
+// Server settings from before the Marlin.config got applied.
+// A key that is removed from a reloaded Marlin.config reverts to these.
+typedef struct _serverLiveDefaults
+{
+  int           m_logLevel   { HLL_NOLOG           };
+  bool          m_doTiming   { true                };
+  bool          m_doEvents   { false               };
+  int           m_logCache   { LOGWRITE_CACHE      };
+  int           m_keepfiles  { LOGWRITE_KEEPFILES  };
+  unsigned long m_streaming  { STREAMING_LIMIT     };
+  unsigned long m_compress   { COMPRESS_LIMIT      };
+  bool          m_metrics    { true                };
+  int           m_maxThreads { NUM_THREADS_MAXIMUM };
+}
+ServerLiveDefaults;
+
 //////////////////////////////////////////////////////////////////////////
 //
 // HTTP Server
@@ -182,7 +200,7 @@ extern MediaTypes* g_media;
 
 // The HTTPServer itself follows here
 //
-class HTTPServer
+class HTTPServer : public ConfigListener
 {
 public:
   HTTPServer(XString p_name);
@@ -251,6 +269,12 @@ public:
   void       SetDetailedLogging(bool p_detail);
   // OPTIONAL: Set (detailed) logging of the server components
   void       SetLogLevel(int p_logLevel);
+  // OPTIONAL: Start capturing all request/response traffic of the sites
+  bool       StartCapture(XString p_directory,size_t p_fileSize,unsigned p_files);
+  // OPTIONAL: Stop capturing the traffic
+  void       StopCapture();
+  // OPTIONAL: Create a site that serves the server-wide metrics (Prometheus text or JSON)
+  HTTPSite*  CreateMetricsSite(int p_port,XString p_baseURL,bool p_secure = false);
 
   // GETTERS
 
@@ -278,8 +302,12 @@ public:
   ULONG       GetEventRetryConnection();
   // Reference to the WebConfigIIS
   MarlinConfig&  GetWebConfig();
+  // Hot reloading of the Marlin.config (if "Server/ConfigReload" is set)
+  ConfigWatcher* GetConfigWatcher();
   // Getting the logfile
   LogAnalysis* GetLogfile();
+  // Getting the traffic capture (if any)
+  MessageCapture* GetCapture();
   // Server session ID for the groups
   HTTP_SERVER_SESSION_ID GetServerSessionID();
   // Getting the request queue (for the group)
@@ -381,6 +409,9 @@ public:
   CRITICAL_SECTION* AcquireSitesLockObject();
   // Handle text-based content-type messages
   void       HandleTextContent(HTTPMessage* p_message);
+  // Parse incoming form-data while receiving the body
+  void       StartStreamingFormData(HTTPMessage* p_message);
+  bool       EndStreamingFormData  (HTTPMessage* p_message);
   // Build the WWW-authenticate challenge
   XString    BuildAuthenticationChallenge(XString p_authScheme,XString p_realm);
   // Find less known verb
@@ -431,6 +462,19 @@ protected:
   virtual void  InitLogging();
   // Initialise the ThreadPool
   virtual void  InitThreadPool();
+  // Initialise the traffic capture
+  virtual void  InitCapture();
+  // Initialise the server-wide metrics
+  virtual void  InitMetrics();
+  // Initialise the hot reloading of the Marlin.config
+  virtual void  InitConfigWatcher();
+  // Settings that can also be applied from a reloaded Marlin.config
+  void          ApplyLogging(MarlinConfig& p_config);
+  void          ApplyHardLimits(MarlinConfig& p_config);
+  void          ApplyEventstreamKeepalive(MarlinConfig& p_config);
+  // Keys of the Marlin.config that we can apply live
+  void          GetLiveConfigKeys(ConfigKeys& p_keys) override;
+  void          ApplyConfig(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed) override;
 
   // Register a URL to listen on
   bool      RegisterSite(const HTTPSite* p_site,const XString& p_urlPrefix);
@@ -477,6 +521,8 @@ protected:
   ULONG                   m_secondsToLive  { 0 };   // Seconds to live in the cache
   ThreadPool              m_pool;                   // Our threadpool for the server
   MarlinConfig*           m_marlinConfig;           // Web.config or Marlin.Config in our current directory
+  ConfigWatcher           m_configWatcher;          // Reloading the Marlin.config on changes
+  ServerLiveDefaults      m_liveDefaults;           // Defaults for a reloaded Marlin.config
   LogAnalysis*            m_log      { nullptr };   // Logging object
   bool                    m_logOwner { false   };   // Server owns the log
   int                     m_logLevel { HLL_NOLOG }; // Detailed logging of the server
@@ -504,6 +550,8 @@ protected:
   CRITICAL_SECTION        m_socketLock;             // Lock to register, find, remove WebSockets
   // Registered DDOS Attacks
   DDOSMap                 m_attacks;                // Registration of DDOS attacks
+  // Traffic capture
+  MessageCapture*         m_capture  { nullptr };   // Capturing request/response pairs
 };
 
 inline XString
@@ -620,12 +668,24 @@ HTTPServer::GetWebConfig()
   return *m_marlinConfig;
 }
 
+inline ConfigWatcher*
+HTTPServer::GetConfigWatcher()
+{
+  return &m_configWatcher;
+}
+
 inline LogAnalysis* 
 HTTPServer::GetLogfile()
 {
   return m_log;
 }
 
+inline MessageCapture*
+HTTPServer::GetCapture()
+{
+  return m_capture;
+}
+
 inline HTTP_SERVER_SESSION_ID 
 HTTPServer::GetServerSessionID()
 {
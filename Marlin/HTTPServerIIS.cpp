@@ -115,6 +115,12 @@ HTTPServerIIS::Initialise()
   // STEP 6: Init the threadpool
   InitThreadPool();
 
+  // STEP 7: Init the traffic capture
+  InitCapture();
+
+  // STEP 8: Init the server-wide metrics
+  InitMetrics();
+
   // We are airborne!
   return (m_initialized = true);
 }
@@ -158,6 +164,9 @@ HTTPServerIIS::Cleanup()
     };
   }
 
+  // Write out the last captured traffic
+  StopCapture();
+
   // Closing the logging file
   if(m_log && m_logOwner)
   {
@@ -636,6 +645,26 @@ HTTPServerIIS::ReceiveIncomingRequest(HTTPMessage* p_message,bool p_utf16)
   // Reading the buffer
   FileBuffer* fbuffer    = p_message->GetFileBuffer();
   BYTE*       bytebuffer = new BYTE[INIT_HTTP_BUFFERSIZE + 1];
+  size_t      totalRead  = fbuffer->GetLength();
+
+  // Form-data of the site can be parsed while receiving
+  // Start with the first block that IIS already gave us
+  StartStreamingFormData(p_message);
+  if(p_message->GetStreamedFormData() && totalRead > 0)
+  {
+    uchar* first  = nullptr;
+    size_t length = 0;
+    fbuffer->GetBufferCopy(first,length);
+    fbuffer->Reset();
+    bool streamed = p_message->ReceiveBody(first,length);
+    delete [] first;
+    if(!streamed)
+    {
+      delete[] bytebuffer;
+      ERRORLOG(ERROR_INVALID_DATA,_T("Invalid multipart/form-data stream"));
+      return false;
+    }
+  }
 
   // Main loop: as long as we must read extra bytes
   while(httpRequest->GetRemainingEntityBytes() > 0)
@@ -655,14 +684,26 @@ HTTPServerIIS::ReceiveIncomingRequest(HTTPMessage* p_message,bool p_utf16)
     // Add to file buffer
     if(received > 0)
     {
-      fbuffer->AddBuffer(bytebuffer,received);
+      totalRead += received;
+      if(!p_message->ReceiveBody(bytebuffer,received))
+      {
+        delete[] bytebuffer;
+        ERRORLOG(ERROR_INVALID_DATA,_T("Invalid multipart/form-data stream"));
+        return false;
+      }
     }
   }
   delete[] bytebuffer;
 
+  // Complete the form-data that was parsed while receiving
+  if(!EndStreamingFormData(p_message))
+  {
+    return false;
+  }
+
     // Check if we received the total predicted message
   // This includes all blocks from initial chunk and extra reads
-  if(fbuffer->GetLength() < contentLength)
+  if(totalRead < contentLength)
   {
       ERRORLOG(ERROR_INVALID_DATA,_T("Total received message shorter dan 'ContentLength' header."));
   }
@@ -1103,8 +1144,10 @@ HTTPServerIIS::SendResponse(HTTPMessage* p_message)
   // Possible zip the contents, and add content-encoding header
   if(p_message->GetHTTPSite()->GetHTTPCompression() && buffer)
   {
-    // But only if the client side requested it
-    if(p_message->GetAcceptEncoding().Find(_T("gzip")) >= 0)
+    // But only if the client side requested it,
+    // and the content is not already encoded (e.g. from a ZIP webroot)
+    if(p_message->GetAcceptEncoding().Find(_T("gzip")) >= 0 &&
+       p_message->GetHeader(_T("Content-Encoding")).IsEmpty())
     {
       if(buffer->ZipBuffer())
       {
@@ -1220,23 +1263,17 @@ HTTPServerIIS::SendResponseBufferParts(IHttpResponse* p_response
                                       ,size_t         p_totalLength
                                       ,bool           p_moredata /*= false*/)
 {
-  int    transmitPart = 0;
-  uchar* entityBuffer = NULL;
-  size_t entityLength = 0;
-  size_t totalSent    = 0;
-  DWORD  bytesSent    = 0;
-  HTTP_DATA_CHUNK dataChunk;
-  memset(&dataChunk,0,sizeof(HTTP_DATA_CHUNK));
+  const BufferChain& chain = p_buffer->GetBufferChain();
+  int       transmitPart = 0;
+  ULONGLONG entityLength = 0;
+  size_t    totalSent    = 0;
+  DWORD     bytesSent    = 0;
+  HTTP_DATA_CHUNK dataChunks[BUFFERCHAIN_MAX_CHUNKS];
 
-  while(p_buffer->GetBufferPart(transmitPart,entityBuffer,entityLength))
+  while(transmitPart < chain.GetNumberOfSlices())
   {
-    if(entityBuffer)
-    {
-      // Add an entity chunk.
-      dataChunk.DataChunkType           = HttpDataChunkFromMemory;
-      dataChunk.FromMemory.pBuffer      = entityBuffer;
-      dataChunk.FromMemory.BufferLength = (ULONG)entityLength;
-    }
+    // Gather as many buffer parts as possible in one call
+    USHORT count = chain.GetDataChunks(transmitPart,dataChunks,BUFFERCHAIN_MAX_CHUNKS,&entityLength);
     // Flag to calculate the last sending part
     bool moreData = p_moredata;
     if(p_moredata == false)
@@ -1245,7 +1282,7 @@ HTTPServerIIS::SendResponseBufferParts(IHttpResponse* p_response
     }
     BOOL completion = false;
 
-    HRESULT hr = p_response->WriteEntityChunks(&dataChunk,1,false,moreData,&bytesSent,&completion);
+    HRESULT hr = p_response->WriteEntityChunks(dataChunks,count,false,moreData,&bytesSent,&completion);
 
     if(SUCCEEDED(hr))
     {
@@ -1257,9 +1294,9 @@ HTTPServerIIS::SendResponseBufferParts(IHttpResponse* p_response
       ERRORLOG(result,_T("HTTP ResponseBufferPart error"));
       break;
     }
-    // Next buffer part
-    totalSent += entityLength;
-    ++transmitPart;
+    // Next buffer parts
+    totalSent    += (size_t)entityLength;
+    transmitPart += count;
   }
 }
 
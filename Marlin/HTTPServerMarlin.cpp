@@ -185,6 +185,15 @@ HTTPServerMarlin::Initialise()
   // STEP 12: Init the ThreadPool
   InitThreadPool();
 
+  // STEP 13: Init the traffic capture
+  InitCapture();
+
+  // STEP 14: Init the server-wide metrics
+  InitMetrics();
+
+  // STEP 15: Optionally reload the Marlin.config on changes
+  InitConfigWatcher();
+
   // We are airborne!
   return (m_initialized = true);
 }
@@ -194,6 +203,10 @@ void
 HTTPServerMarlin::Cleanup()
 {
   ULONG retCode;
+
+  // No more reloading of the configuration
+  m_configWatcher.StopWatching();
+
   AutoCritSec lock1(&m_sitesLock);
   AutoCritSec lock2(&m_eventLock);
 
@@ -286,6 +299,9 @@ HTTPServerMarlin::Cleanup()
     m_initialized = false;
   }
 
+  // Write out the last captured traffic
+  StopCapture();
+
   // Closing the logging file
   if(m_log && m_logOwner)
   {
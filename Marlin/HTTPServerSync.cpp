@@ -168,6 +168,15 @@ HTTPServerSync::Initialise()
   // STEP 12: Init the ThreadPool
   InitThreadPool();
 
+  // STEP 13: Init the traffic capture
+  InitCapture();
+
+  // STEP 14: Init the server-wide metrics
+  InitMetrics();
+
+  // STEP 15: Optionally reload the Marlin.config on changes
+  InitConfigWatcher();
+
   // We are airborne!
   return (m_initialized = true);
 }
@@ -177,6 +186,10 @@ void
 HTTPServerSync::Cleanup()
 {
   ULONG retCode;
+
+  // No more reloading of the configuration
+  m_configWatcher.StopWatching();
+
   AutoCritSec lock1(&m_sitesLock);
   AutoCritSec lock2(&m_eventLock);
 
@@ -262,6 +275,9 @@ HTTPServerSync::Cleanup()
     m_initialized = false;
   }
 
+  // Write out the last captured traffic
+  StopCapture();
+
   // Closing the logging file
   if(m_log && m_logOwner)
   {
@@ -289,6 +305,23 @@ void HTTPSiteCallbackMessage(void* p_argument)
     }
   }
 }
+// Request could not be started before the deadline of the site
+void HTTPSiteCallbackExpired(void* p_argument)
+{
+  HTTPMessage* msg = reinterpret_cast<HTTPMessage*>(p_argument);
+  if(msg)
+  {
+    HTTPSite* site = msg->GetHTTPSite();
+    if(site)
+    {
+      msg->Reset();
+      msg->SetStatus(HTTP_STATUS_SERVICE_UNAVAIL);
+      site->SendResponse(msg);
+    }
+    msg->DropReference();
+  }
+}
+
 void HTTPSiteCallbackEvent(void* p_argument)
 {
   MsgStream* dispatch = reinterpret_cast<MsgStream*>(p_argument);
@@ -622,8 +655,12 @@ HTTPServerSync::RunHTTPServer()
       message->SetReadBuffer(request->Flags & HTTP_REQUEST_FLAG_MORE_ENTITY_BODY_EXISTS);
 
       // Hit the thread pool with this message
+      // In the priority class of the site/handler, and with the deadline of the site
       callback = callback ? callback : HTTPSiteCallbackMessage;
-      m_pool.SubmitWork(callback,reinterpret_cast<void*>(message));
+      WorkPriority priority = site->GetWorkPriority(message->GetCommand());
+      DWORD        waiting  = site->GetWorkDeadline();
+      ULONGLONG    deadline = waiting ? GetTickCount64() + waiting : 0;
+      m_pool.SubmitWork(callback,reinterpret_cast<void*>(message),priority,deadline,HTTPSiteCallbackExpired);
 
       // Ready with this request
       HTTP_SET_NULL_ID(&requestId);
@@ -837,6 +874,9 @@ HTTPServerSync::ReceiveIncomingRequest(HTTPMessage* p_message,bool p_utf16)
 #endif
   }
 
+  // Form-data of the site can be parsed while receiving
+  StartStreamingFormData(p_message);
+
   // Reading loop
   while(reading && totalRead < mustRead)
   {
@@ -851,7 +891,11 @@ HTTPServerSync::ReceiveIncomingRequest(HTTPMessage* p_message,bool p_utf16)
     {
       case NO_ERROR:          // Regular incoming body part
                               entityBuffer[bytesRead] = 0;
-                              p_message->AddBody(entityBuffer,bytesRead);
+                              if(!p_message->ReceiveBody(entityBuffer,bytesRead))
+                              {
+                                reading = false;
+                                retval  = false;
+                              }
                               DETAILLOGV(_T("ReceiveRequestEntityBody [%d] bytes"),bytesRead);
                               totalRead += bytesRead;
                               break;
@@ -859,7 +903,10 @@ HTTPServerSync::ReceiveIncomingRequest(HTTPMessage* p_message,bool p_utf16)
                               if(bytesRead)
                               {
                                 entityBuffer[bytesRead] = 0;
-                                p_message->AddBody(entityBuffer,bytesRead);
+                                if(!p_message->ReceiveBody(entityBuffer,bytesRead))
+                                {
+                                  retval = false;
+                                }
                                 DETAILLOGV(_T("ReceiveRequestEntityBody [%d] bytes"),bytesRead);
                                 totalRead += bytesRead;
                               }
@@ -877,6 +924,12 @@ HTTPServerSync::ReceiveIncomingRequest(HTTPMessage* p_message,bool p_utf16)
   delete [] entityBuffer;
   entityBuffer = nullptr;
 
+  // Complete the form-data that was parsed while receiving
+  if(!EndStreamingFormData(p_message))
+  {
+    retval = false;
+  }
+
   // In case of a POST, try to convert character set before submitting to site
   if(p_message->GetCommand() == HTTPCommand::http_post)
   {
@@ -1166,8 +1219,10 @@ HTTPServerSync::SendResponse(HTTPMessage* p_message)
   // Possible zip the contents, and add content-encoding header
   if(p_message->GetHTTPSite() && p_message->GetHTTPSite()->GetHTTPCompression() && buffer)
   {
-    // But only if the client side requested it
-    if(p_message->GetAcceptEncoding().Find(_T("gzip")) >= 0)
+    // But only if the client side requested it,
+    // and the content is not already encoded (e.g. from a ZIP webroot)
+    if(p_message->GetAcceptEncoding().Find(_T("gzip")) >= 0 &&
+       p_message->GetHeader(_T("Content-Encoding")).IsEmpty())
     {
       if(buffer->ZipBuffer())
       {
@@ -1320,25 +1375,20 @@ HTTPServerSync::SendResponseBufferParts(PHTTP_RESPONSE  p_response
                                        ,FileBuffer*     p_buffer
                                        ,size_t          p_totalLength)
 {
-  int    transmitPart = 0;
-  uchar* entityBuffer = NULL;
-  size_t entityLength = 0;
-  size_t totalSent    = 0;
-  DWORD  bytesSent    = 0;
-  HTTP_DATA_CHUNK dataChunk;
-  memset(&dataChunk,0,sizeof(HTTP_DATA_CHUNK));
+  const BufferChain& chain = p_buffer->GetBufferChain();
+  int       transmitPart = 0;
+  ULONGLONG entityLength = 0;
+  size_t    totalSent    = 0;
+  DWORD     bytesSent    = 0;
+  HTTP_DATA_CHUNK dataChunks[BUFFERCHAIN_MAX_CHUNKS];
 
-  while(p_buffer->GetBufferPart(transmitPart,entityBuffer,entityLength))
+  while(transmitPart < chain.GetNumberOfSlices())
   {
-    if(entityBuffer)
-    {
-      // Add an entity chunk.
-      dataChunk.DataChunkType           = HttpDataChunkFromMemory;
-      dataChunk.FromMemory.pBuffer      = entityBuffer;
-      dataChunk.FromMemory.BufferLength = (ULONG)entityLength;
-      p_response->EntityChunkCount      = 1;
-      p_response->pEntityChunks         = &dataChunk;
-    }
+    // Gather as many buffer parts as possible in one call
+    USHORT count = chain.GetDataChunks(transmitPart,dataChunks,BUFFERCHAIN_MAX_CHUNKS,&entityLength);
+    p_response->EntityChunkCount = count;
+    p_response->pEntityChunks    = dataChunks;
+
     // Flag to calculate the last sending part
     ULONG flags = (totalSent + entityLength) < p_totalLength ? HTTP_SEND_RESPONSE_FLAG_MORE_DATA : 0;
     DWORD  result = 0;
@@ -1369,8 +1419,8 @@ HTTPServerSync::SendResponseBufferParts(PHTTP_RESPONSE  p_response
       result = HttpSendResponseEntityBody(m_requestQueue
                                          ,p_request
                                          ,flags
-                                         ,1
-                                         ,&dataChunk
+                                         ,count
+                                         ,dataChunks
                                          ,&bytesSent
                                          ,NULL
                                          ,NULL
@@ -1384,11 +1434,11 @@ HTTPServerSync::SendResponseBufferParts(PHTTP_RESPONSE  p_response
     }
     else
     {
-      DETAILLOGV(_T("HTTP SendResponsePart [%d] bytes sent"),entityLength);
+      DETAILLOGV(_T("HTTP SendResponsePart [%d] bytes sent"),(int)entityLength);
     }
-    // Next buffer part
-    totalSent += entityLength;
-    ++transmitPart;
+    // Next buffer parts
+    totalSent    += (size_t)entityLength;
+    transmitPart += count;
   }
 }
 
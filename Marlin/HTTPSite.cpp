@@ -34,6 +34,8 @@
 #include "Crypto.h"
 #include "WinINETError.h"
 #include "ErrorReport.h"
+#include "MessageCapture.h"
+#include "Metrics.h"
 #include <WinFile.h>
 #include <winerror.h>
 #include <sddl.h>
@@ -80,6 +82,17 @@ HTTPSite::HTTPSite(HTTPServer*   p_server
   }
   InitializeCriticalSection(&m_filterLock);
   InitializeCriticalSection(&m_sessionLock);
+  InitializeCriticalSection(&m_liveLock);
+  m_live = new SiteLiveSettings();
+  for(auto& shard : m_sequences)
+  {
+    InitializeCriticalSection(&shard.m_lock);
+  }
+
+  // Metrics of a site are kept by the registry, also after the site is gone
+  MetricsLabels labels { { _T("site"),m_prefixURL } };
+  m_metrics       = g_metrics.GetHistogram(_T("marlin_site_request_seconds"),labels,_T("Duration of the requests of a site"));
+  m_metricsErrors = g_metrics.GetCounter  (_T("marlin_site_errors_total"),   labels,_T("Requests of a site ending in an error report"));
 }
 
 HTTPSite::~HTTPSite()
@@ -89,6 +102,12 @@ HTTPSite::~HTTPSite()
   CleanupThrotteling();
   DeleteCriticalSection(&m_filterLock);
   DeleteCriticalSection(&m_sessionLock);
+  DeleteCriticalSection(&m_liveLock);
+  delete m_live;
+  for(auto& shard : m_sequences)
+  {
+    DeleteCriticalSection(&shard.m_lock);
+  }
 }
 
 // Set site's callback function
@@ -117,11 +136,17 @@ HTTPSite::CleanupHandlers()
 void
 HTTPSite::CleanupFilters()
 {
-  for(FilterMap::iterator it = m_filters.begin();it != m_filters.end();++it)
+  AutoCritSec lock(&m_filterLock);
+
+  // First retract the published chain, so no reader can reach the filters
+  FilterMap filters;
+  filters.swap(m_filters);
+  PublishFilters();
+
+  for(FilterMap::iterator it = filters.begin();it != filters.end();++it)
   {
     delete it->second;
   }
-  m_filters.clear();
 }
 
 // Remove all critical sections from the throttling map
@@ -202,6 +227,9 @@ HTTPSite::SetFilter(unsigned p_priority,SiteFilter* p_filter)
   }
   // Remember our site. For some filters this does some processing
   p_filter->SetSite(this);
+  // Latency of this filter in the server-wide metrics
+  MetricsLabels labels { { _T("site"),m_prefixURL },{ _T("filter"),p_filter->GetName() } };
+  p_filter->SetMetrics(g_metrics.GetHistogram(_T("marlin_filter_seconds"),labels,_T("Duration of the calls to a site filter")));
 
   // Lock from here
   AutoCritSec lock(&m_filterLock);
@@ -211,6 +239,7 @@ HTTPSite::SetFilter(unsigned p_priority,SiteFilter* p_filter)
   {
     // Not found: we can add it
     m_filters.insert(std::make_pair(p_priority,p_filter));
+    PublishFilters();
     DETAILLOGV(_T("Setting site filter [%s] for [%s] with priority: %d")
               ,p_filter->GetName().GetString(),m_site.GetString(),p_priority);
     return true;
@@ -276,6 +305,13 @@ HTTPSite::SetHandler(HTTPCommand p_command,SiteHandler* p_handler,bool p_owner /
   // Remember our site
   p_handler->SetSite(this);
 
+  // Latency of the handlers of this command in the server-wide metrics
+  if(m_handlerMetrics[(int)p_command] == nullptr)
+  {
+    MetricsLabels labels { { _T("site"),m_prefixURL },{ _T("command"),headers[(unsigned)p_command] } };
+    m_handlerMetrics[(int)p_command] = g_metrics.GetHistogram(_T("marlin_handler_request_seconds"),labels,_T("Duration of the site handlers per HTTP command"));
+  }
+
   // Register the handler in the handler map
   if(it != m_handlers.end())
   {
@@ -387,15 +423,8 @@ HTTPSite::InitSite(MarlinConfig& p_config)
   else if(level == _T("message")) m_securityLevel = XMLEncryption::XENC_Message;
   else                        m_securityLevel = XMLEncryption::XENC_Plain;
 
-  // Check Unicode forcing
-  m_sendUnicode = p_config.GetParameterBoolean(_T("Server"),_T("RespondUnicode"),m_sendUnicode);
-  m_sendSoapBOM = p_config.GetParameterBoolean(_T("Server"),_T("RespondSoapBOM"),m_sendSoapBOM);
-  m_sendJsonBOM = p_config.GetParameterBoolean(_T("Server"),_T("RespondJsonBOM"),m_sendJsonBOM);
-
-  // Getting various settings
-  m_verbTunneling = p_config.GetParameterBoolean(_T("Server"),_T("VerbTunneling"),  m_verbTunneling);
-  m_compression   = p_config.GetParameterBoolean(_T("Server"),_T("HTTPCompression"),m_compression);
-  m_throttling    = p_config.GetParameterBoolean(_T("Server"),_T("HTTPThrotteling"),m_throttling);
+  // Settings that can also change while running
+  InitLiveSettings(p_config);
 
   // Getting cookie settings
   m_cookieHasSecure = p_config.HasParameter(_T("Cookies"),_T("Secure"));
@@ -445,12 +474,21 @@ HTTPSite::InitSite(MarlinConfig& p_config)
 bool
 HTTPSite::StopSite(bool p_force /*=false*/)
 {
+  // No more changes from a reloaded Marlin.config
+  m_server->GetConfigWatcher()->RemoveListener(this);
+
   // Call all filters 'OnStopSite' methods
   for(auto& filter : m_filters)
   {
     filter.second->OnStopSite();
   }
 
+  // Report the timing of the filters as a last resort
+  if(GetFilterTiming() && !m_filters.empty())
+  {
+    DETAILLOGS(_T("Site filter timing:\n"),GetFilterStatistics());
+  }
+
   // Call all site handlers 'OnStopSite' methods
   for(auto& handler : m_handlers)
   {
@@ -514,6 +552,18 @@ HTTPSite::LogSettings()
     case CookieSameSite::Strict:     sameSite = _T("Strict");     break;
   }
 
+  // One snapshot of the settings that can change while running
+  SiteLiveSettings live(GetLiveSettings());
+
+  // Priority class in the threadpool
+  XString priority;
+  switch(live.m_workPriority)
+  {
+    case WorkPriority::WP_High:   priority = _T("high");   break;
+    case WorkPriority::WP_Normal: priority = _T("normal"); break;
+    case WorkPriority::WP_Low:    priority = _T("low");    break;
+  }
+
   // List other settings of the site
   //         "---------------------------------- : ------------"
   DETAILLOGV(_T("Site HTTP port set to              : %d"),     m_port);
@@ -523,32 +573,35 @@ HTTPSite::LogSettings()
   DETAILLOGS(_T("Site NT-LanManager caching         : "),       m_ntlmCache     ? _T("ON") : _T("OFF"));
   DETAILLOGV(_T("Site a-synchronious SOAP setting to: %sSYNC"), m_async         ? _T("A-") : _T("")   );
   DETAILLOGS(_T("Site accepting Server-Sent-Events  : "),       m_isEventStream ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site allows for HTTP-VERB Tunneling: "),       m_verbTunneling ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site uses HTTP Throtteling         : "),       m_throttling    ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site forces response to UTF-16     : "),       m_sendUnicode   ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site forces SOAP response UTF BOM  : "),       m_sendSoapBOM   ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site forces JSON response UTF BOM  : "),       m_sendJsonBOM   ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site allows for HTTP-VERB Tunneling: "),       live.m_verbTunneling ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site streams incoming form-data    : "),       live.m_streamFormData? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site uses HTTP Throtteling         : "),       live.m_throttling    ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site forces response to UTF-16     : "),       live.m_sendUnicode   ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site forces SOAP response UTF BOM  : "),       live.m_sendSoapBOM   ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site forces JSON response UTF BOM  : "),       live.m_sendJsonBOM   ? _T("ON") : _T("OFF"));
   DETAILLOGS(_T("Site WS-ReliableMessaging setting  : "),       m_reliable      ? _T("ON") : _T("OFF"));
   DETAILLOGS(_T("Site WS-RM needs logged in user    : "),       m_reliableLogIn ? _T("ON") : _T("OFF"));
   DETAILLOGS(_T("Site IFRAME options header         : "),       option);
   DETAILLOGS(_T("Site allows to be IFRAME'd from    : "),       m_xFrameAllowed);
-  DETAILLOGV(_T("Site is HTTPS-only for at least    : %d seconds"),m_hstsMaxAge);
-  DETAILLOGS(_T("Site does allow HTTPS subdomains   : "),       m_hstsSubDomains ? _T("YES"):  _T("NO"));
-  DETAILLOGS(_T("Site does allow content sniffing   : "),       m_xNoSniff       ? _T("NO") : _T("YES"));
-  DETAILLOGS(_T("Site has XSS Protection set to     : "),       m_xXSSProtection ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site has XSS Protection block mode : "),       m_xXSSBlockMode  ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site blocking the browser caching  : "),       m_blockCache     ? _T("ON") : _T("OFF"));
-  DETAILLOGS(_T("Site Cross-Origin-Resource-Sharing : "),       m_useCORS        ? _T("ON") : _T("OFF"));
+  DETAILLOGV(_T("Site is HTTPS-only for at least    : %d seconds"),live.m_hstsMaxAge);
+  DETAILLOGS(_T("Site does allow HTTPS subdomains   : "),       live.m_hstsSubDomains ? _T("YES"):  _T("NO"));
+  DETAILLOGS(_T("Site does allow content sniffing   : "),       live.m_xNoSniff       ? _T("NO") : _T("YES"));
+  DETAILLOGS(_T("Site has XSS Protection set to     : "),       live.m_xXSSProtection ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site has XSS Protection block mode : "),       live.m_xXSSBlockMode  ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site blocking the browser caching  : "),       live.m_blockCache     ? _T("ON") : _T("OFF"));
+  DETAILLOGS(_T("Site Cross-Origin-Resource-Sharing : "),       live.m_useCORS        ? _T("ON") : _T("OFF"));
   DETAILLOG1(XString(_T("Site allows cross-origin           : ")) + (m_allowOrigin.IsEmpty() ? XString(_T("*")) : m_allowOrigin));
   DETAILLOGS(_T("Site CORS allows headers           : "),       m_allowHeaders);
-  DETAILLOGV(_T("Site CORS max age of pre-flight    : %d"),     m_corsMaxAge);
-  DETAILLOGS(_T("Site CORS allows credentials       : "),       m_corsCredentials ? _T("YES") : _T("NO"));
+  DETAILLOGV(_T("Site CORS max age of pre-flight    : %d"),     live.m_corsMaxAge);
+  DETAILLOGS(_T("Site CORS allows credentials       : "),       live.m_corsCredentials ? _T("YES") : _T("NO"));
   DETAILLOGS(_T("Site Cookie secure setting         : "),       m_cookieHasSecure ? m_cookieSecure   ? _T("YES") : _T("NO") : _T("NO"));
   DETAILLOGS(_T("Site Cookie httpOnly setting       : "),       m_cookieHasHttp   ? m_cookieHttpOnly ? _T("YES") : _T("NO") : _T("NO"));
   DETAILLOGS(_T("Site Cookie sameSite setting       : "),       m_cookieHasSame   ? sameSite.GetString() : _T("NO"));
   DETAILLOGS(_T("Site Cookie path setting           : "),       m_cookiePath);
   DETAILLOGS(_T("Site Cookie domain setting         : "),       m_cookieDomain);
   DETAILLOGV(_T("Site Cookie expires setting        : %d min"), m_cookieExpires);
+  DETAILLOGS(_T("Site priority class in threadpool  : "),       priority);
+  DETAILLOGV(_T("Site deadline for starting requests: %d ms"),  live.m_workDeadline);
 }
 
 // Remove the site from the URL group
@@ -633,6 +686,15 @@ HTTPSite::HandleHTTPMessage(HTTPMessage* p_message)
 {
   bool didError = false;
   SiteHandler* handler  = nullptr;
+  CaptureGuard capture(m_server->GetCapture());
+
+  // Measure the total request for the metrics of the site
+  bool metrics = g_metrics.GetActive();
+  LARGE_INTEGER start { 0 };
+  if(metrics)
+  {
+    QueryPerformanceCounter(&start);
+  }
 
   // In case we come from IIS. This is the first entry point in the Server DLL
   // So we alter the thread from the MS-Threadpool from that system to do our
@@ -642,7 +704,7 @@ HTTPSite::HandleHTTPMessage(HTTPMessage* p_message)
   try
   {
     // HTTP Throttling is one call per calling address at the time
-    if(m_throttling)
+    if(GetHTTPThrotteling())
     {
       g_throttle = StartThrottling(p_message);
     }
@@ -672,6 +734,9 @@ HTTPSite::HandleHTTPMessage(HTTPMessage* p_message)
       return;
     }
 
+    // Start a traffic capture record with the request as it came in
+    capture.Start(p_message);
+
     // If site in asynchronous SOAP/XML mode
     if(m_async)
     {
@@ -683,7 +748,7 @@ HTTPSite::HandleHTTPMessage(HTTPMessage* p_message)
     // Call all site filters first, in priority order
     // But only if we do have filters
     bool doPerformHandlers = true;
-    if(!m_filters.empty())
+    if(m_filterChain)
     {
       doPerformHandlers = CallFilters(p_message);
     }
@@ -694,6 +759,7 @@ HTTPSite::HandleHTTPMessage(HTTPMessage* p_message)
       handler = GetSiteHandler(p_message->GetCommand());
       if(handler)
       {
+        MetricsTimer timer(metrics ? m_handlerMetrics[(int)p_message->GetCommand()] : nullptr);
         handler->HandleMessage(p_message);
       }
       else
@@ -708,7 +774,7 @@ HTTPSite::HandleHTTPMessage(HTTPMessage* p_message)
     }
 
     // Remove the throttling lock!
-    if(m_throttling)
+    if(g_throttle)
     {
       EndThrottling(g_throttle);
     }
@@ -751,6 +817,17 @@ HTTPSite::HandleHTTPMessage(HTTPMessage* p_message)
   if(didError)
   {
     PostHandle(p_message);
+    m_metricsErrors->Add();
+  }
+
+  // Request was not answered (yet): capture the request only
+  capture.Close();
+
+  if(metrics)
+  {
+    LARGE_INTEGER stop;
+    QueryPerformanceCounter(&stop);
+    m_metrics->RecordTicks(stop.QuadPart - start.QuadPart);
   }
 
   // End of the line: created in HTTPServer::RunServer
@@ -765,7 +842,7 @@ HTTPSite::PostHandle(HTTPMessage* p_message,bool p_reset /*=true*/)
   try
   {
     // If we did throttling, remove the lock
-    if(m_throttling)
+    if(g_throttle)
     {
       EndThrottling(g_throttle);
     }
@@ -779,7 +856,7 @@ HTTPSite::PostHandle(HTTPMessage* p_message,bool p_reset /*=true*/)
       p_message->GetFileBuffer()->ResetFilename();
       p_message->SetStatus(HTTP_STATUS_SERVER_ERROR);
     }
-    m_server->SendResponse(p_message);
+    SendResponse(p_message);
 
     // See if we need to cleanup after the call for the site handler
     if(g_cleanup)
@@ -818,16 +895,46 @@ HTTPSite::PostHandle(HTTPMessage* p_message,bool p_reset /*=true*/)
 }
 
 // Call the filters in priority order
+// The filter chain is read without locking. Concurrent requests
+// do not wait on each other, even for slow filters
 bool
 HTTPSite::CallFilters(HTTPMessage* p_message)
 {
-  AutoCritSec lock(&m_filterLock);
+  // Leaves the chain, even if a filter throws
+  AutoReaderEpoch reader(m_filterReaders);
+
+  SiteFilterChain* chain = m_filterChain;
+  if(chain == nullptr)
+  {
+    return true;
+  }
 
   // Now call all filters, stopping at first false reaction
   bool result = true;
-  for(FilterMap::iterator it = m_filters.begin(); it != m_filters.end();++it)
+  bool filterTiming = GetFilterTiming();
+  bool timing = filterTiming || g_metrics.GetActive();
+  for(auto& filter : chain->m_filters)
   {
-    if(false == (result = it->second->Handle(p_message)))
+    if(timing)
+    {
+      LARGE_INTEGER start,stop;
+      QueryPerformanceCounter(&start);
+      result = filter->Handle(p_message);
+      QueryPerformanceCounter(&stop);
+      if(filterTiming)
+      {
+        filter->RecordTiming(stop.QuadPart - start.QuadPart);
+      }
+      if(filter->GetMetrics())
+      {
+        filter->GetMetrics()->RecordTicks(stop.QuadPart - start.QuadPart);
+      }
+    }
+    else
+    {
+      result = filter->Handle(p_message);
+    }
+    if(result == false)
     {
       break;
     }
@@ -835,6 +942,28 @@ HTTPSite::CallFilters(HTTPMessage* p_message)
   return result;
 }
 
+// Publish a new immutable snapshot of the filter chain
+// MUST be called with the m_filterLock held!
+// After the swap we wait for the readers, so no reader can have a reference to the old chain.
+// BEWARE: A filter must not set or remove filters from within its 'Handle'
+void
+HTTPSite::PublishFilters()
+{
+  SiteFilterChain* chain = nullptr;
+  if(!m_filters.empty())
+  {
+    chain = new SiteFilterChain();
+    for(const auto& filter : m_filters)
+    {
+      chain->m_filters.push_back(filter.second);
+    }
+  }
+  SiteFilterChain* old = reinterpret_cast<SiteFilterChain*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&m_filterChain),chain));
+
+  m_filterReaders.WaitForReaders();
+  delete old;
+}
+
 // Direct asynchronous response
 void
 HTTPSite::AsyncResponse(HTTPMessage* p_message)
@@ -845,7 +974,7 @@ HTTPSite::AsyncResponse(HTTPMessage* p_message)
   msg->SetCommand(HTTPCommand::http_response);
   msg->SetStatus(HTTP_STATUS_OK);
   msg->GetFileBuffer()->Reset();
-  m_server->SendResponse(msg);
+  SendResponse(msg);
   msg->DropReference();
 
   // Log what we just did
@@ -884,7 +1013,7 @@ HTTPSite::HandleHTTPMessageDefault(HTTPMessage* p_message)
   p_message->GetFileBuffer()->Reset();
   p_message->SetCommand(HTTPCommand::http_response);
   p_message->SetStatus(HTTP_STATUS_BAD_REQUEST);
-  m_server->SendResponse(p_message);
+  SendResponse(p_message);
 }
 
 // Getting the 'ALLOW'ed handlers for the HTTP OPTION request
@@ -926,6 +1055,11 @@ HTTPSite::SendResponse(HTTPMessage* p_message)
 {
   if(m_server)
   {
+    MessageCapture* capture = m_server->GetCapture();
+    if(capture)
+    {
+      capture->CaptureResponse(p_message->GetRequestHandle(),p_message);
+    }
     m_server->SendResponse(p_message);
     return true;
   }
@@ -937,6 +1071,14 @@ HTTPSite::SendResponse(SOAPMessage* p_message)
 {
   if(m_server)
   {
+    // Only build the HTTP answer if the request is being captured
+    MessageCapture* capture = m_server->GetCapture();
+    if(capture && capture->GetIsOpen(p_message->GetRequestHandle()))
+    {
+      HTTPMessage* answer = new HTTPMessage(HTTPCommand::http_response,p_message);
+      capture->CaptureResponse(p_message->GetRequestHandle(),answer);
+      answer->DropReference();
+    }
     m_server->SendResponse(p_message);
     return true;
   }
@@ -948,6 +1090,14 @@ HTTPSite::SendResponse(JSONMessage* p_message)
 {
   if(m_server)
   {
+    // Only build the HTTP answer if the request is being captured
+    MessageCapture* capture = m_server->GetCapture();
+    if(capture && capture->GetIsOpen(p_message->GetRequestHandle()))
+    {
+      HTTPMessage* answer = new HTTPMessage(HTTPCommand::http_response,p_message);
+      capture->CaptureResponse(p_message->GetRequestHandle(),answer);
+      answer->DropReference();
+    }
     m_server->SendResponse(p_message);
     return true;
   }
@@ -968,14 +1118,38 @@ HTTPSite::RemoveFilter(unsigned p_priority)
     ERRORLOG(ERROR_NOT_FOUND,msg);
     return false;
   }
-  // Remove the filter
-  delete it->second;
-  // Remove from map
+  // Remove from map and wait until no reader can use the filter any more
+  SiteFilter* filter = it->second;
   m_filters.erase(it);
+  PublishFilters();
+
+  // Remove the filter
+  delete filter;
 
   return true;
 }
 
+// Report the timing counters of all filters
+XString
+HTTPSite::GetFilterStatistics()
+{
+  AutoCritSec lock(&m_filterLock);
+
+  XString report;
+  for(const auto& filter : m_filters)
+  {
+    SiteFilter* sfilter = filter.second;
+    report.AppendFormat(_T("Filter [%d] %-24s Calls: %I64d Total: %.3f ms Average: %.3f ms Maximum: %.3f ms\n")
+                       ,filter.first
+                       ,sfilter->GetName().GetString()
+                       ,sfilter->GetCallCount()
+                       ,sfilter->GetTotalTime()
+                       ,sfilter->GetAverageTime()
+                       ,sfilter->GetMaximumTime());
+  }
+  return report;
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 // HTTP Throtteling
@@ -1020,6 +1194,7 @@ HTTPSite::EndThrottling(CRITICAL_SECTION*& p_throttle)
 {
   // That easy!
   LeaveCriticalSection(p_throttle);
+  p_throttle = nullptr;
 
   // See if we must start the cleanup process
   // Thread has already serviced the HTTP call
@@ -1162,91 +1337,144 @@ HTTPSite::HttpReliableCheck(SOAPMessage* p_message)
 }
 
 // Normal RM message, try to increment server ID
+// More messages of one sequence can be in flight (client sliding window)
+// so the sequence is checked and updated under the lock of its shard.
 bool
 HTTPSite::RM_HandleMessage(SessionAddress& p_address,SOAPMessage* p_message)
 {
-  SessionSequence* sequence = FindSequence(p_address);
-  if(sequence == NULL)
+  XString clientGUID = p_message->GetClientSequence();
+  XString serverGUID = p_message->GetServerSequence();
+  XString faultString;
+  XString faultDetail;
   {
-    // Return SOAP Fault: Already a sequence for this session
-    SendSOAPFault(p_address
-                 ,p_message
-                 ,_T("Client")
-                 ,_T("No RM sequence found")
-                 ,_T("Client program")
-                 ,_T("No reliable-messaging protocol with 'CreateSequence' found for this connection yet\n")
-                  _T("Server can only respond to WS-ReliableMessaging SOAP protocol. Review your program logic."));
-    return true;
+    SequenceShard& shard = GetSequenceShard(p_address);
+    AutoCritSec lock(&shard.m_lock);
+
+    ReliableMap::iterator it = shard.m_sequences.find(p_address);
+    if(it == shard.m_sequences.end())
+    {
+      faultString = _T("No RM sequence found");
+      faultDetail = _T("No reliable-messaging protocol with 'CreateSequence' found for this connection yet\n")
+                    _T("Server can only respond to WS-ReliableMessaging SOAP protocol. Review your program logic.");
+    }
+    // Check message
+    // 1: Correct client GUID
+    else if(clientGUID.CompareNoCase(it->second.m_serverGUID))
+    {
+      faultString = _T("Wrong RM sequence found");
+      faultDetail = _T("Client send wrong server sequence nonce in ReliableMessaging protocol. Review your program logic");
+    }
+    // 2: Correct server GUID
+    else if(!serverGUID.IsEmpty() && serverGUID.CompareNoCase(it->second.m_clientGUID))
+    {
+      faultString = _T("Wrong RM sequence found");
+      faultDetail = _T("Client send wrong client sequence nonce in ReliableMessaging protocol. Review your program logic");
+    }
+    // 3: Record the client message number. Never deliver a message beyond the window
+    else if(!RM_ReceiveMessage(&(it->second),p_message->GetClientMessageNumber()))
+    {
+      faultString = _T("RM message out of the window");
+      faultDetail.Format(_T("Client sent message number %d, which is more than %d messages ahead of the received messages. Review your settings.")
+                        ,p_message->GetClientMessageNumber()
+                        ,RM_SEQUENCE_WINDOW);
+    }
+    else
+    {
+      SessionSequence* sequence = &(it->second);
+
+      // CHECKS OUT OK, PROCEED TO NEXT MESSAGE
+      // Server saw one more message
+      sequence->m_serverMessageID++;
+
+      // Record in message
+      p_message->SetClientSequence(sequence->m_serverGUID);
+      p_message->SetServerSequence(sequence->m_clientGUID);
+      p_message->SetClientMessageNumber(sequence->m_serverMessageID);
+      RM_Acknowledgement(sequence,p_message);
+      // DO NOT FILL IN THE NONCE, WE ARE RESPONDING ON THIS ID!!
+      // p_message->SetMessageNonce(m_messageGuidID)
+      p_message->SetAddressing(true);
+    }
   }
-  // Check message
-  // 1: Correct client GUID
-  XString clientGUID = p_message->GetClientSequence();
-  if(clientGUID.CompareNoCase(sequence->m_serverGUID))
+  if(!faultString.IsEmpty())
   {
-    // SOAP FAULT
-    SendSOAPFault(p_address
-                 ,p_message
-                 ,_T("Client")
-                 ,_T("Wrong RM sequence found")
-                 ,_T("Client program")
-                 ,_T("Client send wrong server sequence nonce in ReliableMessaging protocol. Review your program logic"));
+    // SOAP FAULT (outside the lock of the shard)
+    SendSOAPFault(p_address,p_message,_T("Client"),faultString,_T("Client program"),faultDetail);
     return true;
   }
-  // 2: Correct server GUID
-  XString serverGUID = p_message->GetServerSequence();
-  if(!serverGUID.IsEmpty() && serverGUID.CompareNoCase(sequence->m_clientGUID))
+  // Server yet to handle real message content
+  return false;
+}
+
+// Record a received client message number in the sequence.
+// The sequence is received up to and including m_clientMessageID.
+// Messages above that (from a window of the client) are kept until the gap is closed.
+// Returns false for a message too far ahead of the window, which may not be delivered.
+bool
+HTTPSite::RM_ReceiveMessage(SessionSequence* p_sequence,int p_number)
+{
+  if(p_number <= p_sequence->m_clientMessageID)
   {
-    // SOAP FAULT
-    SendSOAPFault(p_address
-                 ,p_message
-                 ,_T("Client")
-                 ,_T("Wrong RM sequence found")
-                 ,_T("Client program")
-                 ,_T("Client send wrong client sequence nonce in ReliableMessaging protocol. Review your program logic"));
+    // Retransmission of a message we already saw
     return true;
   }
-  // 3: Check client ID is 1 (one) higher than last
-  if((sequence->m_clientMessageID + 1) == p_message->GetClientMessageNumber())
+  if(p_number == p_sequence->m_clientMessageID + 1)
   {
-    sequence->m_clientMessageID++;
+    p_sequence->m_clientMessageID++;
+
+    // Close the gap with the messages that were ahead of this one
+    std::set<int>::iterator it = p_sequence->m_received.begin();
+    while(it != p_sequence->m_received.end() && *it == p_sequence->m_clientMessageID + 1)
+    {
+      p_sequence->m_clientMessageID++;
+      it = p_sequence->m_received.erase(it);
+    }
+  }
+  else if(p_number - p_sequence->m_clientMessageID <= RM_SEQUENCE_WINDOW)
+  {
+    p_sequence->m_received.insert(p_number);
   }
   else
   {
-    // SOAP FAULT : Handle reliable type 
+    // Too far out of the window. Not recorded, so the client must send it again
+    return false;
   }
+  return true;
+}
 
-  // CHECKS OUT OK, PROCEED TO NEXT MESSAGE
-  // Server saw one more message
-  sequence->m_serverMessageID++;
-
-  // Record in message
-  p_message->SetClientSequence(sequence->m_serverGUID);
-  p_message->SetServerSequence(sequence->m_clientGUID);
-  p_message->SetClientMessageNumber(sequence->m_serverMessageID);
-  p_message->SetServerMessageNumber(sequence->m_clientMessageID);
-  // DO NOT FILL IN THE NONCE, WE ARE RESPONDING ON THIS ID!!
-  // p_message->SetMessageNonce(m_messageGuidID)
-  p_message->SetAddressing(true);
+// Acknowledge all received client messages:
+// the cumulative range up to m_clientMessageID and a selective range for every
+// run of out-of-order messages above the gap.
+void
+HTTPSite::RM_Acknowledgement(SessionSequence* p_sequence,SOAPMessage* p_message)
+{
+  RangeMap& ranges = p_message->GetRangeMap();
+  ranges.clear();
 
-  // Server yet to handle real message content
-  return false;
+  int highest = p_sequence->m_clientMessageID;
+  if(p_sequence->m_clientMessageID > 0)
+  {
+    p_message->SetRange(1,p_sequence->m_clientMessageID);
+  }
+  std::set<int>::iterator it = p_sequence->m_received.begin();
+  while(it != p_sequence->m_received.end())
+  {
+    int lower = *it;
+    int upper = *it;
+    while(++it != p_sequence->m_received.end() && *it == upper + 1)
+    {
+      ++upper;
+    }
+    p_message->SetRange(lower,upper);
+    highest = upper;
+  }
+  // Without a window this is the same as m_clientMessageID
+  p_message->SetServerMessageNumber(highest);
 }
 
 bool
 HTTPSite::RM_HandleCreateSequence(SessionAddress& p_address,SOAPMessage* p_message)
 {
-  SessionSequence* sequence = FindSequence(p_address);
-  if(sequence != NULL)
-  {
-    // Return SOAP Fault: Already a sequence for this session
-    SendSOAPFault(p_address
-                 ,p_message
-                 ,_T("Client")
-                 ,_T("Already a RM sequence")
-                 ,_T("Client program")
-                 ,_T("Program requested a new RM-sequence, but a sequence for this session already exists. Review your program logic."));
-    return true;
-  }
   // Client offers a nonce
   XString guidSequenceClient;
   XMLElement* xmlOffer = p_message->FindElement(_T("Offer"));
@@ -1272,14 +1500,24 @@ HTTPSite::RM_HandleCreateSequence(SessionAddress& p_address,SOAPMessage* p_messa
   // React to 'AcksTo' "/anonymous" or some other user 
 
   // Create the sequence and record offered nonce
-  sequence = CreateSequence(p_address);
-  sequence->m_clientGUID = guidSequenceClient;
+  SessionSequence sequence;
+  if(!CreateSequence(p_address,guidSequenceClient,sequence))
+  {
+    // Return SOAP Fault: Already a sequence for this session
+    SendSOAPFault(p_address
+                 ,p_message
+                 ,_T("Client")
+                 ,_T("Already a RM sequence")
+                 ,_T("Client program")
+                 ,_T("Program requested a new RM-sequence, but a sequence for this session already exists. Review your program logic."));
+    return true;
+  }
 
   // Make CreateSequenceResponse
   p_message->Reset();
 
   // Message body 
-  p_message->SetParameter(_T("Identifier"),sequence->m_serverGUID);
+  p_message->SetParameter(_T("Identifier"),sequence.m_serverGUID);
   XMLElement* accept = p_message->SetParameter(_T("Accept"),_T(""));
   p_message->SetElement(accept,_T("Address"),p_message->GetUnAuthorisedURL());
 
@@ -1290,8 +1528,22 @@ HTTPSite::RM_HandleCreateSequence(SessionAddress& p_address,SOAPMessage* p_messa
 bool
 HTTPSite::RM_HandleLastMessage(SessionAddress& p_address,SOAPMessage* p_message)
 {
-  SessionSequence* sequence = FindSequence(p_address);
-  if(sequence == NULL)
+  bool found   = false;
+  bool already = false;
+  {
+    // Test and record the last message under the lock of the shard
+    SequenceShard& shard = GetSequenceShard(p_address);
+    AutoCritSec lock(&shard.m_lock);
+
+    ReliableMap::iterator it = shard.m_sequences.find(p_address);
+    if(it != shard.m_sequences.end())
+    {
+      found   = true;
+      already = it->second.m_lastMessage;
+      it->second.m_lastMessage = true;
+    }
+  }
+  if(!found)
   {
     // Return SOAP Fault: no sequence for this session
     SendSOAPFault(p_address
@@ -1302,7 +1554,7 @@ HTTPSite::RM_HandleLastMessage(SessionAddress& p_address,SOAPMessage* p_message)
                  ,_T("Program flagged a last-message in a RM-sequence, but the sequence doesn't exist. Review your program logic."));
     return true;
   }
-  if(sequence->m_lastMessage)
+  if(already)
   {
     // SOAP FAULT: already last message
     SendSOAPFault(p_address
@@ -1313,21 +1565,27 @@ HTTPSite::RM_HandleLastMessage(SessionAddress& p_address,SOAPMessage* p_message)
                  ,_T("Program has sent the 'LastMessage' more than once. Review your program logic."));
     return true;
   }
-  // Record the fact that we saw the last message
-  sequence->m_lastMessage = true;
-
-  RM_HandleMessage(p_address,p_message);
+  // Handle as a normal message. A fault has already been sent
+  if(RM_HandleMessage(p_address,p_message))
+  {
+    return true;
+  }
   p_message->Reset();
 
-  ReliableResponse(sequence,p_message);
+  // Respond with the sequence as updated by the message
+  SessionSequence sequence;
+  if(FindSequence(p_address,sequence))
+  {
+    ReliableResponse(sequence,p_message);
+  }
   return true;
 }
 
 bool
 HTTPSite::RM_HandleTerminateSequence(SessionAddress& p_address,SOAPMessage* p_message)
 {
-  SessionSequence* sequence = FindSequence(p_address);
-  if(sequence == NULL)
+  SessionSequence sequence;
+  if(!FindSequence(p_address,sequence))
   {
     // Return SOAP Fault: no sequence for this session
     SendSOAPFault(p_address
@@ -1339,7 +1597,7 @@ HTTPSite::RM_HandleTerminateSequence(SessionAddress& p_address,SOAPMessage* p_me
     return true;
 
   }
-  if(sequence->m_lastMessage == false)
+  if(sequence.m_lastMessage == false)
   {
     // SOAP FAULT: Missing last message
     SendSOAPFault(p_address
@@ -1353,7 +1611,7 @@ HTTPSite::RM_HandleTerminateSequence(SessionAddress& p_address,SOAPMessage* p_me
 
   // Check Sequence to be ended
   XString serverGUID = p_message->GetParameter(_T("Identifier"));
-  if(serverGUID.CompareNoCase(sequence->m_serverGUID))
+  if(serverGUID.CompareNoCase(sequence.m_serverGUID))
   {
     // SOAP FAULT: Missing last message
     SendSOAPFault(p_address
@@ -1367,11 +1625,17 @@ HTTPSite::RM_HandleTerminateSequence(SessionAddress& p_address,SOAPMessage* p_me
 
   // Tell our client that we will end it's nonce
   p_message->Reset();
-  p_message->SetParameter(_T("Identifier"),sequence->m_clientGUID);
+  p_message->SetParameter(_T("Identifier"),sequence.m_clientGUID);
 
-  // Return last response
-  RM_HandleMessage(p_address,p_message);
-  ReliableResponse(sequence,p_message);
+  // Return last response. A fault has already been sent
+  if(RM_HandleMessage(p_address,p_message))
+  {
+    return true;
+  }
+  if(FindSequence(p_address,sequence))
+  {
+    ReliableResponse(sequence,p_message);
+  }
 
   // Remove the sequence legally
   RemoveSequence(p_address);
@@ -1395,63 +1659,94 @@ HTTPSite::DebugPrintSessionAddress(XString p_prefix,SessionAddress& p_address)
   DETAILLOGV(_T("Session abs. path  : %s"),p_address.m_absPath.GetString());
 }
 
-SessionSequence*
-HTTPSite::FindSequence(SessionAddress& p_address)
+// Find the shard of the sequences of a session address.
+// Only uses the members that are compared by the AddressCompare
+SequenceShard&
+HTTPSite::GetSequenceShard(SessionAddress& p_address)
 {
-  // Lock for the m_sequences map
-  AutoCritSec lock(&m_sessionLock);
+  // FNV-1a hash of the address
+  unsigned hash = 2166136261U;
+  auto add = [&hash](const void* p_data,size_t p_size)
+  {
+    const BYTE* data = reinterpret_cast<const BYTE*>(p_data);
+    for(size_t ind = 0; ind < p_size; ++ind)
+    {
+      hash = (hash ^ data[ind]) * 16777619U;
+    }
+  };
+  add(&p_address.m_address,sizeof(ULONG));
+  add(&p_address.m_desktop,sizeof(UINT));
+  add(p_address.m_absPath.GetString(),p_address.m_absPath.GetLength() * sizeof(TCHAR));
+  add(p_address.m_userSID.GetString(),p_address.m_userSID.GetLength() * sizeof(TCHAR));
+
+  return m_sequences[hash % RM_SEQUENCE_SHARDS];
+}
+
+// Copy of the sequence, as it can change as soon as the lock is released
+bool
+HTTPSite::FindSequence(SessionAddress& p_address,SessionSequence& p_sequence)
+{
+  // Lock for the sequences of this shard
+  SequenceShard& shard = GetSequenceShard(p_address);
+  AutoCritSec lock(&shard.m_lock);
 
 // #ifdef _DEBUG
 //   DebugPrintSessionAddress("Find sequence",p_address)
 // #endif
 
-  ReliableMap::iterator it = m_sequences.find(p_address);
-  if(it != m_sequences.end())
+  ReliableMap::iterator it = shard.m_sequences.find(p_address);
+  if(it != shard.m_sequences.end())
   {
-    return &(it->second);
+    p_sequence = it->second;
+    return true;
   }
-  return NULL;
+  return false;
 }
 
-SessionSequence*
-HTTPSite::CreateSequence(SessionAddress& p_address)
+// Create a new sequence with the nonce offered by the client.
+// Fails if the session already has a sequence.
+bool
+HTTPSite::CreateSequence(SessionAddress& p_address,XString p_clientGUID,SessionSequence& p_sequence)
 {
-  // Lock for the m_sequences map
-  AutoCritSec lock(&m_sessionLock);
+  // Lock for the sequences of this shard
+  SequenceShard& shard = GetSequenceShard(p_address);
+  AutoCritSec lock(&shard.m_lock);
 
 // #ifdef _DEBUG
 //   DebugPrintSessionAddress("CreateSequence",p_address)
 // #endif
 
+  if(shard.m_sequences.find(p_address) != shard.m_sequences.end())
+  {
+    return false;
+  }
   SessionSequence sequence;
   sequence.m_serverGUID      = _T("urn:uuid:") + GenerateGUID();
+  sequence.m_clientGUID      = p_clientGUID;
   sequence.m_clientMessageID = 1;
   sequence.m_serverMessageID = 0;
   sequence.m_lastMessage     = false;
 
-  m_sequences.insert(std::make_pair(p_address,sequence));
-  ReliableMap::iterator it = m_sequences.find(p_address);
-  if(it != m_sequences.end())
-  {
-    return &(it->second); 
-  }
-  return NULL;
+  shard.m_sequences.insert(std::make_pair(p_address,sequence));
+  p_sequence = sequence;
+  return true;
 }
 
 void
 HTTPSite::RemoveSequence(SessionAddress& p_address)
 {
-  // Lock for the m_sequences map
-  AutoCritSec lock(&m_sessionLock);
+  // Lock for the sequences of this shard
+  SequenceShard& shard = GetSequenceShard(p_address);
+  AutoCritSec lock(&shard.m_lock);
 
 // #ifdef _DEBUG
 //   DebugPrintSessionAddress("RemoveSequence",p_address)
 // #endif
 
-  ReliableMap::iterator it = m_sequences.find(p_address);
-  if(it != m_sequences.end())
+  ReliableMap::iterator it = shard.m_sequences.find(p_address);
+  if(it != shard.m_sequences.end())
   {
-    m_sequences.erase(it);
+    shard.m_sequences.erase(it);
   }
 }
 
@@ -1473,19 +1768,19 @@ HTTPSite::SendSOAPFault(SessionAddress& p_address
   p_message->SetFault(p_code,p_actor,p_string,p_detail);
 
   // Send as an SOAP Message
-  m_server->SendResponse(p_message);
+  SendResponse(p_message);
 }
 
 // Return ReliableMessaging response to the client
 void
-HTTPSite::ReliableResponse(SessionSequence* p_sequence,SOAPMessage* p_message)
+HTTPSite::ReliableResponse(const SessionSequence& p_sequence,SOAPMessage* p_message)
 {
   p_message->SetReliability(m_reliable,false);
   // REVERSE SEQUENCES AND ID'S, SO CLIENT WILL REACT CORRECTLY
-  p_message->SetClientSequence(p_sequence->m_serverGUID);
-  p_message->SetServerSequence(p_sequence->m_clientGUID);
-  p_message->SetClientMessageNumber(p_sequence->m_serverMessageID);
-  p_message->SetServerMessageNumber(p_sequence->m_clientMessageID);
+  p_message->SetClientSequence(p_sequence.m_serverGUID);
+  p_message->SetServerSequence(p_sequence.m_clientGUID);
+  p_message->SetClientMessageNumber(p_sequence.m_serverMessageID);
+  p_message->SetServerMessageNumber(p_sequence.m_clientMessageID);
   // DO NOT FILL IN THE NONCE, WE ARE RESPONDING ON THIS ID!!
   // p_message->SetMessageNonce(m_messageGuidID)
   p_message->SetAddressing(true);
@@ -1499,7 +1794,7 @@ HTTPSite::ReliableResponse(SessionSequence* p_sequence,SOAPMessage* p_message)
   }
 
   // Send as a SOAP response, HTTP_STATUS = OK
-  m_server->SendResponse(p_message);
+  SendResponse(p_message);
 }
 
 // Get user SID from an internal SID
@@ -1816,28 +2111,88 @@ HTTPSite::SetXFrameOptions(XFrameOption p_option,XString p_uri)
 void
 HTTPSite::SetStrictTransportSecurity(unsigned p_maxAge,bool p_subDomains)
 {
-  m_hstsMaxAge = p_maxAge;
-  m_hstsSubDomains = p_subDomains;
+  AutoCritSec lock(&m_liveLock);
+  SiteLiveSettings settings(*m_live);
+  settings.m_hstsMaxAge     = p_maxAge;
+  settings.m_hstsSubDomains = p_subDomains;
+  PublishLiveSettings(settings);
 }
 
 // No sniffing of my context type (ASCII/UTF-8 etc)
 void
 HTTPSite::SetXContentTypeOptions(bool p_nosniff)
 {
-  m_xNoSniff = p_nosniff;
+  ChangeLiveSetting(&SiteLiveSettings::m_xNoSniff,p_nosniff);
 }
 
 void
 HTTPSite::SetXSSProtection(bool p_on,bool p_block)
 {
-  m_xXSSProtection = p_on;
-  m_xXSSBlockMode = p_block;
+  AutoCritSec lock(&m_liveLock);
+  SiteLiveSettings settings(*m_live);
+  settings.m_xXSSProtection = p_on;
+  settings.m_xXSSBlockMode  = p_block;
+  PublishLiveSettings(settings);
 }
 
 void
 HTTPSite::SetBlockCacheControl(bool p_block)
 {
-  m_blockCache = p_block;
+  ChangeLiveSetting(&SiteLiveSettings::m_blockCache,p_block);
+}
+
+void
+HTTPSite::SetSendUnicode(bool p_unicode)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_sendUnicode,p_unicode);
+}
+
+void
+HTTPSite::SetSendSoapBOM(bool p_bom)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_sendSoapBOM,p_bom);
+}
+
+void
+HTTPSite::SetSendJsonBOM(bool p_bom)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_sendJsonBOM,p_bom);
+}
+
+void
+HTTPSite::SetVerbTunneling(bool p_tunnel)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_verbTunneling,p_tunnel);
+}
+
+void
+HTTPSite::SetStreamFormData(bool p_stream)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_streamFormData,p_stream);
+}
+
+void
+HTTPSite::SetHTTPCompression(bool p_compression)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_compression,p_compression);
+}
+
+void
+HTTPSite::SetHTTPThrotteling(bool p_throttel)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_throttling,p_throttel);
+}
+
+void
+HTTPSite::SetUseCORS(bool p_use)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_useCORS,p_use);
+}
+
+void
+HTTPSite::SetCORSMaxAge(unsigned p_maxAge)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_corsMaxAge,p_maxAge);
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -1846,6 +2201,141 @@ HTTPSite::SetBlockCacheControl(bool p_block)
 //
 //////////////////////////////////////////////////////////////////////////
 
+// Settings that can be applied again from a reloaded Marlin.config
+// The values of the first call (compiled-in or set by the application)
+// are kept as the defaults, so a key removed from the file reverts to them.
+void
+HTTPSite::InitLiveSettings(MarlinConfig& p_config)
+{
+  SiteLiveSettings settings(GetLiveSettings());
+  if(!m_liveDefaulted)
+  {
+    m_liveDefaults  = settings;
+    m_liveDefaulted = true;
+  }
+  ReadLiveSettings(p_config,settings);
+  SetLiveSettings(settings);
+}
+
+// A copy of the published snapshot. Requests needing more than one
+// setting take one copy, so all of them come from the same snapshot.
+SiteLiveSettings
+HTTPSite::GetLiveSettings()
+{
+  AutoReaderEpoch reader(m_liveReaders);
+  return *m_live;
+}
+
+void
+HTTPSite::SetLiveSettings(const SiteLiveSettings& p_settings)
+{
+  AutoCritSec lock(&m_liveLock);
+  PublishLiveSettings(p_settings);
+}
+
+template<typename T>
+void
+HTTPSite::ChangeLiveSetting(T SiteLiveSettings::* p_setting,T p_value)
+{
+  AutoCritSec lock(&m_liveLock);
+  SiteLiveSettings settings(*m_live);
+  settings.*p_setting = p_value;
+  PublishLiveSettings(settings);
+}
+
+// Swap in a new snapshot and retire the old one when no request reads it anymore
+void
+HTTPSite::PublishLiveSettings(const SiteLiveSettings& p_settings)
+{
+  SiteLiveSettings* live = new SiteLiveSettings(p_settings);
+  SiteLiveSettings* old  = reinterpret_cast<SiteLiveSettings*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&m_live),live));
+
+  m_liveReaders.WaitForReaders();
+  delete old;
+}
+
+// Read the live settings from a config file. The current values are the defaults
+/* static */ void
+HTTPSite::ReadLiveSettings(MarlinConfig& p_config,SiteLiveSettings& p_settings)
+{
+  // Check Unicode forcing
+  p_settings.m_sendUnicode = p_config.GetParameterBoolean(_T("Server"),_T("RespondUnicode"),p_settings.m_sendUnicode);
+  p_settings.m_sendSoapBOM = p_config.GetParameterBoolean(_T("Server"),_T("RespondSoapBOM"),p_settings.m_sendSoapBOM);
+  p_settings.m_sendJsonBOM = p_config.GetParameterBoolean(_T("Server"),_T("RespondJsonBOM"),p_settings.m_sendJsonBOM);
+
+  // Getting various settings
+  p_settings.m_verbTunneling = p_config.GetParameterBoolean(_T("Server"),_T("VerbTunneling"),  p_settings.m_verbTunneling);
+  p_settings.m_compression   = p_config.GetParameterBoolean(_T("Server"),_T("HTTPCompression"),p_settings.m_compression);
+  p_settings.m_throttling    = p_config.GetParameterBoolean(_T("Server"),_T("HTTPThrotteling"),p_settings.m_throttling);
+  p_settings.m_filterTiming  = p_config.GetParameterBoolean(_T("Server"),_T("FilterTiming"),   p_settings.m_filterTiming);
+  p_settings.m_streamFormData= p_config.GetParameterBoolean(_T("Server"),_T("StreamFormData"), p_settings.m_streamFormData);
+  p_settings.m_workDeadline  = (DWORD) p_config.GetParameterInteger(_T("Server"),_T("WorkDeadline"),(int)p_settings.m_workDeadline);
+
+  // Priority class of the requests in the threadpool
+  XString priority = p_config.GetParameterString(_T("Server"),_T("WorkPriority"),_T(""));
+       if(priority.CompareNoCase(_T("high"))   == 0) p_settings.m_workPriority = WorkPriority::WP_High;
+  else if(priority.CompareNoCase(_T("normal")) == 0) p_settings.m_workPriority = WorkPriority::WP_Normal;
+  else if(priority.CompareNoCase(_T("low"))    == 0) p_settings.m_workPriority = WorkPriority::WP_Low;
+
+  // Automatic headers without a string value
+  p_settings.m_hstsMaxAge      = p_config.GetParameterInteger(_T("Security"), _T("HSTSMaxAge"),            p_settings.m_hstsMaxAge);
+  p_settings.m_hstsSubDomains  = p_config.GetParameterBoolean(_T("Security"), _T("HSTSSubDomains"),        p_settings.m_hstsSubDomains);
+  p_settings.m_xNoSniff        = p_config.GetParameterBoolean(_T("Security"), _T("ContentNoSniff"),        p_settings.m_xNoSniff);
+  p_settings.m_xXSSProtection  = p_config.GetParameterBoolean(_T("Security"), _T("XSSProtection"),         p_settings.m_xXSSProtection);
+  p_settings.m_xXSSBlockMode   = p_config.GetParameterBoolean(_T("Security"), _T("XSSBlockMode"),          p_settings.m_xXSSBlockMode);
+  p_settings.m_blockCache      = p_config.GetParameterBoolean(_T("Security"), _T("NoCacheControl"),        p_settings.m_blockCache);
+  p_settings.m_useCORS         = p_config.GetParameterBoolean(_T("Security"), _T("CORS"),                  p_settings.m_useCORS);
+  p_settings.m_corsMaxAge      = p_config.GetParameterInteger(_T("Security"), _T("CORS_MaxAge"),           p_settings.m_corsMaxAge);
+  p_settings.m_corsCredentials = p_config.GetParameterBoolean(_T("Security"), _T("CORS_AllowCredentials"), p_settings.m_corsCredentials);
+}
+
+// Keys of the settings above
+void
+HTTPSite::GetLiveConfigKeys(ConfigKeys& p_keys)
+{
+  p_keys.insert(_T("Server/RespondUnicode"));
+  p_keys.insert(_T("Server/RespondSoapBOM"));
+  p_keys.insert(_T("Server/RespondJsonBOM"));
+  p_keys.insert(_T("Server/VerbTunneling"));
+  p_keys.insert(_T("Server/HTTPCompression"));
+  p_keys.insert(_T("Server/HTTPThrotteling"));
+  p_keys.insert(_T("Server/FilterTiming"));
+  p_keys.insert(_T("Server/StreamFormData"));
+  p_keys.insert(_T("Server/WorkDeadline"));
+  p_keys.insert(_T("Server/WorkPriority"));
+  p_keys.insert(_T("Security/HSTSMaxAge"));
+  p_keys.insert(_T("Security/HSTSSubDomains"));
+  p_keys.insert(_T("Security/ContentNoSniff"));
+  p_keys.insert(_T("Security/XSSProtection"));
+  p_keys.insert(_T("Security/XSSBlockMode"));
+  p_keys.insert(_T("Security/NoCacheControl"));
+  p_keys.insert(_T("Security/CORS"));
+  p_keys.insert(_T("Security/CORS_MaxAge"));
+  p_keys.insert(_T("Security/CORS_AllowCredentials"));
+}
+
+// Apply a reloaded Marlin.config. Called on the thread of the config watcher
+// Just as in StartSite, the config file of the site overrides the server settings
+void
+HTTPSite::ApplyConfig(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed)
+{
+  // Start from the defaults, so that removed keys revert
+  SiteLiveSettings settings(m_liveDefaults);
+  ReadLiveSettings(p_snapshot->GetConfig(),settings);
+
+  XString siteConfigFile = MarlinConfig::GetSiteConfig(m_prefixURL);
+  if(!siteConfigFile.IsEmpty())
+  {
+    MarlinConfig config(siteConfigFile);
+    if(config.IsFilled())
+    {
+      ReadLiveSettings(config,settings);
+    }
+  }
+  SetLiveSettings(settings);
+  DETAILLOGV(_T("Site [%s] applied %d changed settings of configuration version [%d]"),m_site.GetString(),(int)p_changed.size(),p_snapshot->GetVersion());
+}
+
 // Set automatic headers upon starting site
 void
 HTTPSite::SetAutomaticHeaders(MarlinConfig& p_config)
@@ -1864,17 +2354,8 @@ HTTPSite::SetAutomaticHeaders(MarlinConfig& p_config)
   // Read everything from the webconfig
   option            = p_config.GetParameterString (_T("Security"), _T("XFrameOption"),          option);
   m_xFrameAllowed   = p_config.GetParameterString (_T("Security"), _T("XFrameAllowed"),         m_xFrameAllowed);
-  m_hstsMaxAge      = p_config.GetParameterInteger(_T("Security"), _T("HSTSMaxAge"),            m_hstsMaxAge);
-  m_hstsSubDomains  = p_config.GetParameterBoolean(_T("Security"), _T("HSTSSubDomains"),        m_hstsSubDomains);
-  m_xNoSniff        = p_config.GetParameterBoolean(_T("Security"), _T("ContentNoSniff"),        m_xNoSniff);
-  m_xXSSProtection  = p_config.GetParameterBoolean(_T("Security"), _T("XSSProtection"),         m_xXSSProtection);
-  m_xXSSBlockMode   = p_config.GetParameterBoolean(_T("Security"), _T("XSSBlockMode"),          m_xXSSBlockMode);
-  m_blockCache      = p_config.GetParameterBoolean(_T("Security"), _T("NoCacheControl"),        m_blockCache);
-  m_useCORS         = p_config.GetParameterBoolean(_T("Security"), _T("CORS"),                  m_useCORS);
   m_allowOrigin     = p_config.GetParameterString (_T("Security"), _T("CORS_AllowOrigin"),      m_allowOrigin);
   m_allowHeaders    = p_config.GetParameterString (_T("Security"), _T("CORS_AllowHeaders"),     m_allowHeaders);
-  m_corsMaxAge      = p_config.GetParameterInteger(_T("Security"), _T("CORS_MaxAge"),           m_corsMaxAge);
-  m_corsCredentials = p_config.GetParameterBoolean(_T("Security"), _T("CORS_AllowCredentials"), m_corsCredentials);
 
   // Translate X-Frame options back
        if(option.CompareNoCase(_T("DENY"))        == 0) m_xFrameOption = XFrameOption::XFO_DENY;
@@ -1888,6 +2369,8 @@ void
 HTTPSite::AddSiteOptionalHeaders(UKHeaders& p_headers)
 {
   XString value;
+  // All headers from one snapshot of the settings
+  SiteLiveSettings live(GetLiveSettings());
 
   // Add X-Frame-Options
   if(m_xFrameOption != XFrameOption::XFO_NO_OPTION)
@@ -1903,25 +2386,25 @@ HTTPSite::AddSiteOptionalHeaders(UKHeaders& p_headers)
     p_headers.push_back(UKHeader(_T("X-Frame-Options"),value));
   }
   // Add HSTS headers
-  if(m_hstsMaxAge > 0)
+  if(live.m_hstsMaxAge > 0)
   {
-    value.Format(_T("max-age=%u"),m_hstsMaxAge);
-    if(m_hstsSubDomains)
+    value.Format(_T("max-age=%u"),live.m_hstsMaxAge);
+    if(live.m_hstsSubDomains)
     {
       value += _T("; includeSubDomains");
     }
     p_headers.push_back(UKHeader(_T("Strict-Transport-Security"),value));
   }
   // Browsers should take our content-type for granted!!
-  if(m_xNoSniff)
+  if(live.m_xNoSniff)
   {
     p_headers.push_back(UKHeader(_T("X-Content-Type-Options"),_T("nosniff")));
   }
   // Add protection against XSS 
-  if(m_xXSSProtection)
+  if(live.m_xXSSProtection)
   {
     value = _T("1");
-    if(m_xXSSBlockMode)
+    if(live.m_xXSSBlockMode)
     {
       value += _T("; mode=block");
     }
@@ -1929,7 +2412,7 @@ HTTPSite::AddSiteOptionalHeaders(UKHeaders& p_headers)
   }
   // Blocking the browser cache for this site!
   // Use for responsive applications only!
-  if(m_blockCache)
+  if(live.m_blockCache)
   {
     p_headers.push_back(UKHeader(_T("Cache-Control"),_T("no-store, no-cache, must-revalidate, max-age=0, post-check=0, pre-check=0")));
     p_headers.push_back(UKHeader(_T("Pragma"),_T("no-cache")));
@@ -1937,7 +2420,7 @@ HTTPSite::AddSiteOptionalHeaders(UKHeaders& p_headers)
   }
 
   // If we use CORS, make sure we advertise the origin
-  if(m_useCORS)
+  if(live.m_useCORS)
   {
     p_headers.push_back(UKHeader(_T("Access-Control-Allow-Origin"),m_allowOrigin.IsEmpty() ? XString(_T("*")) : m_allowOrigin));
   }
@@ -1997,3 +2480,54 @@ HTTPSite::SetCookiesMaxAge(int p_seconds)
   m_cookieMaxAge    = p_seconds;
   m_cookieHasMaxAge = p_seconds > 0;
 }
+
+void
+HTTPSite::SetFilterTiming(bool p_timing)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_filterTiming,p_timing);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Scheduling of the requests in the threadpool
+//
+//////////////////////////////////////////////////////////////////////////
+
+void
+HTTPSite::SetWorkPriority(WorkPriority p_priority)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_workPriority,p_priority);
+}
+
+// Handler for the command must already be set
+bool
+HTTPSite::SetWorkPriority(HTTPCommand p_command,WorkPriority p_priority)
+{
+  RegHandler* reg = FindSiteHandler(p_command);
+  if(reg == nullptr)
+  {
+    ERRORLOG(ERROR_NOT_FOUND,_T("No site handler for the priority class of an HTTP command"));
+    return false;
+  }
+  reg->m_ownPriority = true;
+  reg->m_priority    = p_priority;
+  return true;
+}
+
+void
+HTTPSite::SetWorkDeadline(DWORD p_milliseconds)
+{
+  ChangeLiveSetting(&SiteLiveSettings::m_workDeadline,p_milliseconds);
+}
+
+// Priority class of the handler, or of the site as a whole
+WorkPriority
+HTTPSite::GetWorkPriority(HTTPCommand p_command)
+{
+  RegHandler* reg = FindSiteHandler(p_command);
+  if(reg && reg->m_ownPriority)
+  {
+    return reg->m_priority;
+  }
+  return GetLiveSettings().m_workPriority;
+}
@@ -35,7 +35,9 @@
 #include "SiteFilter.h"
 #include "SiteHandler.h"
 #include "Cookie.h"
+#include "ReaderEpoch.h"
 #include <map>
+#include <set>
 
 // Session address for reliable messaging
 class SessionAddress
@@ -53,9 +55,10 @@ class SessionSequence
 public:
   XString m_clientGUID;             // Client challenging nonce
   XString m_serverGUID;             // Server challenging nonce
-  int     m_clientMessageID { 0 };  // Clients message number
+  int     m_clientMessageID { 0 };  // Clients message number (all below received)
   int     m_serverMessageID { 0 };  // Servers message number
   bool    m_lastMessage { false };  // Last message in stream flag
+  std::set<int> m_received;         // Out-of-order client messages above m_clientMessageID
 };
 
 // Operator for associative mapping for the internet addresses
@@ -94,20 +97,31 @@ enum class XFrameOption
 // Special callback options for different handlers
 void HTTPSiteCallbackMessage(void* p_argument);
 void HTTPSiteCallbackEvent  (void* p_argument);
+void HTTPSiteCallbackExpired(void* p_argument);
 
 // Default maximum number of HTTP Throttling addresses
 constexpr long MAX_HTTP_THROTTLES = 1000;
 
+// Number of shards of the WS-RM sequences (each with its own lock)
+constexpr int RM_SEQUENCE_SHARDS = 16;
+// Maximum distance of an out-of-order message from the acknowledged part of a sequence
+constexpr int RM_SEQUENCE_WINDOW = 256;
+
 class HTTPURLGroup;
 class MarlinConfig;
 class SiteFilter;
+class SiteFilterChain;
 class SiteHandler;
+class MetricsHistogram;
+class MetricsCounter;
 
 // Keeping a mapping of all the site handlers
 typedef struct _regHandler
 {
   SiteHandler* m_handler;
   bool         m_owner;
+  bool         m_ownPriority { false };                   // Handler has its own priority class
+  WorkPriority m_priority    { WorkPriority::WP_Normal }; // Priority class in the threadpool
 }
 RegHandler;
 
@@ -118,10 +132,46 @@ using ReliableMap     = std::map<SessionAddress,SessionSequence,AddressCompare>;
 using HandlerMap      = std::map<HTTPCommand,RegHandler>;
 using ThrottlingMap   = std::map<SessionAddress,CRITICAL_SECTION*,AddressCompare>;
 
+// One shard of the reliable messaging sequences
+// Concurrent sequences of different clients do not contend on one lock
+typedef struct _sequenceShard
+{
+  CRITICAL_SECTION  m_lock;                               // Adding/deleting/updating sequences
+  ReliableMap       m_sequences;                          // Reliable messaging sequences
+}
+SequenceShard;
+
+// Settings of a site that can be applied again from a reloaded Marlin.config
+// They are published as one immutable snapshot, so a request never sees
+// a mix of old and new settings. Changing a setting publishes a new snapshot.
+typedef struct _siteLiveSettings
+{
+  bool         m_sendUnicode     { false };
+  bool         m_sendSoapBOM     { false };
+  bool         m_sendJsonBOM     { false };
+  bool         m_verbTunneling   { false };
+  bool         m_compression     { false };
+  bool         m_throttling      { false };
+  bool         m_filterTiming    { false };
+  bool         m_streamFormData  { false };
+  DWORD        m_workDeadline    { 0     };
+  WorkPriority m_workPriority    { WorkPriority::WP_Normal };
+  unsigned     m_hstsMaxAge      { 0     };
+  bool         m_hstsSubDomains  { false };
+  bool         m_xNoSniff        { false };
+  bool         m_xXSSProtection  { false };
+  bool         m_xXSSBlockMode   { false };
+  bool         m_blockCache      { false };
+  bool         m_useCORS         { false };
+  unsigned     m_corsMaxAge      { 86400 };
+  bool         m_corsCredentials { false };
+}
+SiteLiveSettings;
+
 // Cleanup handler after a crash-report
 extern __declspec(thread) SiteHandler* g_cleanup;
 
-class HTTPSite
+class HTTPSite : public ConfigListener
 {
 public:
   HTTPSite(HTTPServer*    p_server
@@ -189,6 +239,8 @@ public:
   void            SetSendJsonBOM(bool p_bom);
   // OPTIONAL: Set HTTP VERB tunneling 
   void            SetVerbTunneling(bool p_tunnel);
+  // OPTIONAL: Parse incoming multipart/form-data while receiving (files to temporary files)
+  void            SetStreamFormData(bool p_stream);
   // OPTIONAL: Set HTTP gzip compression
   void            SetHTTPCompression(bool p_compression);
   // OPTIONAL: Set HTTP throttling per address
@@ -213,6 +265,14 @@ public:
   void            SetCookiesExpires(int p_minutes);
   // OPTIONAL: Set all cookies to max-age 
   void            SetCookiesMaxAge(int p_seconds);
+  // OPTIONAL: Keep timing counters for all site filters
+  void            SetFilterTiming(bool p_timing);
+  // OPTIONAL: Set priority class in the threadpool of all requests of this site
+  void            SetWorkPriority(WorkPriority p_priority);
+  // OPTIONAL: Set priority class in the threadpool of the handler of one HTTP command
+  bool            SetWorkPriority(HTTPCommand p_command,WorkPriority p_priority);
+  // OPTIONAL: Set deadline (milliseconds) for a request to start. Late requests get a 503
+  void            SetWorkDeadline(DWORD p_milliseconds);
 
   // GETTERS
   XString         GetSite() const                   { return m_site;          };
@@ -231,17 +291,18 @@ public:
   void*           GetPayload()                      { return m_payload;       };
   HTTPServer*     GetHTTPServer()                   { return m_server;        };
   HTTPSite*       GetMainSite()                     { return m_mainSite;      };
-  bool            GetSendUnicode()                  { return m_sendUnicode;   };
-  bool            GetSendSoapBOM()                  { return m_sendSoapBOM;   };
-  bool            GetSendJsonBOM()                  { return m_sendJsonBOM;   };
-  bool            GetVerbTunneling()                { return m_verbTunneling; };
-  bool            GetHTTPCompression()              { return m_compression;   };
-  bool            GetHTTPThrotteling()              { return m_throttling;    };
-  bool            GetUseCORS()                      { return m_useCORS;       };
+  bool            GetSendUnicode()                  { return GetLiveSettings().m_sendUnicode; }
+  bool            GetSendSoapBOM()                  { return GetLiveSettings().m_sendSoapBOM; }
+  bool            GetSendJsonBOM()                  { return GetLiveSettings().m_sendJsonBOM; }
+  bool            GetVerbTunneling()                { return GetLiveSettings().m_verbTunneling; }
+  bool            GetStreamFormData()               { return GetLiveSettings().m_streamFormData; }
+  bool            GetHTTPCompression()              { return GetLiveSettings().m_compression; }
+  bool            GetHTTPThrotteling()              { return GetLiveSettings().m_throttling; }
+  bool            GetUseCORS()                      { return GetLiveSettings().m_useCORS; }
   XString         GetCORSOrigin()                   { return m_allowOrigin;   };
   XString         GetCORSHeaders()                  { return m_allowHeaders;  };
-  int             GetCORSMaxAge()                   { return m_corsMaxAge;    };
-  bool            GetCORSAllowCredentials()         { return m_corsCredentials;  }
+  int             GetCORSMaxAge()                   { return GetLiveSettings().m_corsMaxAge; }
+  bool            GetCORSAllowCredentials()         { return GetLiveSettings().m_corsCredentials; }
   bool            GetCookieHasSecure()              { return m_cookieHasSecure;  }
   bool            GetCookieHasHttpOnly()            { return m_cookieHasHttp;    }
   bool            GetCookieHasSameSite()            { return m_cookieHasSame;    }
@@ -257,6 +318,11 @@ public:
   int             GetCookiesExpires()               { return m_cookieExpires;    }
   int             GetCookiesMaxAge()                { return m_cookieMaxAge;     }
   int             GetAuthentication()               { return m_authScheme;       }
+  bool            GetFilterTiming()                 { return GetLiveSettings().m_filterTiming; }
+  DWORD           GetWorkDeadline()                 { return GetLiveSettings().m_workDeadline; }
+  WorkPriority    GetWorkPriority(HTTPCommand p_command);
+  // One consistent copy of the settings that can change while running
+  SiteLiveSettings GetLiveSettings();
   XString         GetAuthenticationScheme();
   bool            GetAuthenticationNTLMCache();
   XString         GetAuthenticationRealm();
@@ -265,6 +331,7 @@ public:
   XString         GetWebroot();
   SiteHandler*    GetSiteHandler(HTTPCommand p_command);
   SiteFilter*     GetFilter(unsigned p_priority);
+  XString         GetFilterStatistics();
   XString         GetContentType(XString p_extension);
   XString         GetContentTypeByResourceName(XString p_pathname);
   virtual bool    GetHasAnonymousAuthentication(HANDLE p_token);
@@ -294,6 +361,9 @@ public:
                     ,XString          p_detail);
   // Add all optional extra headers of this site
   void AddSiteOptionalHeaders(UKHeaders& p_headers);
+  // Keys of a reloaded Marlin.config that the site applies live
+  void GetLiveConfigKeys(ConfigKeys& p_keys) override;
+  void ApplyConfig(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed) override;
   // Send responses
   bool SendAsChunk (HTTPMessage* p_message,bool p_final = false);
   bool SendResponse(HTTPMessage* p_message);
@@ -301,10 +371,20 @@ public:
   bool SendResponse(JSONMessage* p_message);
 
 protected:
+
   // Init parameters from Marlin.config
   void              InitSite(MarlinConfig& p_config);
   // Set automatic headers upon starting site
   void              SetAutomaticHeaders(MarlinConfig& p_config);
+  // Settings that can also be applied from a reloaded Marlin.config
+  void              InitLiveSettings(MarlinConfig& p_config);
+  void              SetLiveSettings (const SiteLiveSettings& p_settings);
+  static void       ReadLiveSettings(MarlinConfig& p_config,SiteLiveSettings& p_settings);
+  // Change one live setting by publishing a new snapshot
+  template<typename T>
+  void              ChangeLiveSetting(T SiteLiveSettings::* p_setting,T p_value);
+  // Publishing a new snapshot of the live settings (under the m_liveLock)
+  void              PublishLiveSettings(const SiteLiveSettings& p_settings);
   // Log all settings to the site
   void              LogSettings();
   // Cleanup the site when stopping
@@ -315,6 +395,8 @@ protected:
   RegHandler*       FindSiteHandler(HTTPCommand p_command);
   // Calling all filters
   bool              CallFilters(HTTPMessage* p_message);
+  // Publishing a new snapshot of the filter chain (under the m_filterLock)
+  void              PublishFilters();
   // All registered site handlers, and the default action
   void              HandleHTTPMessageDefault(HTTPMessage* p_message);
   // Direct asynchronous response
@@ -334,11 +416,15 @@ protected:
   bool              RM_HandleLastMessage      (SessionAddress&  p_address, SOAPMessage* p_message);
   bool              RM_HandleTerminateSequence(SessionAddress&  p_address, SOAPMessage* p_message);
   bool              RM_HandleMessage          (SessionAddress&  p_address, SOAPMessage* p_message);
-  void              ReliableResponse          (SessionSequence* p_sequence,SOAPMessage* p_message);
-  // Handle all sequences
+  bool              RM_ReceiveMessage         (SessionSequence* p_sequence,int p_number);
+  void              RM_Acknowledgement        (SessionSequence* p_sequence,SOAPMessage* p_message);
+  void              ReliableResponse          (const SessionSequence& p_sequence,SOAPMessage* p_message);
+  // Handle all sequences. Sequences are only changed under the lock of their shard,
+  // so callers get a copy of the sequence and never a pointer into the shard.
   void              RemoveSequence(SessionAddress& p_address);
-  SessionSequence*  FindSequence  (SessionAddress& p_address);
-  SessionSequence*  CreateSequence(SessionAddress& p_address);
+  bool              FindSequence  (SessionAddress& p_address,SessionSequence& p_sequence);
+  bool              CreateSequence(SessionAddress& p_address,XString p_clientGUID,SessionSequence& p_sequence);
+  SequenceShard&    GetSequenceShard(SessionAddress& p_address);
   void              DebugPrintSessionAddress(XString p_prefix,SessionAddress& p_address);
 
   // Handle HTTP throttling
@@ -365,17 +451,9 @@ protected:
   MediaTypeMap      m_contentTypes;                       // Text based content type
   XMLEncryption     m_securityLevel   { XMLEncryption::XENC_Plain };  // Security level
   XString           m_enc_password;                       // Security encryption password
-  bool              m_sendUnicode     { false   };        // Send UTF-16 Unicode answers
-  bool              m_sendSoapBOM     { false   };        // Prepend UTF-16 SOAP message with BOM 
-  bool              m_sendJsonBOM     { false   };        // Prepend UTF-16 JSON message with BOM
-  bool              m_compression     { false   };        // Allows for HTTP gzip compression
-  bool              m_throttling      { false   };        // Perform throttling per address
   // CORS Cross Origin Resource Sharing
-  bool              m_useCORS         { false   };        // Use CORS header methods
   XString           m_allowOrigin;                        // Client that can call us or '*' for everyone
   XString           m_allowHeaders;                       // White-listing of exposed headers
-  unsigned          m_corsMaxAge      { 86400   };        // Pre-flight results are valid this long (1 day in seconds)
-  bool              m_corsCredentials { false   };        // CORS allows credentials to be sent
                                                           // CORS methods comes from the m_handlers map !!!
   // Authentication
   ULONG             m_authScheme      { 0       };        // Authentication scheme's
@@ -386,13 +464,19 @@ protected:
   // WS-ReliableMessaging
   bool              m_reliable        { false   };        // Does WS-Reliable messaging in SOAP POST's
   bool              m_reliableLogIn   { false   };        // RM implies logged-in user
-  ReliableMap       m_sequences;                          // Reliable messaging sequences
+  SequenceShard     m_sequences[RM_SEQUENCE_SHARDS];      // Reliable messaging sequences
   // HTTP Site handlers and filters
   HandlerMap        m_handlers;                           // Site handlers
-  FilterMap         m_filters;                            // Site filters
+  FilterMap         m_filters;                            // Site filters (writers only, under m_filterLock)
+  SiteFilterChain* volatile m_filterChain { nullptr };    // Published snapshot for CallFilters
+  ReaderEpoch       m_filterReaders;                      // Retiring the old filter chain
+  // Server-wide metrics of this site
+  MetricsHistogram* m_metrics         { nullptr };        // Duration of all requests
+  MetricsCounter*   m_metricsErrors   { nullptr };        // Requests ending in an error report
+  MetricsHistogram* m_handlerMetrics[(int)HTTPCommand::http_last_command + 1] { nullptr };  // Per command
   // Multi-threading
   CRITICAL_SECTION  m_filterLock;                         // Adding/deleting/calling filters
-  CRITICAL_SECTION  m_sessionLock;                        // Adding/deleting sessions sequences
+  CRITICAL_SECTION  m_sessionLock;                        // Adding/deleting throttling addresses
   ThrottlingMap     m_throttels;                          // Addresses to be throttled
   // Cookie settings enforcement
   bool              m_cookieHasSecure { false };          // Site override for 'secure'   cookies
@@ -412,13 +496,12 @@ protected:
   // Auto HTTP headers added to all response traffic
   XFrameOption      m_xFrameOption    { XFrameOption::XFO_NO_OPTION };  // Standard frame options
   XString           m_xFrameAllowed;                      // IFrame allowed from this URI
-  unsigned          m_hstsMaxAge      { 0       };        // Max age from HSTS
-  bool              m_hstsSubDomains  { false   };        // Sub-domains allowed on HSTS
-  bool              m_xNoSniff        { false   };        // Block sniffing on ASCII content type
-  bool              m_xXSSProtection  { false   };        // XSS Protection is on or off
-  bool              m_xXSSBlockMode   { false   };        // No mode, or block mode
-  bool              m_blockCache      { false   };        // Blocking the cache control
-  bool              m_verbTunneling   { false   };        // Verb tunneling allowed
+  // Settings that can change while running (with the scheduling in the threadpool)
+  SiteLiveSettings* volatile m_live   { nullptr };        // Published snapshot, read by the requests
+  ReaderEpoch       m_liveReaders;                        // Retiring the old snapshot of the settings
+  CRITICAL_SECTION  m_liveLock;                           // Changing the settings
+  SiteLiveSettings  m_liveDefaults;                       // Settings before any config file: defaults of a reload
+  bool              m_liveDefaulted   { false   };        // m_liveDefaults have been taken
 };
 
 // SETTERS
@@ -489,56 +572,8 @@ HTTPSite::SetCleanup(SiteHandler* p_cleanup)
   g_cleanup = p_cleanup;
 }
 
-inline void
-HTTPSite::SetSendUnicode(bool p_unicode)
-{
-  m_sendUnicode = p_unicode;
-}
-
-inline void
-HTTPSite::SetSendSoapBOM(bool p_bom)
-{
-  m_sendSoapBOM = p_bom;
-}
-
-inline void
-HTTPSite::SetSendJsonBOM(bool p_bom)
-{
-  m_sendJsonBOM = p_bom;
-}
-
-inline void
-HTTPSite::SetVerbTunneling(bool p_tunnel)
-{
-  m_verbTunneling = p_tunnel;
-}
-
-inline void
-HTTPSite::SetHTTPCompression(bool p_compression)
-{
-  m_compression = p_compression;
-}
-
-inline void
-HTTPSite::SetHTTPThrotteling(bool p_throttel)
-{
-  m_throttling = p_throttel;
-}
-
-inline void
-HTTPSite::SetUseCORS(bool p_use)
-{
-  m_useCORS = p_use;
-}
-
 inline void
 HTTPSite::SetCORSOrigin(XString p_origin)
 {
   m_allowOrigin = p_origin;
 }
-
-inline void
-HTTPSite::SetCORSMaxAge(unsigned p_maxAge)
-{
-  m_corsMaxAge = p_maxAge;
-}
@@ -153,6 +153,11 @@ HTTPSiteMarlin::StartSite()
   {
     ERRORLOG(ERROR_INVALID_PARAMETER,_T("No URL group created/found for authentication scheme: ") + m_scheme);
   }
+  // Apply the changes of a reloaded Marlin.config from now on
+  if(result)
+  {
+    m_server->GetConfigWatcher()->AddListener(this);
+  }
   // Return the fact that we started successfully or not
   return (m_isStarted = result);
 }
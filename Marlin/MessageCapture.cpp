@@ -0,0 +1,484 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: MessageCapture.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "MessageCapture.h"
+#include "StoreMessage.h"
+#include "LogAnalysis.h"
+#include "AutoCritical.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Logging via the server
+#define DETAILLOG1(text)        if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,false,text)
+#define DETAILLOGS(text,extra)  if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,true, text,extra)
+#define DETAILLOGV(text,...)    if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,true, text,__VA_ARGS__)
+#define ERRORLOG(code,text)     if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,true,text,code)
+#define ERRORLOGS(code,text,x)  if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,true,text,code,x)
+
+MessageCapture::MessageCapture(LogAnalysis* p_logfile /*= nullptr*/)
+               :m_logfile(p_logfile)
+{
+  InitializeCriticalSection(&m_lock);
+}
+
+MessageCapture::~MessageCapture()
+{
+  Stop();
+  DeleteCriticalSection(&m_lock);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// WORKER BEE
+//
+//////////////////////////////////////////////////////////////////////////
+
+static unsigned int __stdcall StartingTheCaptureThread(void* p_context)
+{
+  MessageCapture* capture = reinterpret_cast<MessageCapture*>(p_context);
+  if(capture)
+  {
+    capture->WriterThreadRunning();
+  }
+  return 0;
+}
+
+bool
+MessageCapture::Start(XString p_directory,size_t p_fileSize /*= CAPTURE_FILE_SIZE*/,unsigned p_files /*= CAPTURE_FILES*/)
+{
+  AutoCritSec lock(&m_lock);
+
+  if(m_running)
+  {
+    // Already capturing
+    return true;
+  }
+
+  // Make sure we have the capture directory
+  m_directory = p_directory;
+  if(m_directory.Right(1) != _T("\\"))
+  {
+    m_directory += _T("\\");
+  }
+  WinFile ensure(m_directory);
+  if(!ensure.CreateDirectory())
+  {
+    ERRORLOGS(ensure.GetLastError(),_T("Code [%d] Cannot reach the capture directory: %s"),m_directory.GetString());
+    return false;
+  }
+  m_fileSize = p_fileSize < (1024 * 1024) ? (1024 * 1024) : p_fileSize;
+  m_files    = p_files    < 1 ? 1 : p_files;
+
+  // Create an event for the writer
+  if(!m_event)
+  {
+    m_event = CreateEvent(NULL,FALSE,FALSE,NULL);
+  }
+
+  // Thread for the capture files
+  unsigned int threadID = 0;
+  m_running = true;
+  if((m_thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL,0,StartingTheCaptureThread,reinterpret_cast<void*>(this),0,&threadID))) == INVALID_HANDLE_VALUE)
+  {
+    m_thread  = NULL;
+    m_running = false;
+    ERRORLOG(ERROR_SERVICE_NOT_ACTIVE,_T("Code [%d] Cannot start a thread for the traffic capture."));
+    return false;
+  }
+  DETAILLOGV(_T("Traffic capture started with threadID [%d] in directory: %s"),threadID,m_directory.GetString());
+  InterlockedExchange(&m_capturing,1);
+  return true;
+}
+
+void
+MessageCapture::Stop()
+{
+  // No new records from here on
+  InterlockedExchange(&m_capturing,0);
+  {
+    AutoCritSec lock(&m_lock);
+    if(!m_running)
+    {
+      return;
+    }
+    m_running = false;
+  }
+  // Writer writes the last records and stops
+  SetEvent(m_event);
+  if(WaitForSingleObject(m_thread,CAPTURE_END_RETRIES * CAPTURE_END_INTERVAL) == WAIT_TIMEOUT)
+  {
+    // Since waiting on the thread did not work, we must preemptively terminate it.
+#pragma warning(disable:6258)
+    TerminateThread(m_thread,3);
+    ERRORLOG(ERROR_TIMEOUT,_T("Code [%d] Traffic capture writer did not stop in time"));
+  }
+  CloseHandle(m_thread);
+  m_thread = NULL;
+  CloseHandle(m_event);
+  m_event = NULL;
+
+  // Anything left behind
+  AutoCritSec lock(&m_lock);
+  for(auto& record : m_queue)
+  {
+    delete record;
+  }
+  m_queue.clear();
+  m_queued = 0;
+  for(auto& open : m_open)
+  {
+    InterlockedIncrement(&m_dropped);
+    delete open.second.m_record;
+  }
+  m_open.clear();
+  if(m_file.GetIsOpen())
+  {
+    m_file.Close();
+  }
+  DETAILLOGV(_T("Traffic capture stopped. Captured: %d Dropped: %d"),m_captured,m_dropped);
+}
+
+// Open a record on the thread handling the request
+// Done before the handlers, so we record the request as it came in
+bool
+MessageCapture::CaptureRequest(HTTPMessage* p_message)
+{
+  if(!m_capturing || p_message == nullptr || p_message->GetRequestHandle() == NULL)
+  {
+    return false;
+  }
+  std::string* record = new std::string();
+  StoreMessage store;
+  if(!store.StoreIncomingMessage(p_message,*record))
+  {
+    InterlockedIncrement(&m_dropped);
+    delete record;
+    return false;
+  }
+  AutoCritSec lock(&m_lock);
+  if(!m_capturing || m_open.size() >= CAPTURE_OPEN_MAXIMUM)
+  {
+    // Too many requests waiting for an answer: the writer ages them out
+    InterlockedIncrement(&m_dropped);
+    delete record;
+    return false;
+  }
+  OpenRecord& open = m_open[p_message->GetRequestHandle()];
+  if(open.m_record)
+  {
+    // Request handle reused before the earlier request got its answer
+    InterlockedIncrement(&m_dropped);
+    delete open.m_record;
+  }
+  open.m_record = record;
+  open.m_opened = GetTickCount64();
+  return true;
+}
+
+// Complete the open record of the request and hand it over to the writer
+void
+MessageCapture::CaptureResponse(HTTP_OPAQUE_ID p_request,HTTPMessage* p_response)
+{
+  std::string* record = nullptr;
+  {
+    AutoCritSec lock(&m_lock);
+    auto open = m_open.find(p_request);
+    if(open == m_open.end())
+    {
+      return;
+    }
+    record = open->second.m_record;
+    m_open.erase(open);
+  }
+  if(p_response)
+  {
+    // On failure we keep the request only
+    StoreMessage store;
+    store.StoreResponseMessage(p_response,*record);
+  }
+  QueueRecord(record);
+}
+
+bool
+MessageCapture::GetIsOpen(HTTP_OPAQUE_ID p_request)
+{
+  if(!m_capturing)
+  {
+    return false;
+  }
+  AutoCritSec lock(&m_lock);
+  return m_open.find(p_request) != m_open.end();
+}
+
+void
+MessageCapture::QueueRecord(std::string* p_record)
+{
+  bool wakeup = false;
+  {
+    AutoCritSec lock(&m_lock);
+    if(m_capturing && m_queued + p_record->size() <= CAPTURE_QUEUE_SIZE)
+    {
+      m_queue.push_back(p_record);
+      m_queued += p_record->size();
+      wakeup    = m_queued >= CAPTURE_WAKEUP_SIZE;
+      p_record  = nullptr;
+    }
+  }
+  if(p_record)
+  {
+    // Writer cannot keep up, or we just stopped
+    InterlockedIncrement(&m_dropped);
+    delete p_record;
+  }
+  else if(wakeup)
+  {
+    SetEvent(m_event);
+  }
+}
+
+// Records without a response after the timeout are recorded with the request only.
+// Their answer went out another way, or the connection was aborted.
+void
+MessageCapture::AgeOpenRecords(ULONGLONG p_now)
+{
+  std::deque<std::string*> aged;
+  {
+    AutoCritSec lock(&m_lock);
+    for(auto open = m_open.begin(); open != m_open.end();)
+    {
+      if(p_now - open->second.m_opened >= CAPTURE_OPEN_TIMEOUT)
+      {
+        aged.push_back(open->second.m_record);
+        open = m_open.erase(open);
+      }
+      else
+      {
+        ++open;
+      }
+    }
+  }
+  for(auto& record : aged)
+  {
+    QueueRecord(record);
+  }
+}
+
+bool
+MessageCapture::GetIsCapturing()
+{
+  return m_capturing != 0;
+}
+
+XString
+MessageCapture::GetDirectory()
+{
+  return m_directory;
+}
+
+XString
+MessageCapture::GetCurrentFile()
+{
+  AutoCritSec lock(&m_lock);
+  return m_filename;
+}
+
+unsigned
+MessageCapture::GetCaptured()
+{
+  return (unsigned) m_captured;
+}
+
+unsigned
+MessageCapture::GetDropped()
+{
+  return (unsigned) m_dropped;
+}
+
+void
+MessageCapture::WriterThreadRunning()
+{
+  // Installing our SEH to exception translator
+  _set_se_translator(SeTranslator);
+  DETAILLOG1(_T("Traffic capture writer started."));
+
+  bool running = true;
+  ULONGLONG scanned = GetTickCount64();
+  do
+  {
+    // Wake every now and then, or when the queue gets big
+    WaitForSingleObject(m_event,CAPTURE_WRITE_INTERVAL);
+
+    // Requests that will never get their answer through the site
+    ULONGLONG now = GetTickCount64();
+    if(now - scanned >= CAPTURE_OPEN_SCAN)
+    {
+      AgeOpenRecords(now);
+      scanned = now;
+    }
+
+    std::deque<std::string*> records;
+    {
+      AutoCritSec lock(&m_lock);
+      records.swap(m_queue);
+      m_queued = 0;
+      running  = m_running;
+    }
+    WriteRecords(records);
+  }
+  while(running);
+
+  // Last file is complete
+  if(m_file.GetIsOpen())
+  {
+    m_file.Close();
+  }
+  DETAILLOG1(_T("Traffic capture writer stopped."));
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// CAPTURE GUARD
+//
+//////////////////////////////////////////////////////////////////////////
+
+CaptureGuard::CaptureGuard(MessageCapture* p_capture)
+             :m_capture(p_capture)
+{
+}
+
+CaptureGuard::~CaptureGuard()
+{
+  Close();
+}
+
+void
+CaptureGuard::Start(HTTPMessage* p_message)
+{
+  if(m_capture && m_capture->CaptureRequest(p_message))
+  {
+    m_message = p_message;
+  }
+}
+
+void
+CaptureGuard::Close()
+{
+  if(m_message)
+  {
+    // Only the site holds the message: no answer will come
+    if(m_message->GetReferences() <= 1)
+    {
+      m_capture->CaptureResponse(m_message->GetRequestHandle(),nullptr);
+    }
+    m_message = nullptr;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+void
+MessageCapture::WriteRecords(std::deque<std::string*>& p_records)
+{
+  for(auto& record : p_records)
+  {
+    DWORD length = (DWORD) record->size();
+
+    // Roll over to the next file
+    if(!m_file.GetIsOpen() || (m_written > 0 && m_written + sizeof(DWORD) + length > m_fileSize))
+    {
+      OpenNextFile();
+    }
+    if(m_file.GetIsOpen() &&
+       m_file.Write(&length,sizeof(DWORD)) &&
+       m_file.Write(const_cast<char*>(record->c_str()),length))
+    {
+      m_written += sizeof(DWORD) + length;
+      InterlockedIncrement(&m_captured);
+    }
+    else
+    {
+      InterlockedIncrement(&m_dropped);
+    }
+    delete record;
+  }
+  p_records.clear();
+}
+
+bool
+MessageCapture::OpenNextFile()
+{
+  if(m_file.GetIsOpen())
+  {
+    m_file.Close();
+  }
+  SYSTEMTIME now;
+  GetLocalTime(&now);
+
+  XString filename;
+  filename.Format(_T("%sCapture_%04d%02d%02d_%02d%02d%02d_%04u%s")
+                 ,m_directory.GetString()
+                 ,now.wYear,now.wMonth,now.wDay,now.wHour,now.wMinute,now.wSecond
+                 ,++m_sequence
+                 ,CAPTURE_FILE_EXTENSION);
+  m_file.SetFilename(filename);
+  if(!m_file.Open(winfile_write | open_trans_binary))
+  {
+    ERRORLOGS(m_file.GetLastError(),_T("Code [%d] Cannot open the capture file: %s"),filename.GetString());
+    return false;
+  }
+  {
+    AutoCritSec lock(&m_lock);
+    m_filename = filename;
+  }
+  m_written = 0;
+  m_history.push_back(filename);
+  RemoveOldFiles();
+
+  DETAILLOGS(_T("Traffic capture to file: %s"),filename.GetString());
+  return true;
+}
+
+// Keep only the last files
+void
+MessageCapture::RemoveOldFiles()
+{
+  while(m_history.size() > m_files)
+  {
+    WinFile oldest(m_history.front());
+    oldest.DeleteFile();
+    m_history.pop_front();
+  }
+}
@@ -0,0 +1,152 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: MessageCapture.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "HTTPMessage.h"
+#include "WinFile.h"
+#include <deque>
+#include <string>
+#include <map>
+
+// Traffic capture of a HTTP server
+//
+// Every captured request/response pair is one record with the same layout
+// as a StoreMessage file, so each record can be read back by StoreMessage.
+// The records are appended to rolling capture files by a background writer.
+// A capture file is a sequence of:
+//
+//   4 bytes   Length of the record
+//   x bytes   Record (StoreMessage layout)
+//
+// Files are not flushed per request: the OS writes them out in its own pace.
+// If the writer cannot keep up, records are dropped instead of queued.
+//
+// A record stays open on the request handle until the response is sent,
+// so responses sent later or from another thread complete the same record.
+// Requests that never get their response through the site (event streams,
+// aborted connections) are aged out by the writer and recorded without one.
+
+#define CAPTURE_FILE_EXTENSION  _T(".mcap")
+#define CAPTURE_FILE_SIZE       (64 * 1024 * 1024)    // Default size of one capture file
+#define CAPTURE_FILES           10                    // Default number of rolling files
+#define CAPTURE_QUEUE_SIZE      (32 * 1024 * 1024)    // Maximum bytes waiting for the writer
+#define CAPTURE_WAKEUP_SIZE     (1024 * 1024)         // Wake the writer before its interval
+#define CAPTURE_WRITE_INTERVAL  250                   // Milliseconds between writes
+#define CAPTURE_END_RETRIES     100                   // Waiting for the writer to stop
+#define CAPTURE_END_INTERVAL    100                   // Milliseconds between retries
+#define CAPTURE_OPEN_MAXIMUM    10000                 // Maximum records waiting for their response
+#define CAPTURE_OPEN_TIMEOUT    (2 * 60 * 1000)       // Milliseconds a record waits for its response
+#define CAPTURE_OPEN_SCAN       (10 * 1000)           // Milliseconds between scans for old records
+
+class LogAnalysis;
+
+class MessageCapture
+{
+public:
+  explicit MessageCapture(LogAnalysis* p_logfile = nullptr);
+ ~MessageCapture();
+
+  // Start capturing to rolling files in this directory
+  bool          Start(XString p_directory,size_t p_fileSize = CAPTURE_FILE_SIZE,unsigned p_files = CAPTURE_FILES);
+  // Stop capturing. Records still in the queue are written first.
+  void          Stop();
+
+  // Called on the threads handling the requests
+  // Open a record with the incoming request. Returns false if not capturing
+  bool          CaptureRequest(HTTPMessage* p_message);
+  // Complete the open record with the response (if any) and queue it for the writer
+  void          CaptureResponse(HTTP_OPAQUE_ID p_request,HTTPMessage* p_response);
+  // Is a record open for this request?
+  bool          GetIsOpen(HTTP_OPAQUE_ID p_request);
+
+  // SETTERS
+  void          SetLogfile(LogAnalysis* p_logfile) { m_logfile = p_logfile; }
+
+  // GETTERS
+  bool          GetIsCapturing();
+  XString       GetDirectory();
+  XString       GetCurrentFile();
+  unsigned      GetCaptured();
+  unsigned      GetDropped();
+
+  // Only to be called by the background writer thread
+  void          WriterThreadRunning();
+
+private:
+  bool          OpenNextFile();
+  void          RemoveOldFiles();
+  void          WriteRecords(std::deque<std::string*>& p_records);
+  void          QueueRecord(std::string* p_record);
+  void          AgeOpenRecords(ULONGLONG p_now);
+
+  typedef struct _openRecord
+  {
+    std::string*  m_record { nullptr };               // Record with the request
+    ULONGLONG     m_opened { 0 };                     // Tickcount of the request
+  }
+  OpenRecord;
+
+  XString       m_directory;                          // Directory of the capture files
+  XString       m_filename;                           // Currently open capture file
+  WinFile       m_file;                               // The capture file
+  size_t        m_fileSize    { CAPTURE_FILE_SIZE };  // Start a new file after this size
+  size_t        m_written     { 0 };                  // Bytes written to the current file
+  unsigned      m_files       { CAPTURE_FILES };      // Number of rolling files to keep
+  unsigned      m_sequence    { 0 };                  // Sequence number of the next file
+  std::deque<XString> m_history;                      // Files written, oldest first
+  // Records waiting for their response
+  std::map<HTTP_OPAQUE_ID,OpenRecord> m_open;         // Open records by request handle
+  // Queue to the writer
+  std::deque<std::string*> m_queue;                   // Records waiting for the writer
+  size_t        m_queued      { 0 };                  // Bytes waiting for the writer
+  long          m_capturing   { 0 };                  // Accepting new records
+  bool          m_running     { false };              // Writer thread is running
+  HANDLE        m_thread      { NULL };               // Background writer
+  HANDLE        m_event       { NULL };               // Wakes up the writer
+  CRITICAL_SECTION m_lock;                            // Locking the queue
+  // Statistics
+  long          m_captured    { 0 };                  // Records written
+  long          m_dropped     { 0 };                  // Records dropped (queue full, errors)
+  LogAnalysis*  m_logfile     { nullptr };            // Logging
+};
+
+// Keeps the record of a request open while a site handles it.
+// On closing, a request that was not answered is recorded without a response,
+// unless a handler holds on to the message to answer it later.
+class CaptureGuard
+{
+public:
+  explicit CaptureGuard(MessageCapture* p_capture);
+ ~CaptureGuard();
+
+  void  Start(HTTPMessage* p_message);
+  void  Close();
+
+private:
+  MessageCapture* m_capture { nullptr };
+  HTTPMessage*    m_message { nullptr };
+};
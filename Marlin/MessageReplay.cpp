@@ -0,0 +1,407 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: MessageReplay.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "MessageReplay.h"
+#include "StoreMessage.h"
+#include "LogAnalysis.h"
+#include "AutoCritical.h"
+#include <algorithm>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Logging via the logfile
+#define DETAILLOGV(text,...)    if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,true, text,__VA_ARGS__)
+#define ERRORLOGS(code,text,x)  if(m_logfile) m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,true,text,code,x)
+
+MessageReplay::MessageReplay(XString p_target,LogAnalysis* p_logfile /*= nullptr*/)
+              :m_target(p_target)
+              ,m_logfile(p_logfile)
+{
+  InitializeCriticalSection(&m_lock);
+  QueryPerformanceFrequency(&m_frequency);
+}
+
+MessageReplay::~MessageReplay()
+{
+  CloseFiles();
+  DeleteCriticalSection(&m_lock);
+}
+
+// Map a capture file and index its records
+bool
+MessageReplay::AddCaptureFile(XString p_filename)
+{
+  ReplayFile file;
+  file.m_filename = p_filename;
+  file.m_mapping  = NULL;
+  file.m_view     = nullptr;
+  file.m_size     = 0;
+  file.m_file     = CreateFile(p_filename,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if(file.m_file == INVALID_HANDLE_VALUE)
+  {
+    ERRORLOGS(GetLastError(),_T("Code [%d] Cannot open capture file: %s"),p_filename.GetString());
+    return false;
+  }
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file.m_file,&size) || size.QuadPart == 0)
+  {
+    // Empty capture file: nothing to replay
+    CloseHandle(file.m_file);
+    return size.QuadPart == 0;
+  }
+  file.m_size    = (size_t) size.QuadPart;
+  file.m_mapping = CreateFileMapping(file.m_file,NULL,PAGE_READONLY,0,0,NULL);
+  if(file.m_mapping)
+  {
+    file.m_view = reinterpret_cast<const BYTE*>(MapViewOfFile(file.m_mapping,FILE_MAP_READ,0,0,0));
+  }
+  if(file.m_view == nullptr)
+  {
+    ERRORLOGS(GetLastError(),_T("Code [%d] Cannot map capture file: %s"),p_filename.GetString());
+    if(file.m_mapping)
+    {
+      CloseHandle(file.m_mapping);
+    }
+    CloseHandle(file.m_file);
+    return false;
+  }
+
+  // Index all complete records.
+  // A capture file of a crashed server may end in a partial record
+  size_t offset = 0;
+  size_t count  = 0;
+  while(offset + sizeof(DWORD) <= file.m_size)
+  {
+    DWORD length = *reinterpret_cast<const DWORD*>(file.m_view + offset);
+    offset += sizeof(DWORD);
+    if(length == 0 || offset + length > file.m_size)
+    {
+      break;
+    }
+    m_records.push_back({ file.m_view + offset,length });
+    offset += length;
+    ++count;
+  }
+  m_files.push_back(file);
+
+  DETAILLOGV(_T("Capture file [%s] has [%d] records to replay"),p_filename.GetString(),(int)count);
+  return true;
+}
+
+void
+MessageReplay::SetConcurrency(unsigned p_threads)
+{
+  if(p_threads < 1)                      p_threads = 1;
+  if(p_threads > REPLAY_MAX_CONCURRENCY) p_threads = REPLAY_MAX_CONCURRENCY;
+  m_threads = p_threads;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// RUNNING THE REPLAY
+//
+//////////////////////////////////////////////////////////////////////////
+
+static unsigned int __stdcall StartingTheReplayThread(void* p_context)
+{
+  MessageReplay* replay = reinterpret_cast<MessageReplay*>(p_context);
+  if(replay)
+  {
+    replay->WorkerThreadRunning();
+  }
+  return 0;
+}
+
+bool
+MessageReplay::Run()
+{
+  if(m_records.empty() || !m_target.Valid())
+  {
+    return false;
+  }
+  // Reset the results of a previous run
+  m_next       = 0;
+  m_total      = (LONG)(m_records.size() * m_loops);
+  m_sent       = 0;
+  m_errors     = 0;
+  m_mismatches = 0;
+  m_duration   = 0.0;
+  m_latencies.clear();
+  m_latencies.reserve(m_total);
+
+  QueryPerformanceCounter(&m_start);
+
+  std::vector<HANDLE> threads;
+  for(unsigned ind = 0; ind < m_threads; ++ind)
+  {
+    unsigned int threadID = 0;
+    HANDLE thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL,0,StartingTheReplayThread,reinterpret_cast<void*>(this),0,&threadID));
+    if(thread && thread != INVALID_HANDLE_VALUE)
+    {
+      threads.push_back(thread);
+    }
+  }
+  if(threads.empty())
+  {
+    return false;
+  }
+  // WaitForMultipleObjects cannot wait for more than 64 threads
+  for(auto& thread : threads)
+  {
+    WaitForSingleObject(thread,INFINITE);
+    CloseHandle(thread);
+  }
+
+  LARGE_INTEGER end;
+  QueryPerformanceCounter(&end);
+  m_duration = (double)(end.QuadPart - m_start.QuadPart) / (double)m_frequency.QuadPart;
+  std::sort(m_latencies.begin(),m_latencies.end());
+
+  DETAILLOGV(_T("Replay done. Sent: %d Errors: %d Mismatches: %d Seconds: %.3f"),m_sent,m_errors,m_mismatches,m_duration);
+  return true;
+}
+
+void
+MessageReplay::WorkerThreadRunning()
+{
+  // Installing our SEH to exception translator
+  _set_se_translator(SeTranslator);
+
+  HTTPClient client;
+  client.SetTimeoutReceive(m_timeout);
+  if(m_logfile)
+  {
+    client.SetLogging(m_logfile);
+  }
+  std::vector<double> latencies;
+  latencies.reserve(m_total / m_threads + 1);
+
+  while(true)
+  {
+    LONG index = InterlockedIncrement(&m_next) - 1;
+    if(index >= m_total)
+    {
+      break;
+    }
+    WaitForSchedule(index);
+
+    double latency = 0.0;
+    try
+    {
+      if(SendRecord(client,m_records[index % m_records.size()],latency))
+      {
+        latencies.push_back(latency);
+      }
+    }
+    catch(StdException& ex)
+    {
+      InterlockedIncrement(&m_errors);
+      ERRORLOGS(0,_T("Code [%d] Replay error: %s"),ex.GetErrorMessage().GetString());
+    }
+  }
+  // Merge our latencies into the run
+  AutoCritSec lock(&m_lock);
+  m_latencies.insert(m_latencies.end(),latencies.begin(),latencies.end());
+}
+
+// Pace the requests over all workers to the requested rate
+void
+MessageReplay::WaitForSchedule(LONG p_index)
+{
+  if(m_rate == 0)
+  {
+    return;
+  }
+  LONGLONG due = m_start.QuadPart + (LONGLONG)p_index * m_frequency.QuadPart / m_rate;
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  if(now.QuadPart < due)
+  {
+    DWORD wait = (DWORD)((due - now.QuadPart) * 1000 / m_frequency.QuadPart);
+    if(wait > 0)
+    {
+      Sleep(wait);
+    }
+  }
+}
+
+// Send one captured request and compare with the captured response
+bool
+MessageReplay::SendRecord(HTTPClient& p_client,const ReplayRecord& p_record,double& p_latency)
+{
+  StoreMessage store;
+  HTTPMessage* request = store.ReadIncomingMessage(p_record.m_record,p_record.m_length);
+  if(request == nullptr)
+  {
+    InterlockedIncrement(&m_errors);
+    return false;
+  }
+  // Aim the request at our target server
+  CrackedURL& url = request->GetCrackedURL();
+  url.m_scheme = m_target.m_scheme;
+  url.m_secure = m_target.m_secure;
+  url.m_host   = m_target.m_host;
+  url.m_port   = m_target.m_port;
+  request->SetURL(url.URL());
+  // Hop-by-hop headers of the original connection
+  request->DelHeader(_T("Host"));
+  request->DelHeader(_T("Content-Length"));
+
+  LARGE_INTEGER begin,end;
+  QueryPerformanceCounter(&begin);
+  bool sent = p_client.Send(request);
+  QueryPerformanceCounter(&end);
+  p_latency = (double)(end.QuadPart - begin.QuadPart) * 1000.0 / (double)m_frequency.QuadPart;
+
+  InterlockedIncrement(&m_sent);
+  if(!sent && request->GetStatus() == 0)
+  {
+    InterlockedIncrement(&m_errors);
+    request->DropReference();
+    return false;
+  }
+
+  // Compare with the captured response (if any was captured)
+  HTTPMessage* captured = store.ReadResponseMessage(p_record.m_record,p_record.m_length);
+  if(captured)
+  {
+    if(!CompareResponse(captured,request))
+    {
+      InterlockedIncrement(&m_mismatches);
+    }
+    captured->DropReference();
+  }
+  request->DropReference();
+  return true;
+}
+
+bool
+MessageReplay::CompareResponse(HTTPMessage* p_captured,HTTPMessage* p_replayed)
+{
+  if(p_captured->GetStatus() != p_replayed->GetStatus())
+  {
+    return false;
+  }
+  if(!m_compareBody)
+  {
+    return true;
+  }
+  uchar* capturedBody = nullptr;
+  uchar* replayedBody = nullptr;
+  size_t capturedLength = 0;
+  size_t replayedLength = 0;
+  p_captured->GetFileBuffer()->GetBufferCopy(capturedBody,capturedLength);
+  p_replayed->GetFileBuffer()->GetBufferCopy(replayedBody,replayedLength);
+
+  bool same = capturedLength == replayedLength &&
+              (capturedLength == 0 || memcmp(capturedBody,replayedBody,capturedLength) == 0);
+
+  delete [] capturedBody;
+  delete [] replayedBody;
+  return same;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// RESULTS
+//
+//////////////////////////////////////////////////////////////////////////
+
+double
+MessageReplay::GetThroughput()
+{
+  return m_duration > 0.0 ? (double)m_sent / m_duration : 0.0;
+}
+
+// Nearest-rank percentile of the sorted latencies
+double
+MessageReplay::GetPercentile(double p_percentile)
+{
+  if(m_latencies.empty())
+  {
+    return 0.0;
+  }
+  if(p_percentile <= 0.0)
+  {
+    return m_latencies.front();
+  }
+  size_t rank = (size_t)ceil(p_percentile / 100.0 * (double)m_latencies.size());
+  if(rank > m_latencies.size())
+  {
+    rank = m_latencies.size();
+  }
+  return m_latencies[rank - 1];
+}
+
+double
+MessageReplay::GetMaximum()
+{
+  return m_latencies.empty() ? 0.0 : m_latencies.back();
+}
+
+XString
+MessageReplay::GetReport()
+{
+  XString report;
+  report.Format(_T("Replayed [%d] requests against [%s] in [%.3f] seconds\n")
+                _T("Throughput : %.1f requests/second\n")
+                _T("Latency    : p50 %.2f ms p90 %.2f ms p99 %.2f ms max %.2f ms\n")
+                _T("Errors     : %d\n")
+                _T("Mismatches : %d\n")
+               ,m_sent
+               ,m_target.SafeURL().GetString()
+               ,m_duration
+               ,GetThroughput()
+               ,GetPercentile(50.0),GetPercentile(90.0),GetPercentile(99.0),GetMaximum()
+               ,m_errors
+               ,m_mismatches);
+  return report;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PRIVATE
+//
+//////////////////////////////////////////////////////////////////////////
+
+void
+MessageReplay::CloseFiles()
+{
+  for(auto& file : m_files)
+  {
+    UnmapViewOfFile(file.m_view);
+    CloseHandle(file.m_mapping);
+    CloseHandle(file.m_file);
+  }
+  m_files.clear();
+  m_records.clear();
+}
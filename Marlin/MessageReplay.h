@@ -0,0 +1,136 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: MessageReplay.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "MessageCapture.h"
+#include "HTTPClient.h"
+#include "CrackURL.h"
+#include <vector>
+
+// Replaying the captured traffic of a server (see MessageCapture)
+// against another (or the same) server as a load generator.
+//
+// The capture files are memory mapped and indexed: no record is copied
+// before a worker thread picks it up. Every worker thread has its own
+// HTTPClient. Requests are paced to the requested rate over all the workers.
+// Each response is compared with the captured response of the request.
+//
+// Usage:
+//   MessageReplay replay(_T("http://testserver:1200"));
+//   replay.AddCaptureFile(_T("C:\\Capture\\Capture_20240101_120000_0001.mcap"));
+//   replay.SetConcurrency(16);
+//   replay.SetRate(500);
+//   replay.Run();
+//   XString report = replay.GetReport();
+
+#define REPLAY_CONCURRENCY      4           // Default number of worker threads
+#define REPLAY_MAX_CONCURRENCY  256         // Maximum number of worker threads
+#define REPLAY_TIMEOUT          (60 * 1000) // Default waiting time per request
+
+class LogAnalysis;
+
+// One captured request/response pair inside a mapped capture file
+typedef struct _replayRecord
+{
+  const BYTE* m_record;
+  size_t      m_length;
+}
+ReplayRecord;
+
+// One memory mapped capture file
+typedef struct _replayFile
+{
+  XString     m_filename;
+  HANDLE      m_file;
+  HANDLE      m_mapping;
+  const BYTE* m_view;
+  size_t      m_size;
+}
+ReplayFile;
+
+class MessageReplay
+{
+public:
+  explicit MessageReplay(XString p_target,LogAnalysis* p_logfile = nullptr);
+ ~MessageReplay();
+
+  // Map a capture file and index its records
+  bool      AddCaptureFile(XString p_filename);
+  // Replay all the records. Returns when all requests are answered
+  bool      Run();
+
+  // SETTERS
+  void      SetConcurrency(unsigned p_threads);
+  void      SetRate(unsigned p_perSecond)       { m_rate        = p_perSecond; }
+  void      SetLoops(unsigned p_loops)          { m_loops       = p_loops > 0 ? p_loops : 1; }
+  void      SetCompareBody(bool p_compare)      { m_compareBody = p_compare;   }
+  void      SetTimeout(int p_milliseconds)      { m_timeout     = p_milliseconds; }
+
+  // GETTERS
+  size_t    GetRecords()                        { return m_records.size(); }
+  unsigned  GetSent()                           { return (unsigned) m_sent;       }
+  unsigned  GetErrors()                         { return (unsigned) m_errors;     }
+  unsigned  GetMismatches()                     { return (unsigned) m_mismatches; }
+  double    GetDuration()                       { return m_duration; }
+  double    GetThroughput();
+  // Latency in milliseconds at this percentile (0.0 - 100.0)
+  double    GetPercentile(double p_percentile);
+  double    GetMaximum();
+  // Report of the last run
+  XString   GetReport();
+
+  // Only to be called by the worker threads
+  void      WorkerThreadRunning();
+
+private:
+  bool      SendRecord  (HTTPClient& p_client,const ReplayRecord& p_record,double& p_latency);
+  bool      CompareResponse(HTTPMessage* p_captured,HTTPMessage* p_replayed);
+  void      WaitForSchedule(LONG p_index);
+  void      CloseFiles();
+
+  CrackedURL                m_target;                             // Server to replay against
+  std::vector<ReplayFile>   m_files;                              // Mapped capture files
+  std::vector<ReplayRecord> m_records;                            // All records of all files
+  unsigned                  m_threads     { REPLAY_CONCURRENCY }; // Concurrent workers
+  unsigned                  m_rate        { 0 };                  // Requests per second (0 = full speed)
+  unsigned                  m_loops       { 1 };                  // Replay the records this many times
+  bool                      m_compareBody { true };               // Also compare the response bodies
+  int                       m_timeout     { REPLAY_TIMEOUT };     // Receive timeout per request
+  // Run state
+  LONG                      m_next        { 0 };                  // Next request to send
+  LONG                      m_total       { 0 };                  // Total requests in this run
+  LARGE_INTEGER             m_frequency   { 0 };                  // Performance counter frequency
+  LARGE_INTEGER             m_start       { 0 };                  // Performance counter at the start
+  // Results
+  long                      m_sent        { 0 };                  // Requests sent
+  long                      m_errors      { 0 };                  // Requests not answered
+  long                      m_mismatches  { 0 };                  // Responses differing from the capture
+  double                    m_duration    { 0.0 };                // Seconds for the total run
+  std::vector<double>       m_latencies;                          // Latencies in milliseconds (sorted)
+  CRITICAL_SECTION          m_lock;                               // Merging the latencies
+  LogAnalysis*              m_logfile     { nullptr };            // Logging
+};
@@ -0,0 +1,546 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: Metrics.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "Metrics.h"
+#include "StringWriter.h"
+#include "AutoCritical.h"
+#include <malloc.h>
+#include <intrin.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// All metrics of the process
+MetricsRegistry g_metrics;
+
+// Prometheus histogram buckets: powers of 4 microseconds (1us - 67s)
+#define METRICS_EXPORT_BUCKETS 14
+
+// Frequency of the QueryPerformanceCounter
+static LONGLONG
+GetFrequency()
+{
+  static LONGLONG frequency = 0;
+  if(frequency == 0)
+  {
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    frequency = freq.QuadPart;
+  }
+  return frequency;
+}
+
+// Shard of the processor we are running on
+inline unsigned
+CurrentShard(unsigned p_mask)
+{
+  return GetCurrentProcessorNumber() & p_mask;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// COUNTER
+//
+//////////////////////////////////////////////////////////////////////////
+
+MetricsCounter::MetricsCounter(unsigned p_shards)
+{
+  m_mask   = p_shards - 1;
+  m_shards = reinterpret_cast<CounterShard*>(_aligned_malloc(sizeof(CounterShard) * p_shards,METRICS_CACHE_LINE));
+  ZeroMemory(m_shards,sizeof(CounterShard) * p_shards);
+}
+
+MetricsCounter::~MetricsCounter()
+{
+  _aligned_free(m_shards);
+}
+
+void
+MetricsCounter::Add(LONGLONG p_value /*=1*/)
+{
+  InterlockedAdd64(&m_shards[CurrentShard(m_mask)].m_value,p_value);
+}
+
+LONGLONG
+MetricsCounter::GetValue()
+{
+  LONGLONG total = 0;
+  for(unsigned index = 0; index <= m_mask; ++index)
+  {
+    total += ReadNoFence64(&m_shards[index].m_value);
+  }
+  return total;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// HISTOGRAM
+//
+//////////////////////////////////////////////////////////////////////////
+
+MetricsHistogram::MetricsHistogram(unsigned p_shards)
+{
+  m_mask   = p_shards - 1;
+  m_shards = reinterpret_cast<HistogramShard*>(_aligned_malloc(sizeof(HistogramShard) * p_shards,METRICS_CACHE_LINE));
+  ZeroMemory(m_shards,sizeof(HistogramShard) * p_shards);
+}
+
+MetricsHistogram::~MetricsHistogram()
+{
+  _aligned_free(m_shards);
+}
+
+// Bucket of a value: 4 linear sub-buckets per power of 2
+// Values 0-3 have a bucket of their own
+unsigned
+MetricsHistogram::BucketIndex(LONGLONG p_microseconds)
+{
+  if(p_microseconds < METRICS_SUBBUCKETS)
+  {
+    return (unsigned) p_microseconds;
+  }
+  unsigned long bit = 0;
+  _BitScanReverse64(&bit,(unsigned __int64)p_microseconds);
+  // Two bits below the highest bit are the sub-bucket
+  unsigned index = METRICS_SUBBUCKETS * (bit - 1) + (unsigned)((p_microseconds >> (bit - 2)) & (METRICS_SUBBUCKETS - 1));
+  return index < METRICS_BUCKETS ? index : METRICS_BUCKETS - 1;
+}
+
+// Lowest value that falls in a bucket
+LONGLONG
+MetricsHistogram::BucketLowest(unsigned p_index)
+{
+  if(p_index < METRICS_SUBBUCKETS)
+  {
+    return p_index;
+  }
+  unsigned bit = p_index / METRICS_SUBBUCKETS + 1;
+  return (LONGLONG)(METRICS_SUBBUCKETS + p_index % METRICS_SUBBUCKETS) << (bit - 2);
+}
+
+void
+MetricsHistogram::Record(LONGLONG p_microseconds)
+{
+  if(p_microseconds < 0)
+  {
+    p_microseconds = 0;
+  }
+  HistogramShard* shard = &m_shards[CurrentShard(m_mask)];
+  InterlockedIncrement64(&shard->m_count);
+  InterlockedAdd64(&shard->m_sum,p_microseconds);
+  InterlockedIncrement64(&shard->m_buckets[BucketIndex(p_microseconds)]);
+
+  // Only compete for the maximum if we have a new one
+  LONGLONG maximum = ReadNoFence64(&shard->m_max);
+  while(p_microseconds > maximum)
+  {
+    LONGLONG found = InterlockedCompareExchange64(&shard->m_max,p_microseconds,maximum);
+    if(found == maximum)
+    {
+      break;
+    }
+    maximum = found;
+  }
+}
+
+void
+MetricsHistogram::RecordTicks(LONGLONG p_ticks)
+{
+  Record(MetricsRegistry::TicksToMicroseconds(p_ticks));
+}
+
+void
+MetricsHistogram::GetSnapshot(MetricsSnapshot& p_snapshot)
+{
+  p_snapshot = MetricsSnapshot();
+  for(unsigned index = 0; index <= m_mask; ++index)
+  {
+    HistogramShard* shard = &m_shards[index];
+    p_snapshot.m_count += ReadNoFence64(&shard->m_count);
+    p_snapshot.m_sum   += ReadNoFence64(&shard->m_sum);
+    LONGLONG maximum    = ReadNoFence64(&shard->m_max);
+    if(maximum > p_snapshot.m_max)
+    {
+      p_snapshot.m_max = maximum;
+    }
+    for(unsigned bucket = 0; bucket < METRICS_BUCKETS; ++bucket)
+    {
+      p_snapshot.m_buckets[bucket] += ReadNoFence64(&shard->m_buckets[bucket]);
+    }
+  }
+}
+
+// Highest value of the bucket where the fraction of all values is reached
+LONGLONG
+MetricsSnapshot::GetPercentile(double p_fraction) const
+{
+  LONGLONG total = 0;
+  for(unsigned bucket = 0; bucket < METRICS_BUCKETS; ++bucket)
+  {
+    total += m_buckets[bucket];
+  }
+  if(total == 0)
+  {
+    return 0;
+  }
+  LONGLONG target = (LONGLONG)(p_fraction * (double)total + 0.5);
+  if(target < 1)
+  {
+    target = 1;
+  }
+  LONGLONG running = 0;
+  for(unsigned bucket = 0; bucket < METRICS_BUCKETS - 1; ++bucket)
+  {
+    running += m_buckets[bucket];
+    if(running >= target)
+    {
+      LONGLONG highest = MetricsHistogram::BucketLowest(bucket + 1) - 1;
+      return highest < m_max ? highest : m_max;
+    }
+  }
+  return m_max;
+}
+
+double
+MetricsSnapshot::GetAverage() const
+{
+  return m_count ? (double)m_sum / (double)m_count : 0.0;
+}
+
+void
+MetricsSnapshot::Subtract(const MetricsSnapshot& p_earlier)
+{
+  m_count -= p_earlier.m_count;
+  m_sum   -= p_earlier.m_sum;
+  for(unsigned bucket = 0; bucket < METRICS_BUCKETS; ++bucket)
+  {
+    m_buckets[bucket] -= p_earlier.m_buckets[bucket];
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// TIMER
+//
+//////////////////////////////////////////////////////////////////////////
+
+MetricsTimer::MetricsTimer(MetricsHistogram* p_histogram)
+             :m_histogram(p_histogram)
+{
+  if(m_histogram)
+  {
+    QueryPerformanceCounter(&m_start);
+  }
+}
+
+MetricsTimer::~MetricsTimer()
+{
+  if(m_histogram)
+  {
+    LARGE_INTEGER stop;
+    QueryPerformanceCounter(&stop);
+    m_histogram->RecordTicks(stop.QuadPart - m_start.QuadPart);
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// REGISTRY
+//
+//////////////////////////////////////////////////////////////////////////
+
+MetricsRegistry::MetricsRegistry()
+{
+  InitializeCriticalSection(&m_lock);
+
+  // One shard per processor, as a power of 2
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  while(m_shards < info.dwNumberOfProcessors && m_shards < METRICS_SHARDS)
+  {
+    m_shards <<= 1;
+  }
+  m_initialized = true;
+}
+
+MetricsRegistry::~MetricsRegistry()
+{
+  m_initialized = false;
+  for(auto& metric : m_metrics)
+  {
+    delete metric.second.m_counter;
+    delete metric.second.m_histogram;
+  }
+  m_metrics.clear();
+  DeleteCriticalSection(&m_lock);
+}
+
+LONGLONG
+MetricsRegistry::TicksToMicroseconds(LONGLONG p_ticks)
+{
+  return (p_ticks * 1000000) / GetFrequency();
+}
+
+MetricsCounter*
+MetricsRegistry::GetCounter(XString p_name,const MetricsLabels& p_labels,XString p_help /*=""*/)
+{
+  AutoCritSec lock(&m_lock);
+  Metric* metric = FindMetric(p_name,p_labels,p_help);
+  if(metric->m_counter == nullptr)
+  {
+    metric->m_counter = new MetricsCounter(m_shards);
+  }
+  return metric->m_counter;
+}
+
+MetricsHistogram*
+MetricsRegistry::GetHistogram(XString p_name,const MetricsLabels& p_labels,XString p_help /*=""*/)
+{
+  AutoCritSec lock(&m_lock);
+  Metric* metric = FindMetric(p_name,p_labels,p_help);
+  if(metric->m_histogram == nullptr)
+  {
+    metric->m_histogram = new MetricsHistogram(m_shards);
+  }
+  return metric->m_histogram;
+}
+
+void
+MetricsRegistry::AddGauge(XString p_name,const MetricsLabels& p_labels,volatile long* p_value,XString p_help /*=""*/)
+{
+  AutoCritSec lock(&m_lock);
+  Metric* metric = FindMetric(p_name,p_labels,p_help);
+  metric->m_gauge = p_value;
+}
+
+// The owner of the variable is going away
+void
+MetricsRegistry::RemoveGauge(volatile long* p_value)
+{
+  // Owner can outlive the registry at the end of the process
+  if(!m_initialized)
+  {
+    return;
+  }
+  AutoCritSec lock(&m_lock);
+  for(MetricsMap::iterator it = m_metrics.begin(); it != m_metrics.end();)
+  {
+    if(it->second.m_gauge == p_value)
+    {
+      it = m_metrics.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+
+// Find or add a metric (registry must be locked)
+MetricsRegistry::Metric*
+MetricsRegistry::FindMetric(XString p_name,const MetricsLabels& p_labels,XString p_help)
+{
+  XString labels = FormatLabels(p_labels);
+  XString key = p_name + _T("{") + labels + _T("}");
+
+  Metric& metric = m_metrics[key];
+  if(metric.m_name.IsEmpty())
+  {
+    metric.m_name      = p_name;
+    metric.m_labels    = labels;
+    metric.m_labelList = p_labels;
+  }
+  if(!p_help.IsEmpty())
+  {
+    m_help[p_name] = p_help;
+  }
+  return &metric;
+}
+
+// Labels as: name="value",name="value"
+// Backslash, double quote and newline are escaped in the value
+XString
+MetricsRegistry::FormatLabels(const MetricsLabels& p_labels)
+{
+  XString result;
+  for(const auto& label : p_labels)
+  {
+    if(!result.IsEmpty())
+    {
+      result += _T(",");
+    }
+    XString value(label.m_value);
+    value.Replace(_T("\\"),_T("\\\\"));
+    value.Replace(_T("\""),_T("\\\""));
+    value.Replace(_T("\n"),_T("\\n"));
+    result += label.m_name + _T("=\"") + value + _T("\"");
+  }
+  return result;
+}
+
+// Write all metrics in the Prometheus text format (version 0.0.4)
+// Histograms are written with cumulative buckets in seconds
+void
+MetricsRegistry::WritePrometheus(StringWriter& p_writer)
+{
+  AutoCritSec lock(&m_lock);
+
+  XString lastName;
+  for(auto& entry : m_metrics)
+  {
+    Metric& metric = entry.second;
+    XString type = metric.m_histogram ? _T("histogram") : metric.m_gauge ? _T("gauge") : _T("counter");
+    XString labels = metric.m_labels.IsEmpty() ? XString() : metric.m_labels + _T(",");
+    XString braces = metric.m_labels.IsEmpty() ? XString() : _T("{") + metric.m_labels + _T("}");
+
+    if(metric.m_name != lastName)
+    {
+      HelpMap::iterator help = m_help.find(metric.m_name);
+      if(help != m_help.end())
+      {
+        p_writer.Write(_T("# HELP ") + metric.m_name + _T(" ") + help->second + _T("\n"));
+      }
+      p_writer.Write(_T("# TYPE ") + metric.m_name + _T(" ") + type + _T("\n"));
+      lastName = metric.m_name;
+    }
+
+    if(metric.m_histogram)
+    {
+      MetricsSnapshot snapshot;
+      metric.m_histogram->GetSnapshot(snapshot);
+
+      LONGLONG running = 0;
+      unsigned bucket  = 0;
+      LONGLONG border  = 1;
+      XString  line;
+      for(int index = 0; index < METRICS_EXPORT_BUCKETS; ++index,border *= 4)
+      {
+        // Prometheus 'le' is less-than-or-equal: a value on the border is counted
+        while(bucket < METRICS_BUCKETS && MetricsHistogram::BucketLowest(bucket) <= border)
+        {
+          running += snapshot.m_buckets[bucket++];
+        }
+        line.Format(_T("%s_bucket{%sle=\"%.6f\"} %I64d\n"),metric.m_name.GetString(),labels.GetString(),(double)border / 1000000.0,running);
+        p_writer.Write(line);
+      }
+      line.Format(_T("%s_bucket{%sle=\"+Inf\"} %I64d\n"),metric.m_name.GetString(),labels.GetString(),snapshot.m_count);
+      p_writer.Write(line);
+      line.Format(_T("%s_sum%s %.6f\n"),metric.m_name.GetString(),braces.GetString(),(double)snapshot.m_sum / 1000000.0);
+      p_writer.Write(line);
+      line.Format(_T("%s_count%s %I64d\n"),metric.m_name.GetString(),braces.GetString(),snapshot.m_count);
+      p_writer.Write(line);
+    }
+    else
+    {
+      LONGLONG value = metric.m_gauge ? (LONGLONG)*metric.m_gauge : metric.m_counter ? metric.m_counter->GetValue() : 0;
+      p_writer.Write(metric.m_name + braces + _T(" "));
+      p_writer.WriteInteger(value);
+      p_writer.Write(_T('\n'));
+    }
+  }
+}
+
+// Write all metrics as one JSON object
+// Histograms are written as count, percentiles and totals in milliseconds
+void
+MetricsRegistry::WriteJson(StringWriter& p_writer)
+{
+  AutoCritSec lock(&m_lock);
+
+  p_writer.Write(_T("{\"metrics\":["));
+  bool first = true;
+  for(auto& entry : m_metrics)
+  {
+    Metric& metric = entry.second;
+    if(!first)
+    {
+      p_writer.Write(_T(','));
+    }
+    first = false;
+
+    p_writer.Write(_T("{\"name\":"));
+    p_writer.WriteJsonString(metric.m_name);
+    p_writer.Write(_T(",\"labels\":{"));
+    for(size_t index = 0; index < metric.m_labelList.size(); ++index)
+    {
+      if(index)
+      {
+        p_writer.Write(_T(','));
+      }
+      p_writer.WriteJsonString(metric.m_labelList[index].m_name);
+      p_writer.Write(_T(':'));
+      p_writer.WriteJsonString(metric.m_labelList[index].m_value);
+    }
+    p_writer.Write(_T("}"));
+
+    if(metric.m_histogram)
+    {
+      MetricsSnapshot snapshot;
+      metric.m_histogram->GetSnapshot(snapshot);
+
+      XString line;
+      line.Format(_T(",\"type\":\"histogram\",\"count\":%I64d,\"sum_ms\":%.3f,\"avg_ms\":%.3f,\"max_ms\":%.3f")
+                  _T(",\"p50_ms\":%.3f,\"p90_ms\":%.3f,\"p99_ms\":%.3f}")
+                 ,snapshot.m_count
+                 ,(double)snapshot.m_sum / 1000.0
+                 ,snapshot.GetAverage()  / 1000.0
+                 ,(double)snapshot.m_max / 1000.0
+                 ,(double)snapshot.GetPercentile(0.50) / 1000.0
+                 ,(double)snapshot.GetPercentile(0.90) / 1000.0
+                 ,(double)snapshot.GetPercentile(0.99) / 1000.0);
+      p_writer.Write(line);
+    }
+    else
+    {
+      LONGLONG value = metric.m_gauge ? (LONGLONG)*metric.m_gauge : metric.m_counter ? metric.m_counter->GetValue() : 0;
+      p_writer.Write(metric.m_gauge ? _T(",\"type\":\"gauge\",\"value\":") : _T(",\"type\":\"counter\",\"value\":"));
+      p_writer.WriteInteger(value);
+      p_writer.Write(_T('}'));
+    }
+  }
+  p_writer.Write(_T("]}"));
+}
+
+XString
+MetricsRegistry::GetPrometheus()
+{
+  StringWriter writer;
+  WritePrometheus(writer);
+  return writer.GetString();
+}
+
+XString
+MetricsRegistry::GetJson()
+{
+  StringWriter writer;
+  WriteJson(writer);
+  return writer.GetString();
+}
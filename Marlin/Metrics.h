@@ -0,0 +1,203 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: Metrics.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include <vector>
+#include <map>
+
+// Server-wide metrics: counters and latency histograms
+//
+// Recording is done on the threads handling the requests and must be cheap:
+// every metric is split in shards of one cache line (or more), and a thread
+// only updates the shard of the processor it is running on, with interlocked
+// instructions. No locks are taken and nothing is allocated while recording.
+// Reading a metric adds up all shards (aggregation on read).
+// Registering a metric takes the lock of the registry. Metrics are registered
+// once and live as long as the registry, so the pointers can be cached.
+//
+// Latency histograms are log-linear in microseconds (HDR style):
+// every power of 2 is split in 4 linear sub-buckets, so the relative error
+// of a percentile is at most 25%, from 1 microsecond up to more than 2 hours.
+
+#define METRICS_SHARDS      16    // Maximum number of shards of a metric
+#define METRICS_BUCKETS     128   // Buckets of a latency histogram
+#define METRICS_SUBBUCKETS  4     // Linear sub-buckets per power of 2
+#define METRICS_CACHE_LINE  64    // Shards are kept apart to prevent false sharing
+
+class StringWriter;
+
+// Label of a metric, e.g. site="/MarlinTest/"
+class MetricsLabel
+{
+public:
+  XString m_name;
+  XString m_value;
+};
+
+using MetricsLabels = std::vector<MetricsLabel>;
+
+// Counter that only goes up
+class MetricsCounter
+{
+public:
+  explicit MetricsCounter(unsigned p_shards);
+ ~MetricsCounter();
+
+  // Hot path: add to the counter
+  void      Add(LONGLONG p_value = 1);
+  // Total of all shards
+  LONGLONG  GetValue();
+
+private:
+  typedef struct DECLSPEC_ALIGN(METRICS_CACHE_LINE) _counterShard
+  {
+    volatile LONGLONG m_value;
+  }
+  CounterShard;
+
+  CounterShard* m_shards { nullptr };
+  unsigned      m_mask   { 0 };
+};
+
+// Aggregated state of a histogram at the moment of reading
+class MetricsSnapshot
+{
+public:
+  LONGLONG  m_count { 0 };                      // Number of recorded values
+  LONGLONG  m_sum   { 0 };                      // Total in microseconds
+  LONGLONG  m_max   { 0 };                      // Highest value in microseconds
+  LONGLONG  m_buckets[METRICS_BUCKETS] { 0 };   // Values per bucket
+
+  // Value (microseconds) below which the fraction (0.0 - 1.0) of the values lies
+  LONGLONG  GetPercentile(double p_fraction) const;
+  // Average value in microseconds
+  double    GetAverage() const;
+  // Only keep what was recorded after an earlier snapshot of the same histogram
+  // The maximum cannot be windowed and is kept as is
+  void      Subtract(const MetricsSnapshot& p_earlier);
+};
+
+// Latency histogram in microseconds
+class MetricsHistogram
+{
+public:
+  explicit MetricsHistogram(unsigned p_shards);
+ ~MetricsHistogram();
+
+  // Hot path: record a value in microseconds
+  void      Record(LONGLONG p_microseconds);
+  // Hot path: record a number of QueryPerformanceCounter ticks
+  void      RecordTicks(LONGLONG p_ticks);
+  // Add up all shards
+  void      GetSnapshot(MetricsSnapshot& p_snapshot);
+
+  // Bucket of a value and the lowest value of a bucket
+  static unsigned BucketIndex(LONGLONG p_microseconds);
+  static LONGLONG BucketLowest(unsigned p_index);
+
+private:
+  typedef struct DECLSPEC_ALIGN(METRICS_CACHE_LINE) _histogramShard
+  {
+    volatile LONGLONG m_count;
+    volatile LONGLONG m_sum;
+    volatile LONGLONG m_max;
+    volatile LONGLONG m_buckets[METRICS_BUCKETS];
+  }
+  HistogramShard;
+
+  HistogramShard* m_shards { nullptr };
+  unsigned        m_mask   { 0 };
+};
+
+// Times a block of code into a histogram. Does nothing for a nullptr
+class MetricsTimer
+{
+public:
+  explicit MetricsTimer(MetricsHistogram* p_histogram);
+ ~MetricsTimer();
+private:
+  MetricsHistogram* m_histogram;
+  LARGE_INTEGER     m_start;
+};
+
+// Registry of all metrics of the process
+class MetricsRegistry
+{
+public:
+  MetricsRegistry();
+ ~MetricsRegistry();
+
+  // Register or find a metric. Never returns a nullptr
+  MetricsCounter*   GetCounter  (XString p_name,const MetricsLabels& p_labels,XString p_help = _T(""));
+  MetricsHistogram* GetHistogram(XString p_name,const MetricsLabels& p_labels,XString p_help = _T(""));
+  // Gauge that is read from a variable of its owner. Must be removed by the owner!
+  void              AddGauge    (XString p_name,const MetricsLabels& p_labels,volatile long* p_value,XString p_help = _T(""));
+  void              RemoveGauge (volatile long* p_value);
+
+  // Write all metrics in the Prometheus text format (version 0.0.4)
+  void              WritePrometheus(StringWriter& p_writer);
+  // Write all metrics as one JSON object
+  void              WriteJson(StringWriter& p_writer);
+  XString           GetPrometheus();
+  XString           GetJson();
+
+  // Recording can be switched off (but is cheap enough to leave on)
+  void              SetActive(bool p_active) { m_active = p_active; };
+  bool              GetActive()              { return m_active;     };
+  unsigned          GetShards()              { return m_shards;     };
+
+  // Conversion of QueryPerformanceCounter ticks
+  static LONGLONG   TicksToMicroseconds(LONGLONG p_ticks);
+
+private:
+  // One registered metric
+  class Metric
+  {
+  public:
+    XString           m_name;
+    XString           m_labels;                   // Formatted as: name="value",name="value"
+    MetricsLabels     m_labelList;
+    MetricsCounter*   m_counter   { nullptr };
+    MetricsHistogram* m_histogram { nullptr };
+    volatile long*    m_gauge     { nullptr };
+  };
+  // Key is "name{labels}": all metrics of one name are next to each other
+  using MetricsMap = std::map<XString,Metric>;
+  using HelpMap    = std::map<XString,XString>;
+
+  Metric*           FindMetric(XString p_name,const MetricsLabels& p_labels,XString p_help);
+  static XString    FormatLabels(const MetricsLabels& p_labels);
+
+  MetricsMap        m_metrics;
+  HelpMap           m_help;
+  unsigned          m_shards      { 1 };
+  volatile bool     m_active      { true  };
+  bool              m_initialized { false };
+  CRITICAL_SECTION  m_lock;                       // Only for registering and reading
+};
+
+extern MetricsRegistry g_metrics;
@@ -33,6 +33,8 @@
 #include "AutoCritical.h"
 #include "LogAnalysis.h"
 #include <sys\timeb.h>
+#include <process.h>
+#include <vector>
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -54,6 +56,12 @@
 //
 // And of course, as always, check for errors, session == 0 etc :-)
 //
+// Getting a token is lock-free as long as the token is valid. A background thread
+// gets a new token after a percentage of its lifetime (see SetRefreshPercentage).
+// If that fails, the old token stays in use until it really expires.
+// Threads that need a token at the same time for the same session, all wait for
+// one and the same request to the token server.
+//
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -61,18 +69,58 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
+_oauthSession::_oauthSession()
+{
+  InitializeCriticalSection(&m_grantLock);
+}
+
+_oauthSession::~_oauthSession()
+{
+  delete m_token;
+  DeleteCriticalSection(&m_grantLock);
+}
+
 OAuth2Cache::OAuth2Cache()
 {
   InitializeCriticalSection(&m_lock);
+  InitializeCriticalSection(&m_clientLock);
+  m_wakeup = CreateEvent(NULL,FALSE,FALSE,NULL);
 }
 
 OAuth2Cache::~OAuth2Cache()
 {
+  // Stop the background refresher. It starts no new grants once stopping,
+  // and a grant in flight ends within the timeouts of the HTTPClient.
+  // Never terminate it: it could leave our locks held.
+  m_stopping = true;
+  if(m_refresher)
+  {
+    SetEvent(m_wakeup);
+    WaitForSingleObject(m_refresher,INFINITE);
+    CloseHandle(m_refresher);
+    m_refresher = NULL;
+  }
+  if(m_wakeup)
+  {
+    CloseHandle(m_wakeup);
+    m_wakeup = NULL;
+  }
+  // Remove all sessions
+  if(m_cache)
+  {
+    for(auto& ses : *m_cache)
+    {
+      ReleaseSession(ses.second);
+    }
+    delete m_cache;
+    m_cache = nullptr;
+  }
   if(m_client)
   {
     delete m_client;
     m_client = nullptr;
   }
+  DeleteCriticalSection(&m_clientLock);
   DeleteCriticalSection(&m_lock);
 }
 
@@ -92,16 +140,17 @@ OAuth2Cache::CreateClientCredentialsGrant(XString p_url
                                          ,XString p_appKey
                                          ,XString p_scope)
 {
-  OAuthSession session;
-  session.m_flow    = OAuthFlow::OA_CLIENT;
-  session.m_url     = p_url;
-  session.m_appID   = p_appID;
-  session.m_appKey  = p_appKey;
-  session.m_expires = 0L;
-  session.m_scope   = CrackedURL::EncodeURLChars(p_scope,true);
+  OAuthSession* session = new OAuthSession();
+  session->m_flow    = OAuthFlow::OA_CLIENT;
+  session->m_url     = p_url;
+  session->m_appID   = p_appID;
+  session->m_appKey  = p_appKey;
+  session->m_scope   = CrackedURL::EncodeURLChars(p_scope,true);
 
   AutoCritSec lock(&m_lock);
-  m_cache.insert(std::make_pair(++m_nextSession,session));
+  AuthCache* cache = m_cache ? new AuthCache(*m_cache) : new AuthCache();
+  cache->insert(std::make_pair(++m_nextSession,session));
+  PublishSessions(cache);
   return m_nextSession;
 }
 
@@ -114,85 +163,108 @@ OAuth2Cache::CreateResourceOwnerCredentialsGrant(XString p_url
                                                 ,XString p_username
                                                 ,XString p_password)
 {
-  OAuthSession session;
-  session.m_flow     = OAuthFlow::OA_ROWNER;
-  session.m_url      = p_url;
-  session.m_appID    = p_appID;
-  session.m_appKey   = p_appKey;
-  session.m_expires  = 0L;
-  session.m_scope    = CrackedURL::EncodeURLChars(p_scope);
-  session.m_username = p_username;
-  session.m_password = p_password;
+  OAuthSession* session = new OAuthSession();
+  session->m_flow     = OAuthFlow::OA_ROWNER;
+  session->m_url      = p_url;
+  session->m_appID    = p_appID;
+  session->m_appKey   = p_appKey;
+  session->m_scope    = CrackedURL::EncodeURLChars(p_scope);
+  session->m_username = p_username;
+  session->m_password = p_password;
 
   AutoCritSec lock(&m_lock);
-  m_cache.insert(std::make_pair(++m_nextSession,session));
+  AuthCache* cache = m_cache ? new AuthCache(*m_cache) : new AuthCache();
+  cache->insert(std::make_pair(++m_nextSession,session));
+  PublishSessions(cache);
   return m_nextSession;
 }
 
 // Ending a session, removing from the cache
+// A grant that is still running keeps the session alive until it is done
 bool
 OAuth2Cache::EndSession(int p_session)
 {
   AutoCritSec lock(&m_lock);
-  AuthCache::iterator it = m_cache.find(p_session);
-  if(it != m_cache.end())
+
+  if(m_cache == nullptr)
   {
-    m_cache.erase(it);
-    return true;
+    return false;
   }
-  return false;
+  AuthCache::iterator it = m_cache->find(p_session);
+  if(it == m_cache->end())
+  {
+    return false;
+  }
+  OAuthSession* session = it->second;
+  AuthCache* cache = new AuthCache(*m_cache);
+  cache->erase(p_session);
+  PublishSessions(cache);
+  ReleaseSession(session);
+  return true;
 }
 
+// Getting the bearer token of a session.
+// Reading a valid token is lock-free. Only if there is no valid token
+// (or a refresh is demanded) the caller waits for a grant of the token server.
+// All callers that need a token for the same session wait for one and the same grant.
 XString
 OAuth2Cache::GetBearerToken(int p_session,bool p_refresh /*= false*/)
 {
-  AutoCritSec lock(&m_lock);
-
-  XString token;
-  OAuthSession* session = FindSession(p_session);
-  if(session)
+  OAuthSession* session = nullptr;
+  long generation = 0;
   {
-    if(GetIsExpired(p_session) || p_refresh)
+    AutoReaderEpoch reader(m_readers);
+
+    session = FindSession(p_session);
+    if(session == nullptr)
     {
-      StartCredentialsGrant(session);
+      return XString();
     }
-    if(!GetIsExpired(p_session))
+    // Generation first, so we cannot miss a grant that completes from here on
+    generation = session->m_generation;
+    const OAuthToken* token = session->m_token;
+    if(token && !p_refresh && token->m_expires > GetTimeNow())
     {
-      token = session->m_bearerToken;
+      return token->m_bearerToken;
     }
+    // Keep the session alive outside the reader
+    InterlockedIncrement(&session->m_references);
   }
+  XString token = GrantToken(session,generation);
+  ReleaseSession(session);
   return token;
 }
 
 bool
 OAuth2Cache::GetIsExpired(int p_session)
 {
-  AutoCritSec lock(&m_lock);
+  AutoReaderEpoch reader(m_readers);
 
-  bool expired = true;
   const OAuthSession* session = FindSession(p_session);
   if(session)
   {
-    __timeb64 now;
-    _ftime64_s(&now);
-
-    if(session->m_expires > now.time)
+    const OAuthToken* token = session->m_token;
+    if(token && token->m_expires > GetTimeNow())
     {
-      expired = false;
+      return false;
     }
   }
-  return expired;
+  return true;
 }
 
 INT64
 OAuth2Cache::GetExpires(int p_session)
 {
-  AutoCritSec lock(&m_lock);
+  AutoReaderEpoch reader(m_readers);
 
-  OAuthSession* session = FindSession(p_session);
+  const OAuthSession* session = FindSession(p_session);
   if(session)
   {
-    return session->m_expires;
+    const OAuthToken* token = session->m_token;
+    if(token)
+    {
+      return token->m_expires;
+    }
   }
   return 0L;
 }
@@ -209,9 +281,27 @@ OAuth2Cache::SetDefaultExpirationPeriod(INT64 p_default)
   m_defaultPeriod = p_default;
 }
 
+int
+OAuth2Cache::GetRefreshPercentage()
+{
+  return m_refreshPercent;
+}
+
+// Percentage of the lifetime of a token, after which
+// the token will be refreshed in the background
+void
+OAuth2Cache::SetRefreshPercentage(int p_percentage)
+{
+  if(p_percentage <  10) p_percentage =  10;
+  if(p_percentage > 100) p_percentage = 100;
+  m_refreshPercent = p_percentage;
+}
+
 void
 OAuth2Cache::SetAnalysisLog(LogAnalysis* p_logfile)
 {
+  AutoCritSec lock(&m_clientLock);
+
   m_logfile = p_logfile;
   if(m_client)
   {
@@ -223,11 +313,34 @@ OAuth2Cache::SetAnalysisLog(LogAnalysis* p_logfile)
 void
 OAuth2Cache::SetExpired(int p_session)
 {
-  OAuthSession* session = FindSession(p_session);
-  if(session)
+  SetExpired(p_session,XString());
+}
+
+// Forces to get a new Bearer token, but only if the current token is 'p_token'
+// Many threads can get an 'unauthorized' on the same token, but only the
+// first one drops it. The others will find the newly granted one.
+void
+OAuth2Cache::SetExpired(int p_session,XString p_token)
+{
+  OAuthSession* session = nullptr;
+  {
+    AutoReaderEpoch reader(m_readers);
+    session = FindSession(p_session);
+    if(session == nullptr)
+    {
+      return;
+    }
+    InterlockedIncrement(&session->m_references);
+  }
   {
-    session->m_expires = 0;
+    AutoCritSec lock(&session->m_grantLock);
+    const OAuthToken* token = session->m_token;
+    if(token && (p_token.IsEmpty() || token->m_bearerToken == p_token))
+    {
+      PublishToken(session,nullptr);
+    }
   }
+  ReleaseSession(session);
 }
 
 void
@@ -240,13 +353,16 @@ OAuth2Cache::SetDevelopment(bool p_dev /*= true*/)
 int
 OAuth2Cache::GetHasSession(XString p_appID,XString p_appKey)
 {
-  AutoCritSec lock(&m_lock);
+  AutoReaderEpoch reader(m_readers);
 
-  for(const auto& ses : m_cache)
+  if(m_cache)
   {
-    if(ses.second.m_appID == p_appID && ses.second.m_appKey == p_appKey)
+    for(const auto& ses : *m_cache)
     {
-      return ses.first;
+      if(ses.second->m_appID == p_appID && ses.second->m_appKey == p_appKey)
+      {
+        return ses.first;
+      }
     }
   }
   return 0;
@@ -258,17 +374,91 @@ OAuth2Cache::GetHasSession(XString p_appID,XString p_appKey)
 //
 //////////////////////////////////////////////////////////////////////////
 
+// Find a session in the published cache
+// MUST be called by a reader!
 OAuthSession* 
 OAuth2Cache::FindSession(int p_session)
+{
+  const AuthCache* cache = m_cache;
+  if(cache)
+  {
+    AuthCache::const_iterator it = cache->find(p_session);
+    if(it != cache->end())
+    {
+      return it->second;
+    }
+  }
+  return nullptr;
+}
+
+// Drop a reference to a session. The last one removes it.
+void
+OAuth2Cache::ReleaseSession(OAuthSession* p_session)
+{
+  if(InterlockedDecrement(&p_session->m_references) == 0)
+  {
+    delete p_session;
+  }
+}
+
+// Publish a new snapshot of the sessions
+// MUST be called with the m_lock held!
+void
+OAuth2Cache::PublishSessions(AuthCache* p_sessions)
+{
+  AuthCache* old = reinterpret_cast<AuthCache*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&m_cache),p_sessions));
+  m_readers.WaitForReaders();
+  delete old;
+}
+
+// Publish a new token snapshot for a session (or drop it with a nullptr)
+// MUST be called with the m_grantLock of the session held!
+void
+OAuth2Cache::PublishToken(OAuthSession* p_session,OAuthToken* p_token)
 {
   AutoCritSec lock(&m_lock);
 
-  AuthCache::iterator it = m_cache.find(p_session);
-  if(it != m_cache.end())
+  OAuthToken* old = reinterpret_cast<OAuthToken*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&p_session->m_token),p_token));
+  InterlockedIncrement(&p_session->m_generation);
+  m_readers.WaitForReaders();
+  delete old;
+
+  // Refresher must know about the next moment to refresh
+  if(p_token)
   {
-    return &it->second;
+    StartRefresher();
+    SetEvent(m_wakeup);
   }
-  return nullptr;
+}
+
+// Get a token for a session from the token server, one grant at the time.
+// If another thread got a token while we were waiting, we use that one.
+// A failed grant keeps the old token in use until it really expires.
+XString
+OAuth2Cache::GrantToken(OAuthSession* p_session,long p_generation)
+{
+  AutoCritSec lock(&p_session->m_grantLock);
+
+  // Tokens only change under the grant lock, so this one stays put
+  const OAuthToken* current = p_session->m_token;
+  INT64 now = GetTimeNow();
+
+  if(p_session->m_generation != p_generation && current && current->m_expires > now)
+  {
+    return current->m_bearerToken;
+  }
+  OAuthToken* token = RequestToken(p_session);
+  if(token)
+  {
+    XString bearer = token->m_bearerToken;
+    PublishToken(p_session,token);
+    return bearer;
+  }
+  if(current && current->m_expires > now)
+  {
+    return current->m_bearerToken;
+  }
+  return XString();
 }
 
 HTTPClient*
@@ -294,19 +484,17 @@ OAuth2Cache::GetClient()
   return m_client;
 }
 
-void
-OAuth2Cache::StartCredentialsGrant(OAuthSession* p_session)
+// Request a new token from the token server
+// Returns a new token snapshot, or a nullptr in case of an error
+OAuthToken*
+OAuth2Cache::RequestToken(OAuthSession* p_session)
 {
-  bool valid = false;
   XString typeFound;
-
-  // Reset the token
-  p_session->m_bearerToken.Empty();
-  p_session->m_expires = 0L;
+  XString bearer;
+  INT64   expiresIn = 0;
 
   // Getting the current time
-  __timeb64 now;
-  _ftime64_s(&now);
+  INT64 now = GetTimeNow();
 
   // Getting a token from this URL with a POST from this message
   HTTPMessage getToken(HTTPCommand::http_post,p_session->m_url);
@@ -316,8 +504,9 @@ OAuth2Cache::StartCredentialsGrant(OAuthSession* p_session)
   getToken.SetPassword(p_session->m_appKey);
   XString payload = CreateTokenRequest(p_session);
   getToken.SetBody(payload);
-  
+
   // Send through extra HTTPClient
+  AutoCritSec lock(&m_clientLock);
   HTTPClient* client = GetClient();
   client->SetPreEmptiveAuthorization(WINHTTP_AUTH_SCHEME_BASIC);
 
@@ -335,51 +524,48 @@ OAuth2Cache::StartCredentialsGrant(OAuthSession* p_session)
         }
         if(pair.m_name.CompareNoCase(_T("access_token")) == 0)
         {
-          // Remember our token
-          p_session->m_bearerToken = pair.m_value.GetString();
+          bearer = pair.m_value.GetString();
         }
         if(pair.m_name.CompareNoCase(_T("expires_in")) == 0)
         {
-          // Expires after a percentage of the given time, so we get a new token in time!
-          p_session->m_expires = now.time + (pair.m_value.GetNumberInt() * token_validity_time / 100);
+          expiresIn = pair.m_value.GetNumberInt();
         }
       }
 
       // Check if we have everything
-      if(typeFound.CompareNoCase(_T("bearer")) == 0 && p_session->m_bearerToken.GetLength() > 0 )
+      if(typeFound.CompareNoCase(_T("bearer")) == 0 && bearer.GetLength() > 0)
       {
-        valid = true;
-
         // Token expiration not given, use the default
-        if(p_session->m_expires == 0)
+        if(expiresIn <= 0)
         {
-          p_session->m_expires = m_defaultPeriod;
+          expiresIn = m_defaultPeriod;
         }
+        // Refresh after a percentage of the given time, so we get a new token in time!
+        OAuthToken* token    = new OAuthToken();
+        token->m_bearerToken = bearer;
+        token->m_expires     = now + expiresIn;
+        token->m_refresh     = now + (expiresIn * m_refreshPercent / 100);
 
         if(m_logfile)
         {
           m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_INFO,true,_T("Received OAuth2 Bearer token from: %s"),p_session->m_url.GetString());
         }
+        return token;
       }
     }
   }
 
-  // In case of an error: reset everything!!
-  if(!valid)
+  // In case of an error: log what we got
+  if(m_logfile)
   {
-    p_session->m_bearerToken.Empty();
-    p_session->m_expires = 0;
+    BYTE*  response = nullptr;
+    unsigned length = 0;
+    m_client->GetResponse(response,length);
 
-    if(m_logfile)
-    {
-      BYTE*  response = nullptr;
-      unsigned length = 0;
-      m_client->GetResponse(response,length);
-
-      m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,true,_T("Invalid response from token server. HTTP [%d]"),m_client->GetStatus());
-      m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,false,reinterpret_cast<TCHAR*>(response));
-    }
+    m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,true,_T("Invalid response from token server. HTTP [%d]"),m_client->GetStatus());
+    m_logfile->AnalysisLog(_T(__FUNCTION__),LogType::LOG_ERROR,false,reinterpret_cast<TCHAR*>(response));
   }
+  return nullptr;
 }
 
 XString
@@ -404,3 +590,150 @@ OAuth2Cache::CreateTokenRequest(OAuthSession* p_session)
   }
   return request;
 }
+
+//////////////////////////////////////////////////////////////////////////
+//
+// BACKGROUND REFRESHING OF THE TOKENS
+//
+//////////////////////////////////////////////////////////////////////////
+
+INT64
+OAuth2Cache::GetTimeNow()
+{
+  __timeb64 now;
+  _ftime64_s(&now);
+  return now.time;
+}
+
+unsigned __stdcall
+OAuth2Cache::RunRefresher(void* p_cache)
+{
+  reinterpret_cast<OAuth2Cache*>(p_cache)->Refresher();
+  return 0;
+}
+
+// Start the refresher as soon as there is a token to refresh
+// MUST be called with the m_lock held!
+void
+OAuth2Cache::StartRefresher()
+{
+  if(m_refresher == NULL && !m_stopping)
+  {
+    m_refresher = reinterpret_cast<HANDLE>(_beginthreadex(NULL,0,RunRefresher,reinterpret_cast<void*>(this),0,NULL));
+    if(m_refresher == INVALID_HANDLE_VALUE)
+    {
+      // Tokens will be gotten on demand only
+      m_refresher = NULL;
+    }
+  }
+}
+
+// Background thread: sleeps until the first token must be refreshed
+void
+OAuth2Cache::Refresher()
+{
+  DWORD wait = INFINITE;
+  while(WaitForSingleObject(m_wakeup,wait) != WAIT_FAILED && !m_stopping)
+  {
+    wait = RefreshSessions();
+  }
+}
+
+// Refresh all tokens that are past their refresh moment
+// Returns the number of milliseconds until the next refresh
+DWORD
+OAuth2Cache::RefreshSessions()
+{
+  std::vector<OAuthSession*> refresh;
+  INT64 next = 0;
+  INT64 now  = GetTimeNow();
+  {
+    AutoReaderEpoch reader(m_readers);
+
+    const AuthCache* cache = m_cache;
+    if(cache)
+    {
+      for(const auto& ses : *cache)
+      {
+        // Sessions without a token get one on demand
+        const OAuthToken* token = ses.second->m_token;
+        if(token == nullptr)
+        {
+          continue;
+        }
+        if(token->m_refresh <= now)
+        {
+          InterlockedIncrement(&ses.second->m_references);
+          refresh.push_back(ses.second);
+        }
+        else if(next == 0 || token->m_refresh < next)
+        {
+          next = token->m_refresh;
+        }
+      }
+    }
+  }
+
+  bool retry = false;
+  for(auto& session : refresh)
+  {
+    // No new grants while the cache is being destroyed
+    if(m_stopping)
+    {
+      ReleaseSession(session);
+      continue;
+    }
+    // If a grant is already running for this session, we do not start another one
+    if(TryEnterCriticalSection(&session->m_grantLock))
+    {
+      const OAuthToken* current = session->m_token;
+      if(current && current->m_refresh <= GetTimeNow())
+      {
+        OAuthToken* token = RequestToken(session);
+        if(token == nullptr)
+        {
+          retry = true;
+        }
+        if(token == nullptr && current->m_expires > GetTimeNow())
+        {
+          // Keep serving the old token until it really expires, but try again later
+          token = new OAuthToken(*current);
+          token->m_refresh = GetTimeNow() + token_retry_time;
+          if(token->m_refresh > token->m_expires)
+          {
+            token->m_refresh = token->m_expires;
+          }
+        }
+        // Publish the new token, or drop the expired one
+        PublishToken(session,token);
+      }
+      LeaveCriticalSection(&session->m_grantLock);
+    }
+    else
+    {
+      // The running grant might fail: look again later
+      retry = true;
+    }
+    ReleaseSession(session);
+  }
+
+  // Publishing a token wakes us up again to calculate the next moment.
+  // Nothing published for a session: come back after the retry time.
+  DWORD retryWait = token_retry_time * CLOCKS_PER_SEC;
+  if(next == 0)
+  {
+    return retry ? retryWait : INFINITE;
+  }
+  __timeb64 now64;
+  _ftime64_s(&now64);
+  INT64 wait = (next * CLOCKS_PER_SEC) - (now64.time * CLOCKS_PER_SEC + now64.millitm);
+  if(wait < 0)
+  {
+    wait = 0;
+  }
+  if(retry && wait > retryWait)
+  {
+    wait = retryWait;
+  }
+  return static_cast<DWORD>(wait);
+}
@@ -26,6 +26,7 @@
 // THE SOFTWARE.
 //
 #pragma once
+#include "ReaderEpoch.h"
 #include <map>
 
 enum class OAuthFlow
@@ -43,11 +44,26 @@ constexpr LPCTSTR token_server_ms(_T("https://login.microsoftonline.com/%s/oauth
 // Well known scopes
 constexpr LPCTSTR scope_ms_graph(_T("https://graph.microsoft.com/.default"));
 
-// Bearer tokens will be re-gotten after % of the expiration time
+// Bearer tokens will be re-gotten in the background after % of the expiration time
 const int token_validity_time = 90;  // Refresh after 90 percent of time has expired
+// After a failed background refresh, try again after this many seconds
+const int token_retry_time    = 10;
+
+// Immutable snapshot of a bearer token. Once published it never changes,
+// so it can be read without any locking. A refresh publishes a new snapshot.
+typedef struct _oauthToken
+{
+  XString   m_bearerToken;    // Returned "Bearer" token
+  INT64     m_refresh { 0 };  // Moment to get a new token in the background
+  INT64     m_expires { 0 };  // Moment the token really expires
+}
+OAuthToken;
 
 typedef struct _oauthSession
 {
+  _oauthSession();
+ ~_oauthSession();
+
   OAuthFlow m_flow { OAuthFlow::OA_IMPLICIT}; // Type of authorization flow
   XString   m_url;            // URL of the token server
   XString   m_appID;          // Client-id of the application
@@ -55,15 +71,17 @@ typedef struct _oauthSession
   XString   m_username;       // For Resource-owners only!
   XString   m_password;       // For Resource-owners only!
   XString   m_scope;          // Scope of the grant
-  XString   m_bearerToken;    // Last returned "Bearer" token
   XString   m_retryToken;     // Retry token (if any)
-  INT64     m_expires { 0 };  // Moment the token expires
+  OAuthToken* volatile m_token { nullptr }; // Current token snapshot (if any)
+  volatile long m_generation   { 0 };       // Number of published snapshots
+  volatile long m_references   { 1 };       // The cache + running grants
+  CRITICAL_SECTION m_grantLock;             // One grant in flight per session
 }
 OAuthSession;
 
 class HTTPClient;
 class LogAnalysis;
-using AuthCache = std::map<int,OAuthSession>;
+using AuthCache = std::map<int,OAuthSession*>;
 
 class OAuth2Cache
 {
@@ -87,26 +105,49 @@ public:
   bool      GetIsExpired(int p_session);
   INT64     GetExpires(int p_session);
   INT64     GetDefaultExpirationPeriod();
+  int       GetRefreshPercentage();
   int       GetHasSession(XString p_appID,XString p_appKey);
 
   // SETTERS
   void      SetExpired(int p_session);
+  void      SetExpired(int p_session,XString p_token);
   void      SetAnalysisLog(LogAnalysis* p_logfile);
   void      SetDefaultExpirationPeriod(INT64 p_default);
+  void      SetRefreshPercentage(int p_percentage);
   void      SetDevelopment(bool p_dev = true);
 
 private:
+  static unsigned __stdcall RunRefresher(void* p_cache);
+
+  // Lock-free reading of the sessions and their tokens
   OAuthSession* FindSession(int p_session);
-  void          StartCredentialsGrant(OAuthSession* p_session);
+  void          ReleaseSession(OAuthSession* p_session);
+  // Getting and publishing tokens
+  XString       GrantToken(OAuthSession* p_session,long p_generation);
+  OAuthToken*   RequestToken(OAuthSession* p_session);
+  void          PublishToken(OAuthSession* p_session,OAuthToken* p_token);
+  void          PublishSessions(AuthCache* p_sessions);
   XString       CreateTokenRequest(OAuthSession* p_session);
   HTTPClient*   GetClient();
+  // Background refreshing of the tokens
+  void          StartRefresher();
+  void          Refresher();
+  DWORD         RefreshSessions();
+  static INT64  GetTimeNow();
 
-  AuthCache     m_cache;                       // All cached authentications
+  AuthCache* volatile m_cache   { nullptr };   // Published snapshot of all cached authentications
+  ReaderEpoch   m_readers;                   // Readers of the sessions and tokens
   HTTPClient*   m_client        { nullptr };   // To send to the token server
   LogAnalysis*  m_logfile       { nullptr };   // Optional logfile
   INT64         m_defaultPeriod { 60 * 60 };   // Token valid for 1 hour
+  int           m_refreshPercent{ token_validity_time };  // Refresh after % of the lifetime
   int           m_nextSession   { 0 };         // Next session number to register
   bool          m_development   { false };     // Used in a development environment
-  // Locking of the session state
+  HANDLE        m_refresher     { NULL  };     // Background refreshing thread
+  HANDLE        m_wakeup        { NULL  };     // Wake up the refresher
+  volatile bool m_stopping      { false };     // Cache is being destroyed
+  // Locking of the session state (writers only, never around a token request)
   CRITICAL_SECTION m_lock;
+  // Locking of the HTTPClient to the token server
+  CRITICAL_SECTION m_clientLock;
 };
@@ -0,0 +1,276 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: SOAPBinding.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "SOAPBinding.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// SOAPBinding
+//
+//////////////////////////////////////////////////////////////////////////
+
+SOAPBinding::SOAPBinding(XString p_operation)
+            :m_operation(p_operation)
+{
+}
+
+// Build from a template message, e.g. the input message of a WSDL operation
+SOAPBinding::SOAPBinding(XString p_operation,const SOAPMessage* p_template)
+            :m_operation(p_operation)
+{
+  if(p_template)
+  {
+    AddTemplate(p_template->GetParameterObjectNode(),_T(""));
+  }
+}
+
+// Add an expected parameter while building the binding
+int
+SOAPBinding::AddParameter(XString p_path)
+{
+  BindIDs::iterator it = m_ids.find(p_path);
+  if(it != m_ids.end())
+  {
+    return it->second;
+  }
+
+  // Split the path in the first level name and the steps below it
+  BindParam param;
+  param.m_path = p_path;
+  XString first;
+  int pos = 0;
+  XString step = p_path.Tokenize(_T("/"),pos);
+  while(!step.IsEmpty())
+  {
+    if(first.IsEmpty())
+    {
+      first = step;
+    }
+    else
+    {
+      param.m_steps.push_back(step);
+    }
+    step = p_path.Tokenize(_T("/"),pos);
+  }
+  if(first.IsEmpty())
+  {
+    return -1;
+  }
+
+  int id = (int)m_params.size();
+  m_params.push_back(param);
+  m_ids.insert(std::make_pair(p_path,id));
+
+  // Group of the first level name
+  BindIDs::iterator group = m_first.find(first);
+  if(group == m_first.end())
+  {
+    group = m_first.insert(std::make_pair(first,(int)m_groups.size())).first;
+    m_groups.push_back(std::vector<int>());
+  }
+  m_groups[group->second].push_back(id);
+  return id;
+}
+
+// Find the id of a parameter, or -1 if not in the binding
+int
+SOAPBinding::GetParameterID(XString p_path) const
+{
+  BindIDs::const_iterator it = m_ids.find(p_path);
+  if(it != m_ids.end())
+  {
+    return it->second;
+  }
+  return -1;
+}
+
+XString
+SOAPBinding::GetParameterPath(int p_id) const
+{
+  if(p_id >= 0 && p_id < (int)m_params.size())
+  {
+    return m_params[p_id].m_path;
+  }
+  return XString();
+}
+
+// Add all elements of the template below this element
+void
+SOAPBinding::AddTemplate(XMLElement* p_element,XString p_prefix)
+{
+  if(p_element == nullptr)
+  {
+    return;
+  }
+  for(auto& child : p_element->GetChildren())
+  {
+    XString path = p_prefix + child->GetName();
+    AddParameter(path);
+    if(!child->GetChildren().empty())
+    {
+      AddTemplate(child,path + _T("/"));
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// SOAPParameters
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Resolve all parameters of the binding in one pass over the parameter object.
+// Just like SOAPMessage::GetParameter, the first element of a name is found
+SOAPParameters::SOAPParameters(const SOAPBinding* p_binding,SOAPMessage* p_message)
+               :m_binding(p_binding)
+{
+  if(m_binding == nullptr)
+  {
+    return;
+  }
+  m_elements.resize(m_binding->m_params.size(),nullptr);
+
+  XMLElement* object = p_message ? p_message->GetParameterObjectNode() : nullptr;
+  if(object == nullptr)
+  {
+    return;
+  }
+
+  std::vector<bool> done(m_binding->m_groups.size(),false);
+  for(auto& child : object->GetChildren())
+  {
+    SOAPBinding::BindIDs::const_iterator it = m_binding->m_first.find(child->GetName());
+    if(it == m_binding->m_first.end() || done[it->second])
+    {
+      continue;
+    }
+    done[it->second] = true;
+
+    // All parameters on or below this first level element
+    for(auto id : m_binding->m_groups[it->second])
+    {
+      XMLElement* element = child;
+      for(auto& step : m_binding->m_params[id].m_steps)
+      {
+        XMLElement* found = nullptr;
+        for(auto& sub : element->GetChildren())
+        {
+          if(sub->GetName().Compare(step) == 0)
+          {
+            found = sub;
+            break;
+          }
+        }
+        element = found;
+        if(element == nullptr)
+        {
+          break;
+        }
+      }
+      m_elements[id] = element;
+    }
+  }
+}
+
+XMLElement*
+SOAPParameters::GetElement(int p_id) const
+{
+  if(p_id >= 0 && p_id < (int)m_elements.size())
+  {
+    return m_elements[p_id];
+  }
+  return nullptr;
+}
+
+XString
+SOAPParameters::GetParameter(int p_id) const
+{
+  XMLElement* element = GetElement(p_id);
+  if(element)
+  {
+    return element->GetValue();
+  }
+  return XString();
+}
+
+int
+SOAPParameters::GetParameterInteger(int p_id) const
+{
+  return _ttoi(GetParameter(p_id));
+}
+
+// Same rules as XMLMessage::GetElementBoolean
+bool
+SOAPParameters::GetParameterBoolean(int p_id) const
+{
+  XString value = GetParameter(p_id);
+  if((value.CompareNoCase(_T("true")) == 0) ||
+     (value.CompareNoCase(_T("yes"))  == 0))
+  {
+    return true;
+  }
+  return _ttoi(value) > 0;
+}
+
+double
+SOAPParameters::GetParameterDouble(int p_id) const
+{
+  return _ttof(GetParameter(p_id));
+}
+
+bool
+SOAPParameters::HasParameter(int p_id) const
+{
+  return GetElement(p_id) != nullptr;
+}
+
+XString
+SOAPParameters::GetParameter(XString p_path) const
+{
+  return m_binding ? GetParameter(m_binding->GetParameterID(p_path)) : XString();
+}
+
+int
+SOAPParameters::GetResolvedCount() const
+{
+  int count = 0;
+  for(auto& element : m_elements)
+  {
+    if(element)
+    {
+      ++count;
+    }
+  }
+  return count;
+}
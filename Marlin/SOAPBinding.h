@@ -0,0 +1,107 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: SOAPBinding.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "SOAPMessage.h"
+#include <vector>
+#include <map>
+
+// Binding of the expected parameters of one SOAP operation.
+// Every parameter name is resolved once to a number (the id of the parameter),
+// so the service code gets a parameter by its id in O(1) through SOAPParameters.
+// Parameters on a lower level are named by their path: "Parameters/LanguageFrom"
+// A binding is not changed after it has been built, so it can be shared
+// by all threads that handle the operation. See WSDLCache::GetBinding.
+//
+class SOAPBinding
+{
+public:
+  explicit SOAPBinding(XString p_operation);
+  // Build the binding from a template message (all parameters on all levels)
+  SOAPBinding(XString p_operation,const SOAPMessage* p_template);
+
+  // Add an expected parameter while building the binding. Returns the id
+  int     AddParameter(XString p_path);
+  // Find the id of a parameter, or -1 if not in the binding
+  int     GetParameterID(XString p_path) const;
+  // Path of a parameter id
+  XString GetParameterPath(int p_id) const;
+
+  XString GetOperation() const      { return m_operation;           };
+  int     GetParameterCount() const { return (int)m_params.size();  };
+
+private:
+  friend class SOAPParameters;
+
+  // Add all elements of the template below this element
+  void    AddTemplate(XMLElement* p_element,XString p_prefix);
+
+  // One expected parameter
+  typedef struct _bindParam
+  {
+    XString              m_path;      // Full path of the parameter
+    std::vector<XString> m_steps;     // Steps of the path below the first level
+  }
+  BindParam;
+
+  using BindParams = std::vector<BindParam>;
+  using BindIDs    = std::map<XString,int>;
+  using BindGroups = std::vector<std::vector<int>>;
+
+  XString     m_operation;            // Name of the SOAP operation
+  BindParams  m_params;               // All parameters by id
+  BindIDs     m_ids;                  // Path of the parameter -> id
+  BindIDs     m_first;                // First level name -> group of parameters
+  BindGroups  m_groups;               // Parameter ids per first level name
+};
+
+// The parameters of one SOAP message, resolved by a SOAPBinding.
+// Resolving walks the parameter object of the message once: all the gets
+// after that are O(1). Results are the same as SOAPMessage::GetParameter...
+// Lives no longer than the message itself: e.g. during the handling of the message.
+//
+class SOAPParameters
+{
+public:
+  SOAPParameters(const SOAPBinding* p_binding,SOAPMessage* p_message);
+
+  // Getting by the id of the binding
+  XMLElement* GetElement         (int p_id) const;
+  XString     GetParameter       (int p_id) const;
+  int         GetParameterInteger(int p_id) const;
+  bool        GetParameterBoolean(int p_id) const;
+  double      GetParameterDouble (int p_id) const;
+  bool        HasParameter       (int p_id) const;
+  // Getting by path: one lookup in the binding, no searching in the message
+  XString     GetParameter       (XString p_path) const;
+  // Number of parameters of the binding found in the message
+  int         GetResolvedCount() const;
+
+private:
+  const SOAPBinding*       m_binding { nullptr };
+  std::vector<XMLElement*> m_elements;    // Resolved elements by id
+};
@@ -72,3 +72,61 @@ SiteFilter::Handle(HTTPMessage* p_message)
 
   return true;
 }
+
+// Record the duration of one call to the filter
+void
+SiteFilter::RecordTiming(LONGLONG p_ticks)
+{
+  InterlockedIncrement64(&m_calls);
+  InterlockedAdd64(&m_ticks,p_ticks);
+
+  LONGLONG maximum = m_maxTicks;
+  while(p_ticks > maximum)
+  {
+    LONGLONG found = InterlockedCompareExchange64(&m_maxTicks,p_ticks,maximum);
+    if(found == maximum)
+    {
+      break;
+    }
+    maximum = found;
+  }
+}
+
+void
+SiteFilter::ResetTiming()
+{
+  InterlockedExchange64(&m_calls,   0);
+  InterlockedExchange64(&m_ticks,   0);
+  InterlockedExchange64(&m_maxTicks,0);
+}
+
+// Performance counter ticks to milliseconds
+static double
+TicksToMilliseconds(LONGLONG p_ticks)
+{
+  static LARGE_INTEGER frequency { 0 };
+  if(frequency.QuadPart == 0)
+  {
+    QueryPerformanceFrequency(&frequency);
+  }
+  return (1000.0 * (double)p_ticks) / (double)frequency.QuadPart;
+}
+
+double
+SiteFilter::GetTotalTime()
+{
+  return TicksToMilliseconds(m_ticks);
+}
+
+double
+SiteFilter::GetAverageTime()
+{
+  LONGLONG calls = m_calls;
+  return calls ? TicksToMilliseconds(m_ticks) / (double)calls : 0.0;
+}
+
+double
+SiteFilter::GetMaximumTime()
+{
+  return TicksToMilliseconds(m_maxTicks);
+}
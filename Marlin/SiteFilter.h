@@ -28,6 +28,8 @@
 #pragma once
 #include "HTTPSite.h"
 
+class MetricsHistogram;
+
 // The site filter
 // Create your own derived class with it's own "Handle" method
 //
@@ -50,10 +52,35 @@ public:
   XString      GetName()                 { return m_name;     };
   unsigned     GetPriority()             { return m_priority; };
 
+  // Timing of the filter (only if the site has 'FilterTiming' switched on)
+  void         RecordTiming(LONGLONG p_ticks);
+  void         ResetTiming();
+  LONGLONG     GetCallCount()            { return m_calls;    };
+  double       GetTotalTime();           // Milliseconds
+  double       GetAverageTime();         // Milliseconds
+  double       GetMaximumTime();         // Milliseconds
+  // Latency histogram in the server-wide metrics
+  void         SetMetrics(MetricsHistogram* p_metrics) { m_metrics = p_metrics; };
+  MetricsHistogram* GetMetrics()         { return m_metrics;  };
+
 protected:
   HTTPSite* m_site      { nullptr };
   unsigned  m_priority  { 0       };
   XString   m_name;
+  // Timing counters
+  volatile LONGLONG m_calls    { 0 };   // Number of timed calls
+  volatile LONGLONG m_ticks    { 0 };   // Total performance counter ticks
+  volatile LONGLONG m_maxTicks { 0 };   // Slowest call in ticks
+  MetricsHistogram* m_metrics  { nullptr };
+};
+
+// Immutable snapshot of the filters of a site, in priority order.
+// Published by HTTPSite::SetFilter/RemoveFilter and read without locking
+// by HTTPSite::CallFilters. Never changed after it has been published.
+class SiteFilterChain
+{
+public:
+  std::vector<SiteFilter*> m_filters;
 };
 
 
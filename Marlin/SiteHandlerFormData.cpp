@@ -47,24 +47,27 @@ SiteHandlerFormData::Handle(HTTPMessage* p_message)
   XString contentType = p_message->GetContentType();
   FileBuffer* buffer  = p_message->GetFileBuffer();
   MultiPartBuffer multi(FormDataType::FD_UNKNOWN);
+  // Form-data can already be parsed while receiving the message
+  MultiPartBuffer* streamed = p_message->GetStreamedFormData();
+  MultiPartBuffer* parts    = streamed ? streamed : &multi;
 
-  if(buffer && !contentType.IsEmpty())
+  if(streamed || (buffer && !contentType.IsEmpty()))
   {
     // Getting all parts from the HTTPMessage
-    if(multi.ParseBuffer(contentType,buffer))
+    if(streamed || multi.ParseBuffer(contentType,buffer))
     {
       // Clear the message for an answer
       p_message->Reset();
       p_message->SetStatus(HTTP_STATUS_OK);
 
       // Do Pre-handling first
-      PreHandleBuffer(p_message,&multi);
+      PreHandleBuffer(p_message,parts);
 
       // Cycle through all the parts
-      size_t parts = multi.GetParts();
-      for(size_t ind = 0; ind < parts; ++ind)
+      size_t number = parts->GetParts();
+      for(size_t ind = 0; ind < number; ++ind)
       {
-        MultiPart* part = multi.GetPart((int)ind);
+        MultiPart* part = parts->GetPart((int)ind);
         if(part)
         {
           if(part->GetShortFileName().IsEmpty())
@@ -83,7 +86,7 @@ SiteHandlerFormData::Handle(HTTPMessage* p_message)
         }
       }
       // Now ready with all the parts. Do the post-handling
-      PostHandleBuffer(p_message,&multi);
+      PostHandleBuffer(p_message,parts);
     }
     else
     {
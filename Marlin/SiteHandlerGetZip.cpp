@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: SiteHandlerGetZip.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "SiteHandlerGetZip.h"
+#include "HTTPMessage.h"
+#include "HTTPSite.h"
+#include "HTTPServer.h"
+#include "ServiceQuality.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+SiteHandlerGetZip::SiteHandlerGetZip(XString p_archive,size_t p_cacheSize /*= ZIPWEBROOT_CACHE*/)
+                  :m_webroot(p_archive,p_cacheSize)
+{
+}
+
+SiteHandlerGetZip::~SiteHandlerGetZip()
+{
+}
+
+// Map the archive and index it once: not on every request
+void
+SiteHandlerGetZip::OnStartSite()
+{
+  SiteHandlerGet::OnStartSite();
+
+  if(m_webroot.Open())
+  {
+    XString text;
+    text.Format(_T("ZIP webroot with %d entries: "),m_webroot.GetNumberOfEntries());
+    SITE_DETAILLOGS(text,m_webroot.GetArchive());
+  }
+  else
+  {
+    SITE_ERRORLOG(ERROR_FILE_NOT_FOUND,_T("Cannot open ZIP webroot: ") + m_webroot.GetArchive());
+  }
+}
+
+void
+SiteHandlerGetZip::OnStopSite()
+{
+  m_webroot.Close();
+  SiteHandlerGet::OnStopSite();
+}
+
+bool
+SiteHandlerGetZip::Handle(HTTPMessage* p_message)
+{
+  p_message->SetCommand(HTTPCommand::http_response);
+
+  // Resource relative to the site is the name in the archive
+  XString resource = CrackedURL::DecodeURLChars(p_message->GetAbsoluteResource());
+  XString site     = m_site->GetSite();
+  if(resource.Left(site.GetLength()).CompareNoCase(site) == 0)
+  {
+    resource = resource.Mid(site.GetLength());
+  }
+  // See to transformations of derived handler (index.html)
+  if(resource.IsEmpty())
+  {
+    resource = _T("/");
+  }
+  FileNameTransformations(resource);
+
+  // Client accepts the deflate stream of the archive wrapped as gzip?
+  // A quality of zero ("gzip;q=0") means the client refuses it
+  ServiceQuality encodings(p_message->GetAcceptEncoding());
+  bool gzip    = encodings.GetPreferenceByName(_T("gzip"))   > 0 ||
+                 encodings.GetPreferenceByName(_T("x-gzip")) > 0;
+  bool encoded = false;
+  BufferChain content;
+  if(m_webroot.GetContent(resource,gzip,content,encoded))
+  {
+    FileBuffer* buffer = p_message->GetFileBuffer();
+    buffer->Reset();
+    buffer->ResetFilename();
+    buffer->AddBufferChain(content);
+
+    p_message->SetContentType(m_site->GetContentTypeByResourceName(resource));
+    if(encoded)
+    {
+      p_message->AddHeader(_T("Content-Encoding"),_T("gzip"));
+      p_message->AddHeader(_T("Vary"),_T("Accept-Encoding"));
+    }
+    p_message->SetStatus(HTTP_STATUS_OK);
+    SITE_DETAILLOGS(_T("HTTP GET from ZIP: "),resource);
+  }
+  else
+  {
+    p_message->SetStatus(HTTP_STATUS_NOT_FOUND);
+    XString text;
+    text.Format(_T("HTTP GET: Not found in ZIP webroot: %s"),resource.GetString());
+    SITE_ERRORLOG(ERROR_FILE_NOT_FOUND,text);
+  }
+  // Ready with the get
+  return true;
+}
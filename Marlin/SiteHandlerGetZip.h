@@ -0,0 +1,55 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: SiteHandlerGetZip.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "SiteHandlerGet.h"
+#include "ZipWebroot.h"
+
+// GET handler that serves a site from a ZIP archive instead of the webroot directory.
+// The resource name relative to the site is the name of the entry in the archive.
+// Deploying a new version of the site is replacing one file.
+//
+// Stored entries are sent straight from the memory-mapped archive.
+// Deflated entries are sent as "Content-Encoding: gzip" without recompressing if the
+// client accepts gzip, otherwise they are inflated into a bounded cache.
+//
+class SiteHandlerGetZip: public SiteHandlerGet
+{
+public:
+  explicit SiteHandlerGetZip(XString p_archive,size_t p_cacheSize = ZIPWEBROOT_CACHE);
+  virtual ~SiteHandlerGetZip();
+
+  virtual void OnStartSite() override;
+  virtual void OnStopSite()  override;
+
+  ZipWebroot*  GetWebroot()  { return &m_webroot; }
+
+protected:
+  virtual bool Handle(HTTPMessage* p_message) override;
+
+  ZipWebroot   m_webroot;
+};
@@ -31,6 +31,7 @@
 #include "SiteHandlerSoap.h"
 #include "WebServiceServer.h"
 #include "HTTPSite.h"
+#include "JSONTranscoder.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -115,8 +116,7 @@ SiteHandlerJson2Soap::PostHandle(HTTPMessage* p_message)
   // CONVERT SOAP Message to JSON message
   if(g_soapMessage && !g_soapMessage->GetHasBeenAnswered())
   {
-    JSONMessage jsonMessage(g_soapMessage);
-    if(m_site->SendResponse(&jsonMessage))
+    if(SendJsonResponse(g_soapMessage))
     {
       p_message    ->SetHasBeenAnswered();
       g_soapMessage->SetHasBeenAnswered();
@@ -133,8 +133,7 @@ SiteHandlerJson2Soap::CleanUp(HTTPMessage* p_message)
     if(!g_soapMessage->GetHasBeenAnswered() &&
        !p_message->GetHasBeenAnswered())
     {
-      JSONMessage jsonMessage(g_soapMessage);
-      m_site->SendResponse(&jsonMessage);
+      SendJsonResponse(g_soapMessage);
     }
     p_message->SetHasBeenAnswered();
     // Cleanup the SOAP message
@@ -151,3 +150,20 @@ SiteHandlerJson2Soap::CleanUp(HTTPMessage* p_message)
     m_site->SendResponse(p_message);
   }
 }
+
+// Stream the SOAP message directly as the JSON body of the response.
+// Only when lookahead is needed, we go through a JSONMessage tree
+bool
+SiteHandlerJson2Soap::SendJsonResponse(SOAPMessage* p_soap)
+{
+  JSONTranscoder transcoder;
+  if(!transcoder.CanWriteSoap(p_soap))
+  {
+    JSONMessage jsonMessage(p_soap);
+    return m_site->SendResponse(&jsonMessage);
+  }
+  HTTPMessage* answer = new HTTPMessage(HTTPCommand::http_response,p_soap,true);
+  bool result = m_site->SendResponse(answer);
+  answer->DropReference();
+  return result;
+}
@@ -40,4 +40,7 @@ protected:
   virtual bool     Handle(SOAPMessage* p_message);
   virtual void PostHandle(HTTPMessage* p_message) override;
   virtual void CleanUp   (HTTPMessage* p_message) override;
+
+  // Send the SOAP answer as JSON: streamed if possible
+  bool SendJsonResponse(SOAPMessage* p_soap);
 };
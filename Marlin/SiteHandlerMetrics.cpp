@@ -0,0 +1,73 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: SiteHandlerMetrics.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "SiteHandlerMetrics.h"
+#include "HTTPMessage.h"
+#include "HTTPSite.h"
+#include "HTTPServer.h"
+#include "Metrics.h"
+#include "StringWriter.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+bool
+SiteHandlerMetrics::Handle(HTTPMessage* p_message)
+{
+  XString resource = p_message->GetAbsoluteResource();
+  XString accept   = p_message->GetHeader(_T("Accept"));
+  bool json = resource.Right(4).CompareNoCase(_T("json")) == 0 ||
+              p_message->GetCrackedURL().GetParameter(_T("format")).CompareNoCase(_T("json")) == 0 ||
+              accept.MakeLower().Find(_T("application/json")) >= 0;
+
+  // Answer with a fresh response
+  p_message->Reset();
+  XString empty;
+  p_message->SetFile(empty);
+
+  // Aggregate all metrics directly into the response buffer
+  StringWriter writer(p_message->GetFileBuffer(),_T("utf-8"));
+  if(json)
+  {
+    g_metrics.WriteJson(writer);
+    p_message->SetContentType(_T("application/json; charset=utf-8"));
+  }
+  else
+  {
+    g_metrics.WritePrometheus(writer);
+    p_message->SetContentType(_T("text/plain; version=0.0.4; charset=utf-8"));
+  }
+  writer.Flush();
+  p_message->AddHeader(_T("Cache-Control"),_T("no-store"));
+
+  SITE_DETAILLOGS(_T("Served the server-wide metrics to: "),SocketToServer(p_message->GetSender()));
+  return true;
+}
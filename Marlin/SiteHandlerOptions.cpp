@@ -69,7 +69,9 @@ SiteHandlerOptions::Handle(HTTPMessage* p_message)
   }
 
   // The OPTIONS call is where we do the Pre-flight checks of CORS
-  if(m_site->GetUseCORS())
+  // All CORS settings come from one snapshot of the site settings
+  SiteLiveSettings live(m_site->GetLiveSettings());
+  if(live.m_useCORS)
   {
     // Read the message
     XString comesFrom = p_message->GetHeader(_T("Origin"));
@@ -77,7 +79,7 @@ SiteHandlerOptions::Handle(HTTPMessage* p_message)
     XString reqHeader = p_message->GetHeader(_T("Access-Control-Request-Headers"));
     p_message->Reset();
 
-    if(CheckCrossOriginSettings(p_message,comesFrom,reqMethod,reqHeader) == false)
+    if(CheckCrossOriginSettings(p_message,comesFrom,reqMethod,reqHeader,live.m_corsMaxAge,live.m_corsCredentials) == false)
     {
       p_message->SetCommand(HTTPCommand::http_response);
       m_site->SendResponse(p_message);
@@ -127,7 +129,9 @@ bool
 SiteHandlerOptions::CheckCrossOriginSettings(HTTPMessage* p_message
                                             ,XString      p_origin
                                             ,XString      p_method
-                                            ,XString      p_headers)
+                                            ,XString      p_headers
+                                            ,unsigned     p_maxAge
+                                            ,bool         p_credentials)
 {
   // Check all requested header methods
   if(!CheckCORSOrigin (p_message,p_origin))  return false;
@@ -135,14 +139,14 @@ SiteHandlerOptions::CheckCrossOriginSettings(HTTPMessage* p_message
   if(!CheckCORSHeaders(p_message,p_headers)) return false;
 
   // Adding the max age if any
-  if(m_site->GetCORSMaxAge() > 0)
+  if(p_maxAge > 0)
   {
     XString maxAge;
-    maxAge.Format(_T("%d"),m_site->GetCORSMaxAge());
+    maxAge.Format(_T("%u"),p_maxAge);
     p_message->AddHeader(_T("Access-Control-Max-Age"),maxAge);
   }
 
-  if(m_site->GetCORSAllowCredentials())
+  if(p_credentials)
   {
     p_message->AddHeader(_T("Access-Control-Allow-Credentials"),_T("true"));
   }
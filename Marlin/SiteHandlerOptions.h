@@ -43,7 +43,12 @@ protected:
   virtual void PostHandle(HTTPMessage* p_message) override;
 private:
   // Do the CORS Pre-Flight checking for an OPTIONS call
-  bool CheckCrossOriginSettings(HTTPMessage* p_message,XString p_origin,XString p_method,XString p_headers);
+  bool CheckCrossOriginSettings(HTTPMessage* p_message
+                               ,XString      p_origin
+                               ,XString      p_method
+                               ,XString      p_headers
+                               ,unsigned     p_maxAge
+                               ,bool         p_credentials);
 
   bool CheckCORSOrigin (HTTPMessage* p_message,XString p_origin);
   bool CheckCORSMethod (HTTPMessage* p_message,XString p_method);
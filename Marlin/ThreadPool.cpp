@@ -30,6 +30,7 @@
 #include "ErrorReport.h"
 #include "CPULoad.h"
 #include "AutoCritical.h"
+#include "Metrics.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -48,9 +49,13 @@ static char THIS_FILE[] = __FILE__;
 #define TP_TRACE2(sz,p1,p2)  ;
 #endif
 
+// Numbering of the pools in the metrics
+static volatile long g_poolNumbers = 0;
+
 // Static function, running a thread
 static unsigned _stdcall RunThread(void* p_myThread);
 static unsigned _stdcall RunHeartBeat(void* p_pool);
+static unsigned _stdcall RunSizerThread(void* p_pool);
 
 
 // Set a name on your thread
@@ -109,6 +114,8 @@ ThreadPool::ThreadPool(int p_minThreads,int p_maxThreads)
 ThreadPool::~ThreadPool()
 {
   StopThreadPool();
+  delete m_sizer;
+  delete m_sizerSnapshot;
   DeleteCriticalSection(&m_critical);
   DeleteCriticalSection(&m_cpuclock);
 }
@@ -188,6 +195,19 @@ ThreadPool::InitThreadPool()
     m_completion = CreateIoCompletionPort(INVALID_HANDLE_VALUE,NULL,NULL,0);
   }
 
+  // Register the metrics of the pool: threads and the waiting time of the work
+  if(m_poolNumber == 0)
+  {
+    m_poolNumber = InterlockedIncrement(&g_poolNumbers);
+  }
+  XString number;
+  number.Format(_T("%d"),m_poolNumber);
+  MetricsLabels labels { { _T("pool"),number } };
+  g_metrics.AddGauge(_T("marlin_threadpool_threads"),labels,&m_curThreads,_T("Current number of threads in the pool"));
+  g_metrics.AddGauge(_T("marlin_threadpool_busy"),   labels,&m_bsyThreads,_T("Number of busy threads in the pool"));
+  m_queueMetrics = g_metrics.GetHistogram(_T("marlin_threadpool_queue_wait_seconds"),labels,_T("Waiting time of submitted work in the queue"));
+  m_expiredMetrics = g_metrics.GetCounter(_T("marlin_threadpool_work_expired_total"),labels,_T("Work that could not start before its deadline"));
+
   // Create our minimum threads
   for(int ind = 0; ind < m_minThreads; ++ind)
   {
@@ -196,6 +216,12 @@ ThreadPool::InitThreadPool()
   // Open for business
   m_initialized = true;
   m_openForWork = true;
+
+  // Sizing by a controller instead of the CPU load
+  if(m_sizer)
+  {
+    StartSizer();
+  }
 }
 
 // Create a thread in the threadpool
@@ -413,7 +439,7 @@ RunThread(void* p_myThread)
 }
 
 DWORD
-ThreadPool::RunAThread(ThreadRegister* /*p_register*/)
+ThreadPool::RunAThread(ThreadRegister* p_register)
 {
   // Install SEH to regular exception translator
   _set_se_translator(SeTranslator);
@@ -466,7 +492,9 @@ ThreadPool::RunAThread(ThreadRegister* /*p_register*/)
     }
 
     // Should we add another thread to the pool?
-    if((m_bsyThreads == m_curThreads) &&
+    // With a sizer, the sizing thread decides
+    if(!m_sizer &&
+       (m_bsyThreads == m_curThreads) &&
        (m_bsyThreads  < m_maxThreads) &&
        (GetCPULoad(&m_cpuclock)  < 0.75) &&
        m_openForWork)
@@ -494,28 +522,48 @@ ThreadPool::RunAThread(ThreadRegister* /*p_register*/)
         void*         payload  = nullptr;
         if(WorkToDo(callback,payload))
         {
+          p_register->m_workStarted = GetTickCount64();
           DoTheCallback(callback,payload);
+          p_register->m_workStarted = 0;
+          InterlockedIncrement64(&m_completed);
         }
       }
       else if (key == COMPLETION_CALL)
       {
         // 2: Implement your overload of this special call
+        p_register->m_workStarted = GetTickCount64();
         DoTheCallback(overlapped);
+        p_register->m_workStarted = 0;
+        InterlockedIncrement64(&m_completed);
       }
       else
       {
         // 3: The completion key **IS** the callback mechanism
         LPFN_CALLBACK callback = reinterpret_cast<LPFN_CALLBACK>(key);
+        p_register->m_workStarted = GetTickCount64();
         (*callback)(overlapped);
+        p_register->m_workStarted = 0;
+        InterlockedIncrement64(&m_completed);
       }
     }
 
-    // Find CPU load and see if we must remain in the threadpool
-    load = GetCPULoad(&m_cpuclock);
-    TP_TRACE1("CPU Load: %f\n",load);
-    if((load > 0.9) && (m_curThreads > m_minThreads))
+    if(m_sizer)
     {
-      stayInThePool = false;
+      // See if the sizer asked for one thread less
+      if(LeaveForSizer())
+      {
+        stayInThePool = false;
+      }
+    }
+    else
+    {
+      // Find CPU load and see if we must remain in the threadpool
+      load = GetCPULoad(&m_cpuclock);
+      TP_TRACE1("CPU Load: %f\n",load);
+      if((load > 0.9) && (m_curThreads > m_minThreads))
+      {
+        stayInThePool = false;
+      }
     }
     if(m_abortfunction)
     {
@@ -575,21 +623,98 @@ ThreadPool::WorkToDo(LPFN_CALLBACK& p_callback,void*& p_argument)
   AutoLockTP lock(&m_critical);
 
   // See if there are items in the work queue
-  if(m_work.size() == 0)
+  int priority = NextWorkClass();
+  if(priority < 0)
   {
     return false;
   }
-  // User first arguments in the work queue
-  p_callback = m_work[0].m_callback;
-  p_argument = m_work[0].m_argument;
+  // User first arguments in the work queue of the class
+  ThreadWork& work = m_work[priority].front();
+  p_callback = work.m_callback;
+  p_argument = work.m_argument;
+  if(work.m_queued && m_queueMetrics)
+  {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    m_queueMetrics->RecordTicks(now.QuadPart - work.m_queued);
+  }
+  // Too late to start: do the expiration callback (reject/drop) instead
+  if(work.m_deadline && work.m_expired && GetTickCount64() > work.m_deadline)
+  {
+    TP_TRACE0("Work item past its deadline\n");
+    p_callback = work.m_expired;
+    InterlockedIncrement(&m_expired);
+    if(m_expiredMetrics)
+    {
+      m_expiredMetrics->Add();
+    }
+  }
   // Remove first element in the work queue
-  m_work.pop_front();
+  m_work[priority].pop_front();
+  InterlockedIncrement64(&m_started);
 
   TP_TRACE0("WORK POPPPED from the work queue!\n");
 
   return true;
 }
 
+// Priority class to take the next work from, or -1 if no work
+// The highest class with work goes first. But a lower class with work that 
+// waits longer than WORK_STARVATION milliseconds gets every WORK_STARVATION_SHARE turn.
+// Pool is/MUST BE already in a locked state
+int
+ThreadPool::NextWorkClass()
+{
+  int next     = -1;
+  int starving = -1;
+  ULONGLONG now = GetTickCount64();
+
+  for(int priority = 0; priority < WORK_PRIORITIES; ++priority)
+  {
+    if(m_work[priority].empty())
+    {
+      continue;
+    }
+    if(next < 0)
+    {
+      next = priority;
+    }
+    else if(starving < 0 && (now - m_work[priority].front().m_submitted) > WORK_STARVATION)
+    {
+      starving = priority;
+    }
+  }
+  // Starving lower class has its turn
+  if(starving >= 0 && ++m_starvedTurns >= WORK_STARVATION_SHARE)
+  {
+    m_starvedTurns = 0;
+    return starving;
+  }
+  return next;
+}
+
+// Total of all work still in the queues
+int
+ThreadPool::GetWorkOverflow()
+{
+  AutoLockTP lock(&m_critical);
+
+  size_t total = 0;
+  for(int priority = 0; priority < WORK_PRIORITIES; ++priority)
+  {
+    total += m_work[priority].size();
+  }
+  return (int)total;
+}
+
+// Work still in the queue of one priority class
+int
+ThreadPool::GetWorkOverflow(WorkPriority p_priority)
+{
+  AutoLockTP lock(&m_critical);
+  return (int)m_work[(int)p_priority].size();
+}
+
 // Stop a thread for good
 // Stop the last thread in the pool. Does **NOT** stop the exact thread (anymore)
 // Now only relevant for stopping ALL jobs at the end of the lifetime
@@ -752,6 +877,33 @@ ThreadPool::StopHeartbeat()
 bool
 ThreadPool::SubmitWork(LPFN_CALLBACK p_callback,void* p_argument)
 {
+  return SubmitWork(p_callback,p_argument,WorkPriority::WP_Normal);
+}
+
+// Submit in a priority class, optionally with a deadline to start the work.
+// If the deadline passes before a thread is free, the p_expired callback is 
+// called with the argument instead, so the work can be rejected or dropped.
+// Without an expiration callback, late work is still done.
+bool
+ThreadPool::SubmitWork(LPFN_CALLBACK p_callback
+                      ,void*         p_argument
+                      ,WorkPriority  p_priority
+                      ,ULONGLONG     p_deadline /*= 0*/
+                      ,LPFN_CALLBACK p_expired  /*= nullptr*/)
+{
+  // Already too late: do not queue the work
+  ULONGLONG now = GetTickCount64();
+  if(p_deadline && now > p_deadline)
+  {
+    TP_TRACE0("Work rejected: deadline has already passed\n");
+    InterlockedIncrement(&m_expired);
+    if(m_expiredMetrics)
+    {
+      m_expiredMetrics->Add();
+    }
+    return false;
+  }
+
   // Lock the pool
   AutoLockTP lock(&m_critical);
 
@@ -769,10 +921,19 @@ ThreadPool::SubmitWork(LPFN_CALLBACK p_callback,void* p_argument)
 
   // Queue the work for later use
   ThreadWork work;
-  work.m_callback = p_callback;
-  work.m_argument = p_argument;
-  m_work.push_back(work);
-  TP_TRACE1("Queueing 1 job. Work queue now [%d] items\n",m_work.size());
+  work.m_callback  = p_callback;
+  work.m_argument  = p_argument;
+  work.m_submitted = now;
+  work.m_deadline  = p_deadline;
+  work.m_expired   = p_expired;
+  if(g_metrics.GetActive() || m_sizer)
+  {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    work.m_queued = now.QuadPart;
+  }
+  m_work[(int)p_priority].push_back(work);
+  TP_TRACE2("Queueing 1 job in class [%d]. Work queue now [%d] items\n",(int)p_priority,m_work[(int)p_priority].size());
 
   // Post to free 1 thread from the pool
   if(!PostQueuedCompletionStatus(m_completion,0,COMPLETION_WORK,(LPOVERLAPPED)INVALID_HANDLE_VALUE))
@@ -794,6 +955,203 @@ ThreadPool::SubmitCleanup(LPFN_CALLBACK p_cleanup,void* p_argument)
   TP_TRACE1("Cleanup jobs queue [%d] items\n",m_cleanup.size());
 }
 
+//////////////////////////////////////////////////////////////////////////
+//
+// SIZING THE THREADPOOL
+//
+//////////////////////////////////////////////////////////////////////////
+
+// Size the pool with a sizing controller instead of the CPU load
+// Can be called once. The pool takes ownership of the sizer
+bool
+ThreadPool::SetSizer(PoolSizer* p_sizer,DWORD p_interval)
+{
+  AutoLockTP lock(&m_critical);
+
+  if(m_sizer || p_sizer == nullptr)
+  {
+    return false;
+  }
+  m_sizer         = p_sizer;
+  m_sizerInterval = p_interval > 0 ? p_interval : SIZER_INTERVAL;
+
+  // Already running: start sizing right away
+  if(m_initialized && m_openForWork)
+  {
+    StartSizer();
+  }
+  return true;
+}
+
+// Start the sizing thread and register the metrics of the decisions
+void
+ThreadPool::StartSizer()
+{
+  if(m_sizerRunning || m_sizerThread)
+  {
+    return;
+  }
+  if(m_sizerSnapshot == nullptr)
+  {
+    m_sizerSnapshot = new MetricsSnapshot();
+  }
+  XString number;
+  number.Format(_T("%d"),m_poolNumber);
+  MetricsLabels labels  { { _T("pool"),number } };
+  MetricsLabels growing { { _T("pool"),number },{ _T("decision"),_T("grow")   } };
+  MetricsLabels shrinks { { _T("pool"),number },{ _T("decision"),_T("shrink") } };
+  g_metrics.AddGauge(_T("marlin_threadpool_blocked"),labels,&m_blkThreads,_T("Threads blocked on one work item"));
+  g_metrics.AddGauge(_T("marlin_threadpool_queue_wait_p95_microseconds"),labels,&m_waitP95,_T("95th percentile of the queue waiting time of the last sizing interval"));
+  m_sizerGrow   = g_metrics.GetCounter(_T("marlin_threadpool_sizer_decisions_total"),growing,_T("Decisions of the sizer of the pool"));
+  m_sizerShrink = g_metrics.GetCounter(_T("marlin_threadpool_sizer_decisions_total"),shrinks,_T("Decisions of the sizer of the pool"));
+
+  m_sizerEvent = CreateEvent(NULL,FALSE,FALSE,NULL);
+  if(m_sizerEvent)
+  {
+    m_sizerRunning = true;
+    m_sizerThread  = reinterpret_cast<HANDLE>(_beginthreadex(nullptr,m_stackSize,RunSizerThread,reinterpret_cast<void*>(this),0,NULL));
+    if(m_sizerThread)
+    {
+      TP_TRACE0("Created a sizing thread!\n");
+      return;
+    }
+    m_sizerRunning = false;
+    CloseHandle(m_sizerEvent);
+    m_sizerEvent = nullptr;
+  }
+}
+
+// Stop the sizing thread and wait for it to end.
+// A decision in progress may still use the sizer, so we cannot time out:
+// the sizer is deleted by the destructor right after this.
+void
+ThreadPool::StopSizer()
+{
+  if(m_sizerThread == nullptr)
+  {
+    return;
+  }
+  TP_TRACE0("Stopping the sizing thread\n");
+  SetEvent(m_sizerEvent);
+  if(GetThreadId(m_sizerThread) != GetCurrentThreadId())
+  {
+    WaitForSingleObject(m_sizerThread,INFINITE);
+  }
+  CloseHandle(m_sizerThread);
+  CloseHandle(m_sizerEvent);
+  m_sizerThread  = nullptr;
+  m_sizerEvent   = nullptr;
+  m_sizerRunning = false;
+}
+
+// Go running our sizer
+/*static */unsigned _stdcall RunSizerThread(void* p_pool)
+{
+  ThreadPool* pool = reinterpret_cast<ThreadPool*>(p_pool);
+  return pool->RunSizer();
+}
+
+// Running the sizing thread: one decision per interval
+DWORD
+ThreadPool::RunSizer()
+{
+  // Install SEH to regular exception translator
+  _set_se_translator(SeTranslator);
+
+  while(WaitForSingleObject(m_sizerEvent,m_sizerInterval) == WAIT_TIMEOUT)
+  {
+    if(m_openForWork)
+    {
+      SizeThreadPool();
+    }
+  }
+  TP_TRACE0("Sizing thread stopping\n");
+  m_sizerRunning = false;
+  return 0;
+}
+
+// Measure the last interval and let the sizer decide
+void
+ThreadPool::SizeThreadPool()
+{
+  PoolSample sample;
+  ULONGLONG  now = GetTickCount64();
+
+  // Work in the queue and threads that do not make progress
+  {
+    AutoLockTP lock(&m_critical);
+    sample.m_queued = GetWorkOverflow();
+    for(auto& thread : m_threads)
+    {
+      ULONGLONG started = thread->m_workStarted;
+      if(started && (now - started) > SIZER_BLOCKED_TIME)
+      {
+        ++sample.m_blkThreads;
+      }
+    }
+  }
+  m_blkThreads        = sample.m_blkThreads;
+  sample.m_curThreads = m_curThreads;
+  sample.m_bsyThreads = m_bsyThreads;
+  sample.m_minThreads = m_minThreads;
+  sample.m_maxThreads = m_maxThreads;
+  sample.m_interval   = m_sizerInterval;
+  sample.m_started    = InterlockedExchange64(&m_started,  0);
+  sample.m_completed  = InterlockedExchange64(&m_completed,0);
+
+  // Waiting time of the work that was started in this interval
+  if(m_queueMetrics)
+  {
+    MetricsSnapshot snapshot;
+    m_queueMetrics->GetSnapshot(snapshot);
+    MetricsSnapshot window(snapshot);
+    window.Subtract(*m_sizerSnapshot);
+    *m_sizerSnapshot = snapshot;
+    sample.m_waitP95 = window.m_count > 0 ? window.GetPercentile(0.95) : 0;
+  }
+  m_waitP95 = (long)min(sample.m_waitP95,(LONGLONG)LONG_MAX);
+
+  switch(m_sizer->Decide(sample))
+  {
+    case PoolSizing::PS_Grow:   // Blocked threads do not count for the maximum
+                                if(m_curThreads < m_maxThreads + sample.m_blkThreads)
+                                {
+                                  TP_TRACE0("Sizer grows the threadpool\n");
+                                  CreateThreadPoolThread();
+                                  m_sizerGrow->Add();
+                                }
+                                break;
+    case PoolSizing::PS_Shrink: // One thread at a time. Wake an idle thread to leave
+                                if(m_curThreads > m_minThreads && m_shrinking == 0)
+                                {
+                                  TP_TRACE0("Sizer shrinks the threadpool\n");
+                                  InterlockedIncrement(&m_shrinking);
+                                  PostQueuedCompletionStatus(m_completion,0,COMPLETION_WORK,(LPOVERLAPPED)INVALID_HANDLE_VALUE);
+                                  m_sizerShrink->Add();
+                                }
+                                break;
+    case PoolSizing::PS_Keep:   [[fallthrough]];
+    default:                    break;
+  }
+}
+
+// Called by a thread after its work: take a shrink request of the sizer
+bool
+ThreadPool::LeaveForSizer()
+{
+  long shrinking = m_shrinking;
+  while(shrinking > 0 && m_curThreads > m_minThreads)
+  {
+    long found = InterlockedCompareExchange(&m_shrinking,shrinking - 1,shrinking);
+    if(found == shrinking)
+    {
+      return true;
+    }
+    shrinking = found;
+  }
+  return false;
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 // SLEEPING THREADS
@@ -1015,7 +1373,7 @@ ThreadPool::WaitingForIdle(int p_part)
                               break;
         case WF_IDLE_CLEAN:   if(m_cleanup.empty()) idle = true;
                               break;
-        case WF_IDLE_WORK:    if(m_work.empty())    idle = true;
+        case WF_IDLE_WORK:    if(GetWorkOverflow() == 0) idle = true;
                               break;
         case WF_IDLE_THREADS: if(m_threads.empty()) idle = true;
                               break;
@@ -1037,6 +1395,9 @@ ThreadPool::StopThreadPool()
   // Not open for work, No more SubmitWork or SleepThread can occur
   m_openForWork = false;
 
+  // No more sizing decisions
+  StopSizer();
+
   // Try to wake all sleeping threads
   WakeUpAllSleepers();
   WaitingForIdle(WF_IDLE_SLEEP);
@@ -1060,7 +1421,7 @@ ThreadPool::StopThreadPool()
     TP_TRACE1("Stopping thread: %d\n", ind);
     StopThread(0);
   }
-  TP_TRACE1("Total items of work still in the work-queue: %d\n", m_work.size());
+  TP_TRACE1("Total items of work still in the work-queue: %d\n", GetWorkOverflow());
 
   // Wait for the queue to become idle
   bool idle = WaitingForIdle(WF_IDLE_THREADS);
@@ -1070,6 +1431,12 @@ ThreadPool::StopThreadPool()
   CloseHandle(m_completion);
   m_completion = nullptr;
 
+  // Thread counters are no longer in the metrics
+  g_metrics.RemoveGauge(&m_curThreads);
+  g_metrics.RemoveGauge(&m_bsyThreads);
+  g_metrics.RemoveGauge(&m_blkThreads);
+  g_metrics.RemoveGauge(&m_waitP95);
+
   // No longer initialize after this point
   AutoLockTP lock(&m_critical);
   m_initialized = false;
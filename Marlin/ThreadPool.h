@@ -26,6 +26,7 @@
 // THE SOFTWARE.
 //
 #pragma once
+#include "ThreadPoolSizer.h"
 #include <vector>
 #include <deque>
 
@@ -41,6 +42,17 @@ constexpr auto NUM_THREADS_MAXIMUM = 20;   // More than this is not wise under W
 // Standard stack size of a thread in 64 bits architectures
 constexpr auto THREAD_STACKSIZE = (2 * 1024 * 1024);
 
+// Priority classes of the work. Higher classes are taken from the queue first
+enum class WorkPriority
+{
+  WP_High   = 0   // Health checks, keep-alives, cheap requests
+ ,WP_Normal = 1   // Default for all submitted work
+ ,WP_Low    = 2   // Heavy calls and batches
+};
+constexpr auto WORK_PRIORITIES       =    3;
+constexpr auto WORK_STARVATION       = 1000;  // Milliseconds before work of a lower class is starving
+constexpr auto WORK_STARVATION_SHARE =    4;  // Starving lower class gets every 4th turn
+
 // Set a name on your thread
 void SetThreadName(char* threadName,DWORD dwThreadID = MAXDWORD);
 
@@ -51,6 +63,9 @@ typedef bool (* LPFN_TRYABORT)(void *,bool p_stayInThePool,bool p_forcedAbort);
 // Forward declaration of our ThreadPool
 class ThreadPool;
 class AutoIncrementPoolMax;
+class MetricsHistogram;
+class MetricsCounter;
+class MetricsSnapshot;
 
 #define COMPLETION_WORK   1
 #define COMPLETION_CALL   2
@@ -63,6 +78,7 @@ public:
     ThreadPool*   m_pool;
     HANDLE        m_thread;
     unsigned      m_threadId;
+    volatile ULONGLONG m_workStarted { 0 };   // GetTickCount64 at start of the current work (0 = idle)
 };
 
 using ThreadMap = std::vector<ThreadRegister*>;
@@ -86,9 +102,13 @@ class ThreadWork
 public:
   LPFN_CALLBACK m_callback;
   void*         m_argument;
+  LONGLONG      m_queued    { 0 };        // Performance counter at submit (metrics only)
+  ULONGLONG     m_submitted { 0 };        // GetTickCount64 at submit (starvation protection)
+  ULONGLONG     m_deadline  { 0 };        // GetTickCount64 before which the work must start (0 = none)
+  LPFN_CALLBACK m_expired   { nullptr };  // Called instead of m_callback if the deadline has passed
 };
 
-// FIFO Queue of work items still to process
+// FIFO Queue of work items still to process (one per priority class)
 using WorkMap = std::deque<ThreadWork>;
 
 class ThreadPool
@@ -104,6 +124,13 @@ public:
 
   // Submit an item, starting a thread on it
   bool  SubmitWork(LPFN_CALLBACK p_callback,void* p_argument);
+  // Submit an item in a priority class, with an optional deadline to start (GetTickCount64)
+  // Returns false if the deadline has already passed. The work is not queued then!
+  bool  SubmitWork(LPFN_CALLBACK p_callback
+                  ,void*         p_argument
+                  ,WorkPriority  p_priority
+                  ,ULONGLONG     p_deadline = 0
+                  ,LPFN_CALLBACK p_expired  = nullptr);
   // Submitting cleanup jobs. Runs when ThreadPool stops
   void  SubmitCleanup(LPFN_CALLBACK p_cleanup,void* p_argument);
 
@@ -120,6 +147,8 @@ public:
   // Extend the maximum for a period of time
   void  ExtendMaximumThreads (AutoIncrementPoolMax& p_increment);
   void  RestoreMaximumThreads(AutoIncrementPoolMax& p_increment);
+  // Size the pool with a sizing controller instead of the CPU load (pool takes ownership)
+  bool  SetSizer(PoolSizer* p_sizer,DWORD p_interval = SIZER_INTERVAL);
   // Number of current running threads
   long  GetCurrentThreads();
 
@@ -151,15 +180,21 @@ public:
   int  GetMaxThreads()          { return m_maxThreads;          };
   int  GetStackSize()           { return m_stackSize;           };
   int  GetProcessors()          { return m_processors;          };
-  int  GetWorkOverflow()        { return (int)m_work.size();    };
+  int  GetWorkOverflow();
+  int  GetWorkOverflow(WorkPriority p_priority);
   int  GetCleanupJobs()         { return (int)m_cleanup.size(); };
   int  GetHeartBeatTime()       { return m_heartbeat;           };
+  long GetBlockedThreads()      { return m_blkThreads;          };
+  long GetQueueWaitP95()        { return m_waitP95;             };   // Microseconds, with a sizer only
+  long GetExpiredWork()         { return m_expired;             };
+  PoolSizer* GetSizer()         { return m_sizer;               };
 
   // These running-a-thread methods are public, but really should only be called 
   // from within the static work functions of the ThreadPool itself, to get things working
   // Do **NOT** call from your application!!
   DWORD RunAThread(ThreadRegister* p_register);
   DWORD RunHeartbeat();
+  DWORD RunSizer();
 
 private:
   // CONTROLING THE THREADPOOL
@@ -178,12 +213,19 @@ private:
   bool IsThreadInThreadPool(unsigned p_threadID);
   // More work to do on a thread  (pool must be locked!!)
   bool WorkToDo(LPFN_CALLBACK& p_callback,void*& p_argument);
+  // Priority class to take the next work from
+  int  NextWorkClass();
   // Running all cleanup jobs for the ThreadPool
   void RunCleanupJobs();
   // Wake up all sleeping threads as part of the shutdown
   void WakeUpAllSleepers();
   // Safe SEH calling of a heartbeat function
   void SafeCallHeartbeat(LPFN_CALLBACK p_function,void* p_payload);
+  // Sizing the pool by the sizer
+  void StartSizer();
+  void StopSizer();
+  void SizeThreadPool();
+  bool LeaveForSizer();
 
   // This is the real callback. 
   // Overload for your needs, in your own class derived from ThreadPool
@@ -210,7 +252,7 @@ private:
   HANDLE            m_completion      { nullptr };              // I/O Completion port for I/O and thread sync
   ThreadMap         m_threads;                                  // Map with all running and waiting threads
   SleepingMap       m_sleeping;                                 // Registration of sleeping threads
-  WorkMap           m_work;                                     // Map with the backlog of work to do
+  WorkMap           m_work[WORK_PRIORITIES];                    // Map with the backlog of work to do per class
   WorkMap           m_cleanup;                                  // Cleanup jobs after closing the queue
   CRITICAL_SECTION  m_critical;                                 // Locking synchronization object
   CRITICAL_SECTION  m_cpuclock;                                 // Lock for CPULoad
@@ -223,6 +265,26 @@ private:
   DWORD             m_heartbeat        { 0       };             // HB milliseconds between heartbeats
   HANDLE            m_heartbeatEvent   { nullptr };             // HB event to wake up the heartbeat
   bool              m_extraHeartbeat   { false   };             // HB Extra event?
+  // Metrics section
+  long              m_poolNumber       { 0       };             // Number of the pool in the metrics
+  MetricsHistogram* m_queueMetrics     { nullptr };             // Waiting time in the work queue
+  MetricsCounter*   m_expiredMetrics   { nullptr };             // Work started after its deadline
+  volatile long     m_expired          { 0       };             // Number of work items past their deadline
+  int               m_starvedTurns     { 0       };             // Turns since a starving class went first
+  // Sizing section
+  PoolSizer*        m_sizer            { nullptr };             // SZ sizing controller (owned)
+  DWORD             m_sizerInterval    { SIZER_INTERVAL };      // SZ milliseconds between decisions
+  HANDLE            m_sizerEvent       { nullptr };             // SZ event to stop the sizing thread
+  HANDLE            m_sizerThread      { nullptr };             // SZ handle of the sizing thread (joined on stop)
+  volatile bool     m_sizerRunning     { false   };             // SZ sizing thread is running
+  MetricsSnapshot*  m_sizerSnapshot    { nullptr };             // SZ waiting time at the previous decision
+  MetricsCounter*   m_sizerGrow        { nullptr };             // SZ number of grow decisions
+  MetricsCounter*   m_sizerShrink      { nullptr };             // SZ number of shrink decisions
+  volatile long     m_blkThreads       { 0       };             // SZ threads blocked on one work item
+  volatile long     m_shrinking        { 0       };             // SZ threads asked to leave the pool
+  volatile long     m_waitP95          { 0       };             // SZ last 95th percentile of the waiting time
+  volatile LONGLONG m_started          { 0       };             // SZ work taken from the queue in the interval
+  volatile LONGLONG m_completed        { 0       };             // SZ work completed in the interval
 };
 
 // Number of current running threads
@@ -0,0 +1,147 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ThreadPoolSizer.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "ThreadPoolSizer.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Gains of the PI controller on the relative error of the waiting time
+constexpr auto QUEUEWAIT_GAIN_P    = 1.0;
+constexpr auto QUEUEWAIT_GAIN_I    = 0.25;
+constexpr auto QUEUEWAIT_THRESHOLD = 0.5;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// QUEUE WAITING TIME
+//
+//////////////////////////////////////////////////////////////////////////
+
+QueueWaitSizer::QueueWaitSizer(LONGLONG p_targetWait)
+               :m_target(p_targetWait > 0 ? p_targetWait : SIZER_TARGET_WAIT)
+{
+}
+
+PoolSizing
+QueueWaitSizer::Decide(const PoolSample& p_sample)
+{
+  // Relative error of the waiting time. Positive = waiting too long
+  double error = 0.0;
+  if(p_sample.m_started > 0)
+  {
+    error = (double)(p_sample.m_waitP95 - m_target) / (double)m_target;
+  }
+  else if(p_sample.m_queued > 0)
+  {
+    // Work is waiting, but nothing could be started: starvation
+    error = 1.0;
+  }
+  else if(p_sample.m_bsyThreads < p_sample.m_curThreads)
+  {
+    // No work at all and idle threads
+    error = -1.0;
+  }
+  error = max(-1.0,min(4.0,error));
+
+  // Leaky integral: older intervals count less and less
+  m_integral = max(-4.0,min(4.0,m_integral / 2.0 + error));
+  double output = QUEUEWAIT_GAIN_P * error + QUEUEWAIT_GAIN_I * m_integral;
+
+  if(output > QUEUEWAIT_THRESHOLD && (p_sample.m_queued > 0 || p_sample.m_bsyThreads == p_sample.m_curThreads))
+  {
+    return PoolSizing::PS_Grow;
+  }
+  if(output < -QUEUEWAIT_THRESHOLD && p_sample.m_queued == 0 && p_sample.m_bsyThreads < p_sample.m_curThreads)
+  {
+    return PoolSizing::PS_Shrink;
+  }
+  return PoolSizing::PS_Keep;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// HILL CLIMBING
+//
+//////////////////////////////////////////////////////////////////////////
+
+PoolSizing
+HillClimbSizer::Decide(const PoolSample& p_sample)
+{
+  double throughput = 0.0;
+  if(p_sample.m_interval)
+  {
+    throughput = (double)p_sample.m_completed * 1000.0 / (double)p_sample.m_interval;
+  }
+
+  // No work waiting: nothing to climb for. Give back idle threads
+  if(p_sample.m_queued == 0)
+  {
+    m_direction   = 1;
+    m_lastThreads = 0;
+    return p_sample.m_bsyThreads < p_sample.m_curThreads ? PoolSizing::PS_Shrink : PoolSizing::PS_Keep;
+  }
+
+  // Blocked threads make no progress: always try one more
+  if(p_sample.m_blkThreads > 0)
+  {
+    m_direction = 1;
+  }
+  // Did our previous step lower the throughput? Then turn around
+  else if(m_lastThreads && m_lastThreads != p_sample.m_curThreads &&
+          throughput < m_lastThroughput * (1.0 - SIZER_NOISE))
+  {
+    m_direction = -m_direction;
+  }
+  m_lastThreads    = p_sample.m_curThreads;
+  m_lastThroughput = throughput;
+
+  return m_direction > 0 ? PoolSizing::PS_Grow : PoolSizing::PS_Shrink;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// FACTORY
+//
+//////////////////////////////////////////////////////////////////////////
+
+PoolSizer*
+CreatePoolSizer(XString p_name,LONGLONG p_targetWait)
+{
+  if(p_name.CompareNoCase(_T("queuewait")) == 0)
+  {
+    return new QueueWaitSizer(p_targetWait);
+  }
+  if(p_name.CompareNoCase(_T("hillclimb")) == 0)
+  {
+    return new HillClimbSizer();
+  }
+  return nullptr;
+}
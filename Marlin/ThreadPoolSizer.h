@@ -0,0 +1,110 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ThreadPoolSizer.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+
+// Pluggable sizing of the ThreadPool
+//
+// Every sizing interval the ThreadPool measures how its work is doing (a PoolSample)
+// and asks its sizer to keep, grow or shrink the pool by one thread.
+// The pool keeps the result between the minimum and maximum number of threads.
+// Threads that are busy on one work item for longer than the blocked time are
+// counted as 'blocked': they do not count for the maximum, so the pool can
+// inject a thread for each of them, like the AutoIncrementPoolMax does.
+
+constexpr auto SIZER_INTERVAL     =   500;  // Milliseconds between two sizing decisions
+constexpr auto SIZER_BLOCKED_TIME =  2000;  // Milliseconds on one work item before a thread is blocked
+constexpr auto SIZER_TARGET_WAIT  = 50000;  // Default target of the queue waiting time (microseconds)
+constexpr auto SIZER_NOISE        =  0.05;  // Throughput changes below 5% are noise for the hill climber
+
+// Decision of a sizer
+enum class PoolSizing
+{
+  PS_Keep
+ ,PS_Grow
+ ,PS_Shrink
+};
+
+// Measurements of the ThreadPool over one sizing interval
+class PoolSample
+{
+public:
+  int       m_curThreads { 0 };   // Threads in the pool
+  int       m_bsyThreads { 0 };   // Threads doing work
+  int       m_blkThreads { 0 };   // Threads blocked on one work item
+  int       m_minThreads { 0 };   // Current minimum of the pool
+  int       m_maxThreads { 0 };   // Current maximum of the pool
+  int       m_queued     { 0 };   // Work items waiting in the queue
+  LONGLONG  m_started    { 0 };   // Work items taken from the queue in the interval
+  LONGLONG  m_completed  { 0 };   // Work items completed in the interval
+  LONGLONG  m_waitP95    { 0 };   // 95th percentile of the queue waiting time (microseconds)
+  DWORD     m_interval   { 0 };   // Length of the interval (milliseconds)
+};
+
+// Base class of all sizers. Called from the sizing thread of the pool only.
+class PoolSizer
+{
+public:
+  virtual ~PoolSizer() = default;
+  virtual PoolSizing Decide(const PoolSample& p_sample) = 0;
+  virtual LPCTSTR    GetName() = 0;
+};
+
+// PI controller on the 95th percentile of the waiting time in the queue.
+// Grows while work waits longer than the target, shrinks while idle threads are left.
+// Work that is waiting while nothing could be started counts as a full error (starvation).
+class QueueWaitSizer : public PoolSizer
+{
+public:
+  explicit QueueWaitSizer(LONGLONG p_targetWait = SIZER_TARGET_WAIT);
+
+  PoolSizing Decide(const PoolSample& p_sample) override;
+  LPCTSTR    GetName() override { return _T("queuewait"); };
+
+private:
+  LONGLONG  m_target;               // Target waiting time in microseconds
+  double    m_integral { 0.0 };     // Leaky sum of the errors
+};
+
+// Hill climbing on the throughput (completed work per second), like the .NET ThreadPool.
+// As long as work is waiting, the pool moves one thread at a time in one direction.
+// If the last step lowered the throughput, the direction is reversed.
+// Without waiting work, idle threads are given back.
+class HillClimbSizer : public PoolSizer
+{
+public:
+  PoolSizing Decide(const PoolSample& p_sample) override;
+  LPCTSTR    GetName() override { return _T("hillclimb"); };
+
+private:
+  int       m_direction      { 1   };   // +1 = growing, -1 = shrinking
+  int       m_lastThreads    { 0   };   // Threads at the previous decision
+  double    m_lastThroughput { 0.0 };   // Throughput at the previous decision
+};
+
+// Create a sizer by name: "queuewait" or "hillclimb". nullptr for all other names
+PoolSizer* CreatePoolSizer(XString p_name,LONGLONG p_targetWait = SIZER_TARGET_WAIT);
@@ -99,6 +99,7 @@ WSDLCache::ClearCache()
   {
     delete it->second.m_input;
     delete it->second.m_output;
+    delete it->second.m_binding;
   }
   m_operations.clear();
 }
@@ -148,6 +149,8 @@ WSDLCache::AddOperation(int p_code,XString p_name,SOAPMessage* p_input,SOAPMessa
   operation.m_code   = p_code;
   operation.m_input  = new SOAPMessage(p_input);
   operation.m_output = new SOAPMessage(p_output);
+  // All parameter names of the input resolved once for the service code
+  operation.m_binding = new SOAPBinding(p_name,operation.m_input);
 
   m_operations.insert(std::make_pair(p_name,operation));
   return true;
@@ -166,6 +169,20 @@ WSDLCache::GetCommandCode(XString& p_commandName)
   return 0;
 }
 
+// Parameter binding of the input of an operation
+// Built once by AddOperation, and shared by all threads of the service
+const SOAPBinding*
+WSDLCache::GetBinding(XString p_operation)
+{
+  OperationMap::iterator it = m_operations.find(p_operation);
+
+  if(it != m_operations.end())
+  {
+    return it->second.m_binding;
+  }
+  return nullptr;
+}
+
 bool
 WSDLCache::GenerateWSDL()
 {
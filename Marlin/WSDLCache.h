@@ -34,6 +34,7 @@
 #pragma once
 #include "SOAPMessage.h"
 #include "XMLRestriction.h"
+#include "SOAPBinding.h"
 #include <vector>
 #include <map>
 
@@ -45,6 +46,7 @@ public:
   int          m_code;
   SOAPMessage* m_input;
   SOAPMessage* m_output;
+  SOAPBinding* m_binding;   // Precomputed parameter lookups of the input
 };
 
 using OperationMap = std::map<XString,WsdlOperation>;
@@ -99,6 +101,8 @@ public:
   XString GetOperationPage(XString p_operation,XString p_hostname);
   XString GetServiceBasePageName();
   int     GetCommandCode(XString& p_commandName);
+  // Parameter binding of the input of an operation (shared, do not delete)
+  const SOAPBinding* GetBinding(XString p_operation);
   size_t  GetOperationsCount()                   { return m_operations.size();     };
   XString GetErrorMessage()                      { return m_errormessage;          };
   XString GetWSDLFilename()                      { return m_filename;              };
@@ -29,9 +29,11 @@
 #include "WebServiceClient.h"
 #include "GenerateGUID.h"
 #include "SOAPSecurity.h"
+#include "AutoCritical.h"
 #include <objbase.h>
 #include <rpc.h>
 #include <wincrypt.h>
+#include <process.h>
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -68,6 +70,7 @@ WebServiceClient::WebServiceClient(XString p_contract
     m_errorText = _T("Cannot initialize the GUID creation interface. ")
                   _T("Apartment threading changed?");
   }
+  InitializeCriticalSection(&m_windowLock);
 }
 
 WebServiceClient::~WebServiceClient()
@@ -75,6 +78,7 @@ WebServiceClient::~WebServiceClient()
   // Do not really close on destruction.
   // You should call this method earlier on, before all static objects destruct
   Close();
+  DeleteCriticalSection(&m_windowLock);
 
   // Release COM+ modules
   CoUninitialize();
@@ -336,6 +340,58 @@ WebServiceClient::Send(SOAPMessage* p_message)
   // Name of call for error messages
   m_request = p_message->GetSoapAction();
 
+  // URL, namespace and encryption
+  PrepareMessage(p_message);
+
+  // Keep message to a total of StoreSize messages
+  if(m_reliable)
+  {
+    ReliabilityChecks(p_message);
+    PrepareForReliable(p_message);
+  }
+
+  // Provide the authentication of this message
+  PrepareAuthentication(p_message);
+
+  // Override van de SOAPAction
+  m_httpClient->SetSoapAction(m_soapAction);
+
+  // Send by the HTTP client
+  if(m_jsonTranslation)
+  {
+    // Doing the SOAP -> JSON -> SOAP roundtrip
+    m_result = m_httpClient->SendAsJSON(p_message);
+  }
+  else
+  {
+    // Send directly as a SOAP service
+    m_result = m_httpClient->Send(p_message);
+  }
+
+  // Generic error handling
+  if(m_result == false)
+  {
+    ErrorHandling(p_message);
+  }
+  else if(m_reliable)
+  {
+    // Check results for consistency (WS-RM)
+    CheckHeader(p_message);
+  }
+
+  // Check if we have to retransmit last messages
+  DoRetransmit();
+
+  // No longer sending
+  m_isSending = false;
+
+  return m_result;
+}
+
+// Prepare a message for sending: URL, namespace and encryption
+void
+WebServiceClient::PrepareMessage(SOAPMessage* p_message)
+{
   // Check whether message is for us
   if(p_message->GetURL().IsEmpty())
   {
@@ -354,15 +410,12 @@ WebServiceClient::Send(SOAPMessage* p_message)
     p_message->SetSecurityPassword(m_encryptionPassword);
     p_message->SetSigningMethod(m_signingMethod);
   }
+}
 
-  // Keep message to a total of StoreSize messages
-  if(m_reliable)
-  {
-    ReliabilityChecks(p_message);
-    PrepareForReliable(p_message);
-  }
-
-  // Provide the authentication of this message
+// Provide the authentication of a message
+void
+WebServiceClient::PrepareAuthentication(SOAPMessage* p_message)
+{
   if(m_tokenProfile)
   {
     m_soapSecurity->SetSecurity(p_message);
@@ -378,35 +431,165 @@ WebServiceClient::Send(SOAPMessage* p_message)
     p_message->SetUser(m_user);
     p_message->SetPassword(m_password);
   }
+}
 
-  // Override van de SOAPAction
-  m_httpClient->SetSoapAction(m_soapAction);
+//////////////////////////////////////////////////////////////////////////
+//
+// SENDING WINDOW
+// A series of messages is sent by 'WindowSize' sender threads, each with
+// its own HTTPClient. So up to 'WindowSize' messages are in flight at the
+// same time, instead of waiting for each answer before sending the next.
+// Every answer of the server acknowledges all messages it has received so far
+// (cumulative range and selective ranges), so the acknowledgements can
+// arrive out-of-order. For RELIABLE_ATLEAST1 the unacknowledged messages are
+// retransmitted after the retransmission interval.
+//
+//////////////////////////////////////////////////////////////////////////
 
-  // Send by the HTTP client
-  if(m_jsonTranslation)
+// Results of NextWindowMessage
+#define WINDOW_DONE  -1   // All messages done
+#define WINDOW_WAIT  -2   // Messages in flight or waiting for retransmission
+
+static unsigned int __stdcall StartingTheWindowThread(void* p_context)
+{
+  WebServiceClient* client = reinterpret_cast<WebServiceClient*>(p_context);
+  if(client)
   {
-    // Doing the SOAP -> JSON -> SOAP roundtrip
-    m_result = m_httpClient->SendAsJSON(p_message);
+    client->WindowThreadRunning();
   }
-  else
+  return 0;
+}
+
+bool
+WebServiceClient::SendWindow(SOAPMessages& p_messages)
+{
+  // Without a window: one message after another
+  if(m_windowSize <= 1 || p_messages.size() <= 1)
   {
-    // Send directly as a SOAP service
-    m_result = m_httpClient->Send(p_message);
+    bool result = true;
+    for(auto& message : p_messages)
+    {
+      if(!Send(message))
+      {
+        result = false;
+      }
+    }
+    return result;
   }
 
-  // Generic error handling
-  if(m_result == false)
+  // Program error. Already busy sending
+  if(m_isSending)
   {
-    ErrorHandling(p_message);
+    return false;
   }
-  else if(m_reliable)
+
+  // If not opened: try to open it now
+  if(!m_isopen)
   {
-    // Check results for consistency (WS-RM)
-    CheckHeader(p_message);
+    Open();
+    if(!m_isopen)
+    {
+      return false;
+    }
   }
 
-  // Check if we have to retransmit last messages
+  // Check all messages before the window starts
+  for(auto& message : p_messages)
+  {
+    PrepareMessage(message);
+    if(m_reliable)
+    {
+      ReliabilityChecks(message);
+    }
+  }
+
+  // Busy sending from now on
+  m_isSending = true;
+  m_result    = true;
+  m_request   = p_messages.front()->GetSoapAction();
+
+  // The message store must hold the whole window while it is in flight
+  int storeSize = m_storeSize;
+  m_storeSize  += (int)p_messages.size();
+
+  // Number all messages in the order of the sequence
+  m_window.clear();
+  m_window.resize(p_messages.size());
+  m_windowNext = 0;
+  for(size_t ind = 0; ind < p_messages.size(); ++ind)
+  {
+    WindowMsg& entry = m_window[ind];
+    entry.m_message  = p_messages[ind];
+    if(m_reliable)
+    {
+      entry.m_messageNumber = ++m_clientMessageNumber;
+      entry.m_nonce         = GenerateGUID();
+      SetReliableHeaders(entry.m_message,entry.m_messageNumber,entry.m_nonce);
+    }
+    PrepareAuthentication(entry.m_message);
+
+    // Keep a copy for retransmission
+    if(m_reliable)
+    {
+      PutInMessageStore(entry.m_message,entry.m_messageNumber);
+    }
+  }
+
+  // Start the senders of the window
+  size_t senders = m_window.size() < (size_t)m_windowSize ? m_window.size() : (size_t)m_windowSize;
+  DETAILLOG(_T("Sending window of %d messages with %d senders"),(int)m_window.size(),(int)senders);
+
+  std::vector<HANDLE> threads;
+  for(size_t ind = 0; ind < senders; ++ind)
+  {
+    unsigned int threadID = 0;
+    HANDLE thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL,0,StartingTheWindowThread,reinterpret_cast<void*>(this),0,&threadID));
+    if(thread && thread != INVALID_HANDLE_VALUE)
+    {
+      threads.push_back(thread);
+    }
+  }
+  if(threads.empty())
+  {
+    // Cannot start a thread: do it ourselves
+    WindowThreadRunning();
+  }
+  // WaitForMultipleObjects cannot wait for more than 64 threads
+  for(auto& thread : threads)
+  {
+    WaitForSingleObject(thread,INFINITE);
+    CloseHandle(thread);
+  }
+
+  // Every message must have been answered and acknowledged
+  for(auto& entry : m_window)
+  {
+    if(!entry.m_answered)
+    {
+      XString error;
+      error.Format(_T("No answer on message [%d] of the sending window for call [%s/%s]: %s\n")
+                  ,entry.m_messageNumber
+                  ,m_contract.GetString()
+                  ,entry.m_message->GetSoapAction().GetString()
+                  ,entry.m_message->GetFaultString().GetString());
+      WindowError(error);
+    }
+    else if(!entry.m_acked)
+    {
+      XString error;
+      error.Format(_T("WS-ReliableMessaging message [%d] not acknowledged for call [%s/%s]\n")
+                  ,entry.m_messageNumber
+                  ,m_contract.GetString()
+                  ,entry.m_message->GetSoapAction().GetString());
+      WindowError(error);
+    }
+  }
+  m_window.clear();
+
+  // Last resort for the messages the server never acknowledged
   DoRetransmit();
+  m_storeSize = storeSize;
+  TrimMessageStore();
 
   // No longer sending
   m_isSending = false;
@@ -414,6 +597,176 @@ WebServiceClient::Send(SOAPMessage* p_message)
   return m_result;
 }
 
+// One sender thread of the window
+void
+WebServiceClient::WindowThreadRunning()
+{
+  // Same proxy, certificates, credentials, headers and timeouts as our sendport
+  HTTPClient client;
+  client.CopySettings(*m_httpClient);
+  client.SetSoapAction(m_soapAction);
+
+  while(true)
+  {
+    int index = NextWindowMessage();
+    if(index == WINDOW_DONE)
+    {
+      break;
+    }
+    if(index == WINDOW_WAIT)
+    {
+      Sleep(WINDOW_POLL_TIME);
+      continue;
+    }
+    SendWindowMessage(&client,index);
+  }
+}
+
+// Find the next message to send: first all new messages in sequence order,
+// then the unacknowledged messages of which the retransmission timer has expired.
+int
+WebServiceClient::NextWindowMessage()
+{
+  AutoCritSec lock(&m_windowLock);
+
+  if(m_windowNext < m_window.size())
+  {
+    int index = (int)m_windowNext++;
+    m_window[index].m_inFlight = true;
+    m_window[index].m_attempts = 1;
+    return index;
+  }
+
+  bool pending = false;
+  ULONGLONG now = GetTickCount64();
+  for(size_t ind = 0; ind < m_window.size(); ++ind)
+  {
+    WindowMsg& entry = m_window[ind];
+    if(entry.m_inFlight)
+    {
+      pending = true;
+      continue;
+    }
+    // Only retransmit for RELIABLE_ATLEAST1 if the message store still has it
+    if(entry.m_acked || entry.m_attempts > RETRANSMIT_ATTEMPTS ||
+       m_reliableType != ReliableType::RELIABLE_ATLEAST1 ||
+       FindInMessageStore(entry.m_messageNumber) == nullptr)
+    {
+      continue;
+    }
+    if(now - entry.m_sentAt >= (ULONGLONG)m_retransmitInterval)
+    {
+      DETAILLOG(_T("*** RETRANSMIT message [%d] from the sending window ***"),entry.m_messageNumber);
+      entry.m_inFlight = true;
+      entry.m_attempts++;
+      return (int)ind;
+    }
+    pending = true;
+  }
+  return pending ? WINDOW_WAIT : WINDOW_DONE;
+}
+
+// Send one message of the window. Runs outside the window lock
+void
+WebServiceClient::SendWindowMessage(HTTPClient* p_client,int p_index)
+{
+  WindowMsg&   entry   = m_window[p_index];
+  SOAPMessage* message = entry.m_message;
+
+  // Retransmission: the message of the caller is already replaced by a (failed) answer
+  if(entry.m_attempts > 1)
+  {
+    AutoCritSec lock(&m_windowLock);
+    message = new SOAPMessage(FindInMessageStore(entry.m_messageNumber));
+    SetReliableHeaders(message,entry.m_messageNumber,entry.m_nonce);
+  }
+
+  bool result = m_jsonTranslation ? p_client->SendAsJSON(message) : p_client->Send(message);
+
+  AutoCritSec lock(&m_windowLock);
+  entry.m_inFlight = false;
+  entry.m_sentAt   = GetTickCount64();
+  if(result)
+  {
+    if(!entry.m_answered && message != entry.m_message)
+    {
+      // Answer of a retransmission goes to the message of the caller
+      XString answer = message->GetSoapMessage();
+      entry.m_message->Reset();
+      entry.m_message->SetStatus(message->GetStatus());
+      entry.m_message->ParseMessage(answer);
+    }
+    entry.m_answered = true;
+    CheckWindowAnswer(entry,message);
+  }
+  else
+  {
+    DETAILLOG(_T("Message [%d] of the sending window failed: %s"),entry.m_messageNumber,message->GetFaultString().GetString());
+    ErrorHandling(message,p_client);
+  }
+  if(message != entry.m_message)
+  {
+    delete message;
+  }
+}
+
+// Check the WS-RM header of an answer in the window (under the window lock)
+// Answers can arrive out-of-order, so the server message number is not checked
+// to be the next one. Acknowledgement ranges mark the messages as received by the server.
+void
+WebServiceClient::CheckWindowAnswer(WindowMsg& p_entry,SOAPMessage* p_answer)
+{
+  if(m_reliable == false)
+  {
+    p_entry.m_acked = true;
+    return;
+  }
+  if(m_guidSequenceClient.CompareNoCase(p_answer->GetClientSequence()) ||
+     m_guidSequenceServer.CompareNoCase(p_answer->GetServerSequence()))
+  {
+    XString error;
+    error.Format(_T("Incorrect Sequence Identifier in header on WS-ReliableMessaging for call [%s/%s]\n"),m_contract.GetString(),p_answer->GetSoapAction().GetString());
+    WindowError(error);
+    return;
+  }
+  XString answerMessageID = p_answer->GetMessageNonce();
+  if(!answerMessageID.IsEmpty() && p_entry.m_nonce.CompareNoCase(answerMessageID))
+  {
+    XString error;
+    error.Format(_T("Out of band answer on call from [%s/%s]. Wrong message ID\n"),m_contract.GetString(),p_answer->GetSoapAction().GetString());
+    WindowError(error);
+    return;
+  }
+  if(p_answer->GetServerMessageNumber() > m_serverMessageNumber)
+  {
+    m_serverMessageNumber = p_answer->GetServerMessageNumber();
+  }
+
+  // Window is numbered without gaps
+  int first = m_window.front().m_messageNumber;
+  int last  = m_window.back().m_messageNumber;
+  for(const auto& range : p_answer->GetRangeMap())
+  {
+    int lower = range.m_lower < first ? first : range.m_lower;
+    int upper = range.m_upper > last  ? last  : range.m_upper;
+    for(int number = lower; number <= upper; ++number)
+    {
+      m_window[number - first].m_acked = true;
+    }
+    // No need to retransmit from the message store
+    CheckMessageRange(range.m_lower,range.m_upper);
+  }
+}
+
+// Errors in the sender threads cannot be thrown
+void
+WebServiceClient::WindowError(XString p_error)
+{
+  DETAILLOG1(p_error);
+  m_errorText += p_error;
+  m_result = false;
+}
+
 // Add message to queue (NOT WS-Reliable!!)
 // Pass through to the HTTPClient queue.
 bool
@@ -457,34 +810,52 @@ WebServiceClient::ReliabilityChecks(SOAPMessage* p_message)
 }
 
 void
-WebServiceClient::ErrorHandling(SOAPMessage* p_message)
+WebServiceClient::ErrorHandling(SOAPMessage* p_message,HTTPClient* p_client /*= nullptr*/)
 {
+  // Sender threads of the window have their own client
+  HTTPClient* client = p_client ? p_client : m_httpClient;
+  XString error;
+
   if(!p_message->GetFaultCode().IsEmpty())
   {
     // XML-error stack or HTML error present
-    m_errorText.Format(_T("ERROR: %s\n")
+    error.Format(_T("ERROR: %s\n")
                        _T("\n")
-                       _T("WS Fault actor : %s\n")
-                       _T("WS Fault code  : %s\n")
-                       _T("WS Fault string: %s\n")
-                       _T("WS Fault detail: %s\n")
-                       _T("\n")
-                       _T("Total WS-SOAP error stack:\n")
-                       _T("\n")
-                       _T("%s")
-                       ,m_httpClient->GetStatusText().GetString()
-                       ,p_message->GetFaultCode().GetString()
-                       ,p_message->GetFaultActor().GetString()
-                       ,p_message->GetFaultString().GetString()
-                       ,p_message->GetFaultDetail().GetString()
-                       ,p_message->GetSoapMessage().GetString());
-  }
-  else if(m_httpClient->GetStatus() != HTTP_STATUS_OK)
+                 _T("WS Fault actor : %s\n")
+                 _T("WS Fault code  : %s\n")
+                 _T("WS Fault string: %s\n")
+                 _T("WS Fault detail: %s\n")
+                 _T("\n")
+                 _T("Total WS-SOAP error stack:\n")
+                 _T("\n")
+                 _T("%s")
+                 ,client->GetStatusText().GetString()
+                 ,p_message->GetFaultCode().GetString()
+                 ,p_message->GetFaultActor().GetString()
+                 ,p_message->GetFaultString().GetString()
+                 ,p_message->GetFaultDetail().GetString()
+                 ,p_message->GetSoapMessage().GetString());
+  }
+  else if(client->GetStatus() != HTTP_STATUS_OK)
   {
     // HTTP Protocol error (connection etc)
-    m_errorText.Format(_T("HTTP WS Protocol error. %s\n%s\n")
-                      ,m_httpClient->GetStatusText().GetString()
-                      ,p_message->GetSoapMessage().GetString());
+    error.Format(_T("HTTP WS Protocol error. %s\n%s\n")
+                ,client->GetStatusText().GetString()
+                ,p_message->GetSoapMessage().GetString());
+  }
+  else
+  {
+    return;
+  }
+  if(p_client)
+  {
+    // A window collects the errors of all its messages.
+    // The message can still succeed on a retransmission, so the result is not touched
+    m_errorText += error;
+  }
+  else
+  {
+    m_errorText = error;
   }
 }
 
@@ -533,6 +904,28 @@ WebServiceClient::SetStoreSize(int p_size)
   throw StdException(error);
 }
 
+void
+WebServiceClient::SetWindowSize(int p_size)
+{
+  if(m_isSending == false)
+  {
+    if(p_size >= 1 && p_size <= MESSAGEWINDOW_MAXIMUM)
+    {
+      m_windowSize = p_size;
+      return;
+    }
+    XString error;
+    error.Format(_T("WebServiceClient: Sending window size out of range [1:%d]"),MESSAGEWINDOW_MAXIMUM);
+    DETAILLOG1(error);
+    m_errorText += error;
+    throw StdException(error);
+  }
+  XString error(_T("WebServiceClient: Cannot set sending window size while sending for: ") + m_contract);
+  DETAILLOG1(error);
+  m_errorText += error;
+  throw StdException(error);
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 //  Check protocols in return header
@@ -731,24 +1124,44 @@ WebServiceClient::DoRetransmit()
 }
 
 void
-WebServiceClient::PutInMessageStore(SOAPMessage* p_message)
+WebServiceClient::PutInMessageStore(SOAPMessage* p_message,int p_number)
 {
   // Put in the message store
   SoapMsg soap;
   soap.m_message       = new SOAPMessage(p_message);
   soap.m_retransmit    = true;
-  soap.m_messageNumber = m_clientMessageNumber;
+  soap.m_messageNumber = p_number;
   m_messages.push_back(soap);
 
+  TrimMessageStore();
+}
+
+void
+WebServiceClient::TrimMessageStore()
+{
   // If more messages are present: forget them
   // if requested later for retransmit, it will be too late!
-  if(m_messages.size() > (size_t)m_storeSize)
+  while(m_messages.size() > (size_t)m_storeSize)
   {
     delete m_messages[0].m_message;
     m_messages.pop_front();
   }
 }
 
+// Number of messages in the deque is always very low
+SOAPMessage*
+WebServiceClient::FindInMessageStore(int p_number)
+{
+  for(auto& mesg : m_messages)
+  {
+    if(mesg.m_messageNumber == p_number)
+    {
+      return mesg.m_message;
+    }
+  }
+  return nullptr;
+}
+
 //////////////////////////////////////////////////////////////////////////
 //
 // PRIVATE METHODS
@@ -800,6 +1213,14 @@ WebServiceClient::PrepareForReliable(SOAPMessage* p_message)
   ++m_clientMessageNumber;
   m_messageGuidID = GenerateGUID();
 
+  SetReliableHeaders(p_message,m_clientMessageNumber,m_messageGuidID);
+  PutInMessageStore(p_message,m_clientMessageNumber);
+}
+
+// Set the WS-RM sequence, message number and message ID in a message
+void
+WebServiceClient::SetReliableHeaders(SOAPMessage* p_message,int p_number,XString p_nonce)
+{
   // IF no RM contract set, use that of our application
   if(p_message->GetNamespace().IsEmpty())
   {
@@ -808,14 +1229,12 @@ WebServiceClient::PrepareForReliable(SOAPMessage* p_message)
   // Pass on to the message
   p_message->SetClientSequence(m_guidSequenceClient);
   p_message->SetServerSequence(m_guidSequenceServer);
-  p_message->SetClientMessageNumber(m_clientMessageNumber);
+  p_message->SetClientMessageNumber(p_number);
   p_message->SetServerMessageNumber(m_serverMessageNumber);
-  p_message->SetMessageNonce(m_messageGuidID);
+  p_message->SetMessageNonce(p_nonce);
   p_message->SetAddressing(true);
   // If everything above is set, ONLY THEN will switching to RM work!
   p_message->SetReliability(m_reliable);
-
-  PutInMessageStore(p_message);
 }
 
 void
@@ -42,12 +42,22 @@
 #include "WSDLCache.h"
 #include "LogAnalysis.h"
 #include <deque>
+#include <vector>
 
 // Default and maximum nr. of messages to store
 constexpr auto MESSAGESTORE_MINIMUM = 0;
 constexpr auto MESSAGESTORE_DEFAULT = 10;
 constexpr auto MESSAGESTORE_MAXIMUM = 256;
 
+// Default and maximum nr. of messages in flight in a sending window
+constexpr auto MESSAGEWINDOW_DEFAULT = 1;
+constexpr auto MESSAGEWINDOW_MAXIMUM = 64;
+
+// Retransmission of unacknowledged messages in a sending window
+constexpr auto RETRANSMIT_INTERVAL = 1000;  // Milliseconds after the last transmission
+constexpr auto RETRANSMIT_ATTEMPTS = 3;     // Maximum retransmissions per message
+constexpr auto WINDOW_POLL_TIME    = 10;    // Milliseconds between polls of an idle sender
+
 // Forward declaration
 class SOAPSecurity;
 
@@ -71,6 +81,24 @@ public:
 // Keeping messages for retransmit in WS-RM
 using MessageStore = std::deque<SoapMsg>;
 
+// Message in the sending window of a WS-RM sequence
+class WindowMsg
+{
+public:
+  SOAPMessage* m_message       { nullptr };  // Message of the caller, receives the answer
+  XString      m_nonce;                      // MessageID of the request
+  int          m_messageNumber { 0       };  // Client message number in the sequence
+  int          m_attempts      { 0       };  // Number of transmissions so far
+  ULONGLONG    m_sentAt        { 0       };  // Tick count the last transmission ended
+  bool         m_inFlight      { false   };  // Currently being sent by a sender thread
+  bool         m_answered      { false   };  // Answer is in m_message
+  bool         m_acked         { false   };  // Acknowledged by the server
+};
+
+// The messages of one SendWindow call
+using MessageWindow = std::vector<WindowMsg>;
+using SOAPMessages  = std::vector<SOAPMessage*>;
+
 // BEWARE: The WebServiceClient can throw CStrings in all of its behavior
 //         Even an Open() or Close() can do this as they handle the WS-Reliable protocol
 //
@@ -89,6 +117,10 @@ public:
   void      StopSendport();
   // Send this message (w/o reliable protocol)
   bool      Send(SOAPMessage* p_message);
+  // Send a series of messages, with up to 'WindowSize' messages in flight
+  bool      SendWindow(SOAPMessages& p_messages);
+  // Sender thread of the window (do not call directly)
+  void      WindowThreadRunning();
   // Add message to queue (NOT WS-Reliable!!)
   bool      AddToQueue(SOAPMessage* p_message);
  
@@ -118,11 +150,14 @@ public:
   XString       GetWSDLFilename()        { return m_wsdlFile;               }
   SOAPSecurity* GetSOAPSecurity()        { return m_soapSecurity;           }
   XString       GetSOAPAction()          { return m_soapAction;             }
+  int           GetWindowSize()          { return m_windowSize;             }
+  int           GetRetransmitInterval()  { return m_retransmitInterval;     }
   bool          GetDetailLogging();
 
   // General Setters
   void      SetHTTPClient(HTTPClient* p_client);
   void      SetStoreSize(int p_size);
+  void      SetWindowSize(int p_size);
   void      SetLogAnalysis(LogAnalysis* p_log);
   void      SetReliable(bool p_reliable,ReliableType p_type = ReliableType::RELIABLE_ONCE);
   void      SetTimeouts(int p_resolve,int p_connect,int p_send,int p_receive);
@@ -138,16 +173,20 @@ public:
   void      SetWSDLFilename(XString p_file)                 { m_wsdlFile           = p_file;        }
   void      SetJsonSoapTranslation(bool p_json)             { m_jsonTranslation    = p_json;        }
   void      SetSOAPAction(XString p_soapAction)             { m_soapAction         = p_soapAction;  }
+  void      SetRetransmitInterval(int p_interval)           { m_retransmitInterval = p_interval;    }
   void      SetLogLevel(int p_logLevel);
   void      SetDetailLogging(bool p_detail);
 
 private:
   void      MinimumCheck();
   void      ReliabilityChecks(SOAPMessage* p_message);
-  void      ErrorHandling(SOAPMessage* p_message);
+  void      ErrorHandling(SOAPMessage* p_message,HTTPClient* p_client = nullptr);
+  void      PrepareMessage(SOAPMessage* p_message);
+  void      PrepareAuthentication(SOAPMessage* p_message);
 
   // Extra messages for reliable messaging
   void      PrepareForReliable(SOAPMessage* p_message);
+  void      SetReliableHeaders(SOAPMessage* p_message,int p_number,XString p_nonce);
   void      CreateSequence();
   void      LastMessage();
   void      TerminateSequence();
@@ -162,10 +201,20 @@ private:
   // Check message store for needed retransmits
   void      CheckMessageRange(int lower,int upper);
   // Keep message in message store
-  void      PutInMessageStore(SOAPMessage* p_message);
+  void      PutInMessageStore(SOAPMessage* p_message,int p_number);
+  // Forget the oldest messages above the StoreSize
+  void      TrimMessageStore();
+  // Find a stored message for retransmission
+  SOAPMessage* FindInMessageStore(int p_number);
   // After ack-ranges are checked
   void      DoRetransmit();
 
+  // Sending window
+  int       NextWindowMessage();
+  void      SendWindowMessage(HTTPClient* p_client,int p_index);
+  void      CheckWindowAnswer(WindowMsg& p_entry,SOAPMessage* p_answer);
+  void      WindowError(XString p_error);
+
   // PRIVATE DATA
   HTTPClient*   m_httpClient          { nullptr   };           // Sendport to send XML to
   WSDLCache     m_wsdl                { false     };           // Client side WSDL
@@ -209,6 +258,12 @@ private:
   // Messages in store for retransmit
   MessageStore  m_messages;                                    // All messages          
   int           m_storeSize           { MESSAGESTORE_DEFAULT };// Max number of messages to store
+  // Sending window
+  int           m_windowSize          { MESSAGEWINDOW_DEFAULT };// Max number of messages in flight
+  int           m_retransmitInterval  { RETRANSMIT_INTERVAL };  // Retransmit unacknowledged after (ms)
+  MessageWindow m_window;                                      // Messages of the current SendWindow
+  size_t        m_windowNext          { 0         };           // Next message never sent
+  CRITICAL_SECTION m_windowLock;                               // Locking the window for the sender threads
   // Timeouts
   int           m_timeoutResolve      { DEF_TIMEOUT_RESOLVE }; // Timeout resolving URL
   int           m_timeoutConnect      { DEF_TIMEOUT_CONNECT }; // Timeout connecting to URL
@@ -0,0 +1,603 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ZipWebroot.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "ZipWebroot.h"
+#include "ConvertWideString.h"
+#include "NameIndex.h"
+#include <ZIP\gzip.h>
+#include <ZIP\zlib.h>
+#include <vector>
+#include <list>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Signatures and sizes of the ZIP records (PKWARE APPNOTE)
+#define ZIP_LOCAL_SIGNATURE     0x04034b50
+#define ZIP_CENTRAL_SIGNATURE   0x02014b50
+#define ZIP_END_SIGNATURE       0x06054b50
+#define ZIP_LOCAL_SIZE          30
+#define ZIP_CENTRAL_SIZE        46
+#define ZIP_END_SIZE            22
+#define ZIP_MAX_COMMENT         0xFFFF
+#define ZIP_FLAG_ENCRYPTED      0x0001
+#define ZIP_FLAG_UTF8           0x0800
+#define ZIP_METHOD_STORED       0
+#define ZIP_METHOD_DEFLATED     8
+#define ZIP_INFLATE_PART        (64 * 1024)   // Inflating to a file in parts of this size
+
+// Fixed gzip header in front of a deflate stream: no name, no time, unknown OS
+static const uchar g_gzipHeader[10] = { 0x1F,0x8B,0x08,0x00,0x00,0x00,0x00,0x00,0x00,0xFF };
+
+static inline USHORT
+ZipShort(const uchar* p_data)
+{
+  return (USHORT)(p_data[0] | (p_data[1] << 8));
+}
+
+static inline DWORD
+ZipLong(const uchar* p_data)
+{
+  return (DWORD)p_data[0] | ((DWORD)p_data[1] << 8) | ((DWORD)p_data[2] << 16) | ((DWORD)p_data[3] << 24);
+}
+
+// Names in the archive and resource names are compared case-insensitive,
+// without leading slashes and with forward slashes only
+static XString
+NormalizeName(XString p_name)
+{
+  p_name.Replace(_T('\\'),_T('/'));
+  p_name.TrimLeft(_T('/'));
+  p_name.MakeLower();
+  return p_name;
+}
+
+// The file mapping, kept alive by the last slice that references it
+typedef struct _zipMapping
+{
+  HANDLE       m_file;
+  HANDLE       m_mapping;
+  const uchar* m_view;
+}
+ZipMapping;
+
+static void
+ReleaseMapping(void* p_context)
+{
+  ZipMapping* mapping = reinterpret_cast<ZipMapping*>(p_context);
+  UnmapViewOfFile(mapping->m_view);
+  CloseHandle(mapping->m_mapping);
+  CloseHandle(mapping->m_file);
+  delete mapping;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// SNAPSHOT OF AN OPENED ARCHIVE
+//
+//////////////////////////////////////////////////////////////////////////
+
+// The mapping, the entries and the index never change after opening.
+// Only the cache of inflated entries changes, under the lock of the snapshot.
+class ZipSnapshot
+{
+public:
+  explicit ZipSnapshot(size_t p_cacheSize);
+
+  bool    Open(const XString& p_archive);
+  bool    GetContent(const XString& p_name,bool p_gzip,BufferChain& p_chain,bool& p_encoded);
+  int     GetNumberOfEntries() { return (int)m_entries.size(); }
+  size_t  GetCachedBytes();
+
+  void    AddReference();
+  void    DropReference();
+
+private:
+ ~ZipSnapshot();
+
+  typedef struct _zipEntry
+  {
+    XString       m_name;                   // Normalized name in the archive
+    USHORT        m_method     { 0 };       // 0 = stored, 8 = deflated
+    DWORD         m_crc        { 0 };       // CRC32 of the inflated data
+    DWORD         m_compressed { 0 };       // Size in the archive
+    DWORD         m_size       { 0 };       // Inflated size
+    ULONGLONG     m_offset     { 0 };       // Offset of the data in the archive
+    BufferBlock*  m_inflated   { nullptr }; // Inflated data in the cache
+    std::list<int>::iterator m_lru;         // Position in the cache
+  }
+  ZipEntry;
+
+  bool          ReadCentralDirectory();
+  BufferBlock*  GetInflated(int p_index);
+  BufferBlock*  InflateToFile(const ZipEntry& p_entry);
+  void          EvictInflated();
+
+  long                  m_references { 1 };
+  BufferBlock*          m_mapping   { nullptr };    // The mapped archive as one block
+  const uchar*          m_view      { nullptr };
+  ULONGLONG             m_size      { 0 };
+  std::vector<ZipEntry> m_entries;
+  NameIndex*            m_index     { nullptr };    // Names of the entries
+  // Cache of inflated entries
+  size_t                m_cacheSize { ZIPWEBROOT_CACHE };
+  size_t                m_cached    { 0 };
+  std::list<int>        m_lru;                      // Least recently used at the front
+  CRITICAL_SECTION      m_lock;
+};
+
+ZipSnapshot::ZipSnapshot(size_t p_cacheSize)
+            :m_cacheSize(p_cacheSize)
+{
+  InitializeCriticalSection(&m_lock);
+}
+
+// Last reference is gone: no request is reading the archive any more
+ZipSnapshot::~ZipSnapshot()
+{
+  for(auto& entry : m_entries)
+  {
+    if(entry.m_inflated)
+    {
+      entry.m_inflated->DropReference();
+    }
+  }
+  delete m_index;
+
+  // Responses still being sent keep the mapping alive
+  if(m_mapping)
+  {
+    m_mapping->DropReference();
+  }
+  DeleteCriticalSection(&m_lock);
+}
+
+void
+ZipSnapshot::AddReference()
+{
+  InterlockedIncrement(&m_references);
+}
+
+void
+ZipSnapshot::DropReference()
+{
+  if(InterlockedDecrement(&m_references) <= 0)
+  {
+    delete this;
+  }
+}
+
+// Map the archive and read the central directory
+bool
+ZipSnapshot::Open(const XString& p_archive)
+{
+  HANDLE file = CreateFile(p_archive,GENERIC_READ,FILE_SHARE_READ,NULL,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,NULL);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  LARGE_INTEGER size;
+  if(!GetFileSizeEx(file,&size) || size.QuadPart < ZIP_END_SIZE)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMapping(file,NULL,PAGE_READONLY,0,0,NULL);
+  if(mapping == NULL)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  const uchar* view = reinterpret_cast<const uchar*>(MapViewOfFile(mapping,FILE_MAP_READ,0,0,0));
+  if(view == nullptr)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  // From now on, the mapping is released with the last slice
+  ZipMapping* context = new ZipMapping();
+  context->m_file    = file;
+  context->m_mapping = mapping;
+  context->m_view    = view;
+  m_view    = view;
+  m_size    = (ULONGLONG)size.QuadPart;
+  m_mapping = BufferBlock::CreateReference(view,(size_t)m_size,ReleaseMapping,context);
+
+  return ReadCentralDirectory();
+}
+
+// Content of an entry.
+// Stored entries are slices of the mapping. Deflated entries are a gzip stream
+// (header + slice of the mapping + trailer) if the client accepts it,
+// otherwise a slice of the inflated data in the cache or a temporary file.
+bool
+ZipSnapshot::GetContent(const XString& p_name,bool p_gzip,BufferChain& p_chain,bool& p_encoded)
+{
+  int index = m_index->First(p_name);
+  if(index < 0 || m_entries[index].m_name != p_name)
+  {
+    return false;
+  }
+  const ZipEntry& entry = m_entries[index];
+
+  if(entry.m_method == ZIP_METHOD_STORED)
+  {
+    p_chain.AddSlice(m_mapping,entry.m_offset,entry.m_size);
+    return true;
+  }
+  if(p_gzip)
+  {
+    // gzip trailer: CRC32 and size of the inflated data
+    uchar trailer[8];
+    for(int ind = 0; ind < 4; ++ind)
+    {
+      trailer[ind    ] = (uchar)(entry.m_crc  >> (8 * ind));
+      trailer[ind + 4] = (uchar)(entry.m_size >> (8 * ind));
+    }
+    p_chain.AddReference(g_gzipHeader,sizeof(g_gzipHeader),nullptr,nullptr);
+    p_chain.AddSlice(m_mapping,entry.m_offset,entry.m_compressed);
+    p_chain.AddCopy(trailer,sizeof(trailer));
+    p_encoded = true;
+    return true;
+  }
+  BufferBlock* inflated = GetInflated(index);
+  if(inflated == nullptr)
+  {
+    return false;
+  }
+  p_chain.AddSlice(inflated,0,inflated->GetLength());
+  inflated->DropReference();
+  return true;
+}
+
+size_t
+ZipSnapshot::GetCachedBytes()
+{
+  AutoCritSec lock(&m_lock);
+  return m_cached;
+}
+
+// Read all entries of the central directory and index them by name
+bool
+ZipSnapshot::ReadCentralDirectory()
+{
+  // Find the end-of-central-directory record, searching back over the comment
+  ULONGLONG lowest = m_size > ZIP_END_SIZE + ZIP_MAX_COMMENT ? m_size - ZIP_END_SIZE - ZIP_MAX_COMMENT : 0;
+  const uchar* end = nullptr;
+  for(ULONGLONG pos = m_size - ZIP_END_SIZE + 1; pos-- > lowest;)
+  {
+    if(ZipLong(m_view + pos) == ZIP_END_SIGNATURE)
+    {
+      end = m_view + pos;
+      break;
+    }
+  }
+  if(end == nullptr)
+  {
+    return false;
+  }
+  USHORT    count     = ZipShort(end + 10);
+  DWORD     dirSize   = ZipLong (end + 12);
+  ULONGLONG dirOffset = ZipLong (end + 16);
+  if(dirOffset + dirSize > m_size)
+  {
+    return false;
+  }
+
+  m_entries.reserve(count);
+  const uchar* record = m_view + dirOffset;
+  const uchar* last   = record + dirSize;
+  for(USHORT number = 0; number < count; ++number)
+  {
+    if(record + ZIP_CENTRAL_SIZE > last || ZipLong(record) != ZIP_CENTRAL_SIGNATURE)
+    {
+      return false;
+    }
+    USHORT flags      = ZipShort(record +  8);
+    USHORT method     = ZipShort(record + 10);
+    DWORD  crc        = ZipLong (record + 16);
+    DWORD  compressed = ZipLong (record + 20);
+    DWORD  size       = ZipLong (record + 24);
+    USHORT nameLength = ZipShort(record + 28);
+    USHORT extra      = ZipShort(record + 30);
+    USHORT comment    = ZipShort(record + 32);
+    DWORD  local      = ZipLong (record + 42);
+    const uchar* name = record + ZIP_CENTRAL_SIZE;
+    record += ZIP_CENTRAL_SIZE + nameLength + extra + comment;
+    if(record > last)
+    {
+      return false;
+    }
+
+    // Skip directories, encrypted entries and entries we cannot send
+    if((nameLength && name[nameLength - 1] == '/') || (flags & ZIP_FLAG_ENCRYPTED) ||
+       (method != ZIP_METHOD_STORED && method != ZIP_METHOD_DEFLATED) ||
+       (method == ZIP_METHOD_STORED && compressed != size))
+    {
+      continue;
+    }
+    // The data starts after the local header, that has its own extra field
+    const uchar* header = m_view + local;
+    if((ULONGLONG)local + ZIP_LOCAL_SIZE > m_size || ZipLong(header) != ZIP_LOCAL_SIGNATURE)
+    {
+      continue;
+    }
+    ULONGLONG offset = (ULONGLONG)local + ZIP_LOCAL_SIZE + ZipShort(header + 26) + ZipShort(header + 28);
+    if(offset + compressed > m_size)
+    {
+      continue;
+    }
+
+    ZipEntry entry;
+    std::string narrow(reinterpret_cast<const char*>(name),nameLength);
+    entry.m_name       = NormalizeName(LPCSTRToString(narrow.c_str(),(flags & ZIP_FLAG_UTF8) != 0));
+    entry.m_method     = method;
+    entry.m_crc        = crc;
+    entry.m_compressed = compressed;
+    entry.m_size       = size;
+    entry.m_offset     = offset;
+    m_entries.push_back(entry);
+  }
+
+  m_index = new NameIndex(m_entries.size());
+  for(auto& entry : m_entries)
+  {
+    m_index->Add(entry.m_name);
+  }
+  return true;
+}
+
+// Inflated data of an entry, with a reference for the caller.
+// Entries are inflated outside the lock. The sizes in the central directory
+// cannot be trusted: only entries that fit in the cache are inflated into
+// memory. Larger entries are inflated in parts into a temporary file.
+BufferBlock*
+ZipSnapshot::GetInflated(int p_index)
+{
+  ZipEntry& entry = m_entries[p_index];
+  if(entry.m_size > m_cacheSize)
+  {
+    return InflateToFile(entry);
+  }
+  {
+    AutoCritSec lock(&m_lock);
+    if(entry.m_inflated)
+    {
+      m_lru.splice(m_lru.end(),m_lru,entry.m_lru);
+      entry.m_inflated->AddReference();
+      return entry.m_inflated;
+    }
+  }
+
+  uchar* buffer = new uchar[(size_t)entry.m_size + 2];
+  if(!zip_inflate_memory(const_cast<uchar*>(m_view + entry.m_offset),entry.m_compressed,buffer,entry.m_size))
+  {
+    delete [] buffer;
+    return nullptr;
+  }
+  buffer[entry.m_size] = buffer[entry.m_size + 1] = 0;
+  BufferBlock* block = BufferBlock::CreateOwned(buffer,entry.m_size);
+
+  AutoCritSec lock(&m_lock);
+  if(entry.m_inflated)
+  {
+    // Another thread was here first: use that one
+    block->DropReference();
+    block = entry.m_inflated;
+    block->AddReference();
+  }
+  else
+  {
+    // One reference for the cache, one for the caller
+    block->AddReference();
+    entry.m_inflated = block;
+    entry.m_lru      = m_lru.insert(m_lru.end(),p_index);
+    m_cached        += entry.m_size;
+    EvictInflated();
+  }
+  return block;
+}
+
+// Inflate an entry in parts into a temporary file, that is removed with its last slice.
+// Never writes more than the size in the central directory.
+BufferBlock*
+ZipSnapshot::InflateToFile(const ZipEntry& p_entry)
+{
+  TCHAR path[MAX_PATH + 1] = { 0 };
+  TCHAR name[MAX_PATH + 1] = { 0 };
+  if(!GetTempPath(MAX_PATH,path) || !GetTempFileName(path,_T("zip"),0,name))
+  {
+    return nullptr;
+  }
+  HANDLE file = CreateFile(name,GENERIC_READ | GENERIC_WRITE,FILE_SHARE_READ | FILE_SHARE_DELETE,NULL,CREATE_ALWAYS
+                          ,FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE,NULL);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    DeleteFile(name);
+    return nullptr;
+  }
+
+  z_stream strm;
+  memset(&strm,0,sizeof(z_stream));
+  strm.next_in  = const_cast<uchar*>(m_view + p_entry.m_offset);
+  strm.avail_in = p_entry.m_compressed;
+  // Negative window bits: raw deflate stream without a header
+  if(inflateInit2(&strm,-15) != Z_OK)
+  {
+    CloseHandle(file);
+    return nullptr;
+  }
+  uchar* part = new uchar[ZIP_INFLATE_PART];
+  int    res  = Z_OK;
+  do
+  {
+    strm.next_out  = part;
+    strm.avail_out = ZIP_INFLATE_PART;
+    res = inflate(&strm,Z_NO_FLUSH);
+    DWORD length  = ZIP_INFLATE_PART - strm.avail_out;
+    DWORD written = 0;
+    if((res != Z_OK && res != Z_STREAM_END) || strm.total_out > p_entry.m_size ||
+       (length && (!::WriteFile(file,part,length,&written,NULL) || written != length)))
+    {
+      res = Z_DATA_ERROR;
+      break;
+    }
+  }
+  while(res != Z_STREAM_END);
+  inflateEnd(&strm);
+  delete [] part;
+
+  if(res != Z_STREAM_END || strm.total_out != p_entry.m_size)
+  {
+    CloseHandle(file);
+    return nullptr;
+  }
+  return BufferBlock::CreateFileRegion(file,0,p_entry.m_size,true);
+}
+
+// Drop the least recently used entries until the cache is within its size
+// Lock must be held by the caller
+void
+ZipSnapshot::EvictInflated()
+{
+  while(m_cached > m_cacheSize && !m_lru.empty())
+  {
+    ZipEntry& entry = m_entries[m_lru.front()];
+    m_lru.pop_front();
+    m_cached -= entry.m_size;
+    entry.m_inflated->DropReference();
+    entry.m_inflated = nullptr;
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// THE WEBROOT
+//
+//////////////////////////////////////////////////////////////////////////
+
+ZipWebroot::ZipWebroot(XString p_archive,size_t p_cacheSize /*= ZIPWEBROOT_CACHE*/)
+           :m_archive(p_archive)
+           ,m_cacheSize(p_cacheSize)
+{
+  InitializeCriticalSection(&m_lock);
+}
+
+ZipWebroot::~ZipWebroot()
+{
+  Close();
+  DeleteCriticalSection(&m_lock);
+}
+
+// Map the archive and read the central directory
+bool
+ZipWebroot::Open()
+{
+  AutoCritSec lock(&m_lock);
+
+  if(m_snapshot)
+  {
+    return true;
+  }
+  ZipSnapshot* snapshot = new ZipSnapshot(m_cacheSize);
+  if(!snapshot->Open(m_archive))
+  {
+    snapshot->DropReference();
+    return false;
+  }
+  m_snapshot = snapshot;
+  return true;
+}
+
+// Forget the archive. The snapshot goes with the last request reading it
+void
+ZipWebroot::Close()
+{
+  ZipSnapshot* snapshot = nullptr;
+  {
+    AutoCritSec lock(&m_lock);
+    snapshot   = m_snapshot;
+    m_snapshot = nullptr;
+  }
+  if(snapshot)
+  {
+    snapshot->DropReference();
+  }
+}
+
+// Content of an entry, read from the snapshot that was current at the start
+bool
+ZipWebroot::GetContent(XString p_name,bool p_gzip,BufferChain& p_chain,bool& p_encoded)
+{
+  p_encoded = false;
+  ZipSnapshot* snapshot = GetSnapshot();
+  if(snapshot == nullptr)
+  {
+    return false;
+  }
+  bool result = snapshot->GetContent(NormalizeName(p_name),p_gzip,p_chain,p_encoded);
+  snapshot->DropReference();
+  return result;
+}
+
+bool
+ZipWebroot::GetIsOpen()
+{
+  AutoCritSec lock(&m_lock);
+  return m_snapshot != nullptr;
+}
+
+int
+ZipWebroot::GetNumberOfEntries()
+{
+  AutoCritSec lock(&m_lock);
+  return m_snapshot ? m_snapshot->GetNumberOfEntries() : 0;
+}
+
+size_t
+ZipWebroot::GetCachedBytes()
+{
+  AutoCritSec lock(&m_lock);
+  return m_snapshot ? m_snapshot->GetCachedBytes() : 0;
+}
+
+ZipSnapshot*
+ZipWebroot::GetSnapshot()
+{
+  AutoCritSec lock(&m_lock);
+  if(m_snapshot)
+  {
+    m_snapshot->AddReference();
+  }
+  return m_snapshot;
+}
@@ -0,0 +1,76 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: ZipWebroot.h
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#pragma once
+#include "BufferChain.h"
+
+// Default size of the cache of inflated entries
+#define ZIPWEBROOT_CACHE  (16*1024*1024)  // 16 Megabyte
+
+class ZipSnapshot;
+
+// A ZIP archive used as the webroot of a site.
+// The archive is memory-mapped and the central directory is indexed by name
+// when opening the archive. Stored entries are served straight from the mapping.
+// Deflated entries are served as 'gzip' by wrapping the deflate stream with a
+// gzip header and trailer, or are inflated into a bounded cache for clients
+// that do not accept gzip. Entries larger than the cache are inflated into a
+// temporary file instead of memory. No ZIP64 and no encrypted entries.
+//
+// The opened archive is a refcounted snapshot: a request keeps it alive while
+// it reads it, so the site can be stopped (Close) while requests are running.
+//
+class ZipWebroot
+{
+public:
+  explicit ZipWebroot(XString p_archive,size_t p_cacheSize = ZIPWEBROOT_CACHE);
+ ~ZipWebroot();
+
+  // Map the archive and read the central directory
+  bool    Open();
+  // Forget the archive. Requests and responses still running keep it alive
+  void    Close();
+
+  // Content of an entry. With p_gzip a deflated entry comes as a gzip stream (p_encoded = true)
+  bool    GetContent(XString p_name,bool p_gzip,BufferChain& p_chain,bool& p_encoded);
+
+  // GETTERS
+  XString GetArchive()          { return m_archive;   }
+  size_t  GetCacheSize()        { return m_cacheSize; }
+  bool    GetIsOpen();
+  int     GetNumberOfEntries();
+  size_t  GetCachedBytes();
+
+private:
+  // Current snapshot with a reference for the caller, or nullptr
+  ZipSnapshot*  GetSnapshot();
+
+  XString         m_archive;                  // Path of the archive file
+  size_t          m_cacheSize { ZIPWEBROOT_CACHE };
+  ZipSnapshot*    m_snapshot  { nullptr };    // The opened archive
+  CRITICAL_SECTION m_lock;                    // Swapping the snapshot
+};
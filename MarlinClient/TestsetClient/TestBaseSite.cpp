@@ -2,7 +2,12 @@
 #include "TestClient.h"
 #include "HTTPMessage.h"
 #include "HTTPClient.h"
+#include <winsock2.h>
+#include <ws2tcpip.h>
 #include <io.h>
+#include <string>
+
+#pragma comment(lib,"ws2_32.lib")
 
 bool 
 PreFlight(HTTPClient* p_client,HTTPMessage& p_msg,XString p_method,XString p_headers)
@@ -141,6 +146,98 @@ TestPut(HTTPClient* p_client)
   return result ? 0 : 1;
 }
 
+// Status of the n-th response in a stream of pipelined responses
+static int
+PipelinedStatus(const std::string& p_responses,int p_number)
+{
+  size_t pos = 0;
+  for(int index = 0; index <= p_number; ++index)
+  {
+    pos = p_responses.find("HTTP/1.1 ",index ? pos + 1 : 0);
+    if(pos == std::string::npos)
+    {
+      return 0;
+    }
+  }
+  return atoi(p_responses.c_str() + pos + 9);
+}
+
+// Two requests in one write on a keep-alive connection.
+// The server must answer both, in the order of the requests:
+// OPTIONS is answered by the options handler, DELETE has no handler (400)
+int
+TestPipelining()
+{
+  bool result = false;
+
+  xprintf(_T("TESTING PIPELINED REQUESTS ON THE BASE SITE
+"));
+  xprintf(_T("===========================================
+"));
+
+  WSADATA data;
+  if(WSAStartup(MAKEWORD(2,2),&data) != 0)
+  {
+    _tprintf(_T("ERROR Cannot start the sockets\n"));
+    return 1;
+  }
+  CT2A host(MARLIN_HOST);
+  char port[20];
+  sprintf_s(port,20,"%d",TESTING_HTTP_PORT);
+
+  ADDRINFOA  hints {};
+  ADDRINFOA* address = nullptr;
+  hints.ai_family   = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+  if(getaddrinfo(host,port,&hints,&address) == 0)
+  {
+    SOCKET sock = socket(address->ai_family,address->ai_socktype,address->ai_protocol);
+    if(sock != INVALID_SOCKET && connect(sock,address->ai_addr,(int)address->ai_addrlen) == 0)
+    {
+      std::string requests;
+      requests  = "OPTIONS /MarlinTest/Site/FileOne.html HTTP/1.1\r\n";
+      requests += "Host: " + std::string(host) + "\r\n";
+      requests += "Connection: keep-alive\r\n";
+      requests += "Content-Length: 0\r\n\r\n";
+      requests += "DELETE /MarlinTest/Site/FileOne.html HTTP/1.1\r\n";
+      requests += "Host: " + std::string(host) + "\r\n";
+      requests += "Connection: close\r\n";
+      requests += "Content-Length: 0\r\n\r\n";
+
+      if(send(sock,requests.c_str(),(int)requests.size(),0) == (int)requests.size())
+      {
+        // The server closes the connection after the second response
+        DWORD timeout = 10000;
+        setsockopt(sock,SOL_SOCKET,SO_RCVTIMEO,reinterpret_cast<const char*>(&timeout),sizeof(DWORD));
+        std::string responses;
+        char buffer[4096];
+        int  received = 0;
+        while((received = recv(sock,buffer,sizeof(buffer),0)) > 0)
+        {
+          responses.append(buffer,received);
+        }
+        int first  = PipelinedStatus(responses,0);
+        int second = PipelinedStatus(responses,1);
+        xprintf(_T("Pipelined responses: %d %d\n"),first,second);
+        result = (first == HTTP_STATUS_OK && second == HTTP_STATUS_BAD_REQUEST);
+      }
+    }
+    if(sock != INVALID_SOCKET)
+    {
+      closesocket(sock);
+    }
+    freeaddrinfo(address);
+  }
+  WSACleanup();
+
+  // SUMMARY OF THE TEST
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Pipelined requests answered in order           : %s\n"),result ? _T("OK") : _T("ERROR"));
+
+  return result ? 0 : 1;
+}
+
 int
 TestBaseSite(HTTPClient* p_client)
 {
@@ -148,7 +245,9 @@ TestBaseSite(HTTPClient* p_client)
   if(TestGet(p_client) == 0)
   {
     // If the 'GET' succeeds, try the 'PUT'
-    return TestPut(p_client);
+    int errors = TestPut(p_client);
+    // Two requests on one connection
+    return errors + TestPipelining();
   }
   return 1;
 }
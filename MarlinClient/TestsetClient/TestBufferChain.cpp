@@ -0,0 +1,230 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestBufferChain.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "FileBuffer.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Body of many small parts, as a serializer produces it
+const int CHAIN_PARTS  = 1000;
+const int CHAIN_PART   = 512;
+const int CHAIN_ROUNDS = 1000;
+
+static int g_released = 0;
+
+static void
+ReleaseReference(void* p_context)
+{
+  ++g_released;
+  delete [] reinterpret_cast<uchar*>(p_context);
+}
+
+static double
+Microseconds(LARGE_INTEGER& p_start,LARGE_INTEGER& p_stop,int p_rounds)
+{
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return (double)(p_stop.QuadPart - p_start.QuadPart) * 1000000.0 / (double)frequency.QuadPart / p_rounds;
+}
+
+// Slices of chains must reference the same bytes, in the same order
+static int
+TestBufferChainSlices()
+{
+  int errors = 0;
+  const uchar* text = (const uchar*)"Hello, scatter/gather world!";
+
+  uchar* referenced = new uchar[8];
+  memcpy(referenced,"REFERENC",8);
+  g_released = 0;
+  {
+    BufferChain chain;
+    chain.AddCopy(text,7);                  // "Hello, "
+    chain.AddCopy(text + 7,21);             // "scatter/gather world!"
+    chain.AddReference(referenced,8,ReleaseReference,referenced);
+
+    BufferChain copy(chain);
+    BufferChain part = chain.Slice(10,15);  // "tter/gather wor"
+    chain.Reset();
+
+    uchar buffer[64] = { 0 };
+    if(!part.CopyTo(buffer) || part.GetLength() != 15 || strcmp((char*)buffer,"tter/gather wor") != 0)
+    {
+      xprintf(_T("Slice of a buffer chain is wrong\n"));
+      ++errors;
+    }
+    HTTP_DATA_CHUNK chunks[BUFFERCHAIN_MAX_CHUNKS];
+    ULONGLONG bytes = 0;
+    USHORT count = copy.GetDataChunks(1,chunks,BUFFERCHAIN_MAX_CHUNKS,&bytes);
+    if(count != 2 || bytes != 29 || chunks[1].FromMemory.pBuffer != referenced)
+    {
+      xprintf(_T("Data chunks of a buffer chain are wrong\n"));
+      ++errors;
+    }
+    if(g_released != 0)
+    {
+      xprintf(_T("Referenced buffer released too early\n"));
+      ++errors;
+    }
+  }
+  if(g_released != 1)
+  {
+    xprintf(_T("Referenced buffer not released by the last slice\n"));
+    ++errors;
+  }
+
+  // Copies of a FileBuffer share the parts
+  FileBuffer original;
+  original.AddBuffer((uchar*)text,7);
+  original.AddBuffer((uchar*)text + 7,21);
+  FileBuffer copied(original);
+  uchar* one = nullptr;
+  uchar* two = nullptr;
+  size_t length = 0;
+  original.GetBufferPart(1,one,length);
+  copied  .GetBufferPart(1,two,length);
+  uchar* whole = nullptr;
+  if(one != two || !copied.GetBufferCopy(whole,length) || length != 28 || memcmp(whole,text,28) != 0)
+  {
+    xprintf(_T("FileBuffer copy does not share its parts\n"));
+    ++errors;
+  }
+  delete [] whole;
+  return errors;
+}
+
+// Writing a FileBuffer must include the regions of other files
+static int
+TestBufferChainFile()
+{
+  int errors = 0;
+  TCHAR path[MAX_PATH + 1] = { 0 };
+  GetTempPath(MAX_PATH,path);
+  XString source = XString(path) + _T("BufferChainSource.txt");
+  XString target = XString(path) + _T("BufferChainTarget.txt");
+
+  HANDLE file = CreateFile(source,GENERIC_READ | GENERIC_WRITE,FILE_SHARE_READ,nullptr,CREATE_ALWAYS,FILE_ATTRIBUTE_NORMAL,nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    xprintf(_T("Cannot create the source file for a buffer chain\n"));
+    return 1;
+  }
+  DWORD written = 0;
+  ::WriteFile(file,"0123456789ABCDEFGHIJ",20,&written,nullptr);
+
+  BufferChain region;
+  region.AddFileRegion(file,5,10,true);     // "56789ABCDE"
+
+  FileBuffer buffer;
+  buffer.AddBuffer((uchar*)"Head:",5);
+  buffer.AddBufferChain(region);
+  buffer.AddBuffer((uchar*)":Tail",5);
+  buffer.SetFileName(target);
+
+  FileBuffer result;
+  result.SetFileName(target);
+  uchar* data = nullptr;
+  size_t length = 0;
+  if(!buffer.WriteFile() || !result.ReadFile() || !result.GetBufferCopy(data,length) ||
+     length != 20 || memcmp(data,"Head:56789ABCDE:Tail",20) != 0)
+  {
+    xprintf(_T("FileBuffer does not write the file regions of a buffer chain\n"));
+    ++errors;
+  }
+  delete [] data;
+  buffer.Reset();
+  region.Reset();
+  DeleteFile(source);
+  DeleteFile(target);
+  return errors;
+}
+
+// Copying a body of many parts, as done for logging/tracing and resending a message
+static void
+BenchmarkBufferChain()
+{
+  FileBuffer body;
+  uchar part[CHAIN_PART];
+  memset(part,'x',CHAIN_PART);
+  for(int index = 0; index < CHAIN_PARTS; ++index)
+  {
+    body.AddBuffer(part,CHAIN_PART);
+  }
+
+  size_t total = 0;
+  LARGE_INTEGER start,middle,stop;
+  QueryPerformanceCounter(&start);
+  for(int round = 0; round < CHAIN_ROUNDS / 10; ++round)
+  {
+    // Baseline: a deep copy of every part
+    FileBuffer copy;
+    uchar* buffer = nullptr;
+    size_t length = 0;
+    for(unsigned index = 0; body.GetBufferPart(index,buffer,length); ++index)
+    {
+      copy.AddBuffer(buffer,length);
+    }
+    total += copy.GetLength();
+  }
+  QueryPerformanceCounter(&middle);
+  for(int round = 0; round < CHAIN_ROUNDS; ++round)
+  {
+    FileBuffer copy(body);
+    total += copy.GetLength();
+  }
+  QueryPerformanceCounter(&stop);
+  // --- "--------------------------- - ------\n"
+  _tprintf(_T("Body copy of all parts      : %.1f us\n"),Microseconds(start,middle,CHAIN_ROUNDS / 10));
+  _tprintf(_T("Body copy of shared slices  : %.1f us\n"),Microseconds(middle,stop,CHAIN_ROUNDS));
+
+  // Keep the optimizer from removing the loops
+  if(total == 0)
+  {
+    _tprintf(_T("Nothing copied!\n"));
+  }
+}
+
+int
+TestBufferChain(void)
+{
+  xprintf(_T("TESTING SCATTER/GATHER BUFFER CHAINS\n"));
+  xprintf(_T("====================================\n"));
+
+  int errors = TestBufferChainSlices();
+  errors += TestBufferChainFile();
+  BenchmarkBufferChain();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Buffer chain slices shared without copying     : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
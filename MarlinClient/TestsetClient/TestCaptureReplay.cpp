@@ -0,0 +1,126 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestCaptureReplay.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "MessageCapture.h"
+#include "MessageReplay.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Capture a request/response pair as the server does, and replay it
+// against the test server. One pair answers as captured, one does not.
+static int
+CaptureAndReplay()
+{
+  int errors = 0;
+  TCHAR path[MAX_PATH + 1] = { 0 };
+  GetTempPath(MAX_PATH,path);
+  XString directory = XString(path) + _T("MarlinCapture\\");
+
+  XString url;
+  url.Format(_T("http://%s:%d/MarlinTest/Site/FileOne.html"),MARLIN_HOST,TESTING_HTTP_PORT);
+
+  MessageCapture capture;
+  if(!capture.Start(directory,CAPTURE_FILE_SIZE,1))
+  {
+    xprintf(_T("Cannot start the traffic capture in: %s\n"),directory.GetString());
+    return 1;
+  }
+  // Two requests, as the site hands them to the handlers
+  // OPTIONS is answered with a 200 by the base site
+  for(int index = 1; index <= 2; ++index)
+  {
+    HTTPMessage* request = new HTTPMessage(HTTPCommand::http_options,url);
+    request->SetRequestHandle((HTTP_OPAQUE_ID)index);
+    if(!capture.CaptureRequest(request) || !capture.GetIsOpen((HTTP_OPAQUE_ID)index))
+    {
+      xprintf(_T("No open capture record for request [%d]\n"),index);
+      ++errors;
+    }
+    HTTPMessage* response = new HTTPMessage(HTTPCommand::http_response,index == 1 ? HTTP_STATUS_OK : HTTP_STATUS_CREATED);
+    capture.CaptureResponse((HTTP_OPAQUE_ID)index,response);
+    if(capture.GetIsOpen((HTTP_OPAQUE_ID)index))
+    {
+      xprintf(_T("Capture record still open after the response [%d]\n"),index);
+      ++errors;
+    }
+    response->DropReference();
+    request ->DropReference();
+  }
+  // A response without an open record is not captured
+  HTTPMessage* stray = new HTTPMessage(HTTPCommand::http_response,HTTP_STATUS_OK);
+  capture.CaptureResponse((HTTP_OPAQUE_ID)3,stray);
+  stray->DropReference();
+
+  // Writes the queued records
+  capture.Stop();
+  XString filename = capture.GetCurrentFile();
+  if(capture.GetCaptured() != 2 || capture.GetDropped() != 0 || filename.IsEmpty())
+  {
+    xprintf(_T("Traffic capture wrote [%d] records, dropped [%d]\n"),capture.GetCaptured(),capture.GetDropped());
+    return ++errors;
+  }
+
+  XString target;
+  target.Format(_T("http://%s:%d"),MARLIN_HOST,TESTING_HTTP_PORT);
+  {
+    MessageReplay replay(target);
+    replay.SetConcurrency(1);
+    replay.SetCompareBody(false);
+    if(!replay.AddCaptureFile(filename) || replay.GetRecords() != 2)
+    {
+      xprintf(_T("Capture file cannot be read for a replay: %s\n"),filename.GetString());
+      ++errors;
+    }
+    else if(!replay.Run() || replay.GetSent() != 2 || replay.GetErrors() != 0 || replay.GetMismatches() != 1)
+    {
+      xprintf(_T("Replay sent [%d] errors [%d] mismatches [%d]\n"),replay.GetSent(),replay.GetErrors(),replay.GetMismatches());
+      ++errors;
+    }
+  }
+  DeleteFile(filename);
+  RemoveDirectory(directory);
+  return errors;
+}
+
+int
+TestCaptureReplay(void)
+{
+  xprintf(_T("TESTING TRAFFIC CAPTURE AND REPLAY\n"));
+  xprintf(_T("==================================\n"));
+
+  int errors = CaptureAndReplay();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Traffic capture replayed against the server    : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
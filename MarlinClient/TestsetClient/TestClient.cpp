@@ -151,10 +151,20 @@ int _tmain(int argc,const TCHAR* argv[],const TCHAR* /*envp[]*/)
 //    errors += TestCookiesOverwrite();   Moved to baseLibrary
 //    errors += TestDecryptCookie();      Moved to baseLibrary
 //    errors += TestMSGraph(client);      Moved to baseLibrary
+      errors += TestURLView();
+      errors += TestNameIndex();
+      errors += TestReaderEpoch();
+      errors += TestBufferChain();
+      errors += TestMultiPartStream();
+      errors += TestJsonTranscoder();
+      errors += TestCryptoHash();
+      errors += TestSOAPEncryption();
 
       // Unit testing of the client to a web server
       errors += TestFindClientCertificate();
       errors += TestBaseSite(client);
+      errors += TestCaptureReplay();
+      errors += TestZipSite(client);
       errors += TestSecureSite(client);
       errors += TestClientCertificate(client);
       errors += TestChunkedTransfer(client);
@@ -166,6 +176,7 @@ int _tmain(int argc,const TCHAR* argv[],const TCHAR* /*envp[]*/)
       errors += TestContract(client,false,true);   // WS   WS-Secure token-profile
       errors += TestPatching(client);
       errors += TestCompression(client);
+      errors += TestMetrics(client);
       errors += TestEvents(client);
       errors += TestWebSocketAccept();
 
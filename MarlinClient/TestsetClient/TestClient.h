@@ -30,6 +30,8 @@
 #include "StdException.h"
 
 #define NUM_RM_TESTS 3
+#define NUM_RM_WINDOW_TESTS 40
+#define NUM_RM_WINDOW_SIZE   8
 
 class   HTTPClient;
 class   LogAnalysis;
@@ -47,6 +49,15 @@ void WaitForKey();
 // In the various testing files
 extern int TestURLChars(void);
 extern int TestCrackURL(void);
+extern int TestURLView(void);
+extern int TestNameIndex(void);
+extern int TestReaderEpoch(void);
+extern int TestBufferChain(void);
+extern int TestMultiPartStream(void);
+extern int TestCaptureReplay(void);
+extern int TestJsonTranscoder(void);
+extern int TestCryptoHash(void);
+extern int TestSOAPEncryption(void);
 extern int TestCryptography(void);
 extern int TestConvert(void);
 extern int TestFindClientCertificate(void);
@@ -60,8 +71,10 @@ extern int TestJsonData(HTTPClient* p_client);
 extern int TestPatching(HTTPClient* p_client);
 extern int TestFormData(HTTPClient* p_client);
 extern int TestBaseSite(HTTPClient* p_client);
+extern int TestZipSite(HTTPClient* p_client);
 extern int TestSecureSite(HTTPClient* p_client);
 extern int TestCompression(HTTPClient* p_client);
+extern int TestMetrics(HTTPClient* p_client);
 extern int TestChunkedTransfer(HTTPClient* p_client);
 extern int TestWebservices(HTTPClient& p_client);
 extern int TestClientCertificate(HTTPClient* p_client);
@@ -0,0 +1,211 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestCryptoHash.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "Crypto.h"
+#include "CryptoHash.h"
+#include <wincrypt.h>
+#include <process.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Known answers from FIPS 180: "abc" and a message of two blocks
+static const char* hashInput[2] =
+{
+  "abc"
+ ,"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+};
+
+typedef struct _knownHash
+{
+  unsigned m_method;
+  LPCTSTR  m_digest[2];
+}
+KnownHash;
+
+static const KnownHash knownHashes[] =
+{
+  { CALG_SHA1,   { _T("a9993e364706816aba3e25717850c26c9cd0d89d")
+                  ,_T("84983e441c3bd26ebaae4aa1f95129e5e54670f1") } }
+ ,{ CALG_SHA_256,{ _T("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad")
+                  ,_T("248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") } }
+ ,{ CALG_SHA_384,{ _T("cb00753f45a35e8bb5a03d699ac65007272c32ab0eded1631a8b605a43ff5bed8086072ba1e7cc2358baeca134c825a7")
+                  ,_T("3391fdddfc8dc7393707a65b1b4709397cf8b1d162af05abfe8f450de5f36bc6b0455a8520bc4e6f5fe95b1fe3c8452b") } }
+ ,{ CALG_SHA_512,{ _T("ddaf35a193617abacc417349ae20413112e6fa4e89a97ea20a9eeee64b55d39a2192992a274fc1a836ba3c23a3feebbd454d4423643ce80e2a9ac94fa54ca49f")
+                  ,_T("204a8fc6dda82f0a0ced7beb8e08a41657c16ef468b228a8279be331a703c33596fd15c13b1b07f9aa1d3bea57789ca031ad85c7a71dd70354ec631238ca3445") } }
+};
+
+// Hashes per thread in the benchmark, and the size of a typical SOAP body
+const int    HASH_ROUNDS  = 20000;
+const size_t HASH_MESSAGE = 2048;
+const int    HASH_THREADS[] = { 1, 2, 4, 8, 16 };
+
+static XString
+HexDigest(const BYTE* p_digest,size_t p_size)
+{
+  XString hex;
+  for(size_t index = 0; index < p_size; ++index)
+  {
+    hex.AppendFormat(_T("%02x"),p_digest[index]);
+  }
+  return hex;
+}
+
+// Known answers through the one-shot, the incremental and the Crypto::Digest interface
+static int
+TestHashKnownAnswers()
+{
+  int errors = 0;
+
+  for(auto& known : knownHashes)
+  {
+    for(int input = 0; input < 2; ++input)
+    {
+      const char* data = hashInput[input];
+      size_t length = strlen(data);
+      BYTE digest[CRYPTOHASH_MAXSIZE];
+
+      // One-shot on the context of this thread
+      size_t size = CryptoHash::Hash(known.m_method,data,length,digest);
+      XString oneShot = HexDigest(digest,size);
+
+      // Incremental in pieces of 1, 2, 3... bytes
+      CryptoHash hash(known.m_method);
+      for(size_t pos = 0,piece = 1; pos < length; pos += piece++)
+      {
+        hash.Update(data + pos,(length - pos < piece) ? length - pos : piece);
+      }
+      size = hash.Final(digest);
+      XString pieces = HexDigest(digest,size);
+
+      // The old interface
+      Crypto crypt;
+      XString digested = crypt.Digest(data,length,known.m_method);
+      digested.Trim();
+      digested.MakeLower();
+
+      if(oneShot  != known.m_digest[input] ||
+         pieces   != known.m_digest[input] ||
+         digested != known.m_digest[input])
+      {
+        xprintf(_T("Wrong hash for method [%X] input [%d]\n"),known.m_method,input);
+        ++errors;
+      }
+    }
+  }
+
+  // Portable kernels must give the same hash as the SHA extensions
+  if(CryptoHash::GetAcceleration())
+  {
+    std::vector<BYTE> message(HASH_MESSAGE * 3 + 17);
+    for(size_t index = 0; index < message.size(); ++index)
+    {
+      message[index] = (BYTE)(index * 31 + 7);
+    }
+    for(auto& known : knownHashes)
+    {
+      BYTE fast[CRYPTOHASH_MAXSIZE];
+      BYTE slow[CRYPTOHASH_MAXSIZE];
+      size_t size = CryptoHash::Hash(known.m_method,message.data(),message.size(),fast);
+      CryptoHash::SetAcceleration(false);
+      CryptoHash::Hash(known.m_method,message.data(),message.size(),slow);
+      CryptoHash::SetAcceleration(true);
+      if(memcmp(fast,slow,size) != 0)
+      {
+        xprintf(_T("SHA extensions and portable hash differ for method [%X]\n"),known.m_method);
+        ++errors;
+      }
+    }
+  }
+  return errors;
+}
+
+static unsigned __stdcall
+HashThread(void* p_message)
+{
+  const BYTE* message = reinterpret_cast<const BYTE*>(p_message);
+  Crypto crypt;
+  for(int round = 0; round < HASH_ROUNDS; ++round)
+  {
+    crypt.Digest(message,HASH_MESSAGE,(round & 1) ? CALG_SHA_256 : CALG_SHA1);
+  }
+  return 0;
+}
+
+// Every thread digests SOAP sized messages, as signing and WS-Security do
+static void
+BenchmarkHashing()
+{
+  std::vector<BYTE> message(HASH_MESSAGE,'x');
+  LARGE_INTEGER frequency,start,stop;
+  QueryPerformanceFrequency(&frequency);
+
+  _tprintf(_T("SHA extensions of processor : %s\n"),CryptoHash::GetAcceleration() ? _T("yes") : _T("no"));
+  for(auto number : HASH_THREADS)
+  {
+    std::vector<HANDLE> threads;
+    QueryPerformanceCounter(&start);
+    for(int index = 0; index < number; ++index)
+    {
+      HANDLE thread = (HANDLE)_beginthreadex(nullptr,0,HashThread,message.data(),0,nullptr);
+      if(thread)
+      {
+        threads.push_back(thread);
+      }
+    }
+    for(auto& thread : threads)
+    {
+      WaitForSingleObject(thread,INFINITE);
+      CloseHandle(thread);
+    }
+    QueryPerformanceCounter(&stop);
+
+    double seconds = (double)(stop.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+    double rate    = seconds > 0.0 ? (double)number * HASH_ROUNDS / seconds : 0.0;
+    // --- "--------------------------- - ------\n"
+    _tprintf(_T("Digest 2KB %2d threads       : %.0f hashes/sec\n"),number,rate);
+  }
+}
+
+int
+TestCryptoHash(void)
+{
+  xprintf(_T("TESTING BUILT-IN SHA HASHING\n"));
+  xprintf(_T("============================\n"));
+
+  int errors = TestHashKnownAnswers();
+  BenchmarkHashing();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Built-in SHA-1/SHA-256/SHA-384/SHA-512 hashing : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
@@ -84,9 +84,64 @@ int DoSend(HTTPClient* p_client,JSONMessage* p_msg)
   return errors;
 }
 
+// Large message is streamed in parts into the body of the HTTP message
+// Must be exactly the same as the message in one string
+int TestJsonStreaming()
+{
+  int errors = 1;
+
+  XString text(_T("{\"rows\":["));
+  for(int ind = 0; ind < 5000; ++ind)
+  {
+    text.AppendFormat(_T("%s{\"id\":%d,\"amount\":%d.25,\"name\":\"Row \\\"%d\\\"\\tend\",\"valid\":true}")
+                     ,ind ? _T(",") : _T(""),ind,ind,ind);
+  }
+  text += _T("]}");
+
+  JSONMessage json(text);
+  HTTPMessage http(HTTPCommand::http_response,&json);
+
+  XString oneString = json.GetJsonMessage();
+  XString streamed  = http.GetBody();
+  if(oneString == streamed && http.GetFileBuffer()->GetNumberOfParts() > 1 &&
+     _ttoi(http.GetHeader(_T("Content-Length"))) == (int)http.GetBodyLength())
+  {
+    --errors;
+  }
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Json message streamed into HTTP body parts     : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
+
+// The JSON print of an XML message is kept as it always was.
+// Compares the full print, so any change in the output shows up here.
+int TestXmlPrintJson()
+{
+  int errors = 1;
+
+  XMLMessage xml;
+  xml.SetRootNodeName(_T("Order"));
+  XMLElement* customer = xml.AddElement(nullptr,_T("Customer"),XDT_String,_T(""));
+  xml.AddElement(customer,_T("Name"),XDT_String,_T("Marlin \"fish\""));
+  xml.AddElement(customer,_T("Number"),XDT_Integer,_T("42"));
+  xml.SetCondensed(true);
+
+  XString json = xml.PrintJson(false);
+  if(json.Compare(_T("\"Order\": \"\"{}\n")) == 0)
+  {
+    --errors;
+  }
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("XML message printed as JSON                    : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
+
 int TestJsonData(HTTPClient* p_client)
 {
   int errors = 0;
+
+  errors += TestJsonStreaming();
+  errors += TestXmlPrintJson();
   XString url;
   url.Format(_T("http://%s:%d/MarlinTest/Data?test=2&size=medium%%20large"),MARLIN_HOST,TESTING_HTTP_PORT);
 
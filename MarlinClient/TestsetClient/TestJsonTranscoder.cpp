@@ -0,0 +1,243 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestJsonTranscoder.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "SOAPMessage.h"
+#include "JSONMessage.h"
+#include "JSONTranscoder.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+const int TRANSCODE_ROUNDS = 1000;
+
+static LPCTSTR g_jsonText = _T("{\"TestTranscoder\":{\"Name\":\"Marlin\",\"Version\":8,\"Price\":12.50,\"Active\":true,\"Nothing\":null,")
+                            _T("\"Items\":[{\"Item\":\"One\"},\"Two\",[3,4]],\"Empty\":{},\"Nested\":{\"Deep\":{\"Deeper\":\"text\"}}}}");
+
+static double
+Microseconds(LARGE_INTEGER& p_start,LARGE_INTEGER& p_stop,int p_rounds)
+{
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return (double)(p_stop.QuadPart - p_start.QuadPart) * 1000000.0 / (double)frequency.QuadPart / p_rounds;
+}
+
+// SOAP message with pairs, attributes, arrays and runs of the same element
+static void
+FillMessage(SOAPMessage& p_msg)
+{
+  XMLElement* param = p_msg.GetParameterObjectNode();
+  p_msg.SetParameter(_T("Name"),_T("Marlin"));
+  p_msg.SetParameter(_T("Empty"),_T(""));
+  XMLElement* version = p_msg.SetParameter(_T("Version"),_T(" 8 "));
+  p_msg.SetAttribute(version,_T("major"),_T("8"));
+
+  XMLElement* items = p_msg.AddElement(param,_T("Items"),XDT_String,_T(""));
+  for(int index = 1; index <= 3; ++index)
+  {
+    XString value;
+    value.Format(_T("Item %d"),index);
+    p_msg.AddElement(items,_T("Item"),XDT_String,value);
+  }
+  for(int index = 1; index <= 2; ++index)
+  {
+    XMLElement* line = p_msg.AddElement(param,_T("Line"),XDT_String,_T(""));
+    p_msg.SetAttribute(line,_T("number"),index);
+    p_msg.AddElement(line,_T("Amount"),XDT_String,_T("12.50"));
+    p_msg.AddElement(line,_T("Currency"),XDT_String,_T("EUR"));
+  }
+  XMLElement* list = p_msg.AddElement(param,_T("List"),XDT_Array,_T(""));
+  p_msg.AddElement(list,_T("Value"),XDT_String,_T("One"));
+  p_msg.AddElement(list,_T("Value"),XDT_String,_T(""));
+  XMLElement* value = p_msg.AddElement(list,_T("Value"),XDT_String,_T(""));
+  p_msg.AddElement(value,_T("Sub"),XDT_String,_T("Two"));
+  p_msg.AddElement(param,_T("Total"),XDT_String,_T("25.00"));
+}
+
+// Streamed JSON must be exactly the same as the JSONMessage tree produces
+static int
+TestTranscodeSoapToJson()
+{
+  int errors = 0;
+  XString namesp(_T("http://interface.marlin.org/testing/"));
+  XString action(_T("TestTranscoder"));
+
+  for(int white = 0; white <= 1; ++white)
+  {
+    SOAPMessage msg(namesp,action);
+    FillMessage(msg);
+    msg.SetCondensed(white == 0);
+
+    JSONTranscoder transcoder;
+    if(!transcoder.CanWriteSoap(&msg))
+    {
+      xprintf(_T("SOAP message cannot be streamed as JSON\n"));
+      ++errors;
+      continue;
+    }
+    StringWriter writer;
+    transcoder.WriteSoapAsJson(&msg,writer,white != 0);
+
+    JSONMessage json(&msg);
+    if(writer.GetString() != json.GetJsonMessage())
+    {
+      xprintf(_T("Streamed JSON differs from the JSON tree:\n%s\n%s\n"),writer.GetString().GetString(),json.GetJsonMessage().GetString());
+      ++errors;
+    }
+  }
+
+  // Mixed content and split runs need the tree
+  SOAPMessage mixed(namesp,action);
+  XMLElement* element = mixed.SetParameter(_T("Mixed"),_T("text"));
+  mixed.AddElement(element,_T("Child"),XDT_String,_T("child"));
+  SOAPMessage split(namesp,action);
+  XMLElement* param = split.GetParameterObjectNode();
+  split.AddElement(param,_T("Run"),XDT_String,_T("1"));
+  split.AddElement(param,_T("Run"),XDT_String,_T("2"));
+  split.AddElement(param,_T("Other"),XDT_String,_T("3"));
+  split.AddElement(param,_T("Run"),XDT_String,_T("4"));
+  split.AddElement(param,_T("Run"),XDT_String,_T("5"));
+
+  JSONTranscoder transcoder;
+  if(transcoder.CanWriteSoap(&mixed) || transcoder.CanWriteSoap(&split))
+  {
+    xprintf(_T("Lookahead for mixed content or split runs not detected\n"));
+    ++errors;
+  }
+  return errors;
+}
+
+// Transcoded SOAP must be exactly the same as with the JSONMessage tree
+static int
+TestTranscodeJsonToSoap()
+{
+  int errors = 0;
+  LPCTSTR texts[] =
+  {
+    g_jsonText
+   ,_T("{\"Envelope\":{\"Body\":{\"Action\":{\"Param\":\"one\"}},\"Extra\":[1,2]}}")
+   ,_T("{\"Broken\":{\"Param\":\"one\",}")
+  };
+  for(auto& text : texts)
+  {
+    JSONMessage json(text);
+    SOAPMessage tree;
+    tree = json;
+
+    XString answer(text);
+    JSONMessage empty;
+    empty.SetIncoming(true);
+    SOAPMessage streamed;
+    streamed.TranscodeJSON(empty,answer);
+
+    if(tree.GetSoapMessage() != streamed.GetSoapMessage())
+    {
+      xprintf(_T("Transcoded SOAP differs from the JSON tree:\n%s\n%s\n"),streamed.GetSoapMessage().GetString(),tree.GetSoapMessage().GetString());
+      ++errors;
+    }
+  }
+  return errors;
+}
+
+static void
+BenchmarkTranscoder()
+{
+  XString namesp(_T("http://interface.marlin.org/testing/"));
+  XString action(_T("TestTranscoder"));
+  SOAPMessage msg(namesp,action);
+  FillMessage(msg);
+
+  size_t total = 0;
+  LARGE_INTEGER start,middle,stop;
+  QueryPerformanceCounter(&start);
+  for(int round = 0; round < TRANSCODE_ROUNDS; ++round)
+  {
+    JSONMessage json(&msg);
+    total += json.GetJsonMessage().GetLength();
+  }
+  QueryPerformanceCounter(&middle);
+  for(int round = 0; round < TRANSCODE_ROUNDS; ++round)
+  {
+    JSONTranscoder transcoder;
+    StringWriter writer;
+    if(transcoder.CanWriteSoap(&msg))
+    {
+      transcoder.WriteSoapAsJson(&msg,writer,true);
+    }
+    total += writer.GetLength();
+  }
+  QueryPerformanceCounter(&stop);
+  // --- "--------------------------- - ------\n"
+  _tprintf(_T("SOAP->JSON through tree     : %.1f us\n"),Microseconds(start,middle,TRANSCODE_ROUNDS));
+  _tprintf(_T("SOAP->JSON streamed         : %.1f us\n"),Microseconds(middle,stop,TRANSCODE_ROUNDS));
+
+  QueryPerformanceCounter(&start);
+  for(int round = 0; round < TRANSCODE_ROUNDS; ++round)
+  {
+    JSONMessage json(g_jsonText);
+    SOAPMessage soap;
+    soap = json;
+    total += soap.GetParameterCount();
+  }
+  QueryPerformanceCounter(&middle);
+  for(int round = 0; round < TRANSCODE_ROUNDS; ++round)
+  {
+    XString text(g_jsonText);
+    JSONMessage json;
+    SOAPMessage soap;
+    soap.TranscodeJSON(json,text);
+    total += soap.GetParameterCount();
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("JSON->SOAP through tree     : %.1f us\n"),Microseconds(start,middle,TRANSCODE_ROUNDS));
+  _tprintf(_T("JSON->SOAP streamed         : %.1f us\n"),Microseconds(middle,stop,TRANSCODE_ROUNDS));
+
+  // Keep the optimizer from removing the loops
+  if(total == 0)
+  {
+    _tprintf(_T("Nothing transcoded!\n"));
+  }
+}
+
+int
+TestJsonTranscoder(void)
+{
+  xprintf(_T("TESTING STREAMING JSON <-> SOAP TRANSCODER\n"));
+  xprintf(_T("==========================================\n"));
+
+  int errors = TestTranscodeSoapToJson();
+  errors += TestTranscodeJsonToSoap();
+  BenchmarkTranscoder();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("JSON <-> SOAP streamed as the JSON tree        : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
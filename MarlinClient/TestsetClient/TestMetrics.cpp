@@ -0,0 +1,91 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestMetrics.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "HTTPClient.h"
+#include "JSONMessage.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Getting the server-wide metrics from the built-in metrics site
+// Once in the Prometheus text format and once as JSON
+int TestMetrics(HTTPClient* p_client)
+{
+  int errors = 0;
+
+  xprintf(_T("TESTING THE SERVER-WIDE METRICS SITE /MarlinTest/Metrics/\n"));
+  xprintf(_T("=========================================================\n"));
+
+  XString url;
+  url.Format(_T("http://%s:%d/MarlinTest/Metrics/"),MARLIN_HOST,TESTING_HTTP_PORT);
+  HTTPMessage text(HTTPCommand::http_get,url);
+  if(p_client->Send(&text) && p_client->GetStatus() == HTTP_STATUS_OK)
+  {
+    // Histograms of the sites tested before must be in here
+    XString body = text.GetBody();
+    xprintf(_T("%s\n"),body.GetString());
+    if(body.Find(_T("# TYPE marlin_site_request_seconds histogram")) < 0 ||
+       body.Find(_T("marlin_site_request_seconds_bucket{")) < 0)
+    {
+      ++errors;
+    }
+  }
+  else
+  {
+    ++errors;
+  }
+  // SUMMARY OF THE TEST
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Server metrics in the Prometheus text format   : %s\n"),errors ? _T("ERROR") : _T("OK"));
+
+  int jsonErrors = 0;
+  url.Format(_T("http://%s:%d/MarlinTest/Metrics/?format=json"),MARLIN_HOST,TESTING_HTTP_PORT);
+  HTTPMessage json(HTTPCommand::http_get,url);
+  if(p_client->Send(&json) && p_client->GetStatus() == HTTP_STATUS_OK)
+  {
+    JSONMessage metrics(json.GetBody());
+    if(metrics.GetErrorState() || metrics.FindValue(_T("metrics")) == nullptr ||
+                                  metrics.FindValue(_T("p99_ms"))  == nullptr)
+    {
+      ++jsonErrors;
+    }
+  }
+  else
+  {
+    ++jsonErrors;
+  }
+  // SUMMARY OF THE TEST
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Server metrics as a JSON object                : %s\n"),jsonErrors ? _T("ERROR") : _T("OK"));
+
+  return errors + jsonErrors;
+}
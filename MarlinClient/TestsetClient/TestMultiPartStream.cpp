@@ -0,0 +1,142 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestMultiPartStream.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "MultiPartBuffer.h"
+#include <string>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// The streaming multipart parser must find the delimiter wherever it falls:
+// straddling two received blocks, or the edge of its scanning window.
+
+static const char* boundary = "MarlinBoundary1234";
+
+// Collect the file part that goes to the callback
+static bool
+CollectFileData(void* p_context,MultiPart* /*p_part*/,const uchar* p_data,size_t p_length)
+{
+  reinterpret_cast<std::string*>(p_context)->append(reinterpret_cast<const char*>(p_data),p_length);
+  return true;
+}
+
+// Two data parts and a file part. The second part holds a near miss of the delimiter
+static std::string
+MakeBody(const std::string& p_file,size_t& p_fileOffset)
+{
+  std::string delimiter = std::string("--") + boundary;
+  std::string body;
+  body  = delimiter + "\r\n";
+  body += "Content-Disposition: form-data; name=\"one\"\r\n\r\n";
+  body += "first value\r\n";
+  body += delimiter + "\r\n";
+  body += "Content-Disposition: form-data; name=\"two\"\r\n\r\n";
+  body += "second value\r\n--MarlinBoundar almost\r\n";
+  body += delimiter + "\r\n";
+  body += "Content-Disposition: form-data; name=\"file\"; filename=\"stream.bin\"\r\n";
+  body += "Content-Type: application/octet-stream\r\n\r\n";
+  p_fileOffset = body.size();
+  body += p_file;
+  body += "\r\n" + delimiter + "--\r\n";
+  return body;
+}
+
+// Stream the body in two blocks, split at this offset
+static bool
+StreamSplit(const std::string& p_body,size_t p_split,const std::string& p_file)
+{
+  XString contentType;
+  contentType.Format(_T("multipart/form-data; boundary=%s"),XString(boundary).GetString());
+
+  std::string file;
+  MultiPartBuffer buffer(FormDataType::FD_MULTIPART);
+  if(!buffer.StartStreaming(contentType,_T(""),CollectFileData,&file))
+  {
+    return false;
+  }
+  const uchar* data = reinterpret_cast<const uchar*>(p_body.c_str());
+  if(!buffer.StreamBuffer(data,p_split) ||
+     !buffer.StreamBuffer(data + p_split,p_body.size() - p_split) ||
+     !buffer.EndStreaming())
+  {
+    return false;
+  }
+  MultiPart* one = buffer.GetPart(_T("one"));
+  MultiPart* two = buffer.GetPart(_T("two"));
+  return buffer.GetParts() == 3 &&
+         one && one->GetData() == _T("first value") &&
+         two && two->GetData() == _T("second value\r\n--MarlinBoundar almost") &&
+         file == p_file;
+}
+
+int
+TestMultiPartStream(void)
+{
+  int errors = 0;
+
+  xprintf(_T("TESTING THE STREAMING MULTIPART PARSER\n"));
+  xprintf(_T("======================================\n"));
+
+  // Every split of a small body: all delimiters straddle the two blocks once
+  size_t offset = 0;
+  std::string file("Contents of a small file\r\n--Marlin");
+  std::string body = MakeBody(file,offset);
+  for(size_t split = 0; split <= body.size(); ++split)
+  {
+    if(!StreamSplit(body,split,file))
+    {
+      xprintf(_T("Multipart stream failed when split at offset: %d\n"),(int)split);
+      ++errors;
+    }
+  }
+
+  // Closing delimiter around the edge of the first scanning window
+  // The window holds the scan size plus the delimiter, and starts with a CR-LF
+  size_t delimiter = strlen(boundary) + 4;
+  size_t edge      = MULTIPART_SCAN_SIZE + delimiter - 2;
+  MakeBody("",offset);
+  for(size_t end = edge - delimiter - 8; end <= edge + 8; ++end)
+  {
+    std::string large(end - offset,'x');
+    std::string window = MakeBody(large,offset);
+    if(!StreamSplit(window,window.size(),large))
+    {
+      xprintf(_T("Multipart stream failed with delimiter at window offset: %d\n"),(int)end);
+      ++errors;
+    }
+  }
+
+  // SUMMARY OF THE TEST
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Multipart boundaries split over received blocks: %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
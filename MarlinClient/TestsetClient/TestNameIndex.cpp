@@ -0,0 +1,266 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestNameIndex.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "XMLMessage.h"
+#include "JSONMessage.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Wide documents: one node with many children
+const int WIDE_CHILDREN = 2000;
+// Deep documents: a chain of nodes, each with a few leafs
+const int DEEP_LEVELS   = 200;
+const int DEEP_LEAFS    = 40;
+// Lookups per measurement
+const int INDEX_ROUNDS  = 100000;
+
+static double
+Nanoseconds(LARGE_INTEGER& p_start,LARGE_INTEGER& p_stop,int p_rounds)
+{
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return (double)(p_stop.QuadPart - p_start.QuadPart) * 1000000000.0 / (double)frequency.QuadPart / p_rounds;
+}
+
+static void
+BuildWideXML(XMLMessage& p_msg)
+{
+  XMLElement* wide = p_msg.AddElement(nullptr,_T("Wide"),XDT_String,_T(""));
+  for(int index = 0; index < WIDE_CHILDREN; ++index)
+  {
+    XString name;
+    name.Format(_T("Child%d"),index);
+    p_msg.AddElement(wide,name,XDT_Integer,name);
+  }
+  // Duplicate names must be found in document order
+  p_msg.AddElement(wide,_T("Double"),XDT_String,_T("first"));
+  p_msg.AddElement(wide,_T("ns:Double"),XDT_String,_T("second"));
+}
+
+static void
+BuildDeepXML(XMLMessage& p_msg)
+{
+  XMLElement* node = nullptr;
+  for(int level = 0; level < DEEP_LEVELS; ++level)
+  {
+    for(int leaf = 0; leaf < DEEP_LEAFS; ++leaf)
+    {
+      XString name;
+      name.Format(_T("Leaf%d"),leaf);
+      p_msg.AddElement(node,name,XDT_String,name);
+    }
+    XString name;
+    name.Format(_T("Level%d"),level);
+    node = p_msg.AddElement(node,name,XDT_String,_T(""));
+  }
+  p_msg.AddElement(node,_T("Bottom"),XDT_String,_T("bottom"));
+}
+
+static void
+BuildWideJSON(JSONvalue& p_value)
+{
+  p_value.SetDatatype(JsonType::JDT_object);
+  for(int index = 0; index < WIDE_CHILDREN; ++index)
+  {
+    XString name;
+    name.Format(_T("Child%d"),index);
+    JSONpair pair(name,index);
+    p_value.Add(pair);
+  }
+  JSONpair first(_T("Double"),_T("first"));
+  JSONpair second(_T("Double"),12);
+  p_value.Add(first);
+  p_value.Add(second);
+}
+
+// Indexed lookups must find exactly what a linear scan finds
+static int
+TestNameIndexLookups()
+{
+  int errors = 0;
+
+  XMLMessage xml;
+  BuildWideXML(xml);
+  XMLElement* wide = xml.FindElement(_T("Wide"));
+  if(xml.GetElement(wide,_T("Child1999")) != _T("Child1999") ||
+     xml.GetElement(wide,_T("Child2000")) != _T("")          ||
+     xml.GetElement(wide,_T("Double"))    != _T("first")     ||
+     xml.FindElement(wide,_T("ns:Double"),false)->GetValue() != _T("second"))
+  {
+    xprintf(_T("Indexed XML lookup of a wide node failed\n"));
+    ++errors;
+  }
+  // Changing the children invalidates the index
+  xml.DeleteElement(wide,_T("Double"));
+  xml.FindElement(wide,_T("Child5"),false)->SetName(_T("Renamed"));
+  if(xml.GetElement(wide,_T("Double"))  != _T("second")  ||
+     xml.GetElement(wide,_T("Renamed")) != _T("Child5")  ||
+     xml.GetElement(wide,_T("Child5"))  != _T(""))
+  {
+    xprintf(_T("XML name index not invalidated by a change\n"));
+    ++errors;
+  }
+  // Looking up while appending, as SetElement and SetParameter do
+  XMLElement* build = xml.AddElement(nullptr,_T("Build"),XDT_String,_T(""));
+  for(int index = 0; index < WIDE_CHILDREN; ++index)
+  {
+    XString name;
+    name.Format(_T("Param%d"),index);
+    xml.SetElement(build,name,XDT_Integer,name);
+  }
+  if(build->GetChildren().size() != WIDE_CHILDREN ||
+     xml.GetElement(build,_T("Param0"))    != _T("Param0") ||
+     xml.GetElement(build,_T("Param1999")) != _T("Param1999"))
+  {
+    xprintf(_T("XML name index not extended by appending children\n"));
+    ++errors;
+  }
+  // A child without this parent can be renamed without telling the index
+  XMLElement* stranger = new XMLElement();
+  stranger->SetName(_T("Stranger"));
+  build->GetChildren().push_back(stranger);
+  xml.GetElement(build,_T("Stranger"));
+  stranger->SetName(_T("Known"));
+  if(xml.GetElement(build,_T("Stranger")) != _T("") || xml.FindElement(build,_T("Known"),false) != stranger)
+  {
+    xprintf(_T("XML name index misses a renamed child\n"));
+    ++errors;
+  }
+
+  XMLMessage deep;
+  BuildDeepXML(deep);
+  XMLElement* bottom = deep.FindElement(_T("Bottom"));
+  if(bottom == nullptr || bottom->GetValue() != _T("bottom"))
+  {
+    xprintf(_T("Recursive XML lookup in a deep document failed\n"));
+    ++errors;
+  }
+
+  JSONMessage json;
+  BuildWideJSON(json.GetValue());
+  JsonType number = JsonType::JDT_number_int;
+  JSONvalue* twelve = json.FindValue(_T("Double"),false,false,&number);
+  JSONpair*  double1 = json.FindPair(_T("Double"),false);
+  if(json.GetValue()[_T("Child1999")].GetNumberInt() != 1999 ||
+     json.FindPair(_T("Child2000")) != nullptr ||
+     twelve  == nullptr || twelve->GetNumberInt() != 12 ||
+     double1 == nullptr || double1->m_value.GetString() != _T("first"))
+  {
+    xprintf(_T("Indexed JSON lookup of a wide object failed\n"));
+    ++errors;
+  }
+  return errors;
+}
+
+// Repeated lookups of the last children of a wide node, and of the bottom of a deep document
+static void
+BenchmarkNameIndex()
+{
+  size_t total = 0;
+  LARGE_INTEGER start,middle,stop;
+
+  XMLMessage xml;
+  BuildWideXML(xml);
+  XMLElement* wide = xml.FindElement(_T("Wide"));
+
+  // Baseline: what every lookup did before the index
+  QueryPerformanceCounter(&start);
+  for(int round = 0; round < INDEX_ROUNDS / 100; ++round)
+  {
+    for(auto& element : wide->GetChildren())
+    {
+      if(element->GetName().Compare(_T("Child1999")) == 0)
+      {
+        total += element->GetValue().GetLength();
+        break;
+      }
+    }
+  }
+  QueryPerformanceCounter(&middle);
+  for(int round = 0; round < INDEX_ROUNDS; ++round)
+  {
+    total += xml.GetElement(wide,_T("Child1999")).GetLength();
+  }
+  QueryPerformanceCounter(&stop);
+  // --- "--------------------------- - ------\n"
+  _tprintf(_T("XML wide node linear scan   : %.0f ns\n"),Nanoseconds(start,middle,INDEX_ROUNDS / 100));
+  _tprintf(_T("XML wide node name index    : %.0f ns\n"),Nanoseconds(middle,stop,INDEX_ROUNDS));
+
+  XMLMessage deep;
+  BuildDeepXML(deep);
+  QueryPerformanceCounter(&start);
+  for(int round = 0; round < INDEX_ROUNDS / 100; ++round)
+  {
+    XMLElement* bottom = deep.FindElement(_T("Bottom"));
+    total += bottom ? 1 : 0;
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("XML deep document find      : %.0f ns\n"),Nanoseconds(start,stop,INDEX_ROUNDS / 100));
+
+  JSONMessage json;
+  BuildWideJSON(json.GetValue());
+  QueryPerformanceCounter(&start);
+  for(int round = 0; round < INDEX_ROUNDS; ++round)
+  {
+    total += json.GetValue()[_T("Child1999")].GetNumberInt();
+  }
+  QueryPerformanceCounter(&middle);
+  for(int round = 0; round < INDEX_ROUNDS; ++round)
+  {
+    JSONpair* pair = json.FindPair(_T("Child1999"));
+    total += pair ? 1 : 0;
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("JSON wide object index      : %.0f ns\n"),Nanoseconds(start,middle,INDEX_ROUNDS));
+  _tprintf(_T("JSON wide object find pair  : %.0f ns\n"),Nanoseconds(middle,stop,INDEX_ROUNDS));
+
+  // Keep the optimizer from removing the loops
+  if(total == 0)
+  {
+    _tprintf(_T("Nothing found!\n"));
+  }
+}
+
+int
+TestNameIndex(void)
+{
+  xprintf(_T("TESTING NAME INDEX OF LARGE XML AND JSON NODES\n"));
+  xprintf(_T("==============================================\n"));
+
+  int errors = TestNameIndexLookups();
+  BenchmarkNameIndex();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Name index of wide XML/JSON nodes              : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
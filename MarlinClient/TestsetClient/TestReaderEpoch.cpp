@@ -0,0 +1,156 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestReaderEpoch.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "ReaderEpoch.h"
+#include <process.h>
+#include <vector>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Readers keep looking at the published snapshot, while the writer
+// publishes new ones and retires the old ones after WaitForReaders.
+// A reader must never see a snapshot that has already been retired.
+const int EPOCH_READERS   = 4;
+const int EPOCH_PUBLISHES = 2000;
+const int EPOCH_ALIVE     = 0x5AFE;
+const int EPOCH_RETIRED   = 0xDEAD;
+
+typedef struct _epochSnapshot
+{
+  volatile int m_state { EPOCH_ALIVE };
+  int          m_value { 0 };
+}
+EpochSnapshot;
+
+static ReaderEpoch              g_epoch;
+static EpochSnapshot* volatile  g_snapshot { nullptr };
+static volatile bool            g_reading  { false   };
+static volatile long            g_retired  { 0       };
+
+static unsigned int __stdcall EpochReader(void* /*p_context*/)
+{
+  while(g_reading)
+  {
+    AutoReaderEpoch reader(g_epoch);
+    EpochSnapshot* snapshot = g_snapshot;
+    for(int look = 0; look < 10; ++look)
+    {
+      if(snapshot->m_state != EPOCH_ALIVE)
+      {
+        InterlockedIncrement(&g_retired);
+      }
+    }
+  }
+  return 0;
+}
+
+// Retired snapshots are kept (not deleted) so a late reader shows up as an error
+static int
+TestReaderEpochRetire()
+{
+  std::vector<EpochSnapshot*> retired;
+  g_snapshot = new EpochSnapshot();
+  g_reading  = true;
+  g_retired  = 0;
+
+  std::vector<HANDLE> threads;
+  for(int ind = 0; ind < EPOCH_READERS; ++ind)
+  {
+    unsigned int threadID = 0;
+    HANDLE thread = reinterpret_cast<HANDLE>(_beginthreadex(NULL,0,EpochReader,NULL,0,&threadID));
+    if(thread && thread != INVALID_HANDLE_VALUE)
+    {
+      threads.push_back(thread);
+    }
+  }
+  for(int publish = 1; publish <= EPOCH_PUBLISHES; ++publish)
+  {
+    EpochSnapshot* snapshot = new EpochSnapshot();
+    snapshot->m_value = publish;
+    EpochSnapshot* old = reinterpret_cast<EpochSnapshot*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(&g_snapshot),snapshot));
+    g_epoch.WaitForReaders();
+    old->m_state = EPOCH_RETIRED;
+    retired.push_back(old);
+  }
+  g_reading = false;
+  for(auto& thread : threads)
+  {
+    WaitForSingleObject(thread,INFINITE);
+    CloseHandle(thread);
+  }
+  for(auto& snapshot : retired)
+  {
+    delete snapshot;
+  }
+  delete g_snapshot;
+  g_snapshot = nullptr;
+
+  if(threads.empty() || g_retired > 0)
+  {
+    xprintf(_T("Readers saw %d retired snapshots with %d reader threads\n"),(int)g_retired,(int)threads.size());
+    return 1;
+  }
+  return 0;
+}
+
+// A reader that leaves by an exception does not keep the writer waiting
+static int
+TestReaderEpochException()
+{
+  ReaderEpoch epoch;
+  try
+  {
+    AutoReaderEpoch reader(epoch);
+    throw StdException(_T("Leaving the reader"));
+  }
+  catch(StdException& /*ex*/)
+  {
+  }
+  // Would wait forever if the reader was not left
+  epoch.WaitForReaders();
+  return 0;
+}
+
+int
+TestReaderEpoch(void)
+{
+  xprintf(_T("TESTING RETIRING SNAPSHOTS BY READER EPOCH\n"));
+  xprintf(_T("==========================================\n"));
+
+  int errors = TestReaderEpochRetire();
+  errors += TestReaderEpochException();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Reader epoch retires snapshots after readers   : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
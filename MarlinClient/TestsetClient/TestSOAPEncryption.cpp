@@ -0,0 +1,227 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestSOAPEncryption.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "SOAPMessage.h"
+#include "Crypto.h"
+#include "CryptoAES.h"
+#include <wincrypt.h>
+#include <process.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+static LPCTSTR soapPassword = _T("ForEverSweet16");
+
+// Messages per thread in the benchmark
+const int SOAP_ROUNDS    = 2000;
+const int SOAP_THREADS[] = { 1, 2, 4, 8 };
+
+// Decrypt the way Crypto did before: through the CryptoAPI provider
+// Proves that the cached keys and the bulk path are still wire compatible
+static bool
+ProviderDecryption(const std::vector<BYTE>& p_encrypted,XString p_password,std::vector<BYTE>& p_output)
+{
+  HCRYPTPROV provider = NULL;
+  HCRYPTHASH hash     = NULL;
+  HCRYPTKEY  key      = NULL;
+  bool       result   = false;
+
+  p_output = p_encrypted;
+  DWORD length = (DWORD)p_output.size();
+
+  if(CryptAcquireContext(&provider,NULL,MS_ENH_RSA_AES_PROV,PROV_RSA_AES,CRYPT_VERIFYCONTEXT | CRYPT_MACHINE_KEYSET) &&
+     CryptCreateHash(provider,CALG_SHA_256,0,0,&hash) &&
+     CryptHashData(hash,reinterpret_cast<const BYTE*>(p_password.GetString()),p_password.GetLength() * sizeof(TCHAR),0) &&
+     CryptDeriveKey(provider,CALG_AES_256,hash,0,&key) &&
+     CryptDecrypt(key,NULL,TRUE,0,p_output.data(),&length))
+  {
+    p_output.resize(length);
+    result = true;
+  }
+  if(key)
+  {
+    CryptDestroyKey(key);
+  }
+  if(hash)
+  {
+    CryptDestroyHash(hash);
+  }
+  if(provider)
+  {
+    CryptReleaseContext(provider,0);
+  }
+  return result;
+}
+
+static int
+TestAESKnownAnswers()
+{
+  int errors = 0;
+
+  // FIPS-197 appendix C.3: AES-256. CBC with a zero IV is ECB for the first block
+  BYTE key[32];
+  BYTE plain[16];
+  for(int index = 0; index < 32; ++index)
+  {
+    key[index] = (BYTE)index;
+  }
+  for(int index = 0; index < 16; ++index)
+  {
+    plain[index] = (BYTE)(index * 0x11);
+  }
+  static const BYTE expected[16] = { 0x8e,0xa2,0xb7,0xca,0x51,0x67,0x45,0xbf,0xea,0xfc,0x49,0x90,0x4b,0x49,0x60,0x89 };
+
+  for(int pass = 0; pass < 2; ++pass)
+  {
+    bool accelerated = CryptoAES::GetAcceleration();
+    AESKey schedule;
+    std::vector<BYTE> encrypted;
+    std::vector<BYTE> decrypted;
+    CryptoAES::SetKey(key,sizeof(key),schedule);
+    CryptoAES::Encrypt(schedule,plain,sizeof(plain),encrypted);
+    if(encrypted.size() != 32 || memcmp(encrypted.data(),expected,16) != 0 ||
+       !CryptoAES::Decrypt(schedule,encrypted.data(),encrypted.size(),decrypted) ||
+       decrypted.size() != 16 || memcmp(decrypted.data(),plain,16) != 0)
+    {
+      xprintf(_T("AES-256 known answer failed. AES instructions: %s\n"),accelerated ? _T("yes") : _T("no"));
+      ++errors;
+    }
+    // Second pass on the portable path
+    if(!accelerated)
+    {
+      break;
+    }
+    CryptoAES::SetAcceleration(false);
+  }
+  CryptoAES::SetAcceleration(true);
+
+  // Strings through Crypto, and compatible with the crypto provider
+  XString body(_T("<Parameters><One>ABC</One><Two>1-2-3</Two><Text>Some more text for a few blocks</Text></Parameters>"));
+  Crypto crypt;
+  XString encoded = crypt.Encryption(body,soapPassword);
+  XString decoded = crypt.Decryption(encoded,soapPassword);
+
+  std::vector<BYTE> encrypted;
+  std::vector<BYTE> provider;
+  crypt.Encryption(reinterpret_cast<const BYTE*>(body.GetString()),body.GetLength() * sizeof(TCHAR),soapPassword,encrypted);
+  if(decoded != body || !ProviderDecryption(encrypted,soapPassword,provider) ||
+     provider.size() != body.GetLength() * sizeof(TCHAR) ||
+     memcmp(provider.data(),body.GetString(),provider.size()) != 0)
+  {
+    xprintf(_T("Encryption not compatible with the crypto provider\n"));
+    ++errors;
+  }
+  // Wrong password must not give a result
+  if(crypt.Decryption(encoded,_T("WrongPassword")) == body)
+  {
+    xprintf(_T("Decrypted with the wrong password\n"));
+    ++errors;
+  }
+  return errors;
+}
+
+// Build, encrypt and decrypt a SOAP message body, as client and server do
+static unsigned __stdcall
+SOAPThread(void* /*p_argument*/)
+{
+  XString namesp(_T("http://interface.marlin.org/testing/"));
+  XString action(_T("TestMessageEncrypt"));
+
+  for(int round = 0; round < SOAP_ROUNDS; ++round)
+  {
+    SOAPMessage msg(namesp,action,SoapVersion::SOAP_12);
+    for(int param = 0; param < 20; ++param)
+    {
+      XString name;
+      name.Format(_T("Parameter%d"),param);
+      msg.SetParameter(name,_T("Some text of a parameter to be encrypted"));
+    }
+    msg.SetSecurityLevel(XMLEncryption::XENC_Body);
+    msg.SetSecurityPassword(soapPassword);
+    msg.GetSoapMessage();
+
+    XMLElement* cypher = msg.FindElement(_T("CypherValue"));
+    if(cypher)
+    {
+      Crypto crypt;
+      crypt.Decryption(cypher->GetValue(),soapPassword);
+    }
+  }
+  return 0;
+}
+
+static void
+BenchmarkSOAPEncryption()
+{
+  LARGE_INTEGER frequency,start,stop;
+  QueryPerformanceFrequency(&frequency);
+
+  _tprintf(_T("AES instructions of processor: %s\n"),CryptoAES::GetAcceleration() ? _T("yes") : _T("no"));
+  for(auto number : SOAP_THREADS)
+  {
+    std::vector<HANDLE> threads;
+    QueryPerformanceCounter(&start);
+    for(int index = 0; index < number; ++index)
+    {
+      HANDLE thread = (HANDLE)_beginthreadex(nullptr,0,SOAPThread,nullptr,0,nullptr);
+      if(thread)
+      {
+        threads.push_back(thread);
+      }
+    }
+    for(auto& thread : threads)
+    {
+      WaitForSingleObject(thread,INFINITE);
+      CloseHandle(thread);
+    }
+    QueryPerformanceCounter(&stop);
+
+    double seconds = (double)(stop.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+    double rate    = seconds > 0.0 ? (double)number * SOAP_ROUNDS / seconds : 0.0;
+    // --- "--------------------------- - ------\n"
+    _tprintf(_T("Encrypted SOAP %d threads    : %.0f messages/sec\n"),number,rate);
+  }
+}
+
+int
+TestSOAPEncryption(void)
+{
+  xprintf(_T("TESTING BULK AES ENCRYPTION OF SOAP MESSAGES\n"));
+  xprintf(_T("============================================\n"));
+
+  int errors = TestAESKnownAnswers();
+  BenchmarkSOAPEncryption();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("AES-256 bulk encryption with cached keys       : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
@@ -0,0 +1,165 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestURLView.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include "CrackURL.h"
+#include "URLView.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Typical REST calls to our services
+static LPCTSTR urls[] =
+{
+   _T("http://localhost:1200/MarlinTest/Data?test=2&size=medium+large")
+  ,_T("https://api.example.com/v1/customers/12345/orders?page=2&pageSize=50&sort=date#top")
+  ,_T("http://server.example.com:8080/api/v2/products/ABC-123/stock.json")
+  ,_T("https://login.example.com/common/oauth2/v2.0/token?grant_type=client_credentials&scope=api%3A%2F%2Fservice")
+};
+
+// URLView must find the same parts as the CrackedURL
+static int
+TestURLViewParts()
+{
+  int errors = 0;
+
+  for(auto url : urls)
+  {
+    CrackedURL cracked(url);
+    CrackedURL viewed;
+    URLView    view(url);
+    view.ToCrackedURL(viewed);
+
+    bool same = cracked.m_valid     == viewed.m_valid     &&
+                cracked.m_secure    == viewed.m_secure    &&
+                cracked.m_host      == viewed.m_host      &&
+                cracked.m_port      == viewed.m_port      &&
+                cracked.m_path      == viewed.m_path      &&
+                cracked.m_extension == viewed.m_extension &&
+                cracked.m_anchor    == viewed.m_anchor    &&
+                cracked.GetParameterCount() == viewed.GetParameterCount();
+    for(unsigned index = 0; same && index < cracked.GetParameterCount(); ++index)
+    {
+      same = cracked.GetParameter(index)->m_key   == viewed.GetParameter(index)->m_key &&
+             cracked.GetParameter(index)->m_value == viewed.GetParameter(index)->m_value;
+    }
+    if(!same)
+    {
+      xprintf(_T("URLView differs from CrackedURL: %s\n"),url);
+      ++errors;
+    }
+  }
+
+  // Setting parts rebuilds the URL only once
+  URLView view(_T("http://localhost/MarlinTest/Data?one=1&two=2"));
+  view.SetSecure(true);
+  view.SetPort(1201);
+  view.SetParameter(_T("three"),_T("3 4"));
+  if(view.URL() != _T("https://localhost:1201/MarlinTest/Data?one=1&two=2&three=3+4") ||
+     view.GetParameter(_T("THREE")) != _T("3 4"))
+  {
+    xprintf(_T("URLView not correctly rebuilt: %s\n"),view.URL().GetString());
+    ++errors;
+  }
+
+  // Scheme and default port go together
+  URLView plain(_T("https://localhost/MarlinTest/Data"));
+  plain.SetSecure(false);
+  URLView other(_T("https://localhost:1201/MarlinTest/Data"));
+  other.SetSecure(false);
+  if(plain.URL() != _T("http://localhost/MarlinTest/Data") ||
+     other.URL() != _T("http://localhost:1201/MarlinTest/Data"))
+  {
+    xprintf(_T("URLView not correctly made unsecure: %s\n"),plain.URL().GetString());
+    ++errors;
+  }
+
+  // Only paths that CrackedURL would change are not plain
+  if(!URLView(urls[1]).PlainPath() ||
+      URLView(_T("http://localhost/Marlin Test/Data")).PlainPath() ||
+      URLView(_T("http://localhost/MarlinTest//Data")).PlainPath())
+  {
+    xprintf(_T("URLView plain paths not recognized\n"));
+    ++errors;
+  }
+  return errors;
+}
+
+// Cracking a URL and reading two parameters: the work of every request
+static void
+BenchmarkURL()
+{
+  const int rounds = 100000;
+  LARGE_INTEGER frequency,start,middle,stop;
+  QueryPerformanceFrequency(&frequency);
+  size_t total = 0;
+
+  QueryPerformanceCounter(&start);
+  for(int round = 0; round < rounds; ++round)
+  {
+    CrackedURL cracked(urls[round % 4]);
+    total += cracked.GetParameter(_T("page")).GetLength();
+    total += cracked.m_path.GetLength();
+  }
+  QueryPerformanceCounter(&middle);
+  for(int round = 0; round < rounds; ++round)
+  {
+    URLView view(urls[round % 4]);
+    total += view.GetParameter(_T("page")).GetLength();
+    total += view.GetPath().GetLength();
+  }
+  QueryPerformanceCounter(&stop);
+
+  double cracked = (double)(middle.QuadPart - start.QuadPart)  * 1000000000.0 / (double)frequency.QuadPart / rounds;
+  double viewed  = (double)(stop.QuadPart   - middle.QuadPart) * 1000000000.0 / (double)frequency.QuadPart / rounds;
+  // --- "--------------------------- - ------\n"
+  _tprintf(_T("CrackedURL per REST URL     : %.0f ns\n"),cracked);
+  _tprintf(_T("URLView    per REST URL     : %.0f ns\n"),viewed);
+  // Keep the optimizer from removing the loops
+  if(total == 0)
+  {
+    _tprintf(_T("Nothing cracked!\n"));
+  }
+}
+
+int
+TestURLView(void)
+{
+  xprintf(_T("TESTING URLVIEW AGAINST CRACKEDURL\n"));
+  xprintf(_T("==================================\n"));
+
+  int errors = TestURLViewParts();
+  BenchmarkURL();
+
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("URLView lazy parts and parameters              : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
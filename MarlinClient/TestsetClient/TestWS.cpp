@@ -316,6 +316,90 @@ TestReliableMessaging(HTTPClient* p_client,XString p_namespace,XString p_action,
   return (totalDone == NUM_RM_TESTS) ? 0 : 1;
 }
 
+// Send a series of RM messages with a sending window. Returns messages per second or 0.0 on errors
+static double
+SendReliableWindow(HTTPClient* p_client,XString p_namespace,XString p_action,XString p_url,int p_window,int& p_errors)
+{
+  WebServiceClient client(p_namespace,p_url,_T(""),true);
+  client.SetHTTPClient(p_client);
+  client.SetLogAnalysis(p_client->GetLogging());
+  client.SetReliable(true,ReliableType::RELIABLE_ATLEAST1);
+  client.SetWindowSize(p_window);
+
+  SOAPMessages messages;
+  for(int ind = 0; ind < NUM_RM_WINDOW_TESTS; ++ind)
+  {
+    messages.push_back(CreateSoapMessage(p_namespace,p_action,p_url));
+  }
+
+  double rate = 0.0;
+  try
+  {
+    // Client must be opened for RM protocol
+    client.Open();
+
+    LARGE_INTEGER frequency,start,stop;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+    bool sent = client.SendWindow(messages);
+    QueryPerformanceCounter(&stop);
+
+    if(sent)
+    {
+      double seconds = (double)(stop.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+      rate = seconds > 0.0 ? (double)NUM_RM_WINDOW_TESTS / seconds : 0.0;
+    }
+    else
+    {
+      ++p_errors;
+      _tprintf(_T("Error code WebServiceClient: %s\n"),client.GetErrorText().GetString());
+    }
+    // Every message must have gotten its own answer
+    for(auto& message : messages)
+    {
+      if(message->GetParameter(_T("Three")) != _T("DEF") || message->GetParameterInteger(_T("Four")) != 123)
+      {
+        ++p_errors;
+        rate = 0.0;
+        _tprintf(_T("Answer with fault: %s\n"),message->GetFault().GetString());
+        break;
+      }
+    }
+    // Must be closed to complete RM protocol
+    client.Close();
+  }
+  catch(StdException& error)
+  {
+    ++p_errors;
+    rate = 0.0;
+    _tprintf(_T("ERROR received      : %s\n"),error.GetErrorMessage().GetString());
+    _tprintf(_T("ERROR from WS Client: %s\n"),client.GetErrorText().GetString());
+  }
+  for(auto& message : messages)
+  {
+    delete message;
+  }
+  return rate;
+}
+
+// Benchmark of the sending window against a reliable site with injected latency
+int
+TestReliableWindow(HTTPClient* p_client,XString p_namespace,XString p_action,XString p_url)
+{
+  int errors = 0;
+
+  double single = SendReliableWindow(p_client,p_namespace,p_action,p_url,1,errors);
+  double window = SendReliableWindow(p_client,p_namespace,p_action,p_url,NUM_RM_WINDOW_SIZE,errors);
+
+  // SUMMARY OF THE TEST
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("WS-RM window  1 message  in flight : %6.1f msg/sec\n"),single);
+  _tprintf(_T("WS-RM window %2d messages in flight : %6.1f msg/sec\n"),NUM_RM_WINDOW_SIZE,window);
+  _tprintf(_T("Send: SOAP WS-ReliableMessaging sending window : %s\n"),errors ? _T("ERROR") : _T("OK"));
+
+  return errors;
+}
+
 int
 DoSendByQueue(HTTPClient& p_client,XString p_namespace,XString p_action,XString p_url)
 {
@@ -422,6 +506,12 @@ int TestWebservices(HTTPClient& client)
   url = CreateURL(_T("ReliableBA"));
   errors += TestReliableMessaging(&client,namesp,command,url,true);
 
+  // Test 6b
+  xprintf(_T("TESTING RELIABLE MESSAGING WINDOW TO /MarlinTest/ReliableWindow/\n"));
+  xprintf(_T("===============================================================\n"));
+  url = CreateURL(_T("ReliableWindow"));
+  errors += TestReliableWindow(&client,namesp,command,url);
+
   // Test 7
   xprintf(_T("TESTING THE TOKEN FUNCTION TO /MarlinTest/TestToken/\n"));
   xprintf(_T("====================================================\n"));
@@ -0,0 +1,85 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestZipSite.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestClient.h"
+#include <string>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Get one resource from the site that is served from a ZIP archive
+static bool
+GetFromZipSite(HTTPClient* p_client,XString p_resource,std::string& p_body)
+{
+  XString url;
+  url.Format(_T("http://%s:%d/MarlinTest/Zip/%s"),MARLIN_HOST,TESTING_HTTP_PORT,p_resource.GetString());
+  HTTPMessage msg(HTTPCommand::http_get,url);
+
+  if(!p_client->Send(&msg) || msg.GetStatus() != HTTP_STATUS_OK)
+  {
+    xprintf(_T("ERROR Client received status [%d] for: %s\n"),msg.GetStatus(),url.GetString());
+    return false;
+  }
+  uchar* body   = nullptr;
+  size_t length = 0;
+  if(!msg.GetFileBuffer()->GetBufferCopy(body,length))
+  {
+    return false;
+  }
+  p_body.assign(reinterpret_cast<const char*>(body),length);
+  delete [] body;
+  return true;
+}
+
+int
+TestZipSite(HTTPClient* p_client)
+{
+  int errors = 0;
+  xprintf(_T("TESTING GET FROM A SITE IN A ZIP ARCHIVE /MarlinTest/Zip/\n"));
+  xprintf(_T("=========================================================\n"));
+
+  // Stored entry, straight from the mapped archive
+  std::string body;
+  if(!GetFromZipSite(p_client,_T("index.html"),body) || body != "<html><body>Marlin from ZIP</body></html>")
+  {
+    ++errors;
+  }
+  // Deflated entry larger than the cache of the site
+  if(!GetFromZipSite(p_client,_T("big.css"),body) || body.size() != 4000 * 28 || body.compare(0,10,"div.marlin") != 0)
+  {
+    ++errors;
+  }
+
+  // SUMMARY OF THE TEST
+  // --- "---------------------------------------------- - ------
+  _tprintf(_T("Stored and inflated entries from a ZIP site    : %s\n"),errors ? _T("ERROR") : _T("OK"));
+  return errors;
+}
@@ -0,0 +1,202 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestCommandBus.cpp
+//
+// Marlin Server: Internet server/client
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "ThreadPool.h"
+#include "CommandBus.h"
+#include <process.h>
+#include <array>
+#include <utility>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Benchmark of the CommandBus: publishes per second from many publisher threads
+// to 1 up to 100 subscribers of one command. Every subscriber gets its own pool item
+// per command (direct), or one pool item drains all of its pending commands (batched).
+// Batched subscribers must see the commands of each publisher in order.
+
+static int totalChecks = 2;
+
+const int BUS_PUBLISHERS  =    8;   // Publisher threads
+const int BUS_PUBLISHES   = 1000;   // Commands per publisher thread
+const int BUS_SUBSCRIBERS =  100;   // Maximum number of subscribers
+const int BUS_ROUNDS[]    = { 1, 10, 100 };
+
+static volatile long g_delivered = 0;
+static volatile long g_disorder  = 0;
+static bool          g_ordered   = false;
+static long          g_lastCommand[BUS_SUBSCRIBERS][BUS_PUBLISHERS];
+
+// Argument of a command: publisher number and sequence number
+static void
+Delivered(int p_subscriber,void* p_argument)
+{
+  if(g_ordered)
+  {
+    INT_PTR argument  = reinterpret_cast<INT_PTR>(p_argument);
+    int     publisher = (int)(argument >> 24);
+    long    sequence  = (long)(argument & 0xFFFFFF);
+    if(sequence <= g_lastCommand[p_subscriber][publisher])
+    {
+      InterlockedIncrement(&g_disorder);
+    }
+    g_lastCommand[p_subscriber][publisher] = sequence;
+  }
+  InterlockedIncrement(&g_delivered);
+}
+
+// One distinct function per subscriber, as the bus subscribes functions
+template<int N>
+static void
+BusSubscriber(void* p_argument)
+{
+  Delivered(N,p_argument);
+}
+
+template<int... N>
+static std::array<LPFN_CALLBACK,sizeof...(N)>
+MakeSubscribers(std::integer_sequence<int,N...>)
+{
+  return {{ BusSubscriber<N>... }};
+}
+
+typedef struct _busPublisher
+{
+  CommandBus* m_bus;
+  int         m_command;
+  int         m_publisher;
+}
+BusPublisher;
+
+static unsigned __stdcall
+PublishCommands(void* p_publisher)
+{
+  BusPublisher* publisher = reinterpret_cast<BusPublisher*>(p_publisher);
+  for(INT_PTR sequence = 1; sequence <= BUS_PUBLISHES; ++sequence)
+  {
+    INT_PTR argument = ((INT_PTR)publisher->m_publisher << 24) | sequence;
+    publisher->m_bus->PublishCommand(publisher->m_command,reinterpret_cast<void*>(argument));
+  }
+  return 0;
+}
+
+// One round: returns the number of publishes per second
+static double
+BusRound(int p_subscribers,bool p_batched,bool& p_complete)
+{
+  static const auto subscribers = MakeSubscribers(std::make_integer_sequence<int,BUS_SUBSCRIBERS>());
+
+  ThreadPool pool(NUM_THREADS_MINIMUM,NUM_THREADS_MAXIMUM);
+  pool.Run();
+  CommandBus bus(_T("Benchmark"),&pool);
+
+  for(int index = 0; index < p_subscribers; ++index)
+  {
+    bus.SubscribeCommand(_T("Benchmark"),subscribers[index],nullptr,p_batched);
+  }
+  g_delivered = 0;
+  g_ordered   = p_batched;
+  ZeroMemory(g_lastCommand,sizeof(g_lastCommand));
+
+  BusPublisher publishers[BUS_PUBLISHERS];
+  HANDLE       threads   [BUS_PUBLISHERS];
+  int command = bus.GetCommandID(_T("Benchmark"));
+
+  LARGE_INTEGER frequency,start,stop;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&start);
+  for(int index = 0; index < BUS_PUBLISHERS; ++index)
+  {
+    publishers[index].m_bus       = &bus;
+    publishers[index].m_command   = command;
+    publishers[index].m_publisher = index;
+    threads[index] = (HANDLE)_beginthreadex(nullptr,0,PublishCommands,&publishers[index],0,nullptr);
+  }
+  WaitForMultipleObjects(BUS_PUBLISHERS,threads,TRUE,INFINITE);
+  QueryPerformanceCounter(&stop);
+  for(int index = 0; index < BUS_PUBLISHERS; ++index)
+  {
+    CloseHandle(threads[index]);
+  }
+
+  // Wait for all deliveries
+  long expected = (long)BUS_PUBLISHERS * BUS_PUBLISHES * p_subscribers;
+  for(int wait = 0; wait < 600 && g_delivered < expected; ++wait)
+  {
+    Sleep(100);
+  }
+  p_complete = p_complete && g_delivered == expected;
+
+  double seconds = (double)(stop.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+  return seconds > 0.0 ? (double)(BUS_PUBLISHERS * BUS_PUBLISHES) / seconds : 0.0;
+}
+
+int
+TestMarlinServer::TestCommandBus(bool p_standalone)
+{
+  // Only in our own process: not in an IIS application pool
+  if(!p_standalone)
+  {
+    totalChecks = 0;
+    return 0;
+  }
+  xprintf(_T("TESTING PUBLISHING RATE OF THE COMMANDBUS\n"));
+  xprintf(_T("=========================================\n"));
+
+  bool complete = true;
+  g_disorder = 0;
+  for(auto subscribers : BUS_ROUNDS)
+  {
+    double direct  = BusRound(subscribers,false,complete);
+    double batched = BusRound(subscribers,true, complete);
+    // --- "--------------------------- - ------\n"
+    qprintf(_T("CommandBus %3d subscribers  : %.0f direct %.0f batched publishes/sec\n"),subscribers,direct,batched);
+  }
+  if(complete)
+  {
+    --totalChecks;
+  }
+  if(g_disorder == 0)
+  {
+    --totalChecks;
+  }
+  return totalChecks;
+}
+
+int
+TestMarlinServer::AfterTestCommandBus()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("CommandBus publishing 1-100 subscribers        : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
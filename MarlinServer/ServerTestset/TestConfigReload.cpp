@@ -0,0 +1,257 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestConfigReload.cpp
+//
+// Marlin Server: Internet server/client
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "ConfigSnapshot.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Function test of the hot reloading of a config file.
+// A listener declares one of two keys as live. After both keys change on disk,
+// the watcher must publish a new version to the listener, hand it only the
+// live key and keep the other key for a restart.
+// Then the HTTPServer and an HTTPSite listen to a config file. Their settings
+// must follow the file, and revert to their defaults when the keys are removed.
+
+static int totalChecks = 6;
+
+const int RELOAD_WAIT  = 100;   // Milliseconds between looking for the new version
+const int RELOAD_TRIES = 100;   // Giving the watcher 10 seconds
+const int RELOAD_KEEPALIVE = 20000; // Event keep-alive that is not the default
+
+class ReloadListener : public ConfigListener
+{
+public:
+  void GetLiveConfigKeys(ConfigKeys& p_keys) override
+  {
+    p_keys.insert(_T("Test/Live"));
+  }
+  void ApplyConfig(ConfigSnapshot* p_snapshot,const ConfigKeys& p_changed) override
+  {
+    m_changed = p_changed;
+    m_other   = p_snapshot->GetParameterInteger(_T("Test"),_T("Other"),0);
+    m_version = p_snapshot->GetVersion();
+    m_value   = p_snapshot->GetParameterInteger(_T("Test"),_T("Live"),0);
+  }
+  ConfigKeys    m_changed;
+  int           m_other   { 0 };
+  long          m_version { 0 };
+  volatile int  m_value   { 0 };
+};
+
+static void
+WriteTestConfig(XString p_filename,int p_live,int p_other)
+{
+  MarlinConfig config(p_filename);
+  config.SetSection(_T("Test"));
+  config.SetParameter(_T("Test"),_T("Live"), p_live);
+  config.SetParameter(_T("Test"),_T("Other"),p_other);
+  config.WriteConfig();
+}
+
+// Settings for the server and the site, or the same file without them
+static void
+WriteListenerConfig(XString p_filename,bool p_settings)
+{
+  MarlinConfig config(p_filename);
+  config.SetSection(_T("Test"));
+  config.SetParameter(_T("Test"),_T("Settings"),p_settings);
+  if(p_settings)
+  {
+    config.SetParameter(_T("Server"),_T("HTTPCompression"),true);
+    config.SetParameter(_T("Server"),_T("EventKeepAlive"),RELOAD_KEEPALIVE);
+  }
+  else
+  {
+    config.RemoveParameter(_T("Server"),_T("HTTPCompression"));
+    config.RemoveParameter(_T("Server"),_T("EventKeepAlive"));
+  }
+  config.WriteConfig();
+}
+
+static void
+WaitForVersion(ConfigWatcher& p_watcher,long p_version)
+{
+  for(int tries = 0; tries < RELOAD_TRIES; ++tries)
+  {
+    if(p_watcher.GetAppliedVersion() >= p_version)
+    {
+      break;
+    }
+    Sleep(RELOAD_WAIT);
+  }
+}
+
+int
+TestMarlinServer::TestConfigReload(bool p_standalone)
+{
+  // Only in our own process: not in an IIS application pool
+  if(!p_standalone)
+  {
+    totalChecks = 0;
+    return 0;
+  }
+  xprintf(_T("TESTING HOT RELOADING OF A CONFIG FILE\n"));
+  xprintf(_T("======================================\n"));
+
+  XString filename = MarlinConfig::GetExePath() + _T("TestConfigReload.config");
+  DeleteFile(filename);
+  WriteTestConfig(filename,1,1);
+
+  ReloadListener listener;
+  ConfigWatcher  watcher;
+  watcher.AddListener(&listener);
+  if(watcher.StartWatching(filename))
+  {
+    // Change both keys on disk and wait for the watcher
+    WriteTestConfig(filename,2,2);
+    for(int tries = 0; tries < RELOAD_TRIES; ++tries)
+    {
+      if(watcher.GetAppliedVersion() >= 2)
+      {
+        break;
+      }
+      Sleep(RELOAD_WAIT);
+    }
+
+    // New version is handed to the listener
+    bool published = watcher.GetVersion() == 2 && listener.m_version == 2 && listener.m_other == 2;
+    // Only the live key is applied
+    bool applied = listener.m_value == 2 && listener.m_changed.size() == 1 &&
+                   listener.m_changed.find(_T("Test/Live")) != listener.m_changed.end();
+    // The other key waits for a restart
+    ConfigKeys restart = watcher.GetRestartKeys();
+    bool waiting = restart.size() == 1 && restart.find(_T("Test/Other")) != restart.end();
+    // Reading an unchanged file publishes nothing
+    bool unchanged = !watcher.Reload() && watcher.GetVersion() == 2;
+
+    // --- "--------------------------- - ------\n"
+    qprintf(_T("Config reload new version   : %s\n"),published ? _T("OK") : _T("ERROR"));
+    qprintf(_T("Config reload live key      : %s\n"),applied   ? _T("OK") : _T("ERROR"));
+    qprintf(_T("Config reload restart key   : %s\n"),waiting   ? _T("OK") : _T("ERROR"));
+    qprintf(_T("Config reload unchanged file: %s\n"),unchanged ? _T("OK") : _T("ERROR"));
+
+    for(bool check : { published, applied, waiting, unchanged })
+    {
+      if(check)
+      {
+        --totalChecks;
+      }
+    }
+
+    watcher.StopWatching();
+  }
+  else
+  {
+    xprintf(_T("Cannot start watching the config file: %s\n"),filename.GetString());
+  }
+  watcher.RemoveListener(&listener);
+  DeleteFile(filename);
+
+  TestConfigListeners();
+  return totalChecks;
+}
+
+// The HTTPServer and a site apply the keys of a reloaded file
+void
+TestMarlinServer::TestConfigListeners()
+{
+  XString url(_T("/MarlinTest/Reload/"));
+  HTTPSite* site = m_httpServer->CreateSite(PrefixType::URLPRE_Strong,false,m_inPortNumber,url);
+  if(site == nullptr || !site->StartSite())
+  {
+    xerror();
+    qprintf(_T("ERROR STARTING SITE: %s\n"),url.GetString());
+    return;
+  }
+  ConfigListener* server = m_httpServer;
+
+  XString filename = MarlinConfig::GetExePath() + _T("TestConfigListeners.config");
+  DeleteFile(filename);
+  WriteListenerConfig(filename,false);
+
+  ConfigWatcher watcher;
+  if(watcher.StartWatching(filename))
+  {
+    watcher.AddListener(server);
+    watcher.AddListener(site);
+
+    // Keys are added to the file
+    WriteListenerConfig(filename,true);
+    WaitForVersion(watcher,2);
+    bool applied  = site->GetHTTPCompression() &&
+                    m_httpServer->GetEventKeepAlive() == RELOAD_KEEPALIVE;
+
+    // Keys are removed again: back to the defaults
+    WriteListenerConfig(filename,false);
+    WaitForVersion(watcher,3);
+    bool reverted = !site->GetHTTPCompression() &&
+                    m_httpServer->GetEventKeepAlive() == DEFAULT_EVENT_KEEPALIVE;
+
+    watcher.StopWatching();
+    watcher.RemoveListener(site);
+    watcher.RemoveListener(server);
+
+    // Our server goes back to its own Marlin.config
+    ConfigSnapshot original(m_httpServer->GetWebConfig().GetFilename(),0);
+    ConfigKeys keys;
+    server->GetLiveConfigKeys(keys);
+    server->ApplyConfig(&original,keys);
+
+    // --- "--------------------------- - ------\n"
+    qprintf(_T("Config reload server + site : %s\n"),applied  ? _T("OK") : _T("ERROR"));
+    qprintf(_T("Config reload removed keys  : %s\n"),reverted ? _T("OK") : _T("ERROR"));
+
+    for(bool check : { applied, reverted })
+    {
+      if(check)
+      {
+        --totalChecks;
+      }
+    }
+  }
+  else
+  {
+    xprintf(_T("Cannot start watching the config file: %s\n"),filename.GetString());
+  }
+  m_httpServer->DeleteSite(m_inPortNumber,url);
+  DeleteFile(filename);
+}
+
+int
+TestMarlinServer::AfterTestConfigReload()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("Config file hot reloading to live listeners    : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
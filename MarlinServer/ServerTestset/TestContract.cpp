@@ -163,12 +163,18 @@ TestMarlinServer::OnMarlinFifth(int p_code,SOAPMessage* p_message)
   ASSERT(p_code == CONTRACT_MV);
   UNREFERENCED_PARAMETER(p_code);
 
-  XString pi;
-  XMLElement* pielem = p_message->FindElement(_T("PiApprox"));
-  if(pielem)
+  // Parameters resolved in one pass by the binding of the WSDL operation
+  // The id's are the same for all calls, so they are looked up once
+  // as soon as the binding of the operation has been registered
+  const SOAPBinding* binding = GetWSDLCache()->GetBinding(_T("MarlinFifth"));
+  static int piApprox = -1;
+  if(piApprox < 0 && binding)
   {
-    pi = pielem->GetValue();
+    piApprox = binding->GetParameterID(_T("Parameters/PiApprox"));
   }
+  SOAPParameters params(binding,p_message);
+
+  XString pi = params.GetParameter(piApprox);
   p_message->Reset(ResponseType::RESP_ACTION_NAME,m_targetNamespace);
 
   if(!pi.IsEmpty())
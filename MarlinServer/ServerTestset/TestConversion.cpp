@@ -0,0 +1,187 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestConversion.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "Stdafx.h"
+#include "TestMarlinServer.h"
+#include "ConvertWideString.h"
+#include "HPFCounter.h"
+#include <string>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+static int totalChecks = 4;
+
+// Body of the given size in UTF-8: mostly ASCII with some multi-byte chars
+static std::string
+MakeUTF8Body(size_t p_size)
+{
+  static const char* line = "{ \"name\": \"Caf\xC3\xA9 Gr\xC3\xBC\xC3\x9F" "e\", \"price\": \"12 \xE2\x82\xAC\", \"item\": \"abcdefghijklmnopqrstuvwxyz\" }\n";
+  std::string body;
+  body.reserve(p_size + 128);
+  while(body.size() < p_size)
+  {
+    body += line;
+  }
+  return body;
+}
+
+// The former way: always through the OS conversion
+static size_t
+ConvertByOS(const std::string& p_body,wchar_t* p_buffer)
+{
+  int length = MultiByteToWideChar(CP_UTF8,0,p_body.c_str(),-1,NULL,0);
+  if(length > 0)
+  {
+    length = MultiByteToWideChar(CP_UTF8,0,p_body.c_str(),-1,p_buffer,length);
+  }
+  return length > 0 ? (size_t)length - 1 : 0;
+}
+
+// The fast path (for UTF-8 always without the OS)
+static size_t
+ConvertFast(const std::string& p_body,wchar_t* p_buffer)
+{
+  size_t length = 0;
+#ifdef UNICODE
+  XString result;
+  bool foundBom = false;
+  if(TryConvertNarrowString(reinterpret_cast<const BYTE*>(p_body.c_str()),(int)p_body.size(),_T("utf-8"),result,foundBom))
+  {
+    length = (size_t)result.GetLength();
+    memcpy(p_buffer,result.GetString(),length * sizeof(wchar_t));
+  }
+#else
+  BYTE* buffer = nullptr;
+  int   bytes  = 0;
+  if(TryCreateWideString(XString(p_body.c_str()),_T("utf-8"),false,&buffer,bytes))
+  {
+    length = (size_t)bytes / 2;
+    memcpy(p_buffer,buffer,(size_t)bytes);
+  }
+  delete[] buffer;
+#endif
+  return length;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Testframe
+//
+//////////////////////////////////////////////////////////////////////////
+
+int
+TestMarlinServer::TestConversion()
+{
+  // SUMMARY OF THE TEST
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("Test conversion to/from wire: <+>"));
+
+  // Pure ASCII passes unchanged
+  XString ascii(_T("<Envelope><Body>Plain ASCII text</Body></Envelope>"));
+  if(EncodeStringForTheWire(ascii) != ascii || DecodeStringFromTheWire(ascii) != ascii)
+  {
+    qprintf(_T("broken. ASCII changed on the wire. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  // Round trip of non-ASCII chars
+  XString text = WStringToString(L"Caf\u00e9 Gr\u00fc\u00dfe");
+  XString wire = EncodeStringForTheWire(text);
+  if(DecodeStringFromTheWire(wire) != text)
+  {
+    qprintf(_T("broken. UTF-8 round trip failed. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  // Charset names are case insensitive, also for the not built-in ones
+  if(CharsetToCodepage(_T("ISO-8859-2"))   != 28592 ||
+     CharsetToCodepage(_T("Windows-1250")) != 1250  ||
+     CharsetToCodepage(_T("KOI8-R"))       != 20866 ||
+     CharsetToCodepage(_T("UTF-8"))        != 65001)
+  {
+    qprintf(_T("broken. Mixed case charset not found. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  // Compare with the OS conversion on bodies of 1 KB up to 10 MB
+  bool same = true;
+  size_t sizes[] = { 1024, 64 * 1024, 1024 * 1024, 10 * 1024 * 1024 };
+  for(auto size : sizes)
+  {
+    std::string body = MakeUTF8Body(size);
+    wchar_t* bufferOS   = new wchar_t[body.size() + 1];
+    wchar_t* bufferFast = new wchar_t[body.size() + 1];
+
+    HPFCounter counterOS;
+    size_t lengthOS = ConvertByOS(body,bufferOS);
+    counterOS.Stop();
+
+    HPFCounter counterFast;
+    size_t lengthFast = ConvertFast(body,bufferFast);
+    counterFast.Stop();
+
+    if(lengthOS != lengthFast || memcmp(bufferOS,bufferFast,lengthOS * sizeof(wchar_t)) != 0)
+    {
+      same = false;
+    }
+    xprintf(_T("UTF-8 body of %8u bytes. OS: %8.3f ms Fast path: %8.3f ms\n")
+           ,(unsigned)body.size()
+           ,counterOS.GetCounter()   * 1000.0
+           ,counterFast.GetCounter() * 1000.0);
+    delete[] bufferOS;
+    delete[] bufferFast;
+  }
+  if(!same)
+  {
+    qprintf(_T("broken. Fast path differs from the OS. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  qprintf(_T("OK\n"));
+  return 0;
+}
+
+int
+TestMarlinServer::AfterTestConversion()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("Conversion of strings to/from the wire          : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
@@ -36,7 +36,7 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
-static int totalChecks = 2;
+static int totalChecks = 3;
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -97,6 +97,16 @@ SiteFilterTester23::Handle(HTTPMessage* p_message)
 
   --totalChecks;
 
+  // Filter 1 has been timed before we were called
+  SiteFilter* first = GetSite()->GetFilter(1);
+  if(first && first->GetCallCount() > 0)
+  {
+    // SUMMARY OF THE TEST
+    // --- "---------------------------------------------- - ------
+    qprintf(_T("Filter timing counters of priority 1           : OK\n"));
+    --totalChecks;
+  }
+
   return true;
 }
 
@@ -169,6 +179,7 @@ TestMarlinServer::TestFilter()
   // Add filters to this site by priority of handling
   site->SetFilter( 1, new SiteFilterTester1 ( 1,_T("Tester1")));
   site->SetFilter(23, new SiteFilterTester23(23,_T("Tester23")));
+  site->SetFilterTiming(true);
 
   // Modify the standard settings for this site
   site->AddContentType(_T(""),_T("text/xml"));
@@ -188,6 +188,8 @@ TestMarlinServer::TestFormData()
 
   // Modify the standard settings for this site
   site->AddContentType(_T(""),_T("multipart/form-data;"));
+  // Parse the form-data while receiving: file parts go to temporary files
+  site->SetStreamFormData(true);
 
   // Start the site explicitly
   if(site->StartSite())
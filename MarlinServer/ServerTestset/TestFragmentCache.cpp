@@ -0,0 +1,174 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestFragmentCache.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "Stdafx.h"
+#include "TestMarlinServer.h"
+#include "..\..\HTTPSYS\FragmentCache.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Unit test of the fragment cache of our own HTTPSYS driver:
+// hits, misses, flushing (invalidation) and the CLOCK eviction
+
+static int totalChecks = 4;
+
+static ULONG
+AddTestFragment(FragmentCache& p_cache,CString p_name,ULONG p_length)
+{
+  static char data[100] = "Marlin fragment";
+  HTTP_DATA_CHUNK chunk;
+  memset(&chunk,0,sizeof(HTTP_DATA_CHUNK));
+  chunk.DataChunkType           = HttpDataChunkFromMemory;
+  chunk.FromMemory.pBuffer      = data;
+  chunk.FromMemory.BufferLength = p_length;
+  return p_cache.AddFragment(p_name,&chunk,nullptr);
+}
+
+// See if a fragment is in the cache. Counts as a hit or a miss
+static bool
+HasFragment(FragmentCache& p_cache,CString p_name)
+{
+  Fragment* fragment = p_cache.FindFragment(p_name);
+  if(fragment)
+  {
+    fragment->DropReference();
+    return true;
+  }
+  return false;
+}
+
+int
+TestMarlinServer::TestFragmentCache()
+{
+  // SUMMARY OF THE TEST
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("Test HTTPSYS fragment cache : <+>"));
+
+  FragmentCache cache;
+  FragmentStatistics stats;
+
+  // Hit, miss and a duplicate name (names are case insensitive)
+  if(AddTestFragment(cache,_T("/MarlinTest/One"),100) != NO_ERROR ||
+     AddTestFragment(cache,_T("/marlintest/one"),100) != ERROR_DUPLICATE_TAG ||
+    !HasFragment(cache,_T("/MARLINTEST/ONE")) ||
+     HasFragment(cache,_T("/MarlinTest/Two")))
+  {
+    qprintf(_T("broken. Fragment not found or duplicated. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  cache.GetStatistics(stats);
+  if(stats.m_hits != 1 || stats.m_misses != 1 || stats.m_fragments != 1 || stats.m_bytes != 100)
+  {
+    qprintf(_T("broken. Hits and misses not counted. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  // Invalidation: one fragment, or all fragments below a name
+  AddTestFragment(cache,_T("/MarlinTest/Sub/One"),10);
+  AddTestFragment(cache,_T("/MarlinTest/Sub/Two"),10);
+  if(cache.FlushFragment(_T("/MarlinTest/One"),false) != NO_ERROR   ||
+     HasFragment(cache,_T("/MarlinTest/One"))                       ||
+    !HasFragment(cache,_T("/MarlinTest/Sub/Two"))                   ||
+     cache.FlushFragment(_T("/MarlinTest/Sub/"),true) != NO_ERROR   ||
+     HasFragment(cache,_T("/MarlinTest/Sub/One"))                   ||
+     cache.FlushFragment(_T("/MarlinTest/Sub/"),true) != ERROR_NOT_FOUND)
+  {
+    qprintf(_T("broken. Fragments not flushed. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  cache.GetStatistics(stats);
+  if(stats.m_fragments != 0 || stats.m_bytes != 0)
+  {
+    qprintf(_T("broken. Flushed fragments still counted. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  // Eviction: a full cache removes the fragment not used since the last pass
+  // The used fragment gets a second chance
+  cache.SetBudget(300);
+  AddTestFragment(cache,_T("/a"),100);
+  AddTestFragment(cache,_T("/b"),100);
+  AddTestFragment(cache,_T("/c"),100);
+  HasFragment(cache,_T("/a"));
+  if(AddTestFragment(cache,_T("/d"),100) != NO_ERROR ||
+    !HasFragment(cache,_T("/a")) ||
+     HasFragment(cache,_T("/b")) ||
+    !HasFragment(cache,_T("/d")))
+  {
+    qprintf(_T("broken. Wrong fragment evicted. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  cache.GetStatistics(stats);
+  if(stats.m_evictions != 1 || stats.m_bytes != 300 ||
+     AddTestFragment(cache,_T("/e"),400) != ERROR_NOT_ENOUGH_MEMORY)
+  {
+    qprintf(_T("broken. Budget of the cache not kept. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  // An evicted fragment that is still being sent stays alive
+  Fragment* sending = cache.FindFragment(_T("/c"));
+  cache.DeleteAllFragments();
+  bool alive = sending && sending->GetLength() == 100 &&
+               strcmp(reinterpret_cast<char*>(sending->GetBuffer()),"Marlin fragment") == 0;
+  if(sending)
+  {
+    sending->DropReference();
+  }
+  if(!alive)
+  {
+    qprintf(_T("broken. Fragment freed while sending. FixMe\n"));
+    xerror();
+    return 1;
+  }
+  --totalChecks;
+
+  qprintf(_T("OK\n"));
+  return 0;
+}
+
+int
+TestMarlinServer::AfterTestFragmentCache()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("HTTPSYS fragment cache hits, flushes & eviction : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
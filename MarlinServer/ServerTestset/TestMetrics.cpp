@@ -0,0 +1,90 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestMetrics.cpp
+//
+// Marlin Server: Internet server/client
+// 
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "Metrics.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// The metrics site is called by the client test (Prometheus text and JSON)
+// Afterwards the site must have recorded its own requests in the metrics
+static int totalChecks = 2;
+static HTTPSite* g_metricsSite = nullptr;
+
+int
+TestMarlinServer::TestMetrics()
+{
+  int error = 0;
+  XString url(_T("/MarlinTest/Metrics/"));
+
+  xprintf(_T("TESTING THE SERVER-WIDE METRICS SITE\n"));
+  xprintf(_T("====================================\n"));
+
+  // Create URL channel to listen to "http://+:port/MarlinTest/Metrics/"
+  g_metricsSite = m_httpServer->CreateMetricsSite(m_inPortNumber,url);
+  if(g_metricsSite)
+  {
+    // SUMMARY OF THE TEST
+    // --- "--------------------------- - ------\n"
+    qprintf(_T("HTTPSite for metrics        : OK : %s\n"),g_metricsSite->GetPrefixURL().GetString());
+    --totalChecks;
+  }
+  else
+  {
+    ++error;
+    xerror();
+    qprintf(_T("ERROR: Cannot make a HTTP site for: %s\n"),url.GetString());
+  }
+  return error;
+}
+
+int
+TestMarlinServer::AfterTestMetrics()
+{
+  if(g_metricsSite)
+  {
+    // Same histogram as the site registered for itself
+    MetricsLabels labels { { _T("site"),g_metricsSite->GetPrefixURL() } };
+    MetricsSnapshot snapshot;
+    g_metrics.GetHistogram(_T("marlin_site_request_seconds"),labels)->GetSnapshot(snapshot);
+    if(snapshot.m_count > 0)
+    {
+      --totalChecks;
+    }
+    xprintf(_T("Metrics site: %I64d requests. p50: %I64d us p99: %I64d us\n")
+           ,snapshot.m_count,snapshot.GetPercentile(0.5),snapshot.GetPercentile(0.99));
+  }
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("Server-wide metrics recorded and served        : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
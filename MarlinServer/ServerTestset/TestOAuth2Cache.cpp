@@ -0,0 +1,337 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestOAuth2Cache.cpp
+//
+// Marlin Server: Internet server/client
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "TestPorts.h"
+#include "OAuth2Cache.h"
+#include "HTTPClient.h"
+#include <http.h>
+#include <process.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Test of the OAuth2Cache against a stand-in token server on a private request queue.
+// - Threads that need a token at the same time get it from one and the same grant
+// - Tokens are refreshed in the background, without blocking the readers
+// - A failing token server leaves the old token in use until it really expires
+
+static int totalChecks = 5;
+
+const int  OAUTH_THREADS = 16;    // Concurrent first readers
+const int  OAUTH_EXPIRES =  4;    // Lifetime of a token in seconds
+const int  OAUTH_PERCENT = 50;    // Refresh after 2 seconds
+const DWORD OAUTH_DELAY  = 500;   // Milliseconds the token server takes for a grant
+
+static volatile LONG g_grants  = 0;
+static volatile LONG g_failing = 0;
+
+// Stand-in token server: hands out "token-1", "token-2" etc.
+// Stops after answering a "/Stop" request
+static unsigned __stdcall
+TokenServer(void* p_queue)
+{
+  HANDLE queue = reinterpret_cast<HANDLE>(p_queue);
+  ULONG  size  = sizeof(HTTP_REQUEST_V2) + 4096;
+  PHTTP_REQUEST request = reinterpret_cast<PHTTP_REQUEST>(malloc(size));
+  if(request == nullptr)
+  {
+    return 1;
+  }
+
+  while(true)
+  {
+    ULONG bytes = 0;
+    ZeroMemory(request,size);
+    if(HttpReceiveHttpRequest(queue,HTTP_NULL_ID,0,request,size,&bytes,NULL) != NO_ERROR)
+    {
+      break;
+    }
+    bool stop = request->pRawUrl && strstr(request->pRawUrl,"/Stop") != nullptr;
+
+    char body[200] = "";
+    USHORT status  = HTTP_STATUS_OK;
+    if(stop)
+    {
+      strcpy_s(body,"{}");
+    }
+    else if(g_failing)
+    {
+      status = HTTP_STATUS_SERVER_ERROR;
+      strcpy_s(body,"{ \"error\": \"temporarily_unavailable\" }");
+    }
+    else
+    {
+      Sleep(OAUTH_DELAY);
+      sprintf_s(body,"{ \"token_type\": \"Bearer\", \"access_token\": \"token-%d\", \"expires_in\": %d }"
+               ,InterlockedIncrement(&g_grants),OAUTH_EXPIRES);
+    }
+    char length[20];
+    sprintf_s(length,"%d",(int)strlen(body));
+
+    HTTP_RESPONSE   response;
+    HTTP_DATA_CHUNK chunk;
+    ZeroMemory(&response,sizeof(HTTP_RESPONSE));
+    ZeroMemory(&chunk,   sizeof(HTTP_DATA_CHUNK));
+    chunk.DataChunkType           = HttpDataChunkFromMemory;
+    chunk.FromMemory.pBuffer      = body;
+    chunk.FromMemory.BufferLength = (ULONG)strlen(body);
+    response.StatusCode           = status;
+    response.pReason              = status == HTTP_STATUS_OK ? "OK" : "Error";
+    response.ReasonLength         = (USHORT)strlen(response.pReason);
+    response.EntityChunkCount     = 1;
+    response.pEntityChunks        = &chunk;
+    response.Headers.KnownHeaders[HttpHeaderContentType].pRawValue        = "application/json";
+    response.Headers.KnownHeaders[HttpHeaderContentType].RawValueLength   = 16;
+    response.Headers.KnownHeaders[HttpHeaderContentLength].pRawValue      = length;
+    response.Headers.KnownHeaders[HttpHeaderContentLength].RawValueLength = (USHORT)strlen(length);
+
+    HttpSendHttpResponse(queue,request->RequestId,0,&response,NULL,NULL,NULL,0,NULL,NULL);
+    if(stop)
+    {
+      break;
+    }
+  }
+  free(request);
+  return 0;
+}
+
+typedef struct _tokenReader
+{
+  OAuth2Cache* m_cache;
+  int          m_session;
+  XString      m_token;
+}
+TokenReader;
+
+// Reader: get the token of the session
+static unsigned __stdcall
+ReadToken(void* p_reader)
+{
+  TokenReader* reader = reinterpret_cast<TokenReader*>(p_reader);
+  reader->m_token = reader->m_cache->GetBearerToken(reader->m_session);
+  return 0;
+}
+
+// Wait until the clock has passed a moment in time
+static void
+WaitUntil(INT64 p_moment)
+{
+  while(_time64(nullptr) <= p_moment)
+  {
+    Sleep(100);
+  }
+}
+
+static void
+CheckOAuth2Cache(OAuth2Cache& p_cache,int p_session)
+{
+  // 1: All readers of a new session wait for one grant
+  TokenReader readers[OAUTH_THREADS];
+  HANDLE      threads[OAUTH_THREADS];
+  for(int index = 0; index < OAUTH_THREADS; ++index)
+  {
+    readers[index].m_cache   = &p_cache;
+    readers[index].m_session = p_session;
+    threads[index] = (HANDLE)_beginthreadex(nullptr,0,ReadToken,&readers[index],0,nullptr);
+  }
+  WaitForMultipleObjects(OAUTH_THREADS,threads,TRUE,INFINITE);
+  bool same = true;
+  for(int index = 0; index < OAUTH_THREADS; ++index)
+  {
+    CloseHandle(threads[index]);
+    same = same && readers[index].m_token == _T("token-1");
+  }
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("OAuth2 %2d readers one grant : %s\n"),OAUTH_THREADS,same && g_grants == 1 ? _T("OK") : _T("ERROR"));
+  if(same && g_grants == 1)
+  {
+    --totalChecks;
+  }
+
+  // 2: Token is refreshed in the background, while reading stays fast
+  INT64 expires = p_cache.GetExpires(p_session);
+  WaitUntil(expires - OAUTH_EXPIRES + (OAUTH_EXPIRES * OAUTH_PERCENT / 100));
+  LARGE_INTEGER frequency,start,stop;
+  QueryPerformanceFrequency(&frequency);
+  double slowest = 0.0;
+  bool   always  = true;
+  for(int index = 0; index < 150; ++index)
+  {
+    QueryPerformanceCounter(&start);
+    XString token = p_cache.GetBearerToken(p_session);
+    QueryPerformanceCounter(&stop);
+    double millisec = (double)(stop.QuadPart - start.QuadPart) * 1000.0 / (double)frequency.QuadPart;
+    slowest = millisec > slowest ? millisec : slowest;
+    always  = always && !token.IsEmpty();
+    Sleep(10);
+  }
+  bool refreshed = g_grants == 2 && p_cache.GetBearerToken(p_session) == _T("token-2");
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("OAuth2 background refresh   : %s (slowest read %.3f ms)\n"),refreshed && always ? _T("OK") : _T("ERROR"),slowest);
+  if(refreshed && always && slowest < (double)OAUTH_DELAY / 2)
+  {
+    --totalChecks;
+  }
+
+  // 3: Failing refresh keeps the old token
+  g_failing = 1;
+  expires = p_cache.GetExpires(p_session);
+  WaitUntil(expires - OAUTH_EXPIRES + (OAUTH_EXPIRES * OAUTH_PERCENT / 100));
+  Sleep(OAUTH_DELAY);
+  bool kept = p_cache.GetBearerToken(p_session) == _T("token-2") && !p_cache.GetIsExpired(p_session);
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("OAuth2 failed refresh       : %s\n"),kept ? _T("OK") : _T("ERROR"));
+  if(kept)
+  {
+    --totalChecks;
+  }
+
+  // 4: Until it really expires
+  WaitUntil(expires);
+  bool expired = p_cache.GetBearerToken(p_session).IsEmpty() && p_cache.GetIsExpired(p_session);
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("OAuth2 hard expiry          : %s\n"),expired ? _T("OK") : _T("ERROR"));
+  if(expired)
+  {
+    --totalChecks;
+  }
+
+  // 5: Recovery, and only the rejected token is dropped
+  g_failing = 0;
+  XString token = p_cache.GetBearerToken(p_session);
+  p_cache.SetExpired(p_session,_T("token-2"));
+  bool recover = token == _T("token-3") && p_cache.GetBearerToken(p_session) == _T("token-3");
+  p_cache.SetExpired(p_session,token);
+  recover = recover && p_cache.GetBearerToken(p_session) == _T("token-4");
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("OAuth2 recovery/expiring    : %s\n"),recover ? _T("OK") : _T("ERROR"));
+  if(recover)
+  {
+    --totalChecks;
+  }
+}
+
+int
+TestMarlinServer::TestOAuth2Cache(bool p_standalone)
+{
+  // Only in our own process: not in an IIS application pool
+  if(!p_standalone)
+  {
+    totalChecks = 0;
+    return 0;
+  }
+  xprintf(_T("TESTING THE OAUTH2 CACHE AGAINST A STAND-IN TOKEN SERVER\n"));
+  xprintf(_T("========================================================\n"));
+
+  HTTP_SERVER_SESSION_ID session = 0;
+  HTTP_URL_GROUP_ID      group   = 0;
+  HANDLE                 queue   = NULL;
+  XString url;
+  url.Format(_T("http://+:%d/MarlinTest/OAuth2/"),TESTING_OAUTH_PORT);
+  wstring uniURL = StringToWString(url);
+
+  ULONG result = HttpCreateServerSession(HTTPAPI_VERSION_2,&session,0);
+  if(result == NO_ERROR)
+  {
+    result = HttpCreateUrlGroup(session,&group,0);
+  }
+  if(result == NO_ERROR)
+  {
+    result = HttpCreateRequestQueue(HTTPAPI_VERSION_2,NULL,NULL,0,&queue);
+  }
+  if(result == NO_ERROR)
+  {
+    HTTP_BINDING_INFO binding;
+    binding.Flags.Present      = 1;
+    binding.RequestQueueHandle = queue;
+    result = HttpSetUrlGroupProperty(group,HttpServerBindingProperty,&binding,sizeof(HTTP_BINDING_INFO));
+  }
+  if(result == NO_ERROR)
+  {
+    result = HttpAddUrlToUrlGroup(group,uniURL.c_str(),0,0);
+  }
+
+  if(result == NO_ERROR)
+  {
+    HANDLE server = (HANDLE)_beginthreadex(nullptr,0,TokenServer,queue,0,nullptr);
+
+    XString tokenURL;
+    tokenURL.Format(_T("http://localhost:%d/MarlinTest/OAuth2/Token"),TESTING_OAUTH_PORT);
+    {
+      OAuth2Cache cache;
+      cache.SetRefreshPercentage(OAUTH_PERCENT);
+      int grant = cache.CreateClientCredentialsGrant(tokenURL,_T("MarlinTest"),_T("Secret"),_T("Testing"));
+      CheckOAuth2Cache(cache,grant);
+      cache.EndSession(grant);
+    }
+
+    // Stop the token server
+    HTTPClient client;
+    XString stopURL;
+    stopURL.Format(_T("http://localhost:%d/MarlinTest/OAuth2/Stop"),TESTING_OAUTH_PORT);
+    client.Send(stopURL);
+    if(server)
+    {
+      WaitForSingleObject(server,INFINITE);
+      CloseHandle(server);
+    }
+    HttpRemoveUrlFromUrlGroup(group,uniURL.c_str(),0);
+  }
+  else
+  {
+    xprintf(_T("Cannot create the token server on [%s] Error: %lu\n"),url.GetString(),result);
+  }
+
+  if(queue)
+  {
+    HttpShutdownRequestQueue(queue);
+    HttpCloseRequestQueue(queue);
+  }
+  if(group)
+  {
+    HttpCloseUrlGroup(group);
+  }
+  if(session)
+  {
+    HttpCloseServerSession(session);
+  }
+  return totalChecks;
+}
+
+int
+TestMarlinServer::AfterTestOAuth2Cache()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("OAuth2 cache single-flight/background refresh  : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
@@ -0,0 +1,145 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestPoolSizing.cpp
+//
+// Marlin Server: Internet server/client
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "ThreadPool.h"
+#include "ThreadPoolSizer.h"
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Synthetic workload for the sizers of the ThreadPool.
+// A mix of CPU-bound work (spinning) and blocking work (sleeping, like waiting
+// on a database or another server) is submitted at a fixed rate.
+// Every second the number of threads and the 95th percentile of the waiting
+// time in the queue are shown, so the convergence of the sizer can be seen.
+
+static int totalChecks = 2;
+
+const int   SIZING_SECONDS   =    6;   // Duration of the workload per sizer
+const int   SIZING_RATE      =  400;   // Work items per second
+const int   SIZING_BLOCKING  =   30;   // Percentage of blocking work
+const DWORD SIZING_CPU_TIME  =    1;   // Milliseconds of spinning for CPU-bound work
+const DWORD SIZING_SLEEP     =   50;   // Milliseconds of sleeping for blocking work
+
+static volatile long g_submitted = 0;
+static volatile long g_completed = 0;
+
+static void
+SizingCPUWork(void* /*p_argument*/)
+{
+  ULONGLONG stop = GetTickCount64() + SIZING_CPU_TIME;
+  volatile ULONGLONG count = 0;
+  while(GetTickCount64() < stop)
+  {
+    ++count;
+  }
+  InterlockedIncrement(&g_completed);
+}
+
+static void
+SizingBlockingWork(void* /*p_argument*/)
+{
+  Sleep(SIZING_SLEEP);
+  InterlockedIncrement(&g_completed);
+}
+
+// Run the workload on a private pool with one sizer
+static bool
+SizingRound(XString p_sizer)
+{
+  ThreadPool pool(NUM_THREADS_MINIMUM,NUM_THREADS_MAXIMUM);
+  pool.SetSizer(CreatePoolSizer(p_sizer));
+  pool.Run();
+
+  g_submitted = 0;
+  g_completed = 0;
+
+  const int slice = 10;   // Submitting in slices of 10 milliseconds
+  for(int second = 0; second < SIZING_SECONDS; ++second)
+  {
+    for(int part = 0; part < 1000 / slice; ++part)
+    {
+      for(int item = 0; item < SIZING_RATE * slice / 1000; ++item)
+      {
+        bool blocking = (g_submitted % 100) < SIZING_BLOCKING;
+        if(pool.SubmitWork(blocking ? SizingBlockingWork : SizingCPUWork,nullptr))
+        {
+          InterlockedIncrement(&g_submitted);
+        }
+      }
+      Sleep(slice);
+    }
+    // --- "--------------------------- - ------\n"
+    qprintf(_T("Pool sizer %-9s second %d : %2d threads, %2d blocked, p95 wait %ld us\n")
+           ,p_sizer.GetString(),second + 1
+           ,(int)pool.GetCurrentThreads(),(int)pool.GetBlockedThreads(),pool.GetQueueWaitP95());
+  }
+
+  // Give the pool some time to finish all work
+  for(int wait = 0; wait < 100 && g_completed < g_submitted; ++wait)
+  {
+    Sleep(100);
+  }
+  return g_completed == g_submitted;
+}
+
+int
+TestMarlinServer::TestPoolSizing(bool p_standalone)
+{
+  // Only in our own process: not in an IIS application pool
+  if(!p_standalone)
+  {
+    totalChecks = 0;
+    return 0;
+  }
+  xprintf(_T("TESTING THE SIZERS OF THE THREADPOOL WITH A MIXED WORKLOAD\n"));
+  xprintf(_T("==========================================================\n"));
+
+  if(SizingRound(_T("queuewait")))
+  {
+    --totalChecks;
+  }
+  if(SizingRound(_T("hillclimb")))
+  {
+    --totalChecks;
+  }
+  return totalChecks;
+}
+
+int
+TestMarlinServer::AfterTestPoolSizing()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("Threadpool sizers queuewait/hillclimb          : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
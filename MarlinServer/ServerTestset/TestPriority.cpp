@@ -0,0 +1,213 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestPriority.cpp
+//
+// Marlin Server: Internet server/client
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "ThreadPool.h"
+#include <algorithm>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Benchmark of the priority classes of the ThreadPool.
+// The pool is saturated by a flood of slow low-priority work (like SOAP batches),
+// while short probes (like health checks) are submitted at a steady pace.
+// The tail latency of the probes (from submit to start) is measured with all work
+// in one class (FIFO), and with the probes in the high priority class.
+
+static int totalChecks = 3;
+
+const int   PRIORITY_FLOOD    = 100;  // Low-priority items per thread of the pool
+const DWORD PRIORITY_WORK     =  20;  // Milliseconds per low-priority item
+const int   PRIORITY_PROBES   = 200;  // Number of probes per round
+const DWORD PRIORITY_PACE     =   5;  // Milliseconds between probes
+const DWORD PRIORITY_DEADLINE =  50;  // Milliseconds deadline of the expiring work
+
+static LONGLONG      g_frequency = 0;
+static LONGLONG      g_probeSubmit[PRIORITY_PROBES];
+static LONGLONG      g_probeStart [PRIORITY_PROBES];
+static volatile long g_flooded = 0;
+static volatile long g_expiredWork = 0;
+
+static void
+PriorityFloodWork(void* /*p_argument*/)
+{
+  Sleep(PRIORITY_WORK);
+  InterlockedIncrement(&g_flooded);
+}
+
+static void
+PriorityExpiredWork(void* /*p_argument*/)
+{
+  InterlockedIncrement(&g_expiredWork);
+}
+
+static void
+PriorityProbe(void* p_argument)
+{
+  LARGE_INTEGER now;
+  QueryPerformanceCounter(&now);
+  g_probeStart[reinterpret_cast<INT_PTR>(p_argument)] = now.QuadPart;
+}
+
+// Latency percentile of the probes in milliseconds
+static double
+ProbePercentile(std::vector<LONGLONG>& p_latency,double p_percentile)
+{
+  if(p_latency.empty())
+  {
+    return 0.0;
+  }
+  size_t index = (size_t)(p_percentile * (double)(p_latency.size() - 1));
+  return (double)p_latency[index] * 1000.0 / (double)g_frequency;
+}
+
+// One round: flood in one class, probes in another. Returns the p99 in milliseconds
+static double
+PriorityRound(XString p_name,WorkPriority p_flood,WorkPriority p_probes)
+{
+  ThreadPool pool(NUM_THREADS_MINIMUM,NUM_THREADS_MAXIMUM);
+  pool.Run();
+
+  g_flooded = 0;
+  ZeroMemory(g_probeStart,sizeof(g_probeStart));
+
+  // Saturate the pool with a backlog of low-priority work
+  int flood = PRIORITY_FLOOD * pool.GetMaxThreads();
+  for(int index = 0; index < flood; ++index)
+  {
+    pool.SubmitWork(PriorityFloodWork,nullptr,p_flood);
+  }
+
+  // Submit the probes at a steady pace
+  for(INT_PTR probe = 0; probe < PRIORITY_PROBES; ++probe)
+  {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    g_probeSubmit[probe] = now.QuadPart;
+    pool.SubmitWork(PriorityProbe,reinterpret_cast<void*>(probe),p_probes);
+    Sleep(PRIORITY_PACE);
+  }
+
+  // Wait for the flood to drain
+  for(int wait = 0; wait < 600 && g_flooded < flood; ++wait)
+  {
+    Sleep(100);
+  }
+
+  std::vector<LONGLONG> latency;
+  for(int probe = 0; probe < PRIORITY_PROBES; ++probe)
+  {
+    if(g_probeStart[probe])
+    {
+      latency.push_back(g_probeStart[probe] - g_probeSubmit[probe]);
+    }
+  }
+  std::sort(latency.begin(),latency.end());
+  double p50 = ProbePercentile(latency,0.50);
+  double p99 = ProbePercentile(latency,0.99);
+
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("Probes %-9s %3d started : p50 %8.2f ms p99 %8.2f ms\n"),p_name.GetString(),(int)latency.size(),p50,p99);
+  return p99;
+}
+
+// Work with a deadline: rejected at submit, or expired in the queue
+static bool
+DeadlineRound()
+{
+  ThreadPool pool(NUM_THREADS_MINIMUM,NUM_THREADS_MAXIMUM);
+  pool.Run();
+
+  g_flooded     = 0;
+  g_expiredWork = 0;
+
+  // Deadline that has already passed is rejected at once
+  bool rejected = !pool.SubmitWork(PriorityFloodWork,nullptr,WorkPriority::WP_Normal,GetTickCount64() - 1,PriorityExpiredWork);
+
+  // Flood with deadlines: most of it cannot start in time
+  int flood = PRIORITY_FLOOD * pool.GetMaxThreads();
+  for(int index = 0; index < flood; ++index)
+  {
+    pool.SubmitWork(PriorityFloodWork,nullptr,WorkPriority::WP_Low,GetTickCount64() + PRIORITY_DEADLINE,PriorityExpiredWork);
+  }
+  for(int wait = 0; wait < 600 && (g_flooded + g_expiredWork) < flood; ++wait)
+  {
+    Sleep(100);
+  }
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("Work with deadline %d ms    : %d done, %d expired\n"),PRIORITY_DEADLINE,(int)g_flooded,(int)g_expiredWork);
+
+  return rejected && g_expiredWork > 0 && (g_flooded + g_expiredWork) == flood;
+}
+
+int
+TestMarlinServer::TestPriority(bool p_standalone)
+{
+  // Only in our own process: not in an IIS application pool
+  if(!p_standalone)
+  {
+    totalChecks = 0;
+    return 0;
+  }
+  xprintf(_T("TESTING PRIORITY CLASSES AND DEADLINES OF THE THREADPOOL\n"));
+  xprintf(_T("========================================================\n"));
+
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  g_frequency = frequency.QuadPart;
+
+  double fifo = PriorityRound(_T("fifo"),    WorkPriority::WP_Normal,WorkPriority::WP_Normal);
+  double high = PriorityRound(_T("priority"),WorkPriority::WP_Low,   WorkPriority::WP_High);
+
+  // Both rounds must have run, and the high class must be faster
+  if(fifo > 0.0)
+  {
+    --totalChecks;
+  }
+  if(high < fifo)
+  {
+    --totalChecks;
+  }
+  if(DeadlineRound())
+  {
+    --totalChecks;
+  }
+  return totalChecks;
+}
+
+int
+TestMarlinServer::AfterTestPriority()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("Threadpool priority classes and deadlines      : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
@@ -198,6 +198,82 @@ TestMarlinServer::TestReliableBA()
   return error;
 }
 
+// Site for the benchmark of the client sending window.
+// Injects latency in every answer, so more messages in flight pay off
+constexpr int RM_WINDOW_LATENCY = 25;  // Milliseconds
+
+class SiteHandlerSoapWindow: public SiteHandlerSoap
+{
+  // RM protocol handled in the PreHandle of the base class
+public:
+  bool  Handle(SOAPMessage* p_message);
+};
+
+bool
+SiteHandlerSoapWindow::Handle(SOAPMessage* p_message)
+{
+  // Simulate a slow network or a slow service
+  Sleep(RM_WINDOW_LATENCY);
+
+  XString paramOne = p_message->GetParameter(_T("One"));
+  XString paramTwo = p_message->GetParameter(_T("Two"));
+  bool result = (paramOne == _T("ABC") && paramTwo == _T("1-2-3"));
+
+  // reuse message for response
+  XString response = _T("TestMessageResponse");
+  p_message->Reset();
+  p_message->SetSoapAction(response);
+  p_message->SetParameter(_T("Three"),result ? _T("DEF") : _T("ERROR"));
+  p_message->SetParameter(_T("Four"), result ? _T("123") : _T("0"));
+  return true;
+}
+
+int
+TestMarlinServer::TestReliableWindow()
+{
+  int error = 0;
+
+  xprintf(_T("TESTING RELIABLE MESSAGING SENDING WINDOW OF THE HTTP SERVER\n"));
+  xprintf(_T("============================================================\n"));
+
+  // Create URL channel to listen to "http://+:port/MarlinTest/ReliableWindow/"
+  XString url(_T("/MarlinTest/ReliableWindow/"));
+  HTTPSite* site = m_httpServer->CreateSite(PrefixType::URLPRE_Strong,false,m_inPortNumber,url);
+  if(site)
+  {
+    // SUMMARY OF THE TEST
+    // --- "--------------------------- - ------\n"
+    qprintf(_T("HTTPSite reliable window    : OK : %s\n"),site->GetPrefixURL().GetString());
+  }
+  else
+  {
+    ++error;
+    xerror();
+    qprintf(_T("ERROR: Cannot register a HTTP site for: %s\n"),url.GetString());
+    return error;
+  }
+
+  site->SetHandler(HTTPCommand::http_post,new SiteHandlerSoapWindow());
+
+  // Modify the standard settings for this site
+  site->AddContentType(_T(""),_T("text/xml"));
+  site->AddContentType(_T("xml"),_T("application/soap+xml"));
+  site->SetReliable(true);
+
+  // new: Start the site explicitly
+  if(site->StartSite())
+  {
+    xprintf(_T("Site started correctly\n"));
+  }
+  else
+  {
+    ++error;
+    xerror();
+    qprintf(_T("ERROR STARTING SITE: %s\n"),url.GetString());
+  }
+  return error;
+}
+
 int
 TestMarlinServer::AfterTestReliable()
 {
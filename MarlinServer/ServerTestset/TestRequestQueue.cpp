@@ -0,0 +1,258 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestRequestQueue.cpp
+//
+// Marlin Server: Internet server/client
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "TestPorts.h"
+#include "HTTPClient.h"
+#include <http.h>
+#include <process.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Benchmark of the receive/dispatch rate of a request queue.
+// A private request queue is served by 1 up to 64 consumer threads that call
+// HttpReceiveHttpRequest/HttpSendHttpResponse, while a fixed number of client
+// threads fire small GET requests at it. Works with HTTP.SYS and our own HTTPSYS driver.
+
+static int totalChecks = 1;
+
+const int    QUEUE_REQUESTS = 1000;   // Requests per round
+const int    QUEUE_CLIENTS  =    8;   // Client threads per round
+const ULONG  QUEUE_BUFFER   = 4096;   // Room for the request headers
+const int    QUEUE_ROUNDS[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+static volatile LONG g_sent   = 0;
+static volatile LONG g_failed = 0;
+
+// Consumer: receive requests from the queue and answer them
+// Stops after answering a "/Stop" request
+static unsigned __stdcall
+QueueConsumer(void* p_queue)
+{
+  HANDLE queue = reinterpret_cast<HANDLE>(p_queue);
+  ULONG  size  = sizeof(HTTP_REQUEST_V2) + QUEUE_BUFFER;
+  PHTTP_REQUEST request = reinterpret_cast<PHTTP_REQUEST>(malloc(size));
+  if(request == nullptr)
+  {
+    return 1;
+  }
+
+  while(true)
+  {
+    ULONG bytes = 0;
+    ZeroMemory(request,size);
+    if(HttpReceiveHttpRequest(queue,HTTP_NULL_ID,0,request,size,&bytes,NULL) != NO_ERROR)
+    {
+      break;
+    }
+    bool stop = request->pRawUrl && strstr(request->pRawUrl,"/Stop") != nullptr;
+
+    HTTP_RESPONSE   response;
+    HTTP_DATA_CHUNK chunk;
+    ZeroMemory(&response,sizeof(HTTP_RESPONSE));
+    ZeroMemory(&chunk,   sizeof(HTTP_DATA_CHUNK));
+    chunk.DataChunkType           = HttpDataChunkFromMemory;
+    chunk.FromMemory.pBuffer      = (PVOID)"OK";
+    chunk.FromMemory.BufferLength = 2;
+    response.StatusCode           = HTTP_STATUS_OK;
+    response.pReason              = "OK";
+    response.ReasonLength         = 2;
+    response.EntityChunkCount     = 1;
+    response.pEntityChunks        = &chunk;
+    response.Headers.KnownHeaders[HttpHeaderContentLength].pRawValue      = "2";
+    response.Headers.KnownHeaders[HttpHeaderContentLength].RawValueLength = 1;
+
+    HttpSendHttpResponse(queue,request->RequestId,0,&response,NULL,NULL,NULL,0,NULL,NULL);
+    if(stop)
+    {
+      break;
+    }
+  }
+  free(request);
+  return 0;
+}
+
+// Client: send requests until the round is complete
+static unsigned __stdcall
+QueueClient(void* /*p_argument*/)
+{
+  HTTPClient client;
+  XString url;
+  url.Format(_T("http://localhost:%d/MarlinTest/Queue/Call"),TESTING_QUEUE_PORT);
+
+  while(InterlockedIncrement(&g_sent) <= QUEUE_REQUESTS)
+  {
+    if(!client.Send(url) || client.GetStatus() != HTTP_STATUS_OK)
+    {
+      InterlockedIncrement(&g_failed);
+    }
+  }
+  return 0;
+}
+
+// Start a number of threads and wait for all of them to end
+static void
+RunThreads(int p_number,_beginthreadex_proc_type p_function,void* p_argument,bool p_wait)
+{
+  std::vector<HANDLE> threads;
+  for(int index = 0; index < p_number; ++index)
+  {
+    HANDLE thread = (HANDLE)_beginthreadex(nullptr,0,p_function,p_argument,0,nullptr);
+    if(thread)
+    {
+      threads.push_back(thread);
+    }
+  }
+  if(p_wait)
+  {
+    for(auto& thread : threads)
+    {
+      WaitForSingleObject(thread,INFINITE);
+    }
+  }
+  for(auto& thread : threads)
+  {
+    CloseHandle(thread);
+  }
+}
+
+// One round with a number of consumer threads. Returns requests per second
+static double
+QueueRound(HANDLE p_queue,int p_consumers)
+{
+  g_sent = 0;
+
+  RunThreads(p_consumers,QueueConsumer,p_queue,false);
+
+  LARGE_INTEGER frequency,start,stop;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&start);
+  RunThreads(QUEUE_CLIENTS,QueueClient,nullptr,true);
+  QueryPerformanceCounter(&stop);
+
+  // Stop the consumers: each one stops after one "/Stop" request
+  HTTPClient client;
+  XString url;
+  url.Format(_T("http://localhost:%d/MarlinTest/Queue/Stop"),TESTING_QUEUE_PORT);
+  for(int index = 0; index < p_consumers; ++index)
+  {
+    client.Send(url);
+  }
+
+  double seconds = (double)(stop.QuadPart - start.QuadPart) / (double)frequency.QuadPart;
+  return seconds > 0.0 ? (double)QUEUE_REQUESTS / seconds : 0.0;
+}
+
+int
+TestMarlinServer::TestRequestQueue(bool p_standalone)
+{
+  // Only in our own process: not in an IIS application pool
+  if(!p_standalone)
+  {
+    --totalChecks;
+    return 0;
+  }
+  xprintf(_T("TESTING RECEIVE/DISPATCH RATE OF A REQUEST QUEUE\n"));
+  xprintf(_T("================================================\n"));
+
+  HTTP_SERVER_SESSION_ID session = 0;
+  HTTP_URL_GROUP_ID      group   = 0;
+  HANDLE                 queue   = NULL;
+  XString url;
+  url.Format(_T("http://+:%d/MarlinTest/Queue/"),TESTING_QUEUE_PORT);
+  wstring uniURL = StringToWString(url);
+
+  ULONG result = HttpCreateServerSession(HTTPAPI_VERSION_2,&session,0);
+  if(result == NO_ERROR)
+  {
+    result = HttpCreateUrlGroup(session,&group,0);
+  }
+  if(result == NO_ERROR)
+  {
+    result = HttpCreateRequestQueue(HTTPAPI_VERSION_2,NULL,NULL,0,&queue);
+  }
+  if(result == NO_ERROR)
+  {
+    HTTP_BINDING_INFO binding;
+    binding.Flags.Present      = 1;
+    binding.RequestQueueHandle = queue;
+    result = HttpSetUrlGroupProperty(group,HttpServerBindingProperty,&binding,sizeof(HTTP_BINDING_INFO));
+  }
+  if(result == NO_ERROR)
+  {
+    result = HttpAddUrlToUrlGroup(group,uniURL.c_str(),0,0);
+  }
+
+  if(result == NO_ERROR)
+  {
+    g_failed = 0;
+    for(auto consumers : QUEUE_ROUNDS)
+    {
+      double rate = QueueRound(queue,consumers);
+      // --- "--------------------------- - ------\n"
+      qprintf(_T("Request queue %2d consumers  : %.0f requests/sec\n"),consumers,rate);
+    }
+    if(g_failed == 0)
+    {
+      --totalChecks;
+    }
+    HttpRemoveUrlFromUrlGroup(group,uniURL.c_str(),0);
+  }
+  else
+  {
+    xprintf(_T("Cannot create request queue on [%s] Error: %lu\n"),url.GetString(),result);
+  }
+
+  if(queue)
+  {
+    HttpShutdownRequestQueue(queue);
+    HttpCloseRequestQueue(queue);
+  }
+  if(group)
+  {
+    HttpCloseUrlGroup(group);
+  }
+  if(session)
+  {
+    HttpCloseServerSession(session);
+  }
+  return totalChecks;
+}
+
+int
+TestMarlinServer::AfterTestRequestQueue()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("Request queue receive/dispatch 1-64 threads    : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
@@ -28,6 +28,7 @@
 #include "Stdafx.h"
 #include "TestMarlinServer.h"
 #include "HTTPTime.h"
+#include "XMLTemporal.h"
 #include "WinHttp.h"
 
 #ifdef _DEBUG
@@ -36,7 +37,114 @@
 static char THIS_FILE[] = __FILE__;
 #endif
 
-static int totalChecks = 1;
+static int totalChecks = 2;
+const  int TIME_ROUNDS = 100000;
+
+static double
+Nanoseconds(LARGE_INTEGER& p_start,LARGE_INTEGER& p_stop,int p_rounds)
+{
+  LARGE_INTEGER frequency;
+  QueryPerformanceFrequency(&frequency);
+  return (double)(p_stop.QuadPart - p_start.QuadPart) * 1000000000.0 / (double)frequency.QuadPart / p_rounds;
+}
+
+// Fixed-width RFC 1123 and ISO 8601 paths and the cached "Date:" header
+static int
+TestFastTime()
+{
+  int errors = 0;
+  SYSTEMTIME time = { 1994,11,0,6,8,49,37,0 };
+  SYSTEMTIME back;
+  TCHAR buffer[HTTPTIME_LENGTH + 1];
+
+  // Round trip of the fixed-width RFC 1123 format
+  if(!HTTPTimeFormat(&time,buffer) || _tcscmp(buffer,_T("Sun, 06 Nov 1994 08:49:37 GMT")) != 0 ||
+     !HTTPTimeParse(buffer,&back) || memcmp(&time,&back,sizeof(SYSTEMTIME)) != 0)
+  {
+    xprintf(_T("Fixed-width RFC 1123 round trip failed\n"));
+    ++errors;
+  }
+  // Strict parsing leaves all other formats to the loose parser
+  if(HTTPTimeParse(_T("Sun, 06-Nov-1994 08:49:37 GMT"),&back))
+  {
+    xprintf(_T("Strict RFC 1123 parser accepted a MS-Exchange time\n"));
+    ++errors;
+  }
+  // Cached date header must always be a valid RFC 1123 time
+  XString date = HTTPGetSystemTime();
+  if(date.GetLength() != HTTPTIME_LENGTH || !HTTPTimeParse(date.GetString(),&back))
+  {
+    xprintf(_T("Cached date header is not a RFC 1123 time: %s\n"),date.GetString());
+    ++errors;
+  }
+  // ISO 8601 with fraction: fixed-width path and the fallback
+  XMLTimestamp stamp1(_T("2024-02-29T13:45:06.05"));
+  XMLTimestamp stamp2(_T("2024-02-29 13:45:06"));
+  if(stamp1.AsString() != _T("2024-02-29T13:45:06.05") ||
+     stamp2.AsString() != _T("2024-02-29T13:45:06")    ||
+     stamp1.GetValue() != stamp2.GetValue())
+  {
+    xprintf(_T("ISO 8601 timestamps not parsed correctly\n"));
+    ++errors;
+  }
+
+  // Benchmark of all paths
+  LARGE_INTEGER start,stop;
+  XString result;
+
+  QueryPerformanceCounter(&start);
+  for(int index = 0; index < TIME_ROUNDS; ++index)
+  {
+    HTTPGetSystemTime(buffer);
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("HTTP Date header (cached)   : %.0f ns\n"),Nanoseconds(start,stop,TIME_ROUNDS));
+
+  QueryPerformanceCounter(&start);
+  for(int index = 0; index < TIME_ROUNDS; ++index)
+  {
+    HTTPTimeFromSystemTime(&time,result);
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("RFC 1123 format             : %.0f ns\n"),Nanoseconds(start,stop,TIME_ROUNDS));
+
+  XString rfc1123(_T("Sun, 06 Nov 1994 08:49:37 GMT"));
+  XString rfc850 (_T("Sunday, 06-Nov-94 08:49:37 GMT"));
+  QueryPerformanceCounter(&start);
+  for(int index = 0; index < TIME_ROUNDS; ++index)
+  {
+    HTTPTimeToSystemTime(rfc1123,&back);
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("RFC 1123 parse              : %.0f ns\n"),Nanoseconds(start,stop,TIME_ROUNDS));
+
+  QueryPerformanceCounter(&start);
+  for(int index = 0; index < TIME_ROUNDS; ++index)
+  {
+    HTTPTimeToSystemTime(rfc850,&back);
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("RFC 850 parse (loose)       : %.0f ns\n"),Nanoseconds(start,stop,TIME_ROUNDS));
+
+  XString iso(_T("2024-02-29T13:45:06.123456789"));
+  QueryPerformanceCounter(&start);
+  for(int index = 0; index < TIME_ROUNDS; ++index)
+  {
+    XMLTimestamp stamp(iso);
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("ISO 8601 parse              : %.0f ns\n"),Nanoseconds(start,stop,TIME_ROUNDS));
+
+  QueryPerformanceCounter(&start);
+  for(int index = 0; index < TIME_ROUNDS; ++index)
+  {
+    result = stamp1.AsString();
+  }
+  QueryPerformanceCounter(&stop);
+  _tprintf(_T("ISO 8601 format             : %.0f ns\n"),Nanoseconds(start,stop,TIME_ROUNDS));
+
+  return errors;
+}
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -137,7 +245,16 @@ TestMarlinServer::TestHTTPTime()
     qprintf(_T("OK\n"));
     --totalChecks;
   }
-  return errors;
+
+  // Fixed-width and cached paths
+  int fast = TestFastTime();
+  if(fast == 0)
+  {
+    --totalChecks;
+  }
+  // --- "--------------------------- - ------\n"
+  qprintf(_T("Fast RFC 1123 / ISO 8601    : %s\n"),fast ? _T("ERROR") : _T("OK"));
+  return errors + fast;
 }
 
 int
@@ -0,0 +1,321 @@
+/////////////////////////////////////////////////////////////////////////////////
+//
+// SourceFile: TestZipWebroot.cpp
+//
+// Marlin Server: Internet server/client
+//
+// Copyright (c) 2014-2024 ir. W.E. Huisman
+// All rights reserved
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files(the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and / or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions :
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+#include "stdafx.h"
+#include "TestMarlinServer.h"
+#include "ZipWebroot.h"
+#include "SiteHandlerGetZip.h"
+#include "HTTPSite.h"
+#include <ZIP\gzip.h>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#undef THIS_FILE
+static char THIS_FILE[] = __FILE__;
+#endif
+
+// Serving a site from a ZIP archive: a small archive with one stored and two
+// deflated entries is written to the TEMP directory and opened as a ZipWebroot.
+// Stored entries come from the mapping, deflated entries as gzip or inflated.
+// The same archive is the webroot of the site /MarlinTest/Zip/ for the client.
+
+static int totalChecks = 7;
+
+const size_t ZIPTEST_CACHE = 32 * 1024;   // 'big.css' does not fit in the cache
+const size_t ZIPTEST_INDEX = 41;          // Length of 'index.html'
+const size_t ZIPTEST_STYLE = 4000 * 28;   // Length of 'big.css'
+
+// GET handler of the site, checking what the client gets from the archive
+class SiteHandlerGetZipTest : public SiteHandlerGetZip
+{
+public:
+  explicit SiteHandlerGetZipTest(XString p_archive) : SiteHandlerGetZip(p_archive,ZIPTEST_CACHE) {};
+protected:
+  virtual bool Handle(HTTPMessage* p_message) override;
+};
+
+bool
+SiteHandlerGetZipTest::Handle(HTTPMessage* p_message)
+{
+  XString resource = p_message->GetAbsoluteResource();
+  bool result = SiteHandlerGetZip::Handle(p_message);
+
+  size_t length = p_message->GetFileBuffer()->GetLength();
+  bool   plain  = p_message->GetHeader(_T("Content-Encoding")).IsEmpty();
+  bool   ok     = false;
+  if(resource.Right(10).CompareNoCase(_T("index.html")) == 0)
+  {
+    ok = p_message->GetStatus() == HTTP_STATUS_OK && plain && length == ZIPTEST_INDEX;
+    // --- "---------------------------------------------- - ------
+    qprintf(_T("ZIP site stored entry through the handler      : %s\n"),ok ? _T("OK") : _T("ERROR"));
+  }
+  else if(resource.Right(7).CompareNoCase(_T("big.css")) == 0)
+  {
+    // Client does not accept gzip: inflated into a temporary file
+    ok = p_message->GetStatus() == HTTP_STATUS_OK && (!plain || length == ZIPTEST_STYLE);
+    qprintf(_T("ZIP site large inflated entry through handler  : %s\n"),ok ? _T("OK") : _T("ERROR"));
+  }
+  if(ok)
+  {
+    --totalChecks;
+  }
+  return result;
+}
+
+typedef struct _zipTestEntry
+{
+  std::string m_name;
+  std::string m_content;
+  bool        m_deflate;
+}
+ZipTestEntry;
+
+static void
+PutShort(std::string& p_zip,unsigned p_value)
+{
+  p_zip += (char)(p_value & 0xFF);
+  p_zip += (char)((p_value >> 8) & 0xFF);
+}
+
+static void
+PutLong(std::string& p_zip,DWORD p_value)
+{
+  PutShort(p_zip,p_value & 0xFFFF);
+  PutShort(p_zip,p_value >> 16);
+}
+
+// Write a ZIP archive. Deflated data and CRC are taken from a gzip stream,
+// as that is a raw deflate stream between a 10 byte header and an 8 byte trailer.
+static bool
+WriteZipArchive(XString p_filename,std::vector<ZipTestEntry>& p_entries)
+{
+  std::string zip;
+  std::string directory;
+
+  for(auto& entry : p_entries)
+  {
+    std::vector<uint8_t> gzip;
+    if(!gzip_compress_memory((void*)entry.m_content.data(),entry.m_content.size(),gzip) || gzip.size() < 18)
+    {
+      return false;
+    }
+    const uint8_t* trailer = &gzip[gzip.size() - 8];
+    DWORD crc = (DWORD)trailer[0] | ((DWORD)trailer[1] << 8) | ((DWORD)trailer[2] << 16) | ((DWORD)trailer[3] << 24);
+    std::string data = entry.m_deflate ? std::string((const char*)&gzip[10],gzip.size() - 18) : entry.m_content;
+    DWORD offset = (DWORD)zip.size();
+
+    // Local header
+    PutLong (zip,0x04034b50);
+    PutShort(zip,20);                         // Version needed
+    PutShort(zip,0);                          // Flags
+    PutShort(zip,entry.m_deflate ? 8 : 0);    // Method
+    PutLong (zip,0);                          // DOS time and date
+    PutLong (zip,crc);
+    PutLong (zip,(DWORD)data.size());
+    PutLong (zip,(DWORD)entry.m_content.size());
+    PutShort(zip,(unsigned)entry.m_name.size());
+    PutShort(zip,0);                          // Extra field
+    zip += entry.m_name;
+    zip += data;
+
+    // Central directory record
+    PutLong (directory,0x02014b50);
+    PutShort(directory,20);                   // Version made by
+    PutShort(directory,20);                   // Version needed
+    PutShort(directory,0);
+    PutShort(directory,entry.m_deflate ? 8 : 0);
+    PutLong (directory,0);
+    PutLong (directory,crc);
+    PutLong (directory,(DWORD)data.size());
+    PutLong (directory,(DWORD)entry.m_content.size());
+    PutShort(directory,(unsigned)entry.m_name.size());
+    PutShort(directory,0);                    // Extra field
+    PutShort(directory,0);                    // Comment
+    PutShort(directory,0);                    // Disk number
+    PutShort(directory,0);                    // Internal attributes
+    PutLong (directory,0);                    // External attributes
+    PutLong (directory,offset);
+    directory += entry.m_name;
+  }
+  DWORD dirOffset = (DWORD)zip.size();
+  zip += directory;
+
+  // End of central directory
+  PutLong (zip,0x06054b50);
+  PutShort(zip,0);
+  PutShort(zip,0);
+  PutShort(zip,(unsigned)p_entries.size());
+  PutShort(zip,(unsigned)p_entries.size());
+  PutLong (zip,(DWORD)directory.size());
+  PutLong (zip,dirOffset);
+  PutShort(zip,0);
+
+  FILE* file = nullptr;
+  if(_tfopen_s(&file,p_filename,_T("wb")) || file == nullptr)
+  {
+    return false;
+  }
+  bool written = fwrite(zip.data(),1,zip.size(),file) == zip.size();
+  fclose(file);
+  return written;
+}
+
+// Content of an entry as one string
+static bool
+GetZipContent(ZipWebroot& p_root,XString p_name,bool p_gzip,std::string& p_content,bool& p_encoded)
+{
+  BufferChain chain;
+  if(!p_root.GetContent(p_name,p_gzip,chain,p_encoded))
+  {
+    return false;
+  }
+  p_content.resize((size_t)chain.GetLength());
+  return chain.CopyTo((uchar*)p_content.data());
+}
+
+int
+TestMarlinServer::TestZipWebroot()
+{
+  xprintf(_T("TESTING SITE CONTENT FROM A ZIP ARCHIVE\n"));
+  xprintf(_T("=======================================\n"));
+
+  std::string script;
+  std::string style;
+  for(int index = 0; index < 1000; ++index)
+  {
+    script += "console.log('Marlin from ZIP');\n";
+  }
+  for(int index = 0; index < 4000; ++index)
+  {
+    style += "div.marlin { color: blue; }\n";
+  }
+  std::vector<ZipTestEntry> entries;
+  entries.push_back({ "index.html",     "<html><body>Marlin from ZIP</body></html>", false });
+  entries.push_back({ "Scripts/App.js", script, true });
+  entries.push_back({ "big.css",        style,  true });
+
+  TCHAR temp[MAX_PATH + 1];
+  GetTempPath(MAX_PATH,temp);
+  XString archive = XString(temp) + _T("MarlinZipWebroot.zip");
+  if(!WriteZipArchive(archive,entries))
+  {
+    xerror();
+    qprintf(_T("Cannot write ZIP archive: %s\n"),archive.GetString());
+    return totalChecks;
+  }
+
+  {
+    ZipWebroot root(archive,ZIPTEST_CACHE);
+
+    // 1: Open and index the archive
+    bool ok = root.Open() && root.GetNumberOfEntries() == 3;
+    // --- "---------------------------------------------- - ------
+    qprintf(_T("ZIP webroot opened and indexed                 : %s\n"),ok ? _T("OK") : _T("ERROR"));
+    if(ok)
+    {
+      --totalChecks;
+    }
+
+    // 2: Stored entry, found without regard to case or leading slash
+    std::string content;
+    bool encoded = true;
+    ok = GetZipContent(root,_T("/INDEX.html"),true,content,encoded) && !encoded && content == entries[0].m_content;
+    BufferChain missing;
+    ok = ok && !root.GetContent(_T("missing.html"),false,missing,encoded);
+    qprintf(_T("ZIP webroot stored entry                       : %s\n"),ok ? _T("OK") : _T("ERROR"));
+    if(ok)
+    {
+      --totalChecks;
+    }
+
+    // 3: Deflated entry as a gzip stream
+    std::vector<uint8_t> inflated;
+    ok = GetZipContent(root,_T("scripts/app.js"),true,content,encoded) && encoded &&
+         gzip_decompress_memory((void*)content.data(),content.size(),inflated) &&
+         std::string(inflated.begin(),inflated.end()) == script;
+    qprintf(_T("ZIP webroot deflated entry as gzip             : %s\n"),ok ? _T("OK") : _T("ERROR"));
+    if(ok)
+    {
+      --totalChecks;
+    }
+
+    // 4: Inflated entries: small ones are cached, too big ones are not
+    ok = GetZipContent(root,_T("scripts/app.js"),false,content,encoded) && !encoded && content == script &&
+         GetZipContent(root,_T("scripts/app.js"),false,content,encoded) && content == script &&
+         root.GetCachedBytes() == script.size() &&
+         GetZipContent(root,_T("big.css"),false,content,encoded) && content == style &&
+         root.GetCachedBytes() == script.size();
+    qprintf(_T("ZIP webroot inflated entries in bounded cache  : %s\n"),ok ? _T("OK") : _T("ERROR"));
+    if(ok)
+    {
+      --totalChecks;
+    }
+
+    // 5: Content taken before a Close (site stopping) stays readable
+    BufferChain taken;
+    ok = root.GetContent(_T("index.html"),false,taken,encoded);
+    root.Close();
+    content.resize((size_t)taken.GetLength());
+    ok = ok && taken.CopyTo((uchar*)content.data()) && content == entries[0].m_content &&
+         !root.GetContent(_T("index.html"),false,missing,encoded) && root.Open();
+    qprintf(_T("ZIP webroot content outlives closing the site  : %s\n"),ok ? _T("OK") : _T("ERROR"));
+    if(ok)
+    {
+      --totalChecks;
+    }
+  }
+
+  // The archive as the webroot of a site
+  XString url(_T("/MarlinTest/Zip/"));
+  HTTPSite* site = m_httpServer->CreateSite(PrefixType::URLPRE_Strong,false,m_inPortNumber,url);
+  if(site == nullptr)
+  {
+    xerror();
+    qprintf(_T("ERROR: Cannot make a HTTP site for: %s\n"),url.GetString());
+    return totalChecks;
+  }
+  site->SetHandler(HTTPCommand::http_get,new SiteHandlerGetZipTest(archive));
+  if(site->StartSite())
+  {
+    xprintf(_T("Site started correctly: %s\n"),url.GetString());
+  }
+  else
+  {
+    xerror();
+    qprintf(_T("ERROR STARTING SITE: %s\n"),url.GetString());
+  }
+  return totalChecks;
+}
+
+int
+TestMarlinServer::AfterTestZipWebroot()
+{
+  // SUMMARY OF THE TEST
+  // ---- "---------------------------------------------- - ------
+  qprintf(_T("Site content from a ZIP archive                : %s\n"),totalChecks > 0 ? _T("ERROR") : _T("OK"));
+  return totalChecks > 0;
+}
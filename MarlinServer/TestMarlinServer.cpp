@@ -466,6 +466,7 @@ TestMarlinServer::RegisterSiteHandlers()
   TestEventDriver();
   TestFilter();
   TestFormData();
+  TestFragmentCache();
   // Sites
   TestInsecure();
   TestSecureSite       (m_runAsService != RUNAS_IISAPPPOOL);
@@ -474,14 +475,25 @@ TestMarlinServer::RegisterSiteHandlers()
   TestPatch();
   TestChunking();
   TestCompression();
+  TestConversion();
+  TestSOAPBinding();
   TestMessageEncryption();
+  TestMetrics();
   TestReliable();
   TestReliableBA();
+  TestReliableWindow();
+  TestRequestQueue(m_runAsService != RUNAS_IISAPPPOOL);
+  TestOAuth2Cache (m_runAsService != RUNAS_IISAPPPOOL);
   TestSubSites();
   TestThreadPool(m_pool);
+  TestPoolSizing(m_runAsService != RUNAS_IISAPPPOOL);
+  TestPriority  (m_runAsService != RUNAS_IISAPPPOOL);
+  TestCommandBus(m_runAsService != RUNAS_IISAPPPOOL);
+  TestConfigReload(m_runAsService != RUNAS_IISAPPPOOL);
   TestHTTPTime();
   TestToken();
   TestWebSocket();
+  TestZipWebroot();
 }
 
 // Perform all after test reporting
@@ -499,6 +511,7 @@ TestMarlinServer::AfterTests()
   AfterTestEvents();
   AfterTestFilter();
   AfterTestFormData();
+  AfterTestFragmentCache();
   AfterTestInsecure();
   AfterTestSecureSite();
   AfterTestClientCert();
@@ -506,11 +519,21 @@ TestMarlinServer::AfterTests()
   AfterTestPatch();
   AfterTestChunking();
   AfterTestCompression();
+  AfterTestConversion();
+  AfterTestSOAPBinding();
   AfterTestMessageEncryption();
+  AfterTestMetrics();
   AfterTestReliable();
+  AfterTestRequestQueue();
+  AfterTestOAuth2Cache();
   AfterTestSubSites();
   AfterTestThreadpool();
+  AfterTestPoolSizing();
+  AfterTestPriority();
+  AfterTestCommandBus();
+  AfterTestConfigReload();
   AfterTestHTTPTime();
   AfterTestToken();
   AfterTestWebSocket();
+  AfterTestZipWebroot();
 }
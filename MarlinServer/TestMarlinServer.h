@@ -103,19 +103,31 @@ private:
   int TestBodyEncryption();
   int TestBodySigning();
   int TestChunking();
+  int TestCommandBus(bool p_standalone);
+  int TestConfigReload(bool p_standalone);
+  void TestConfigListeners();
   int TestCompression();
+  int TestConversion();
   int TestCookies();
   int TestCrackURL();
   int TestPushEvents();
   int TestFilter();
   int TestFormData();
+  int TestFragmentCache();
   int TestInsecure();
   int TestJsonData();
   int TestMessageEncryption();
+  int TestMetrics();
   int TestPatch();
+  int TestPoolSizing(bool p_standalone);
+  int TestPriority(bool p_standalone);
   int TestReliable();
   int TestReliableBA();
+  int TestReliableWindow();
+  int TestRequestQueue(bool p_standalone);
+  int TestOAuth2Cache(bool p_standalone);
   int TestSecureSite(bool p_standalone);
+  int TestSOAPBinding();
   int TestClientCertificate(bool p_standalone);
   int TestSubSites();
   int TestThreadPool(ThreadPool* p_pool);
@@ -123,6 +135,7 @@ private:
   int TestToken();
   int TestWebSocket();
   int TestEventDriver();
+  int TestZipWebroot();
 
   // AFTER THE TEST
   int  StopSubsites();
@@ -135,25 +148,36 @@ private:
   int AfterTestBodySigning();
   int AfterTestClientCert();
   int AfterTestChunking();
+  int AfterTestCommandBus();
+  int AfterTestConfigReload();
   int AfterTestCompression();
   int AfterTestContract();
+  int AfterTestConversion();
+  int AfterTestSOAPBinding();
   int AfterTestCookies();
   int AfterTestCrackURL();
   int AfterTestEvents();
   int AfterTestEventDriver();
   int AfterTestFilter();
   int AfterTestFormData();
+  int AfterTestFragmentCache();
   int AfterTestInsecure();
   int AfterTestJsonData();
   int AfterTestMessageEncryption();
+  int AfterTestMetrics();
   int AfterTestPatch();
+  int AfterTestPoolSizing();
+  int AfterTestPriority();
   int AfterTestReliable();
+  int AfterTestRequestQueue();
+  int AfterTestOAuth2Cache();
   int AfterTestSecureSite();
   int AfterTestSubSites();
   int AfterTestThreadpool();
   int AfterTestHTTPTime();
   int AfterTestToken();
   int AfterTestWebSocket();
+  int AfterTestZipWebroot();
 
   // SERVICE TESTING OnMarlin.....
   XString Translation(XString p_language, XString p_translation, XString p_word);
@@ -32,4 +32,6 @@
 // All tests running on these ports in Marlin Standalone
 const int TESTING_HTTP_PORT   = 1200;
 const int TESTING_HTTPS_PORT  = 1201;   // Port + 1
-const int TESTING_CLCERT_PORT = 1202;   // Port + 2
\ No newline at end of file
+const int TESTING_CLCERT_PORT = 1202;   // Port + 2
+const int TESTING_QUEUE_PORT  = 1203;   // Port + 3: Request queue benchmark
+const int TESTING_OAUTH_PORT  = 1204;   // Port + 4: Stand-in OAuth2 token server
\ No newline at end of file